@@ -880,7 +880,7 @@ cupsCMYKDoRGB(const cups_cmyk_t   *cmyk,
 	  k  = min(c, min(m, y));
 
 	  if ((km = max(c, max(m, y))) > k)
-            k = k * k * k / (km * km);
+            k = (int)((k * k * k * cmyk->black_mult[km]) >> 40);
 
 	  kc = cmyk->color_lut[k] - k;
 	  k  = cmyk->black_lut[k];
@@ -925,7 +925,7 @@ cupsCMYKDoRGB(const cups_cmyk_t   *cmyk,
 	  k  = min(c, min(m, y));
 
 	  if ((km = max(c, max(m, y))) > k)
-            k = k * k * k / (km * km);
+            k = (int)((k * k * k * cmyk->black_mult[km]) >> 40);
 
 	  kc = cmyk->color_lut[k] - k;
 	  k  = cmyk->black_lut[k];
@@ -975,7 +975,7 @@ cupsCMYKDoRGB(const cups_cmyk_t   *cmyk,
 	  k  = min(c, min(m, y));
 
 	  if ((km = max(c, max(m, y))) > k)
-            k = k * k * k / (km * km);
+            k = (int)((k * k * k * cmyk->black_mult[km]) >> 40);
 
 	  kc = cmyk->color_lut[k] - k;
 	  k  = cmyk->black_lut[k];
@@ -1639,6 +1639,15 @@ cupsCMYKNew(int num_channels)		/* I - Number of color components */
   for (i = 0; i < 256; i ++)
     cmyk->black_lut[i] = i;
 
+ /*
+  * Black generation divides k^3 by max(c,m,y)^2; multiplying by the
+  * rounded-up reciprocal and shifting gives the same quotient for all
+  * k^3 < 2^24...
+  */
+
+  for (i = 1; i < 256; i ++)
+    cmyk->black_mult[i] = ((1ULL << 40) + i * i - 1) / (i * i);
+
   switch (num_channels)
   {
     case 1 : /* K */
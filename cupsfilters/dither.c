@@ -11,9 +11,22 @@
  *
  * Contents:
  *
- *   cupsDitherDelete() - Free a dithering buffer.
- *   cupsDitherLine()   - Dither a line of pixels...
- *   cupsDitherNew()    - Create a dithering buffer.
+ *   cupsDitherBand()       - Dither a band of lines for all channels.
+ *   cupsDitherBandDelete() - Stop the dither threads and free the state.
+ *   cupsDitherBandNew()    - Create a multi-channel dithering state.
+ *   cupsDitherDelete()     - Free a dithering buffer.
+ *   cupsDitherLine()       - Dither a line of pixels...
+ *   cupsDitherNew()        - Create a dithering buffer.
+ *   dither_ltr()           - Error diffuse pixels from left to right.
+ *   dither_mask_init()     - Make the blue noise threshold matrix.
+ *   dither_mask_update()   - Add or remove a dot of the blue noise pattern.
+ *   dither_rand()          - Return the next number of a random sequence.
+ *   dither_range()         - Return the randomness for an error value.
+ *   dither_row()           - Error diffuse a line, alternating directions.
+ *   dither_rtl()           - Error diffuse pixels from right to left.
+ *   dither_seed()          - Return the random seed for a line.
+ *   dither_task()          - Dither one part of a band.
+ *   dither_thread()        - Dither parts of bands.
  */
 
 /*
@@ -22,6 +35,450 @@
 
 #include <config.h>
 #include "driver.h"
+#include <string.h>
+#ifdef HAVE_PTHREAD_H
+#  include <pthread.h>
+#  include <sched.h>
+#endif /* HAVE_PTHREAD_H */
+
+
+/*
+ * Constants...
+ */
+
+#define DITHER_CHUNK	256		/* Pixels between wavefront updates */
+#define DITHER_MASK	64		/* Size of blue noise matrix */
+#define DITHER_THREADS	16		/* Maximum number of dither threads */
+
+/*
+ * Rows of a wavefront band can only overlap with atomic progress
+ * counters; other compilers dither the rows one after the other...
+ */
+
+#if defined(HAVE_PTHREAD_H) && defined(__GNUC__)
+#  define DITHER_WAVEFRONT_THREADS
+#  define DITHER_GET(v)		__atomic_load_n(&(v), __ATOMIC_ACQUIRE)
+#  define DITHER_SET(v,x)	__atomic_store_n(&(v), (x), __ATOMIC_RELEASE)
+#else
+#  define DITHER_GET(v)		(v)
+#  define DITHER_SET(v,x)	(v) = (x)
+#endif /* HAVE_PTHREAD_H && __GNUC__ */
+
+
+/*
+ * Types...
+ */
+
+typedef struct cups_dither_thr_s	/**** Threshold for an intensity ****/
+{
+  unsigned char	lo,			/* Pixel below the intensity */
+		hi;			/* Pixel above the intensity */
+  unsigned short frac;			/* Position between them (0-256) */
+} cups_dither_thr_t;
+
+struct cups_dither_band_s		/**** Multi-channel dithering state ****/
+{
+  int		width,			/* Width of lines */
+		num_channels,		/* Number of color channels */
+		mode,			/* Dithering mode */
+		y;			/* First line of the current band */
+  const cups_lut_t *luts[CUPS_MAX_CHAN];/* Lookup tables */
+  cups_dither_t	*states[CUPS_MAX_CHAN];	/* Serpentine error buffers */
+  int		*errors;		/* Wavefront error lines */
+  int		*progress;		/* Pixels done for each wavefront line */
+  int		max_lines;		/* Lines of the error buffers */
+  cups_dither_thr_t *thresholds;	/* Blue noise thresholds */
+  const short	*data;			/* Separation data of band */
+  unsigned char	* const *planes;	/* Output pixels of band */
+  int		num_lines,		/* Lines in band */
+		num_tasks,		/* Parts of band */
+		next_task,		/* Next part to dither */
+		done_tasks;		/* Parts dithered */
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t mutex;		/* Mutex for the band */
+  pthread_cond_t cond;			/* Band state changed */
+  int		num_threads;		/* Number of threads */
+  pthread_t	threads[DITHER_THREADS];/* Threads */
+  int		generation,		/* Current band number */
+		shutdown;		/* Stop the threads? */
+#endif /* HAVE_PTHREAD_H */
+};
+
+
+/*
+ * Local globals...
+ */
+
+static const signed char dither_small[16] =
+{					/* Randomness for errors 0-15 */
+  0, -3, -2, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+static const signed char dither_large[128] =
+{					/* Randomness for errors 16-2047 */
+  0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4,
+  5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+  6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+  6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+  7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+  7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+  7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+  7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7
+};
+static unsigned char	dither_mask[DITHER_MASK][DITHER_MASK];
+					/* Blue noise threshold matrix */
+#ifdef HAVE_PTHREAD_H
+static pthread_once_t	dither_mask_once = PTHREAD_ONCE_INIT;
+#else
+static int		dither_mask_done = 0;
+#endif /* HAVE_PTHREAD_H */
+
+
+/*
+ * Local functions...
+ */
+
+static void	dither_ltr(const cups_lut_t *lut, const short *data,
+		           int num_channels, unsigned char *p, int count,
+			   int *p0, int *p1, int *carry, unsigned *rng);
+static void	dither_mask_init(void);
+static void	dither_mask_update(float *energy, unsigned char *dots,
+		                   const float *weights, int radius, int index,
+				   int dot);
+static void	dither_row(cups_dither_t *d, const cups_lut_t *lut,
+		           const short *data, int num_channels,
+			   unsigned char *p, unsigned *rng);
+static void	dither_rtl(const cups_lut_t *lut, const short *data,
+		           int num_channels, unsigned char *p, int count,
+			   int *p0, int *p1, int *carry, unsigned *rng);
+static unsigned	dither_seed(int channel, int y);
+static void	dither_task(cups_dither_band_t *b, int task);
+#ifdef HAVE_PTHREAD_H
+static void	*dither_thread(void *data);
+#endif /* HAVE_PTHREAD_H */
+
+
+/*
+ * 'cupsDitherBand()' - Dither a band of lines for all channels.
+ *
+ * "data" holds "num_lines" lines of interleaved separation data for all
+ * channels, the dithered pixels of channel N go to "planes[N]", one line
+ * of "width" pixels after the other.  The lines are dithered on all
+ * threads of the state; the pixels do not depend on the number of
+ * threads.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+
+int					/* O - 0 on success, -1 on failure */
+cupsDitherBand(cups_dither_band_t   *b,	/* I - Dither state */
+               const short          *data,
+					/* I - Separation data */
+	       int                  num_lines,
+					/* I - Number of lines */
+	       unsigned char * const *planes)
+					/* O - Pixels for each channel */
+{
+  int		c,			/* Current channel */
+		task;			/* Current part of band */
+  size_t	linesize;		/* Size of an error line */
+  int		*errors,		/* New error lines */
+		*progress;		/* New progress counters */
+
+
+  if (!b || !data || !planes || num_lines <= 0)
+    return (-1);
+
+  linesize = b->width + 4;
+
+  if (b->mode == CUPS_DITHER_WAVEFRONT)
+  {
+    if (num_lines > b->max_lines)
+    {
+     /*
+      * Make room for the error lines of the band, keeping the errors of
+      * the last line of the previous band...
+      */
+
+      errors   = calloc((size_t)b->num_channels * (num_lines + 1) * linesize,
+                        sizeof(int));
+      progress = calloc((size_t)b->num_channels * num_lines, sizeof(int));
+
+      if (!errors || !progress)
+      {
+        free(errors);
+	free(progress);
+        return (-1);
+      }
+
+      for (c = 0; c < b->num_channels; c ++)
+        memcpy(errors + c * (num_lines + 1) * linesize,
+	       b->errors + c * (b->max_lines + 1) * linesize,
+	       linesize * sizeof(int));
+
+      free(b->errors);
+      free(b->progress);
+
+      b->errors    = errors;
+      b->progress  = progress;
+      b->max_lines = num_lines;
+    }
+
+    memset(b->progress, 0, (size_t)b->num_channels * num_lines * sizeof(int));
+  }
+
+ /*
+  * Diffusion dithers each channel on its own, the other modes each line
+  * of each channel...
+  */
+
+  b->data       = data;
+  b->planes     = planes;
+  b->num_lines  = num_lines;
+  b->num_tasks  = b->num_channels;
+  b->next_task  = 0;
+  b->done_tasks = 0;
+
+  if (b->mode != CUPS_DITHER_DIFFUSE)
+    b->num_tasks *= num_lines;
+
+#ifdef HAVE_PTHREAD_H
+  if (b->num_threads > 0)
+  {
+    pthread_mutex_lock(&b->mutex);
+    b->generation ++;
+    pthread_cond_broadcast(&b->cond);
+
+    while (b->next_task < b->num_tasks)
+    {
+      task = b->next_task ++;
+
+      pthread_mutex_unlock(&b->mutex);
+      dither_task(b, task);
+      pthread_mutex_lock(&b->mutex);
+
+      b->done_tasks ++;
+    }
+
+    while (b->done_tasks < b->num_tasks)
+      pthread_cond_wait(&b->cond, &b->mutex);
+
+    pthread_mutex_unlock(&b->mutex);
+  }
+  else
+#endif /* HAVE_PTHREAD_H */
+  for (task = 0; task < b->num_tasks; task ++)
+    dither_task(b, task);
+
+ /*
+  * The errors of the last line are the input of the next band...
+  */
+
+  if (b->mode == CUPS_DITHER_WAVEFRONT)
+    for (c = 0; c < b->num_channels; c ++)
+    {
+      errors = b->errors + c * (b->max_lines + 1) * linesize;
+      memcpy(errors, errors + num_lines * linesize, linesize * sizeof(int));
+    }
+
+  b->y += num_lines;
+
+  return (0);
+}
+
+
+/*
+ * 'cupsDitherBandDelete()' - Stop the dither threads and free the state.
+ */
+
+void
+cupsDitherBandDelete(
+    cups_dither_band_t *b)		/* I - Dither state */
+{
+  int	i;				/* Looping var */
+
+
+  if (!b)
+    return;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&b->mutex);
+  b->shutdown = 1;
+  pthread_cond_broadcast(&b->cond);
+  pthread_mutex_unlock(&b->mutex);
+
+  for (i = 0; i < b->num_threads; i ++)
+    pthread_join(b->threads[i], NULL);
+
+  pthread_cond_destroy(&b->cond);
+  pthread_mutex_destroy(&b->mutex);
+#endif /* HAVE_PTHREAD_H */
+
+  for (i = 0; i < b->num_channels; i ++)
+    cupsDitherDelete(b->states[i]);
+
+  free(b->errors);
+  free(b->progress);
+  free(b->thresholds);
+  free(b);
+}
+
+
+/*
+ * 'cupsDitherBandNew()' - Create a multi-channel dithering state.
+ *
+ * CUPS_DITHER_DIFFUSE does the error diffusion of cupsDitherLine() with a
+ * random sequence for each line, so the channels are dithered in
+ * parallel.  CUPS_DITHER_WAVEFRONT diffuses all lines from left to right,
+ * so that a line can start once the line above is a few pixels ahead.
+ * CUPS_DITHER_BLUENOISE compares the pixels against a blue noise matrix
+ * and has no dependencies between pixels at all.
+ *
+ * "num_threads" is the number of threads to use, 0 for one per processor.
+ */
+
+cups_dither_band_t *			/* O - New state or NULL on error */
+cupsDitherBandNew(
+    int              width,		/* I - Width of output in pixels */
+    int              num_channels,	/* I - Number of color channels */
+    const cups_lut_t * const *luts,	/* I - Lookup table for each channel */
+    int              mode,		/* I - Dithering mode */
+    int              num_threads)	/* I - Number of threads */
+{
+  cups_dither_band_t	*b;		/* New dithering state */
+  cups_dither_thr_t	*thr;		/* Thresholds for a channel */
+  int			c, i,		/* Looping vars */
+			pixel,		/* Pixel value */
+			lo, hi,		/* Levels around intensity */
+			num_levels;	/* Number of levels */
+  int			levels[256],	/* Intensity of each pixel value */
+			pixels[256];	/* Pixel values in use */
+
+
+  if (width <= 0 || num_channels <= 0 || num_channels > CUPS_MAX_CHAN ||
+      !luts || mode < CUPS_DITHER_DIFFUSE || mode > CUPS_DITHER_BLUENOISE)
+    return (NULL);
+
+  if ((b = calloc(1, sizeof(cups_dither_band_t))) == NULL)
+    return (NULL);
+
+  b->width        = width;
+  b->num_channels = num_channels;
+  b->mode         = mode;
+
+  for (c = 0; c < num_channels; c ++)
+    b->luts[c] = luts[c];
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_init(&b->mutex, NULL);
+  pthread_cond_init(&b->cond, NULL);
+#endif /* HAVE_PTHREAD_H */
+
+  switch (mode)
+  {
+    case CUPS_DITHER_DIFFUSE :
+        for (c = 0; c < num_channels; c ++)
+	  if ((b->states[c] = cupsDitherNew(width)) == NULL)
+	  {
+	    cupsDitherBandDelete(b);
+	    return (NULL);
+	  }
+        break;
+
+    case CUPS_DITHER_WAVEFRONT :
+        if ((b->errors = calloc((size_t)num_channels * (width + 4),
+	                        sizeof(int))) == NULL)
+	{
+	  cupsDitherBandDelete(b);
+	  return (NULL);
+	}
+        break;
+
+    case CUPS_DITHER_BLUENOISE :
+#ifdef HAVE_PTHREAD_H
+        pthread_once(&dither_mask_once, dither_mask_init);
+#else
+        if (!dither_mask_done)
+	{
+	  dither_mask_init();
+	  dither_mask_done = 1;
+	}
+#endif /* HAVE_PTHREAD_H */
+
+        if ((b->thresholds = calloc((size_t)num_channels * (CUPS_MAX_LUT + 1),
+	                            sizeof(cups_dither_thr_t))) == NULL)
+	{
+	  cupsDitherBandDelete(b);
+	  return (NULL);
+	}
+
+       /*
+        * Find the intensity of each pixel value from the errors of the
+	* lookup table, and the two pixel values around each intensity...
+	*/
+
+        for (c = 0; c < num_channels; c ++)
+	{
+	  for (i = 0; i < 256; i ++)
+	    levels[i] = -1;
+
+          for (i = 0; i <= CUPS_MAX_LUT; i ++)
+	    if ((pixel = luts[c][i].pixel) >= 0 && pixel < 256 &&
+	        levels[pixel] < 0)
+	      levels[pixel] = i - luts[c][i].error;
+
+          for (i = 0, num_levels = 0; i < 256; i ++)
+	    if (levels[i] >= 0)
+	      pixels[num_levels ++] = i;
+
+          thr = b->thresholds + c * (CUPS_MAX_LUT + 1);
+
+	  for (i = 0, lo = 0; i <= CUPS_MAX_LUT; i ++)
+	  {
+	    while (lo + 1 < num_levels && levels[pixels[lo + 1]] <= i)
+	      lo ++;
+
+	    hi = lo + 1 < num_levels ? lo + 1 : lo;
+
+	    thr[i].lo = pixels[lo];
+	    thr[i].hi = pixels[hi];
+
+	    if (levels[pixels[hi]] > levels[pixels[lo]])
+	      thr[i].frac = 256 * (i - levels[pixels[lo]]) /
+	                    (levels[pixels[hi]] - levels[pixels[lo]]);
+	  }
+	}
+        break;
+  }
+
+ /*
+  * Start the threads; the calling thread dithers as well...
+  */
+
+#ifdef HAVE_PTHREAD_H
+  if (num_threads <= 0)
+    num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+#  ifndef DITHER_WAVEFRONT_THREADS
+  if (mode == CUPS_DITHER_WAVEFRONT)
+    num_threads = 1;
+#  endif /* !DITHER_WAVEFRONT_THREADS */
+
+  if (num_threads > DITHER_THREADS)
+    num_threads = DITHER_THREADS;
+
+  for (i = 0; i < num_threads - 1; i ++)
+  {
+    if (pthread_create(b->threads + i, NULL, dither_thread, b))
+      break;
+
+    b->num_threads ++;
+  }
+#else
+  (void)num_threads;
+#endif /* HAVE_PTHREAD_H */
+
+  return (b);
+}
 
 
 /*
@@ -50,8 +507,96 @@ cupsDitherLine(cups_dither_t    *d,	/* I - Dither data */
 					/* I - Number of components */
 	       unsigned char    *p)	/* O - Pixels */
 {
-  register int	x,			/* Horizontal position in line... */
-		pixel,			/* Current adjusted pixel... */
+  dither_row(d, lut, data, num_channels, p, NULL);
+}
+
+
+/*
+ * 'cupsDitherNew()' - Create an error-diffusion dithering buffer.
+ */
+
+cups_dither_t *			/* O - New state array */
+cupsDitherNew(int width)	/* I - Width of output in pixels */
+{
+  cups_dither_t	*d;		/* New dithering buffer */
+
+
+  if ((d = (cups_dither_t *)calloc(1, sizeof(cups_dither_t) +
+                                   2 * (width + 4) *
+				       sizeof(int))) == NULL)
+    return (NULL);
+
+  d->width = width;
+
+  return (d);
+}
+
+
+/*
+ * 'dither_rand()' - Return the next number of a random sequence.
+ */
+
+static inline unsigned			/* O - Random number */
+dither_rand(unsigned *rng)		/* IO - Random state */
+{
+  unsigned	x = *rng;		/* Random state */
+
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+
+  return (*rng = x);
+}
+
+
+/*
+ * 'dither_range()' - Return the randomness for an error value.
+ *
+ * This is about log2(e) - 3; errors larger than 2048 get no randomness.
+ */
+
+static inline int			/* O - Randomness */
+dither_range(int e)			/* I - Error value */
+{
+  if (e < 0)
+    e = -e;
+
+  if (e < 16)
+    return (dither_small[e]);
+  else if (e < 2048)
+    return (dither_large[e >> 4]);
+  else if (e == 2048)
+    return (8);
+  else
+    return (0);
+}
+
+
+/*
+ * 'dither_ltr()' - Error diffuse pixels from left to right.
+ *
+ *       e0   ==        p0[0]
+ *    e1 e2   == p1[-1] p1[0]
+ *
+ * "carry" holds e0, e1, and e2 between calls, so a line can be dithered
+ * in pieces.  The error is randomized with CUPS_RAND() when "rng" is
+ * NULL.
+ */
+
+static void
+dither_ltr(const cups_lut_t *lut,	/* I - Lookup table */
+	   const short      *data,	/* I - Separation data */
+	   int              num_channels,
+					/* I - Number of components */
+	   unsigned char    *p,		/* O - Pixels */
+	   int              count,	/* I - Number of pixels */
+	   int              *p0,	/* I - Errors of this line */
+	   int              *p1,	/* O - Errors for the next line */
+	   int              *carry,	/* IO - Errors between pixels */
+	   unsigned         *rng)	/* IO - Random state or NULL */
+{
+  register int	pixel,			/* Current adjusted pixel... */
 		e,			/* Current error */
 		e0,e1,e2;		/* Error values */
   register int	errval0,		/* First half of error value */
@@ -60,240 +605,654 @@ cupsDitherLine(cups_dither_t    *d,	/* I - Dither data */
 		errbase0,		/* Base multiplier for large values */
 		errbase1,		/* Base multiplier for small values */
 		errrange;		/* Range of random multiplier */
-  register int	*p0,			/* Error buffer pointers... */
-		*p1;
-  static char	logtable[16384];	/* Error magnitude for randomness */
-  static char	loginit = 0;		/* Has the table been initialized? */
 
 
-  if (!loginit)
+  e0 = carry[0];
+  e1 = carry[1];
+  e2 = carry[2];
+
+ /*
+  * Error diffuse each output pixel...
+  */
+
+  for (;
+       count > 0;
+       count --, p0 ++, p1 ++, p ++, data += num_channels)
   {
    /*
-    * Initialize a logarithmic table for the magnitude of randomness
-    * that is introduced.
+    * Skip blank pixels...
     */
 
-    loginit = 1;
+    if (*data == 0)
+    {
+      *p     = 0;
+      e0     = p0[1];
+      p1[-1] = e1;
+      e1     = e2;
+      e2     = 0;
+      continue;
+    }
 
-    logtable[0] = 0;
-    for (x = 1; x < 2049; x ++)
-      logtable[x] = (int)(log(x / 16.0) / log(2.0) + 1.0);
-    for (; x < 16384; x ++)
-      logtable[x] = logtable[2049];
-  }
+   /*
+    * Compute the net pixel brightness and brightness error.  Set a dot
+    * if necessary...
+    */
+
+    pixel = lut[*data].intensity + e0 / 128;
+
+    if (pixel > CUPS_MAX_LUT)
+      pixel = CUPS_MAX_LUT;
+    else if (pixel < 0)
+      pixel = 0;
+
+    *p = lut[pixel].pixel;
+    e  = lut[pixel].error;
 
-  if (d->row == 0)
-  {
    /*
-    * Dither from left to right:
-    *
-    *       e0   ==        p0[0]
-    *    e1 e2   == p1[-1] p1[0]
+    * Set the randomness factor...
     */
 
-    p0 = d->errors + 2;
-    p1 = d->errors + 2 + d->width + 4;
-    e0 = p0[0];
-    e1 = 0;
-    e2 = 0;
+    errrange = dither_range(e);
+    errbase  = 8 - errrange;
+    errrange = errrange * 2 + 1;
 
    /*
-    * Error diffuse each output pixel...
+    * Randomize the error value.
     */
 
-    for (x = d->width;
-	 x > 0;
-	 x --, p0 ++, p1 ++, p ++, data += num_channels)
+    if (errrange <= 1)
+      errbase0 = errbase1 = errbase;
+    else if (rng)
     {
-     /*
-      * Skip blank pixels...
-      */
+      errbase0 = errbase +
+                 (int)(((unsigned long long)dither_rand(rng) * errrange) >> 32);
+      errbase1 = errbase +
+                 (int)(((unsigned long long)dither_rand(rng) * errrange) >> 32);
+    }
+    else
+    {
+      errbase0 = errbase + (CUPS_RAND() % errrange);
+      errbase1 = errbase + (CUPS_RAND() % errrange);
+    }
 
-      if (*data == 0)
-      {
-        *p     = 0;
-	e0     = p0[1];
-	p1[-1] = e1;
-	e1     = e2;
-	e2     = 0;
-	continue;
-      }
+   /*
+    *       X   7/16 =    X  e0
+    * 3/16 5/16 1/16 =    e1 e2
+    */
 
-     /*
-      * Compute the net pixel brightness and brightness error.  Set a dot
-      * if necessary...
-      */
+    errval0 = errbase0 * e;
+    errval1 = (16 - errbase0) * e;
+    e0      = p0[1] + 7 * errval0;
+    e1      = e2 + 5 * errval1;
 
-      pixel = lut[*data].intensity + e0 / 128;
+    errval0 = errbase1 * e;
+    errval1 = (16 - errbase1) * e;
+    e2      = errval0;
+    p1[-1]  = e1 + 3 * errval1;
+  }
 
-      if (pixel > CUPS_MAX_LUT)
-	pixel = CUPS_MAX_LUT;
-      else if (pixel < 0)
-	pixel = 0;
+  carry[0] = e0;
+  carry[1] = e1;
+  carry[2] = e2;
+}
 
-      *p = lut[pixel].pixel;
-      e  = lut[pixel].error;
 
-     /*
-      * Set the randomness factor...
-      */
+/*
+ * 'dither_mask_init()' - Make the blue noise threshold matrix.
+ *
+ * This is the void-and-cluster method: a random pattern is first
+ * relaxed by moving dots from the tightest cluster to the largest void,
+ * then dots are ranked by removing them from the tightest clusters and
+ * adding them to the largest voids.  The matrix wraps around, so it tiles
+ * without seams.
+ */
 
-      if (e > 0)
-        errrange = logtable[e];
-      else
-        errrange = logtable[-e];
+static void
+dither_mask_init(void)
+{
+  int		i, j,			/* Looping vars */
+		x, y,			/* Position in matrix */
+		count,			/* Number of dots */
+		best;			/* Tightest cluster or largest void */
+  int		*ranks;			/* Rank of each position */
+  unsigned char	*dots,			/* Current pattern */
+		*proto;			/* Relaxed initial pattern */
+  float		*energy,		/* Dot density around each position */
+		*proto_energy;		/* Density of initial pattern */
+  float		weights[13 * 13];	/* Gaussian filter */
+  unsigned	rng = 0x2545f491;	/* Random state */
+  const int	size = DITHER_MASK * DITHER_MASK,
+					/* Positions in matrix */
+		radius = 6;		/* Radius of filter */
 
-      errbase  = 8 - errrange;
-      errrange = errrange * 2 + 1;
 
-     /*
-      * Randomize the error value.
-      */
+  ranks        = calloc(size, sizeof(int));
+  dots         = calloc(size, 1);
+  proto        = calloc(size, 1);
+  energy       = calloc(size, sizeof(float));
+  proto_energy = calloc(size, sizeof(float));
 
-      if (errrange > 1)
-      {
-        errbase0 = errbase + (CUPS_RAND() % errrange);
-        errbase1 = errbase + (CUPS_RAND() % errrange);
-      }
-      else
-        errbase0 = errbase1 = errbase;
+  if (!ranks || !dots || !proto || !energy || !proto_energy)
+  {
+   /*
+    * Fall back to a plain random matrix...
+    */
 
-     /*
-      *       X   7/16 =    X  e0
-      * 3/16 5/16 1/16 =    e1 e2
-      */
+    for (i = 0; i < size; i ++)
+      dither_mask[i / DITHER_MASK][i % DITHER_MASK] = dither_rand(&rng) >> 24;
 
-      errval0 = errbase0 * e;
-      errval1 = (16 - errbase0) * e;
-      e0      = p0[1] + 7 * errval0;
-      e1      = e2 + 5 * errval1;
+    goto done;
+  }
 
-      errval0 = errbase1 * e;
-      errval1 = (16 - errbase1) * e;
-      e2      = errval0;
-      p1[-1]  = e1 + 3 * errval1;
+  for (y = -radius; y <= radius; y ++)
+    for (x = -radius; x <= radius; x ++)
+      weights[(y + radius) * (2 * radius + 1) + x + radius] =
+          (float)exp(-(x * x + y * y) / (2.0 * 1.5 * 1.5));
+
+ /*
+  * Start with a random pattern of 10% dots and relax it...
+  */
+
+  for (count = 0; count < size / 10;)
+  {
+    i = dither_rand(&rng) % size;
+
+    if (!dots[i])
+    {
+      dither_mask_update(energy, dots, weights, radius, i, 1);
+      count ++;
     }
   }
+
+  for (j = 0; j < size; j ++)
+  {
+    for (i = 0, best = -1; i < size; i ++)
+      if (dots[i] && (best < 0 || energy[i] > energy[best]))
+        best = i;
+
+    dither_mask_update(energy, dots, weights, radius, best, 0);
+    x = best;
+
+    for (i = 0, best = -1; i < size; i ++)
+      if (!dots[i] && (best < 0 || energy[i] < energy[best]))
+        best = i;
+
+    dither_mask_update(energy, dots, weights, radius, best, 1);
+
+    if (best == x)
+      break;
+  }
+
+  memcpy(proto, dots, size);
+  memcpy(proto_energy, energy, size * sizeof(float));
+
+ /*
+  * Rank the dots of the initial pattern by removing the tightest
+  * clusters first...
+  */
+
+  for (j = count - 1; j >= 0; j --)
+  {
+    for (i = 0, best = -1; i < size; i ++)
+      if (dots[i] && (best < 0 || energy[i] > energy[best]))
+        best = i;
+
+    dither_mask_update(energy, dots, weights, radius, best, 0);
+    ranks[best] = j;
+  }
+
+ /*
+  * Then rank the other positions by filling the largest voids...
+  */
+
+  memcpy(dots, proto, size);
+  memcpy(energy, proto_energy, size * sizeof(float));
+
+  for (j = count; j < size; j ++)
+  {
+    for (i = 0, best = -1; i < size; i ++)
+      if (!dots[i] && (best < 0 || energy[i] < energy[best]))
+        best = i;
+
+    dither_mask_update(energy, dots, weights, radius, best, 1);
+    ranks[best] = j;
+  }
+
+  for (i = 0; i < size; i ++)
+    dither_mask[i / DITHER_MASK][i % DITHER_MASK] = 256 * ranks[i] / size;
+
+  done:
+
+  free(ranks);
+  free(dots);
+  free(proto);
+  free(energy);
+  free(proto_energy);
+}
+
+
+/*
+ * 'dither_mask_update()' - Add or remove a dot of the blue noise pattern.
+ */
+
+static void
+dither_mask_update(
+    float               *energy,	/* IO - Dot density */
+    unsigned char       *dots,		/* IO - Pattern */
+    const float         *weights,	/* I - Gaussian filter */
+    int                 radius,		/* I - Radius of filter */
+    int                 index,		/* I - Position of dot */
+    int                 dot)		/* I - 1 to add, 0 to remove */
+{
+  int	x, y,				/* Offset from dot */
+	dx, dy;				/* Position in matrix */
+  float	sign = dot ? 1.0f : -1.0f;	/* Add or subtract filter */
+
+
+  dots[index] = dot;
+
+  for (y = -radius; y <= radius; y ++)
+  {
+    dy = (index / DITHER_MASK + y + DITHER_MASK) % DITHER_MASK;
+
+    for (x = -radius; x <= radius; x ++)
+    {
+      dx = (index % DITHER_MASK + x + DITHER_MASK) % DITHER_MASK;
+
+      energy[dy * DITHER_MASK + dx] +=
+          sign * weights[(y + radius) * (2 * radius + 1) + x + radius];
+    }
+  }
+}
+
+
+/*
+ * 'dither_row()' - Error diffuse a line, alternating directions.
+ */
+
+static void
+dither_row(cups_dither_t    *d,		/* I - Dither data */
+           const cups_lut_t *lut,	/* I - Lookup table */
+	   const short      *data,	/* I - Separation data */
+	   int              num_channels,
+					/* I - Number of components */
+	   unsigned char    *p,		/* O - Pixels */
+	   unsigned         *rng)	/* IO - Random state or NULL */
+{
+  int	*p0,				/* Error buffer pointers... */
+	*p1;
+  int	carry[3];			/* Errors between pixels */
+
+
+  if (d->row == 0)
+  {
+   /*
+    * Dither from left to right...
+    */
+
+    p0 = d->errors + 2;
+    p1 = d->errors + 2 + d->width + 4;
+
+    carry[0] = p0[0];
+    carry[1] = 0;
+    carry[2] = 0;
+
+    dither_ltr(lut, data, num_channels, p, d->width, p0, p1, carry, rng);
+  }
   else
   {
    /*
-    * Dither from right to left:
-    *
-    *    e0      == p0[0]
-    *    e2 e1   == p1[0] p1[1]
+    * Dither from right to left...
+    */
+
+    p0 = d->errors + d->width + 1 + d->width + 4;
+    p1 = d->errors + d->width + 1;
+
+    carry[0] = p0[0];
+    carry[1] = 0;
+    carry[2] = 0;
+
+    dither_rtl(lut, data + num_channels * (d->width - 1), num_channels,
+               p + d->width - 1, d->width, p0, p1, carry, rng);
+  }
+
+ /*
+  * Update to the next row...
+  */
+
+  d->row = 1 - d->row;
+}
+
+
+/*
+ * 'dither_rtl()' - Error diffuse pixels from right to left.
+ *
+ *    e0      == p0[0]
+ *    e2 e1   == p1[0] p1[1]
+ *
+ * "data", "p", "p0", and "p1" point at the rightmost pixel.
+ */
+
+static void
+dither_rtl(const cups_lut_t *lut,	/* I - Lookup table */
+	   const short      *data,	/* I - Separation data */
+	   int              num_channels,
+					/* I - Number of components */
+	   unsigned char    *p,		/* O - Pixels */
+	   int              count,	/* I - Number of pixels */
+	   int              *p0,	/* I - Errors of this line */
+	   int              *p1,	/* O - Errors for the next line */
+	   int              *carry,	/* IO - Errors between pixels */
+	   unsigned         *rng)	/* IO - Random state or NULL */
+{
+  register int	pixel,			/* Current adjusted pixel... */
+		e,			/* Current error */
+		e0,e1,e2;		/* Error values */
+  register int	errval0,		/* First half of error value */
+  		errval1,		/* Second half of error value */
+		errbase,		/* Base multiplier */
+		errbase0,		/* Base multiplier for large values */
+		errbase1,		/* Base multiplier for small values */
+		errrange;		/* Range of random multiplier */
+
+
+  e0 = carry[0];
+  e1 = carry[1];
+  e2 = carry[2];
+
+ /*
+  * Error diffuse each output pixel...
+  */
+
+  for (;
+       count > 0;
+       count --, p0 --, p1 --, p --, data -= num_channels)
+  {
+   /*
+    * Skip blank pixels...
     */
 
-    p0   = d->errors + d->width + 1 + d->width + 4;
-    p1   = d->errors + d->width + 1;
-    p    += d->width - 1;
-    data += num_channels * (d->width - 1);
-    e0   = p0[0];
-    e1   = 0;
-    e2   = 0;
+    if (*data == 0)
+    {
+      *p    = 0;
+      e0    = p0[-1];
+      p1[1] = e1;
+      e1    = e2;
+      e2    = 0;
+      continue;
+    }
 
    /*
-    * Error diffuse each output pixel...
+    * Compute the net pixel brightness and brightness error.  Set a dot
+    * if necessary...
     */
 
-    for (x = d->width;
-	 x > 0;
-	 x --, p0 --, p1 --, p --, data -= num_channels)
+    pixel = lut[*data].intensity + e0 / 128;
+
+    if (pixel > CUPS_MAX_LUT)
+      pixel = CUPS_MAX_LUT;
+    else if (pixel < 0)
+      pixel = 0;
+
+    *p = lut[pixel].pixel;
+    e  = lut[pixel].error;
+
+   /*
+    * Set the randomness factor...
+    */
+
+    errrange = dither_range(e);
+    errbase  = 8 - errrange;
+    errrange = errrange * 2 + 1;
+
+   /*
+    * Randomize the error value.
+    */
+
+    if (errrange <= 1)
+      errbase0 = errbase1 = errbase;
+    else if (rng)
     {
-     /*
-      * Skip blank pixels...
-      */
+      errbase0 = errbase +
+                 (int)(((unsigned long long)dither_rand(rng) * errrange) >> 32);
+      errbase1 = errbase +
+                 (int)(((unsigned long long)dither_rand(rng) * errrange) >> 32);
+    }
+    else
+    {
+      errbase0 = errbase + (CUPS_RAND() % errrange);
+      errbase1 = errbase + (CUPS_RAND() % errrange);
+    }
 
-      if (*data == 0)
-      {
-        *p    = 0;
-	e0    = p0[-1];
-	p1[1] = e1;
-	e1    = e2;
-	e2    = 0;
-	continue;
-      }
+   /*
+    *       X   7/16 =    X  e0
+    * 3/16 5/16 1/16 =    e1 e2
+    */
 
-     /*
-      * Compute the net pixel brightness and brightness error.  Set a dot
-      * if necessary...
-      */
+    errval0 = errbase0 * e;
+    errval1 = (16 - errbase0) * e;
+    e0      = p0[-1] + 7 * errval0;
+    e1      = e2 + 5 * errval1;
 
-      pixel = lut[*data].intensity + e0 / 128;
+    errval0 = errbase1 * e;
+    errval1 = (16 - errbase1) * e;
+    e2      = errval0;
+    p1[1]   = e1 + 3 * errval1;
+  }
 
-      if (pixel > CUPS_MAX_LUT)
-	pixel = CUPS_MAX_LUT;
-      else if (pixel < 0)
-	pixel = 0;
+  carry[0] = e0;
+  carry[1] = e1;
+  carry[2] = e2;
+}
 
-      *p = lut[pixel].pixel;
-      e  = lut[pixel].error;
 
-     /*
-      * Set the randomness factor...
-      */
+/*
+ * 'dither_seed()' - Return the random seed for a line.
+ *
+ * Each line of each channel has its own random sequence, so that the
+ * pixels do not depend on the order in which lines are dithered.
+ */
 
-      if (e > 0)
-        errrange = logtable[e];
-      else
-        errrange = logtable[-e];
+static unsigned				/* O - Seed */
+dither_seed(int channel,		/* I - Color channel */
+            int y)			/* I - Line number */
+{
+  unsigned	x;			/* Seed */
 
-      errbase  = 8 - errrange;
-      errrange = errrange * 2 + 1;
 
-     /*
-      * Randomize the error value.
-      */
+  x = (unsigned)y * 0x9e3779b9U ^ (unsigned)channel * 0x85ebca6bU ^
+      0x2545f491U;
+  x ^= x >> 16;
+  x *= 0x7feb352dU;
+  x ^= x >> 15;
+  x *= 0x846ca68bU;
+  x ^= x >> 16;
 
-      if (errrange > 1)
+  return (x ? x : 1);
+}
+
+
+/*
+ * 'dither_task()' - Dither one part of a band.
+ *
+ * For CUPS_DITHER_DIFFUSE a part is a channel, otherwise a line of a
+ * channel; lines are numbered so that all channels of a line come before
+ * the next line.
+ */
+
+static void
+dither_task(cups_dither_band_t *b,	/* I - Dither state */
+            int                task)	/* I - Part of band */
+{
+  int			c,		/* Channel */
+			line,		/* Line in band */
+			x,		/* Current column */
+			pixel,		/* Intensity of pixel */
+			count,		/* Pixels in piece */
+			need;		/* Pixels needed from line above */
+  size_t		linesize,	/* Size of an error line */
+			datasize;	/* Size of a line of data */
+  const short		*data;		/* Separation data */
+  unsigned char		*p;		/* Pixels */
+  int			*errors,	/* Error lines of channel */
+			*p0,		/* Errors of line */
+			*p1,		/* Errors for next line */
+			*above;		/* Progress of line above */
+  int			carry[3];	/* Errors between pixels */
+  unsigned		rng;		/* Random state */
+  const cups_dither_thr_t *thr;		/* Thresholds */
+  const unsigned char	*mask;		/* Row of blue noise matrix */
+  int			xoff;		/* Column offset in matrix */
+
+
+  datasize = (size_t)b->width * b->num_channels;
+
+  if (b->mode == CUPS_DITHER_DIFFUSE)
+  {
+    c    = task;
+    data = b->data + c;
+    p    = b->planes[c];
+
+    for (line = 0; line < b->num_lines; line ++, data += datasize,
+         p += b->width)
+    {
+      rng = dither_seed(c, b->y + line);
+
+      dither_row(b->states[c], b->luts[c], data, b->num_channels, p, &rng);
+    }
+
+    return;
+  }
+
+  c    = task % b->num_channels;
+  line = task / b->num_channels;
+  data = b->data + line * datasize + c;
+  p    = b->planes[c] + line * b->width;
+
+  if (b->mode == CUPS_DITHER_BLUENOISE)
+  {
+   /*
+    * Threshold against the blue noise matrix, shifted for each channel
+    * so that the dots of the channels do not line up...
+    */
+
+    thr  = b->thresholds + c * (CUPS_MAX_LUT + 1);
+    mask = dither_mask[(b->y + line + 23 * c) % DITHER_MASK];
+    xoff = 41 * c;
+
+    for (x = 0; x < b->width; x ++, data += b->num_channels, p ++)
+    {
+      if (*data == 0)
       {
-        errbase0 = errbase + (CUPS_RAND() % errrange);
-        errbase1 = errbase + (CUPS_RAND() % errrange);
+        *p = 0;
+	continue;
       }
-      else
-        errbase0 = errbase1 = errbase;
 
-     /*
-      *       X   7/16 =    X  e0
-      * 3/16 5/16 1/16 =    e1 e2
-      */
+      pixel = b->luts[c][*data].intensity;
 
-      errval0 = errbase0 * e;
-      errval1 = (16 - errbase0) * e;
-      e0      = p0[-1] + 7 * errval0;
-      e1      = e2 + 5 * errval1;
+      if (pixel > CUPS_MAX_LUT)
+        pixel = CUPS_MAX_LUT;
+      else if (pixel < 0)
+        pixel = 0;
 
-      errval0 = errbase1 * e;
-      errval1 = (16 - errbase1) * e;
-      e2      = errval0;
-      p1[1]   = e1 + 3 * errval1;
+      if (thr[pixel].frac > mask[(x + xoff) % DITHER_MASK])
+        *p = thr[pixel].hi;
+      else
+        *p = thr[pixel].lo;
     }
+
+    return;
   }
 
  /*
-  * Update to the next row...
+  * Wavefront diffusion: wait until the line above has finished the
+  * pixels whose errors this piece reads...
   */
 
-  d->row = 1 - d->row;
+  linesize = b->width + 4;
+  errors   = b->errors + c * (b->max_lines + 1) * linesize;
+  p0       = errors + line * linesize + 2;
+  p1       = p0 + linesize;
+  above    = line > 0 ? b->progress + (line - 1) * b->num_channels + c : NULL;
+  rng      = dither_seed(c, b->y + line);
+
+  p1[b->width - 1] = 0;
+  p1[b->width]     = 0;
+
+  carry[0] = 0;
+  carry[1] = 0;
+  carry[2] = 0;
+
+  for (x = 0; x < b->width; x += count)
+  {
+    if ((count = b->width - x) > DITHER_CHUNK)
+      count = DITHER_CHUNK;
+
+    if (above)
+    {
+      if ((need = x + count + 1) > b->width)
+        need = b->width;
+
+      while (DITHER_GET(*above) < need)
+#ifdef HAVE_PTHREAD_H
+        sched_yield();
+#else
+        ;
+#endif /* HAVE_PTHREAD_H */
+    }
+
+    if (x == 0)
+      carry[0] = p0[0];
+
+    dither_ltr(b->luts[c], data + x * b->num_channels, b->num_channels,
+               p + x, count, p0 + x, p1 + x, carry, &rng);
+
+    DITHER_SET(b->progress[line * b->num_channels + c], x + count);
+  }
 }
 
 
+#ifdef HAVE_PTHREAD_H
 /*
- * 'cupsDitherNew()' - Create an error-diffusion dithering buffer.
+ * 'dither_thread()' - Dither parts of bands.
  */
 
-cups_dither_t *			/* O - New state array */
-cupsDitherNew(int width)	/* I - Width of output in pixels */
+static void *				/* O - Thread exit status */
+dither_thread(void *data)		/* I - Dither state */
 {
-  cups_dither_t	*d;		/* New dithering buffer */
+  cups_dither_band_t	*b = (cups_dither_band_t *)data;
+					/* Dither state */
+  int			generation = 0,	/* Last band seen */
+			task;		/* Current part of band */
 
 
-  if ((d = (cups_dither_t *)calloc(1, sizeof(cups_dither_t) +
-                                   2 * (width + 4) *
-				       sizeof(int))) == NULL)
-    return (NULL);
+  pthread_mutex_lock(&b->mutex);
 
-  d->width = width;
+  for (;;)
+  {
+    while (!b->shutdown && b->generation == generation)
+      pthread_cond_wait(&b->cond, &b->mutex);
 
-  return (d);
-}
+    if (b->shutdown)
+      break;
+
+    generation = b->generation;
+
+    while (b->next_task < b->num_tasks)
+    {
+      task = b->next_task ++;
+
+      pthread_mutex_unlock(&b->mutex);
+      dither_task(b, task);
+      pthread_mutex_lock(&b->mutex);
 
+      if (++ b->done_tasks == b->num_tasks)
+        pthread_cond_broadcast(&b->cond);
+    }
+  }
+
+  pthread_mutex_unlock(&b->mutex);
+
+  return (NULL);
+}
+#endif /* HAVE_PTHREAD_H */
@@ -56,6 +56,13 @@ extern "C" {
 #define CUPS_MAX_LUT	4095		/* Maximum LUT value */
 #define CUPS_MAX_RGB	4		/* Maximum number of sRGB components */
 
+#define CUPS_DITHER_DIFFUSE	0	/* Serpentine error diffusion */
+#define CUPS_DITHER_WAVEFRONT	1	/* Left-to-right error diffusion */
+#define CUPS_DITHER_BLUENOISE	2	/* Blue noise threshold */
+
+#define CUPS_RGB_TETRAHEDRAL	0	/* Tetrahedral interpolation */
+#define CUPS_RGB_TRILINEAR	1	/* Original trilinear interpolation */
+
 
 /*
  * Types/structures for the various routines.
@@ -75,6 +82,9 @@ typedef struct cups_dither_s		/**** Dithering State ****/
   int		errors[96];		/* Error values */
 } cups_dither_t;
 
+typedef struct cups_dither_band_s cups_dither_band_t;
+					/**** Multi-channel dithering state ****/
+
 typedef struct cups_sample_s		/**** Color sample point ****/
 {
   unsigned char	rgb[3];			/* sRGB values */
@@ -91,6 +101,10 @@ typedef struct cups_rgb_s		/**** Color separation lookup table ****/
   int		cache_init;		/* Are cached values initialized? */
   unsigned char	black[CUPS_MAX_RGB];	/* Cached black (sRGB = 0,0,0) */
   unsigned char	white[CUPS_MAX_RGB];	/* Cached white (sRGB = 255,255,255) */
+  int		interpolation;		/* Interpolation method */
+  int		tetra_index[256];	/* Tetrahedral cube index for sRGB value */
+  int		tetra_frac[256];	/* Position in cube cell (0-256) */
+  unsigned long long *tetra_colors;	/* Samples with 16 bits per channel */
 } cups_rgb_t;
 
 typedef struct cups_cmyk_s		/**** Simple CMYK lookup table ****/
@@ -101,6 +115,7 @@ typedef struct cups_cmyk_s		/**** Simple CMYK lookup table ****/
   int		num_channels;		/* Number of components */
   short		*channels[CUPS_MAX_CHAN];
 					/* Lookup tables */
+  unsigned long long black_mult[256];	/* Reciprocals for black generation */
 } cups_cmyk_t;
 
 
@@ -147,6 +162,13 @@ extern void		cupsDitherLine(cups_dither_t *d, const cups_lut_t *lut,
 				       unsigned char *p);
 extern cups_dither_t	*cupsDitherNew(int width);
 extern void		cupsDitherDelete(cups_dither_t *);
+extern int		cupsDitherBand(cups_dither_band_t *b,
+			               const short *data, int num_lines,
+				       unsigned char * const *planes);
+extern cups_dither_band_t *cupsDitherBandNew(int width, int num_channels,
+			                     const cups_lut_t * const *luts,
+					     int mode, int num_threads);
+extern void		cupsDitherBandDelete(cups_dither_band_t *b);
 
 /*
  * Lookup table functions for dithering...
@@ -194,6 +216,8 @@ extern cups_rgb_t	*cupsRGBLoad(ppd_file_t *ppd,
 			             const char *resolution);
 extern cups_rgb_t	*cupsRGBNew(int num_samples, cups_sample_t *samples,
 			            int cube_size, int num_channels);
+extern void		cupsRGBSetInterpolation(cups_rgb_t *rgb,
+			                        int interpolation);
 
 /*
  * CMYK separation functions...
@@ -11,12 +11,14 @@
  *
  * Contents:
  *
- *   _cupsImageReadGIF() - Read a GIF image file.
+ *   _cupsImageNumPagesGIF() - Get the number of images in a GIF file.
+ *   _cupsImageReadGIF()     - Read a GIF image file.
  *   gif_get_block()     - Read a GIF data block...
  *   gif_get_code()      - Get a LZW code from the file...
  *   gif_read_cmap()     - Read the colormap from a GIF file...
  *   gif_read_image()    - Read a GIF image stream...
  *   gif_read_lzw()      - Read a byte from the LZW stream...
+ *   gif_skip_image()    - Skip an image without decoding it...
  */
 
 /*
@@ -37,25 +39,97 @@
 typedef cups_ib_t	gif_cmap_t[256][4];
 typedef short		gif_table_t[4096];
 
+typedef struct gif_lzw_s		/**** GIF decoder state ****/
+{
+  FILE		*fp;			/* File to read from */
+  int		eof;			/* Did we hit EOF? */
+  unsigned char	buf[280];		/* Input buffer of codes */
+  unsigned	curbit,			/* Current bit */
+		lastbit,		/* Last bit in buffer */
+		done,			/* Done with this buffer? */
+		last_byte;		/* Last byte in buffer */
+  short		fresh,			/* 1 = empty buffers */
+		code_size,		/* Current code size */
+		set_code_size,		/* Initial code size set */
+		max_code,		/* Maximum code used */
+		max_code_size,		/* Maximum code size */
+		firstcode,		/* First code read */
+		oldcode,		/* Last code read */
+		clear_code,		/* Clear code for LZW input */
+		end_code,		/* End code for LZW input */
+		*stack,			/* Output stack */
+		*sp;			/* Current stack pointer */
+  gif_table_t	*table;			/* String table */
+} gif_lzw_t;
+
 
 /*
- * Local globals...
+ * Local functions...
  */
 
-static int	gif_eof = 0;		/* Did we hit EOF? */
+static int	gif_get_block(gif_lzw_t *gif, unsigned char *buffer);
+static int	gif_get_code (gif_lzw_t *gif, int code_size, int first_time);
+static int	gif_read_cmap(FILE *fp, int ncolors, gif_cmap_t cmap,
+		              int *gray);
+static int	gif_read_image(gif_lzw_t *gif, cups_image_t *img,
+		               gif_cmap_t cmap, int interlace);
+static int	gif_read_lzw(gif_lzw_t *gif, int first_time,
+		             int input_code_size);
+static int	gif_skip_image(gif_lzw_t *gif, unsigned char *buf);
 
 
 /*
- * Local functions...
+ * '_cupsImageNumPagesGIF()' - Get the number of images in a GIF file.
+ *
+ * The images are skipped without decoding them; the file is not closed.
  */
 
-static int	gif_get_block(FILE *fp, unsigned char *buffer);
-static int	gif_get_code (FILE *fp, int code_size, int first_time);
-static int	gif_read_cmap(FILE *fp, int ncolors, gif_cmap_t cmap,
-		              int *gray);
-static int	gif_read_image(FILE *fp, cups_image_t *img, gif_cmap_t cmap,
-		               int interlace);
-static int	gif_read_lzw(FILE *fp, int first_time, int input_code_size);
+int					/* O - Number of images or -1 on error */
+_cupsImageNumPagesGIF(FILE *fp)		/* I - GIF file */
+{
+  unsigned char	buf[1024];		/* Input buffer */
+  gif_lzw_t	gif;			/* Decoder state */
+  int		pages = 0;		/* Number of images */
+
+
+  memset(&gif, 0, sizeof(gif));
+  gif.fp = fp;
+
+  if (fseek(fp, 0, SEEK_SET) || fread(buf, 13, 1, fp) != 1)
+    return (-1);
+
+  if ((buf[10] & GIF_COLORMAP) &&
+      fseek(fp, 3 * (2 << (buf[10] & 0x07)), SEEK_CUR))
+    return (-1);
+
+  for (;;)
+  {
+    switch (getc(fp))
+    {
+      case ';' :	/* End of image */
+      case EOF :
+          return (pages);
+
+      case '!' :	/* Extension record */
+          getc(fp);
+          while (gif_get_block(&gif, buf) > 0);
+
+          if (gif.eof && feof(fp))
+            return (pages);
+          break;
+
+      case ',' :	/* cupsImage data */
+          if (gif_skip_image(&gif, buf))
+            return (pages);
+
+          pages ++;
+          break;
+
+      default :		/* Garbage after the images */
+          return (pages);
+    }
+  }
+}
 
 
 /*
@@ -78,7 +152,9 @@ _cupsImageReadGIF(
 		bpp,			/* Bytes per pixel */
 		gray,			/* Grayscale image? */
 		ncolors,		/* Bits per pixel */
-		transparent;		/* Transparent color index */
+		transparent,		/* Transparent color index */
+		page;			/* Current image in file */
+  gif_lzw_t	gif;			/* Decoder state */
 
 
  /*
@@ -88,6 +164,9 @@ _cupsImageReadGIF(
   if (primary == CUPS_IMAGE_RGB_CMYK)
     primary = CUPS_IMAGE_RGB;
 
+  memset(&gif, 0, sizeof(gif));
+  gif.fp = fp;
+
  /*
   * Read the header; we already know it is a GIF file...
   */
@@ -108,6 +187,7 @@ _cupsImageReadGIF(
     }
 
   transparent = -1;
+  page        = 0;
 
   for (;;)
   {
@@ -121,21 +201,40 @@ _cupsImageReadGIF(
           buf[0] = getc(fp);
           if (buf[0] == 0xf9)	/* Graphic Control Extension */
           {
-            gif_get_block(fp, buf);
+            gif_get_block(&gif, buf);
             if (buf[0] & 1)	/* Get transparent color index */
               transparent = buf[3];
           }
 
-          while (gif_get_block(fp, buf) != 0)
+          while (gif_get_block(&gif, buf) != 0)
           {
-            if(gif_eof)
+            if (gif.eof)
             {
+              fclose(fp);
               return (-1);
             }
           }
           break;
 
       case ',' :	/* cupsImage data */
+          if (page < img->page)
+	  {
+	   /*
+	    * Skip the images before the page to read, along with their
+	    * graphic control...
+	    */
+
+	    if (gif_skip_image(&gif, buf))
+	    {
+	      fclose(fp);
+	      return (-1);
+	    }
+
+	    page ++;
+	    transparent = -1;
+	    break;
+	  }
+
           if (fread(buf, 9, 1, fp) == 0 && ferror(fp))
 	    DEBUG_printf(("Error reading file!"));
 
@@ -247,8 +346,10 @@ _cupsImageReadGIF(
 	    return (1);
 	  }
 
-	  i = gif_read_image(fp, img, cmap, buf[8] & GIF_INTERLACE);
+	  i = gif_read_image(&gif, img, cmap, buf[8] & GIF_INTERLACE);
           fclose(fp);
+	  free(gif.table);
+	  free(gif.stack);
           return (i);
     }
   }
@@ -260,7 +361,7 @@ _cupsImageReadGIF(
  */
 
 static int				/* O - Number characters read */
-gif_get_block(FILE          *fp,	/* I - File to read from */
+gif_get_block(gif_lzw_t     *gif,	/* I - Decoder state */
 	      unsigned char *buf)	/* I - Input buffer */
 {
   int	count;				/* Number of character to read */
@@ -270,20 +371,20 @@ gif_get_block(FILE          *fp,	/* I - File to read from */
   * Read the count byte followed by the data from the file...
   */
 
-  if ((count = getc(fp)) == EOF)
+  if ((count = getc(gif->fp)) == EOF)
   {
-    gif_eof = 1;
+    gif->eof = 1;
     return (-1);
   }
   else if (count == 0)
-    gif_eof = 1;
-  else if (fread(buf, 1, count, fp) < count)
+    gif->eof = 1;
+  else if (fread(buf, 1, count, gif->fp) < count)
   {
-    gif_eof = 1;
+    gif->eof = 1;
     return (-1);
   }
   else
-    gif_eof = 0;
+    gif->eof = 0;
 
   return (count);
 }
@@ -294,18 +395,14 @@ gif_get_block(FILE          *fp,	/* I - File to read from */
  */
 
 static int				/* O - LZW code */
-gif_get_code(FILE *fp,			/* I - File to read from */
-	     int  code_size,		/* I - Size of code in bits */
-	     int  first_time)		/* I - 1 = first time, 0 = not first time */
+gif_get_code(gif_lzw_t *gif,		/* I - Decoder state */
+	     int       code_size,	/* I - Size of code in bits */
+	     int       first_time)	/* I - 1 = first time, 0 = not first time */
 {
   unsigned		i, j,		/* Looping vars */
 			ret;		/* Return value */
   int			count;		/* Number of bytes read */
-  static unsigned char	buf[280];	/* Input buffer */
-  static unsigned	curbit,		/* Current bit */
-			lastbit,	/* Last bit in buffer */
-			done,		/* Done with this buffer? */
-			last_byte;	/* Last byte in buffer */
+  unsigned char		*buf = gif->buf;/* Input buffer */
   static const unsigned char bits[8] =	/* Bit masks for codes */
 			{
 			  0x01, 0x02, 0x04, 0x08,
@@ -319,50 +416,50 @@ gif_get_code(FILE *fp,			/* I - File to read from */
     * Just initialize the input buffer...
     */
 
-    curbit    = 0;
-    lastbit   = 0;
-    last_byte = 0;
-    done      = 0;
+    gif->curbit    = 0;
+    gif->lastbit   = 0;
+    gif->last_byte = 0;
+    gif->done      = 0;
 
     return (0);
   }
 
-  if ((curbit + code_size) >= lastbit)
+  if ((gif->curbit + code_size) >= gif->lastbit)
   {
    /*
     * Don't have enough bits to hold the code...
     */
 
-    if (done)
+    if (gif->done)
       return (-1);	/* Sorry, no more... */
 
    /*
     * Move last two bytes to front of buffer...
     */
 
-    if (last_byte > 1)
+    if (gif->last_byte > 1)
     {
-      buf[0]    = buf[last_byte - 2];
-      buf[1]    = buf[last_byte - 1];
-      last_byte = 2;
+      buf[0]         = buf[gif->last_byte - 2];
+      buf[1]         = buf[gif->last_byte - 1];
+      gif->last_byte = 2;
     }
-    else if (last_byte == 1)
+    else if (gif->last_byte == 1)
     {
-      buf[0]    = buf[last_byte - 1];
-      last_byte = 1;
+      buf[0]         = buf[gif->last_byte - 1];
+      gif->last_byte = 1;
     }
 
    /*
     * Read in another buffer...
     */
 
-    if ((count = gif_get_block(fp, buf + last_byte)) <= 0)
+    if ((count = gif_get_block(gif, buf + gif->last_byte)) <= 0)
     {
      /*
       * Whoops, no more data!
       */
 
-      done = 1;
+      gif->done = 1;
       return (-1);
     }
 
@@ -370,17 +467,17 @@ gif_get_code(FILE *fp,			/* I - File to read from */
     * Update buffer state...
     */
 
-    curbit    = (curbit - lastbit) + 8 * last_byte;
-    last_byte += count;
-    lastbit   = last_byte * 8;
+    gif->curbit    = (gif->curbit - gif->lastbit) + 8 * gif->last_byte;
+    gif->last_byte += count;
+    gif->lastbit    = gif->last_byte * 8;
   }
 
-  for (ret = 0, i = curbit + code_size - 1, j = code_size;
+  for (ret = 0, i = gif->curbit + code_size - 1, j = code_size;
        j > 0;
        i --, j --)
     ret = (ret << 1) | ((buf[i / 8] & bits[i & 7]) != 0);
 
-  curbit += code_size;
+  gif->curbit += code_size;
 
   return ret;
 }
@@ -439,7 +536,7 @@ gif_read_cmap(FILE       *fp,		/* I - File to read from */
  */
 
 static int				/* I - 0 = success, -1 = failure */
-gif_read_image(FILE         *fp,	/* I - Input file */
+gif_read_image(gif_lzw_t    *gif,	/* I - Decoder state */
 	       cups_image_t *img,	/* I - cupsImage pointer */
 	       gif_cmap_t   cmap,	/* I - Colormap */
 	       int          interlace)	/* I - Non-zero = interlaced image */
@@ -463,19 +560,19 @@ gif_read_image(FILE         *fp,	/* I - Input file */
   xpos      = 0;
   ypos      = 0;
   pass      = 0;
-  code_size = getc(fp);
+  code_size = getc(gif->fp);
 
   if (!pixels)
     return (-1);
 
-  if (code_size > GIF_MAX_BITS || gif_read_lzw(fp, 1, code_size) < 0)
+  if (code_size > GIF_MAX_BITS || gif_read_lzw(gif, 1, code_size) < 0)
   {
     free(pixels);
     return (-1);
   }
 
   temp = pixels;
-  while ((pixel = gif_read_lzw(fp, 0, code_size)) >= 0)
+  while ((pixel = gif_read_lzw(gif, 0, code_size)) >= 0)
   {
     switch (bpp)
     {
@@ -531,25 +628,13 @@ gif_read_image(FILE         *fp,	/* I - Input file */
  */
 
 static int				/* I - Byte from stream */
-gif_read_lzw(FILE *fp,			/* I - File to read from */
-	     int  first_time,		/* I - 1 = first time, 0 = not first time */
- 	     int  input_code_size)	/* I - Code size in bits */
+gif_read_lzw(gif_lzw_t *gif,		/* I - Decoder state */
+	     int       first_time,	/* I - 1 = first time, 0 = not first time */
+ 	     int       input_code_size)	/* I - Code size in bits */
 {
   int			i,		/* Looping var */
 			code,		/* Current code */
 			incode;		/* Input code */
-  static short		fresh = 0,	/* 1 = empty buffers */
-			code_size,	/* Current code size */
-			set_code_size,	/* Initial code size set */
-			max_code,	/* Maximum code used */
-			max_code_size,	/* Maximum code size */
-			firstcode,	/* First code read */
-			oldcode,	/* Last code read */
-			clear_code,	/* Clear code for LZW input */
-			end_code,	/* End code for LZW input */
-			*stack = NULL,	/* Output stack */
-			*sp;		/* Current stack pointer */
-  static gif_table_t	*table = NULL;	/* String table */
 
 
   if (first_time)
@@ -558,141 +643,168 @@ gif_read_lzw(FILE *fp,			/* I - File to read from */
     * Setup LZW state...
     */
 
-    set_code_size = input_code_size;
-    code_size     = set_code_size + 1;
-    clear_code    = 1 << set_code_size;
-    end_code      = clear_code + 1;
-    max_code_size = 2 * clear_code;
-    max_code      = clear_code + 2;
+    gif->set_code_size = input_code_size;
+    gif->code_size     = gif->set_code_size + 1;
+    gif->clear_code    = 1 << gif->set_code_size;
+    gif->end_code      = gif->clear_code + 1;
+    gif->max_code_size = 2 * gif->clear_code;
+    gif->max_code      = gif->clear_code + 2;
 
    /*
     * Allocate memory for buffers...
     */
 
-    if (table == NULL)
-      table = calloc(2, sizeof(gif_table_t));
+    if (gif->table == NULL)
+      gif->table = calloc(2, sizeof(gif_table_t));
 
-    if (table == NULL)
+    if (gif->table == NULL)
       return (-1);
 
-    if (stack == NULL)
-      stack = calloc(8192, sizeof(short));
+    if (gif->stack == NULL)
+      gif->stack = calloc(8192, sizeof(short));
 
-    if (stack == NULL)
+    if (gif->stack == NULL)
       return (-1);
 
    /*
     * Initialize input buffers...
     */
 
-    gif_get_code(fp, 0, 1);
+    gif_get_code(gif, 0, 1);
 
    /*
     * Wipe the decompressor table (already mostly 0 due to the calloc above...)
     */
 
-    fresh = 1;
+    gif->fresh = 1;
 
-    for (i = 1; i < clear_code; i ++)
-      table[1][i] = i;
+    for (i = 1; i < gif->clear_code; i ++)
+      gif->table[1][i] = i;
 
-    sp = stack;
+    gif->sp = gif->stack;
 
     return (0);
   }
-  else if (fresh)
+  else if (gif->fresh)
   {
-    fresh = 0;
+    gif->fresh = 0;
 
     do
     {
-      firstcode = oldcode = gif_get_code(fp, code_size, 0);
+      gif->firstcode = gif->oldcode = gif_get_code(gif, gif->code_size, 0);
     }
-    while (firstcode == clear_code);
+    while (gif->firstcode == gif->clear_code);
 
-    return (firstcode & 255);
+    return (gif->firstcode & 255);
   }
-  else if (!table)
+  else if (!gif->table)
     return (0);
 
-  if (sp > stack)
-    return ((*--sp) & 255);
+  if (gif->sp > gif->stack)
+    return ((*--gif->sp) & 255);
 
-  while ((code = gif_get_code(fp, code_size, 0)) >= 0)
+  while ((code = gif_get_code(gif, gif->code_size, 0)) >= 0)
   {
-    if (code == clear_code)
+    if (code == gif->clear_code)
     {
      /*
       * Clear/reset the compression table...
       */
 
-      memset(table, 0, 2 * sizeof(gif_table_t));
-      for (i = 1; i < clear_code; i ++)
-	table[1][i] = i;
+      memset(gif->table, 0, 2 * sizeof(gif_table_t));
+      for (i = 1; i < gif->clear_code; i ++)
+	gif->table[1][i] = i;
 
-      code_size     = set_code_size + 1;
-      max_code_size = 2 * clear_code;
-      max_code      = clear_code + 2;
+      gif->code_size     = gif->set_code_size + 1;
+      gif->max_code_size = 2 * gif->clear_code;
+      gif->max_code      = gif->clear_code + 2;
 
-      sp = stack;
+      gif->sp = gif->stack;
 
-      firstcode = oldcode = gif_get_code(fp, code_size, 0);
+      gif->firstcode = gif->oldcode = gif_get_code(gif, gif->code_size, 0);
 
-      return (firstcode & 255);
+      return (gif->firstcode & 255);
     }
-    else if (code == end_code || code > max_code)
+    else if (code == gif->end_code || code > gif->max_code)
     {
       unsigned char	buf[260];	/* Block buffer */
 
-      if (!gif_eof)
-        while (gif_get_block(fp, buf) > 0);
+      if (!gif->eof)
+        while (gif_get_block(gif, buf) > 0);
 
       return (-2);
     }
 
     incode = code;
 
-    if (code == max_code)
+    if (code == gif->max_code)
     {
-      if (sp < (stack + 8192))
-	*sp++ = firstcode;
+      if (gif->sp < (gif->stack + 8192))
+	*gif->sp++ = gif->firstcode;
 
-      code = oldcode;
+      code = gif->oldcode;
     }
 
-    while (code >= clear_code && sp < (stack + 8192))
+    while (code >= gif->clear_code && gif->sp < (gif->stack + 8192))
     {
-      *sp++ = table[1][code];
-      if (code == table[0][code])
+      *gif->sp++ = gif->table[1][code];
+      if (code == gif->table[0][code])
 	return (255);
 
-      code = table[0][code];
+      code = gif->table[0][code];
     }
 
-    if (sp < (stack + 8192))
-      *sp++ = firstcode = table[1][code];
+    if (gif->sp < (gif->stack + 8192))
+      *gif->sp++ = gif->firstcode = gif->table[1][code];
 
-    code = max_code;
+    code = gif->max_code;
 
     if (code < 4096)
     {
-      table[0][code] = oldcode;
-      table[1][code] = firstcode;
-      max_code ++;
+      gif->table[0][code] = gif->oldcode;
+      gif->table[1][code] = gif->firstcode;
+      gif->max_code ++;
 
-      if (max_code >= max_code_size && max_code_size < 4096)
+      if (gif->max_code >= gif->max_code_size && gif->max_code_size < 4096)
       {
-	max_code_size *= 2;
-	code_size ++;
+	gif->max_code_size *= 2;
+	gif->code_size ++;
       }
     }
 
-    oldcode = incode;
+    gif->oldcode = incode;
 
-    if (sp > stack)
-      return ((*--sp) & 255);
+    if (gif->sp > gif->stack)
+      return ((*--gif->sp) & 255);
   }
 
   return (code & 255);
 }
 
+
+
+/*
+ * 'gif_skip_image()' - Skip an image without decoding it...
+ *
+ * The image separator has been read already; the image descriptor, the
+ * local colormap (if any), and the data blocks are skipped.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+gif_skip_image(gif_lzw_t     *gif,	/* I - Decoder state */
+               unsigned char *buf)	/* I - Buffer of at least 256 bytes */
+{
+  if (fread(buf, 9, 1, gif->fp) != 1)
+    return (-1);
+
+  if ((buf[8] & GIF_COLORMAP) &&
+      fseek(gif->fp, 3 * (2 << (buf[8] & 0x07)), SEEK_CUR))
+    return (-1);
+
+  if (getc(gif->fp) == EOF)		/* LZW code size */
+    return (-1);
+
+  while (gif_get_block(gif, buf) > 0);
+
+  return (gif->eof && feof(gif->fp) ? -1 : 0);
+}
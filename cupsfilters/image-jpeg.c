@@ -12,6 +12,9 @@
  * Contents:
  *
  *   _cupsImageReadJPEG() - Read a JPEG image file.
+ *   close_jpeg()         - Free the JPEG decoder.
+ *   decode_jpeg_row()    - Decode and convert the next row.
+ *   read_jpeg_row()      - Read the next row of a streamed JPEG image.
  */
 
 /*
@@ -24,6 +27,34 @@
 #  include <jpeglib.h>	/* JPEG/JFIF image definitions */
 
 
+/*
+ * Local types...
+ */
+
+typedef struct jpeg_state_s		/**** JPEG decoder state ****/
+{
+  struct jpeg_decompress_struct	cinfo;	/* Decompressor info */
+  struct jpeg_error_mgr	jerr;		/* Error handler info */
+  FILE			*fp;		/* Image file */
+  cups_ib_t		*in;		/* Input pixels */
+  int			width,		/* Width of decoded rows */
+			psjpeg,		/* Non-zero if Photoshop CMYK JPEG */
+			saturation,	/* Color saturation (%) */
+			hue;		/* Color hue (degrees) */
+  const cups_ib_t	*lut;		/* Lookup table for gamma/brightness */
+} jpeg_state_t;
+
+
+/*
+ * Local functions...
+ */
+
+static void	close_jpeg(void *data);
+static void	decode_jpeg_row(cups_image_t *img, jpeg_state_t *js,
+		                cups_ib_t *out);
+static int	read_jpeg_row(cups_image_t *img, cups_ib_t *pixels);
+
+
 /*
  * '_cupsImageReadJPEG()' - Read a JPEG image file.
  */
@@ -38,12 +69,11 @@ _cupsImageReadJPEG(
     int             hue,		/* I  - Color hue (degrees) */
     const cups_ib_t *lut)		/* I  - Lookup table for gamma/brightness */
 {
-  struct jpeg_decompress_struct	cinfo;	/* Decompressor info */
-  struct jpeg_error_mgr	jerr;		/* Error handler info */
-  cups_ib_t		*in,		/* Input pixels */
-			*out;		/* Output pixels */
+  jpeg_state_t		*js;		/* Decoder state */
+  struct jpeg_decompress_struct	*cinfo;	/* Decompressor info */
+  cups_ib_t		*out;		/* Output pixels */
   jpeg_saved_marker_ptr	marker;		/* Pointer to marker data */
-  int			psjpeg = 0;	/* Non-zero if Photoshop CMYK JPEG */
+  unsigned		scale;		/* Reduction factor */
   static const char	*cspaces[] =
 			{		/* JPEG colorspaces... */
 			  "JCS_UNKNOWN",
@@ -59,11 +89,23 @@ _cupsImageReadJPEG(
   * Read the JPEG header...
   */
 
-  cinfo.err = jpeg_std_error(&jerr);
-  jpeg_create_decompress(&cinfo);
-  jpeg_save_markers(&cinfo, JPEG_APP0 + 14, 0xffff); /* Adobe JPEG */
-  jpeg_stdio_src(&cinfo, fp);
-  jpeg_read_header(&cinfo, 1);
+  if ((js = calloc(1, sizeof(jpeg_state_t))) == NULL)
+  {
+    fclose(fp);
+    return (1);
+  }
+
+  cinfo          = &(js->cinfo);
+  js->fp         = fp;
+  js->saturation = saturation;
+  js->hue        = hue;
+  js->lut        = lut;
+
+  cinfo->err = jpeg_std_error(&(js->jerr));
+  jpeg_create_decompress(cinfo);
+  jpeg_save_markers(cinfo, JPEG_APP0 + 14, 0xffff); /* Adobe JPEG */
+  jpeg_stdio_src(cinfo, fp);
+  jpeg_read_header(cinfo, 1);
 
  /*
   * Parse any Adobe APPE data embedded in the JPEG file.  Since Adobe doesn't
@@ -71,38 +113,38 @@ _cupsImageReadJPEG(
   * Adobe apps...
   */
 
-  for (marker = cinfo.marker_list; marker; marker = marker->next)
+  for (marker = cinfo->marker_list; marker; marker = marker->next)
     if (marker->marker == (JPEG_APP0 + 14) && marker->data_length >= 12 &&
         !memcmp(marker->data, "Adobe", 5))
     {
       fputs("DEBUG: Adobe CMYK JPEG detected (inverting color values)\n",
 	    stderr);
-      psjpeg = 1;
+      js->psjpeg = 1;
     }
 
-  cinfo.quantize_colors = 0;
+  cinfo->quantize_colors = 0;
 
-  fprintf(stderr, "DEBUG: num_components = %d\n", cinfo.num_components);
+  fprintf(stderr, "DEBUG: num_components = %d\n", cinfo->num_components);
   fprintf(stderr, "DEBUG: jpeg_color_space = %s\n",
-          cspaces[cinfo.jpeg_color_space]);
+          cspaces[cinfo->jpeg_color_space]);
 
-  if (cinfo.num_components == 1)
+  if (cinfo->num_components == 1)
   {
     fputs("DEBUG: Converting image to grayscale...\n", stderr);
 
-    cinfo.out_color_space      = JCS_GRAYSCALE;
-    cinfo.out_color_components = 1;
-    cinfo.output_components    = 1;
+    cinfo->out_color_space      = JCS_GRAYSCALE;
+    cinfo->out_color_components = 1;
+    cinfo->output_components    = 1;
 
     img->colorspace = secondary;
   }
-  else if (cinfo.num_components == 4)
+  else if (cinfo->num_components == 4)
   {
     fputs("DEBUG: Converting image to CMYK...\n", stderr);
 
-    cinfo.out_color_space      = JCS_CMYK;
-    cinfo.out_color_components = 4;
-    cinfo.output_components    = 4;
+    cinfo->out_color_space      = JCS_CMYK;
+    cinfo->out_color_components = 4;
+    cinfo->output_components    = 4;
 
     img->colorspace = (primary == CUPS_IMAGE_RGB_CMYK) ? CUPS_IMAGE_CMYK : primary;
   }
@@ -110,41 +152,39 @@ _cupsImageReadJPEG(
   {
     fputs("DEBUG: Converting image to RGB...\n", stderr);
 
-    cinfo.out_color_space      = JCS_RGB;
-    cinfo.out_color_components = 3;
-    cinfo.output_components    = 3;
+    cinfo->out_color_space      = JCS_RGB;
+    cinfo->out_color_components = 3;
+    cinfo->output_components    = 3;
 
     img->colorspace = (primary == CUPS_IMAGE_RGB_CMYK) ? CUPS_IMAGE_RGB : primary;
   }
 
-  jpeg_calc_output_dimensions(&cinfo);
+  jpeg_calc_output_dimensions(cinfo);
 
-  if (cinfo.output_width <= 0 || cinfo.output_width > CUPS_IMAGE_MAX_WIDTH ||
-      cinfo.output_height <= 0 || cinfo.output_height > CUPS_IMAGE_MAX_HEIGHT)
+  if (cinfo->output_width <= 0 || cinfo->output_width > CUPS_IMAGE_MAX_WIDTH ||
+      cinfo->output_height <= 0 || cinfo->output_height > CUPS_IMAGE_MAX_HEIGHT)
   {
     fprintf(stderr, "DEBUG: Bad JPEG dimensions %dx%d!\n",
-            cinfo.output_width, cinfo.output_height);
-
-    jpeg_destroy_decompress(&cinfo);
+            cinfo->output_width, cinfo->output_height);
 
-    fclose(fp);
+    close_jpeg(js);
     return (1);
   }
 
-  img->xsize      = cinfo.output_width;
-  img->ysize      = cinfo.output_height;
+  img->xsize      = cinfo->output_width;
+  img->ysize      = cinfo->output_height;
 
-  if (cinfo.X_density > 0 && cinfo.Y_density > 0 && cinfo.density_unit > 0)
+  if (cinfo->X_density > 0 && cinfo->Y_density > 0 && cinfo->density_unit > 0)
   {
-    if (cinfo.density_unit == 1)
+    if (cinfo->density_unit == 1)
     {
-      img->xppi = cinfo.X_density;
-      img->yppi = cinfo.Y_density;
+      img->xppi = cinfo->X_density;
+      img->yppi = cinfo->Y_density;
     }
     else
     {
-      img->xppi = (int)((float)cinfo.X_density * 2.54);
-      img->yppi = (int)((float)cinfo.Y_density * 2.54);
+      img->xppi = (int)((float)cinfo->X_density * 2.54);
+      img->yppi = (int)((float)cinfo->Y_density * 2.54);
     }
 
     if (img->xppi == 0 || img->yppi == 0)
@@ -156,156 +196,250 @@ _cupsImageReadJPEG(
   }
 
   fprintf(stderr, "DEBUG: JPEG image %dx%dx%d, %dx%d PPI\n",
-          img->xsize, img->ysize, cinfo.output_components,
+          img->xsize, img->ysize, cinfo->output_components,
 	  img->xppi, img->yppi);
 
-  cupsImageSetMaxTiles(img, 0);
+  if ((scale = _cupsImageReduceFactor(img)) > 1)
+  {
+   /*
+    * Let the decoder do as much of the reduction as it can with DCT
+    * scaling, any remaining reduction is done while reading...
+    */
 
-  in  = malloc(img->xsize * cinfo.output_components);
-  out = malloc(img->xsize * cupsImageGetDepth(img));
+    cinfo->scale_num   = 1;
+    cinfo->scale_denom = scale >= 8 ? 8 : scale >= 4 ? 4 : 2;
 
-  jpeg_start_decompress(&cinfo);
+    jpeg_calc_output_dimensions(cinfo);
 
-  while (cinfo.output_scanline < cinfo.output_height)
+    fprintf(stderr, "DEBUG: Decoding JPEG image at 1/%d size, %dx%d\n",
+            cinfo->scale_denom, cinfo->output_width, cinfo->output_height);
+
+    _cupsImageReduceSize(img, cinfo->output_width, cinfo->output_height);
+  }
+
+  js->width = img->xsize;
+  js->in    = malloc(img->xsize * cinfo->output_components);
+
+  if (!js->in)
   {
-    jpeg_read_scanlines(&cinfo, (JSAMPROW *)&in, (JDIMENSION)1);
+    fputs("DEBUG: Unable to allocate memory for JPEG image!\n", stderr);
+    close_jpeg(js);
+    return (1);
+  }
 
-    if (psjpeg && cinfo.output_components == 4)
-    {
-     /*
-      * Invert CMYK data from Photoshop...
-      */
+  jpeg_start_decompress(cinfo);
 
-      cups_ib_t	*ptr;	/* Pointer into buffer */
-      int	i;	/* Looping var */
+  if (img->source)
+  {
+   /*
+    * Rows are decoded as they are read...
+    */
 
+    img->source->read  = read_jpeg_row;
+    img->source->close = close_jpeg;
+    img->source->data  = js;
 
-      for (ptr = in, i = img->xsize * 4; i > 0; i --, ptr ++)
-        *ptr = 255 - *ptr;
-    }
+    _cupsImageReduceStart(img);
 
-    if ((saturation != 100 || hue != 0) && cinfo.output_components == 3)
-      cupsImageRGBAdjust(in, img->xsize, saturation, hue);
+    return (0);
+  }
 
-    if ((img->colorspace == CUPS_IMAGE_WHITE && cinfo.out_color_space == JCS_GRAYSCALE) ||
-	(img->colorspace == CUPS_IMAGE_CMYK && cinfo.out_color_space == JCS_CMYK))
-    {
-#ifdef DEBUG
-      int	i, j;
-      cups_ib_t	*ptr;
+  _cupsImageReduceStart(img);
+  cupsImageSetMaxTiles(img, 0);
 
+  if ((out = malloc(js->width * cupsImageGetDepth(img))) == NULL)
+  {
+    fputs("DEBUG: Unable to allocate memory for JPEG image!\n", stderr);
+    close_jpeg(js);
+    return (1);
+  }
 
-      fputs("DEBUG: Direct Data...\n", stderr);
+  while (cinfo->output_scanline < cinfo->output_height)
+  {
+    decode_jpeg_row(img, js, out);
+
+    _cupsImagePutRow(img, 0, cinfo->output_scanline - 1, js->width, out);
+  }
 
-      fputs("DEBUG:", stderr);
+  free(out);
 
-      for (i = 0, ptr = in; i < img->xsize; i ++)
-      {
-        putc(' ', stderr);
-	for (j = 0; j < cinfo.output_components; j ++, ptr ++)
-	  fprintf(stderr, "%02X", *ptr & 255);
-      }
+  close_jpeg(js);
 
-      putc('\n', stderr);
-#endif /* DEBUG */
+  return (0);
+}
 
-      if (lut)
-        cupsImageLut(in, img->xsize * cupsImageGetDepth(img), lut);
 
-      _cupsImagePutRow(img, 0, cinfo.output_scanline - 1, img->xsize, in);
+/*
+ * 'close_jpeg()' - Free the JPEG decoder.
+ */
+
+static void
+close_jpeg(void *data)			/* I - Decoder state */
+{
+  jpeg_state_t	*js = (jpeg_state_t *)data;
+					/* Decoder state */
+
+
+  if (js->cinfo.output_height > 0 &&
+      js->cinfo.output_scanline >= js->cinfo.output_height)
+    jpeg_finish_decompress(&(js->cinfo));
+
+  jpeg_destroy_decompress(&(js->cinfo));
+
+  fclose(js->fp);
+  free(js->in);
+  free(js);
+}
+
+
+/*
+ * 'decode_jpeg_row()' - Decode and convert the next row.
+ */
+
+static void
+decode_jpeg_row(cups_image_t *img,	/* I - Image */
+                jpeg_state_t *js,	/* I - Decoder state */
+                cups_ib_t    *out)	/* O - Output pixels */
+{
+  struct jpeg_decompress_struct	*cinfo = &(js->cinfo);
+					/* Decompressor info */
+  cups_ib_t	*in = js->in;		/* Input pixels */
+
+
+  jpeg_read_scanlines(cinfo, (JSAMPROW *)&in, (JDIMENSION)1);
+
+  if (js->psjpeg && cinfo->output_components == 4)
+  {
+   /*
+    * Invert CMYK data from Photoshop...
+    */
+
+    cups_ib_t	*ptr;	/* Pointer into buffer */
+    int		i;	/* Looping var */
+
+
+    for (ptr = in, i = js->width * 4; i > 0; i --, ptr ++)
+      *ptr = 255 - *ptr;
+  }
+
+  if ((js->saturation != 100 || js->hue != 0) &&
+      cinfo->output_components == 3)
+    cupsImageRGBAdjust(in, js->width, js->saturation, js->hue);
+
+  if ((img->colorspace == CUPS_IMAGE_WHITE && cinfo->out_color_space == JCS_GRAYSCALE) ||
+      (img->colorspace == CUPS_IMAGE_CMYK && cinfo->out_color_space == JCS_CMYK))
+  {
+#ifdef DEBUG
+    int		i, j;
+    cups_ib_t	*ptr;
+
+
+    fputs("DEBUG: Direct Data...\n", stderr);
+
+    fputs("DEBUG:", stderr);
+
+    for (i = 0, ptr = in; i < js->width; i ++)
+    {
+      putc(' ', stderr);
+      for (j = 0; j < cinfo->output_components; j ++, ptr ++)
+	fprintf(stderr, "%02X", *ptr & 255);
     }
-    else if (cinfo.out_color_space == JCS_GRAYSCALE)
+
+    putc('\n', stderr);
+#endif /* DEBUG */
+
+    memcpy(out, in, js->width * cupsImageGetDepth(img));
+  }
+  else if (cinfo->out_color_space == JCS_GRAYSCALE)
+  {
+    switch (img->colorspace)
     {
-      switch (img->colorspace)
-      {
-        default :
-	    break;
-
-        case CUPS_IMAGE_BLACK :
-            cupsImageWhiteToBlack(in, out, img->xsize);
-            break;
-        case CUPS_IMAGE_RGB :
-            cupsImageWhiteToRGB(in, out, img->xsize);
-            break;
-        case CUPS_IMAGE_CMY :
-            cupsImageWhiteToCMY(in, out, img->xsize);
-            break;
-        case CUPS_IMAGE_CMYK :
-            cupsImageWhiteToCMYK(in, out, img->xsize);
-            break;
-      }
-
-      if (lut)
-        cupsImageLut(out, img->xsize * cupsImageGetDepth(img), lut);
-
-      _cupsImagePutRow(img, 0, cinfo.output_scanline - 1, img->xsize, out);
+      default :
+	  break;
+
+      case CUPS_IMAGE_BLACK :
+	  cupsImageWhiteToBlack(in, out, js->width);
+	  break;
+      case CUPS_IMAGE_RGB :
+	  cupsImageWhiteToRGB(in, out, js->width);
+	  break;
+      case CUPS_IMAGE_CMY :
+	  cupsImageWhiteToCMY(in, out, js->width);
+	  break;
+      case CUPS_IMAGE_CMYK :
+	  cupsImageWhiteToCMYK(in, out, js->width);
+	  break;
     }
-    else if (cinfo.out_color_space == JCS_RGB)
+  }
+  else if (cinfo->out_color_space == JCS_RGB)
+  {
+    switch (img->colorspace)
     {
-      switch (img->colorspace)
-      {
-        default :
-	    break;
-
-        case CUPS_IMAGE_RGB :
-            cupsImageRGBToRGB(in, out, img->xsize);
-	    break;
-        case CUPS_IMAGE_WHITE :
-            cupsImageRGBToWhite(in, out, img->xsize);
-            break;
-        case CUPS_IMAGE_BLACK :
-            cupsImageRGBToBlack(in, out, img->xsize);
-            break;
-        case CUPS_IMAGE_CMY :
-            cupsImageRGBToCMY(in, out, img->xsize);
-            break;
-        case CUPS_IMAGE_CMYK :
-            cupsImageRGBToCMYK(in, out, img->xsize);
-            break;
-      }
-
-      if (lut)
-        cupsImageLut(out, img->xsize * cupsImageGetDepth(img), lut);
-
-      _cupsImagePutRow(img, 0, cinfo.output_scanline - 1, img->xsize, out);
+      default :
+	  break;
+
+      case CUPS_IMAGE_RGB :
+	  cupsImageRGBToRGB(in, out, js->width);
+	  break;
+      case CUPS_IMAGE_WHITE :
+	  cupsImageRGBToWhite(in, out, js->width);
+	  break;
+      case CUPS_IMAGE_BLACK :
+	  cupsImageRGBToBlack(in, out, js->width);
+	  break;
+      case CUPS_IMAGE_CMY :
+	  cupsImageRGBToCMY(in, out, js->width);
+	  break;
+      case CUPS_IMAGE_CMYK :
+	  cupsImageRGBToCMYK(in, out, js->width);
+	  break;
     }
-    else /* JCS_CMYK */
+  }
+  else /* JCS_CMYK */
+  {
+    fputs("DEBUG: JCS_CMYK\n", stderr);
+
+    switch (img->colorspace)
     {
-      fputs("DEBUG: JCS_CMYK\n", stderr);
-
-      switch (img->colorspace)
-      {
-        default :
-	    break;
-
-        case CUPS_IMAGE_WHITE :
-            cupsImageCMYKToWhite(in, out, img->xsize);
-            break;
-        case CUPS_IMAGE_BLACK :
-            cupsImageCMYKToBlack(in, out, img->xsize);
-            break;
-        case CUPS_IMAGE_CMY :
-            cupsImageCMYKToCMY(in, out, img->xsize);
-            break;
-        case CUPS_IMAGE_RGB :
-            cupsImageCMYKToRGB(in, out, img->xsize);
-            break;
-      }
-
-      if (lut)
-        cupsImageLut(out, img->xsize * cupsImageGetDepth(img), lut);
-
-      _cupsImagePutRow(img, 0, cinfo.output_scanline - 1, img->xsize, out);
+      default :
+	  break;
+
+      case CUPS_IMAGE_WHITE :
+	  cupsImageCMYKToWhite(in, out, js->width);
+	  break;
+      case CUPS_IMAGE_BLACK :
+	  cupsImageCMYKToBlack(in, out, js->width);
+	  break;
+      case CUPS_IMAGE_CMY :
+	  cupsImageCMYKToCMY(in, out, js->width);
+	  break;
+      case CUPS_IMAGE_RGB :
+	  cupsImageCMYKToRGB(in, out, js->width);
+	  break;
     }
   }
 
-  free(in);
-  free(out);
+  if (js->lut)
+    cupsImageLut(out, js->width * cupsImageGetDepth(img), js->lut);
+}
+
+
+/*
+ * 'read_jpeg_row()' - Read the next row of a streamed JPEG image.
+ */
+
+static int				/* O - -1 on error, 0 on success */
+read_jpeg_row(cups_image_t *img,	/* I - Image */
+              cups_ib_t    *pixels)	/* O - Row pixels */
+{
+  jpeg_state_t	*js = (jpeg_state_t *)img->source->data;
+					/* Decoder state */
+
 
-  jpeg_finish_decompress(&cinfo);
-  jpeg_destroy_decompress(&cinfo);
+  if (js->cinfo.output_scanline >= js->cinfo.output_height)
+    return (-1);
 
-  fclose(fp);
+  decode_jpeg_row(img, js, pixels);
 
   return (0);
 }
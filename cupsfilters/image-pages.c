@@ -0,0 +1,610 @@
+/*
+ *   Multi-page image routines for CUPS.
+ *
+ *   Copyright 2020 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ *   GIF and TIFF files can hold more than one image, like the pages of a
+ *   fax.  cupsImagePagesOpen() counts the pages of a file and selects the
+ *   ones in the "page-ranges" option without decoding any of them, and
+ *   cupsImagePagesNext() returns the selected pages in order.  With more
+ *   than one page selected, the next pages are decoded ahead on a pool of
+ *   threads, each of which reads the file through its own descriptor.
+ *   All pages are decoded with the same xsize and ysize limits, so the
+ *   caller gets every page at the size it chose for the first one; the
+ *   imagetoraster filter also reuses the first page's layout and crop.
+ *
+ * Contents:
+ *
+ *   cupsImagePagesClose()  - Close the pages of an image file.
+ *   cupsImagePagesCount()  - Get the number of selected pages.
+ *   cupsImagePagesNext()   - Get the next selected page.
+ *   cupsImagePagesOpen()   - Open the pages of an image file.
+ *   cupsImagePagesRewind() - Go back to the first selected page.
+ *   count_pages()          - Count the pages of an image file.
+ *   page_selected()        - Check whether a page is in the page ranges.
+ *   pages_decode()         - Decode a page.
+ *   pages_thread()         - Decode pages ahead of the caller.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "image-private.h"
+#include <fcntl.h>
+#ifdef HAVE_PTHREAD_H
+#  include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+
+/*
+ * Constants...
+ */
+
+#define CUPS_PAGES_THREADS	8	/* Maximum number of decoding threads */
+
+
+/*
+ * Types and structures...
+ */
+
+#ifdef HAVE_PTHREAD_H
+typedef struct cups_ipworker_s		/**** Page decoding thread ****/
+{
+  struct cups_ipages_s	*pages;		/* Pages to decode */
+  int			fd;		/* Image file of this thread */
+  pthread_t		thread;		/* Thread */
+} cups_ipworker_t;
+#endif /* HAVE_PTHREAD_H */
+
+struct cups_ipages_s			/**** Pages of a multi-page image ****/
+{
+  cups_icspace_t	primary,	/* Primary colorspace */
+			secondary;	/* Secondary colorspace */
+  int			saturation,	/* Color saturation */
+			hue;		/* Color hue */
+  const cups_ib_t	*lut;		/* Gamma/brightness LUT */
+  unsigned		xsize,		/* Width of fit box or 0 */
+			ysize;		/* Height of fit box or 0 */
+  int			fd,		/* Image file */
+			num_pages,	/* Number of pages in file */
+			count,		/* Number of selected pages */
+			*pages,		/* Selected pages, starting at 0 */
+			next;		/* Next selected page to return */
+  cups_image_t		**images;	/* Pages decoded ahead */
+  int			*done;		/* Non-zero when a page is decoded */
+#ifdef HAVE_PTHREAD_H
+  int			num_threads,	/* Number of decoding threads */
+			decode,		/* Next selected page to decode */
+			generation,	/* Incremented when rewinding */
+			shutdown;	/* Non-zero to stop the threads */
+  pthread_mutex_t	mutex;		/* Mutex for the pages */
+  pthread_cond_t	cond;		/* Page decoded or returned */
+  cups_ipworker_t	workers[CUPS_PAGES_THREADS];
+					/* Decoding threads */
+#endif /* HAVE_PTHREAD_H */
+};
+
+
+/*
+ * Local functions...
+ */
+
+static int		count_pages(int fd);
+static int		page_selected(const char *page_ranges, int page);
+static cups_image_t	*pages_decode(cups_ipages_t *pages, int fd, int page,
+			              int stream);
+#ifdef HAVE_PTHREAD_H
+static void		*pages_thread(void *data);
+#endif /* HAVE_PTHREAD_H */
+
+
+/*
+ * 'cupsImagePagesClose()' - Close the pages of an image file.
+ *
+ * Pages returned by cupsImagePagesNext() stay open until they are closed
+ * with cupsImageClose().
+ */
+
+void
+cupsImagePagesClose(
+    cups_ipages_t *pages)		/* I - Pages of image file */
+{
+  int	i;				/* Looping var */
+
+
+  if (!pages)
+    return;
+
+#ifdef HAVE_PTHREAD_H
+  if (pages->num_threads > 0)
+  {
+    pthread_mutex_lock(&pages->mutex);
+    pages->shutdown = 1;
+    pthread_cond_broadcast(&pages->cond);
+    pthread_mutex_unlock(&pages->mutex);
+
+    for (i = 0; i < pages->num_threads; i ++)
+    {
+      pthread_join(pages->workers[i].thread, NULL);
+      close(pages->workers[i].fd);
+    }
+
+    pthread_cond_destroy(&pages->cond);
+    pthread_mutex_destroy(&pages->mutex);
+  }
+#endif /* HAVE_PTHREAD_H */
+
+  for (i = 0; i < pages->count; i ++)
+    if (pages->images[i])
+      cupsImageClose(pages->images[i]);
+
+  close(pages->fd);
+
+  free(pages->pages);
+  free(pages->images);
+  free(pages->done);
+  free(pages);
+}
+
+
+/*
+ * 'cupsImagePagesCount()' - Get the number of selected pages.
+ */
+
+int					/* O - Number of selected pages */
+cupsImagePagesCount(
+    cups_ipages_t *pages)		/* I - Pages of image file */
+{
+  return (pages ? pages->count : 0);
+}
+
+
+/*
+ * 'cupsImagePagesNext()' - Get the next selected page.
+ *
+ * Returns NULL after the last selected page, with "page" set to 0, or
+ * when the page cannot be read, with "page" set to its number (starting
+ * at 1).  The returned image is closed with cupsImageClose().
+ */
+
+cups_image_t *				/* O - Page image or NULL */
+cupsImagePagesNext(
+    cups_ipages_t *pages,		/* I - Pages of image file */
+    int           *page)		/* O - Page number or NULL */
+{
+  int		i;			/* Selected page */
+  cups_image_t	*img;			/* Page image */
+
+
+  if (!pages || pages->next >= pages->count)
+  {
+    if (page)
+      *page = 0;
+
+    return (NULL);
+  }
+
+  i = pages->next;
+
+  if (page)
+    *page = pages->pages[i] + 1;
+
+#ifdef HAVE_PTHREAD_H
+  if (pages->num_threads > 0)
+  {
+   /*
+    * Wait for the page to be decoded, the threads can then go on with the
+    * page after the last one decoded ahead...
+    */
+
+    pthread_mutex_lock(&pages->mutex);
+
+    while (!pages->done[i])
+      pthread_cond_wait(&pages->cond, &pages->mutex);
+
+    img               = pages->images[i];
+    pages->images[i]  = NULL;
+    pages->next ++;
+
+    pthread_cond_broadcast(&pages->cond);
+    pthread_mutex_unlock(&pages->mutex);
+
+    return (img);
+  }
+#endif /* HAVE_PTHREAD_H */
+
+ /*
+  * Decode the page now; a single page is streamed like with
+  * cupsImageOpenStream()...
+  */
+
+  pages->next ++;
+
+  return (pages_decode(pages, pages->fd, pages->pages[i], pages->count == 1));
+}
+
+
+/*
+ * 'cupsImagePagesOpen()' - Open the pages of an image file.
+ *
+ * The pages of GIF (images of an animation) and TIFF files are counted
+ * and those in "page-ranges" ("1-3,5,8-" like the IPP attribute, NULL or
+ * empty for all pages) selected, without decoding any page.  The pages
+ * are decoded like with cupsImageOpenFit(); a single page image is always
+ * selected and streamed like with cupsImageOpenStream().
+ *
+ * With more than one page selected, up to "num_threads" pages are decoded
+ * ahead of the caller on as many threads; pass 0 for one thread per
+ * processor.  The file can be removed once it is opened.
+ */
+
+cups_ipages_t *				/* O - Pages of image file or NULL */
+cupsImagePagesOpen(
+    const char      *filename,		/* I - Filename of image */
+    cups_icspace_t  primary,		/* I - Primary colorspace needed */
+    cups_icspace_t  secondary,		/* I - Secondary colorspace if primary no good */
+    int             saturation,		/* I - Color saturation level */
+    int             hue,		/* I - Color hue adjustment */
+    const cups_ib_t *lut,		/* I - RGB gamma/brightness LUT */
+    unsigned        xsize,		/* I - Width of fit box or 0 */
+    unsigned        ysize,		/* I - Height of fit box or 0 */
+    const char      *page_ranges,	/* I - Pages to select or NULL */
+    int             num_threads)	/* I - Number of threads or 0 */
+{
+  cups_ipages_t	*pages;			/* Pages of image file */
+  int		i;			/* Looping var */
+
+
+  DEBUG_printf(("cupsImagePagesOpen(\"%s\", %d, %d, %d, %d, %p, %u, %u, "
+                "\"%s\", %d)\n", filename ? filename : "(null)", primary,
+		secondary, saturation, hue, lut, xsize, ysize,
+		page_ranges ? page_ranges : "(null)", num_threads));
+
+  if ((pages = calloc(1, sizeof(cups_ipages_t))) == NULL)
+    return (NULL);
+
+  if ((pages->fd = open(filename, O_RDONLY)) < 0)
+  {
+    free(pages);
+    return (NULL);
+  }
+
+  pages->primary    = primary;
+  pages->secondary  = secondary;
+  pages->saturation = saturation;
+  pages->hue        = hue;
+  pages->lut        = lut;
+  pages->xsize      = xsize;
+  pages->ysize      = ysize;
+
+ /*
+  * Select the pages...
+  */
+
+  if ((pages->num_pages = count_pages(pages->fd)) < 1)
+    pages->num_pages = 1;
+
+  DEBUG_printf(("Image file has %d page(s).", pages->num_pages));
+
+  pages->pages  = calloc(pages->num_pages, sizeof(int));
+  pages->images = calloc(pages->num_pages, sizeof(cups_image_t *));
+  pages->done   = calloc(pages->num_pages, sizeof(int));
+
+  if (!pages->pages || !pages->images || !pages->done)
+  {
+    cupsImagePagesClose(pages);
+    return (NULL);
+  }
+
+  for (i = 0; i < pages->num_pages; i ++)
+    if (pages->num_pages == 1 || page_selected(page_ranges, i + 1))
+      pages->pages[pages->count ++] = i;
+
+#ifdef HAVE_PTHREAD_H
+ /*
+  * Start the threads to decode more than one page...
+  */
+
+  if (num_threads <= 0)
+    num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (num_threads > CUPS_PAGES_THREADS)
+    num_threads = CUPS_PAGES_THREADS;
+
+  if (num_threads > pages->count)
+    num_threads = pages->count;
+
+  if (pages->count > 1)
+  {
+   /*
+    * The threads may adjust the colors of RGB images at the same time, so
+    * build the shared lookup table for that first...
+    */
+
+    cups_ib_t	rgb[3] = { 0, 0, 0 };	/* Color to adjust */
+
+    if (saturation != 100 || hue != 0)
+      cupsImageRGBAdjust(rgb, 1, saturation, hue);
+
+    pthread_mutex_init(&pages->mutex, NULL);
+    pthread_cond_init(&pages->cond, NULL);
+
+   /*
+    * The threads wait for the mutex until all of them are started, so
+    * that they see the final number of threads...
+    */
+
+    pthread_mutex_lock(&pages->mutex);
+
+    for (i = 0; i < num_threads; i ++)
+    {
+      pages->workers[i].pages = pages;
+
+      if ((pages->workers[i].fd = open(filename, O_RDONLY)) < 0)
+        break;
+
+      if (pthread_create(&pages->workers[i].thread, NULL, pages_thread,
+                         pages->workers + i))
+      {
+        close(pages->workers[i].fd);
+	break;
+      }
+
+      pages->num_threads ++;
+    }
+
+    pthread_mutex_unlock(&pages->mutex);
+
+    if (pages->num_threads == 0)
+    {
+      pthread_cond_destroy(&pages->cond);
+      pthread_mutex_destroy(&pages->mutex);
+    }
+    else
+      DEBUG_printf(("Decoding %d pages with %d threads.", pages->count,
+                    pages->num_threads));
+  }
+#else
+  (void)num_threads;
+#endif /* HAVE_PTHREAD_H */
+
+  return (pages);
+}
+
+
+/*
+ * 'cupsImagePagesRewind()' - Go back to the first selected page.
+ *
+ * The selected pages are then decoded again, as for collated copies.
+ */
+
+void
+cupsImagePagesRewind(
+    cups_ipages_t *pages)		/* I - Pages of image file */
+{
+  int	i;				/* Looping var */
+
+
+  if (!pages)
+    return;
+
+#ifdef HAVE_PTHREAD_H
+  if (pages->num_threads > 0)
+    pthread_mutex_lock(&pages->mutex);
+#endif /* HAVE_PTHREAD_H */
+
+  for (i = 0; i < pages->count; i ++)
+  {
+    if (pages->images[i])
+      cupsImageClose(pages->images[i]);
+
+    pages->images[i] = NULL;
+    pages->done[i]   = 0;
+  }
+
+  pages->next = 0;
+
+#ifdef HAVE_PTHREAD_H
+  if (pages->num_threads > 0)
+  {
+   /*
+    * Pages which are being decoded now are thrown away when done...
+    */
+
+    pages->decode = 0;
+    pages->generation ++;
+
+    pthread_cond_broadcast(&pages->cond);
+    pthread_mutex_unlock(&pages->mutex);
+  }
+#endif /* HAVE_PTHREAD_H */
+}
+
+
+/*
+ * 'count_pages()' - Count the pages of an image file.
+ */
+
+static int				/* O - Number of pages or -1 */
+count_pages(int fd)			/* I - Image file */
+{
+  FILE		*fp;			/* Image file */
+  unsigned char	header[4];		/* First bytes of file */
+  int		dupfd,			/* Duplicate of image file */
+		num_pages = 1;		/* Number of pages */
+
+
+  if ((dupfd = dup(fd)) < 0)
+    return (-1);
+
+  if ((fp = fdopen(dupfd, "r")) == NULL)
+  {
+    close(dupfd);
+    return (-1);
+  }
+
+  if (fread(header, 1, sizeof(header), fp) != sizeof(header))
+    num_pages = -1;
+  else if (!memcmp(header, "GIF8", 4))
+    num_pages = _cupsImageNumPagesGIF(fp);
+#ifdef HAVE_LIBTIFF
+  else if (!memcmp(header, "MM\000\052", 4) ||
+           !memcmp(header, "II\052\000", 4))
+    num_pages = _cupsImageNumPagesTIFF(fp);
+#endif /* HAVE_LIBTIFF */
+
+  fclose(fp);
+
+  return (num_pages);
+}
+
+
+/*
+ * 'page_selected()' - Check whether a page is in the page ranges.
+ */
+
+static int				/* O - 1 if selected, 0 otherwise */
+page_selected(const char *page_ranges,	/* I - Selection of pages or NULL */
+              int        page)		/* I - Page number */
+{
+  const char	*range;			/* Pointer into range string */
+  int		lower, upper;		/* Lower and upper page numbers */
+
+
+  if (!page_ranges || page_ranges[0] == '\0')
+    return (1);				/* No range, select all pages... */
+
+  for (range = page_ranges; *range != '\0';)
+  {
+    if (*range == '-')
+    {
+      lower = 1;
+      range ++;
+      upper = (int)strtol(range, (char **)&range, 10);
+    }
+    else
+    {
+      lower = (int)strtol(range, (char **)&range, 10);
+
+      if (*range == '-')
+      {
+        range ++;
+	if (!isdigit(*range & 255))
+	  upper = 65535;
+	else
+	  upper = (int)strtol(range, (char **)&range, 10);
+      }
+      else
+        upper = lower;
+    }
+
+    if (page >= lower && page <= upper)
+      return (1);
+
+    if (*range == ',')
+      range ++;
+    else
+      break;
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'pages_decode()' - Decode a page.
+ *
+ * The file descriptor must only be used by one thread at a time.
+ */
+
+static cups_image_t *			/* O - Page image or NULL */
+pages_decode(cups_ipages_t *pages,	/* I - Pages of image file */
+             int           fd,		/* I - Image file */
+	     int           page,	/* I - Page, starting at 0 */
+	     int           stream)	/* I - Stream rows? */
+{
+  FILE	*fp;				/* Image file */
+  int	dupfd;				/* Duplicate of image file */
+
+
+  if ((dupfd = dup(fd)) < 0)
+    return (NULL);
+
+  if (lseek(dupfd, 0, SEEK_SET) < 0 || (fp = fdopen(dupfd, "r")) == NULL)
+  {
+    close(dupfd);
+    return (NULL);
+  }
+
+  DEBUG_printf(("Decoding page %d of image file.", page + 1));
+
+  return (_cupsImageOpenFP(fp, pages->primary, pages->secondary,
+                           pages->saturation, pages->hue, pages->lut,
+			   pages->xsize, pages->ysize, stream, page));
+}
+
+
+#ifdef HAVE_PTHREAD_H
+/*
+ * 'pages_thread()' - Decode pages ahead of the caller.
+ *
+ * No more pages are decoded ahead than there are threads, so that the
+ * memory used stays bounded for long documents.
+ */
+
+static void *				/* O - Thread exit status */
+pages_thread(void *data)		/* I - Decoding thread */
+{
+  cups_ipworker_t	*worker = (cups_ipworker_t *)data;
+					/* Decoding thread */
+  cups_ipages_t		*pages = worker->pages;
+					/* Pages of image file */
+  cups_image_t		*img;		/* Page image */
+  int			i,		/* Selected page to decode */
+			generation;	/* Generation of the page */
+
+
+  pthread_mutex_lock(&pages->mutex);
+
+  for (;;)
+  {
+    while (!pages->shutdown &&
+           (pages->decode >= pages->count ||
+	    pages->decode >= pages->next + pages->num_threads))
+      pthread_cond_wait(&pages->cond, &pages->mutex);
+
+    if (pages->shutdown)
+      break;
+
+    i          = pages->decode ++;
+    generation = pages->generation;
+
+    pthread_mutex_unlock(&pages->mutex);
+
+    img = pages_decode(pages, worker->fd, pages->pages[i], 0);
+
+    pthread_mutex_lock(&pages->mutex);
+
+    if (generation != pages->generation)
+    {
+      if (img)
+        cupsImageClose(img);
+    }
+    else
+    {
+      pages->images[i] = img;
+      pages->done[i]   = 1;
+
+      pthread_cond_broadcast(&pages->cond);
+    }
+  }
+
+  pthread_mutex_unlock(&pages->mutex);
+
+  return (NULL);
+}
+#endif /* HAVE_PTHREAD_H */
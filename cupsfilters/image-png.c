@@ -12,6 +12,9 @@
  * Contents:
  *
  *   _cupsImageReadPNG() - Read a PNG image file.
+ *   close_png()         - Free the PNG decoder.
+ *   convert_png_row()   - Convert a decoded row.
+ *   read_png_row()      - Read the next row of a streamed PNG image.
  */
 
 /*
@@ -24,6 +27,34 @@
 #  include <png.h>	/* Portable Network Graphics (PNG) definitions */
 
 
+/*
+ * Local types...
+ */
+
+typedef struct cups_png_state_s		/**** PNG decoder state ****/
+{
+  png_structp		pp;		/* PNG read pointer */
+  png_infop		info;		/* PNG info pointers */
+  FILE			*fp;		/* Image file */
+  cups_ib_t		*in;		/* Input pixels */
+  int			width,		/* Width of decoded rows */
+			color,		/* Non-zero for RGB rows */
+			saturation,	/* Color saturation (%) */
+			hue;		/* Color hue (degrees) */
+  const cups_ib_t	*lut;		/* Lookup table for gamma/brightness */
+} cups_png_state_t;
+
+
+/*
+ * Local functions...
+ */
+
+static void	close_png(void *data);
+static void	convert_png_row(cups_image_t *img, cups_png_state_t *ps,
+		                cups_ib_t *in, cups_ib_t *out);
+static int	read_png_row(cups_image_t *img, cups_ib_t *pixels);
+
+
 /*
  * '_cupsImageReadPNG()' - Read a PNG image file.
  */
@@ -57,6 +88,8 @@ _cupsImageReadPNG(
 		*inptr,			/* Pointer into pixels */
 		*out;			/* Output pixels */
   png_color_16	bg;			/* Background color */
+  cups_png_state_t state,		/* Decoder state */
+		*ps;			/* Streamed decoder state */
 
 
  /*
@@ -130,8 +163,6 @@ _cupsImageReadPNG(
     }
   }
 
-  cupsImageSetMaxTiles(img, 0);
-
   passes = png_set_interlace_handling(pp);
 
  /*
@@ -215,6 +246,38 @@ _cupsImageReadPNG(
     return (1);
   }
 
+  state.pp         = pp;
+  state.info       = info;
+  state.fp         = fp;
+  state.in         = in;
+  state.width      = img->xsize;
+  state.color      = color_type & PNG_COLOR_MASK_COLOR;
+  state.saturation = saturation;
+  state.hue        = hue;
+  state.lut        = lut;
+
+  if (img->source && passes == 1 && (ps = malloc(sizeof(state))) != NULL)
+  {
+   /*
+    * Rows are decoded as they are read...
+    */
+
+    *ps = state;
+
+    free(out);
+
+    img->source->read  = read_png_row;
+    img->source->close = close_png;
+    img->source->data  = ps;
+
+    _cupsImageReduceStart(img);
+
+    return (0);
+  }
+
+  _cupsImageReduceStart(img);
+  cupsImageSetMaxTiles(img, 0);
+
  /*
   * Read the image, interlacing as needed...
   */
@@ -226,60 +289,7 @@ _cupsImageReadPNG(
 
       if (pass == passes)
       {
-       /*
-        * Output this row...
-	*/
-
-	if (color_type & PNG_COLOR_MASK_COLOR)
-	{
-	  if ((saturation != 100 || hue != 0) && bpp > 1)
-	    cupsImageRGBAdjust(inptr, img->xsize, saturation, hue);
-
-	  switch (img->colorspace)
-	  {
-	    case CUPS_IMAGE_WHITE :
-		cupsImageRGBToWhite(inptr, out, img->xsize);
-		break;
-	    case CUPS_IMAGE_RGB :
-	    case CUPS_IMAGE_RGB_CMYK :
-		cupsImageRGBToRGB(inptr, out, img->xsize);
-		break;
-	    case CUPS_IMAGE_BLACK :
-		cupsImageRGBToBlack(inptr, out, img->xsize);
-		break;
-	    case CUPS_IMAGE_CMY :
-		cupsImageRGBToCMY(inptr, out, img->xsize);
-		break;
-	    case CUPS_IMAGE_CMYK :
-		cupsImageRGBToCMYK(inptr, out, img->xsize);
-		break;
-	  }
-	}
-	else
-	{
-	  switch (img->colorspace)
-	  {
-	    case CUPS_IMAGE_WHITE :
-		memcpy(out, inptr, img->xsize);
-		break;
-	    case CUPS_IMAGE_RGB :
-	    case CUPS_IMAGE_RGB_CMYK :
-		cupsImageWhiteToRGB(inptr, out, img->xsize);
-		break;
-	    case CUPS_IMAGE_BLACK :
-		cupsImageWhiteToBlack(inptr, out, img->xsize);
-		break;
-	    case CUPS_IMAGE_CMY :
-		cupsImageWhiteToCMY(inptr, out, img->xsize);
-		break;
-	    case CUPS_IMAGE_CMYK :
-		cupsImageWhiteToCMYK(inptr, out, img->xsize);
-		break;
-	  }
-	}
-
-	if (lut)
-	  cupsImageLut(out, img->xsize * bpp, lut);
+	convert_png_row(img, &state, inptr, out);
 
 	_cupsImagePutRow(img, 0, y, img->xsize, out);
       }
@@ -302,5 +312,110 @@ _cupsImageReadPNG(
 
   return (0);
 }
+
+
+/*
+ * 'close_png()' - Free the PNG decoder.
+ */
+
+static void
+close_png(void *data)			/* I - Decoder state */
+{
+  cups_png_state_t	*ps = (cups_png_state_t *)data;
+					/* Decoder state */
+
+
+  png_destroy_read_struct(&(ps->pp), &(ps->info), NULL);
+
+  fclose(ps->fp);
+  free(ps->in);
+  free(ps);
+}
+
+
+/*
+ * 'convert_png_row()' - Convert a decoded row.
+ */
+
+static void
+convert_png_row(cups_image_t     *img,	/* I - Image */
+                cups_png_state_t *ps,	/* I - Decoder state */
+                cups_ib_t        *in,	/* I - Decoded row */
+                cups_ib_t        *out)	/* O - Output pixels */
+{
+  int	bpp = cupsImageGetDepth(img);	/* Bytes per pixel */
+
+
+  if (ps->color)
+  {
+    if ((ps->saturation != 100 || ps->hue != 0) && bpp > 1)
+      cupsImageRGBAdjust(in, ps->width, ps->saturation, ps->hue);
+
+    switch (img->colorspace)
+    {
+      case CUPS_IMAGE_WHITE :
+	  cupsImageRGBToWhite(in, out, ps->width);
+	  break;
+      case CUPS_IMAGE_RGB :
+      case CUPS_IMAGE_RGB_CMYK :
+	  cupsImageRGBToRGB(in, out, ps->width);
+	  break;
+      case CUPS_IMAGE_BLACK :
+	  cupsImageRGBToBlack(in, out, ps->width);
+	  break;
+      case CUPS_IMAGE_CMY :
+	  cupsImageRGBToCMY(in, out, ps->width);
+	  break;
+      case CUPS_IMAGE_CMYK :
+	  cupsImageRGBToCMYK(in, out, ps->width);
+	  break;
+    }
+  }
+  else
+  {
+    switch (img->colorspace)
+    {
+      case CUPS_IMAGE_WHITE :
+	  memcpy(out, in, ps->width);
+	  break;
+      case CUPS_IMAGE_RGB :
+      case CUPS_IMAGE_RGB_CMYK :
+	  cupsImageWhiteToRGB(in, out, ps->width);
+	  break;
+      case CUPS_IMAGE_BLACK :
+	  cupsImageWhiteToBlack(in, out, ps->width);
+	  break;
+      case CUPS_IMAGE_CMY :
+	  cupsImageWhiteToCMY(in, out, ps->width);
+	  break;
+      case CUPS_IMAGE_CMYK :
+	  cupsImageWhiteToCMYK(in, out, ps->width);
+	  break;
+    }
+  }
+
+  if (ps->lut)
+    cupsImageLut(out, ps->width * bpp, ps->lut);
+}
+
+
+/*
+ * 'read_png_row()' - Read the next row of a streamed PNG image.
+ */
+
+static int				/* O - -1 on error, 0 on success */
+read_png_row(cups_image_t *img,		/* I - Image */
+             cups_ib_t    *pixels)	/* O - Row pixels */
+{
+  cups_png_state_t	*ps = (cups_png_state_t *)img->source->data;
+					/* Decoder state */
+
+
+  png_read_row(ps->pp, (png_bytep)ps->in, NULL);
+
+  convert_png_row(img, ps, ps->in, pixels);
+
+  return (0);
+}
 #endif /* HAVE_LIBPNG && HAVE_LIBZ */
 
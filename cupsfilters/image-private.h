@@ -74,6 +74,8 @@ typedef enum cups_iztype_e		/**** Image zoom type ****/
 } cups_iztype_t;
 
 struct cups_ic_s;
+struct cups_ireduce_s;
+struct cups_isource_s;
 
 typedef struct cups_itile_s		/**** Image tile ****/
 {
@@ -104,8 +106,44 @@ struct cups_image_s			/**** Image file data ****/
 			*last;		/* Last cached tile in image */
   int			cachefile;	/* Tile cache file */
   char			cachename[256];	/* Tile cache filename */
+  unsigned		xfit,		/* Width of box to fit image into */
+			yfit;		/* Height of box to fit image into */
+  struct cups_ireduce_s	*reduce;	/* Box reduction while reading */
+  struct cups_isource_s	*source;	/* Row source of streamed image */
+  int			page;		/* Page to read, 0 for the first */
 };
 
+typedef struct cups_ireduce_s		/**** Image box reduction ****/
+{
+  cups_image_t		*img;		/* Reduced image */
+  unsigned		factor,		/* Reduction factor */
+			length,		/* Length of input lines in pixels */
+			group,		/* Output line of accumulated lines */
+			count,		/* Number of accumulated lines */
+			lines;		/* Number of input lines (streamed) */
+  int			column;		/* Non-zero if columns are put */
+  unsigned		*sums;		/* Sums of accumulated lines */
+  cups_ib_t		*line,		/* Reduced output line */
+			*in;		/* Input line (streamed) */
+} cups_ireduce_t;
+
+typedef struct cups_isource_s		/**** Streamed image row source ****/
+{
+  int			fd;		/* Image file, for reading it again */
+  cups_icspace_t	primary,	/* Primary colorspace */
+			secondary;	/* Secondary colorspace */
+  int			saturation,	/* Color saturation */
+			hue;		/* Color hue */
+  const cups_ib_t	*lut;		/* Gamma/brightness LUT */
+  int			(*read)(cups_image_t *img, cups_ib_t *pixels);
+					/* Read the next input row */
+  void			(*close)(void *data);
+					/* Free the reader data */
+  void			*data;		/* Reader data */
+  unsigned		y;		/* Next row to read */
+  cups_ib_t		*row;		/* Last row read */
+} cups_isource_t;
+
 struct cups_izoom_s			/**** Image zoom data ****/
 {
   cups_image_t		*img;		/* Image to zoom */
@@ -138,6 +176,14 @@ struct cups_izoom_s			/**** Image zoom data ****/
  * Prototypes...
  */
 
+extern int		_cupsImageNumPagesGIF(FILE *fp);
+extern int		_cupsImageNumPagesTIFF(FILE *fp);
+extern cups_image_t	*_cupsImageOpenFP(FILE *fp, cups_icspace_t primary,
+			                  cups_icspace_t secondary,
+					  int saturation, int hue,
+					  const cups_ib_t *lut,
+					  unsigned xsize, unsigned ysize,
+					  int stream, int page);
 extern int		_cupsImagePutCol(cups_image_t *img, int x, int y,
 			                 int height, const cups_ib_t *pixels);
 extern int		_cupsImagePutRow(cups_image_t *img, int x, int y,
@@ -197,6 +243,15 @@ extern int		_cupsImageReadTIFF(cups_image_t *img, FILE *fp,
 					   cups_icspace_t secondary,
 			                   int saturation, int hue,
 					   const cups_ib_t *lut);
+extern unsigned		_cupsImageReduceFactor(cups_image_t *img);
+extern void		_cupsImageReduceFinish(cups_image_t *img);
+extern int		_cupsImageReduceRead(cups_image_t *img,
+			                     cups_ib_t *pixels);
+extern int		_cupsImageReducePut(cups_image_t *img, int column,
+			                    int line, const cups_ib_t *pixels);
+extern void		_cupsImageReduceSize(cups_image_t *img,
+			                     unsigned xsize, unsigned ysize);
+extern unsigned		_cupsImageReduceStart(cups_image_t *img);
 extern void		_cupsImageZoomDelete(cups_izoom_t *z);
 extern void		_cupsImageZoomFill(cups_izoom_t *z, int iy);
 extern cups_izoom_t	*_cupsImageZoomNew(cups_image_t *img, int xc0, int yc0,
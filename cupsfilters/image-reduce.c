@@ -0,0 +1,447 @@
+/*
+ *   cupsImage box reduction routines for CUPS.
+ *
+ *   Copyright 2020 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ *   Images which are opened with cupsImageOpenFit() only need enough
+ *   pixels to be scaled down into the given box, so readers can reduce
+ *   them while decoding.  A reader calls _cupsImageReduceStart() once
+ *   the size, resolution, and colorspace of the image are known and
+ *   then keeps putting full-size rows or columns; these are averaged
+ *   in boxes of "factor" by "factor" pixels into a smaller image which
+ *   replaces the full-size one when reading is finished.  Streamed
+ *   images are averaged the same way as their rows are read.
+ *
+ * Contents:
+ *
+ *   _cupsImageReduceFactor() - Get the reduction factor for an image.
+ *   _cupsImageReduceFinish() - Finish reading a reduced image.
+ *   _cupsImageReducePut()    - Put a row or column of pixels to a reduced
+ *                              image.
+ *   _cupsImageReduceRead()   - Read a reduced row of a streamed image.
+ *   _cupsImageReduceSize()   - Set the size of a reduced image.
+ *   _cupsImageReduceStart()  - Start reducing an image while reading it.
+ *   reduce_add()             - Add a line to the box sums.
+ *   reduce_flush()           - Output the accumulated lines.
+ *   reduce_line()            - Compute the reduced line from the box sums.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "image-private.h"
+
+
+/*
+ * Limit the factor so that the sums of a box fit into 32 bits...
+ */
+
+#define CUPS_REDUCE_MAX	256
+
+
+/*
+ * Local functions...
+ */
+
+static void	reduce_add(cups_ireduce_t *r, int bpp,
+		           const cups_ib_t *pixels);
+static int	reduce_flush(cups_ireduce_t *r, int bpp);
+static void	reduce_line(cups_ireduce_t *r, int bpp);
+
+
+/*
+ * '_cupsImageReduceFactor()' - Get the reduction factor for an image.
+ *
+ * The image still fills the fit box of cupsImageOpenFit() when it is
+ * reduced by the returned factor; 1 means no reduction.
+ */
+
+unsigned				/* O - Reduction factor */
+_cupsImageReduceFactor(
+    cups_image_t *img)			/* I - Image */
+{
+  unsigned	xfactor,		/* Horizontal factor */
+		yfactor;		/* Vertical factor */
+
+
+  if (img->xfit == 0 || img->yfit == 0)
+    return (1);
+
+ /*
+  * An image which is scaled to fit is limited by the direction with the
+  * larger factor, so that direction still has enough pixels...
+  */
+
+  xfactor = img->xsize / img->xfit;
+  yfactor = img->ysize / img->yfit;
+
+  if (xfactor < yfactor)
+    xfactor = yfactor;
+
+  if (xfactor < 1)
+    return (1);
+  else if (xfactor > CUPS_REDUCE_MAX)
+    return (CUPS_REDUCE_MAX);
+  else
+    return (xfactor);
+}
+
+
+/*
+ * '_cupsImageReduceFinish()' - Finish reading a reduced image.
+ *
+ * The reduced image replaces the full-size image in "img".
+ */
+
+void
+_cupsImageReduceFinish(
+    cups_image_t *img)			/* I - Image being read */
+{
+  cups_ireduce_t	*r = img->reduce;
+					/* Box reduction state */
+  cups_image_t		*reduced = r->img,
+					/* Reduced image */
+			temp;		/* Swap space */
+
+
+  if (r->count > 0)
+    reduce_flush(r, cupsImageGetDepth(img));
+
+  free(r->sums);
+  free(r->line);
+  free(r->in);
+  free(r);
+
+  img->reduce = NULL;
+
+ /*
+  * Swap the image data, so the caller keeps its image pointer...
+  */
+
+  temp         = *img;
+  *img         = *reduced;
+  *reduced     = temp;
+  img->xfit    = temp.xfit;
+  img->yfit    = temp.yfit;
+
+  cupsImageClose(reduced);
+}
+
+
+/*
+ * '_cupsImageReducePut()' - Put a row or column of pixels to a reduced image.
+ *
+ * Only full rows or columns of the full-size image can be put; the lines
+ * of each output line must be put one after another, in any order.
+ */
+
+int					/* O - -1 on error, 0 on success */
+_cupsImageReducePut(
+    cups_image_t    *img,		/* I - Image being read */
+    int             column,		/* I - Non-zero for a column */
+    int             line,		/* I - Row or column number */
+    const cups_ib_t *pixels)		/* I - Pixels to put */
+{
+  cups_ireduce_t	*r = img->reduce;
+					/* Box reduction state */
+  int			bpp;		/* Bytes per pixel */
+  unsigned		outlength;	/* Length of output lines */
+
+
+  if (line < 0 || line >= (int)(column ? img->xsize : img->ysize))
+    return (-1);
+
+  bpp = cupsImageGetDepth(img);
+
+  if (r->sums == NULL || column != r->column)
+  {
+   /*
+    * (Re)allocate the sums for the line length...
+    */
+
+    if (r->count > 0 && reduce_flush(r, bpp))
+      return (-1);
+
+    free(r->sums);
+    free(r->line);
+
+    r->column = column;
+    r->length = column ? img->ysize : img->xsize;
+    outlength = (r->length + r->factor - 1) / r->factor;
+    r->sums   = calloc(outlength * bpp, sizeof(unsigned));
+    r->line   = malloc(outlength * bpp);
+
+    if (!r->sums || !r->line)
+      return (-1);
+  }
+  else if (r->count > 0 && (unsigned)line / r->factor != r->group)
+  {
+   /*
+    * Output the previous, incomplete box line...
+    */
+
+    if (reduce_flush(r, bpp))
+      return (-1);
+  }
+
+  r->group = line / r->factor;
+
+  reduce_add(r, bpp, pixels);
+
+  if (r->count >= r->factor)
+    return (reduce_flush(r, bpp));
+  else
+    return (0);
+}
+
+
+/*
+ * '_cupsImageReduceRead()' - Read a reduced row of a streamed image.
+ */
+
+int					/* O - -1 on error, 0 on success */
+_cupsImageReduceRead(
+    cups_image_t *img,			/* I - Streamed image */
+    cups_ib_t    *pixels)		/* O - Reduced row */
+{
+  cups_ireduce_t	*r = img->reduce;
+					/* Box reduction state */
+  cups_isource_t	*source = img->source;
+					/* Row source */
+  int			bpp;		/* Bytes per pixel */
+  unsigned		line;		/* Current input row */
+
+
+  bpp = cupsImageGetDepth(img);
+
+  for (line = source->y * r->factor;
+       line < (source->y + 1) * r->factor && line < r->lines;
+       line ++)
+  {
+    if ((*source->read)(img, r->in))
+      return (-1);
+
+    reduce_add(r, bpp, r->in);
+  }
+
+  reduce_line(r, bpp);
+  memcpy(pixels, r->line, img->xsize * bpp);
+
+  return (0);
+}
+
+
+/*
+ * '_cupsImageReduceSize()' - Set the size of a reduced image.
+ *
+ * The resolution is scaled with the size, so the image keeps its natural
+ * size in inches.
+ */
+
+void
+_cupsImageReduceSize(
+    cups_image_t *img,			/* I - Image */
+    unsigned     xsize,			/* I - New width */
+    unsigned     ysize)			/* I - New height */
+{
+  img->xppi = (unsigned)(((unsigned long long)img->xppi * xsize +
+                          img->xsize / 2) / img->xsize);
+  img->yppi = (unsigned)(((unsigned long long)img->yppi * ysize +
+                          img->ysize / 2) / img->ysize);
+
+  if (img->xppi < 1)
+    img->xppi = 1;
+  if (img->yppi < 1)
+    img->yppi = 1;
+
+  img->xsize = xsize;
+  img->ysize = ysize;
+}
+
+
+/*
+ * '_cupsImageReduceStart()' - Start reducing an image while reading it.
+ *
+ * Call this when the size, resolution, and colorspace of the image are
+ * known; nothing is done unless the image is larger than needed for the
+ * fit box.  The rows or columns are then put at full size.
+ */
+
+unsigned				/* O - Reduction factor, 1 for none */
+_cupsImageReduceStart(
+    cups_image_t *img)			/* I - Image being read */
+{
+  unsigned	factor;			/* Reduction factor */
+  cups_ireduce_t *r;			/* Box reduction state */
+  cups_image_t	*reduced;		/* Reduced image */
+
+
+  if ((factor = _cupsImageReduceFactor(img)) < 2 || img->reduce)
+    return (1);
+
+  if ((r = calloc(1, sizeof(cups_ireduce_t))) == NULL)
+    return (1);
+
+  r->factor = factor;
+
+  if (img->source && img->source->read)
+  {
+   /*
+    * Streamed images are reduced as rows are read, the reader keeps
+    * producing full-size rows...
+    */
+
+    r->length = img->xsize;
+    r->lines  = img->ysize;
+    r->sums   = calloc(((img->xsize + factor - 1) / factor) *
+                       cupsImageGetDepth(img), sizeof(unsigned));
+    r->line   = malloc(((img->xsize + factor - 1) / factor) *
+                       cupsImageGetDepth(img));
+    r->in     = malloc(img->xsize * cupsImageGetDepth(img));
+
+    if (!r->sums || !r->line || !r->in)
+    {
+      free(r->sums);
+      free(r->line);
+      free(r->in);
+      free(r);
+      return (1);
+    }
+
+    fprintf(stderr, "DEBUG: Reducing %ux%u streamed image by %u...\n",
+            img->xsize, img->ysize, factor);
+
+    _cupsImageReduceSize(img, (img->xsize + factor - 1) / factor,
+                         (img->ysize + factor - 1) / factor);
+
+    img->reduce = r;
+
+    return (factor);
+  }
+
+  if ((reduced = calloc(sizeof(cups_image_t), 1)) == NULL)
+  {
+    free(r);
+    return (1);
+  }
+
+  reduced->cachefile  = -1;
+  reduced->max_ics    = CUPS_TILE_MINIMUM;
+  reduced->colorspace = img->colorspace;
+  reduced->xsize      = img->xsize;
+  reduced->ysize      = img->ysize;
+  reduced->xppi       = img->xppi;
+  reduced->yppi       = img->yppi;
+
+  _cupsImageReduceSize(reduced, (img->xsize + factor - 1) / factor,
+                       (img->ysize + factor - 1) / factor);
+  cupsImageSetMaxTiles(reduced, 0);
+
+  r->img      = reduced;
+  img->reduce = r;
+
+  fprintf(stderr, "DEBUG: Reducing %ux%u image by %u to %ux%u, %ux%u PPI\n",
+          img->xsize, img->ysize, factor, reduced->xsize, reduced->ysize,
+	  reduced->xppi, reduced->yppi);
+
+  return (factor);
+}
+
+
+/*
+ * 'reduce_add()' - Add a line to the box sums.
+ */
+
+static void
+reduce_add(cups_ireduce_t  *r,		/* I - Box reduction state */
+           int             bpp,		/* I - Bytes per pixel */
+           const cups_ib_t *pixels)	/* I - Input line */
+{
+  unsigned	i, j,			/* Looping vars */
+		count;			/* Pixels in this box */
+  unsigned	*sum;			/* Pointer into sums */
+
+
+  for (i = 0, sum = r->sums; i < r->length; i += count, sum += bpp)
+  {
+    if ((count = r->length - i) > r->factor)
+      count = r->factor;
+
+    for (j = count; j > 0; j --)
+      switch (bpp)
+      {
+        case 4 :
+            sum[3] += pixels[3];
+	    /* fall through */
+        case 3 :
+            sum[2] += pixels[2];
+            sum[1] += pixels[1];
+	    /* fall through */
+        case 1 :
+            sum[0] += pixels[0];
+	    pixels += bpp;
+            break;
+      }
+  }
+
+  r->count ++;
+}
+
+
+/*
+ * 'reduce_flush()' - Output the accumulated lines.
+ */
+
+static int				/* O - -1 on error, 0 on success */
+reduce_flush(cups_ireduce_t *r,		/* I - Box reduction state */
+             int            bpp)	/* I - Bytes per pixel */
+{
+  unsigned	outlength;		/* Length of output line */
+
+
+  outlength = (r->length + r->factor - 1) / r->factor;
+
+  reduce_line(r, bpp);
+
+  if (r->column)
+    return (_cupsImagePutCol(r->img, r->group, 0, outlength, r->line));
+  else
+    return (_cupsImagePutRow(r->img, 0, r->group, outlength, r->line));
+}
+
+
+/*
+ * 'reduce_line()' - Compute the reduced line from the box sums.
+ */
+
+static void
+reduce_line(cups_ireduce_t *r,		/* I - Box reduction state */
+            int            bpp)		/* I - Bytes per pixel */
+{
+  unsigned	i,			/* Looping var */
+		count;			/* Pixels in this box */
+  int		j;			/* Looping var */
+  unsigned	*sum;			/* Pointer into sums */
+  cups_ib_t	*ptr;			/* Pointer into output line */
+
+
+  for (i = 0, sum = r->sums, ptr = r->line; i < r->length; i += r->factor)
+  {
+    if ((count = r->length - i) > r->factor)
+      count = r->factor;
+
+    count *= r->count;
+
+    for (j = 0; j < bpp; j ++, sum ++)
+    {
+      *ptr++ = (*sum + count / 2) / count;
+      *sum   = 0;
+    }
+  }
+
+  r->count = 0;
+}
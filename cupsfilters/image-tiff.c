@@ -11,7 +11,12 @@
  *
  * Contents:
  *
- *   _cupsImageReadTIFF() - Read a TIFF image file.
+ *   _cupsImageNumPagesTIFF() - Get the number of pages in a TIFF file.
+ *   _cupsImageReadTIFF()     - Read a TIFF image file.
+ *   tiff_open()              - Open a TIFF file.
+ *   tiff_read_row()          - Read a row of a TIFF image.
+ *   tiff_rows_free()         - Free the strip or tile row buffers.
+ *   tiff_rows_init()         - Set up reading the rows of a TIFF image.
  */
 
 /*
@@ -26,6 +31,71 @@
 #  include <unistd.h>
 
 
+/*
+ * Constants...
+ */
+
+#  define TIFF_MAX_STRIP	(16 * 1024 * 1024)
+					/* Largest strip to decode at once */
+
+
+/*
+ * Types...
+ */
+
+typedef struct tiff_rows_s		/**** Rows of strips or tiles ****/
+{
+  TIFF		*tif;			/* TIFF file */
+  int		tiled;			/* 1 = tiles, 0 = strips, -1 = rows */
+  uint32	width,			/* Width of image */
+		height,			/* Height of image */
+		block_rows,		/* Rows per strip or tile */
+		tile_width;		/* Width of tiles */
+  tsize_t	scanwidth,		/* Bytes per row */
+		tile_rowsize;		/* Bytes per row of a tile */
+  uint32	first,			/* First row in buffer */
+		count;			/* Number of rows in buffer */
+  unsigned char	*buffer,		/* Decoded rows */
+		*tile;			/* Decoded tile */
+} tiff_rows_t;
+
+
+/*
+ * Local functions...
+ */
+
+static TIFF	*tiff_open(FILE *fp);
+static void	tiff_read_row(tiff_rows_t *rows, unsigned char *row,
+		              uint32 y);
+static void	tiff_rows_free(tiff_rows_t *rows);
+static int	tiff_rows_init(tiff_rows_t *rows, TIFF *tif, uint32 width,
+		               uint32 height);
+
+
+/*
+ * '_cupsImageNumPagesTIFF()' - Get the number of pages in a TIFF file.
+ *
+ * Only the chain of image directories is read; the file is not closed.
+ */
+
+int					/* O - Number of pages or -1 on error */
+_cupsImageNumPagesTIFF(FILE *fp)	/* I - TIFF file */
+{
+  TIFF	*tif;				/* TIFF file */
+  int	pages;				/* Number of pages */
+
+
+  if ((tif = tiff_open(fp)) == NULL)
+    return (-1);
+
+  pages = TIFFNumberOfDirectories(tif);
+
+  TIFFClose(tif);
+
+  return (pages);
+}
+
+
 /*
  * '_cupsImageReadTIFF()' - Read a TIFF image file.
  */
@@ -67,6 +137,7 @@ _cupsImageReadTIFF(
 		scanwidth,		/* Width of scanline */
 		r, g, b, k,		/* Red, green, blue, and black values */
 		alpha;			/* cupsImage includes alpha? */
+  tiff_rows_t	rows;			/* Strip or tile reader */
   cups_ib_t		*in,			/* Input buffer */
 		*out,			/* Output buffer */
 		*p,			/* Pointer into buffer */
@@ -82,15 +153,27 @@ _cupsImageReadTIFF(
   * Open the TIFF file and get the required parameters...
   */
 
-  lseek(fileno(fp), 0, SEEK_SET); /* Work around "feature" in some stdio's */
+  tif = tiff_open(fp);
 
-  if ((tif = TIFFFdOpen(fileno(fp), "", "r")) == NULL)
+  if (tif == NULL)
   {
     fputs("DEBUG: TIFFFdOpen() failed!\n", stderr);
     fclose(fp);
     return (-1);
   }
 
+ /*
+  * Go to the page to read...
+  */
+
+  if (img->page > 0 && !TIFFSetDirectory(tif, (tdir_t)img->page))
+  {
+    fprintf(stderr, "DEBUG: No page %d in the file!\n", img->page + 1);
+    TIFFClose(tif);
+    fclose(fp);
+    return (-1);
+  }
+
   if (!TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width))
   {
     fputs("DEBUG: No image width tag in the file!\n", stderr);
@@ -218,6 +301,7 @@ _cupsImageReadTIFF(
 
   bpp = cupsImageGetDepth(img);
 
+  _cupsImageReduceStart(img);
   cupsImageSetMaxTiles(img, 0);
 
  /*
@@ -293,6 +377,16 @@ _cupsImageReadTIFF(
   scanwidth = TIFFScanlineSize(tif);
   scanline  = _TIFFmalloc(scanwidth);
 
+  if (!scanline || tiff_rows_init(&rows, tif, width, height))
+  {
+    fputs("DEBUG: Unable to allocate TIFF row buffers!\n", stderr);
+    if (scanline)
+      _TIFFfree(scanline);
+    TIFFClose(tif);
+    fclose(fp);
+    return (-1);
+  }
+
  /*
   * Allocate input and output buffers...
   */
@@ -354,7 +448,7 @@ _cupsImageReadTIFF(
           {
             if (bits == 1)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (xcount = img->xsize, scanptr = scanline, p = in + xstart, bit = 128;
                    xcount > 0;
                    xcount --, p += pstep)
@@ -375,7 +469,7 @@ _cupsImageReadTIFF(
             }
             else if (bits == 2)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (xcount = img->xsize, scanptr = scanline, p = in + xstart, bit = 0xc0;
                    xcount > 0;
                    xcount --, p += pstep)
@@ -396,7 +490,7 @@ _cupsImageReadTIFF(
             }
             else if (bits == 4)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (xcount = img->xsize, scanptr = scanline, p = in + xstart, bit = 0xf0;
                    xcount > 0;
                    xcount --, p += pstep)
@@ -416,7 +510,7 @@ _cupsImageReadTIFF(
             }
             else if (xdir < 0 || zero || alpha)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
 
               if (alpha)
 	      {
@@ -456,7 +550,7 @@ _cupsImageReadTIFF(
               }
             }
             else
-              TIFFReadScanline(tif, in, row, 0);
+              tiff_read_row(&rows, in, row);
 
             if (img->colorspace == CUPS_IMAGE_WHITE)
 	    {
@@ -505,7 +599,7 @@ _cupsImageReadTIFF(
           {
             if (bits == 1)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (ycount = img->ysize, scanptr = scanline, p = in + ystart, bit = 128;
                    ycount > 0;
                    ycount --, p += ydir)
@@ -526,7 +620,7 @@ _cupsImageReadTIFF(
             }
             else if (bits == 2)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (ycount = img->ysize, scanptr = scanline, p = in + ystart, bit = 0xc0;
                    ycount > 0;
                    ycount --, p += ydir)
@@ -548,7 +642,7 @@ _cupsImageReadTIFF(
             }
             else if (bits == 4)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (ycount = img->ysize, scanptr = scanline, p = in + ystart, bit = 0xf0;
                    ycount > 0;
                    ycount --, p += ydir)
@@ -568,7 +662,7 @@ _cupsImageReadTIFF(
             }
             else if (ydir < 0 || zero || alpha)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
 
               if (alpha)
 	      {
@@ -608,7 +702,7 @@ _cupsImageReadTIFF(
 	      }
             }
             else
-              TIFFReadScanline(tif, in, row, 0);
+              tiff_read_row(&rows, in, row);
 
             if (img->colorspace == CUPS_IMAGE_WHITE)
 	    {
@@ -651,12 +745,13 @@ _cupsImageReadTIFF(
 	if (!TIFFGetField(tif, TIFFTAG_COLORMAP, &redcmap, &greencmap, &bluecmap))
 	{
 	  _TIFFfree(scanline);
+	  tiff_rows_free(&rows);
 	  free(in);
 	  free(out);
 
 	  TIFFClose(tif);
-	  fputs("DEBUG: No colormap tag in the file!\n", stderr);
 	  fclose(fp);
+	  fputs("DEBUG: No colormap tag in the file!\n", stderr);
 	  return (-1);
 	}
 
@@ -681,7 +776,7 @@ _cupsImageReadTIFF(
           {
             if (bits == 1)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (xcount = img->xsize, scanptr = scanline,
 	               p = in + xstart * 3, bit = 128;
                    xcount > 0;
@@ -711,7 +806,7 @@ _cupsImageReadTIFF(
             }
             else if (bits == 2)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (xcount = img->xsize, scanptr = scanline,
 	               p = in + xstart * 3, bit = 0xc0;
                    xcount > 0;
@@ -736,7 +831,7 @@ _cupsImageReadTIFF(
             }
             else if (bits == 4)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (xcount = img->xsize, scanptr = scanline,
 	               p = in + 3 * xstart, bit = 0xf0;
                    xcount > 0;
@@ -762,7 +857,7 @@ _cupsImageReadTIFF(
             }
             else
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
 
               for (xcount = img->xsize, p = in + 3 * xstart, scanptr = scanline;
                    xcount > 0;
@@ -814,7 +909,7 @@ _cupsImageReadTIFF(
           {
             if (bits == 1)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (ycount = img->ysize, scanptr = scanline,
 	               p = in + 3 * ystart, bit = 128;
                    ycount > 0;
@@ -844,7 +939,7 @@ _cupsImageReadTIFF(
             }
             else if (bits == 2)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (ycount = img->ysize, scanptr = scanline,
 	               p = in + 3 * ystart, bit = 0xc0;
                    ycount > 0;
@@ -869,7 +964,7 @@ _cupsImageReadTIFF(
             }
             else if (bits == 4)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (ycount = img->ysize, scanptr = scanline,
 	               p = in + 3 * ystart, bit = 0xf0;
                    ycount > 0;
@@ -895,7 +990,7 @@ _cupsImageReadTIFF(
             }
             else
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
 
               for (ycount = img->ysize, p = in + 3 * ystart, scanptr = scanline;
                    ycount > 0;
@@ -950,7 +1045,7 @@ _cupsImageReadTIFF(
           {
             if (bits == 1)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (xcount = img->xsize, scanptr = scanline, p = in + xstart * 3, bit = 0xf0;
                    xcount > 0;
                    xcount --, p += pstep)
@@ -981,7 +1076,7 @@ _cupsImageReadTIFF(
             }
             else if (bits == 2)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (xcount = img->xsize, scanptr = scanline, p = in + xstart * 3;
                    xcount > 0;
                    xcount --, p += pstep, scanptr ++)
@@ -996,7 +1091,7 @@ _cupsImageReadTIFF(
             }
             else if (bits == 4)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (xcount = img->xsize, scanptr = scanline, p = in + xstart * 3;
                    xcount > 0;
                    xcount -= 2, p += 2 * pstep, scanptr += 3)
@@ -1020,7 +1115,7 @@ _cupsImageReadTIFF(
             }
             else if (xdir < 0 || alpha)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
 
               if (alpha)
 	      {
@@ -1046,7 +1141,7 @@ _cupsImageReadTIFF(
 	      }
             }
             else
-              TIFFReadScanline(tif, in, row, 0);
+              tiff_read_row(&rows, in, row);
 
             if ((saturation != 100 || hue != 0) && bpp > 1)
               cupsImageRGBAdjust(in, img->xsize, saturation, hue);
@@ -1091,7 +1186,7 @@ _cupsImageReadTIFF(
           {
             if (bits == 1)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (ycount = img->ysize, scanptr = scanline, p = in + ystart * 3, bit = 0xf0;
                    ycount > 0;
                    ycount --, p += pstep)
@@ -1122,7 +1217,7 @@ _cupsImageReadTIFF(
             }
             else if (bits == 2)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (ycount = img->ysize, scanptr = scanline, p = in + ystart * 3;
                    ycount > 0;
                    ycount --, p += pstep, scanptr ++)
@@ -1137,7 +1232,7 @@ _cupsImageReadTIFF(
             }
             else if (bits == 4)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
               for (ycount = img->ysize, scanptr = scanline, p = in + ystart * 3;
                    ycount > 0;
                    ycount -= 2, p += 2 * pstep, scanptr += 3)
@@ -1161,7 +1256,7 @@ _cupsImageReadTIFF(
             }
             else if (ydir < 0 || alpha)
             {
-              TIFFReadScanline(tif, scanline, row, 0);
+              tiff_read_row(&rows, scanline, row);
 
               if (alpha)
 	      {
@@ -1187,7 +1282,7 @@ _cupsImageReadTIFF(
 	      }
             }
             else
-              TIFFReadScanline(tif, in, row, 0);
+              tiff_read_row(&rows, in, row);
 
             if ((saturation != 100 || hue != 0) && bpp > 1)
               cupsImageRGBAdjust(in, img->ysize, saturation, hue);
@@ -1250,7 +1345,7 @@ _cupsImageReadTIFF(
             {
               if (bits == 1)
               {
-        	TIFFReadScanline(tif, scanline, row, 0);
+        	tiff_read_row(&rows, scanline, row);
         	for (xcount = img->xsize, scanptr = scanline, p = in + xstart * 3, bit = 0xf0;
                      xcount > 0;
                      xcount --, p += pstep)
@@ -1290,7 +1385,7 @@ _cupsImageReadTIFF(
               }
               else if (bits == 2)
               {
-        	TIFFReadScanline(tif, scanline, row, 0);
+        	tiff_read_row(&rows, scanline, row);
         	for (xcount = img->xsize, scanptr = scanline, p = in + xstart * 3;
                      xcount > 0;
                      xcount --, p += pstep, scanptr ++)
@@ -1336,7 +1431,7 @@ _cupsImageReadTIFF(
               }
               else if (bits == 4)
               {
-        	TIFFReadScanline(tif, scanline, row, 0);
+        	tiff_read_row(&rows, scanline, row);
         	for (xcount = img->xsize, scanptr = scanline, p = in + xstart * 3;
                      xcount > 0;
                      xcount --, p += pstep, scanptr += 2)
@@ -1382,12 +1477,12 @@ _cupsImageReadTIFF(
               }
               else if (img->colorspace == CUPS_IMAGE_CMYK)
 	      {
-	        TIFFReadScanline(tif, scanline, row, 0);
+	        tiff_read_row(&rows, scanline, row);
 		_cupsImagePutRow(img, 0, y, img->xsize, scanline);
 	      }
 	      else
               {
-        	TIFFReadScanline(tif, scanline, row, 0);
+        	tiff_read_row(&rows, scanline, row);
 
         	for (xcount = img->xsize, p = in + xstart * 3, scanptr = scanline;
                      xcount > 0;
@@ -1472,7 +1567,7 @@ _cupsImageReadTIFF(
             {
               if (bits == 1)
               {
-        	TIFFReadScanline(tif, scanline, row, 0);
+        	tiff_read_row(&rows, scanline, row);
         	for (ycount = img->ysize, scanptr = scanline, p = in + xstart * 3, bit = 0xf0;
                      ycount > 0;
                      ycount --, p += pstep)
@@ -1512,7 +1607,7 @@ _cupsImageReadTIFF(
               }
               else if (bits == 2)
               {
-        	TIFFReadScanline(tif, scanline, row, 0);
+        	tiff_read_row(&rows, scanline, row);
         	for (ycount = img->ysize, scanptr = scanline, p = in + xstart * 3;
                      ycount > 0;
                      ycount --, p += pstep, scanptr ++)
@@ -1558,7 +1653,7 @@ _cupsImageReadTIFF(
               }
               else if (bits == 4)
               {
-        	TIFFReadScanline(tif, scanline, row, 0);
+        	tiff_read_row(&rows, scanline, row);
         	for (ycount = img->ysize, scanptr = scanline, p = in + xstart * 3;
                      ycount > 0;
                      ycount --, p += pstep, scanptr += 2)
@@ -1604,12 +1699,12 @@ _cupsImageReadTIFF(
               }
               else if (img->colorspace == CUPS_IMAGE_CMYK)
 	      {
-	        TIFFReadScanline(tif, scanline, row, 0);
+	        tiff_read_row(&rows, scanline, row);
 		_cupsImagePutCol(img, x, 0, img->ysize, scanline);
 	      }
               else
               {
-        	TIFFReadScanline(tif, scanline, row, 0);
+        	tiff_read_row(&rows, scanline, row);
 
         	for (ycount = img->ysize, p = in + xstart * 3, scanptr = scanline;
                      ycount > 0;
@@ -1688,10 +1783,12 @@ _cupsImageReadTIFF(
 
     default :
 	_TIFFfree(scanline);
+	tiff_rows_free(&rows);
 	free(in);
 	free(out);
 
 	TIFFClose(tif);
+	fclose(fp);
 	fputs("DEBUG: Unknown TIFF photometric value!\n", stderr);
 	return (-1);
   }
@@ -1701,10 +1798,205 @@ _cupsImageReadTIFF(
   */
 
   _TIFFfree(scanline);
+  tiff_rows_free(&rows);
   free(in);
   free(out);
 
   TIFFClose(tif);
+  fclose(fp);
+  return (0);
+}
+
+/*
+ * 'tiff_open()' - Open a TIFF file.
+ *
+ * libtiff closes the file descriptor it reads when the TIFF file is
+ * closed, so it gets its own duplicate of the descriptor of "fp".
+ */
+
+static TIFF *				/* O - TIFF file or NULL */
+tiff_open(FILE *fp)			/* I - Image file */
+{
+  int	fd;				/* Duplicate file descriptor */
+  TIFF	*tif;				/* TIFF file */
+
+
+  if ((fd = dup(fileno(fp))) < 0)
+    return (NULL);
+
+  if (lseek(fd, 0, SEEK_SET) < 0 || (tif = TIFFFdOpen(fd, "", "r")) == NULL)
+  {
+    close(fd);
+    return (NULL);
+  }
+
+  return (tif);
+}
+
+
+/*
+ * 'tiff_read_row()' - Read a row of a TIFF image.
+ *
+ * The rows are read as the strip or row of tiles holding them is decoded
+ * as a whole, so reading the rows in order decodes each block once.  Rows
+ * which cannot be read are cleared.
+ */
+
+static void
+tiff_read_row(tiff_rows_t   *rows,	/* I - Strip or tile reader */
+              unsigned char *row,	/* O - Row of the image */
+              uint32        y)		/* I - Row to read */
+{
+  uint32	x,			/* Current column */
+		i;			/* Looping var */
+  tsize_t	bytes,			/* Bytes of a tile row to copy */
+		offset;			/* Offset of tile in row */
+
+
+  if (rows->tiled < 0)
+  {
+    if (TIFFReadScanline(rows->tif, row, y, 0) < 0)
+      memset(row, 0, rows->scanwidth);
+
+    return;
+  }
+
+  if (y < rows->first || y >= rows->first + rows->count)
+  {
+    rows->first = y - y % rows->block_rows;
+    rows->count = 0;
+
+    if (rows->tiled)
+    {
+     /*
+      * Decode all tiles of this row of tiles, and put their rows together
+      * into whole rows of the image...
+      */
+
+      for (x = 0, offset = 0; x < rows->width;
+           x += rows->tile_width, offset += rows->tile_rowsize)
+      {
+	if (TIFFReadTile(rows->tif, rows->tile, x, rows->first, 0, 0) < 0)
+	  memset(rows->tile, 0, rows->tile_rowsize * rows->block_rows);
+
+	bytes = rows->scanwidth - offset;
+	if (bytes > rows->tile_rowsize)
+	  bytes = rows->tile_rowsize;
+
+	for (i = 0; i < rows->block_rows; i ++)
+	  memcpy(rows->buffer + i * rows->scanwidth + offset,
+	         rows->tile + i * rows->tile_rowsize, bytes);
+      }
+
+      rows->count = rows->block_rows;
+    }
+    else
+    {
+      if ((bytes = TIFFReadEncodedStrip(rows->tif,
+                                        TIFFComputeStrip(rows->tif, y, 0),
+                                        rows->buffer, (tsize_t)-1)) > 0)
+        rows->count = bytes / rows->scanwidth;
+    }
+
+    if (rows->first + rows->count > rows->height)
+      rows->count = rows->height - rows->first;
+
+    if (y >= rows->first + rows->count)
+    {
+      rows->count = 0;
+      memset(row, 0, rows->scanwidth);
+      return;
+    }
+  }
+
+  memcpy(row, rows->buffer + (y - rows->first) * rows->scanwidth,
+         rows->scanwidth);
+}
+
+
+/*
+ * 'tiff_rows_free()' - Free the strip or tile row buffers.
+ */
+
+static void
+tiff_rows_free(tiff_rows_t *rows)	/* I - Strip or tile reader */
+{
+  if (rows->buffer)
+    _TIFFfree(rows->buffer);
+
+  if (rows->tile)
+    _TIFFfree(rows->tile);
+}
+
+
+/*
+ * 'tiff_rows_init()' - Set up reading the rows of a TIFF image.
+ *
+ * Strips are decoded with TIFFReadEncodedStrip() and tiles with
+ * TIFFReadTile().  Very large strips (a whole compressed image in one
+ * strip) are read with TIFFReadScanline() instead, so that they need no
+ * more memory than before.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+tiff_rows_init(tiff_rows_t *rows,	/* O - Strip or tile reader */
+               TIFF        *tif,	/* I - TIFF file */
+               uint32      width,	/* I - Width of image */
+               uint32      height)	/* I - Height of image */
+{
+  uint32	tile_length;		/* Height of tiles */
+
+
+  memset(rows, 0, sizeof(tiff_rows_t));
+
+  rows->tif       = tif;
+  rows->width     = width;
+  rows->height    = height;
+  rows->scanwidth = TIFFScanlineSize(tif);
+
+  if (TIFFIsTiled(tif))
+  {
+    if (!TIFFGetField(tif, TIFFTAG_TILEWIDTH, &rows->tile_width) ||
+        !TIFFGetField(tif, TIFFTAG_TILELENGTH, &tile_length) ||
+        rows->tile_width == 0 || tile_length == 0)
+      return (-1);
+
+    rows->tiled        = 1;
+    rows->block_rows   = tile_length;
+    rows->tile_rowsize = TIFFTileRowSize(tif);
+    rows->tile         = _TIFFmalloc(TIFFTileSize(tif));
+    rows->buffer       = _TIFFmalloc(rows->scanwidth * tile_length);
+
+    fprintf(stderr, "DEBUG: TIFF tiles = %ux%u\n", (unsigned)rows->tile_width,
+            (unsigned)tile_length);
+  }
+  else if (TIFFStripSize(tif) <= TIFF_MAX_STRIP)
+  {
+    if (!TIFFGetField(tif, TIFFTAG_ROWSPERSTRIP, &rows->block_rows) ||
+        rows->block_rows > height)
+      rows->block_rows = height;
+
+    rows->tiled  = 0;
+    rows->tile   = NULL;
+    rows->buffer = _TIFFmalloc(TIFFStripSize(tif));
+
+    fprintf(stderr, "DEBUG: TIFF rows per strip = %u\n",
+            (unsigned)rows->block_rows);
+  }
+  else
+  {
+    rows->tiled = -1;
+    return (0);
+  }
+
+  if (!rows->buffer || (rows->tiled && !rows->tile) ||
+      rows->scanwidth <= 0 || rows->block_rows == 0)
+  {
+    tiff_rows_free(rows);
+    rows->buffer = rows->tile = NULL;
+    return (-1);
+  }
+
   return (0);
 }
 #endif /* HAVE_LIBTIFF */
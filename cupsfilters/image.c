@@ -21,11 +21,19 @@
  *   cupsImageGetXPPI()       - Get the horizontal resolution of an image.
  *   cupsImageGetYPPI()       - Get the vertical resolution of an image.
  *   cupsImageOpen()          - Open an image file and read it into memory.
+ *   cupsImageOpenFit()       - Open an image file and read it into memory
+ *                              at the size needed for a fit box.
+ *   cupsImageOpenStream()    - Open an image file for reading its rows in
+ *                              order.
+ *   _cupsImageOpenFP()       - Open an image file from a file pointer.
  *   _cupsImagePutCol()       - Put a column of pixels to an image.
  *   _cupsImagePutRow()       - Put a row of pixels to an image.
  *   cupsImageSetMaxTiles()   - Set the maximum number of tiles to cache.
  *   flush_tile()             - Flush the least-recently-used tile in the cache.
  *   get_tile()               - Get a cached tile.
+ *   open_image()             - Open an image file.
+ *   read_image()             - Read an image file with the matching reader.
+ *   stream_to_tiles()        - Read a streamed image into the tile cache.
  */
 
 /*
@@ -41,6 +49,16 @@
 
 static int		flush_tile(cups_image_t *img);
 static cups_ib_t	*get_tile(cups_image_t *img, int x, int y);
+static cups_image_t	*open_image(const char *filename,
+			            cups_icspace_t primary,
+				    cups_icspace_t secondary, int saturation,
+				    int hue, const cups_ib_t *lut,
+				    unsigned xsize, unsigned ysize, int stream);
+static int		read_image(cups_image_t *img, FILE *fp,
+			           cups_icspace_t primary,
+				   cups_icspace_t secondary, int saturation,
+				   int hue, const cups_ib_t *lut);
+static int		stream_to_tiles(cups_image_t *img);
 
 
 /*
@@ -51,9 +69,38 @@ void
 cupsImageClose(cups_image_t *img)	/* I - Image to close */
 {
   cups_ic_t	*current,		/* Current cached tile */
-		*next;			/* Next cached tile */
+		*prev;			/* Previous cached tile */
 
 
+ /*
+  * Free the reduced image (if any)...
+  */
+
+  if (img->reduce)
+  {
+    if (img->reduce->img)
+      cupsImageClose(img->reduce->img);
+
+    free(img->reduce->sums);
+    free(img->reduce->line);
+    free(img->reduce->in);
+    free(img->reduce);
+  }
+
+ /*
+  * Close the row source of a streamed image (if any)...
+  */
+
+  if (img->source)
+  {
+    if (img->source->close)
+      (*img->source->close)(img->source->data);
+
+    close(img->source->fd);
+    free(img->source->row);
+    free(img->source);
+  }
+
  /*
   * Wipe the tile cache file (if any)...
   */
@@ -72,11 +119,17 @@ cupsImageClose(cups_image_t *img)	/* I - Image to close */
 
   DEBUG_puts("Freeing memory...");
 
-  for (current = img->first, next = NULL; current != NULL; current = next)
+ /*
+  * get_tile() can leave img->first past the oldest tile when there is
+  * only one, so walk the cache backwards from the newest tile...
+  */
+
+  for (current = img->last; current != NULL; current = prev)
   {
-    DEBUG_printf(("Freeing cache (%p, next = %p)...\n", current, next));
+    DEBUG_printf(("Freeing cache (%p, prev = %p)...\n", current,
+                  current->prev));
 
-    next = current->next;
+    prev = current->prev;
     free(current);
   }
 
@@ -131,6 +184,9 @@ cupsImageGetCol(cups_image_t *img,	/* I - Image */
   if (height < 1)
     return (-1);
 
+  if (img->source && stream_to_tiles(img))
+    return (-1);
+
   bpp    = cupsImageGetDepth(img);
   twidth = bpp * (CUPS_TILE_SIZE - 1);
 
@@ -214,6 +270,7 @@ cupsImageGetRow(cups_image_t *img,	/* I - Image */
   int			bpp,		/* Bytes per pixel */
 			count;		/* Number of pixels to get */
   const cups_ib_t	*ib;		/* Pointer to pixels */
+  cups_isource_t	*source;	/* Row source of streamed image */
 
 
   if (img == NULL || y < 0 || y >= img->ysize || x >= img->xsize)
@@ -233,6 +290,44 @@ cupsImageGetRow(cups_image_t *img,	/* I - Image */
 
   bpp = img->colorspace < 0 ? -img->colorspace : img->colorspace;
 
+  if ((source = img->source) != NULL)
+  {
+   /*
+    * Streamed images are read in order without caching; the last row
+    * stays available for filters which get the same row again...
+    */
+
+    if ((unsigned)y + 1 >= source->y)
+    {
+      if (!source->row &&
+          (source->row = malloc(img->xsize * bpp)) == NULL)
+        return (-1);
+
+      while (source->y <= (unsigned)y)
+      {
+        if (img->reduce)
+	{
+	  if (_cupsImageReduceRead(img, source->row))
+	    return (-1);
+	}
+	else if ((*source->read)(img, source->row))
+	  return (-1);
+
+        source->y ++;
+      }
+
+      memcpy(pixels, source->row + x * bpp, width * bpp);
+      return (0);
+    }
+
+   /*
+    * Going back needs the whole image...
+    */
+
+    if (stream_to_tiles(img))
+      return (-1);
+  }
+
   while (width > 0)
   {
     ib = get_tile(img, x, y);
@@ -299,35 +394,95 @@ cupsImageOpen(
     int             hue,		/* I - Color hue adjustment */
     const cups_ib_t *lut)		/* I - RGB gamma/brightness LUT */
 {
-  FILE		*fp;			/* File pointer */
-  unsigned char	header[16],		/* First 16 bytes of file */
-		header2[16];		/* Bytes 2048-2064 (PhotoCD) */
-  cups_image_t	*img;			/* New image buffer */
-  int		status;			/* Status of load... */
+  return (cupsImageOpenFit(filename, primary, secondary, saturation, hue,
+                           lut, 0, 0));
+}
 
 
-  DEBUG_printf(("cupsImageOpen(\"%s\", %d, %d, %d, %d, %p)\n",
+/*
+ * 'cupsImageOpenFit()' - Open an image file and read it into memory at the
+ *                        size needed for a fit box.
+ *
+ * The image is only printed scaled to fit into a box of "xsize" by "ysize"
+ * output pixels, so readers which support it decode large images at a
+ * reduced size which still fills the box.  The resolution of a reduced
+ * image is reduced accordingly.  Pass 0 for no reduction; if the image
+ * may be rotated, pass the larger of the box dimensions for both.
+ */
+
+cups_image_t *				/* O - New image */
+cupsImageOpenFit(
+    const char      *filename,		/* I - Filename of image */
+    cups_icspace_t  primary,		/* I - Primary colorspace needed */
+    cups_icspace_t  secondary,		/* I - Secondary colorspace if primary no good */
+    int             saturation,		/* I - Color saturation level */
+    int             hue,		/* I - Color hue adjustment */
+    const cups_ib_t *lut,		/* I - RGB gamma/brightness LUT */
+    unsigned        xsize,		/* I - Width of fit box or 0 */
+    unsigned        ysize)		/* I - Height of fit box or 0 */
+{
+  DEBUG_printf(("cupsImageOpenFit(\"%s\", %d, %d, %d, %d, %p, %u, %u)\n",
         	filename ? filename : "(null)", primary, secondary,
-		saturation, hue, lut));
+		saturation, hue, lut, xsize, ysize));
 
- /*
-  * Figure out the file type...
-  */
+  return (open_image(filename, primary, secondary, saturation, hue, lut,
+                     xsize, ysize, 0));
+}
 
-  if ((fp = fopen(filename, "r")) == NULL)
-    return (NULL);
 
-  if (fread(header, 1, sizeof(header), fp) == 0)
-  {
-    fclose(fp);
-    return (NULL);
-  }
+/*
+ * 'cupsImageOpenStream()' - Open an image file for reading its rows in order.
+ *
+ * Like cupsImageOpenFit(), but images whose reader supports it are not
+ * decoded into the tile cache; each cupsImageGetRow() call decodes the
+ * rows up to the requested one instead, so a filter which reads the rows
+ * once from top to bottom needs no swap file and only one row of memory.
+ * Any other access reads the whole image into the tile cache first.
+ */
+
+cups_image_t *				/* O - New image */
+cupsImageOpenStream(
+    const char      *filename,		/* I - Filename of image */
+    cups_icspace_t  primary,		/* I - Primary colorspace needed */
+    cups_icspace_t  secondary,		/* I - Secondary colorspace if primary no good */
+    int             saturation,		/* I - Color saturation level */
+    int             hue,		/* I - Color hue adjustment */
+    const cups_ib_t *lut,		/* I - RGB gamma/brightness LUT */
+    unsigned        xsize,		/* I - Width of fit box or 0 */
+    unsigned        ysize)		/* I - Height of fit box or 0 */
+{
+  DEBUG_printf(("cupsImageOpenStream(\"%s\", %d, %d, %d, %d, %p, %u, %u)\n",
+        	filename ? filename : "(null)", primary, secondary,
+		saturation, hue, lut, xsize, ysize));
+
+  return (open_image(filename, primary, secondary, saturation, hue, lut,
+                     xsize, ysize, 1));
+}
+
+
+/*
+ * '_cupsImageOpenFP()' - Open an image file from a file pointer.
+ *
+ * The file is always closed.  "page" selects the page of multi-page
+ * images (GIF and TIFF), starting at 0; other readers ignore it.
+ */
+
+cups_image_t *				/* O - New image */
+_cupsImageOpenFP(
+    FILE            *fp,		/* I - Image file */
+    cups_icspace_t  primary,		/* I - Primary colorspace needed */
+    cups_icspace_t  secondary,		/* I - Secondary colorspace if primary no good */
+    int             saturation,		/* I - Color saturation level */
+    int             hue,		/* I - Color hue adjustment */
+    const cups_ib_t *lut,		/* I - RGB gamma/brightness LUT */
+    unsigned        xsize,		/* I - Width of fit box or 0 */
+    unsigned        ysize,		/* I - Height of fit box or 0 */
+    int             stream,		/* I - Stream rows if possible? */
+    int             page)		/* I - Page to read */
+{
+  cups_image_t	*img;			/* New image buffer */
+  cups_isource_t *source;		/* Row source */
 
-  fseek(fp, 2048, SEEK_SET);
-  memset(header2, 0, sizeof(header2));
-  if (fread(header2, 1, sizeof(header2), fp) == 0 && ferror(fp))
-    DEBUG_printf(("Error reading file!"));
-  fseek(fp, 0, SEEK_SET);
 
  /*
   * Allocate memory...
@@ -341,68 +496,59 @@ cupsImageOpen(
     return (NULL);
   }
 
- /*
-  * Load the image as appropriate...
-  */
-
   img->cachefile = -1;
   img->max_ics   = CUPS_TILE_MINIMUM;
   img->xppi      = 128;
   img->yppi      = 128;
+  img->xfit      = xsize;
+  img->yfit      = ysize;
+  img->page      = page;
 
-  if (!memcmp(header, "GIF87a", 6) || !memcmp(header, "GIF89a", 6))
-    status = _cupsImageReadGIF(img, fp, primary, secondary, saturation, hue,
-                               lut);
-  else if (!memcmp(header, "BM", 2))
-    status = _cupsImageReadBMP(img, fp, primary, secondary, saturation, hue,
-                               lut);
-  else if (header[0] == 0x01 && header[1] == 0xda)
-    status = _cupsImageReadSGI(img, fp, primary, secondary, saturation, hue,
-                               lut);
-  else if (header[0] == 0x59 && header[1] == 0xa6 &&
-           header[2] == 0x6a && header[3] == 0x95)
-    status = _cupsImageReadSunRaster(img, fp, primary, secondary, saturation,
-                                     hue, lut);
-  else if (header[0] == 'P' && header[1] >= '1' && header[1] <= '6')
-    status = _cupsImageReadPNM(img, fp, primary, secondary, saturation, hue,
-                               lut);
-  else if (!memcmp(header2, "PCD_IPI", 7))
-    status = _cupsImageReadPhotoCD(img, fp, primary, secondary, saturation,
-                                   hue, lut);
-  else if (!memcmp(header + 8, "\000\010", 2) ||
-           !memcmp(header + 8, "\000\030", 2))
-    status = _cupsImageReadPIX(img, fp, primary, secondary, saturation, hue,
-                               lut);
-#if defined(HAVE_LIBPNG) && defined(HAVE_LIBZ)
-  else if (!memcmp(header, "\211PNG", 4))
-    status = _cupsImageReadPNG(img, fp, primary, secondary, saturation, hue,
-                               lut);
-#endif /* HAVE_LIBPNG && HAVE_LIBZ */
-#ifdef HAVE_LIBJPEG
-  else if (!memcmp(header, "\377\330\377", 3) &&	/* Start-of-Image */
-	   header[3] >= 0xe0 && header[3] <= 0xef)	/* APPn */
-    status = _cupsImageReadJPEG(img, fp, primary, secondary, saturation, hue,
-                                lut);
-#endif /* HAVE_LIBJPEG */
-#ifdef HAVE_LIBTIFF
-  else if (!memcmp(header, "MM\000\052", 4) ||
-           !memcmp(header, "II\052\000", 4))
-    status = _cupsImageReadTIFF(img, fp, primary, secondary, saturation, hue,
-                                lut);
-#endif /* HAVE_LIBTIFF */
-  else
+  if (stream && (source = calloc(1, sizeof(cups_isource_t))) != NULL)
   {
-    fclose(fp);
-    status = -1;
+   /*
+    * Keep the file open, the image is read again if the rows are not
+    * read in order...
+    */
+
+    if ((source->fd = dup(fileno(fp))) < 0)
+      free(source);
+    else
+    {
+      source->primary    = primary;
+      source->secondary  = secondary;
+      source->saturation = saturation;
+      source->hue        = hue;
+      source->lut        = lut;
+      img->source        = source;
+    }
   }
 
-  if (status)
+ /*
+  * Load the image as appropriate...
+  */
+
+  if (read_image(img, fp, primary, secondary, saturation, hue, lut))
   {
-    free(img);
+    cupsImageClose(img);
     return (NULL);
   }
-  else
-    return (img);
+
+  if ((source = img->source) != NULL && !source->read)
+  {
+   /*
+    * This reader can't stream...
+    */
+
+    close(source->fd);
+    free(source);
+    img->source = NULL;
+  }
+
+  if (img->reduce && !img->source)
+    _cupsImageReduceFinish(img);
+
+  return (img);
 }
 
 
@@ -429,6 +575,14 @@ _cupsImagePutCol(
   if (img == NULL || x < 0 || x >= img->xsize || y >= img->ysize)
     return (-1);
 
+  if (img->reduce)
+  {
+    if (y != 0 || height != img->ysize)
+      return (-1);
+
+    return (_cupsImageReducePut(img, 1, x, pixels));
+  }
+
   if (y < 0)
   {
     height += y;
@@ -503,6 +657,14 @@ _cupsImagePutRow(
   if (img == NULL || y < 0 || y >= img->ysize || x >= img->xsize)
     return (-1);
 
+  if (img->reduce)
+  {
+    if (x != 0 || width != img->xsize)
+      return (-1);
+
+    return (_cupsImageReducePut(img, 0, y, pixels));
+  }
+
   if (x < 0)
   {
     width += x;
@@ -816,6 +978,179 @@ get_tile(cups_image_t *img,		/* I - Image */
   return (ic->pixels + bpp * (y * CUPS_TILE_SIZE + x));
 }
 
+
+/*
+ * 'open_image()' - Open an image file.
+ */
+
+static cups_image_t *			/* O - New image */
+open_image(
+    const char      *filename,		/* I - Filename of image */
+    cups_icspace_t  primary,		/* I - Primary colorspace needed */
+    cups_icspace_t  secondary,		/* I - Secondary colorspace if primary no good */
+    int             saturation,		/* I - Color saturation level */
+    int             hue,		/* I - Color hue adjustment */
+    const cups_ib_t *lut,		/* I - RGB gamma/brightness LUT */
+    unsigned        xsize,		/* I - Width of fit box or 0 */
+    unsigned        ysize,		/* I - Height of fit box or 0 */
+    int             stream)		/* I - Stream rows if possible? */
+{
+  FILE		*fp;			/* File pointer */
+
+
+  if ((fp = fopen(filename, "r")) == NULL)
+    return (NULL);
+
+  return (_cupsImageOpenFP(fp, primary, secondary, saturation, hue, lut,
+                           xsize, ysize, stream, 0));
+}
+
+
+/*
+ * 'read_image()' - Read an image file with the matching reader.
+ *
+ * The file is always closed.
+ */
+
+static int				/* O - Read status */
+read_image(
+    cups_image_t    *img,		/* I - Image */
+    FILE            *fp,		/* I - Image file */
+    cups_icspace_t  primary,		/* I - Primary colorspace needed */
+    cups_icspace_t  secondary,		/* I - Secondary colorspace if primary no good */
+    int             saturation,		/* I - Color saturation level */
+    int             hue,		/* I - Color hue adjustment */
+    const cups_ib_t *lut)		/* I - RGB gamma/brightness LUT */
+{
+  unsigned char	header[16],		/* First 16 bytes of file */
+		header2[16];		/* Bytes 2048-2064 (PhotoCD) */
+  int		status;			/* Status of load... */
+
+
+ /*
+  * Figure out the file type...
+  */
+
+  if (fread(header, 1, sizeof(header), fp) == 0)
+  {
+    fclose(fp);
+    return (-1);
+  }
+
+  fseek(fp, 2048, SEEK_SET);
+  memset(header2, 0, sizeof(header2));
+  if (fread(header2, 1, sizeof(header2), fp) == 0 && ferror(fp))
+    DEBUG_printf(("Error reading file!"));
+  fseek(fp, 0, SEEK_SET);
+
+  if (!memcmp(header, "GIF87a", 6) || !memcmp(header, "GIF89a", 6))
+    status = _cupsImageReadGIF(img, fp, primary, secondary, saturation, hue,
+                               lut);
+  else if (!memcmp(header, "BM", 2))
+    status = _cupsImageReadBMP(img, fp, primary, secondary, saturation, hue,
+                               lut);
+  else if (header[0] == 0x01 && header[1] == 0xda)
+    status = _cupsImageReadSGI(img, fp, primary, secondary, saturation, hue,
+                               lut);
+  else if (header[0] == 0x59 && header[1] == 0xa6 &&
+           header[2] == 0x6a && header[3] == 0x95)
+    status = _cupsImageReadSunRaster(img, fp, primary, secondary, saturation,
+                                     hue, lut);
+  else if (header[0] == 'P' && header[1] >= '1' && header[1] <= '6')
+    status = _cupsImageReadPNM(img, fp, primary, secondary, saturation, hue,
+                               lut);
+  else if (!memcmp(header2, "PCD_IPI", 7))
+    status = _cupsImageReadPhotoCD(img, fp, primary, secondary, saturation,
+                                   hue, lut);
+  else if (!memcmp(header + 8, "\000\010", 2) ||
+           !memcmp(header + 8, "\000\030", 2))
+    status = _cupsImageReadPIX(img, fp, primary, secondary, saturation, hue,
+                               lut);
+#if defined(HAVE_LIBPNG) && defined(HAVE_LIBZ)
+  else if (!memcmp(header, "\211PNG", 4))
+    status = _cupsImageReadPNG(img, fp, primary, secondary, saturation, hue,
+                               lut);
+#endif /* HAVE_LIBPNG && HAVE_LIBZ */
+#ifdef HAVE_LIBJPEG
+  else if (!memcmp(header, "\377\330\377", 3) &&	/* Start-of-Image */
+	   header[3] >= 0xe0 && header[3] <= 0xef)	/* APPn */
+    status = _cupsImageReadJPEG(img, fp, primary, secondary, saturation, hue,
+                                lut);
+#endif /* HAVE_LIBJPEG */
+#ifdef HAVE_LIBTIFF
+  else if (!memcmp(header, "MM\000\052", 4) ||
+           !memcmp(header, "II\052\000", 4))
+    status = _cupsImageReadTIFF(img, fp, primary, secondary, saturation, hue,
+                                lut);
+#endif /* HAVE_LIBTIFF */
+  else
+  {
+    fclose(fp);
+    status = -1;
+  }
+
+  return (status);
+}
+
+
+/*
+ * 'stream_to_tiles()' - Read a streamed image into the tile cache.
+ *
+ * The image is read again from the start with the same reader and
+ * reduction, so it keeps its size and resolution.
+ */
+
+static int				/* O - -1 on error, 0 on success */
+stream_to_tiles(cups_image_t *img)	/* I - Streamed image */
+{
+  cups_isource_t	*source = img->source;
+					/* Row source */
+  cups_ireduce_t	*r = img->reduce;
+					/* Box reduction state */
+  FILE			*fp;		/* Image file */
+  int			fd,		/* Duplicate of image file */
+			status;		/* Status of load... */
+
+
+  DEBUG_puts("Reading streamed image into the tile cache...");
+
+  img->source = NULL;
+  img->reduce = NULL;
+
+  (*source->close)(source->data);
+
+  if (r)
+  {
+    free(r->sums);
+    free(r->line);
+    free(r->in);
+    free(r);
+  }
+
+  img->xppi = 128;
+  img->yppi = 128;
+
+  if (lseek(source->fd, 0, SEEK_SET) < 0 || (fd = dup(source->fd)) < 0)
+    status = -1;
+  else if ((fp = fdopen(fd, "r")) == NULL)
+  {
+    close(fd);
+    status = -1;
+  }
+  else
+    status = read_image(img, fp, source->primary, source->secondary,
+                        source->saturation, source->hue, source->lut);
+
+  close(source->fd);
+  free(source->row);
+  free(source);
+
+  if (!status && img->reduce)
+    _cupsImageReduceFinish(img);
+
+  return (status);
+}
+
 /*
  * Crop a image.
  * (posw,posh): Position of left corner
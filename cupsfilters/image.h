@@ -53,6 +53,10 @@ struct cups_izoom_s;
 typedef struct cups_izoom_s cups_izoom_t;
 					/**** Image zoom data ****/
 
+struct cups_ipages_s;
+typedef struct cups_ipages_s cups_ipages_t;
+					/**** Pages of a multi-page image ****/
+
 
 /*
  * Prototypes...
@@ -86,6 +90,30 @@ extern cups_image_t	*cupsImageOpen(const char *filename,
 				       cups_icspace_t secondary,
 			               int saturation, int hue,
 				       const cups_ib_t *lut) _CUPS_API_1_2;
+extern cups_image_t	*cupsImageOpenFit(const char *filename,
+			                  cups_icspace_t primary,
+					  cups_icspace_t secondary,
+			                  int saturation, int hue,
+					  const cups_ib_t *lut,
+					  unsigned xsize, unsigned ysize);
+extern cups_image_t	*cupsImageOpenStream(const char *filename,
+			                     cups_icspace_t primary,
+					     cups_icspace_t secondary,
+			                     int saturation, int hue,
+					     const cups_ib_t *lut,
+					     unsigned xsize, unsigned ysize);
+extern void		cupsImagePagesClose(cups_ipages_t *pages);
+extern int		cupsImagePagesCount(cups_ipages_t *pages);
+extern cups_image_t	*cupsImagePagesNext(cups_ipages_t *pages, int *page);
+extern cups_ipages_t	*cupsImagePagesOpen(const char *filename,
+			                    cups_icspace_t primary,
+					    cups_icspace_t secondary,
+			                    int saturation, int hue,
+					    const cups_ib_t *lut,
+					    unsigned xsize, unsigned ysize,
+					    const char *page_ranges,
+					    int num_threads);
+extern void		cupsImagePagesRewind(cups_ipages_t *pages);
 extern void		cupsImageRGBAdjust(cups_ib_t *pixels, int count,
 			                   int saturation, int hue) _CUPS_API_1_2;
 extern void		cupsImageRGBToBlack(const cups_ib_t *in,
@@ -15,6 +15,14 @@
  *   cupsPackHorizontal2()   - Pack 2-bit pixels horizontally...
  *   cupsPackHorizontalBit() - Pack pixels horizontally by bit...
  *   cupsPackVertical()      - Pack pixels vertically...
+ *   pack_bits_sse2()        - Pack 16 pixels at a time with SSE2.
+ *   pack_bits_avx2()        - Pack 32 pixels at a time with AVX2.
+ *   pack_bits_neon()        - Pack 16 pixels at a time with NEON.
+ *   pack_bits()             - Pack whole bytes of 1-bit pixels with SIMD.
+ *   pack_2bits_sse2()       - Pack 64 2-bit pixels at a time with SSE2.
+ *   pack_2bits_avx2()       - Pack 128 2-bit pixels at a time with AVX2.
+ *   pack_2bits_neon()       - Pack 64 2-bit pixels at a time with NEON.
+ *   pack_2bits()            - Pack whole bytes of 2-bit pixels with SIMD.
  */
 
 /*
@@ -22,6 +30,41 @@
  */
 
 #include "driver.h"
+#include <string.h>
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#  if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#    include <immintrin.h>
+#    define PACK_AVX2			/* Build AVX2 code, chosen at run-time */
+#  endif /* __GNUC__ >= 5 || __clang__ */
+#elif defined(__ARM_NEON)
+#  include <arm_neon.h>
+#endif /* __SSE2__ */
+
+
+/*
+ * Local globals...
+ */
+
+#ifdef __SSE2__
+#  define R2(n)	n, n + 2 * 64, n + 1 * 64, n + 3 * 64
+#  define R4(n)	R2(n), R2(n + 2 * 16), R2(n + 1 * 16), R2(n + 3 * 16)
+#  define R6(n)	R4(n), R4(n + 2 * 4), R4(n + 1 * 4), R4(n + 3 * 4)
+
+static const unsigned char BitReverse[256] =
+					/* Bits of a byte in reverse order */
+	{ R6(0), R6(2), R6(1), R6(3) };
+#endif /* __SSE2__ */
+
+
+/*
+ * Local functions...
+ */
+
+static int	pack_bits(const unsigned char *ipixels, unsigned char *obytes,
+		          int width, unsigned char clearto, unsigned char bit);
+static int	pack_2bits(const unsigned char *ipixels, unsigned char *obytes,
+		           int width);
 
 
 /*
@@ -36,44 +79,40 @@ cupsPackHorizontal(const unsigned char *ipixels,/* I - Input pixels */
 		   const int           step)	/* I - Step value between pixels */
 {
   register unsigned char	b;		/* Current byte */
+  int				count;		/* Number of pixels packed */
 
 
  /*
-  * Do whole bytes first...
+  * Do whole bytes of adjacent pixels 16 or 32 at a time first...
   */
 
-  while (width > 7)
+  if (step == 1)
   {
-    b = clearto;
-
-    if (*ipixels)
-      b ^= 0x80;
-    ipixels += step;
-    if (*ipixels)
-      b ^= 0x40;
-    ipixels += step;
-    if (*ipixels)
-      b ^= 0x20;
-    ipixels += step;
-    if (*ipixels)
-      b ^= 0x10;
-    ipixels += step;
-    if (*ipixels)
-      b ^= 0x08;
-    ipixels += step;
-    if (*ipixels)
-      b ^= 0x04;
-    ipixels += step;
-    if (*ipixels)
-      b ^= 0x02;
-    ipixels += step;
-    if (*ipixels)
-      b ^= 0x01;
-    ipixels += step;
+    count   = pack_bits(ipixels, obytes, width, clearto, 0xff);
+    ipixels += count;
+    obytes  += count / 8;
+    width   -= count;
+  }
 
-    *obytes++ = b;
+ /*
+  * Then the remaining whole bytes, without branching on the pixels...
+  */
 
-    width -= 8;
+  while (width > 7)
+  {
+    b = ((ipixels[0] != 0) << 7) |
+        ((ipixels[step] != 0) << 6) |
+        ((ipixels[2 * step] != 0) << 5) |
+        ((ipixels[3 * step] != 0) << 4) |
+        ((ipixels[4 * step] != 0) << 3) |
+        ((ipixels[5 * step] != 0) << 2) |
+        ((ipixels[6 * step] != 0) << 1) |
+        (ipixels[7 * step] != 0);
+
+    *obytes++ = b ^ clearto;
+
+    ipixels += 8 * step;
+    width   -= 8;
   }
 
  /*
@@ -122,10 +161,23 @@ cupsPackHorizontal2(const unsigned char *ipixels,	/* I - Input pixels */
 		    const int           step)		/* I - Stepping value */
 {
   register unsigned char	b;			/* Current byte */
+  int				count;			/* Number of pixels packed */
+
+
+ /*
+  * Do whole bytes of adjacent pixels 64 or 128 at a time first...
+  */
 
+  if (step == 1)
+  {
+    count   = pack_2bits(ipixels, obytes, width);
+    ipixels += count;
+    obytes  += count / 4;
+    width   -= count;
+  }
 
  /*
-  * Do whole bytes first...
+  * Then the remaining whole bytes...
   */
 
   while (width > 3)
@@ -176,36 +228,37 @@ cupsPackHorizontalBit(const unsigned char *ipixels,	/* I - Input pixels */
 		      const unsigned char bit)		/* I - Bit to check */
 {
   register unsigned char	b;			/* Current byte */
+  int				count;			/* Number of pixels packed */
 
 
  /*
-  * Do whole bytes first...
+  * Do whole bytes 16 or 32 pixels at a time first...
   */
 
-  while (width > 7)
-  {
-    b = clearto;
-
-    if (*ipixels++ & bit)
-      b ^= 0x80;
-    if (*ipixels++ & bit)
-      b ^= 0x40;
-    if (*ipixels++ & bit)
-      b ^= 0x20;
-    if (*ipixels++ & bit)
-      b ^= 0x10;
-    if (*ipixels++ & bit)
-      b ^= 0x08;
-    if (*ipixels++ & bit)
-      b ^= 0x04;
-    if (*ipixels++ & bit)
-      b ^= 0x02;
-    if (*ipixels++ & bit)
-      b ^= 0x01;
+  count   = pack_bits(ipixels, obytes, width, clearto, bit);
+  ipixels += count;
+  obytes  += count / 8;
+  width   -= count;
 
-    *obytes++ = b;
+ /*
+  * Then the remaining whole bytes, without branching on the pixels...
+  */
 
-    width -= 8;
+  while (width > 7)
+  {
+    b = (((ipixels[0] & bit) != 0) << 7) |
+        (((ipixels[1] & bit) != 0) << 6) |
+        (((ipixels[2] & bit) != 0) << 5) |
+        (((ipixels[3] & bit) != 0) << 4) |
+        (((ipixels[4] & bit) != 0) << 3) |
+        (((ipixels[5] & bit) != 0) << 2) |
+        (((ipixels[6] & bit) != 0) << 1) |
+        ((ipixels[7] & bit) != 0);
+
+    *obytes++ = b ^ clearto;
+
+    ipixels += 8;
+    width   -= 8;
   }
 
  /*
@@ -254,38 +307,29 @@ cupsPackVertical(const unsigned char *ipixels,	/* I - Input pixels */
                  const unsigned char bit,	/* I - Output bit */
                  const int           step)	/* I - Number of bytes between columns */
 {
+  unsigned long long	pixels[2];	/* 16 pixels at once */
+  int			i;		/* Looping var */
+
+
  /*
-  * Loop through the entire array...
+  * Loop through the entire array, skipping blank runs of 16 pixels (the
+  * common case on a page) with a single test...
   */
 
-  while (width > 7)
+  while (width > 15)
   {
-    if (*ipixels++)
-      *obytes ^= bit;
-    obytes += step;
-    if (*ipixels++)
-      *obytes ^= bit;
-    obytes += step;
-    if (*ipixels++)
-      *obytes ^= bit;
-    obytes += step;
-    if (*ipixels++)
-      *obytes ^= bit;
-    obytes += step;
-    if (*ipixels++)
-      *obytes ^= bit;
-    obytes += step;
-    if (*ipixels++)
-      *obytes ^= bit;
-    obytes += step;
-    if (*ipixels++)
-      *obytes ^= bit;
-    obytes += step;
-    if (*ipixels++)
-      *obytes ^= bit;
-    obytes += step;
-
-    width -= 8;
+    memcpy(pixels, ipixels, sizeof(pixels));
+
+    if (pixels[0] | pixels[1])
+    {
+      for (i = 0; i < 16; i ++, obytes += step)
+        *obytes ^= bit & -(ipixels[i] != 0);
+    }
+    else
+      obytes += 16 * step;
+
+    ipixels += 16;
+    width   -= 16;
   }
 
   while (width > 0)
@@ -298,3 +342,349 @@ cupsPackVertical(const unsigned char *ipixels,	/* I - Input pixels */
   }
 }
 
+
+
+#ifdef __SSE2__
+/*
+ * 'pack_bits_sse2()' - Pack 16 pixels at a time with SSE2.
+ *
+ * The pixels are tested with a byte compare and gathered with movemask,
+ * which puts the first pixel in the lowest bit, so each byte is reversed
+ * through a table.
+ */
+
+static int				/* O - Number of pixels packed */
+pack_bits_sse2(
+    const unsigned char *ipixels,	/* I - Input pixels */
+    unsigned char       *obytes,	/* O - Output bytes */
+    int                 width,		/* I - Number of pixels */
+    unsigned char       clearto,	/* I - Initial value of bytes */
+    unsigned char       bit)		/* I - Bit to check */
+{
+  int		count;			/* Number of pixels packed */
+  unsigned	mask;			/* Off pixels */
+  __m128i	zero = _mm_setzero_si128(),
+					/* All zeros */
+		bits = _mm_set1_epi8((char)bit);
+					/* Bit to check in each pixel */
+
+
+  for (count = 0; count + 16 <= width; count += 16, obytes += 2)
+  {
+    mask = (unsigned)_mm_movemask_epi8(
+               _mm_cmpeq_epi8(_mm_and_si128(_mm_loadu_si128(
+                                  (const __m128i *)(ipixels + count)), bits),
+                              zero));
+
+    obytes[0] = BitReverse[~mask & 255] ^ clearto;
+    obytes[1] = BitReverse[(~mask >> 8) & 255] ^ clearto;
+  }
+
+  return (count);
+}
+
+
+#  ifdef PACK_AVX2
+/*
+ * 'pack_bits_avx2()' - Pack 32 pixels at a time with AVX2.
+ *
+ * The pixels of each byte are put in reverse order with a shuffle before
+ * the movemask, which then yields 4 output bytes directly.  The rest is
+ * left to pack_bits_sse2().
+ */
+
+__attribute__((target("avx2")))
+static int				/* O - Number of pixels packed */
+pack_bits_avx2(
+    const unsigned char *ipixels,	/* I - Input pixels */
+    unsigned char       *obytes,	/* O - Output bytes */
+    int                 width,		/* I - Number of pixels */
+    unsigned char       clearto,	/* I - Initial value of bytes */
+    unsigned char       bit)		/* I - Bit to check */
+{
+  int		count;			/* Number of pixels packed */
+  unsigned	mask,			/* On pixels */
+		clear4;			/* clearto in each of 4 bytes */
+  __m256i	zero = _mm256_setzero_si256(),
+					/* All zeros */
+		bits = _mm256_set1_epi8((char)bit),
+					/* Bit to check in each pixel */
+		reverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0,
+		                           15, 14, 13, 12, 11, 10, 9, 8,
+		                           7, 6, 5, 4, 3, 2, 1, 0,
+		                           15, 14, 13, 12, 11, 10, 9, 8);
+					/* Reverse pixels of each byte */
+
+
+  clear4 = clearto * 0x01010101U;
+
+  for (count = 0; count + 32 <= width; count += 32, obytes += 4)
+  {
+    mask = ~(unsigned)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_shuffle_epi8(
+                                      _mm256_loadu_si256(
+                                          (const __m256i *)(ipixels + count)),
+                                      reverse), bits),
+                                  zero)) ^ clear4;
+
+    obytes[0] = (unsigned char)mask;
+    obytes[1] = (unsigned char)(mask >> 8);
+    obytes[2] = (unsigned char)(mask >> 16);
+    obytes[3] = (unsigned char)(mask >> 24);
+  }
+
+  return (count + pack_bits_sse2(ipixels + count, obytes, width - count,
+                                 clearto, bit));
+}
+#  endif /* PACK_AVX2 */
+#endif /* __SSE2__ */
+
+
+#if defined(__ARM_NEON) && !defined(__SSE2__)
+/*
+ * 'pack_bits_neon()' - Pack 16 pixels at a time with NEON.
+ *
+ * Each on pixel selects its bit in the output byte, and 3 pairwise adds
+ * sum the 8 bits of each byte.
+ */
+
+static int				/* O - Number of pixels packed */
+pack_bits_neon(
+    const unsigned char *ipixels,	/* I - Input pixels */
+    unsigned char       *obytes,	/* O - Output bytes */
+    int                 width,		/* I - Number of pixels */
+    unsigned char       clearto,	/* I - Initial value of bytes */
+    unsigned char       bit)		/* I - Bit to check */
+{
+  static const unsigned char weights[16] =
+  {					/* Output bit of each pixel */
+    0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+    0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01
+  };
+  int		count;			/* Number of pixels packed */
+  uint8x16_t	bits = vdupq_n_u8(bit),	/* Bit to check in each pixel */
+		weight = vld1q_u8(weights),
+					/* Output bits */
+		on;			/* Output bits of on pixels */
+  uint8x8_t	sum;			/* Pairwise sums */
+
+
+  for (count = 0; count + 16 <= width; count += 16, obytes += 2)
+  {
+    on  = vandq_u8(vtstq_u8(vld1q_u8(ipixels + count), bits), weight);
+    sum = vpadd_u8(vget_low_u8(on), vget_high_u8(on));
+    sum = vpadd_u8(sum, sum);
+    sum = vpadd_u8(sum, sum);
+
+    obytes[0] = vget_lane_u8(sum, 0) ^ clearto;
+    obytes[1] = vget_lane_u8(sum, 1) ^ clearto;
+  }
+
+  return (count);
+}
+#endif /* __ARM_NEON && !__SSE2__ */
+
+
+/*
+ * 'pack_bits()' - Pack whole bytes of 1-bit pixels with SIMD.
+ *
+ * A pixel is on when "pixel & bit" is non-zero.  Returns the number of
+ * pixels packed, a multiple of 8; the caller packs the rest.
+ */
+
+static int				/* O - Number of pixels packed */
+pack_bits(const unsigned char *ipixels,	/* I - Input pixels */
+          unsigned char       *obytes,	/* O - Output bytes */
+          int                 width,	/* I - Number of pixels */
+          unsigned char       clearto,	/* I - Initial value of bytes */
+          unsigned char       bit)	/* I - Bit to check */
+{
+#if defined(__SSE2__)
+#  ifdef PACK_AVX2
+  if (__builtin_cpu_supports("avx2"))
+    return (pack_bits_avx2(ipixels, obytes, width, clearto, bit));
+#  endif /* PACK_AVX2 */
+
+  return (pack_bits_sse2(ipixels, obytes, width, clearto, bit));
+
+#elif defined(__ARM_NEON)
+  return (pack_bits_neon(ipixels, obytes, width, clearto, bit));
+
+#else
+  (void)ipixels;
+  (void)obytes;
+  (void)width;
+  (void)clearto;
+  (void)bit;
+
+  return (0);
+#endif /* __SSE2__ */
+}
+
+
+#ifdef __SSE2__
+/*
+ * 'pack_2bits_sse2()' - Pack 64 2-bit pixels at a time with SSE2.
+ *
+ * Like the scalar code the pixels are OR'd together unmasked: adjacent
+ * pixels are merged in 16-bit lanes, those pairs in 32-bit lanes, and the
+ * low bytes of the lanes are packed down to 16 output bytes.
+ */
+
+static int				/* O - Number of pixels packed */
+pack_2bits_sse2(
+    const unsigned char *ipixels,	/* I - Input pixels */
+    unsigned char       *obytes,	/* O - Output bytes */
+    int                 width)		/* I - Number of pixels */
+{
+  int		count,			/* Number of pixels packed */
+		i;			/* Looping var */
+  __m128i	mask16 = _mm_set1_epi16(0x03fc),
+					/* First pixel of a pair */
+		mask32 = _mm_set1_epi32(0x3ff0),
+					/* First pair of a quad */
+		byte32 = _mm_set1_epi32(0xff),
+					/* Output byte */
+		v[4];			/* Output bytes in 32-bit lanes */
+
+
+  for (count = 0; count + 64 <= width; count += 64, obytes += 16)
+  {
+    for (i = 0; i < 4; i ++)
+    {
+      v[i] = _mm_loadu_si128((const __m128i *)(ipixels + count + 16 * i));
+      v[i] = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(v[i], 2), mask16),
+                          _mm_srli_epi16(v[i], 8));
+      v[i] = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(v[i], 4), mask32),
+                          _mm_srli_epi32(v[i], 16));
+      v[i] = _mm_and_si128(v[i], byte32);
+    }
+
+    _mm_storeu_si128((__m128i *)obytes,
+                     _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]),
+                                      _mm_packs_epi32(v[2], v[3])));
+  }
+
+  return (count);
+}
+
+
+#  ifdef PACK_AVX2
+/*
+ * 'pack_2bits_avx2()' - Pack 128 2-bit pixels at a time with AVX2.
+ *
+ * Same as pack_2bits_sse2(), but the packs work within 128-bit lanes, so
+ * the 4-byte groups are put back in order with a permute.
+ */
+
+__attribute__((target("avx2")))
+static int				/* O - Number of pixels packed */
+pack_2bits_avx2(
+    const unsigned char *ipixels,	/* I - Input pixels */
+    unsigned char       *obytes,	/* O - Output bytes */
+    int                 width)		/* I - Number of pixels */
+{
+  int		count,			/* Number of pixels packed */
+		i;			/* Looping var */
+  __m256i	mask16 = _mm256_set1_epi16(0x03fc),
+					/* First pixel of a pair */
+		mask32 = _mm256_set1_epi32(0x3ff0),
+					/* First pair of a quad */
+		byte32 = _mm256_set1_epi32(0xff),
+					/* Output byte */
+		order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7),
+					/* Order of the 4-byte groups */
+		v[4];			/* Output bytes in 32-bit lanes */
+
+
+  for (count = 0; count + 128 <= width; count += 128, obytes += 32)
+  {
+    for (i = 0; i < 4; i ++)
+    {
+      v[i] = _mm256_loadu_si256((const __m256i *)(ipixels + count + 32 * i));
+      v[i] = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi16(v[i], 2),
+                                              mask16),
+                             _mm256_srli_epi16(v[i], 8));
+      v[i] = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(v[i], 4),
+                                              mask32),
+                             _mm256_srli_epi32(v[i], 16));
+      v[i] = _mm256_and_si256(v[i], byte32);
+    }
+
+    _mm256_storeu_si256((__m256i *)obytes,
+                        _mm256_permutevar8x32_epi32(
+                            _mm256_packus_epi16(
+                                _mm256_packs_epi32(v[0], v[1]),
+                                _mm256_packs_epi32(v[2], v[3])),
+                            order));
+  }
+
+  return (count + pack_2bits_sse2(ipixels + count, obytes, width - count));
+}
+#  endif /* PACK_AVX2 */
+#endif /* __SSE2__ */
+
+
+#if defined(__ARM_NEON) && !defined(__SSE2__)
+/*
+ * 'pack_2bits_neon()' - Pack 64 2-bit pixels at a time with NEON.
+ *
+ * A de-interleaving load puts each of the 4 pixels of the output bytes in
+ * its own register.
+ */
+
+static int				/* O - Number of pixels packed */
+pack_2bits_neon(
+    const unsigned char *ipixels,	/* I - Input pixels */
+    unsigned char       *obytes,	/* O - Output bytes */
+    int                 width)		/* I - Number of pixels */
+{
+  int		count;			/* Number of pixels packed */
+  uint8x16x4_t	v;			/* Pixels 0 to 3 of 16 output bytes */
+
+
+  for (count = 0; count + 64 <= width; count += 64, obytes += 16)
+  {
+    v = vld4q_u8(ipixels + count);
+
+    vst1q_u8(obytes, vorrq_u8(vorrq_u8(vshlq_n_u8(v.val[0], 6),
+                                       vshlq_n_u8(v.val[1], 4)),
+                              vorrq_u8(vshlq_n_u8(v.val[2], 2), v.val[3])));
+  }
+
+  return (count);
+}
+#endif /* __ARM_NEON && !__SSE2__ */
+
+
+/*
+ * 'pack_2bits()' - Pack whole bytes of 2-bit pixels with SIMD.
+ *
+ * Returns the number of pixels packed, a multiple of 4; the caller packs
+ * the rest.
+ */
+
+static int				/* O - Number of pixels packed */
+pack_2bits(const unsigned char *ipixels,/* I - Input pixels */
+           unsigned char       *obytes,	/* O - Output bytes */
+           int                 width)	/* I - Number of pixels */
+{
+#if defined(__SSE2__)
+#  ifdef PACK_AVX2
+  if (__builtin_cpu_supports("avx2"))
+    return (pack_2bits_avx2(ipixels, obytes, width));
+#  endif /* PACK_AVX2 */
+
+  return (pack_2bits_sse2(ipixels, obytes, width));
+
+#elif defined(__ARM_NEON)
+  return (pack_2bits_neon(ipixels, obytes, width));
+
+#else
+  (void)ipixels;
+  (void)obytes;
+  (void)width;
+
+  return (0);
+#endif /* __SSE2__ */
+}
@@ -44,6 +44,7 @@
 #include "driver.h"
 #include <string.h>
 #include <ctype.h>
+#include <sys/mman.h>
 #ifdef HAVE_CUPS_1_7
 #include <cups/pwg.h>
 #endif /* HAVE_CUPS_1_7 */
@@ -83,7 +84,6 @@
  */
 
 
-cups_array_t *opt_strings_catalog = NULL;
 char ppdgenerator_msg[1024];
 
 typedef struct _pwg_finishings_s	/**** PWG finishings mapping data ****/
@@ -95,6 +95,18 @@ typedef struct _pwg_finishings_s	/**** PWG finishings mapping data ****/
 
 #define _PWG_EQUIVALENT(x, y)	(abs((x)-(y)) < 2)
 
+typedef struct ppd_size_strings_s	/**** Formatted PPD media size ****/
+{
+  char		name[128];		/* PPD size name */
+  char		*human_readable;	/* Human-readable name or NULL */
+  char		width[32],		/* Width string */
+		length[32],		/* Length string */
+		left[32],		/* Left string */
+		bottom[32],		/* Bottom string */
+		right[32],		/* Right string */
+		top[32];		/* Top string */
+} ppd_size_strings_t;
+
 static void	pwg_ppdize_name(const char *ipp, char *name, size_t namesize);
 static void	pwg_ppdize_resolution(ipp_attribute_t *attr, int element,
                                  int *xres, int *yres, char *name, size_t namesize);
@@ -572,6 +584,73 @@ typedef struct ipp_opt_strings_s {
   cups_array_t *choices;
 } ipp_opt_strings_t;
 
+/*
+ * Compiled UI string catalog: After parsing, the option and choice
+ * strings are put into one contiguous block which contains only
+ * offsets, no pointers, so that it can be written to a cache file as it
+ * is and mapped into memory by later processes. It consists of the
+ * header, a hash table of entry indices, the entries ("option" or
+ * "option.choice" key and human-readable string), and the strings.
+ */
+
+#define IPP_STRINGS_MAGIC	"CFUISTR"	/* Cache file magic */
+#define IPP_STRINGS_VERSION	1		/* Cache file format version */
+
+typedef struct ipp_strings_header_s	/**** Compiled catalog header ****/
+{
+  char		magic[8];		/* IPP_STRINGS_MAGIC */
+  unsigned	version,		/* IPP_STRINGS_VERSION */
+		size,			/* Size of the whole block */
+		num_buckets,		/* Size of hash table (power of 2) */
+		num_entries,		/* Number of entries */
+		source,			/* Offset of source file name/URI */
+		reserved;		/* Padding */
+  long long	source_size,		/* Size of the source file */
+		source_mtime;		/* Modification time of source file */
+} ipp_strings_header_t;
+
+typedef struct ipp_strings_entry_s	/**** Compiled catalog entry ****/
+{
+  unsigned	hash,			/* Hash of the key */
+		key,			/* Offset of "option[.choice]" */
+		value,			/* Offset of human-readable string */
+		next;			/* Next entry in bucket + 1, 0 = none */
+} ipp_strings_entry_t;
+
+typedef struct ipp_strings_catalog_s	/**** Compiled catalog ****/
+{
+  char		*data;			/* Catalog block */
+  size_t	size;			/* Size of block */
+  int		mapped;			/* Mapped from cache file? */
+} ipp_strings_catalog_t;
+
+/* Data structure for a printer's own UI string catalog, cached per
+   printer */
+typedef struct ipp_printer_strings_s {
+  char *printer;			/* printer-uuid or printer URI */
+  char *uri;				/* printer-strings-uri */
+  ipp_strings_catalog_t *catalog;
+  time_t loaded;			/* When the catalog was downloaded */
+  time_t used;				/* When the catalog was last asked for */
+} ipp_printer_strings_t;
+
+/* Printer UI string catalogs are downloaded again after this many
+   seconds, and those not asked for in this time are dropped, as their
+   printers are probably gone */
+#define IPP_PRINTER_STRINGS_TTL	3600
+
+/* Maximum number of cached printer UI string catalogs */
+#define IPP_PRINTER_STRINGS_MAX	64
+
+/* CUPS' UI string catalog, loaded once per process */
+static ipp_strings_catalog_t *opt_strings_catalog = NULL;
+
+/* Cache file for the compiled CUPS UI string catalog */
+static char *opt_strings_cache = NULL;
+
+/* Printer-specific UI string catalogs already loaded by this process */
+static cups_array_t *printer_opt_strings_catalogs = NULL;
+
 int
 compare_choices(void *a, void *b, void *user_data)
 {
@@ -704,51 +783,106 @@ add_choice_to_array(char *name, char *human_readable, char *opt_name,
 
 }
 
+/*
+ * 'strings_hash()' - Continue a case-insensitive FNV-1a hash with a string.
+ */
+
+static unsigned
+strings_hash(unsigned   hash,		/* I - Hash so far */
+	     const char *s)		/* I - String to add */
+{
+  while (*s)
+    hash = (hash ^ (unsigned char)tolower(*s++)) * 16777619U;
+
+  return (hash);
+}
+
+/*
+ * 'lookup_strings()' - Look up an option or a choice in a compiled
+ *                      UI string catalog.
+ */
+
+static const char *
+lookup_strings(ipp_strings_catalog_t *catalog,
+		/* I - Compiled catalog or NULL */
+	       const char            *opt_name,
+		/* I - Option name */
+	       const char            *choice_name)
+		/* I - Choice name or NULL for the option itself */
+{
+  const ipp_strings_header_t	*header;
+  const unsigned		*buckets;
+  const ipp_strings_entry_t	*entries,
+				*entry;
+  const char			*key;
+  unsigned			hash,
+				i;
+  size_t			len;
+
+
+  if (!catalog || !opt_name)
+    return (NULL);
+
+  header  = (const ipp_strings_header_t *)catalog->data;
+  buckets = (const unsigned *)(header + 1);
+  entries = (const ipp_strings_entry_t *)(buckets + header->num_buckets);
+
+  hash = strings_hash(2166136261U, opt_name);
+  if (choice_name)
+    hash = strings_hash(strings_hash(hash, "."), choice_name);
+  len = strlen(opt_name);
+
+  for (i = buckets[hash & (header->num_buckets - 1)]; i; i = entry->next)
+  {
+    entry = entries + i - 1;
+    if (entry->hash != hash)
+      continue;
+    key = catalog->data + entry->key;
+    if (strncasecmp(key, opt_name, len))
+      continue;
+    if (choice_name ? (key[len] == '.' && !strcasecmp(key + len + 1,
+						      choice_name)) :
+	key[len] == '\0')
+      return (catalog->data + entry->value);
+  }
+
+  return (NULL);
+}
+
 char *
-lookup_option(char *name, cups_array_t *options,
-	      cups_array_t *printer_options)
+lookup_option(char *name, ipp_strings_catalog_t *catalog,
+	      ipp_strings_catalog_t *printer_catalog)
 {
-  ipp_opt_strings_t *opt = NULL;
+  const char *human_readable;
 
-  if (!name || !options)
+  if (!name)
     return NULL;
 
-  if (printer_options &&
-      (opt = find_opt_in_array(printer_options, name)) != NULL)
-    return opt->human_readable;
-  if ((opt = find_opt_in_array(options, name)) != NULL)
-    return opt->human_readable;
-  else
-    return NULL;
+  if ((human_readable = lookup_strings(printer_catalog, name, NULL)) == NULL)
+    human_readable = lookup_strings(catalog, name, NULL);
+
+  return (char *)human_readable;
 }
 
 char *
-lookup_choice(char *name, char *opt_name, cups_array_t *options,
-	      cups_array_t *printer_options)
+lookup_choice(char *name, char *opt_name, ipp_strings_catalog_t *catalog,
+	      ipp_strings_catalog_t *printer_catalog)
 {
-  ipp_opt_strings_t *opt = NULL;
-  ipp_choice_strings_t *choice = NULL;
+  const char *human_readable;
 
-  if (!name || !opt_name || !options)
+  if (!name || !opt_name)
     return NULL;
 
-  if (printer_options &&
-      (opt = find_opt_in_array(printer_options, opt_name)) != NULL &&
-      (choice = find_choice_in_array(opt->choices, name)) != NULL)
-    return choice->human_readable;
-  else if ((opt = find_opt_in_array(options, opt_name)) != NULL &&
-	   (choice = find_choice_in_array(opt->choices, name)) != NULL)
-    return choice->human_readable;
-  else
-    return NULL;
+  if ((human_readable = lookup_strings(printer_catalog, opt_name,
+				       name)) == NULL)
+    human_readable = lookup_strings(catalog, opt_name, name);
+
+  return (char *)human_readable;
 }
 
 void
-load_opt_strings_catalog(const char *location, cups_array_t *options)
+parse_opt_strings_catalog(const char *filename, cups_array_t *options)
 {
-  char tmpfile[1024];
-  const char *filename = NULL;
-  struct stat statbuf;
   cups_file_t *fp;
   char line[65536];
   char *ptr, *start, *start2, *end, *end2, *sep;
@@ -761,26 +895,6 @@ load_opt_strings_catalog(const char *location, cups_array_t *options)
 		     2: "..." = "..."
 		    10: EOF, save last entry */
   int digit;
-  int found_in_catalog = 0;
-
-  if (location == NULL || (strncasecmp(location, "http:", 5) &&
-			   strncasecmp(location, "https:", 6))) {
-    if (location == NULL ||
-	(stat(location, &statbuf) == 0 &&
-	 S_ISDIR(statbuf.st_mode))) /* directory? */
-    {
-      filename = _findCUPSMessageCatalog(location);
-      if (filename)
-        found_in_catalog = 1;
-    }
-    else
-      filename = location;
-  } else {
-    if (get_url(location, tmpfile, sizeof(tmpfile)))
-      filename = tmpfile;
-  }
-  if (!filename)
-    return;
 
   if ((fp = cupsFileOpen(filename, "r")) == NULL)
     return;
@@ -954,12 +1068,505 @@ load_opt_strings_catalog(const char *location, cups_array_t *options)
     free(choice_name);
   if (opt_name != NULL)
     free(opt_name);
+}
+
+void
+load_opt_strings_catalog(const char *location, cups_array_t *options)
+{
+  char tmpfile[1024];
+  const char *filename = NULL;
+  struct stat statbuf;
+  int found_in_catalog = 0;
+
+  if (location == NULL || (strncasecmp(location, "http:", 5) &&
+			   strncasecmp(location, "https:", 6))) {
+    if (location == NULL ||
+	(stat(location, &statbuf) == 0 &&
+	 S_ISDIR(statbuf.st_mode))) /* directory? */
+    {
+      filename = _findCUPSMessageCatalog(location);
+      if (filename)
+        found_in_catalog = 1;
+    }
+    else
+      filename = location;
+  } else {
+    if (get_url(location, tmpfile, sizeof(tmpfile)))
+      filename = tmpfile;
+  }
+  if (!filename)
+    return;
+
+  parse_opt_strings_catalog(filename, options);
+
   if (filename == tmpfile)
     unlink(filename);
   if (found_in_catalog)
     free((char *)filename);
 }
 
+/*
+ * 'add_strings_entry()' - Append an entry to a compiled catalog under
+ *                         construction.
+ */
+
+static void
+add_strings_entry(char       *data,	/* I  - Catalog block */
+		  unsigned   *pos,	/* IO - Offset of free string space */
+		  const char *opt_name,	/* I  - Option name */
+		  const char *choice_name,
+					/* I  - Choice name or NULL */
+		  const char *human_readable)
+					/* I  - Human-readable string */
+{
+  ipp_strings_header_t	*header = (ipp_strings_header_t *)data;
+  unsigned		*buckets = (unsigned *)(header + 1);
+  ipp_strings_entry_t	*entry;
+  size_t		len;
+
+
+  entry = (ipp_strings_entry_t *)(buckets + header->num_buckets) +
+	  header->num_entries;
+
+  entry->hash = strings_hash(2166136261U, opt_name);
+  entry->key  = *pos;
+  len         = strlen(opt_name);
+  memcpy(data + *pos, opt_name, len);
+  *pos += len;
+  if (choice_name) {
+    entry->hash = strings_hash(strings_hash(entry->hash, "."), choice_name);
+    data[(*pos) ++] = '.';
+    len = strlen(choice_name);
+    memcpy(data + *pos, choice_name, len);
+    *pos += len;
+  }
+  data[(*pos) ++] = '\0';
+
+  entry->value = *pos;
+  len          = strlen(human_readable) + 1;
+  memcpy(data + *pos, human_readable, len);
+  *pos += len;
+
+  entry->next = buckets[entry->hash & (header->num_buckets - 1)];
+  buckets[entry->hash & (header->num_buckets - 1)] = ++ header->num_entries;
+}
+
+/*
+ * 'compile_opt_strings_catalog()' - Put the strings of a parsed catalog
+ *                                   into a compiled catalog.
+ */
+
+static ipp_strings_catalog_t *
+compile_opt_strings_catalog(cups_array_t *options,
+					/* I - Parsed catalog */
+			    const char   *source,
+					/* I - Source file name/URI */
+			    struct stat  *sourceinfo)
+					/* I - Source file info or NULL */
+{
+  ipp_strings_catalog_t	*catalog;
+  ipp_strings_header_t	*header;
+  ipp_opt_strings_t	*opt;
+  ipp_choice_strings_t	*choice;
+  size_t		num_entries = 0,
+			strsize,
+			size;
+  unsigned		num_buckets = 16,
+			pos;
+
+
+ /*
+  * Count the entries and the space needed for the strings...
+  */
+
+  strsize = strlen(source) + 1;
+  for (opt = cupsArrayFirst(options); opt; opt = cupsArrayNext(options)) {
+    if (opt->human_readable) {
+      num_entries ++;
+      strsize += strlen(opt->name) + strlen(opt->human_readable) + 2;
+    }
+    for (choice = cupsArrayFirst(opt->choices); choice;
+	 choice = cupsArrayNext(opt->choices))
+      if (choice->human_readable) {
+	num_entries ++;
+	strsize += strlen(opt->name) + strlen(choice->name) +
+		   strlen(choice->human_readable) + 3;
+      }
+  }
+
+  while (num_buckets < 2 * num_entries)
+    num_buckets <<= 1;
+
+  size = sizeof(ipp_strings_header_t) + num_buckets * sizeof(unsigned) +
+	 num_entries * sizeof(ipp_strings_entry_t) + strsize;
+  if (size > INT_MAX)
+    return (NULL);
+
+  if ((catalog = calloc(1, sizeof(ipp_strings_catalog_t))) == NULL)
+    return (NULL);
+  if ((catalog->data = calloc(1, size)) == NULL) {
+    free(catalog);
+    return (NULL);
+  }
+  catalog->size = size;
+
+ /*
+  * Fill in the header and add the entries...
+  */
+
+  header = (ipp_strings_header_t *)catalog->data;
+  memcpy(header->magic, IPP_STRINGS_MAGIC, sizeof(header->magic));
+  header->version     = IPP_STRINGS_VERSION;
+  header->size        = (unsigned)size;
+  header->num_buckets = num_buckets;
+  if (sourceinfo) {
+    header->source_size  = (long long)sourceinfo->st_size;
+    header->source_mtime = (long long)sourceinfo->st_mtime;
+  }
+
+  pos = (unsigned)(size - strsize);
+  header->source = pos;
+  memcpy(catalog->data + pos, source, strlen(source) + 1);
+  pos += strlen(source) + 1;
+
+  for (opt = cupsArrayFirst(options); opt; opt = cupsArrayNext(options)) {
+    if (opt->human_readable)
+      add_strings_entry(catalog->data, &pos, opt->name, NULL,
+			opt->human_readable);
+    for (choice = cupsArrayFirst(opt->choices); choice;
+	 choice = cupsArrayNext(opt->choices))
+      if (choice->human_readable)
+	add_strings_entry(catalog->data, &pos, opt->name, choice->name,
+			  choice->human_readable);
+  }
+
+  return (catalog);
+}
+
+/*
+ * 'free_strings_catalog()' - Free or unmap a compiled catalog.
+ */
+
+static void
+free_strings_catalog(ipp_strings_catalog_t *catalog)
+					/* I - Compiled catalog */
+{
+  if (!catalog)
+    return;
+
+  if (catalog->mapped)
+    munmap(catalog->data, catalog->size);
+  else
+    free(catalog->data);
+
+  free(catalog);
+}
+
+/*
+ * 'check_strings_catalog()' - Check the structure of a compiled catalog
+ *                             read from a cache file, so that lookups
+ *                             cannot go out of its bounds.
+ */
+
+static int				/* O - 1 if OK, 0 if damaged */
+check_strings_catalog(const char *data,	/* I - Catalog block */
+		      size_t     size)	/* I - Size of block */
+{
+  const ipp_strings_header_t	*header = (const ipp_strings_header_t *)data;
+  const unsigned		*buckets = (const unsigned *)(header + 1);
+  const ipp_strings_entry_t	*entries;
+  size_t			strings;
+  unsigned			i;
+
+
+  if (size < sizeof(ipp_strings_header_t) ||
+      memcmp(header->magic, IPP_STRINGS_MAGIC, sizeof(header->magic)) ||
+      header->version != IPP_STRINGS_VERSION || header->size != size ||
+      data[size - 1] != '\0' || header->num_buckets == 0 ||
+      (header->num_buckets & (header->num_buckets - 1)) ||
+      header->num_buckets > size / sizeof(unsigned) ||
+      header->num_entries > size / sizeof(ipp_strings_entry_t))
+    return (0);
+
+  strings = sizeof(ipp_strings_header_t) +
+	    header->num_buckets * sizeof(unsigned) +
+	    header->num_entries * sizeof(ipp_strings_entry_t);
+  if (strings > size || header->source < strings || header->source >= size)
+    return (0);
+
+  for (i = 0; i < header->num_buckets; i ++)
+    if (buckets[i] > header->num_entries)
+      return (0);
+
+  entries = (const ipp_strings_entry_t *)(buckets + header->num_buckets);
+  for (i = 0; i < header->num_entries; i ++)
+    if (entries[i].next > header->num_entries ||
+	entries[i].key < strings || entries[i].key >= size ||
+	entries[i].value < strings || entries[i].value >= size)
+      return (0);
+
+  return (1);
+}
+
+/*
+ * 'map_strings_catalog()' - Map a compiled catalog from a cache file if it
+ *                           was made from the given source file and is
+ *                           still up to date with it.
+ */
+
+static ipp_strings_catalog_t *
+map_strings_catalog(const char *cachefile,
+					/* I - Cache file */
+		    const char *source)	/* I - Message catalog in use */
+{
+  ipp_strings_catalog_t		*catalog;
+  const ipp_strings_header_t	*header;
+  struct stat			fileinfo,
+				sourceinfo;
+  void				*data;
+  int				fd;
+
+
+  if ((fd = open(cachefile, O_RDONLY)) < 0)
+    return (NULL);
+
+  if (fstat(fd, &fileinfo) ||
+      fileinfo.st_size < (off_t)sizeof(ipp_strings_header_t) ||
+      fileinfo.st_size > INT_MAX) {
+    close(fd);
+    return (NULL);
+  }
+
+  data = mmap(NULL, (size_t)fileinfo.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return (NULL);
+
+  header = (const ipp_strings_header_t *)data;
+  if (!check_strings_catalog(data, (size_t)fileinfo.st_size) ||
+      strcmp((const char *)data + header->source, source) ||
+      stat((const char *)data + header->source, &sourceinfo) ||
+      (long long)sourceinfo.st_size != header->source_size ||
+      (long long)sourceinfo.st_mtime != header->source_mtime ||
+      (catalog = calloc(1, sizeof(ipp_strings_catalog_t))) == NULL) {
+    munmap(data, (size_t)fileinfo.st_size);
+    return (NULL);
+  }
+
+  catalog->data   = data;
+  catalog->size   = (size_t)fileinfo.st_size;
+  catalog->mapped = 1;
+
+  return (catalog);
+}
+
+/*
+ * 'save_strings_catalog()' - Write a compiled catalog into a cache file.
+ *
+ * The file is replaced atomically, as other processes may have the old
+ * one mapped.
+ */
+
+static void
+save_strings_catalog(ipp_strings_catalog_t *catalog,
+					/* I - Compiled catalog */
+		     const char            *cachefile)
+					/* I - Cache file */
+{
+  char	tempfile[1024];			/* Temporary file */
+  int	fd;				/* File descriptor */
+
+
+  snprintf(tempfile, sizeof(tempfile), "%s.XXXXXX", cachefile);
+  if ((fd = mkstemp(tempfile)) < 0)
+    return;
+
+  if (fchmod(fd, 0644) ||
+      write(fd, catalog->data, catalog->size) != (ssize_t)catalog->size) {
+    close(fd);
+    unlink(tempfile);
+    return;
+  }
+
+  if (close(fd) || rename(tempfile, cachefile))
+    unlink(tempfile);
+}
+
+/*
+ * 'load_cups_strings_catalog()' - Load CUPS' UI string catalog, from the
+ *                                 cache file if it is up to date, otherwise
+ *                                 by parsing CUPS' message catalog and
+ *                                 updating the cache file.
+ */
+
+static ipp_strings_catalog_t *
+load_cups_strings_catalog(void)
+{
+  ipp_strings_catalog_t	*catalog;
+  cups_array_t		*options;
+  const char		*filename;
+  struct stat		sourceinfo;
+
+
+  /*
+   * The catalog chosen depends on the locale, so the cache is only valid
+   * if it was made from the same file...
+   */
+
+  filename = _findCUPSMessageCatalog(NULL);
+
+  if (opt_strings_cache && filename &&
+      (catalog = map_strings_catalog(opt_strings_cache, filename)) != NULL)
+  {
+    free((char *)filename);
+    return (catalog);
+  }
+
+  if ((options = optArrayNew()) == NULL)
+  {
+    free((char *)filename);
+    return (NULL);
+  }
+
+  memset(&sourceinfo, 0, sizeof(sourceinfo));
+  if (filename && stat(filename, &sourceinfo) == 0)
+    parse_opt_strings_catalog(filename, options);
+
+  catalog = compile_opt_strings_catalog(options, filename ? filename : "",
+					&sourceinfo);
+  cupsArrayDelete(options);
+
+  if (catalog && filename && opt_strings_cache)
+    save_strings_catalog(catalog, opt_strings_cache);
+
+  free((char *)filename);
+
+  return (catalog);
+}
+
+/*
+ * 'ppdgeneratorSetStringsCache()' - Set the file in which the compiled CUPS
+ *                                   UI string catalog is kept, so that the
+ *                                   message catalog is only parsed again
+ *                                   when it changes. NULL for no cache file.
+ */
+
+void
+ppdgeneratorSetStringsCache(const char *filename)
+					/* I - Cache file or NULL */
+{
+  if (opt_strings_cache)
+    free(opt_strings_cache);
+  opt_strings_cache = (filename ? strdup(filename) : NULL);
+}
+
+
+int
+compare_printer_strings(void *a, void *b, void *user_data)
+{
+  return strcmp(((ipp_printer_strings_t *)a)->printer,
+		((ipp_printer_strings_t *)b)->printer);
+}
+
+void
+free_printer_strings(void* entry, void* user_data)
+{
+  ipp_printer_strings_t *entry_rec = (ipp_printer_strings_t *)entry;
+
+  if (entry_rec) {
+    if (entry_rec->printer) free(entry_rec->printer);
+    if (entry_rec->uri) free(entry_rec->uri);
+    free_strings_catalog(entry_rec->catalog);
+    free(entry_rec);
+  }
+}
+
+/*
+ * 'get_printer_opt_strings_catalog()' - Get the UI string catalog of a
+ *                                       printer, downloading and parsing
+ *                                       it only on the first request for
+ *                                       the printer. cups-browsed
+ *                                       re-creates the PPDs of the same
+ *                                       printers again and again. The
+ *                                       catalog is downloaded again if
+ *                                       the printer-strings-uri of the
+ *                                       printer changes or after
+ *                                       IPP_PRINTER_STRINGS_TTL seconds,
+ *                                       and catalogs of printers not
+ *                                       seen for that long are dropped.
+ */
+
+ipp_strings_catalog_t *
+get_printer_opt_strings_catalog(const char *printer, const char *uri)
+{
+  ipp_printer_strings_t key, *catalog, *oldest;
+  cups_array_t *options;
+  time_t now = time(NULL);
+
+  if (!uri)
+    return NULL;
+  if (!printer)
+    printer = uri;
+
+  if (printer_opt_strings_catalogs == NULL &&
+      (printer_opt_strings_catalogs =
+       cupsArrayNew3(compare_printer_strings, NULL, NULL, 0,
+		     NULL, free_printer_strings)) == NULL)
+    return NULL;
+
+  /* Drop the catalogs of printers which did not show up for a while,
+     and the least recently used one if there are too many */
+  oldest = NULL;
+  for (catalog = cupsArrayFirst(printer_opt_strings_catalogs); catalog;
+       catalog = cupsArrayNext(printer_opt_strings_catalogs)) {
+    if (now - catalog->used > IPP_PRINTER_STRINGS_TTL ||
+	now < catalog->used)
+      cupsArrayRemove(printer_opt_strings_catalogs, catalog);
+    else if (!oldest || catalog->used < oldest->used)
+      oldest = catalog;
+  }
+
+  key.printer = (char *)printer;
+  if ((catalog = cupsArrayFind(printer_opt_strings_catalogs, &key)) == NULL) {
+    if (oldest &&
+	cupsArrayCount(printer_opt_strings_catalogs) >= IPP_PRINTER_STRINGS_MAX)
+      cupsArrayRemove(printer_opt_strings_catalogs, oldest);
+    if ((catalog = calloc(1, sizeof(ipp_printer_strings_t))) == NULL)
+      return NULL;
+    catalog->printer = strdup(printer);
+    catalog->uri = strdup(uri);
+    if (!catalog->printer || !catalog->uri ||
+	!cupsArrayAdd(printer_opt_strings_catalogs, catalog)) {
+      free_printer_strings(catalog, NULL);
+      return NULL;
+    }
+  } else if (strcmp(catalog->uri, uri) ||
+	     now - catalog->loaded > IPP_PRINTER_STRINGS_TTL ||
+	     now < catalog->loaded) {
+    /* The printer moved its catalog or ours is old, get it again */
+    char *new_uri = strdup(uri);
+    if (!new_uri)
+      return NULL;
+    free(catalog->uri);
+    catalog->uri = new_uri;
+    free_strings_catalog(catalog->catalog);
+    catalog->catalog = NULL;
+  }
+  catalog->used = now;
+
+  /* Load the catalog if we do not have it yet or if the printer did not
+     deliver it last time */
+  if (catalog->catalog == NULL && (options = optArrayNew()) != NULL) {
+    load_opt_strings_catalog(uri, options);
+    if (cupsArrayCount(options) > 0)
+      catalog->catalog = compile_opt_strings_catalog(options, uri, NULL);
+    cupsArrayDelete(options);
+    catalog->loaded = now;
+  }
+
+  return catalog->catalog;
+}
+
 
 int
 compare_resolutions(void *resolution_a, void *resolution_b,
@@ -1618,7 +2225,7 @@ ppdCreateFromIPP2(char         *buffer,          /* I - Filename buffer */
 					/* Localization info */
   struct lconv		*loc = localeconv();
 					/* Locale data */
-  cups_array_t          *printer_opt_strings_catalog = NULL;
+  ipp_strings_catalog_t *printer_opt_strings_catalog = NULL;
                                         /* Printer-specific option UI strings */
   char                  *human_readable,
                         *human_readable2;
@@ -1804,18 +2411,21 @@ ppdCreateFromIPP2(char         *buffer,          /* I - Filename buffer */
 								    NULL));
 
   /* Message catalogs for UI strings */
-  if (opt_strings_catalog == NULL) {
-    opt_strings_catalog = optArrayNew();
-    load_opt_strings_catalog(NULL, opt_strings_catalog);
-  }
+  if (opt_strings_catalog == NULL)
+    opt_strings_catalog = load_cups_strings_catalog();
   if ((attr = ippFindAttribute(response, "printer-strings-uri",
 			       IPP_TAG_URI)) != NULL) {
-    printer_opt_strings_catalog = optArrayNew();
-    load_opt_strings_catalog(ippGetString(attr, 0, NULL),
-			     printer_opt_strings_catalog);
-    if (printer_opt_strings_catalog)
-      cupsFilePrintf(fp, "*cupsStringsURI: \"%s\"\n", ippGetString(attr, 0,
-								   NULL));
+    const char *printer =
+      ippGetString(ippFindAttribute(response, "printer-uuid", IPP_TAG_URI),
+		   0, NULL);
+    if (!printer)
+      printer = ippGetString(ippFindAttribute(response,
+					      "printer-uri-supported",
+					      IPP_TAG_URI), 0, NULL);
+    printer_opt_strings_catalog =
+      get_printer_opt_strings_catalog(printer, ippGetString(attr, 0, NULL));
+    cupsFilePrintf(fp, "*cupsStringsURI: \"%s\"\n", ippGetString(attr, 0,
+								 NULL));
   }
 
  /*
@@ -2191,119 +2801,99 @@ ppdCreateFromIPP2(char         *buffer,          /* I - Filename buffer */
   if (cupsArrayCount(sizes) > 0) {
    /*
     * List all of the standard sizes...
+    *
+    * The names, human-readable strings and dimensions of each size are
+    * formatted once into a table which is then used for the PageSize,
+    * PageRegion, ImageableArea and PaperDimension entries.
     */
 
     char	tleft[256],		/* Left string */
 		tbottom[256],		/* Bottom string */
 		tright[256],		/* Right string */
-		ttop[256],		/* Top string */
-		twidth[256],		/* Width string */
-		tlength[256],		/* Length string */
-		ppdsizename[128];
+		ttop[256];		/* Top string */
     char        *ippsizename;
-    cupsFilePrintf(fp, "*OpenUI *PageSize/%s: PickOne\n"
-		   "*OrderDependency: 10 AnySetup *PageSize\n"
-		   "*DefaultPageSize: %s\n", "Media Size", ppdname);
-    for (size = (cups_size_t *)cupsArrayFirst(sizes); size;
-	 size = (cups_size_t *)cupsArrayNext(sizes)) {
-      _cupsStrFormatd(twidth, twidth + sizeof(twidth),
+    ppd_size_strings_t *size_strings,	/* Formatted sizes */
+		*ss;			/* Current formatted size */
+    int         num_size_strings;	/* Number of formatted sizes */
+
+    if ((size_strings = calloc((size_t)cupsArrayCount(sizes),
+			       sizeof(ppd_size_strings_t))) == NULL) {
+      cupsArrayDelete(sizes);
+      goto bad_ppd;
+    }
+
+    for (size = (cups_size_t *)cupsArrayFirst(sizes), ss = size_strings;
+	 size;
+	 size = (cups_size_t *)cupsArrayNext(sizes), ss ++) {
+      _cupsStrFormatd(ss->width, ss->width + sizeof(ss->width),
 		      size->width * 72.0 / 2540.0, loc);
-      _cupsStrFormatd(tlength, tlength + sizeof(tlength),
+      _cupsStrFormatd(ss->length, ss->length + sizeof(ss->length),
 		      size->length * 72.0 / 2540.0, loc);
-      strlcpy(ppdsizename, size->media, sizeof(ppdsizename));
-      if ((ippsizename = strchr(ppdsizename, ' ')) != NULL) {
+      _cupsStrFormatd(ss->left, ss->left + sizeof(ss->left),
+		      size->left * 72.0 / 2540.0, loc);
+      _cupsStrFormatd(ss->bottom, ss->bottom + sizeof(ss->bottom),
+		      size->bottom * 72.0 / 2540.0, loc);
+      _cupsStrFormatd(ss->right, ss->right + sizeof(ss->right),
+		      (size->width - size->right) * 72.0 / 2540.0, loc);
+      _cupsStrFormatd(ss->top, ss->top + sizeof(ss->top),
+		      (size->length - size->top) * 72.0 / 2540.0, loc);
+      strlcpy(ss->name, size->media, sizeof(ss->name));
+      if ((ippsizename = strchr(ss->name, ' ')) != NULL) {
 	*ippsizename = '\0';
 	ippsizename ++;
       }
 
       if (ippsizename)
-	human_readable = lookup_choice(ippsizename, "media",
-				       opt_strings_catalog,
-				       printer_opt_strings_catalog);
-      else
-	human_readable = NULL;
-      if (!human_readable) {
+	ss->human_readable = lookup_choice(ippsizename, "media",
+					   opt_strings_catalog,
+					   printer_opt_strings_catalog);
+      if (!ss->human_readable) {
 	pwg = pwgMediaForSize(size->width, size->length);
 	if (pwg)
-	  human_readable = lookup_choice((char *)pwg->pwg, "media",
-					 opt_strings_catalog,
-					 printer_opt_strings_catalog);
+	  ss->human_readable = lookup_choice((char *)pwg->pwg, "media",
+					     opt_strings_catalog,
+					     printer_opt_strings_catalog);
       }
+    }
+    num_size_strings = (int)(ss - size_strings);
+
+    cupsFilePrintf(fp, "*OpenUI *PageSize/%s: PickOne\n"
+		   "*OrderDependency: 10 AnySetup *PageSize\n"
+		   "*DefaultPageSize: %s\n", "Media Size", ppdname);
+    for (i = 0, ss = size_strings; i < num_size_strings; i ++, ss ++)
       cupsFilePrintf(fp, "*PageSize %s%s%s%s: \"<</PageSize[%s %s]>>setpagedevice\"\n",
-		     ppdsizename,
-		     (human_readable ? "/" : ""),
-		     (human_readable ? human_readable : ""),
-		     (human_readable && strstr(ppdsizename, ".Borderless") ?
+		     ss->name,
+		     (ss->human_readable ? "/" : ""),
+		     (ss->human_readable ? ss->human_readable : ""),
+		     (ss->human_readable && strstr(ss->name, ".Borderless") ?
 		      " (Borderless)" : ""),
-		     twidth, tlength);
-    }
+		     ss->width, ss->length);
     cupsFilePuts(fp, "*CloseUI: *PageSize\n");
 
     cupsFilePrintf(fp, "*OpenUI *PageRegion/%s: PickOne\n"
 		   "*OrderDependency: 10 AnySetup *PageRegion\n"
 		   "*DefaultPageRegion: %s\n", "Media Size", ppdname);
-    for (size = (cups_size_t *)cupsArrayFirst(sizes); size;
-	 size = (cups_size_t *)cupsArrayNext(sizes)) {
-      _cupsStrFormatd(twidth, twidth + sizeof(twidth),
-		      size->width * 72.0 / 2540.0, loc);
-      _cupsStrFormatd(tlength, tlength + sizeof(tlength),
-		      size->length * 72.0 / 2540.0, loc);
-      strlcpy(ppdsizename, size->media, sizeof(ppdsizename));
-      if ((ippsizename = strchr(ppdsizename, ' ')) != NULL) {
-	*ippsizename = '\0';
-	ippsizename ++;
-      }
-
-      if (ippsizename)
-	human_readable = lookup_choice(ippsizename, "media",
-				       opt_strings_catalog,
-				       printer_opt_strings_catalog);
-      else
-	human_readable = NULL;
-      if (!human_readable) {
-	pwg = pwgMediaForSize(size->width, size->length);
-	if (pwg)
-	  human_readable = lookup_choice((char *)pwg->pwg, "media",
-					 opt_strings_catalog,
-					 printer_opt_strings_catalog);
-      }
+    for (i = 0, ss = size_strings; i < num_size_strings; i ++, ss ++)
       cupsFilePrintf(fp, "*PageRegion %s%s%s%s: \"<</PageSize[%s %s]>>setpagedevice\"\n",
-		     ppdsizename,
-		     (human_readable ? "/" : ""),
-		     (human_readable ? human_readable : ""),
-		     (human_readable && strstr(ppdsizename, ".Borderless") ?
+		     ss->name,
+		     (ss->human_readable ? "/" : ""),
+		     (ss->human_readable ? ss->human_readable : ""),
+		     (ss->human_readable && strstr(ss->name, ".Borderless") ?
 		      " (Borderless)" : ""),
-		     twidth, tlength);
-    }
+		     ss->width, ss->length);
     cupsFilePuts(fp, "*CloseUI: *PageRegion\n");
 
     cupsFilePrintf(fp, "*DefaultImageableArea: %s\n"
 		   "*DefaultPaperDimension: %s\n", ppdname, ppdname);
 
-    for (size = (cups_size_t *)cupsArrayFirst(sizes); size;
-	 size = (cups_size_t *)cupsArrayNext(sizes)) {
-      _cupsStrFormatd(tleft, tleft + sizeof(tleft),
-		      size->left * 72.0 / 2540.0, loc);
-      _cupsStrFormatd(tbottom, tbottom + sizeof(tbottom),
-		      size->bottom * 72.0 / 2540.0, loc);
-      _cupsStrFormatd(tright, tright + sizeof(tright),
-		      (size->width - size->right) * 72.0 / 2540.0, loc);
-      _cupsStrFormatd(ttop, ttop + sizeof(ttop),
-		      (size->length - size->top) * 72.0 / 2540.0, loc);
-      _cupsStrFormatd(twidth, twidth + sizeof(twidth),
-		      size->width * 72.0 / 2540.0, loc);
-      _cupsStrFormatd(tlength, tlength + sizeof(tlength),
-		      size->length * 72.0 / 2540.0, loc);
-      strlcpy(ppdsizename, size->media, sizeof(ppdsizename));
-      if ((ippsizename = strchr(ppdsizename, ' ')) != NULL)
-	*ippsizename = '\0';
-
-      cupsFilePrintf(fp, "*ImageableArea %s: \"%s %s %s %s\"\n", ppdsizename,
-		     tleft, tbottom, tright, ttop);
-      cupsFilePrintf(fp, "*PaperDimension %s: \"%s %s\"\n", ppdsizename,
-		     twidth, tlength);
+    for (i = 0, ss = size_strings; i < num_size_strings; i ++, ss ++) {
+      cupsFilePrintf(fp, "*ImageableArea %s: \"%s %s %s %s\"\n", ss->name,
+		     ss->left, ss->bottom, ss->right, ss->top);
+      cupsFilePrintf(fp, "*PaperDimension %s: \"%s %s\"\n", ss->name,
+		     ss->width, ss->length);
     }
 
+    free(size_strings);
     cupsArrayDelete(sizes);
 
    /*
@@ -4128,8 +4718,6 @@ ppdCreateFromIPP2(char         *buffer,          /* I - Filename buffer */
 	       "Legacy IPP printer")))));
 
   cupsFileClose(fp);
-  if (printer_opt_strings_catalog)
-    cupsArrayDelete(printer_opt_strings_catalog);
 
   return (buffer);
 
@@ -4145,8 +4733,6 @@ ppdCreateFromIPP2(char         *buffer,          /* I - Filename buffer */
   if (max_res) free(max_res);
 
   cupsFileClose(fp);
-  if (printer_opt_strings_catalog)
-    cupsArrayDelete(printer_opt_strings_catalog);
   unlink(buffer);
   *buffer = '\0';
 
@@ -69,6 +69,7 @@ char            *ppdCreateFromIPP2(char *buffer, size_t bufsize,
 				   cups_array_t* conflicts,
 				   cups_array_t *sizes,char* default_pagesize,
 				   const char *default_cluster_color);
+void            ppdgeneratorSetStringsCache(const char *filename);
 int             compare_resolutions(void *resolution_a, void *resolution_b,
 				    void *user_data);
 res_t *         ippResolutionToRes(ipp_attribute_t *attr, int index);
@@ -11,11 +11,16 @@
  *
  * Contents:
  *
- *   cupsRGBDelete() - Delete a color separation.
- *   cupsRGBDoGray() - Do a grayscale separation...
- *   cupsRGBDoRGB()  - Do a RGB separation...
- *   cupsRGBLoad()   - Load a RGB color profile from a PPD file.
- *   cupsRGBNew()    - Create a new RGB color separation.
+ *   cupsRGBDelete()           - Delete a color separation.
+ *   cupsRGBDoGray()           - Do a grayscale separation...
+ *   cupsRGBDoRGB()            - Do a RGB separation...
+ *   cupsRGBLoad()             - Load a RGB color profile from a PPD file.
+ *   cupsRGBNew()              - Create a new RGB color separation.
+ *   cupsRGBSetInterpolation() - Set the interpolation method.
+ *   rgb_tetrahedral()         - Do a RGB separation with tetrahedral
+ *                               interpolation.
+ *   rgb_trilinear()           - Do a RGB separation with the original
+ *                               trilinear interpolation.
  */
 
 /*
@@ -23,6 +28,25 @@
  */
 
 #include "driver.h"
+#include <string.h>
+
+
+/*
+ * Constants...
+ */
+
+#define RGB_CACHE	64		/* Number of colors in cache */
+#define RGB_CACHE_CHECK	256		/* Pixels before checking cache hits */
+
+
+/*
+ * Local functions...
+ */
+
+static void	rgb_tetrahedral(cups_rgb_t *rgbptr, const unsigned char *input,
+		                unsigned char *output, int num_pixels);
+static void	rgb_trilinear(cups_rgb_t *rgbptr, const unsigned char *input,
+		              unsigned char *output, int num_pixels);
 
 
 /*
@@ -39,6 +63,7 @@ cupsRGBDelete(cups_rgb_t *rgbptr)	/* I - Color separation */
   free(rgbptr->colors[0][0]);
   free(rgbptr->colors[0]);
   free(rgbptr->colors);
+  free(rgbptr->tetra_colors);
   free(rgbptr);
 }
 
@@ -64,6 +89,7 @@ cupsRGBDoGray(cups_rgb_t          *rgbptr,
   const unsigned char	*color;		/* Current color data */
   int			tempg;		/* Current separation color */
   int			rgbsize;	/* Separation data size */
+  int			round;		/* Rounding of interpolated values */
 
 
  /*
@@ -82,6 +108,7 @@ cupsRGBDoGray(cups_rgb_t          *rgbptr,
   xs       = rgbptr->cube_size * rgbptr->cube_size * rgbptr->num_channels;
   ys       = rgbptr->cube_size * rgbptr->num_channels;
   zs       = rgbptr->num_channels;
+  round    = rgbptr->interpolation == CUPS_RGB_TRILINEAR ? 0 : 128;
 
  /*
   * Loop through it all...
@@ -135,15 +162,29 @@ cupsRGBDoGray(cups_rgb_t          *rgbptr,
     * Nope, figure this one out on our own...
     */
 
-    gi  = rgbptr->cube_index[g];
-    gm0 = rgbptr->cube_mult[g];
-    gm1 = 256 - gm0;
+    if (rgbptr->interpolation == CUPS_RGB_TRILINEAR)
+    {
+      gi  = rgbptr->cube_index[g];
+      gm0 = rgbptr->cube_mult[g];
+      gm1 = 256 - gm0;
+    }
+    else
+    {
+     /*
+      * Gray is on the diagonal of the cube, between the first and the
+      * last corner of the cell...
+      */
+
+      gi  = rgbptr->tetra_index[g];
+      gm1 = rgbptr->tetra_frac[g];
+      gm0 = 256 - gm1;
+    }
 
     color = rgbptr->colors[gi][gi][gi];
 
     for (i = 0; i < rgbptr->num_channels; i ++, color ++)
     {
-      tempg = (color[0] * gm0 + color[xs + ys + zs] * gm1) / 256;
+      tempg = (color[0] * gm0 + color[xs + ys + zs] * gm1 + round) / 256;
 
       if (tempg > 255)
         *output++ = 255;
@@ -170,22 +211,6 @@ cupsRGBDoRGB(cups_rgb_t          *rgbptr,
 	     int                 num_pixels)
 					/* I - Number of pixels */
 {
-  int			i;		/* Looping var */
-  int			rgb,		/* Current RGB color */
-			lastrgb;	/* Previous RGB color */
-  int			r, ri, rm0, rm1, rs,
-					/* Current red index, multipliexs, and row offset */
-			g, gi, gm0, gm1, gs,
-					/* Current green ... */
-			b, bi, bm0, bm1, bs;
-					/* Current blue ... */
-  const unsigned char	*color;		/* Current color data */
-  int			tempr,		/* Current separation colors */
-			tempg,		/* ... */
-			tempb ;		/* ... */
-  int			rgbsize;	/* Separation data size */
-
-
  /*
   * Range check input...
   */
@@ -193,109 +218,10 @@ cupsRGBDoRGB(cups_rgb_t          *rgbptr,
   if (!rgbptr || !input || !output || num_pixels <= 0)
     return;
 
- /*
-  * Initialize variables used for the duration of the separation...
-  */
-
-  lastrgb = -1;
-  rgbsize = rgbptr->num_channels;
-  rs      = rgbptr->cube_size * rgbptr->cube_size * rgbptr->num_channels;
-  gs      = rgbptr->cube_size * rgbptr->num_channels;
-  bs      = rgbptr->num_channels;
-
- /*
-  * Loop through it all...
-  */
-
-  while (num_pixels > 0)
-  {
-   /*
-    * See if the next pixel is a cached value...
-    */
-
-    num_pixels --;
-
-    r   = cups_srgb_lut[*input++];
-    g   = cups_srgb_lut[*input++];
-    b   = cups_srgb_lut[*input++];
-    rgb = (((r << 8) | g) << 8) | b;
-
-    if (rgb == lastrgb)
-    {
-     /*
-      * Copy previous color and continue...
-      */
-
-      memcpy(output, output - rgbptr->num_channels, rgbsize);
-
-      output += rgbptr->num_channels;
-      continue;
-    }
-    else if (rgb == 0x000000 && rgbptr->cache_init)
-    {
-     /*
-      * Copy black color and continue...
-      */
-
-      memcpy(output, rgbptr->black, rgbsize);
-
-      output += rgbptr->num_channels;
-      continue;
-    }
-    else if (rgb == 0xffffff && rgbptr->cache_init)
-    {
-     /*
-      * Copy white color and continue...
-      */
-
-      memcpy(output, rgbptr->white, rgbsize);
-
-      output += rgbptr->num_channels;
-      continue;
-    }
-
-   /*
-    * Nope, figure this one out on our own...
-    */
-
-    ri  = rgbptr->cube_index[r];
-    rm0 = rgbptr->cube_mult[r];
-    rm1 = 256 - rm0;
-
-    gi  = rgbptr->cube_index[g];
-    gm0 = rgbptr->cube_mult[g];
-    gm1 = 256 - gm0;
-
-    bi  = rgbptr->cube_index[b];
-    bm0 = rgbptr->cube_mult[b];
-    bm1 = 256 - bm0;
-
-    color = rgbptr->colors[ri][gi][bi];
-
-    for (i = rgbptr->num_channels; i > 0; i --, color ++)
-    {
-      tempb = (color[0] * bm0 + color[bs] * bm1) / 256;
-      tempg = tempb  * gm0;
-      tempb = (color[gs] * gm0 + color[gs + bs] * bm1) / 256;
-      tempg = (tempg + tempb  * gm1) / 256;
-
-      tempr = tempg * rm0;
-
-      tempb = (color[rs] * bm0 + color[rs + bs] * bm1) / 256;
-      tempg = tempb  * gm0;
-      tempb = (color[rs + gs] * bm0 + color[rs + gs + bs] * bm1) / 256;
-      tempg = (tempg + tempb  * gm1) / 256;
-
-      tempr = (tempr + tempg * rm1) / 256;
-
-      if (tempr > 255)
-        *output++ = 255;
-      else if (tempr < 0)
-        *output++ = 0;
-      else
-        *output++ = tempr;
-    }
-  }
+  if (rgbptr->interpolation == CUPS_RGB_TRILINEAR)
+    rgb_trilinear(rgbptr, input, output, num_pixels);
+  else
+    rgb_tetrahedral(rgbptr, input, output, num_pixels);
 }
 
 
@@ -432,7 +358,7 @@ cupsRGBNew(int           num_samples,	/* I - Number of samples */
   unsigned char		**tempb ;	/* Pointer for Z arrays */
   unsigned char		***tempg;	/* Pointer for Y arrays */
   unsigned char		****tempr;	/* Pointer for X array */
-  unsigned char		rgb[3];		/* Temporary RGB value */
+  int			pos;		/* Position in cube */
 
 
  /*
@@ -461,8 +387,12 @@ cupsRGBNew(int           num_samples,	/* I - Number of samples */
   tempg = calloc(cube_size * cube_size, sizeof(unsigned char **));
   tempr = calloc(cube_size, sizeof(unsigned char ***));
 
-  if (tempc == NULL || tempb  == NULL || tempg == NULL || tempr == NULL)
+  rgbptr->tetra_colors = calloc(tempsize, sizeof(unsigned long long));
+
+  if (tempc == NULL || tempb  == NULL || tempg == NULL || tempr == NULL ||
+      rgbptr->tetra_colors == NULL)
   {
+    free(rgbptr->tetra_colors);
     free(rgbptr);
 
     if (tempc)
@@ -522,8 +452,73 @@ cupsRGBNew(int           num_samples,	/* I - Number of samples */
       rgbptr->cube_mult[i] = 256;
     else
       rgbptr->cube_mult[i] = 255 - ((i * (cube_size - 1)) & 255);
+
+   /*
+    * The samples are at i * (cube_size - 1) / 255 for tetrahedral
+    * interpolation, so 255 lands on the last sample...
+    */
+
+    pos = (i * (cube_size - 1) * 256 + 127) / 255;
+
+    if ((pos >> 8) < cube_size - 1)
+    {
+      rgbptr->tetra_index[i] = pos >> 8;
+      rgbptr->tetra_frac[i]  = pos & 255;
+    }
+    else
+    {
+      rgbptr->tetra_index[i] = cube_size - 2;
+      rgbptr->tetra_frac[i]  = 256;
+    }
   }
 
+ /*
+  * Spread the channels of each sample over 16-bit lanes, so that all
+  * channels are interpolated with one multiplication per corner...
+  */
+
+  for (i = 0; i < tempsize; i ++)
+    for (r = 0; r < num_channels; r ++)
+      rgbptr->tetra_colors[i] |=
+          (unsigned long long)tempc[i * num_channels + r] << (16 * r);
+
+ /*
+  * Generate the black and white cache values for the separation...
+  */
+
+  cupsRGBSetInterpolation(rgbptr, CUPS_RGB_TETRAHEDRAL);
+
+ /*
+  * Return the separation...
+  */
+
+  return (rgbptr);
+}
+
+
+
+/*
+ * 'cupsRGBSetInterpolation()' - Set the interpolation method.
+ *
+ * CUPS_RGB_TETRAHEDRAL is the default; CUPS_RGB_TRILINEAR gives the
+ * output of older versions of this library.
+ */
+
+void
+cupsRGBSetInterpolation(
+    cups_rgb_t *rgbptr,			/* I - Color separation */
+    int        interpolation)		/* I - Interpolation method */
+{
+  unsigned char	rgb[3];			/* Temporary RGB value */
+
+
+  if (!rgbptr || (interpolation != CUPS_RGB_TETRAHEDRAL &&
+                  interpolation != CUPS_RGB_TRILINEAR))
+    return;
+
+  rgbptr->interpolation = interpolation;
+  rgbptr->cache_init    = 0;
+
  /*
   * Generate the black and white cache values for the separation...
   */
@@ -541,11 +536,364 @@ cupsRGBNew(int           num_samples,	/* I - Number of samples */
   cupsRGBDoRGB(rgbptr, rgb, rgbptr->white, 1);
 
   rgbptr->cache_init = 1;
+}
+
+
+/*
+ * 'rgb_tetrahedral()' - Do a RGB separation with tetrahedral interpolation.
+ *
+ * Each cube cell is split into six tetrahedra along its gray diagonal;
+ * a color is interpolated from the four corners of its tetrahedron.  The
+ * channels of a corner are 16-bit lanes of one 64-bit value: the weights
+ * add up to 256, so the lanes cannot overflow.
+ *
+ * Recent colors are kept in a small hash table, which helps the few
+ * colors of business graphics; it is turned off for the rest of the
+ * call when it hardly ever hits, as for photos.
+ */
+
+static void
+rgb_tetrahedral(cups_rgb_t          *rgbptr,
+					/* I - Color separation */
+	        const unsigned char *input,
+					/* I - Input RGB pixels */
+	        unsigned char       *output,
+					/* O - Output Device-N pixels */
+	        int                 num_pixels)
+					/* I - Number of pixels */
+{
+  int			i;		/* Looping var */
+  int			rgb,		/* Current RGB color */
+			lastrgb,	/* Previous RGB color */
+			hash;		/* Position in cache */
+  int			r, g, b,	/* Current sRGB values */
+			fr, fg, fb,	/* Positions in cube cell */
+			f1, f2, f3;	/* Sorted positions */
+  int			rs, gs, bs;	/* Cube strides */
+  const unsigned long long *base,	/* First corner of cell */
+			*c1,		/* Second corner of tetrahedron */
+			*c2;		/* Third corner of tetrahedron */
+  unsigned long long	sum;		/* Interpolated channels */
+  unsigned		packed;		/* Output channels */
+  int			rgbsize;	/* Separation data size */
+  int			use_cache,	/* Use the cache? */
+			count,		/* Pixels since last check */
+			hits;		/* Cache hits since last check */
+  int			cache_rgb[RGB_CACHE];
+					/* Colors in cache */
+  unsigned		cache_colors[RGB_CACHE];
+					/* Separations in cache */
+
 
  /*
-  * Return the separation...
+  * Initialize variables used for the duration of the separation...
   */
 
-  return (rgbptr);
+  lastrgb   = -1;
+  rgbsize   = rgbptr->num_channels;
+  rs        = rgbptr->cube_size * rgbptr->cube_size;
+  gs        = rgbptr->cube_size;
+  bs        = 1;
+  use_cache = 1;
+  count     = 0;
+  hits      = 0;
+
+  for (i = 0; i < RGB_CACHE; i ++)
+    cache_rgb[i] = -1;
+
+ /*
+  * Loop through it all...
+  */
+
+  while (num_pixels > 0)
+  {
+   /*
+    * See if the next pixel is a cached value...
+    */
+
+    num_pixels --;
+
+    r   = cups_srgb_lut[*input++];
+    g   = cups_srgb_lut[*input++];
+    b   = cups_srgb_lut[*input++];
+    rgb = (((r << 8) | g) << 8) | b;
+
+    if (rgb == lastrgb)
+    {
+     /*
+      * Copy previous color and continue...
+      */
+
+      memcpy(output, output - rgbsize, rgbsize);
+
+      output += rgbsize;
+      continue;
+    }
+
+    lastrgb = rgb;
+
+    if (rgb == 0x000000 && rgbptr->cache_init)
+    {
+     /*
+      * Copy black color and continue...
+      */
+
+      memcpy(output, rgbptr->black, rgbsize);
+
+      output += rgbsize;
+      continue;
+    }
+    else if (rgb == 0xffffff && rgbptr->cache_init)
+    {
+     /*
+      * Copy white color and continue...
+      */
+
+      memcpy(output, rgbptr->white, rgbsize);
+
+      output += rgbsize;
+      continue;
+    }
+
+    hash = ((unsigned)rgb * 0x9e3779b1U) >> 26;
+
+    if (use_cache)
+    {
+      if (cache_rgb[hash] == rgb)
+      {
+        packed = cache_colors[hash];
+	hits ++;
+	goto copy;
+      }
+
+      if (++ count == RGB_CACHE_CHECK)
+      {
+        use_cache = hits >= RGB_CACHE_CHECK / 8;
+	count     = 0;
+	hits      = 0;
+      }
+    }
+
+   /*
+    * Find the tetrahedron from the order of the positions in the cell...
+    */
+
+    fr   = rgbptr->tetra_frac[r];
+    fg   = rgbptr->tetra_frac[g];
+    fb   = rgbptr->tetra_frac[b];
+    base = rgbptr->tetra_colors +
+           (rgbptr->tetra_index[r] * gs + rgbptr->tetra_index[g]) * gs +
+	   rgbptr->tetra_index[b];
+
+    if (fr >= fg)
+    {
+      if (fg >= fb)
+      {
+        f1 = fr;
+	f2 = fg;
+	f3 = fb;
+	c1 = base + rs;
+	c2 = base + rs + gs;
+      }
+      else if (fr >= fb)
+      {
+        f1 = fr;
+	f2 = fb;
+	f3 = fg;
+	c1 = base + rs;
+	c2 = base + rs + bs;
+      }
+      else
+      {
+        f1 = fb;
+	f2 = fr;
+	f3 = fg;
+	c1 = base + bs;
+	c2 = base + rs + bs;
+      }
+    }
+    else if (fb >= fg)
+    {
+      f1 = fb;
+      f2 = fg;
+      f3 = fr;
+      c1 = base + bs;
+      c2 = base + gs + bs;
+    }
+    else if (fb >= fr)
+    {
+      f1 = fg;
+      f2 = fb;
+      f3 = fr;
+      c1 = base + gs;
+      c2 = base + gs + bs;
+    }
+    else
+    {
+      f1 = fg;
+      f2 = fr;
+      f3 = fb;
+      c1 = base + gs;
+      c2 = base + rs + gs;
+    }
+
+    sum = base[0] * (unsigned)(256 - f1) + *c1 * (unsigned)(f1 - f2) +
+          *c2 * (unsigned)(f2 - f3) + base[rs + gs + bs] * (unsigned)f3 +
+	  0x0080008000800080ULL;
+
+   /*
+    * Take the high byte of each lane...
+    */
+
+    sum    = (sum >> 8) & 0x00ff00ff00ff00ffULL;
+    sum    = (sum | (sum >> 8)) & 0x0000ffff0000ffffULL;
+    packed = (unsigned)(sum | (sum >> 16));
+
+    cache_rgb[hash]    = rgb;
+    cache_colors[hash] = packed;
+
+    copy :
+
+    for (i = rgbsize; i > 0; i --, packed >>= 8)
+      *output++ = packed;
+  }
 }
 
+
+/*
+ * 'rgb_trilinear()' - Do a RGB separation with the original trilinear
+ *                     interpolation.
+ *
+ * This is kept unchanged for regression tests against older output.
+ */
+
+static void
+rgb_trilinear(cups_rgb_t          *rgbptr,
+					/* I - Color separation */
+	     const unsigned char *input,
+					/* I - Input RGB pixels */
+	     unsigned char       *output,
+					/* O - Output Device-N pixels */
+	     int                 num_pixels)
+					/* I - Number of pixels */
+{
+  int			i;		/* Looping var */
+  int			rgb,		/* Current RGB color */
+			lastrgb;	/* Previous RGB color */
+  int			r, ri, rm0, rm1, rs,
+					/* Current red index, multipliexs, and row offset */
+			g, gi, gm0, gm1, gs,
+					/* Current green ... */
+			b, bi, bm0, bm1, bs;
+					/* Current blue ... */
+  const unsigned char	*color;		/* Current color data */
+  int			tempr,		/* Current separation colors */
+			tempg,		/* ... */
+			tempb ;		/* ... */
+  int			rgbsize;	/* Separation data size */
+
+
+ /*
+  * Initialize variables used for the duration of the separation...
+  */
+
+  lastrgb = -1;
+  rgbsize = rgbptr->num_channels;
+  rs      = rgbptr->cube_size * rgbptr->cube_size * rgbptr->num_channels;
+  gs      = rgbptr->cube_size * rgbptr->num_channels;
+  bs      = rgbptr->num_channels;
+
+ /*
+  * Loop through it all...
+  */
+
+  while (num_pixels > 0)
+  {
+   /*
+    * See if the next pixel is a cached value...
+    */
+
+    num_pixels --;
+
+    r   = cups_srgb_lut[*input++];
+    g   = cups_srgb_lut[*input++];
+    b   = cups_srgb_lut[*input++];
+    rgb = (((r << 8) | g) << 8) | b;
+
+    if (rgb == lastrgb)
+    {
+     /*
+      * Copy previous color and continue...
+      */
+
+      memcpy(output, output - rgbptr->num_channels, rgbsize);
+
+      output += rgbptr->num_channels;
+      continue;
+    }
+    else if (rgb == 0x000000 && rgbptr->cache_init)
+    {
+     /*
+      * Copy black color and continue...
+      */
+
+      memcpy(output, rgbptr->black, rgbsize);
+
+      output += rgbptr->num_channels;
+      continue;
+    }
+    else if (rgb == 0xffffff && rgbptr->cache_init)
+    {
+     /*
+      * Copy white color and continue...
+      */
+
+      memcpy(output, rgbptr->white, rgbsize);
+
+      output += rgbptr->num_channels;
+      continue;
+    }
+
+   /*
+    * Nope, figure this one out on our own...
+    */
+
+    ri  = rgbptr->cube_index[r];
+    rm0 = rgbptr->cube_mult[r];
+    rm1 = 256 - rm0;
+
+    gi  = rgbptr->cube_index[g];
+    gm0 = rgbptr->cube_mult[g];
+    gm1 = 256 - gm0;
+
+    bi  = rgbptr->cube_index[b];
+    bm0 = rgbptr->cube_mult[b];
+    bm1 = 256 - bm0;
+
+    color = rgbptr->colors[ri][gi][bi];
+
+    for (i = rgbptr->num_channels; i > 0; i --, color ++)
+    {
+      tempb = (color[0] * bm0 + color[bs] * bm1) / 256;
+      tempg = tempb  * gm0;
+      tempb = (color[gs] * gm0 + color[gs + bs] * bm1) / 256;
+      tempg = (tempg + tempb  * gm1) / 256;
+
+      tempr = tempg * rm0;
+
+      tempb = (color[rs] * bm0 + color[rs + bs] * bm1) / 256;
+      tempg = tempb  * gm0;
+      tempb = (color[rs + gs] * bm0 + color[rs + gs + bs] * bm1) / 256;
+      tempg = (tempg + tempb  * gm1) / 256;
+
+      tempr = (tempr + tempg * rm1) / 256;
+
+      if (tempr > 255)
+        *output++ = 255;
+      else if (tempr < 0)
+        *output++ = 0;
+      else
+        *output++ = tempr;
+    }
+  }
+}
@@ -9,6 +9,14 @@
  *       testdither 0 63 127 170 198 227 255 > filename.ppm
  *       testdither 0 210 383 > filename.ppm
  *       testdither 0 82 255 > filename.ppm
+ *       testdither -m bluenoise 0 127 255 > filename.ppm
+ *
+ *   "-m" dithers with cupsDitherBand() in the given mode instead of
+ *   cupsDitherLine(), "-b" compares the speed of the modes on a band of
+ *   six channels and checks that each mode gives the same pixels with
+ *   one and with several threads:
+ *
+ *       testdither -b [-t threads] [0 127 255]
  *
  *   Copyright 2007-2011 by Apple Inc.
  *   Copyright 1993-2005 by Easy Software Products.
@@ -20,8 +28,10 @@
  *
  * Contents:
  *
- *   main()  - Test dithering and output a PPM file.
- *   usage() - Show program usage...
+ *   main()      - Test dithering and output a PPM file.
+ *   benchmark() - Time the dithering modes.
+ *   get_time()  - Get the current time in seconds.
+ *   usage()     - Show program usage...
  */
 
 /*
@@ -32,12 +42,15 @@
 #include <config.h>
 #include <string.h>
 #include <ctype.h>
+#include <sys/time.h>
 
 
 /*
  * Local functions...
  */
 
+int	benchmark(cups_lut_t *lut, int num_threads);
+double	get_time(void);
 void	usage(void);
 
 
@@ -59,38 +72,53 @@ main(int  argc,			/* I - Number of command-line arguments */
   int		nlutvals;	/* Number of lookup values */
   float		lutvals[16];	/* Lookup values */
   int		pixvals[16];	/* Pixel values */
+  int		mode = -1,	/* Band dithering mode */
+		bench = 0,	/* Run benchmark? */
+		num_threads = 0;/* Number of threads */
+  cups_dither_band_t *band = NULL;/* Band dither state */
+  unsigned char	*planes[1];	/* Band pixels */
 
 
  /*
   * See if we have lookup table values on the command-line...
   */
 
-  if (argc > 1)
-  {
-   /*
-    * Yes, collect them...
-    */
-
-    nlutvals = 0;
+  nlutvals = 0;
 
-    for (x = 1; x < argc; x ++)
-      if (isdigit(argv[x][0]) && nlutvals < 16)
-      {
-        pixvals[nlutvals] = atoi(argv[x]);
-        lutvals[nlutvals] = atof(argv[x]) / 255.0;
-	nlutvals ++;
-      }
+  for (x = 1; x < argc; x ++)
+    if (!strcmp(argv[x], "-b"))
+      bench = 1;
+    else if (!strcmp(argv[x], "-m") && x + 1 < argc)
+    {
+      x ++;
+
+      if (!strcmp(argv[x], "diffuse"))
+        mode = CUPS_DITHER_DIFFUSE;
+      else if (!strcmp(argv[x], "wavefront"))
+        mode = CUPS_DITHER_WAVEFRONT;
+      else if (!strcmp(argv[x], "bluenoise"))
+        mode = CUPS_DITHER_BLUENOISE;
       else
         usage();
+    }
+    else if (!strcmp(argv[x], "-t") && x + 1 < argc)
+      num_threads = atoi(argv[++ x]);
+    else if (isdigit(argv[x][0]) && nlutvals < 16)
+    {
+      pixvals[nlutvals] = atoi(argv[x]);
+      lutvals[nlutvals] = atof(argv[x]) / 255.0;
+      nlutvals ++;
+    }
+    else
+      usage();
 
-   /*
-    * See if we have at least 2 values...
-    */
+ /*
+  * See if we have at least 2 values...
+  */
 
-    if (nlutvals < 2)
-      usage();
-  }
-  else
+  if (nlutvals == 1)
+    usage();
+  else if (nlutvals == 0)
   {
    /*
     * Otherwise use the default 2-entry LUT with values of 0 and 255...
@@ -110,6 +138,22 @@ main(int  argc,			/* I - Number of command-line arguments */
   lut    = cupsLutNew(nlutvals, lutvals);
   dither = cupsDitherNew(512);
 
+  if (bench)
+  {
+    cupsDitherDelete(dither);
+    return (benchmark(lut, num_threads));
+  }
+
+  if (mode >= 0 &&
+      (band = cupsDitherBandNew(512, 1, (const cups_lut_t * const *)&lut,
+                                mode, num_threads)) == NULL)
+  {
+    fputs("Unable to create band dither state!\n", stderr);
+    return (1);
+  }
+
+  planes[0] = pixels;
+
  /*
   * Put out the PGM header for a raw 256x256x8-bit grayscale file...
   */
@@ -133,7 +177,10 @@ main(int  argc,			/* I - Number of command-line arguments */
     * Dither the line...
     */
 
-    cupsDitherLine(dither, lut, line, 1, pixels);
+    if (band)
+      cupsDitherBand(band, line, 1, planes);
+    else
+      cupsDitherLine(dither, lut, line, 1, pixels);
 
     if (y == 0)
     {
@@ -163,6 +210,7 @@ main(int  argc,			/* I - Number of command-line arguments */
   */
 
   cupsDitherDelete(dither);
+  cupsDitherBandDelete(band);
   cupsLutDelete(lut);
 
  /*
@@ -173,6 +221,144 @@ main(int  argc,			/* I - Number of command-line arguments */
 }
 
 
+/*
+ * 'benchmark()' - Time the dithering modes.
+ *
+ * A 5760 pixel wide page of six channels is dithered with
+ * cupsDitherLine() and with each mode of cupsDitherBand() in bands of
+ * 64 lines, on one thread and on "num_threads" threads.
+ */
+
+int					/* O - Exit status */
+benchmark(cups_lut_t *lut,		/* I - Lookup table */
+          int        num_threads)	/* I - Number of threads */
+{
+  int			x, y, c,	/* Looping vars */
+			mode,		/* Dithering mode */
+			run,		/* 0 = one thread, 1 = all threads */
+			status = 0;	/* Exit status */
+  const int		width = 5760,	/* Width of page */
+			height = 1024,	/* Height of page */
+			lines = 64,	/* Lines per band */
+			channels = 6;	/* Number of channels */
+  short			*data;		/* Separation data for page */
+  unsigned char		*pixels[2][6],	/* Pixels of each run */
+			*planes[6];	/* Pixels of current band */
+  const cups_lut_t	*luts[6];	/* Lookup tables */
+  cups_dither_t		*dithers[6];	/* Line dither states */
+  cups_dither_band_t	*band;		/* Band dither state */
+  double		start,		/* Start time */
+			secs;		/* Time for page */
+  static const char * const modes[] =	/* Mode names */
+  {
+    "diffuse",
+    "wavefront",
+    "bluenoise"
+  };
+
+
+  if (num_threads <= 0)
+    num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+  data = malloc((size_t)width * height * channels * sizeof(short));
+
+  for (c = 0; c < channels; c ++)
+  {
+    luts[c]      = lut;
+    dithers[c]   = cupsDitherNew(width);
+    pixels[0][c] = malloc((size_t)width * height);
+    pixels[1][c] = malloc((size_t)width * height);
+  }
+
+ /*
+  * Ramps in different directions for each channel...
+  */
+
+  for (y = 0; y < height; y ++)
+    for (x = 0; x < width; x ++)
+      for (c = 0; c < channels; c ++)
+        data[(y * width + x) * channels + c] =
+	    (c & 1 ? x * 4095 / width : y * 4095 / height) * (c + 2) /
+	    (channels + 1);
+
+  start = get_time();
+
+  for (y = 0; y < height; y ++)
+    for (c = 0; c < channels; c ++)
+      cupsDitherLine(dithers[c], lut, data + y * width * channels + c,
+                     channels, pixels[0][c] + y * width);
+
+  secs = get_time() - start;
+
+  printf("cupsDitherLine: %.3f seconds, %.1f Mpixels/second\n", secs,
+         1e-6 * width * height * channels / secs);
+
+  for (mode = CUPS_DITHER_DIFFUSE; mode <= CUPS_DITHER_BLUENOISE; mode ++)
+  {
+    for (run = 0; run < 2; run ++)
+    {
+      band = cupsDitherBandNew(width, channels, luts, mode,
+                               run ? num_threads : 1);
+      start = get_time();
+
+      for (y = 0; y < height; y += lines)
+      {
+        for (c = 0; c < channels; c ++)
+	  planes[c] = pixels[run][c] + y * width;
+
+        cupsDitherBand(band, data + y * width * channels, lines, planes);
+      }
+
+      secs = get_time() - start;
+      cupsDitherBandDelete(band);
+
+      printf("%s, %d thread(s): %.3f seconds, %.1f Mpixels/second\n",
+             modes[mode], run ? num_threads : 1, secs,
+	     1e-6 * width * height * channels / secs);
+    }
+
+    for (c = 0; c < channels; c ++)
+      if (memcmp(pixels[0][c], pixels[1][c], (size_t)width * height))
+      {
+        printf("FAIL: %s channel %d differs with %d threads!\n", modes[mode],
+	       c, num_threads);
+	status = 1;
+      }
+  }
+
+  for (c = 0; c < channels; c ++)
+  {
+    cupsDitherDelete(dithers[c]);
+    free(pixels[0][c]);
+    free(pixels[1][c]);
+  }
+
+  free(data);
+  cupsLutDelete(lut);
+
+  if (!status)
+    puts("PASS: Band dithering does not depend on the number of threads.");
+
+  return (status);
+}
+
+
+/*
+ * 'get_time()' - Get the current time in seconds.
+ */
+
+double					/* O - Time in seconds */
+get_time(void)
+{
+  struct timeval	curtime;	/* Current time */
+
+
+  gettimeofday(&curtime, NULL);
+
+  return (curtime.tv_sec + 0.000001 * curtime.tv_usec);
+}
+
+
 /*
  * 'usage()' - Show program usage...
  */
@@ -180,7 +366,9 @@ main(int  argc,			/* I - Number of command-line arguments */
 void
 usage(void)
 {
-  puts("Usage: testdither [val1 val2 [... val16]] >filename.ppm");
+  puts("Usage: testdither [-m diffuse|wavefront|bluenoise] [-t threads] "
+       "[val1 val2 [... val16]] >filename.ppm");
+  puts("       testdither -b [-t threads] [val1 val2 [... val16]]");
   exit(1);
 }
 
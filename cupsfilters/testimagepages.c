@@ -0,0 +1,469 @@
+/*
+ *   Multi-page image test program for CUPS.
+ *
+ *   Writes a multi-frame GIF file and, with libtiff, a multi-page TIFF
+ *   file with strips and tiles, then checks that cupsImagePagesOpen()
+ *   selects the pages of "page-ranges" and that cupsImagePagesNext()
+ *   returns them in order with the right pixels, with and without
+ *   decoding threads, and that no file descriptors are left open.
+ *
+ *   Copyright 2020 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   main()       - Run the multi-page image tests.
+ *   count_fds()  - Count the open file descriptors.
+ *   gif_code()   - Add a LZW code to the GIF data.
+ *   pixel()      - Get the value of a pixel of a page.
+ *   test_pages() - Test the selected pages of an image file.
+ *   write_gif()  - Write a multi-frame GIF file.
+ *   write_tiff() - Write a multi-page TIFF file.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "image-private.h"
+#include <fcntl.h>
+#ifdef HAVE_LIBTIFF
+#  include <tiffio.h>
+#endif /* HAVE_LIBTIFF */
+
+
+/*
+ * Constants...
+ */
+
+#define NUM_PAGES	5		/* Number of pages */
+#define WIDTH		40		/* Width of pages */
+#define HEIGHT		30		/* Height of pages */
+
+
+/*
+ * Local globals...
+ */
+
+static const struct
+{
+  const char	*ranges;		/* Value of "page-ranges" */
+  int		count,			/* Number of selected pages */
+		pages[NUM_PAGES];	/* Selected pages */
+}		tests[] =
+{
+  { NULL,		5,	{ 1, 2, 3, 4, 5 } },
+  { "",			5,	{ 1, 2, 3, 4, 5 } },
+  { "2",		1,	{ 2 } },
+  { "2,4-",		3,	{ 2, 4, 5 } },
+  { "-2,5",		3,	{ 1, 2, 5 } },
+  { "3-4",		2,	{ 3, 4 } },
+  { "9-",		0,	{ 0 } }
+};
+
+
+/*
+ * Local functions...
+ */
+
+static int	count_fds(void);
+static void	gif_code(unsigned char *data, int *bit, int code);
+static int	pixel(int page, int x, int y);
+static int	test_pages(const char *filename, int num_threads);
+static int	write_gif(const char *filename);
+#ifdef HAVE_LIBTIFF
+static int	write_tiff(const char *filename);
+#endif /* HAVE_LIBTIFF */
+
+
+/*
+ * 'main()' - Run the multi-page image tests.
+ */
+
+int					/* O - Exit status */
+main(void)
+{
+  int	fd,				/* Temporary file */
+	errors = 0;			/* Number of errors */
+  char	filename[1024];			/* Name of temporary file */
+
+
+  if ((fd = cupsTempFd(filename, sizeof(filename))) < 0)
+  {
+    perror("Unable to create temporary file");
+    return (1);
+  }
+
+  close(fd);
+
+  if (write_gif(filename))
+  {
+    printf("Unable to write GIF file \"%s\"!\n", filename);
+    errors ++;
+  }
+  else
+  {
+    puts("GIF:");
+    errors += test_pages(filename, 1);
+    errors += test_pages(filename, 3);
+  }
+
+#ifdef HAVE_LIBTIFF
+  if (write_tiff(filename))
+  {
+    printf("Unable to write TIFF file \"%s\"!\n", filename);
+    errors ++;
+  }
+  else
+  {
+    puts("TIFF:");
+    errors += test_pages(filename, 1);
+    errors += test_pages(filename, 3);
+  }
+#endif /* HAVE_LIBTIFF */
+
+  unlink(filename);
+
+  if (errors)
+  {
+    printf("%d errors!\n", errors);
+    return (1);
+  }
+
+  puts("PASS: All pages selected and decoded correctly.");
+  return (0);
+}
+
+
+/*
+ * 'count_fds()' - Count the open file descriptors.
+ */
+
+static int				/* O - Number of open descriptors */
+count_fds(void)
+{
+  int	fd,				/* Current descriptor */
+	count = 0;			/* Number of open descriptors */
+
+
+  for (fd = 0; fd < 1024; fd ++)
+    if (fcntl(fd, F_GETFD) != -1)
+      count ++;
+
+  return (count);
+}
+
+
+/*
+ * 'gif_code()' - Add a LZW code to the GIF data.
+ *
+ * All codes are 9 bits long, the data has a clear code often enough for
+ * the code size to never grow.
+ */
+
+static void
+gif_code(unsigned char *data,		/* I - GIF data */
+         int           *bit,		/* IO - Next bit in data */
+	 int           code)		/* I - Code to add */
+{
+  int	i;				/* Looping var */
+
+
+  for (i = 0; i < 9; i ++, (*bit) ++)
+    if (code & (1 << i))
+      data[*bit / 8] |= 1 << (*bit & 7);
+}
+
+
+/*
+ * 'pixel()' - Get the value of a pixel of a page.
+ */
+
+static int				/* O - Pixel value */
+pixel(int page,				/* I - Page, starting at 1 */
+      int x,				/* I - X coordinate */
+      int y)				/* I - Y coordinate */
+{
+  return ((page - 1) * 40 + ((x + y) & 15));
+}
+
+
+/*
+ * 'test_pages()' - Test the selected pages of an image file.
+ */
+
+static int				/* O - Number of errors */
+test_pages(const char *filename,	/* I - Image file */
+           int        num_threads)	/* I - Number of decoding threads */
+{
+  int		i, j,			/* Looping vars */
+		x, y,			/* Coordinates in page */
+		page,			/* Page number */
+		count,			/* Number of selected pages */
+		pass,			/* Pass, second one after rewinding */
+		fds,			/* Open descriptors before the test */
+		errors = 0;		/* Number of errors */
+  cups_ipages_t	*pages;			/* Pages of image file */
+  cups_image_t	*img;			/* Page image */
+  cups_ib_t	row[WIDTH];		/* Row of page */
+
+
+  for (i = 0; i < (int)(sizeof(tests) / sizeof(tests[0])); i ++)
+  {
+    printf("    page-ranges=\"%s\", %d thread(s): ",
+           tests[i].ranges ? tests[i].ranges : "(null)", num_threads);
+
+    fds = count_fds();
+
+    if ((pages = cupsImagePagesOpen(filename, CUPS_IMAGE_WHITE,
+                                    CUPS_IMAGE_WHITE, 100, 0, NULL, 0, 0,
+				    tests[i].ranges, num_threads)) == NULL)
+    {
+      puts("FAIL (unable to open)");
+      errors ++;
+      continue;
+    }
+
+    if ((count = cupsImagePagesCount(pages)) != tests[i].count)
+    {
+      printf("FAIL (%d pages selected, expected %d)\n", count,
+             tests[i].count);
+      errors ++;
+      cupsImagePagesClose(pages);
+      continue;
+    }
+
+    for (pass = 0, j = 0; pass < 2; pass ++, cupsImagePagesRewind(pages))
+    {
+      for (j = 0; (img = cupsImagePagesNext(pages, &page)) != NULL; j ++)
+      {
+        if (j >= count || page != tests[i].pages[j])
+	{
+	  printf("FAIL (got page %d, expected %d)\n", page,
+	         j < count ? tests[i].pages[j] : 0);
+	  cupsImageClose(img);
+	  break;
+	}
+
+        if (cupsImageGetWidth(img) != WIDTH ||
+	    cupsImageGetHeight(img) != HEIGHT)
+	{
+	  printf("FAIL (page %d is %dx%d, expected %dx%d)\n", page,
+	         cupsImageGetWidth(img), cupsImageGetHeight(img), WIDTH,
+		 HEIGHT);
+	  cupsImageClose(img);
+	  break;
+	}
+
+        for (y = 0; y < HEIGHT; y ++)
+	{
+	  cupsImageGetRow(img, 0, y, WIDTH, row);
+
+	  for (x = 0; x < WIDTH; x ++)
+	    if (row[x] != pixel(page, x, y))
+	      break;
+
+          if (x < WIDTH)
+	    break;
+	}
+
+        cupsImageClose(img);
+
+        if (y < HEIGHT)
+	{
+	  printf("FAIL (page %d pixel %d,%d is %d, expected %d)\n", page, x,
+	         y, row[x], pixel(page, x, y));
+	  break;
+	}
+      }
+
+      if (img || page || j != count)
+        break;
+    }
+
+    if (pass < 2)
+    {
+      if (!img && page)
+        printf("FAIL (unable to read page %d)\n", page);
+      else if (!img && j != count)
+        printf("FAIL (%d pages returned, expected %d)\n", j, count);
+
+      errors ++;
+      cupsImagePagesClose(pages);
+      continue;
+    }
+
+    cupsImagePagesClose(pages);
+
+    if (count_fds() != fds)
+    {
+      printf("FAIL (%d file descriptors left open)\n", count_fds() - fds);
+      errors ++;
+    }
+    else
+      puts("PASS");
+  }
+
+  return (errors);
+}
+
+
+/*
+ * 'write_gif()' - Write a multi-frame GIF file.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+write_gif(const char *filename)		/* I - File to write */
+{
+  FILE		*fp;			/* GIF file */
+  int		i,			/* Looping var */
+		page,			/* Current page */
+		x, y,			/* Current pixel */
+		bit,			/* Next bit in data */
+		bytes;			/* Bytes of data */
+  unsigned char	*data;			/* LZW data */
+  static const unsigned char header[] =	/* Header with 256 color map */
+  {
+    'G', 'I', 'F', '8', '9', 'a',
+    WIDTH, 0, HEIGHT, 0,
+    0xf7, 0, 0
+  };
+  static const unsigned char descriptor[] =
+  {					/* Image descriptor */
+    ',', 0, 0, 0, 0, WIDTH, 0, HEIGHT, 0, 0
+  };
+
+
+  if ((fp = fopen(filename, "wb")) == NULL)
+    return (-1);
+
+  if ((data = calloc(1, WIDTH * HEIGHT * 2 + 256)) == NULL)
+  {
+    fclose(fp);
+    return (-1);
+  }
+
+ /*
+  * Gray color map...
+  */
+
+  fwrite(header, 1, sizeof(header), fp);
+
+  for (i = 0; i < 256; i ++)
+  {
+    putc(i, fp);
+    putc(i, fp);
+    putc(i, fp);
+  }
+
+ /*
+  * Frames...
+  */
+
+  for (page = 1; page <= NUM_PAGES; page ++)
+  {
+    fwrite(descriptor, 1, sizeof(descriptor), fp);
+    putc(8, fp);
+
+    memset(data, 0, WIDTH * HEIGHT * 2 + 256);
+
+    for (y = 0, i = 0, bit = 0; y < HEIGHT; y ++)
+      for (x = 0; x < WIDTH; x ++, i ++)
+      {
+        if (i % 200 == 0)
+	  gif_code(data, &bit, 256);
+
+        gif_code(data, &bit, pixel(page, x, y));
+      }
+
+    gif_code(data, &bit, 257);
+
+    for (i = 0, bytes = (bit + 7) / 8; i < bytes; i += 255)
+    {
+      putc(bytes - i > 255 ? 255 : bytes - i, fp);
+      fwrite(data + i, 1, bytes - i > 255 ? 255 : bytes - i, fp);
+    }
+
+    putc(0, fp);
+  }
+
+  putc(';', fp);
+
+  free(data);
+
+  return (fclose(fp) ? -1 : 0);
+}
+
+
+#ifdef HAVE_LIBTIFF
+/*
+ * 'write_tiff()' - Write a multi-page TIFF file.
+ *
+ * The third page is written in tiles, the others in strips of 7 rows.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+write_tiff(const char *filename)	/* I - File to write */
+{
+  TIFF		*tif;			/* TIFF file */
+  int		page,			/* Current page */
+		x, y,			/* Current pixel */
+		tx, ty;			/* Current tile */
+  unsigned char	row[WIDTH],		/* Row of strip */
+		tile[16 * 16];		/* Tile */
+
+
+  if ((tif = TIFFOpen(filename, "w")) == NULL)
+    return (-1);
+
+  for (page = 1; page <= NUM_PAGES; page ++)
+  {
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+    TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+
+    if (page == 3)
+    {
+      TIFFSetField(tif, TIFFTAG_TILEWIDTH, 16);
+      TIFFSetField(tif, TIFFTAG_TILELENGTH, 16);
+
+      for (ty = 0; ty < HEIGHT; ty += 16)
+	for (tx = 0; tx < WIDTH; tx += 16)
+	{
+	  for (y = 0; y < 16; y ++)
+	    for (x = 0; x < 16; x ++)
+	      tile[y * 16 + x] = pixel(page, tx + x, ty + y);
+
+	  if (TIFFWriteTile(tif, tile, tx, ty, 0, 0) < 0)
+	    break;
+	}
+    }
+    else
+    {
+      TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 7);
+
+      for (y = 0; y < HEIGHT; y ++)
+      {
+	for (x = 0; x < WIDTH; x ++)
+	  row[x] = pixel(page, x, y);
+
+	if (TIFFWriteScanline(tif, row, y, 0) < 0)
+	  break;
+      }
+    }
+
+    TIFFWriteDirectory(tif);
+  }
+
+  TIFFClose(tif);
+
+  return (0);
+}
+#endif /* HAVE_LIBTIFF */
@@ -0,0 +1,407 @@
+/*
+ *   Reduced image test program for CUPS.
+ *
+ *   Writes a PNG file and, with libtiff, a TIFF file which is read in
+ *   columns, then checks that the images cupsImageOpenFit() and
+ *   cupsImageOpenStream() reduce while decoding have the same pixels as
+ *   the full-size image of cupsImageOpen() averaged in boxes of the
+ *   reduction factor, for 1, 3, and 4 bytes per pixel.
+ *
+ *   Copyright 2020 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   main()        - Run the reduced image tests.
+ *   pixel()       - Get the value of a pixel of the test image.
+ *   test_reduce() - Compare the reduced images of a file with the full
+ *                   size image.
+ *   write_png()   - Write a RGB PNG file.
+ *   write_tiff()  - Write a grayscale TIFF file with left-top orientation.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "image-private.h"
+#ifdef HAVE_LIBPNG
+#  include <png.h>
+#endif /* HAVE_LIBPNG */
+#ifdef HAVE_LIBTIFF
+#  include <tiffio.h>
+#endif /* HAVE_LIBTIFF */
+
+
+/*
+ * Constants...
+ */
+
+#define WIDTH		203		/* Width of image */
+#define HEIGHT		151		/* Height of image */
+
+
+/*
+ * Local functions...
+ */
+
+#if defined(HAVE_LIBPNG) || defined(HAVE_LIBTIFF)
+static int	pixel(int x, int y, int c);
+static int	test_reduce(const char *filename);
+#endif /* HAVE_LIBPNG || HAVE_LIBTIFF */
+#ifdef HAVE_LIBPNG
+static int	write_png(const char *filename);
+#endif /* HAVE_LIBPNG */
+#ifdef HAVE_LIBTIFF
+static int	write_tiff(const char *filename);
+#endif /* HAVE_LIBTIFF */
+
+
+/*
+ * 'main()' - Run the reduced image tests.
+ */
+
+int					/* O - Exit status */
+main(void)
+{
+#if defined(HAVE_LIBPNG) || defined(HAVE_LIBTIFF)
+  int	fd,				/* Temporary file */
+	errors = 0;			/* Number of errors */
+  char	filename[1024];			/* Name of temporary file */
+
+
+  if ((fd = cupsTempFd(filename, sizeof(filename))) < 0)
+  {
+    perror("Unable to create temporary file");
+    return (1);
+  }
+
+  close(fd);
+
+#  ifdef HAVE_LIBPNG
+  if (write_png(filename))
+  {
+    printf("Unable to write PNG file \"%s\"!\n", filename);
+    errors ++;
+  }
+  else
+  {
+    puts("PNG:");
+    errors += test_reduce(filename);
+  }
+#  endif /* HAVE_LIBPNG */
+
+#  ifdef HAVE_LIBTIFF
+  if (write_tiff(filename))
+  {
+    printf("Unable to write TIFF file \"%s\"!\n", filename);
+    errors ++;
+  }
+  else
+  {
+    puts("TIFF:");
+    errors += test_reduce(filename);
+  }
+#  endif /* HAVE_LIBTIFF */
+
+  unlink(filename);
+
+  if (errors)
+  {
+    printf("%d errors!\n", errors);
+    return (1);
+  }
+
+  puts("PASS: All reduced images match the averaged full-size images.");
+  return (0);
+
+#else
+  puts("No PNG or TIFF support, skipping test.");
+  return (77);
+#endif /* HAVE_LIBPNG || HAVE_LIBTIFF */
+}
+
+
+#if defined(HAVE_LIBPNG) || defined(HAVE_LIBTIFF)
+/*
+ * 'pixel()' - Get the value of a pixel of the test image.
+ *
+ * The image has gradients, fine patterns, and black and white areas.
+ */
+
+static int				/* O - Pixel value */
+pixel(int x,				/* I - X coordinate */
+      int y,				/* I - Y coordinate */
+      int c)				/* I - Color, 0 to 2 */
+{
+  if (x < 20 && y < 20)
+    return (x < 10 ? 0 : 255);
+
+  switch (c)
+  {
+    case 0 :
+        return (x * 255 / (WIDTH - 1));
+    case 1 :
+        return ((x * y) & 255);
+    default :
+        return (((x / 3) ^ (y / 5)) & 1 ? 255 - y : (x * 7 + y) & 255);
+  }
+}
+
+
+/*
+ * 'test_reduce()' - Compare the reduced images of a file with the full
+ *                   size image.
+ */
+
+static int				/* O - Number of errors */
+test_reduce(const char *filename)	/* I - Image file */
+{
+  int		i, j,			/* Looping vars */
+		stream,			/* Streamed image? */
+		x, y,			/* Coordinates in full-size image */
+		ox, oy,			/* Coordinates in reduced image */
+		c,			/* Current color */
+		bpp,			/* Bytes per pixel */
+		factor,			/* Reduction factor */
+		xsize, ysize,		/* Size of reduced image */
+		count,			/* Pixels in box */
+		sum,			/* Sum of box */
+		expect,			/* Expected pixel value */
+		errors = 0;		/* Number of errors */
+  cups_image_t	*full,			/* Full-size image */
+		*img;			/* Reduced image */
+  cups_ib_t	*pixels,		/* Pixels of full-size image */
+		row[WIDTH * 4];		/* Row of reduced image */
+  static const struct
+  {
+    cups_icspace_t	cspace;		/* Colorspace to read */
+    const char		*name;		/* Name of colorspace */
+  }		cspaces[] =
+  {
+    { CUPS_IMAGE_WHITE,	"white" },
+    { CUPS_IMAGE_RGB,	"RGB" },
+    { CUPS_IMAGE_CMYK,	"CMYK" }
+  };
+  static const unsigned	fits[] =	/* Sizes of fit boxes */
+  {
+    101,				/* Factor 2 */
+    64,					/* Factor 3 */
+    29					/* Factor 7 */
+  };
+
+
+  for (i = 0; i < (int)(sizeof(cspaces) / sizeof(cspaces[0])); i ++)
+  {
+    if ((full = cupsImageOpen(filename, cspaces[i].cspace, cspaces[i].cspace,
+                              100, 0, NULL)) == NULL)
+    {
+      printf("    %s: FAIL (unable to open)\n", cspaces[i].name);
+      errors ++;
+      continue;
+    }
+
+    bpp = cupsImageGetDepth(full);
+
+    if (cupsImageGetWidth(full) != WIDTH ||
+        cupsImageGetHeight(full) != HEIGHT ||
+        (pixels = malloc(WIDTH * HEIGHT * bpp)) == NULL)
+    {
+      printf("    %s: FAIL (full-size image is %dx%d)\n", cspaces[i].name,
+             cupsImageGetWidth(full), cupsImageGetHeight(full));
+      cupsImageClose(full);
+      errors ++;
+      continue;
+    }
+
+    for (y = 0; y < HEIGHT; y ++)
+      cupsImageGetRow(full, 0, y, WIDTH, pixels + y * WIDTH * bpp);
+
+    cupsImageClose(full);
+
+    for (j = 0; j < (int)(sizeof(fits) / sizeof(fits[0])); j ++)
+      for (stream = 0; stream < 2; stream ++)
+      {
+	printf("    %s, %u pixel box, %s: ", cspaces[i].name, fits[j],
+	       stream ? "streamed" : "cached");
+
+        if (stream)
+	  img = cupsImageOpenStream(filename, cspaces[i].cspace,
+	                            cspaces[i].cspace, 100, 0, NULL, fits[j],
+				    fits[j]);
+	else
+	  img = cupsImageOpenFit(filename, cspaces[i].cspace, cspaces[i].cspace,
+	                         100, 0, NULL, fits[j], fits[j]);
+
+	if (!img)
+	{
+	  puts("FAIL (unable to open)");
+	  errors ++;
+	  continue;
+	}
+
+       /*
+	* The larger factor of both directions is used, so the image still
+	* fills the box...
+	*/
+
+	factor = WIDTH / (int)fits[j];
+	if (factor < HEIGHT / (int)fits[j])
+	  factor = HEIGHT / (int)fits[j];
+
+	xsize = (WIDTH + factor - 1) / factor;
+	ysize = (HEIGHT + factor - 1) / factor;
+
+	if ((int)cupsImageGetWidth(img) != xsize ||
+	    (int)cupsImageGetHeight(img) != ysize)
+	{
+	  printf("FAIL (image is %dx%d, expected %dx%d)\n",
+		 cupsImageGetWidth(img), cupsImageGetHeight(img), xsize,
+		 ysize);
+	  cupsImageClose(img);
+	  errors ++;
+	  continue;
+	}
+
+	for (oy = 0, expect = -1; oy < ysize && expect < 0; oy ++)
+	{
+	  cupsImageGetRow(img, 0, oy, xsize, row);
+
+	  for (ox = 0; ox < xsize && expect < 0; ox ++)
+	    for (c = 0; c < bpp; c ++)
+	    {
+	      for (y = oy * factor, sum = 0, count = 0;
+		   y < (oy + 1) * factor && y < HEIGHT;
+		   y ++)
+		for (x = ox * factor; x < (ox + 1) * factor && x < WIDTH;
+		     x ++, count ++)
+		  sum += pixels[(y * WIDTH + x) * bpp + c];
+
+	      if (row[ox * bpp + c] != (sum + count / 2) / count)
+	      {
+		expect = (sum + count / 2) / count;
+		printf("FAIL (pixel %d,%d color %d is %d, expected %d)\n", ox,
+		       oy, c, row[ox * bpp + c], expect);
+		errors ++;
+		break;
+	      }
+	    }
+	}
+
+	cupsImageClose(img);
+
+	if (expect < 0)
+	  puts("PASS");
+      }
+
+    free(pixels);
+  }
+
+  return (errors);
+}
+#endif /* HAVE_LIBPNG || HAVE_LIBTIFF */
+
+
+#ifdef HAVE_LIBPNG
+/*
+ * 'write_png()' - Write a RGB PNG file.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+write_png(const char *filename)		/* I - File to write */
+{
+  FILE		*fp;			/* PNG file */
+  png_structp	pp;			/* PNG write pointer */
+  png_infop	info;			/* PNG info pointer */
+  int		x, y;			/* Current pixel */
+  png_byte	row[WIDTH * 3];		/* Row of image */
+
+
+  if ((fp = fopen(filename, "wb")) == NULL)
+    return (-1);
+
+  if ((pp = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL,
+                                    NULL)) == NULL)
+  {
+    fclose(fp);
+    return (-1);
+  }
+
+  if ((info = png_create_info_struct(pp)) == NULL || setjmp(png_jmpbuf(pp)))
+  {
+    png_destroy_write_struct(&pp, &info);
+    fclose(fp);
+    return (-1);
+  }
+
+  png_init_io(pp, fp);
+  png_set_IHDR(pp, info, WIDTH, HEIGHT, 8, PNG_COLOR_TYPE_RGB,
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+	       PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(pp, info);
+
+  for (y = 0; y < HEIGHT; y ++)
+  {
+    for (x = 0; x < WIDTH; x ++)
+    {
+      row[x * 3]     = pixel(x, y, 0);
+      row[x * 3 + 1] = pixel(x, y, 1);
+      row[x * 3 + 2] = pixel(x, y, 2);
+    }
+
+    png_write_row(pp, row);
+  }
+
+  png_write_end(pp, info);
+  png_destroy_write_struct(&pp, &info);
+
+  return (fclose(fp) ? -1 : 0);
+}
+#endif /* HAVE_LIBPNG */
+
+
+#ifdef HAVE_LIBTIFF
+/*
+ * 'write_tiff()' - Write a grayscale TIFF file with left-top orientation.
+ *
+ * The rows of the file are the columns of the image, so the reader puts
+ * columns.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+write_tiff(const char *filename)	/* I - File to write */
+{
+  TIFF		*tif;			/* TIFF file */
+  int		x, y;			/* Current pixel */
+  unsigned char	row[HEIGHT];		/* Row of file, column of image */
+
+
+  if ((tif = TIFFOpen(filename, "w")) == NULL)
+    return (-1);
+
+  TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, HEIGHT);
+  TIFFSetField(tif, TIFFTAG_IMAGELENGTH, WIDTH);
+  TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+  TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+  TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+  TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+  TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+  TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_LEFTTOP);
+  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 16);
+
+  for (x = 0; x < WIDTH; x ++)
+  {
+    for (y = 0; y < HEIGHT; y ++)
+      row[y] = pixel(x, y, 2);
+
+    if (TIFFWriteScanline(tif, row, x, 0) < 0)
+      break;
+  }
+
+  TIFFClose(tif);
+
+  return (x < WIDTH ? -1 : 0);
+}
+#endif /* HAVE_LIBTIFF */
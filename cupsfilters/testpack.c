@@ -0,0 +1,505 @@
+/*
+ *   Bit packing test program for CUPS.
+ *
+ *   Compares cupsPackHorizontal(), cupsPackHorizontal2(),
+ *   cupsPackHorizontalBit(), and cupsPackVertical() with the original
+ *   one pixel at a time code, byte for byte, for all widths up to 300
+ *   pixels, unaligned buffers, every pixel value in every position of an
+ *   output byte, and random data.  The time per 1200 DPI line is shown as
+ *   well.
+ *
+ *   Copyright 2007-2011 by Apple Inc.
+ *   Copyright 1993-2005 by Easy Software Products.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   main()               - Run the packing tests.
+ *   compare()            - Compare the output of both packers.
+ *   fill_pixels()        - Fill the input pixels with random data.
+ *   get_time()           - Get the current time in seconds.
+ *   ref_horizontal()     - Original cupsPackHorizontal().
+ *   ref_horizontal2()    - Original cupsPackHorizontal2().
+ *   ref_horizontal_bit() - Original cupsPackHorizontalBit().
+ *   ref_vertical()       - Original cupsPackVertical().
+ *   test_pack()          - Test all packers for one line.
+ *   time_pack()          - Show the time per line of each packer.
+ */
+
+/*
+ * Include necessary headers.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "driver.h"
+
+
+/*
+ * Constants...
+ */
+
+#define MAX_WIDTH	300		/* Widest line tested */
+#define MAX_STEP	4		/* Largest pixel step tested */
+#define SIZE		(MAX_WIDTH * MAX_STEP + 64)
+					/* Size of buffers */
+#define LINE_WIDTH	10200		/* 8.5 inches at 1200 DPI */
+
+
+/*
+ * Local functions...
+ */
+
+static int	compare(const char *name, const unsigned char *obytes,
+		        const unsigned char *ref, int width, int step, int arg);
+static void	fill_pixels(unsigned char *ipixels, int count, int kind);
+static double	get_time(void);
+static void	ref_horizontal(const unsigned char *ipixels,
+		               unsigned char *obytes, int width,
+			       unsigned char clearto, int step);
+static void	ref_horizontal2(const unsigned char *ipixels,
+		                unsigned char *obytes, int width, int step);
+static void	ref_horizontal_bit(const unsigned char *ipixels,
+		                   unsigned char *obytes, int width,
+				   unsigned char clearto, unsigned char bit);
+static void	ref_vertical(const unsigned char *ipixels,
+		             unsigned char *obytes, int width,
+			     unsigned char bit, int step);
+static int	test_pack(const unsigned char *ipixels, int width);
+static void	time_pack(void);
+
+
+/*
+ * 'main()' - Run the packing tests.
+ */
+
+int					/* O - Exit status */
+main(void)
+{
+  int		width,			/* Width of line */
+		offset,			/* Alignment of line */
+		kind,			/* Kind of pixel data */
+		pos,			/* Position of pixel */
+		value,			/* Pixel value */
+		tests = 0,		/* Number of lines tested */
+		errors = 0;		/* Number of errors */
+  unsigned char	*buffer;		/* Input pixels */
+
+
+  srand(1);
+
+  if ((buffer = malloc(SIZE + 32)) == NULL)
+  {
+    puts("Unable to allocate memory!");
+    return (1);
+  }
+
+ /*
+  * Random lines of all widths and alignments...
+  */
+
+  for (width = 0; width <= MAX_WIDTH; width ++)
+    for (offset = 0; offset < 32; offset += (width < 80 ? 1 : 7))
+      for (kind = 0; kind < 4; kind ++)
+      {
+	fill_pixels(buffer + offset, SIZE, kind);
+
+	errors += test_pack(buffer + offset, width);
+	tests ++;
+      }
+
+ /*
+  * Every pixel value in every position of 64 pixels (more than one
+  * 32-pixel block of the widest SIMD code), on a blank and on a random
+  * line...
+  */
+
+  for (kind = 0; kind < 2; kind ++)
+    for (pos = 0; pos < 64; pos ++)
+      for (value = 0; value < 256; value ++)
+      {
+	if (kind)
+	  fill_pixels(buffer, SIZE, 0);
+	else
+	  memset(buffer, 0, SIZE);
+
+	buffer[pos] = value;
+
+	errors += test_pack(buffer, 64 + 7);
+	tests ++;
+      }
+
+  free(buffer);
+
+  time_pack();
+
+  if (errors)
+  {
+    printf("FAIL: %d packing errors in %d lines!\n", errors, tests);
+    return (1);
+  }
+
+  printf("PASS: %d lines packed identically.\n", tests);
+  return (0);
+}
+
+
+/*
+ * 'compare()' - Compare the output of both packers.
+ */
+
+static int				/* O - 1 on error, 0 on success */
+compare(const char          *name,	/* I - Name of packer */
+        const unsigned char *obytes,	/* I - Output bytes */
+        const unsigned char *ref,	/* I - Reference output bytes */
+	int                 width,	/* I - Number of pixels */
+	int                 step,	/* I - Step value */
+	int                 arg)	/* I - clearto or bit value */
+{
+  int	i;				/* Looping var */
+
+
+  if (!memcmp(obytes, ref, SIZE))
+    return (0);
+
+  for (i = 0; i < SIZE; i ++)
+    if (obytes[i] != ref[i])
+      break;
+
+  printf("FAIL: %s, width %d, step %d, arg 0x%02x: byte %d is 0x%02x, "
+         "expected 0x%02x\n", name, width, step, arg, i, obytes[i], ref[i]);
+
+  return (1);
+}
+
+
+/*
+ * 'fill_pixels()' - Fill the input pixels with random data.
+ *
+ * Kind 0 is random bytes, 1 is dithered 0/1 pixels, 2 is mostly blank
+ * 0/255 pixels, and 3 is 2-bit pixels.
+ */
+
+static void
+fill_pixels(unsigned char *ipixels,	/* O - Input pixels */
+            int           count,	/* I - Number of pixels */
+	    int           kind)		/* I - Kind of pixel data */
+{
+  while (count > 0)
+  {
+    switch (kind)
+    {
+      case 0 :
+          *ipixels = rand();
+	  break;
+      case 1 :
+          *ipixels = rand() & 1;
+	  break;
+      case 2 :
+          *ipixels = (rand() % 50) ? 0 : 255;
+	  break;
+      default :
+          *ipixels = rand() & 3;
+	  break;
+    }
+
+    ipixels ++;
+    count --;
+  }
+}
+
+
+/*
+ * 'get_time()' - Get the current time in seconds.
+ */
+
+static double				/* O - Time in seconds */
+get_time(void)
+{
+  struct timeval	curtime;	/* Current time */
+
+
+  gettimeofday(&curtime, NULL);
+  return (curtime.tv_sec + 0.000001 * curtime.tv_usec);
+}
+
+
+/*
+ * 'ref_horizontal()' - Original cupsPackHorizontal().
+ */
+
+static void
+ref_horizontal(
+    const unsigned char *ipixels,	/* I - Input pixels */
+    unsigned char       *obytes,	/* O - Output bytes */
+    int                 width,		/* I - Number of pixels */
+    unsigned char       clearto,	/* I - Initial value of bytes */
+    int                 step)		/* I - Step value between pixels */
+{
+  unsigned char	b;			/* Current byte */
+  int		i;			/* Looping var */
+
+
+  while (width > 0)
+  {
+    b = clearto;
+
+    for (i = 0; i < 8 && i < width; i ++)
+      if (ipixels[i * step])
+        b ^= 0x80 >> i;
+
+    *obytes++ = b;
+
+    ipixels += 8 * step;
+    width   -= 8;
+  }
+}
+
+
+/*
+ * 'ref_horizontal2()' - Original cupsPackHorizontal2().
+ */
+
+static void
+ref_horizontal2(
+    const unsigned char *ipixels,	/* I - Input pixels */
+    unsigned char       *obytes,	/* O - Output bytes */
+    int                 width,		/* I - Number of pixels */
+    int                 step)		/* I - Stepping value */
+{
+  unsigned char	b;			/* Current byte */
+
+
+  while (width > 3)
+  {
+    b = ipixels[0];
+    b = (b << 2) | ipixels[step];
+    b = (b << 2) | ipixels[2 * step];
+    b = (b << 2) | ipixels[3 * step];
+
+    *obytes++ = b;
+
+    ipixels += 4 * step;
+    width   -= 4;
+  }
+
+  b = 0;
+
+  switch (width)
+  {
+    case 3 :
+	b = ipixels[2 * step];
+    case 2 :
+	b = (b << 2) | ipixels[step];
+    case 1 :
+	b = (b << 2) | ipixels[0];
+        *obytes = b << (8 - 2 * width);
+        break;
+  }
+}
+
+
+/*
+ * 'ref_horizontal_bit()' - Original cupsPackHorizontalBit().
+ */
+
+static void
+ref_horizontal_bit(
+    const unsigned char *ipixels,	/* I - Input pixels */
+    unsigned char       *obytes,	/* O - Output bytes */
+    int                 width,		/* I - Number of pixels */
+    unsigned char       clearto,	/* I - Initial value of bytes */
+    unsigned char       bit)		/* I - Bit to check */
+{
+  unsigned char	b;			/* Current byte */
+  int		i;			/* Looping var */
+
+
+  while (width > 0)
+  {
+    b = clearto;
+
+    for (i = 0; i < 8 && i < width; i ++)
+      if (ipixels[i] & bit)
+        b ^= 0x80 >> i;
+
+    *obytes++ = b;
+
+    ipixels += 8;
+    width   -= 8;
+  }
+}
+
+
+/*
+ * 'ref_vertical()' - Original cupsPackVertical().
+ */
+
+static void
+ref_vertical(const unsigned char *ipixels,
+					/* I - Input pixels */
+             unsigned char       *obytes,
+					/* O - Output bytes */
+             int                 width,	/* I - Number of input pixels */
+             unsigned char       bit,	/* I - Output bit */
+             int                 step)	/* I - Bytes between columns */
+{
+  while (width > 0)
+  {
+    if (*ipixels++)
+      *obytes ^= bit;
+
+    obytes += step;
+    width --;
+  }
+}
+
+
+/*
+ * 'test_pack()' - Test all packers for one line.
+ */
+
+static int				/* O - Number of errors */
+test_pack(const unsigned char *ipixels,	/* I - Input pixels */
+          int                 width)	/* I - Number of pixels */
+{
+  static const unsigned char values[] = { 0x00, 0xff, 0x5a, 0x01, 0x80 };
+					/* clearto and bit values */
+  int		i,			/* Looping var */
+		step,			/* Step value */
+		errors = 0;		/* Number of errors */
+  unsigned char	obytes[SIZE],		/* Output bytes */
+		ref[SIZE];		/* Reference output bytes */
+
+
+  for (step = 1; step <= MAX_STEP; step ++)
+  {
+    for (i = 0; i < (int)sizeof(values); i ++)
+    {
+      memset(obytes, 0xa5, SIZE);
+      memset(ref, 0xa5, SIZE);
+
+      cupsPackHorizontal(ipixels, obytes, width, values[i], step);
+      ref_horizontal(ipixels, ref, width, values[i], step);
+
+      errors += compare("cupsPackHorizontal", obytes, ref, width, step,
+                        values[i]);
+
+      memset(obytes, values[i], SIZE);
+      memset(ref, values[i], SIZE);
+
+      cupsPackVertical(ipixels, obytes, width, values[i], step);
+      ref_vertical(ipixels, ref, width, values[i], step);
+
+      errors += compare("cupsPackVertical", obytes, ref, width, step,
+                        values[i]);
+    }
+
+    memset(obytes, 0xa5, SIZE);
+    memset(ref, 0xa5, SIZE);
+
+    cupsPackHorizontal2(ipixels, obytes, width, step);
+    ref_horizontal2(ipixels, ref, width, step);
+
+    errors += compare("cupsPackHorizontal2", obytes, ref, width, step, 0);
+  }
+
+  for (i = 0; i < 8; i ++)
+  {
+    memset(obytes, 0xa5, SIZE);
+    memset(ref, 0xa5, SIZE);
+
+    cupsPackHorizontalBit(ipixels, obytes, width, values[i % 3], 1 << i);
+    ref_horizontal_bit(ipixels, ref, width, values[i % 3], 1 << i);
+
+    errors += compare("cupsPackHorizontalBit", obytes, ref, width, 1,
+                      1 << i);
+  }
+
+  return (errors);
+}
+
+
+/*
+ * 'time_pack()' - Show the time per line of each packer.
+ */
+
+static void
+time_pack(void)
+{
+  int		i,			/* Looping var */
+		pass;			/* 0 = original, 1 = current */
+  unsigned char	*ipixels,		/* Dithered pixels */
+		*obytes;		/* Packed bytes */
+  double	start,			/* Start time */
+		times[4][2];		/* Times per line */
+  static const char * const names[4] =	/* Names of packers */
+  {
+    "cupsPackHorizontal",
+    "cupsPackHorizontal2",
+    "cupsPackHorizontalBit",
+    "cupsPackVertical"
+  };
+
+
+  ipixels = malloc(LINE_WIDTH);
+  obytes  = calloc(LINE_WIDTH, 4);
+
+  if (!ipixels || !obytes)
+  {
+    free(ipixels);
+    free(obytes);
+    return;
+  }
+
+  fill_pixels(ipixels, LINE_WIDTH, 1);
+
+  for (pass = 0; pass < 2; pass ++)
+  {
+    start = get_time();
+    for (i = 0; i < 2000; i ++)
+      if (pass)
+        cupsPackHorizontal(ipixels, obytes, LINE_WIDTH, 0, 1);
+      else
+        ref_horizontal(ipixels, obytes, LINE_WIDTH, 0, 1);
+    times[0][pass] = get_time() - start;
+
+    start = get_time();
+    for (i = 0; i < 2000; i ++)
+      if (pass)
+        cupsPackHorizontal2(ipixels, obytes, LINE_WIDTH, 1);
+      else
+        ref_horizontal2(ipixels, obytes, LINE_WIDTH, 1);
+    times[1][pass] = get_time() - start;
+
+    start = get_time();
+    for (i = 0; i < 2000; i ++)
+      if (pass)
+        cupsPackHorizontalBit(ipixels, obytes, LINE_WIDTH, 0, 1);
+      else
+        ref_horizontal_bit(ipixels, obytes, LINE_WIDTH, 0, 1);
+    times[2][pass] = get_time() - start;
+
+    start = get_time();
+    for (i = 0; i < 2000; i ++)
+      if (pass)
+        cupsPackVertical(ipixels, obytes, LINE_WIDTH, 1, 4);
+      else
+        ref_vertical(ipixels, obytes, LINE_WIDTH, 1, 4);
+    times[3][pass] = get_time() - start;
+  }
+
+  for (i = 0; i < 4; i ++)
+    printf("%s: %.2f us/line, original %.2f us/line\n", names[i],
+           1e6 * times[i][1] / 2000, 1e6 * times[i][0] / 2000);
+
+  free(ipixels);
+  free(obytes);
+}
@@ -0,0 +1,160 @@
+/*
+ *   PPD generator benchmark program for cups-filters.
+ *
+ *   Generates a PPD file from each of the given saved
+ *   Get-Printer-Attributes responses (binary IPP messages, as for
+ *   example written by "ipptool -d" or CUPS' ippWriteFile()) and
+ *   reports the time needed per printer, so that the PPD generation
+ *   time can be tracked over a corpus of real printers:
+ *
+ *       testppdgenerator [-n repetitions] [-k] printer1.ipp [printer2.ipp ...]
+ *
+ *   With "-k" the generated PPD files are kept and their names listed.
+ *
+ *   Copyright 2020 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   main()  - Generate PPDs and report the time needed.
+ *   usage() - Show program usage...
+ */
+
+/*
+ * Include necessary headers.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <cups/cups.h>
+#include "ppdgenerator.h"
+
+
+/*
+ * Local functions...
+ */
+
+void	usage(void);
+
+
+/*
+ * 'main()' - Generate PPDs and report the time needed.
+ */
+
+int				/* O - Exit status */
+main(int  argc,			/* I - Number of command-line arguments */
+     char *argv[])		/* I - Command-line arguments */
+{
+#ifdef HAVE_CUPS_1_6
+  int		i, j;		/* Looping vars */
+  int		repeat = 1,	/* Number of PPDs to generate per printer */
+		keep = 0,	/* Keep generated PPD files? */
+		printers = 0,	/* Number of printers */
+		status = 0;	/* Exit status */
+  int		fd;		/* IPP response file */
+  ipp_t		*response;	/* Get-Printer-Attributes response */
+  char		ppdname[1024];	/* Generated PPD file */
+  struct timeval start,		/* Start time */
+		end;		/* End time */
+  double	secs,		/* Time for this printer */
+		total = 0.0;	/* Time for all printers */
+
+
+  for (i = 1; i < argc; i ++)
+  {
+    if (!strcmp(argv[i], "-n"))
+    {
+      if (++ i >= argc || (repeat = atoi(argv[i])) < 1)
+        usage();
+      continue;
+    }
+    else if (!strcmp(argv[i], "-k"))
+    {
+      keep = 1;
+      continue;
+    }
+    else if (argv[i][0] == '-')
+      usage();
+
+    if ((fd = open(argv[i], O_RDONLY)) < 0)
+    {
+      perror(argv[i]);
+      status = 1;
+      continue;
+    }
+
+    response = ippNew();
+    if (ippReadFile(fd, response) != IPP_STATE_DATA)
+    {
+      fprintf(stderr, "%s: Not a valid IPP message.\n", argv[i]);
+      ippDelete(response);
+      close(fd);
+      status = 1;
+      continue;
+    }
+    close(fd);
+
+    gettimeofday(&start, NULL);
+
+    for (j = 0; j < repeat; j ++)
+    {
+      if (!ppdCreateFromIPP(ppdname, sizeof(ppdname), response, NULL, NULL,
+			    0, 0))
+      {
+	fprintf(stderr, "%s: %s\n", argv[i], ppdgenerator_msg);
+	status = 1;
+	break;
+      }
+
+      if (!keep || j < repeat - 1)
+	unlink(ppdname);
+    }
+
+    gettimeofday(&end, NULL);
+
+    if (j == repeat)
+    {
+      secs = end.tv_sec - start.tv_sec +
+	     0.000001 * (end.tv_usec - start.tv_usec);
+      total += secs;
+      printers ++;
+
+      printf("%s: %.3f ms per PPD (%s)%s%s\n", argv[i],
+	     1000.0 * secs / repeat, ppdgenerator_msg,
+	     keep ? " -> " : "", keep ? ppdname : "");
+    }
+
+    ippDelete(response);
+  }
+
+  if (printers == 0)
+    usage();
+
+  printf("%d printer(s): %.3f ms per PPD on average\n", printers,
+	 1000.0 * total / printers / repeat);
+
+  return (status);
+#else
+  puts("PPD generator needs CUPS 1.6 or newer.");
+  return (1);
+#endif /* HAVE_CUPS_1_6 */
+}
+
+
+/*
+ * 'usage()' - Show program usage...
+ */
+
+void
+usage(void)
+{
+  puts("Usage: testppdgenerator [-n repetitions] [-k] printer.ipp [... printer.ipp]");
+  exit(1);
+}
@@ -0,0 +1,581 @@
+/*
+ *   Color separation test program for CUPS.
+ *
+ *   Checks the RGB and CMYK separations against the original code:
+ *
+ *   - cupsRGBDoRGB() with CUPS_RGB_TRILINEAR must give the same output
+ *     as the original trilinear interpolation, byte for byte.
+ *   - cupsRGBDoRGB() with CUPS_RGB_TETRAHEDRAL must reproduce a linear
+ *     color cube within rounding, and give the same output for a whole
+ *     line as for each pixel on its own (color cache).
+ *   - cupsCMYKDoRGB() must give the same output as the original black
+ *     generation.
+ *
+ *   The time per pixel of both interpolations is shown as well.
+ *
+ *   Copyright 2007-2011 by Apple Inc.
+ *   Copyright 1993-2006 by Easy Software Products, All Rights Reserved.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   main()       - Run the separation tests.
+ *   fill_line()  - Fill a line with random colors.
+ *   get_time()   - Get the current time in seconds.
+ *   new_rgb()    - Create a RGB separation with random or linear samples.
+ *   ref_cmyk()   - Original CMYK separation of sRGB pixels.
+ *   ref_rgb()    - Original trilinear RGB separation.
+ *   test_cmyk()  - Test the CMYK separation.
+ *   test_rgb()   - Test the RGB separation of one color cube.
+ *   time_rgb()   - Show the time per pixel of the RGB separation.
+ */
+
+/*
+ * Include necessary headers.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <sys/time.h>
+#include "driver.h"
+
+
+/*
+ * Constants...
+ */
+
+#define WIDTH	4096			/* Pixels per line */
+
+
+/*
+ * Local functions...
+ */
+
+static void	fill_line(unsigned char *line, int num_pixels, int num_colors);
+static double	get_time(void);
+static cups_rgb_t *new_rgb(int cube_size, int num_channels, int linear);
+static void	ref_cmyk(const cups_cmyk_t *cmyk, const unsigned char *input,
+		         short *output, int num_pixels);
+static void	ref_rgb(cups_rgb_t *rgbptr, const unsigned char *input,
+		        unsigned char *output, int num_pixels);
+static int	test_cmyk(void);
+static int	test_rgb(int cube_size, int num_channels);
+static void	time_rgb(void);
+
+
+/*
+ * 'main()' - Run the separation tests.
+ */
+
+int					/* O - Exit status */
+main(void)
+{
+  int	cube_size,			/* Size of color cube */
+	num_channels,			/* Number of channels */
+	errors = 0;			/* Number of errors */
+
+
+  srand(1);
+
+  for (cube_size = 2; cube_size <= 17; cube_size ++)
+    for (num_channels = 1; num_channels <= CUPS_MAX_RGB; num_channels ++)
+      errors += test_rgb(cube_size, num_channels);
+
+  errors += test_cmyk();
+
+  time_rgb();
+
+  if (errors)
+  {
+    printf("FAIL: %d separation errors!\n", errors);
+    return (1);
+  }
+
+  puts("PASS: All separations match.");
+  return (0);
+}
+
+
+/*
+ * 'fill_line()' - Fill a line with random colors.
+ *
+ * With "num_colors" > 0 the line uses only that many colors, in runs
+ * of random length, like business graphics.
+ */
+
+static void
+fill_line(unsigned char *line,		/* O - RGB pixels */
+          int           num_pixels,	/* I - Number of pixels */
+	  int           num_colors)	/* I - Number of colors or 0 */
+{
+  int		i, run;			/* Looping vars */
+  unsigned char	colors[16][3];		/* Colors to use */
+
+
+  if (num_colors <= 0)
+  {
+    for (i = 0; i < num_pixels * 3; i ++)
+      line[i] = rand();
+
+    return;
+  }
+
+  for (i = 0; i < num_colors * 3; i ++)
+    colors[i / 3][i % 3] = rand();
+
+  while (num_pixels > 0)
+  {
+    i = rand() % num_colors;
+
+    for (run = 1 + rand() % 8; run > 0 && num_pixels > 0;
+         run --, num_pixels --, line += 3)
+      memcpy(line, colors[i], 3);
+  }
+}
+
+
+/*
+ * 'get_time()' - Get the current time in seconds.
+ */
+
+static double				/* O - Time in seconds */
+get_time(void)
+{
+  struct timeval	curtime;	/* Current time */
+
+
+  gettimeofday(&curtime, NULL);
+
+  return (curtime.tv_sec + 0.000001 * curtime.tv_usec);
+}
+
+
+/*
+ * 'new_rgb()' - Create a RGB separation with random or linear samples.
+ */
+
+static cups_rgb_t *			/* O - Color separation */
+new_rgb(int cube_size,			/* I - Size of color cube */
+        int num_channels,		/* I - Number of channels */
+	int linear)			/* I - Linear samples? */
+{
+  int		i, j,			/* Looping vars */
+		num_samples;		/* Number of samples */
+  double	pos[3];			/* Position of sample */
+  cups_sample_t	*samples;		/* Samples */
+  cups_rgb_t	*rgb;			/* Color separation */
+
+
+  num_samples = cube_size * cube_size * cube_size;
+  samples     = calloc(num_samples, sizeof(cups_sample_t));
+
+  for (i = 0; i < num_samples; i ++)
+  {
+   /*
+    * Round the sample positions up, as cupsRGBNew() rounds them down...
+    */
+
+    pos[0] = 255.0 * (i / (cube_size * cube_size)) / (cube_size - 1);
+    pos[1] = 255.0 * (i / cube_size % cube_size) / (cube_size - 1);
+    pos[2] = 255.0 * (i % cube_size) / (cube_size - 1);
+
+    for (j = 0; j < 3; j ++)
+      samples[i].rgb[j] = (int)ceil(pos[j]);
+
+    for (j = 0; j < num_channels; j ++)
+      if (linear)
+        samples[i].colors[j] = (int)(((j + 1) * pos[0] + (3 - j) * pos[1] +
+				      (j & 1 ? 2 : 0) * pos[2]) /
+			             (j & 1 ? 6 : 4));
+      else
+        samples[i].colors[j] = rand();
+  }
+
+  rgb = cupsRGBNew(num_samples, samples, cube_size, num_channels);
+
+  free(samples);
+
+  return (rgb);
+}
+
+
+/*
+ * 'ref_cmyk()' - Original CMYK separation of sRGB pixels.
+ */
+
+static void
+ref_cmyk(const cups_cmyk_t   *cmyk,	/* I - Color separation */
+	 const unsigned char *input,	/* I - Input RGB pixels */
+	 short               *output,	/* O - Output pixels */
+	 int                 num_pixels)/* I - Number of pixels */
+{
+  int			c, m, y, k, kc, km;
+					/* Current values */
+  const short		**channels;	/* Copy of channel LUTs */
+  int			ink, ink_limit;	/* Ink amount and limit */
+
+
+  channels  = (const short **)cmyk->channels;
+  ink_limit = cmyk->ink_limit;
+
+  while (num_pixels > 0)
+  {
+    c  = cups_scmy_lut[*input++];
+    m  = cups_scmy_lut[*input++];
+    y  = cups_scmy_lut[*input++];
+    k  = min(c, min(m, y));
+
+    if ((km = max(c, max(m, y))) > k)
+      k = k * k * k / (km * km);
+
+    kc = cmyk->color_lut[k] - k;
+    k  = cmyk->black_lut[k];
+    c  += kc;
+    m  += kc;
+    y  += kc;
+
+    output[0] = channels[0][c];
+    output[1] = channels[1][m];
+    output[2] = channels[2][y];
+    output[3] = channels[3][k];
+
+    if (ink_limit)
+    {
+      ink = output[0] + output[1] + output[2] + output[3];
+
+      if (ink > ink_limit)
+      {
+	output[0] = ink_limit * output[0] / ink;
+	output[1] = ink_limit * output[1] / ink;
+	output[2] = ink_limit * output[2] / ink;
+	output[3] = ink_limit * output[3] / ink;
+      }
+    }
+
+    output += 4;
+    num_pixels --;
+  }
+}
+
+
+/*
+ * 'ref_rgb()' - Original trilinear RGB separation.
+ */
+
+static void
+ref_rgb(cups_rgb_t          *rgbptr,	/* I - Color separation */
+	const unsigned char *input,	/* I - Input RGB pixels */
+	unsigned char       *output,	/* O - Output Device-N pixels */
+	int                 num_pixels)	/* I - Number of pixels */
+{
+  int			i;		/* Looping var */
+  int			rgb;		/* Current RGB color */
+  int			r, ri, rm0, rm1, rs,
+			g, gi, gm0, gm1, gs,
+			b, bi, bm0, bm1, bs;
+					/* Indices, multipliers, and offsets */
+  const unsigned char	*color;		/* Current color data */
+  int			tempr, tempg, tempb;
+					/* Current separation colors */
+
+
+  rs = rgbptr->cube_size * rgbptr->cube_size * rgbptr->num_channels;
+  gs = rgbptr->cube_size * rgbptr->num_channels;
+  bs = rgbptr->num_channels;
+
+  while (num_pixels > 0)
+  {
+    num_pixels --;
+
+    r   = cups_srgb_lut[*input++];
+    g   = cups_srgb_lut[*input++];
+    b   = cups_srgb_lut[*input++];
+    rgb = (((r << 8) | g) << 8) | b;
+
+    if (rgb == 0x000000)
+    {
+      memcpy(output, rgbptr->black, rgbptr->num_channels);
+      output += rgbptr->num_channels;
+      continue;
+    }
+    else if (rgb == 0xffffff)
+    {
+      memcpy(output, rgbptr->white, rgbptr->num_channels);
+      output += rgbptr->num_channels;
+      continue;
+    }
+
+    ri  = rgbptr->cube_index[r];
+    rm0 = rgbptr->cube_mult[r];
+    rm1 = 256 - rm0;
+
+    gi  = rgbptr->cube_index[g];
+    gm0 = rgbptr->cube_mult[g];
+    gm1 = 256 - gm0;
+
+    bi  = rgbptr->cube_index[b];
+    bm0 = rgbptr->cube_mult[b];
+    bm1 = 256 - bm0;
+
+    color = rgbptr->colors[ri][gi][bi];
+
+    for (i = rgbptr->num_channels; i > 0; i --, color ++)
+    {
+      tempb = (color[0] * bm0 + color[bs] * bm1) / 256;
+      tempg = tempb  * gm0;
+      tempb = (color[gs] * gm0 + color[gs + bs] * bm1) / 256;
+      tempg = (tempg + tempb  * gm1) / 256;
+
+      tempr = tempg * rm0;
+
+      tempb = (color[rs] * bm0 + color[rs + bs] * bm1) / 256;
+      tempg = tempb  * gm0;
+      tempb = (color[rs + gs] * bm0 + color[rs + gs + bs] * bm1) / 256;
+      tempg = (tempg + tempb  * gm1) / 256;
+
+      tempr = (tempr + tempg * rm1) / 256;
+
+      if (tempr > 255)
+        *output++ = 255;
+      else if (tempr < 0)
+        *output++ = 0;
+      else
+        *output++ = tempr;
+    }
+  }
+}
+
+
+/*
+ * 'test_cmyk()' - Test the CMYK separation.
+ */
+
+static int				/* O - Number of errors */
+test_cmyk(void)
+{
+  int		i,			/* Looping var */
+		k, km,			/* Black and maximum color */
+		errors = 0;		/* Number of errors */
+  unsigned char	*line;			/* RGB pixels */
+  short		*output,		/* Output pixels */
+		*ref_output;		/* Reference output pixels */
+  cups_cmyk_t	*cmyk;			/* Color separation */
+
+
+  line       = malloc(WIDTH * 3);
+  output     = malloc(WIDTH * 4 * sizeof(short));
+  ref_output = malloc(WIDTH * 4 * sizeof(short));
+  cmyk       = cupsCMYKNew(4);
+
+  cupsCMYKSetBlack(cmyk, 0.25, 0.9);
+  cupsCMYKSetInkLimit(cmyk, 2.5);
+
+ /*
+  * Check the black generation for all colors...
+  */
+
+  for (km = 1; km < 256 && !errors; km ++)
+    for (k = 0; k < km; k ++)
+      if ((int)((k * k * k * cmyk->black_mult[km]) >> 40) !=
+              k * k * k / (km * km))
+      {
+        printf("FAIL: Black generation for k=%d, max=%d is wrong.\n", k, km);
+	errors ++;
+	break;
+      }
+
+  for (i = 0; i < 64; i ++)
+  {
+    fill_line(line, WIDTH, i & 1 ? 16 : 0);
+
+    cupsCMYKDoRGB(cmyk, line, output, WIDTH);
+    ref_cmyk(cmyk, line, ref_output, WIDTH);
+
+    if (memcmp(output, ref_output, WIDTH * 4 * sizeof(short)))
+    {
+      puts("FAIL: cupsCMYKDoRGB() differs from original separation.");
+      errors ++;
+      break;
+    }
+  }
+
+  cupsCMYKDelete(cmyk);
+  free(line);
+  free(output);
+  free(ref_output);
+
+  return (errors);
+}
+
+
+/*
+ * 'test_rgb()' - Test the RGB separation of one color cube.
+ */
+
+static int				/* O - Number of errors */
+test_rgb(int cube_size,			/* I - Size of color cube */
+         int num_channels)		/* I - Number of channels */
+{
+  int		i, j, x,		/* Looping vars */
+		r, g, b,		/* sRGB values */
+		diff,			/* Difference to expected color */
+		errors = 0;		/* Number of errors */
+  double	pr, pg, pb;		/* Positions in cube */
+  unsigned char	*line,			/* RGB pixels */
+		*output,		/* Output pixels */
+		*ref_output;		/* Reference output pixels */
+  cups_rgb_t	*rgb;			/* Color separation */
+
+
+  line       = malloc(WIDTH * 3);
+  output     = malloc(WIDTH * CUPS_MAX_RGB);
+  ref_output = malloc(WIDTH * CUPS_MAX_RGB);
+
+ /*
+  * The trilinear mode is the original code...
+  */
+
+  rgb = new_rgb(cube_size, num_channels, 0);
+  cupsRGBSetInterpolation(rgb, CUPS_RGB_TRILINEAR);
+
+  for (i = 0; i < 8; i ++)
+  {
+    fill_line(line, WIDTH, i & 1 ? 16 : 0);
+
+    cupsRGBDoRGB(rgb, line, output, WIDTH);
+    ref_rgb(rgb, line, ref_output, WIDTH);
+
+    if (memcmp(output, ref_output, WIDTH * num_channels))
+    {
+      printf("FAIL: Trilinear separation of %d-cube, %d channels differs.\n",
+             cube_size, num_channels);
+      errors ++;
+      break;
+    }
+  }
+
+ /*
+  * The tetrahedral mode gives the same colors with and without cache...
+  */
+
+  cupsRGBSetInterpolation(rgb, CUPS_RGB_TETRAHEDRAL);
+
+  for (i = 0; i < 8; i ++)
+  {
+    fill_line(line, WIDTH, i & 1 ? 16 : 0);
+
+    cupsRGBDoRGB(rgb, line, output, WIDTH);
+
+    for (x = 0; x < WIDTH; x ++)
+      cupsRGBDoRGB(rgb, line + 3 * x, ref_output + num_channels * x, 1);
+
+    if (memcmp(output, ref_output, WIDTH * num_channels))
+    {
+      printf("FAIL: Tetrahedral separation of %d-cube, %d channels differs "
+             "between line and pixels.\n", cube_size, num_channels);
+      errors ++;
+      break;
+    }
+  }
+
+  cupsRGBDelete(rgb);
+
+ /*
+  * ... and reproduces a linear cube...
+  */
+
+  rgb = new_rgb(cube_size, num_channels, 1);
+
+  fill_line(line, WIDTH, 0);
+  cupsRGBDoRGB(rgb, line, output, WIDTH);
+
+  for (x = 0; x < WIDTH && !errors; x ++)
+  {
+    r  = cups_srgb_lut[line[3 * x]];
+    g  = cups_srgb_lut[line[3 * x + 1]];
+    b  = cups_srgb_lut[line[3 * x + 2]];
+    pr = (rgb->tetra_index[r] + rgb->tetra_frac[r] / 256.0) * 255.0 /
+         (cube_size - 1);
+    pg = (rgb->tetra_index[g] + rgb->tetra_frac[g] / 256.0) * 255.0 /
+         (cube_size - 1);
+    pb = (rgb->tetra_index[b] + rgb->tetra_frac[b] / 256.0) * 255.0 /
+         (cube_size - 1);
+
+    for (j = 0; j < num_channels; j ++)
+    {
+     /*
+      * The samples themselves are rounded down, so allow for that...
+      */
+
+      diff = output[num_channels * x + j] -
+             (int)(((j + 1) * pr + (3 - j) * pg + (j & 1 ? 2 : 0) * pb) /
+	           (j & 1 ? 6 : 4) + 0.5);
+
+      if (diff < -2 || diff > 1)
+      {
+        printf("FAIL: Tetrahedral separation of linear %d-cube, channel %d "
+	       "is %d for %d,%d,%d, off by %d.\n", cube_size, j,
+	       output[num_channels * x + j], r, g, b, diff);
+        errors ++;
+	break;
+      }
+    }
+  }
+
+  cupsRGBDelete(rgb);
+  free(line);
+  free(output);
+  free(ref_output);
+
+  return (errors);
+}
+
+
+/*
+ * 'time_rgb()' - Show the time per pixel of the RGB separation.
+ */
+
+static void
+time_rgb(void)
+{
+  int		i,			/* Looping var */
+		mode,			/* Interpolation */
+		colors;			/* Number of colors in line */
+  unsigned char	*line,			/* RGB pixels */
+		*output;		/* Output pixels */
+  cups_rgb_t	*rgb;			/* Color separation */
+  double	start;			/* Start time */
+
+
+  line   = malloc(WIDTH * 3);
+  output = malloc(WIDTH * CUPS_MAX_RGB);
+  rgb    = new_rgb(17, 4, 0);
+
+  for (colors = 0; colors <= 16; colors += 16)
+  {
+    fill_line(line, WIDTH, colors);
+
+    for (mode = CUPS_RGB_TETRAHEDRAL; mode <= CUPS_RGB_TRILINEAR; mode ++)
+    {
+      cupsRGBSetInterpolation(rgb, mode);
+
+      start = get_time();
+
+      for (i = 0; i < 1000; i ++)
+	cupsRGBDoRGB(rgb, line, output, WIDTH);
+
+      printf("%s, %s: %.2f ns/pixel\n",
+             mode == CUPS_RGB_TETRAHEDRAL ? "tetrahedral" : "trilinear",
+	     colors ? "16 colors" : "random colors",
+	     1e9 * (get_time() - start) / WIDTH / 1000);
+    }
+  }
+
+  cupsRGBDelete(rgb);
+  free(line);
+  free(output);
+}
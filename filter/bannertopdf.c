@@ -21,10 +21,10 @@
 #include <stdarg.h>
 #include <math.h>
 
-#ifndef HAVE_OPEN_MEMSTREAM
-#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifndef HAVE_OPEN_MEMSTREAM
+#include <fcntl.h>
 #include <errno.h>
 #endif
 
@@ -354,6 +354,41 @@ opt_t *get_known_opts(
     return opt;
 }
 
+/*
+ * Name of the skeleton file for a template and page size in the cache
+ * directory of CUPS, and the key the skeleton must have been saved with.
+ * The key changes with the template file, so a modified template gets a
+ * new skeleton.  Returns 0 if there is no cache directory.
+ */
+static int get_skeleton_file(const char *template_file,
+                             float width,
+                             float length,
+                             char *filename,
+                             size_t filesize,
+                             char *key,
+                             size_t keysize)
+{
+    const char *cachedir = getenv("CUPS_CACHEDIR");
+    struct stat st;
+    unsigned hash = 2166136261U;
+    const char *ptr;
+
+    if (!cachedir || !*cachedir || stat(template_file, &st))
+        return 0;
+
+    snprintf(key, keysize, "%s %ld %ld %.2f %.2f", template_file,
+             (long)st.st_mtime, (long)st.st_size, width, length);
+    if (strchr(key, '\n'))
+        return 0;
+
+    /* FNV-1a */
+    for (ptr = key; *ptr; ptr ++)
+        hash = (hash ^ (unsigned char)*ptr) * 16777619U;
+
+    snprintf(filename, filesize, "%s/bannertopdf-%08x.skel", cachedir, hash);
+    return 1;
+}
+
 static int generate_banner_pdf(banner_t *banner,
                                ppd_file_t *ppd,
                                const char *jobid,
@@ -365,7 +400,11 @@ static int generate_banner_pdf(banner_t *banner,
     char *buf;
     size_t len;
     FILE *s;
-    pdf_t *doc;
+    pdf_t *doc = NULL;
+    pdf_skeleton_t *skel = NULL;
+    char cachefile[1024], cachekey[1024];
+    int cached;
+    int status = 0;
     float page_width, page_length;
     float media_limits[4];
     float page_scale;
@@ -375,15 +414,36 @@ static int generate_banner_pdf(banner_t *banner,
     struct stat st;
 #endif
 
-    if (!(doc = pdf_load_template(banner->template_file)))
-        return 1;
-
     get_pagesize(ppd, noptions, options,
                  &page_width, &page_length, media_limits);
 
-    pdf_resize_page (doc, 1, page_width, page_length, &page_scale);
-
-    pdf_add_type1_font(doc, 1, "Courier");
+    /*
+     * Use the skeleton of the template for this page size from an
+     * earlier job, or make one.
+     */
+    cached = get_skeleton_file(banner->template_file, page_width, page_length,
+                               cachefile, sizeof(cachefile),
+                               cachekey, sizeof(cachekey));
+    if (cached && (skel = pdf_skeleton_load(cachefile, cachekey)) != NULL) {
+        fprintf(stderr, "DEBUG: Using banner skeleton %s\n", cachefile);
+        page_scale = pdf_skeleton_scale(skel);
+    } else {
+        if (!(doc = pdf_load_template(banner->template_file)))
+            return 1;
+
+        pdf_resize_page (doc, 1, page_width, page_length, &page_scale);
+
+        pdf_add_type1_font(doc, 1, "Courier");
+
+        /* doc stays unchanged if it can't be made into a skeleton */
+        if ((skel = pdf_skeleton_new(doc, page_scale)) != NULL) {
+            if (cached && pdf_skeleton_save(skel, cachefile, cachekey))
+                fprintf(stderr, "DEBUG: Unable to save banner skeleton %s\n",
+                        cachefile);
+            pdf_free(doc);
+            doc = NULL;
+        }
+    }
 
 #ifdef HAVE_OPEN_MEMSTREAM
     s = open_memstream(&buf, &len);
@@ -494,26 +554,37 @@ static int generate_banner_pdf(banner_t *banner,
             noptions,
             options);
 
-    /*
-     * Try to find a PDF form in PDF template and fill it.
-     */
-    int ret = pdf_fill_form(doc, known_opts);
-
-    /*
-     * Could we fill a PDF form? If no, just add PDF stream.
-     */
-    if ( ! ret ) {
-        pdf_prepend_stream(doc, 1, buf, len);
-    }
-
     copies = get_int_option("number-up", noptions, options, 1);
     if (duplex_marked(ppd, noptions, options))
         copies *= 2;
 
-    if (copies > 1)
-        pdf_duplicate_page(doc, 1, copies - 1);
-
-    pdf_write(doc, stdout);
+    if (skel) {
+        /*
+         * Append the form field values or the PDF stream and the copies
+         * to the skeleton.
+         */
+        if (pdf_skeleton_write(skel, stdout, buf, len, known_opts, copies)) {
+            fprintf(stderr, "ERROR: bannertopdf: cannot write banner\n");
+            status = 1;
+        }
+    } else {
+        /*
+         * Try to find a PDF form in PDF template and fill it.
+         */
+        int ret = pdf_fill_form(doc, known_opts);
+
+        /*
+         * Could we fill a PDF form? If no, just add PDF stream.
+         */
+        if ( ! ret ) {
+            pdf_prepend_stream(doc, 1, buf, len);
+        }
+
+        if (copies > 1)
+            pdf_duplicate_page(doc, 1, copies - 1);
+
+        pdf_write(doc, stdout);
+    }
 
     opt_t * opt_current = known_opts;
     opt_t * opt_next = NULL;
@@ -524,8 +595,11 @@ static int generate_banner_pdf(banner_t *banner,
       opt_current = opt_next;
     }
     free(buf);
-    pdf_free(doc);
-    return 0;
+    if (skel)
+        pdf_skeleton_free(skel);
+    if (doc)
+        pdf_free(doc);
+    return status;
 }
 
 
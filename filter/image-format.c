@@ -0,0 +1,3936 @@
+/*
+ *   Line formatting for the image file to raster filter for CUPS.
+ *
+ *   Copyright 2007-2011 by Apple Inc.
+ *   Copyright 1993-2007 by Easy Software Products.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   blank_line()    - Clear a line buffer to the blank value...
+ *   format_CMY()    - Convert image data to CMY.
+ *   format_CMYK()   - Convert image data to CMYK.
+ *   format_K()      - Convert image data to black.
+ *   format_KCMY()   - Convert image data to KCMY.
+ *   format_KCMYcm() - Convert image data to KCMYcm.
+ *   format_RGBA()   - Convert image data to RGBA/RGBW.
+ *   format_W()      - Convert image data to luminance.
+ *   format_YMC()    - Convert image data to YMC.
+ *   format_YMCK()   - Convert image data to YMCK.
+ *   format_line()   - Format a line of raster data for the printer.
+ *   format_select() - Create the dither tables and choose the line
+ *                     formatter for the page.
+ *   pack_1()        - Dither one color of a line to 1 bit per pixel.
+ *   pack_2()        - Dither one color of a line to 2 bits per pixel.
+ *   pack_4()        - Dither one color of a line to 4 bits per pixel.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "image-format.h"
+#include <string.h>
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif /* __SSE2__ */
+
+
+/*
+ * The format_*() functions get the color order and bits per color as
+ * arguments; they are always inlined so that each of the specialized
+ * line formatters below only keeps the loop it uses...
+ */
+
+#ifdef __GNUC__
+#  define FORMAT_INLINE	inline __attribute__((always_inline))
+#else
+#  define FORMAT_INLINE	inline
+#endif /* __GNUC__ */
+
+
+/*
+ * Globals...
+ */
+
+int	XPosition = 0;			/* Horizontal position on page */
+
+static int	Floyd16x16[16][16] =		/* Traditional Floyd ordered dither */
+	{
+	  { 0,   128, 32,  160, 8,   136, 40,  168,
+	    2,   130, 34,  162, 10,  138, 42,  170 },
+	  { 192, 64,  224, 96,  200, 72,  232, 104,
+	    194, 66,  226, 98,  202, 74,  234, 106 },
+	  { 48,  176, 16,  144, 56,  184, 24,  152,
+	    50,  178, 18,  146, 58,  186, 26,  154 },
+	  { 240, 112, 208, 80,  248, 120, 216, 88,
+	    242, 114, 210, 82,  250, 122, 218, 90 },
+	  { 12,  140, 44,  172, 4,   132, 36,  164,
+	    14,  142, 46,  174, 6,   134, 38,  166 },
+	  { 204, 76,  236, 108, 196, 68,  228, 100,
+	    206, 78,  238, 110, 198, 70,  230, 102 },
+	  { 60,  188, 28,  156, 52,  180, 20,  148,
+	    62,  190, 30,  158, 54,  182, 22,  150 },
+	  { 252, 124, 220, 92,  244, 116, 212, 84,
+	    254, 126, 222, 94,  246, 118, 214, 86 },
+	  { 3,   131, 35,  163, 11,  139, 43,  171,
+	    1,   129, 33,  161, 9,   137, 41,  169 },
+	  { 195, 67,  227, 99,  203, 75,  235, 107,
+	    193, 65,  225, 97,  201, 73,  233, 105 },
+	  { 51,  179, 19,  147, 59,  187, 27,  155,
+	    49,  177, 17,  145, 57,  185, 25,  153 },
+	  { 243, 115, 211, 83,  251, 123, 219, 91,
+	    241, 113, 209, 81,  249, 121, 217, 89 },
+	  { 15,  143, 47,  175, 7,   135, 39,  167,
+	    13,  141, 45,  173, 5,   133, 37,  165 },
+	  { 207, 79,  239, 111, 199, 71,  231, 103,
+	    205, 77,  237, 109, 197, 69,  229, 101 },
+	  { 63,  191, 31,  159, 55,  183, 23,  151,
+	    61,  189, 29,  157, 53,  181, 21,  149 },
+	  { 254, 127, 223, 95,  247, 119, 215, 87,
+	    253, 125, 221, 93,  245, 117, 213, 85 }
+	};
+static int	Floyd8x8[8][8] =
+	{
+	  {  0, 32,  8, 40,  2, 34, 10, 42 },
+	  { 48, 16, 56, 24, 50, 18, 58, 26 },
+	  { 12, 44,  4, 36, 14, 46,  6, 38 },
+	  { 60, 28, 52, 20, 62, 30, 54, 22 },
+	  {  3, 35, 11, 43,  1, 33,  9, 41 },
+	  { 51, 19, 59, 27, 49, 17, 57, 25 },
+	  { 15, 47,  7, 39, 13, 45,  5, 37 },
+	  { 63, 31, 55, 23, 61, 29, 53, 21 }
+	};
+static int	Floyd4x4[4][4] =
+	{
+	  {  0,  8,  2, 10 },
+	  { 12,  4, 14,  6 },
+	  {  3, 11,  1,  9 },
+	  { 15,  7, 13,  5 }
+	};
+
+static cups_ib_t OnPixels[256],		/* On-pixel LUT */
+		 OffPixels[256];		/* Off-pixel LUT */
+
+#ifdef __SSE2__
+#  define R2(n)	n, n + 2 * 64, n + 1 * 64, n + 3 * 64
+#  define R4(n)	R2(n), R2(n + 2 * 16), R2(n + 1 * 16), R2(n + 3 * 16)
+#  define R6(n)	R4(n), R4(n + 2 * 4), R4(n + 1 * 4), R4(n + 3 * 4)
+
+static const unsigned char BitReverse[256] =
+					/* Bits of a byte in reverse order */
+	{ R6(0), R6(2), R6(1), R6(3) };
+#endif /* __SSE2__ */
+
+
+/*
+ * Local functions...
+ */
+
+static FORMAT_INLINE void	pack_1(cups_ib_t *ptr, int bitoffset, const cups_ib_t *r0, int step, int xsize, const int *dither);
+static FORMAT_INLINE void	pack_2(cups_ib_t *ptr, int bitoffset, const cups_ib_t *r0, int step, int xsize, const int *dither);
+static FORMAT_INLINE void	pack_4(cups_ib_t *ptr, int bitoffset, const cups_ib_t *r0, int step, int xsize, const int *dither);
+#define		format_RGB format_CMY
+
+
+/*
+ * 'blank_line()' - Clear a line buffer to the blank value...
+ */
+
+void
+blank_line(cups_page_header2_t *header,	/* I - Page header */
+           unsigned char       *row)	/* I - Row buffer */
+{
+  int	count;				/* Remaining bytes */
+
+
+  count = header->cupsBytesPerLine;
+
+  switch (header->cupsColorSpace)
+  {
+    case CUPS_CSPACE_CIEXYZ :
+        while (count > 2)
+	{
+	  *row++ = 242;
+	  *row++ = 255;
+	  *row++ = 255;
+	  count -= 3;
+	}
+	break;
+
+    case CUPS_CSPACE_CIELab :
+    case CUPS_CSPACE_ICC1 :
+    case CUPS_CSPACE_ICC2 :
+    case CUPS_CSPACE_ICC3 :
+    case CUPS_CSPACE_ICC4 :
+    case CUPS_CSPACE_ICC5 :
+    case CUPS_CSPACE_ICC6 :
+    case CUPS_CSPACE_ICC7 :
+    case CUPS_CSPACE_ICC8 :
+    case CUPS_CSPACE_ICC9 :
+    case CUPS_CSPACE_ICCA :
+    case CUPS_CSPACE_ICCB :
+    case CUPS_CSPACE_ICCC :
+    case CUPS_CSPACE_ICCD :
+    case CUPS_CSPACE_ICCE :
+    case CUPS_CSPACE_ICCF :
+        while (count > 2)
+	{
+	  *row++ = 255;
+	  *row++ = 128;
+	  *row++ = 128;
+	  count -= 3;
+	}
+        break;
+
+    case CUPS_CSPACE_K :
+    case CUPS_CSPACE_CMY :
+    case CUPS_CSPACE_CMYK :
+    case CUPS_CSPACE_YMC :
+    case CUPS_CSPACE_YMCK :
+    case CUPS_CSPACE_KCMY :
+    case CUPS_CSPACE_KCMYcm :
+    case CUPS_CSPACE_GMCK :
+    case CUPS_CSPACE_GMCS :
+    case CUPS_CSPACE_WHITE :
+    case CUPS_CSPACE_GOLD :
+    case CUPS_CSPACE_SILVER :
+        memset(row, 0, count);
+	break;
+
+    default :
+        memset(row, 255, count);
+	break;
+  }
+}
+
+
+/*
+ * 'format_CMY()' - Convert image data to CMY.
+ */
+
+static FORMAT_INLINE void
+format_CMY(cups_page_header2_t *header,	/* I - Page header */
+            unsigned char      *row,	/* IO - Bitmap data for device */
+	    int                y,	/* I - Current row */
+	    int                z,	/* I - Current plane */
+	    int                xsize,	/* I - Width of image data */
+	    int	               ysize,	/* I - Height of image data */
+	    int                yerr0,	/* I - Top Y error */
+	    int                yerr1,	/* I - Bottom Y error */
+	    cups_ib_t          *r0,	/* I - Primary image data */
+	    cups_ib_t          *r1,	/* I - Image data for interpolation */
+	    int                order,	/* I - Color order */
+	    int                bits,	/* I - Bits per color */
+	    int                fast)	/* I - Use packing kernels? */
+{
+  cups_ib_t	*ptr,			/* Pointer into row */
+		*cptr,			/* Pointer into cyan */
+		*mptr,			/* Pointer into magenta */
+		*yptr,			/* Pointer into yellow */
+		bitmask;		/* Current mask for pixel */
+  int		bitoffset;		/* Current offset in line */
+  int		bandwidth;		/* Width of a color band */
+  int		x,			/* Current X coordinate on page */
+		*dither;		/* Pointer into dither array */
+
+
+  switch (XPosition)
+  {
+    case -1 :
+        bitoffset = 0;
+	break;
+    default :
+        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
+	break;
+    case 1 :
+        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
+	break;
+  }
+
+  ptr       = row + bitoffset / 8;
+  bandwidth = header->cupsBytesPerLine / 3;
+
+  switch (order)
+  {
+    case CUPS_ORDER_CHUNKED :
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 64 >> (bitoffset & 7);
+	      dither  = Floyd16x16[y & 15];
+
+              for (x = xsize ; x > 0; x --)
+              {
+	        if (*r0++ > dither[x & 15])
+		  *ptr ^= bitmask;
+		bitmask >>= 1;
+
+	        if (*r0++ > dither[x & 15])
+		  *ptr ^= bitmask;
+		bitmask >>= 1;
+
+	        if (*r0++ > dither[x & 15])
+		  *ptr ^= bitmask;
+
+                if (bitmask > 1)
+		  bitmask >>= 2;
+		else
+        	{
+        	  bitmask = 64;
+        	  ptr ++;
+        	}
+              }
+              break;
+
+          case 2 :
+	      dither = Floyd8x8[y & 7];
+
+              for (x = xsize ; x > 0; x --, r0 += 3)
+              {
+	       	if ((r0[0] & 63) > dither[x & 7])
+        	  *ptr ^= (0x30 & OnPixels[r0[0]]);
+        	else
+        	  *ptr ^= (0x30 & OffPixels[r0[0]]);
+
+        	if ((r0[1] & 63) > dither[x & 7])
+        	  *ptr ^= (0x0c & OnPixels[r0[1]]);
+        	else
+        	  *ptr ^= (0x0c & OffPixels[r0[1]]);
+
+        	if ((r0[2] & 63) > dither[x & 7])
+        	  *ptr++ ^= (0x03 & OnPixels[r0[2]]);
+        	else
+        	  *ptr++ ^= (0x03 & OffPixels[r0[2]]);
+              }
+              break;
+
+          case 4 :
+	      dither = Floyd4x4[y & 3];
+
+              for (x = xsize ; x > 0; x --, r0 += 3)
+              {
+        	if ((r0[0] & 15) > dither[x & 3])
+        	  *ptr++ ^= (0x0f & OnPixels[r0[0]]);
+        	else
+        	  *ptr++ ^= (0x0f & OffPixels[r0[0]]);
+
+        	if ((r0[1] & 15) > dither[x & 3])
+        	  *ptr ^= (0xf0 & OnPixels[r0[1]]);
+        	else
+        	  *ptr ^= (0xf0 & OffPixels[r0[1]]);
+
+        	if ((r0[2] & 15) > dither[x & 3])
+        	  *ptr++ ^= (0x0f & OnPixels[r0[2]]);
+        	else
+        	  *ptr++ ^= (0x0f & OffPixels[r0[2]]);
+              }
+              break;
+
+          case 8 :
+              for (x = xsize  * 3; x > 0; x --, r0 ++, r1 ++)
+        	if (*r0 == *r1)
+                  *ptr++ = *r0;
+        	else
+                  *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
+              break;
+        }
+        break;
+
+    case CUPS_ORDER_BANDED :
+	cptr = ptr;
+	mptr = ptr + bandwidth;
+	yptr = ptr + 2 * bandwidth;
+
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 0x80 >> (bitoffset & 7);
+	      dither  = Floyd16x16[y & 15];
+
+              if (fast)
+              {
+                pack_1(cptr, bitoffset, r0, 3, xsize, dither);
+                pack_1(mptr, bitoffset, r0 + 1, 3, xsize, dither);
+                pack_1(yptr, bitoffset, r0 + 2, 3, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --)
+              {
+        	if (*r0++ > dither[x & 15])
+        	  *cptr ^= bitmask;
+        	if (*r0++ > dither[x & 15])
+        	  *mptr ^= bitmask;
+        	if (*r0++ > dither[x & 15])
+        	  *yptr ^= bitmask;
+
+                if (bitmask > 1)
+		  bitmask >>= 1;
+		else
+		{
+		  bitmask = 0x80;
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+        	}
+	      }
+              break;
+
+          case 2 :
+              bitmask = 0xc0 >> (bitoffset & 7);
+	      dither  = Floyd8x8[y & 7];
+
+              if (fast)
+              {
+                pack_2(cptr, bitoffset, r0, 3, xsize, dither);
+                pack_2(mptr, bitoffset, r0 + 1, 3, xsize, dither);
+                pack_2(yptr, bitoffset, r0 + 2, 3, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --)
+              {
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *cptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *cptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *mptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *mptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *yptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *yptr ^= (bitmask & OffPixels[*r0++]);
+
+                if (bitmask > 3)
+		  bitmask >>= 2;
+		else
+		{
+		  bitmask = 0xc0;
+
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+        	}
+	      }
+              break;
+
+          case 4 :
+              bitmask = 0xf0 >> (bitoffset & 7);
+	      dither  = Floyd4x4[y & 3];
+
+              if (fast)
+              {
+                pack_4(cptr, bitoffset, r0, 3, xsize, dither);
+                pack_4(mptr, bitoffset, r0 + 1, 3, xsize, dither);
+                pack_4(yptr, bitoffset, r0 + 2, 3, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --)
+              {
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *cptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *cptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *mptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *mptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *yptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *yptr ^= (bitmask & OffPixels[*r0++]);
+
+                if (bitmask == 0xf0)
+		  bitmask = 0x0f;
+		else
+		{
+		  bitmask = 0xf0;
+
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+        	}
+	      }
+              break;
+
+          case 8 :
+              for (x = xsize; x > 0; x --, r0 += 3, r1 += 3)
+	      {
+        	if (r0[0] == r1[0])
+                  *cptr++ = r0[0];
+        	else
+                  *cptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
+
+        	if (r0[1] == r1[1])
+                  *mptr++ = r0[1];
+        	else
+                  *mptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
+
+        	if (r0[2] == r1[2])
+                  *yptr++ = r0[2];
+        	else
+                  *yptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
+              }
+              break;
+        }
+        break;
+
+    case CUPS_ORDER_PLANAR :
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 0x80 >> (bitoffset & 7);
+	      dither  = Floyd16x16[y & 15];
+
+              if (fast)
+              {
+                pack_1(ptr, bitoffset, r0 + z, 3, xsize, dither);
+                break;
+              }
+
+              switch (z)
+	      {
+	        case 0 :
+        	    for (x = xsize; x > 0; x --, r0 += 3)
+        	    {
+        	      if (r0[0] > dither[x & 15])
+        		*ptr ^= bitmask;
+
+                      if (bitmask > 1)
+			bitmask >>= 1;
+		      else
+		      {
+			bitmask = 0x80;
+			ptr ++;
+        	      }
+	            }
+		    break;
+
+	        case 1 :
+        	    for (x = xsize; x > 0; x --, r0 += 3)
+        	    {
+        	      if (r0[1] > dither[x & 15])
+        		*ptr ^= bitmask;
+
+                      if (bitmask > 1)
+			bitmask >>= 1;
+		      else
+		      {
+			bitmask = 0x80;
+			ptr ++;
+        	      }
+	            }
+		    break;
+
+	        case 2 :
+        	    for (x = xsize; x > 0; x --, r0 += 3)
+        	    {
+        	      if (r0[2] > dither[x & 15])
+        		*ptr ^= bitmask;
+
+                      if (bitmask > 1)
+			bitmask >>= 1;
+		      else
+		      {
+			bitmask = 0x80;
+			ptr ++;
+        	      }
+	            }
+		    break;
+	      }
+              break;
+
+          case 2 :
+              bitmask = 0xc0 >> (bitoffset & 7);
+	      dither  = Floyd8x8[y & 7];
+              r0 += z;
+
+              if (fast)
+              {
+                pack_2(ptr, bitoffset, r0, 3, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --, r0 += 3)
+              {
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *ptr ^= (bitmask & OnPixels[*r0]);
+        	else
+        	  *ptr ^= (bitmask & OffPixels[*r0]);
+
+                if (bitmask > 3)
+		  bitmask >>= 2;
+		else
+		{
+		  bitmask = 0xc0;
+
+		  ptr ++;
+        	}
+	      }
+              break;
+
+          case 4 :
+              bitmask = 0xf0 >> (bitoffset & 7);
+	      dither  = Floyd4x4[y & 3];
+              r0 += z;
+
+              if (fast)
+              {
+                pack_4(ptr, bitoffset, r0, 3, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --, r0 += 3)
+              {
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *ptr ^= (bitmask & OnPixels[*r0]);
+        	else
+        	  *ptr ^= (bitmask & OffPixels[*r0]);
+
+                if (bitmask == 0xf0)
+		  bitmask = 0x0f;
+		else
+		{
+		  bitmask = 0xf0;
+
+		  ptr ++;
+        	}
+	      }
+              break;
+
+          case 8 :
+              r0 += z;
+	      r1 += z;
+
+              for (x = xsize; x > 0; x --, r0 += 3, r1 += 3)
+	      {
+        	if (*r0 == *r1)
+                  *ptr++ = *r0;
+        	else
+                  *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
+              }
+              break;
+        }
+        break;
+  }
+}
+
+
+/*
+ * 'format_CMYK()' - Convert image data to CMYK.
+ */
+
+static FORMAT_INLINE void
+format_CMYK(cups_page_header2_t *header,/* I - Page header */
+            unsigned char       *row,	/* IO - Bitmap data for device */
+	    int                 y,	/* I - Current row */
+	    int                 z,	/* I - Current plane */
+	    int                 xsize,	/* I - Width of image data */
+	    int	                ysize,	/* I - Height of image data */
+	    int                 yerr0,	/* I - Top Y error */
+	    int                 yerr1,	/* I - Bottom Y error */
+	    cups_ib_t           *r0,	/* I - Primary image data */
+	    cups_ib_t           *r1,	/* I - Image data for interpolation */
+	    int                 order,	/* I - Color order */
+	    int                 bits,	/* I - Bits per color */
+	    int                 fast)	/* I - Use packing kernels? */
+{
+  cups_ib_t	*ptr,			/* Pointer into row */
+		*cptr,			/* Pointer into cyan */
+		*mptr,			/* Pointer into magenta */
+		*yptr,			/* Pointer into yellow */
+		*kptr,			/* Pointer into black */
+		bitmask;		/* Current mask for pixel */
+  int		bitoffset;		/* Current offset in line */
+  int		bandwidth;		/* Width of a color band */
+  int		x,			/* Current X coordinate on page */
+		*dither;		/* Pointer into dither array */
+  int		pc, pm, py;		/* CMY pixels */
+
+
+  switch (XPosition)
+  {
+    case -1 :
+        bitoffset = 0;
+	break;
+    default :
+        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
+	break;
+    case 1 :
+        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
+	break;
+  }
+
+  ptr       = row + bitoffset / 8;
+  bandwidth = header->cupsBytesPerLine / 4;
+
+  switch (order)
+  {
+    case CUPS_ORDER_CHUNKED :
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 128 >> (bitoffset & 7);
+	      dither  = Floyd16x16[y & 15];
+
+              for (x = xsize ; x > 0; x --)
+              {
+	        pc = *r0++ > dither[x & 15];
+		pm = *r0++ > dither[x & 15];
+		py = *r0++ > dither[x & 15];
+
+		if (pc && pm && py)
+		{
+		  bitmask >>= 3;
+		  *ptr ^= bitmask;
+		}
+		else
+		{
+		  if (pc)
+		    *ptr ^= bitmask;
+		  bitmask >>= 1;
+
+		  if (pm)
+		    *ptr ^= bitmask;
+		  bitmask >>= 1;
+
+		  if (py)
+		    *ptr ^= bitmask;
+		  bitmask >>= 1;
+                }
+
+                if (bitmask > 1)
+		  bitmask >>= 1;
+		else
+        	{
+        	  bitmask = 128;
+        	  ptr ++;
+        	}
+              }
+              break;
+
+          case 2 :
+	      dither = Floyd8x8[y & 7];
+
+              for (x = xsize ; x > 0; x --, r0 += 4)
+              {
+	       	if ((r0[0] & 63) > dither[x & 7])
+        	  *ptr ^= (0xc0 & OnPixels[r0[0]]);
+        	else
+        	  *ptr ^= (0xc0 & OffPixels[r0[0]]);
+
+        	if ((r0[1] & 63) > dither[x & 7])
+        	  *ptr ^= (0x30 & OnPixels[r0[1]]);
+        	else
+        	  *ptr ^= (0x30 & OffPixels[r0[1]]);
+
+        	if ((r0[2] & 63) > dither[x & 7])
+        	  *ptr ^= (0x0c & OnPixels[r0[2]]);
+        	else
+        	  *ptr ^= (0x0c & OffPixels[r0[2]]);
+
+        	if ((r0[3] & 63) > dither[x & 7])
+        	  *ptr++ ^= (0x03 & OnPixels[r0[3]]);
+        	else
+        	  *ptr++ ^= (0x03 & OffPixels[r0[3]]);
+              }
+              break;
+
+          case 4 :
+	      dither = Floyd4x4[y & 3];
+
+              for (x = xsize ; x > 0; x --, r0 += 4)
+              {
+        	if ((r0[0] & 15) > dither[x & 3])
+        	  *ptr ^= (0xf0 & OnPixels[r0[0]]);
+        	else
+        	  *ptr ^= (0xf0 & OffPixels[r0[0]]);
+
+        	if ((r0[1] & 15) > dither[x & 3])
+        	  *ptr++ ^= (0x0f & OnPixels[r0[1]]);
+        	else
+        	  *ptr++ ^= (0x0f & OffPixels[r0[1]]);
+
+        	if ((r0[2] & 15) > dither[x & 3])
+        	  *ptr ^= (0xf0 & OnPixels[r0[2]]);
+        	else
+        	  *ptr ^= (0xf0 & OffPixels[r0[2]]);
+
+        	if ((r0[3] & 15) > dither[x & 3])
+        	  *ptr++ ^= (0x0f & OnPixels[r0[3]]);
+        	else
+        	  *ptr++ ^= (0x0f & OffPixels[r0[3]]);
+              }
+              break;
+
+          case 8 :
+              for (x = xsize  * 4; x > 0; x --, r0 ++, r1 ++)
+        	if (*r0 == *r1)
+                  *ptr++ = *r0;
+        	else
+                  *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
+              break;
+        }
+        break;
+
+    case CUPS_ORDER_BANDED :
+	cptr = ptr;
+	mptr = ptr + bandwidth;
+	yptr = ptr + 2 * bandwidth;
+	kptr = ptr + 3 * bandwidth;
+
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 0x80 >> (bitoffset & 7);
+	      dither  = Floyd16x16[y & 15];
+
+              for (x = xsize; x > 0; x --)
+              {
+	        pc = *r0++ > dither[x & 15];
+		pm = *r0++ > dither[x & 15];
+		py = *r0++ > dither[x & 15];
+
+		if (pc && pm && py)
+		  *kptr ^= bitmask;
+		else
+		{
+		  if (pc)
+        	    *cptr ^= bitmask;
+		  if (pm)
+        	    *mptr ^= bitmask;
+		  if (py)
+        	    *yptr ^= bitmask;
+                }
+
+                if (bitmask > 1)
+		  bitmask >>= 1;
+		else
+		{
+		  bitmask = 0x80;
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+		  kptr ++;
+        	}
+	      }
+              break;
+
+          case 2 :
+              bitmask = 0xc0 >> (bitoffset & 7);
+	      dither  = Floyd8x8[y & 7];
+
+              if (fast)
+              {
+                pack_2(cptr, bitoffset, r0, 4, xsize, dither);
+                pack_2(mptr, bitoffset, r0 + 1, 4, xsize, dither);
+                pack_2(yptr, bitoffset, r0 + 2, 4, xsize, dither);
+                pack_2(kptr, bitoffset, r0 + 3, 4, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --)
+              {
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *cptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *cptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *mptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *mptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *yptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *yptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *kptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *kptr ^= (bitmask & OffPixels[*r0++]);
+
+                if (bitmask > 3)
+		  bitmask >>= 2;
+		else
+		{
+		  bitmask = 0xc0;
+
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+		  kptr ++;
+        	}
+	      }
+              break;
+
+          case 4 :
+              bitmask = 0xf0 >> (bitoffset & 7);
+	      dither  = Floyd4x4[y & 3];
+
+              if (fast)
+              {
+                pack_4(cptr, bitoffset, r0, 4, xsize, dither);
+                pack_4(mptr, bitoffset, r0 + 1, 4, xsize, dither);
+                pack_4(yptr, bitoffset, r0 + 2, 4, xsize, dither);
+                pack_4(kptr, bitoffset, r0 + 3, 4, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --)
+              {
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *cptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *cptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *mptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *mptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *yptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *yptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *kptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *kptr ^= (bitmask & OffPixels[*r0++]);
+
+                if (bitmask == 0xf0)
+		  bitmask = 0x0f;
+		else
+		{
+		  bitmask = 0xf0;
+
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+		  kptr ++;
+        	}
+	      }
+              break;
+
+          case 8 :
+              for (x = xsize; x > 0; x --, r0 += 4, r1 += 4)
+	      {
+        	if (r0[0] == r1[0])
+                  *cptr++ = r0[0];
+        	else
+                  *cptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
+
+        	if (r0[1] == r1[1])
+                  *mptr++ = r0[1];
+        	else
+                  *mptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
+
+        	if (r0[2] == r1[2])
+                  *yptr++ = r0[2];
+        	else
+                  *yptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
+
+        	if (r0[3] == r1[3])
+                  *kptr++ = r0[3];
+        	else
+                  *kptr++ = (r0[3] * yerr0 + r1[3] * yerr1) / ysize;
+              }
+              break;
+        }
+        break;
+
+    case CUPS_ORDER_PLANAR :
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 0x80 >> (bitoffset & 7);
+	      dither  = Floyd16x16[y & 15];
+
+              for (x = xsize; x > 0; x --)
+              {
+	        pc = *r0++ > dither[x & 15];
+		pm = *r0++ > dither[x & 15];
+		py = *r0++ > dither[x & 15];
+
+		if ((pc && pm && py && z == 3) ||
+		    (pc && z == 0) || (pm && z == 1) || (py && z == 2))
+        	  *ptr ^= bitmask;
+
+                if (bitmask > 1)
+		  bitmask >>= 1;
+		else
+		{
+		  bitmask = 0x80;
+		  ptr ++;
+        	}
+	      }
+	      break;
+
+          case 2 :
+              bitmask = 0xc0 >> (bitoffset & 7);
+	      dither  = Floyd8x8[y & 7];
+              r0      += z;
+
+              if (fast)
+              {
+                pack_2(ptr, bitoffset, r0, 4, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --, r0 += 4)
+              {
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *ptr ^= (bitmask & OnPixels[*r0]);
+        	else
+        	  *ptr ^= (bitmask & OffPixels[*r0]);
+
+                if (bitmask > 3)
+		  bitmask >>= 2;
+		else
+		{
+		  bitmask = 0xc0;
+
+		  ptr ++;
+        	}
+	      }
+              break;
+
+          case 4 :
+              bitmask = 0xf0 >> (bitoffset & 7);
+	      dither  = Floyd4x4[y & 3];
+              r0 += z;
+
+              if (fast)
+              {
+                pack_4(ptr, bitoffset, r0, 4, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --, r0 += 4)
+              {
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *ptr ^= (bitmask & OnPixels[*r0]);
+        	else
+        	  *ptr ^= (bitmask & OffPixels[*r0]);
+
+                if (bitmask == 0xf0)
+		  bitmask = 0x0f;
+		else
+		{
+		  bitmask = 0xf0;
+
+		  ptr ++;
+        	}
+	      }
+              break;
+
+          case 8 :
+              r0 += z;
+	      r1 += z;
+
+              for (x = xsize; x > 0; x --, r0 += 4, r1 += 4)
+	      {
+        	if (*r0 == *r1)
+                  *ptr++ = *r0;
+        	else
+                  *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
+              }
+              break;
+        }
+        break;
+  }
+}
+
+
+/*
+ * 'format_K()' - Convert image data to black.
+ */
+
+static FORMAT_INLINE void
+format_K(cups_page_header2_t *header,	/* I - Page header */
+         unsigned char       *row,	/* IO - Bitmap data for device */
+	 int                 y,		/* I - Current row */
+	 int                 z,		/* I - Current plane */
+	 int                 xsize,	/* I - Width of image data */
+	 int	             ysize,	/* I - Height of image data */
+	 int                 yerr0,	/* I - Top Y error */
+	 int                 yerr1,	/* I - Bottom Y error */
+	 cups_ib_t           *r0,	/* I - Primary image data */
+	 cups_ib_t           *r1,	/* I - Image data for interpolation */
+	 int                 order,	/* I - Color order */
+	 int                 bits,	/* I - Bits per color */
+	 int                 fast)	/* I - Use packing kernels? */
+{
+  cups_ib_t	*ptr,			/* Pointer into row */
+		bitmask;		/* Current mask for pixel */
+  int		bitoffset;		/* Current offset in line */
+  int		x,			/* Current X coordinate on page */
+		*dither;		/* Pointer into dither array */
+
+
+  (void)z;
+  (void)order;
+
+  switch (XPosition)
+  {
+    case -1 :
+        bitoffset = 0;
+	break;
+    default :
+        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
+	break;
+    case 1 :
+        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
+	break;
+  }
+
+  ptr = row + bitoffset / 8;
+
+  switch (bits)
+  {
+    case 1 :
+        bitmask = 0x80 >> (bitoffset & 7);
+        dither  = Floyd16x16[y & 15];
+
+        if (fast)
+        {
+          pack_1(ptr, bitoffset, r0, 1, xsize, dither);
+          break;
+        }
+
+        for (x = xsize; x > 0; x --)
+        {
+          if (*r0++ > dither[x & 15])
+            *ptr ^= bitmask;
+
+          if (bitmask > 1)
+	    bitmask >>= 1;
+	  else
+	  {
+	    bitmask = 0x80;
+	    ptr ++;
+          }
+	}
+        break;
+
+    case 2 :
+        bitmask = 0xc0 >> (bitoffset & 7);
+        dither  = Floyd8x8[y & 7];
+
+        if (fast)
+        {
+          pack_2(ptr, bitoffset, r0, 1, xsize, dither);
+          break;
+        }
+
+        for (x = xsize; x > 0; x --)
+        {
+          if ((*r0 & 63) > dither[x & 7])
+            *ptr ^= (bitmask & OnPixels[*r0++]);
+          else
+            *ptr ^= (bitmask & OffPixels[*r0++]);
+
+          if (bitmask > 3)
+	    bitmask >>= 2;
+	  else
+	  {
+	    bitmask = 0xc0;
+
+	    ptr ++;
+          }
+	}
+        break;
+
+    case 4 :
+        bitmask = 0xf0 >> (bitoffset & 7);
+        dither  = Floyd4x4[y & 3];
+
+        if (fast)
+        {
+          pack_4(ptr, bitoffset, r0, 1, xsize, dither);
+          break;
+        }
+
+        for (x = xsize; x > 0; x --)
+        {
+          if ((*r0 & 15) > dither[x & 3])
+            *ptr ^= (bitmask & OnPixels[*r0++]);
+          else
+            *ptr ^= (bitmask & OffPixels[*r0++]);
+
+          if (bitmask == 0xf0)
+	    bitmask = 0x0f;
+	  else
+	  {
+	    bitmask = 0xf0;
+
+	    ptr ++;
+          }
+	}
+        break;
+
+    case 8 :
+        for (x = xsize; x > 0; x --, r0 ++, r1 ++)
+	{
+          if (*r0 == *r1)
+            *ptr++ = *r0;
+          else
+            *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
+        }
+        break;
+  }
+}
+
+
+/*
+ * 'format_KCMY()' - Convert image data to KCMY.
+ */
+
+static FORMAT_INLINE void
+format_KCMY(cups_page_header2_t *header,/* I - Page header */
+            unsigned char       *row,	/* IO - Bitmap data for device */
+	    int                 y,	/* I - Current row */
+	    int                 z,	/* I - Current plane */
+	    int                 xsize,	/* I - Width of image data */
+	    int	                ysize,	/* I - Height of image data */
+	    int                 yerr0,	/* I - Top Y error */
+	    int                 yerr1,	/* I - Bottom Y error */
+	    cups_ib_t           *r0,	/* I - Primary image data */
+	    cups_ib_t           *r1,	/* I - Image data for interpolation */
+	    int                 order,	/* I - Color order */
+	    int                 bits,	/* I - Bits per color */
+	    int                 fast)	/* I - Use packing kernels? */
+{
+  cups_ib_t	*ptr,			/* Pointer into row */
+		*cptr,			/* Pointer into cyan */
+		*mptr,			/* Pointer into magenta */
+		*yptr,			/* Pointer into yellow */
+		*kptr,			/* Pointer into black */
+		bitmask;		/* Current mask for pixel */
+  int		bitoffset;		/* Current offset in line */
+  int		bandwidth;		/* Width of a color band */
+  int		x,			/* Current X coordinate on page */
+		*dither;		/* Pointer into dither array */
+  int		pc, pm, py;		/* CMY pixels */
+
+
+  switch (XPosition)
+  {
+    case -1 :
+        bitoffset = 0;
+	break;
+    default :
+        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
+	break;
+    case 1 :
+        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
+	break;
+  }
+
+  ptr       = row + bitoffset / 8;
+  bandwidth = header->cupsBytesPerLine / 4;
+
+  switch (order)
+  {
+    case CUPS_ORDER_CHUNKED :
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 128 >> (bitoffset & 7);
+              dither  = Floyd16x16[y & 15];
+
+              for (x = xsize ; x > 0; x --)
+              {
+	        pc = *r0++ > dither[x & 15];
+		pm = *r0++ > dither[x & 15];
+		py = *r0++ > dither[x & 15];
+
+		if (pc && pm && py)
+		{
+		  *ptr ^= bitmask;
+		  bitmask >>= 3;
+		}
+		else
+		{
+		  bitmask >>= 1;
+		  if (pc)
+		    *ptr ^= bitmask;
+
+		  bitmask >>= 1;
+		  if (pm)
+		    *ptr ^= bitmask;
+
+		  bitmask >>= 1;
+		  if (py)
+		    *ptr ^= bitmask;
+                }
+
+                if (bitmask > 1)
+		  bitmask >>= 1;
+		else
+        	{
+        	  bitmask = 128;
+        	  ptr ++;
+        	}
+              }
+              break;
+
+          case 2 :
+              dither = Floyd8x8[y & 7];
+
+              for (x = xsize ; x > 0; x --, r0 += 4)
+              {
+	       	if ((r0[3] & 63) > dither[x & 7])
+        	  *ptr ^= (0xc0 & OnPixels[r0[3]]);
+        	else
+        	  *ptr ^= (0xc0 & OffPixels[r0[3]]);
+
+        	if ((r0[0] & 63) > dither[x & 7])
+        	  *ptr ^= (0x30 & OnPixels[r0[0]]);
+        	else
+        	  *ptr ^= (0x30 & OffPixels[r0[0]]);
+
+        	if ((r0[1] & 63) > dither[x & 7])
+        	  *ptr ^= (0x0c & OnPixels[r0[1]]);
+        	else
+        	  *ptr ^= (0x0c & OffPixels[r0[1]]);
+
+        	if ((r0[2] & 63) > dither[x & 7])
+        	  *ptr++ ^= (0x03 & OnPixels[r0[2]]);
+        	else
+        	  *ptr++ ^= (0x03 & OffPixels[r0[2]]);
+              }
+              break;
+
+          case 4 :
+              dither = Floyd4x4[y & 3];
+
+              for (x = xsize ; x > 0; x --, r0 += 4)
+              {
+        	if ((r0[3] & 15) > dither[x & 3])
+        	  *ptr ^= (0xf0 & OnPixels[r0[3]]);
+        	else
+        	  *ptr ^= (0xf0 & OffPixels[r0[3]]);
+
+        	if ((r0[0] & 15) > dither[x & 3])
+        	  *ptr++ ^= (0x0f & OnPixels[r0[0]]);
+        	else
+        	  *ptr++ ^= (0x0f & OffPixels[r0[0]]);
+
+        	if ((r0[1] & 15) > dither[x & 3])
+        	  *ptr ^= (0xf0 & OnPixels[r0[1]]);
+        	else
+        	  *ptr ^= (0xf0 & OffPixels[r0[1]]);
+
+        	if ((r0[2] & 15) > dither[x & 3])
+        	  *ptr++ ^= (0x0f & OnPixels[r0[2]]);
+        	else
+        	  *ptr++ ^= (0x0f & OffPixels[r0[2]]);
+              }
+              break;
+
+          case 8 :
+              for (x = xsize; x > 0; x --, r0 += 4, r1 += 4)
+	      {
+        	if (r0[3] == r1[3])
+                  *ptr++ = r0[3];
+        	else
+                  *ptr++ = (r0[3] * yerr0 + r1[3] * yerr1) / ysize;
+
+        	if (r0[0] == r1[0])
+                  *ptr++ = r0[0];
+        	else
+                  *ptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
+
+        	if (r0[1] == r1[1])
+                  *ptr++ = r0[1];
+        	else
+                  *ptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
+
+        	if (r0[2] == r1[2])
+                  *ptr++ = r0[2];
+        	else
+                  *ptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
+              }
+              break;
+        }
+        break;
+
+    case CUPS_ORDER_BANDED :
+	kptr = ptr;
+	cptr = ptr + bandwidth;
+	mptr = ptr + 2 * bandwidth;
+	yptr = ptr + 3 * bandwidth;
+
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 0x80 >> (bitoffset & 7);
+              dither  = Floyd16x16[y & 15];
+
+              for (x = xsize; x > 0; x --)
+              {
+	        pc = *r0++ > dither[x & 15];
+		pm = *r0++ > dither[x & 15];
+		py = *r0++ > dither[x & 15];
+
+		if (pc && pm && py)
+		  *kptr ^= bitmask;
+		else
+		{
+		  if (pc)
+        	    *cptr ^= bitmask;
+		  if (pm)
+        	    *mptr ^= bitmask;
+		  if (py)
+        	    *yptr ^= bitmask;
+                }
+
+                if (bitmask > 1)
+		  bitmask >>= 1;
+		else
+		{
+		  bitmask = 0x80;
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+		  kptr ++;
+        	}
+	      }
+              break;
+
+          case 2 :
+              bitmask = 0xc0 >> (bitoffset & 7);
+              dither  = Floyd8x8[y & 7];
+
+              if (fast)
+              {
+                pack_2(cptr, bitoffset, r0, 4, xsize, dither);
+                pack_2(mptr, bitoffset, r0 + 1, 4, xsize, dither);
+                pack_2(yptr, bitoffset, r0 + 2, 4, xsize, dither);
+                pack_2(kptr, bitoffset, r0 + 3, 4, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --)
+              {
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *cptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *cptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *mptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *mptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *yptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *yptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *kptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *kptr ^= (bitmask & OffPixels[*r0++]);
+
+                if (bitmask > 3)
+		  bitmask >>= 2;
+		else
+		{
+		  bitmask = 0xc0;
+
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+		  kptr ++;
+        	}
+	      }
+              break;
+
+          case 4 :
+              bitmask = 0xf0 >> (bitoffset & 7);
+              dither  = Floyd4x4[y & 3];
+
+              if (fast)
+              {
+                pack_4(cptr, bitoffset, r0, 4, xsize, dither);
+                pack_4(mptr, bitoffset, r0 + 1, 4, xsize, dither);
+                pack_4(yptr, bitoffset, r0 + 2, 4, xsize, dither);
+                pack_4(kptr, bitoffset, r0 + 3, 4, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --)
+              {
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *cptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *cptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *mptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *mptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *yptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *yptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *kptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *kptr ^= (bitmask & OffPixels[*r0++]);
+
+                if (bitmask == 0xf0)
+		  bitmask = 0x0f;
+		else
+		{
+		  bitmask = 0xf0;
+
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+		  kptr ++;
+        	}
+	      }
+              break;
+
+          case 8 :
+              for (x = xsize; x > 0; x --, r0 += 4, r1 += 4)
+	      {
+        	if (r0[0] == r1[0])
+                  *cptr++ = r0[0];
+        	else
+                  *cptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
+
+        	if (r0[1] == r1[1])
+                  *mptr++ = r0[1];
+        	else
+                  *mptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
+
+        	if (r0[2] == r1[2])
+                  *yptr++ = r0[2];
+        	else
+                  *yptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
+
+        	if (r0[3] == r1[3])
+                  *kptr++ = r0[3];
+        	else
+                  *kptr++ = (r0[3] * yerr0 + r1[3] * yerr1) / ysize;
+              }
+              break;
+        }
+        break;
+
+    case CUPS_ORDER_PLANAR :
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 0x80 >> (bitoffset & 7);
+              dither  = Floyd16x16[y & 15];
+
+              for (x = xsize; x > 0; x --)
+              {
+	        pc = *r0++ > dither[x & 15];
+		pm = *r0++ > dither[x & 15];
+		py = *r0++ > dither[x & 15];
+
+		if ((pc && pm && py && z == 0) ||
+		    (pc && z == 1) || (pm && z == 2) || (py && z == 3))
+        	  *ptr ^= bitmask;
+
+                if (bitmask > 1)
+		  bitmask >>= 1;
+		else
+		{
+		  bitmask = 0x80;
+		  ptr ++;
+        	}
+	      }
+	      break;
+
+          case 2 :
+              bitmask = 0xc0 >> (bitoffset & 7);
+              dither  = Floyd8x8[y & 7];
+              if (z == 0)
+	        r0 += 3;
+	      else
+	        r0 += z - 1;
+
+              if (fast)
+              {
+                pack_2(ptr, bitoffset, r0, 4, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --, r0 += 4)
+              {
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *ptr ^= (bitmask & OnPixels[*r0]);
+        	else
+        	  *ptr ^= (bitmask & OffPixels[*r0]);
+
+                if (bitmask > 3)
+		  bitmask >>= 2;
+		else
+		{
+		  bitmask = 0xc0;
+
+		  ptr ++;
+        	}
+	      }
+              break;
+
+          case 4 :
+              bitmask = 0xf0 >> (bitoffset & 7);
+              dither  = Floyd4x4[y & 3];
+              if (z == 0)
+	        r0 += 3;
+	      else
+	        r0 += z - 1;
+
+              if (fast)
+              {
+                pack_4(ptr, bitoffset, r0, 4, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --, r0 += 4)
+              {
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *ptr ^= (bitmask & OnPixels[*r0]);
+        	else
+        	  *ptr ^= (bitmask & OffPixels[*r0]);
+
+                if (bitmask == 0xf0)
+		  bitmask = 0x0f;
+		else
+		{
+		  bitmask = 0xf0;
+
+		  ptr ++;
+        	}
+	      }
+              break;
+
+          case 8 :
+              if (z == 0)
+	      {
+	        r0 += 3;
+	        r1 += 3;
+	      }
+	      else
+	      {
+	        r0 += z - 1;
+	        r1 += z - 1;
+	      }
+
+              for (x = xsize; x > 0; x --, r0 += 4, r1 += 4)
+	      {
+        	if (*r0 == *r1)
+                  *ptr++ = *r0;
+        	else
+                  *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
+              }
+              break;
+        }
+        break;
+  }
+}
+
+
+/*
+ * 'format_KCMYcm()' - Convert image data to KCMYcm.
+ */
+
+static FORMAT_INLINE void
+format_KCMYcm(
+    cups_page_header2_t *header,	/* I - Page header */
+    unsigned char       *row,		/* IO - Bitmap data for device */
+    int                 y,		/* I - Current row */
+    int                 z,		/* I - Current plane */
+    int                 xsize,		/* I - Width of image data */
+    int                 ysize,		/* I - Height of image data */
+    int                 yerr0,		/* I - Top Y error */
+    int                 yerr1,		/* I - Bottom Y error */
+    cups_ib_t           *r0,		/* I - Primary image data */
+    cups_ib_t           *r1,		/* I - Image data for interpolation */
+    int                 order,		/* I - Color order */
+    int                 bits,		/* I - Bits per color */
+    int                 fast)		/* I - Use packing kernels? */
+{
+  int		pc, pm, py, pk;		/* Cyan, magenta, yellow, and black values */
+  cups_ib_t	*ptr,			/* Pointer into row */
+		*cptr,			/* Pointer into cyan */
+		*mptr,			/* Pointer into magenta */
+		*yptr,			/* Pointer into yellow */
+		*kptr,			/* Pointer into black */
+		*lcptr,			/* Pointer into light cyan */
+		*lmptr,			/* Pointer into light magenta */
+		bitmask;		/* Current mask for pixel */
+  int		bitoffset;		/* Current offset in line */
+  int		bandwidth;		/* Width of a color band */
+  int		x,			/* Current X coordinate on page */
+		*dither;		/* Pointer into dither array */
+
+
+  (void)bits;
+  (void)fast;
+
+  switch (XPosition)
+  {
+    case -1 :
+        bitoffset = 0;
+	break;
+    default :
+        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
+	break;
+    case 1 :
+        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
+	break;
+  }
+
+  ptr       = row + bitoffset / 8;
+  bandwidth = header->cupsBytesPerLine / 6;
+
+  switch (order)
+  {
+    case CUPS_ORDER_CHUNKED :
+        dither = Floyd16x16[y & 15];
+
+        for (x = xsize ; x > 0; x --)
+        {
+	  pc = *r0++ > dither[x & 15];
+	  pm = *r0++ > dither[x & 15];
+	  py = *r0++ > dither[x & 15];
+	  pk = pc && pm && py;
+
+	  if (pk)
+	    *ptr++ ^= 32;	/* Black */
+	  else if (pc && pm)
+	    *ptr++ ^= 17;	/* Blue (cyan + light magenta) */
+	  else if (pc && py)
+	    *ptr++ ^= 6;	/* Green (light cyan + yellow) */
+	  else if (pm && py)
+	    *ptr++ ^= 12;	/* Red (magenta + yellow) */
+	  else if (pc)
+	    *ptr++ ^= 16;
+	  else if (pm)
+	    *ptr++ ^= 8;
+	  else if (py)
+	    *ptr++ ^= 4;
+	  else
+	    ptr ++;
+        }
+        break;
+
+    case CUPS_ORDER_BANDED :
+	kptr  = ptr;
+	cptr  = ptr + bandwidth;
+	mptr  = ptr + 2 * bandwidth;
+	yptr  = ptr + 3 * bandwidth;
+	lcptr = ptr + 4 * bandwidth;
+	lmptr = ptr + 5 * bandwidth;
+
+        bitmask = 0x80 >> (bitoffset & 7);
+        dither  = Floyd16x16[y & 15];
+
+        for (x = xsize; x > 0; x --)
+        {
+	  pc = *r0++ > dither[x & 15];
+	  pm = *r0++ > dither[x & 15];
+	  py = *r0++ > dither[x & 15];
+	  pk = pc && pm && py;
+
+	  if (pk)
+	    *kptr ^= bitmask;	/* Black */
+	  else if (pc && pm)
+	  {
+	    *cptr ^= bitmask;	/* Blue (cyan + light magenta) */
+	    *lmptr ^= bitmask;
+	  }
+	  else if (pc && py)
+	  {
+	    *lcptr ^= bitmask;	/* Green (light cyan + yellow) */
+	    *yptr  ^= bitmask;
+	  }
+	  else if (pm && py)
+	  {
+	    *mptr ^= bitmask;	/* Red (magenta + yellow) */
+	    *yptr ^= bitmask;
+	  }
+	  else if (pc)
+	    *cptr ^= bitmask;
+	  else if (pm)
+	    *mptr ^= bitmask;
+	  else if (py)
+	    *yptr ^= bitmask;
+
+          if (bitmask > 1)
+	    bitmask >>= 1;
+	  else
+	  {
+	    bitmask = 0x80;
+	    cptr ++;
+	    mptr ++;
+	    yptr ++;
+	    kptr ++;
+	    lcptr ++;
+	    lmptr ++;
+          }
+	}
+        break;
+
+    case CUPS_ORDER_PLANAR :
+        bitmask = 0x80 >> (bitoffset & 7);
+        dither  = Floyd16x16[y & 15];
+
+        for (x = xsize; x > 0; x --)
+        {
+	  pc = *r0++ > dither[x & 15];
+	  pm = *r0++ > dither[x & 15];
+	  py = *r0++ > dither[x & 15];
+	  pk = pc && pm && py;
+
+          if (pk && z == 0)
+            *ptr ^= bitmask;
+	  else if (pc && pm && (z == 1 || z == 5))
+	    *ptr ^= bitmask;	/* Blue (cyan + light magenta) */
+	  else if (pc && py && (z == 3 || z == 4))
+	    *ptr ^= bitmask;	/* Green (light cyan + yellow) */
+	  else if (pm && py && (z == 2 || z == 3))
+	    *ptr ^= bitmask;	/* Red (magenta + yellow) */
+	  else if (pc && z == 1)
+	    *ptr ^= bitmask;
+	  else if (pm && z == 2)
+	    *ptr ^= bitmask;
+	  else if (py && z == 3)
+	    *ptr ^= bitmask;
+
+          if (bitmask > 1)
+	    bitmask >>= 1;
+	  else
+	  {
+	    bitmask = 0x80;
+	    ptr ++;
+          }
+	}
+        break;
+  }
+}
+
+
+/*
+ * 'format_RGBA()' - Convert image data to RGBA/RGBW.
+ */
+
+static FORMAT_INLINE void
+format_RGBA(cups_page_header2_t *header,/* I - Page header */
+            unsigned char       *row,	/* IO - Bitmap data for device */
+	    int                 y,	/* I - Current row */
+	    int                 z,	/* I - Current plane */
+	    int                 xsize,	/* I - Width of image data */
+	    int	                ysize,	/* I - Height of image data */
+	    int                 yerr0,	/* I - Top Y error */
+	    int                 yerr1,	/* I - Bottom Y error */
+	    cups_ib_t           *r0,	/* I - Primary image data */
+	    cups_ib_t           *r1,	/* I - Image data for interpolation */
+	    int                 order,	/* I - Color order */
+	    int                 bits,	/* I - Bits per color */
+	    int                 fast)	/* I - Use packing kernels? */
+{
+  cups_ib_t	*ptr,			/* Pointer into row */
+		*cptr,			/* Pointer into cyan */
+		*mptr,			/* Pointer into magenta */
+		*yptr,			/* Pointer into yellow */
+		bitmask;		/* Current mask for pixel */
+  int		bitoffset;		/* Current offset in line */
+  int		bandwidth;		/* Width of a color band */
+  int		x,			/* Current X coordinate on page */
+		*dither;		/* Pointer into dither array */
+
+
+  switch (XPosition)
+  {
+    case -1 :
+        bitoffset = 0;
+	break;
+    default :
+        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
+	break;
+    case 1 :
+        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
+	break;
+  }
+
+  ptr       = row + bitoffset / 8;
+  bandwidth = header->cupsBytesPerLine / 4;
+
+  switch (order)
+  {
+    case CUPS_ORDER_CHUNKED :
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 128 >> (bitoffset & 7);
+	      dither  = Floyd16x16[y & 15];
+
+              for (x = xsize ; x > 0; x --)
+              {
+	        if (*r0++ > dither[x & 15])
+		  *ptr ^= bitmask;
+		bitmask >>= 1;
+
+	        if (*r0++ > dither[x & 15])
+		  *ptr ^= bitmask;
+		bitmask >>= 1;
+
+	        if (*r0++ > dither[x & 15])
+		  *ptr ^= bitmask;
+
+                if (bitmask > 2)
+		  bitmask >>= 2;
+		else
+        	{
+        	  bitmask = 128;
+        	  ptr ++;
+        	}
+              }
+              break;
+
+          case 2 :
+	      dither = Floyd8x8[y & 7];
+
+              for (x = xsize ; x > 0; x --, r0 += 3)
+              {
+	       	if ((r0[0] & 63) > dither[x & 7])
+        	  *ptr ^= (0xc0 & OnPixels[r0[0]]);
+        	else
+        	  *ptr ^= (0xc0 & OffPixels[r0[0]]);
+
+        	if ((r0[1] & 63) > dither[x & 7])
+        	  *ptr ^= (0x30 & OnPixels[r0[1]]);
+        	else
+        	  *ptr ^= (0x30 & OffPixels[r0[1]]);
+
+        	if ((r0[2] & 63) > dither[x & 7])
+        	  *ptr ^= (0x0c & OnPixels[r0[2]]);
+        	else
+        	  *ptr ^= (0x0c & OffPixels[r0[2]]);
+
+                ptr ++;
+              }
+              break;
+
+          case 4 :
+	      dither = Floyd4x4[y & 3];
+
+              for (x = xsize ; x > 0; x --, r0 += 3)
+              {
+        	if ((r0[0] & 15) > dither[x & 3])
+        	  *ptr ^= (0xf0 & OnPixels[r0[0]]);
+        	else
+        	  *ptr ^= (0xf0 & OffPixels[r0[0]]);
+
+        	if ((r0[1] & 15) > dither[x & 3])
+        	  *ptr++ ^= (0x0f & OnPixels[r0[1]]);
+        	else
+        	  *ptr++ ^= (0x0f & OffPixels[r0[1]]);
+
+        	if ((r0[2] & 15) > dither[x & 3])
+        	  *ptr ^= (0xf0 & OnPixels[r0[2]]);
+        	else
+        	  *ptr ^= (0xf0 & OffPixels[r0[2]]);
+
+                ptr ++;
+              }
+              break;
+
+          case 8 :
+              for (x = xsize; x > 0; x --, r0 += 3, r1 += 3)
+	      {
+        	if (r0[0] == r1[0])
+                  *ptr++ = r0[0];
+        	else
+                  *ptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
+
+        	if (r0[1] == r1[1])
+                  *ptr++ = r0[1];
+        	else
+                  *ptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
+
+        	if (r0[2] == r1[2])
+                  *ptr++ = r0[2];
+        	else
+                  *ptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
+
+                ptr ++;
+              }
+	      break;
+        }
+        break;
+
+    case CUPS_ORDER_BANDED :
+	cptr = ptr;
+	mptr = ptr + bandwidth;
+	yptr = ptr + 2 * bandwidth;
+
+        memset(ptr + 3 * bandwidth, 255, bandwidth);
+
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 0x80 >> (bitoffset & 7);
+	      dither  = Floyd16x16[y & 15];
+
+              if (fast)
+              {
+                pack_1(cptr, bitoffset, r0, 3, xsize, dither);
+                pack_1(mptr, bitoffset, r0 + 1, 3, xsize, dither);
+                pack_1(yptr, bitoffset, r0 + 2, 3, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --)
+              {
+        	if (*r0++ > dither[x & 15])
+        	  *cptr ^= bitmask;
+        	if (*r0++ > dither[x & 15])
+        	  *mptr ^= bitmask;
+        	if (*r0++ > dither[x & 15])
+        	  *yptr ^= bitmask;
+
+                if (bitmask > 1)
+		  bitmask >>= 1;
+		else
+		{
+		  bitmask = 0x80;
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+        	}
+	      }
+              break;
+
+          case 2 :
+              bitmask = 0xc0 >> (bitoffset & 7);
+	      dither  = Floyd8x8[y & 7];
+
+              if (fast)
+              {
+                pack_2(cptr, bitoffset, r0, 3, xsize, dither);
+                pack_2(mptr, bitoffset, r0 + 1, 3, xsize, dither);
+                pack_2(yptr, bitoffset, r0 + 2, 3, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --)
+              {
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *cptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *cptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *mptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *mptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *yptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *yptr ^= (bitmask & OffPixels[*r0++]);
+
+                if (bitmask > 3)
+		  bitmask >>= 2;
+		else
+		{
+		  bitmask = 0xc0;
+
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+        	}
+	      }
+              break;
+
+          case 4 :
+              bitmask = 0xf0 >> (bitoffset & 7);
+	      dither  = Floyd4x4[y & 3];
+
+              if (fast)
+              {
+                pack_4(cptr, bitoffset, r0, 3, xsize, dither);
+                pack_4(mptr, bitoffset, r0 + 1, 3, xsize, dither);
+                pack_4(yptr, bitoffset, r0 + 2, 3, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --)
+              {
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *cptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *cptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *mptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *mptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *yptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *yptr ^= (bitmask & OffPixels[*r0++]);
+
+                if (bitmask == 0xf0)
+		  bitmask = 0x0f;
+		else
+		{
+		  bitmask = 0xf0;
+
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+        	}
+	      }
+              break;
+
+          case 8 :
+              for (x = xsize; x > 0; x --, r0 += 3, r1 += 3)
+	      {
+        	if (r0[0] == r1[0])
+                  *cptr++ = r0[0];
+        	else
+                  *cptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
+
+        	if (r0[1] == r1[1])
+                  *mptr++ = r0[1];
+        	else
+                  *mptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
+
+        	if (r0[2] == r1[2])
+                  *yptr++ = r0[2];
+        	else
+                  *yptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
+              }
+              break;
+        }
+        break;
+
+    case CUPS_ORDER_PLANAR :
+        if (z == 3)
+	{
+          memset(row, 255, header->cupsBytesPerLine);
+	  break;
+        }
+
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 0x80 >> (bitoffset & 7);
+	      dither  = Floyd16x16[y & 15];
+
+              if (fast)
+              {
+                pack_1(ptr, bitoffset, r0 + z, 3, xsize, dither);
+                break;
+              }
+
+              switch (z)
+	      {
+	        case 0 :
+        	    for (x = xsize; x > 0; x --, r0 += 3)
+        	    {
+        	      if (r0[0] > dither[x & 15])
+        		*ptr ^= bitmask;
+
+                      if (bitmask > 1)
+			bitmask >>= 1;
+		      else
+		      {
+			bitmask = 0x80;
+			ptr ++;
+        	      }
+	            }
+		    break;
+
+	        case 1 :
+        	    for (x = xsize; x > 0; x --, r0 += 3)
+        	    {
+        	      if (r0[1] > dither[x & 15])
+        		*ptr ^= bitmask;
+
+                      if (bitmask > 1)
+			bitmask >>= 1;
+		      else
+		      {
+			bitmask = 0x80;
+			ptr ++;
+        	      }
+	            }
+		    break;
+
+	        case 2 :
+        	    for (x = xsize; x > 0; x --, r0 += 3)
+        	    {
+        	      if (r0[2] > dither[x & 15])
+        		*ptr ^= bitmask;
+
+                      if (bitmask > 1)
+			bitmask >>= 1;
+		      else
+		      {
+			bitmask = 0x80;
+			ptr ++;
+        	      }
+	            }
+		    break;
+	      }
+              break;
+
+          case 2 :
+              bitmask = 0xc0 >> (bitoffset & 7);
+	      dither  = Floyd8x8[y & 7];
+              r0 += z;
+
+              if (fast)
+              {
+                pack_2(ptr, bitoffset, r0, 3, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --, r0 += 3)
+              {
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *ptr ^= (bitmask & OnPixels[*r0]);
+        	else
+        	  *ptr ^= (bitmask & OffPixels[*r0]);
+
+                if (bitmask > 3)
+		  bitmask >>= 2;
+		else
+		{
+		  bitmask = 0xc0;
+
+		  ptr ++;
+        	}
+	      }
+              break;
+
+          case 4 :
+              bitmask = 0xf0 >> (bitoffset & 7);
+	      dither  = Floyd4x4[y & 3];
+              r0 += z;
+
+              if (fast)
+              {
+                pack_4(ptr, bitoffset, r0, 3, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --, r0 += 3)
+              {
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *ptr ^= (bitmask & OnPixels[*r0]);
+        	else
+        	  *ptr ^= (bitmask & OffPixels[*r0]);
+
+                if (bitmask == 0xf0)
+		  bitmask = 0x0f;
+		else
+		{
+		  bitmask = 0xf0;
+
+		  ptr ++;
+        	}
+	      }
+              break;
+
+          case 8 :
+              r0 += z;
+	      r1 += z;
+
+              for (x = xsize; x > 0; x --, r0 += 3, r1 += 3)
+	      {
+        	if (*r0 == *r1)
+                  *ptr++ = *r0;
+        	else
+                  *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
+              }
+              break;
+        }
+        break;
+  }
+}
+
+
+/*
+ * 'format_W()' - Convert image data to luminance.
+ */
+
+static FORMAT_INLINE void
+format_W(cups_page_header2_t *header,	/* I - Page header */
+            unsigned char    *row,	/* IO - Bitmap data for device */
+	    int              y,		/* I - Current row */
+	    int              z,		/* I - Current plane */
+	    int              xsize,	/* I - Width of image data */
+	    int	             ysize,	/* I - Height of image data */
+	    int              yerr0,	/* I - Top Y error */
+	    int              yerr1,	/* I - Bottom Y error */
+	    cups_ib_t        *r0,	/* I - Primary image data */
+	    cups_ib_t        *r1,	/* I - Image data for interpolation */
+	    int              order,	/* I - Color order */
+	    int              bits,	/* I - Bits per color */
+	    int              fast)	/* I - Use packing kernels? */
+{
+  cups_ib_t	*ptr,			/* Pointer into row */
+		bitmask;		/* Current mask for pixel */
+  int		bitoffset;		/* Current offset in line */
+  int		x,			/* Current X coordinate on page */
+		*dither;		/* Pointer into dither array */
+
+
+  (void)z;
+  (void)order;
+
+  switch (XPosition)
+  {
+    case -1 :
+        bitoffset = 0;
+	break;
+    default :
+        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
+	break;
+    case 1 :
+        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
+	break;
+  }
+
+  ptr = row + bitoffset / 8;
+
+  switch (bits)
+  {
+    case 1 :
+        bitmask = 0x80 >> (bitoffset & 7);
+        dither  = Floyd16x16[y & 15];
+
+        if (fast)
+        {
+          pack_1(ptr, bitoffset, r0, 1, xsize, dither);
+          break;
+        }
+
+        for (x = xsize; x > 0; x --)
+        {
+          if (*r0++ > dither[x & 15])
+            *ptr ^= bitmask;
+
+          if (bitmask > 1)
+	    bitmask >>= 1;
+	  else
+	  {
+	    bitmask = 0x80;
+	    ptr ++;
+          }
+	}
+        break;
+
+    case 2 :
+        bitmask = 0xc0 >> (bitoffset & 7);
+        dither  = Floyd8x8[y & 7];
+
+        if (fast)
+        {
+          pack_2(ptr, bitoffset, r0, 1, xsize, dither);
+          break;
+        }
+
+        for (x = xsize; x > 0; x --)
+        {
+          if ((*r0 & 63) > dither[x & 7])
+            *ptr ^= (bitmask & OnPixels[*r0++]);
+          else
+            *ptr ^= (bitmask & OffPixels[*r0++]);
+
+          if (bitmask > 3)
+	    bitmask >>= 2;
+	  else
+	  {
+	    bitmask = 0xc0;
+
+	    ptr ++;
+          }
+	}
+        break;
+
+    case 4 :
+        bitmask = 0xf0 >> (bitoffset & 7);
+        dither  = Floyd4x4[y & 3];
+
+        if (fast)
+        {
+          pack_4(ptr, bitoffset, r0, 1, xsize, dither);
+          break;
+        }
+
+        for (x = xsize; x > 0; x --)
+        {
+          if ((*r0 & 15) > dither[x & 3])
+            *ptr ^= (bitmask & OnPixels[*r0++]);
+          else
+            *ptr ^= (bitmask & OffPixels[*r0++]);
+
+          if (bitmask == 0xf0)
+	    bitmask = 0x0f;
+	  else
+	  {
+	    bitmask = 0xf0;
+
+	    ptr ++;
+          }
+	}
+        break;
+
+    case 8 :
+        for (x = xsize; x > 0; x --, r0 ++, r1 ++)
+	{
+          if (*r0 == *r1)
+            *ptr++ = *r0;
+          else
+            *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
+        }
+        break;
+  }
+}
+
+
+/*
+ * 'format_YMC()' - Convert image data to YMC.
+ */
+
+static FORMAT_INLINE void
+format_YMC(cups_page_header2_t *header,	/* I - Page header */
+            unsigned char      *row,	/* IO - Bitmap data for device */
+	    int                y,	/* I - Current row */
+	    int                z,	/* I - Current plane */
+	    int                xsize,	/* I - Width of image data */
+	    int	               ysize,	/* I - Height of image data */
+	    int                yerr0,	/* I - Top Y error */
+	    int                yerr1,	/* I - Bottom Y error */
+	    cups_ib_t          *r0,	/* I - Primary image data */
+	    cups_ib_t          *r1,	/* I - Image data for interpolation */
+	    int                order,	/* I - Color order */
+	    int                bits,	/* I - Bits per color */
+	    int                fast)	/* I - Use packing kernels? */
+{
+  cups_ib_t	*ptr,			/* Pointer into row */
+		*cptr,			/* Pointer into cyan */
+		*mptr,			/* Pointer into magenta */
+		*yptr,			/* Pointer into yellow */
+		bitmask;		/* Current mask for pixel */
+  int		bitoffset;		/* Current offset in line */
+  int		bandwidth;		/* Width of a color band */
+  int		x,			/* Current X coordinate on page */
+		*dither;		/* Pointer into dither array */
+
+
+  switch (XPosition)
+  {
+    case -1 :
+        bitoffset = 0;
+	break;
+    default :
+        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
+	break;
+    case 1 :
+        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
+	break;
+  }
+
+  ptr       = row + bitoffset / 8;
+  bandwidth = header->cupsBytesPerLine / 3;
+
+  switch (order)
+  {
+    case CUPS_ORDER_CHUNKED :
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 64 >> (bitoffset & 7);
+	      dither  = Floyd16x16[y & 15];
+
+              for (x = xsize ; x > 0; x --, r0 += 3)
+              {
+	        if (r0[2] > dither[x & 15])
+		  *ptr ^= bitmask;
+		bitmask >>= 1;
+
+	        if (r0[1] > dither[x & 15])
+		  *ptr ^= bitmask;
+		bitmask >>= 1;
+
+	        if (r0[0] > dither[x & 15])
+		  *ptr ^= bitmask;
+
+                if (bitmask > 1)
+		  bitmask >>= 2;
+		else
+        	{
+        	  bitmask = 64;
+        	  ptr ++;
+        	}
+              }
+              break;
+
+          case 2 :
+	      dither = Floyd8x8[y & 7];
+
+              for (x = xsize ; x > 0; x --, r0 += 3)
+              {
+	       	if ((r0[2] & 63) > dither[x & 7])
+        	  *ptr ^= (0x30 & OnPixels[r0[2]]);
+        	else
+        	  *ptr ^= (0x30 & OffPixels[r0[2]]);
+
+        	if ((r0[1] & 63) > dither[x & 7])
+        	  *ptr ^= (0x0c & OnPixels[r0[1]]);
+        	else
+        	  *ptr ^= (0x0c & OffPixels[r0[1]]);
+
+        	if ((r0[0] & 63) > dither[x & 7])
+        	  *ptr++ ^= (0x03 & OnPixels[r0[0]]);
+        	else
+        	  *ptr++ ^= (0x03 & OffPixels[r0[0]]);
+              }
+              break;
+
+          case 4 :
+	      dither = Floyd4x4[y & 3];
+
+              for (x = xsize ; x > 0; x --, r0 += 3)
+              {
+        	if ((r0[2] & 15) > dither[x & 3])
+        	  *ptr++ ^= (0x0f & OnPixels[r0[2]]);
+        	else
+        	  *ptr++ ^= (0x0f & OffPixels[r0[2]]);
+
+        	if ((r0[1] & 15) > dither[x & 3])
+        	  *ptr ^= (0xf0 & OnPixels[r0[1]]);
+        	else
+        	  *ptr ^= (0xf0 & OffPixels[r0[1]]);
+
+        	if ((r0[0] & 15) > dither[x & 3])
+        	  *ptr++ ^= (0x0f & OnPixels[r0[0]]);
+        	else
+        	  *ptr++ ^= (0x0f & OffPixels[r0[0]]);
+              }
+              break;
+
+          case 8 :
+              for (x = xsize; x > 0; x --, r0 += 3, r1 += 3)
+	      {
+        	if (r0[2] == r1[2])
+                  *ptr++ = r0[2];
+        	else
+                  *ptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
+
+        	if (r0[1] == r1[1])
+                  *ptr++ = r0[1];
+        	else
+                  *ptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
+
+        	if (r0[0] == r1[0])
+                  *ptr++ = r0[0];
+        	else
+                  *ptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
+              }
+	      break;
+        }
+        break;
+
+    case CUPS_ORDER_BANDED :
+	yptr = ptr;
+	mptr = ptr + bandwidth;
+	cptr = ptr + 2 * bandwidth;
+
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 0x80 >> (bitoffset & 7);
+	      dither  = Floyd16x16[y & 15];
+
+              if (fast)
+              {
+                pack_1(cptr, bitoffset, r0, 3, xsize, dither);
+                pack_1(mptr, bitoffset, r0 + 1, 3, xsize, dither);
+                pack_1(yptr, bitoffset, r0 + 2, 3, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --)
+              {
+        	if (*r0++ > dither[x & 15])
+        	  *cptr ^= bitmask;
+        	if (*r0++ > dither[x & 15])
+        	  *mptr ^= bitmask;
+        	if (*r0++ > dither[x & 15])
+        	  *yptr ^= bitmask;
+
+                if (bitmask > 1)
+		  bitmask >>= 1;
+		else
+		{
+		  bitmask = 0x80;
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+        	}
+	      }
+              break;
+
+          case 2 :
+              bitmask = 0xc0 >> (bitoffset & 7);
+	      dither  = Floyd8x8[y & 7];
+
+              if (fast)
+              {
+                pack_2(cptr, bitoffset, r0, 3, xsize, dither);
+                pack_2(mptr, bitoffset, r0 + 1, 3, xsize, dither);
+                pack_2(yptr, bitoffset, r0 + 2, 3, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --)
+              {
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *cptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *cptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *mptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *mptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *yptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *yptr ^= (bitmask & OffPixels[*r0++]);
+
+                if (bitmask > 3)
+		  bitmask >>= 2;
+		else
+		{
+		  bitmask = 0xc0;
+
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+        	}
+	      }
+              break;
+
+          case 4 :
+              bitmask = 0xf0 >> (bitoffset & 7);
+	      dither  = Floyd4x4[y & 3];
+
+              if (fast)
+              {
+                pack_4(cptr, bitoffset, r0, 3, xsize, dither);
+                pack_4(mptr, bitoffset, r0 + 1, 3, xsize, dither);
+                pack_4(yptr, bitoffset, r0 + 2, 3, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --)
+              {
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *cptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *cptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *mptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *mptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *yptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *yptr ^= (bitmask & OffPixels[*r0++]);
+
+                if (bitmask == 0xf0)
+		  bitmask = 0x0f;
+		else
+		{
+		  bitmask = 0xf0;
+
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+        	}
+	      }
+              break;
+
+          case 8 :
+              for (x = xsize; x > 0; x --, r0 += 3, r1 += 3)
+	      {
+        	if (r0[0] == r1[0])
+                  *cptr++ = r0[0];
+        	else
+                  *cptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
+
+        	if (r0[1] == r1[1])
+                  *mptr++ = r0[1];
+        	else
+                  *mptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
+
+        	if (r0[2] == r1[2])
+                  *yptr++ = r0[2];
+        	else
+                  *yptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
+              }
+              break;
+        }
+        break;
+
+    case CUPS_ORDER_PLANAR :
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 0x80 >> (bitoffset & 7);
+	      dither  = Floyd16x16[y & 15];
+
+              if (fast)
+              {
+                pack_1(ptr, bitoffset, r0 + 2 - z, 3, xsize, dither);
+                break;
+              }
+
+              switch (z)
+	      {
+	        case 2 :
+        	    for (x = xsize; x > 0; x --, r0 += 3)
+        	    {
+        	      if (r0[0] > dither[x & 15])
+        		*ptr ^= bitmask;
+
+                      if (bitmask > 1)
+			bitmask >>= 1;
+		      else
+		      {
+			bitmask = 0x80;
+			ptr ++;
+        	      }
+	            }
+		    break;
+
+	        case 1 :
+        	    for (x = xsize; x > 0; x --, r0 += 3)
+        	    {
+        	      if (r0[1] > dither[x & 15])
+        		*ptr ^= bitmask;
+
+                      if (bitmask > 1)
+			bitmask >>= 1;
+		      else
+		      {
+			bitmask = 0x80;
+			ptr ++;
+        	      }
+	            }
+		    break;
+
+	        case 0 :
+        	    for (x = xsize; x > 0; x --, r0 += 3)
+        	    {
+        	      if (r0[2] > dither[x & 15])
+        		*ptr ^= bitmask;
+
+                      if (bitmask > 1)
+			bitmask >>= 1;
+		      else
+		      {
+			bitmask = 0x80;
+			ptr ++;
+        	      }
+	            }
+		    break;
+	      }
+              break;
+
+          case 2 :
+              bitmask = 0xc0 >> (bitoffset & 7);
+	      dither  = Floyd8x8[y & 7];
+              z       = 2 - z;
+              r0      += z;
+
+              if (fast)
+              {
+                pack_2(ptr, bitoffset, r0, 3, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --, r0 += 3)
+              {
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *ptr ^= (bitmask & OnPixels[*r0]);
+        	else
+        	  *ptr ^= (bitmask & OffPixels[*r0]);
+
+                if (bitmask > 3)
+		  bitmask >>= 2;
+		else
+		{
+		  bitmask = 0xc0;
+
+		  ptr ++;
+        	}
+	      }
+              break;
+
+          case 4 :
+              bitmask = 0xf0 >> (bitoffset & 7);
+	      dither  = Floyd4x4[y & 3];
+              z       = 2 - z;
+              r0      += z;
+
+              if (fast)
+              {
+                pack_4(ptr, bitoffset, r0, 3, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --, r0 += 3)
+              {
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *ptr ^= (bitmask & OnPixels[*r0]);
+        	else
+        	  *ptr ^= (bitmask & OffPixels[*r0]);
+
+                if (bitmask == 0xf0)
+		  bitmask = 0x0f;
+		else
+		{
+		  bitmask = 0xf0;
+
+		  ptr ++;
+        	}
+	      }
+              break;
+
+          case 8 :
+              z  = 2 - z;
+              r0 += z;
+	      r1 += z;
+
+              for (x = xsize; x > 0; x --, r0 += 3, r1 += 3)
+	      {
+        	if (*r0 == *r1)
+                  *ptr++ = *r0;
+        	else
+                  *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
+              }
+              break;
+        }
+        break;
+  }
+}
+
+
+/*
+ * 'format_YMCK()' - Convert image data to YMCK.
+ */
+
+static FORMAT_INLINE void
+format_YMCK(cups_page_header2_t *header,/* I - Page header */
+            unsigned char       *row,	/* IO - Bitmap data for device */
+	    int                 y,	/* I - Current row */
+	    int                 z,	/* I - Current plane */
+	    int                 xsize,	/* I - Width of image data */
+	    int	                ysize,	/* I - Height of image data */
+	    int                 yerr0,	/* I - Top Y error */
+	    int                 yerr1,	/* I - Bottom Y error */
+	    cups_ib_t           *r0,	/* I - Primary image data */
+	    cups_ib_t           *r1,	/* I - Image data for interpolation */
+	    int                 order,	/* I - Color order */
+	    int                 bits,	/* I - Bits per color */
+	    int                 fast)	/* I - Use packing kernels? */
+{
+  cups_ib_t	*ptr,			/* Pointer into row */
+		*cptr,			/* Pointer into cyan */
+		*mptr,			/* Pointer into magenta */
+		*yptr,			/* Pointer into yellow */
+		*kptr,			/* Pointer into black */
+		bitmask;		/* Current mask for pixel */
+  int		bitoffset;		/* Current offset in line */
+  int		bandwidth;		/* Width of a color band */
+  int		x,			/* Current X coordinate on page */
+		*dither;		/* Pointer into dither array */
+  int		pc, pm, py;		/* CMY pixels */
+
+
+  switch (XPosition)
+  {
+    case -1 :
+        bitoffset = 0;
+	break;
+    default :
+        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
+	break;
+    case 1 :
+        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
+	break;
+  }
+
+  ptr       = row + bitoffset / 8;
+  bandwidth = header->cupsBytesPerLine / 4;
+
+  switch (order)
+  {
+    case CUPS_ORDER_CHUNKED :
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 128 >> (bitoffset & 7);
+              dither  = Floyd16x16[y & 15];
+
+              for (x = xsize ; x > 0; x --)
+              {
+	        pc = *r0++ > dither[x & 15];
+		pm = *r0++ > dither[x & 15];
+		py = *r0++ > dither[x & 15];
+
+		if (pc && pm && py)
+		{
+		  bitmask >>= 3;
+		  *ptr ^= bitmask;
+		}
+		else
+		{
+		  if (py)
+		    *ptr ^= bitmask;
+		  bitmask >>= 1;
+
+		  if (pm)
+		    *ptr ^= bitmask;
+		  bitmask >>= 1;
+
+		  if (pc)
+		    *ptr ^= bitmask;
+		  bitmask >>= 1;
+                }
+
+                if (bitmask > 1)
+		  bitmask >>= 1;
+		else
+        	{
+        	  bitmask = 128;
+
+        	  ptr ++;
+        	}
+              }
+              break;
+
+          case 2 :
+              dither = Floyd8x8[y & 7];
+
+              for (x = xsize ; x > 0; x --, r0 += 4)
+              {
+	       	if ((r0[2] & 63) > dither[x & 7])
+        	  *ptr ^= (0xc0 & OnPixels[r0[2]]);
+        	else
+        	  *ptr ^= (0xc0 & OffPixels[r0[2]]);
+
+        	if ((r0[1] & 63) > dither[x & 7])
+        	  *ptr ^= (0x30 & OnPixels[r0[1]]);
+        	else
+        	  *ptr ^= (0x30 & OffPixels[r0[1]]);
+
+        	if ((r0[0] & 63) > dither[x & 7])
+        	  *ptr ^= (0x0c & OnPixels[r0[0]]);
+        	else
+        	  *ptr ^= (0x0c & OffPixels[r0[0]]);
+
+        	if ((r0[3] & 63) > dither[x & 7])
+        	  *ptr++ ^= (0x03 & OnPixels[r0[3]]);
+        	else
+        	  *ptr++ ^= (0x03 & OffPixels[r0[3]]);
+              }
+              break;
+
+          case 4 :
+              dither = Floyd4x4[y & 3];
+
+              for (x = xsize ; x > 0; x --, r0 += 4)
+              {
+        	if ((r0[2] & 15) > dither[x & 3])
+        	  *ptr ^= (0xf0 & OnPixels[r0[2]]);
+        	else
+        	  *ptr ^= (0xf0 & OffPixels[r0[2]]);
+
+        	if ((r0[1] & 15) > dither[x & 3])
+        	  *ptr++ ^= (0x0f & OnPixels[r0[1]]);
+        	else
+        	  *ptr++ ^= (0x0f & OffPixels[r0[1]]);
+
+        	if ((r0[0] & 15) > dither[x & 3])
+        	  *ptr ^= (0xf0 & OnPixels[r0[0]]);
+        	else
+        	  *ptr ^= (0xf0 & OffPixels[r0[0]]);
+
+        	if ((r0[3] & 15) > dither[x & 3])
+        	  *ptr++ ^= (0x0f & OnPixels[r0[3]]);
+        	else
+        	  *ptr++ ^= (0x0f & OffPixels[r0[3]]);
+              }
+              break;
+
+          case 8 :
+              for (x = xsize; x > 0; x --, r0 += 4, r1 += 4)
+	      {
+        	if (r0[2] == r1[2])
+                  *ptr++ = r0[2];
+        	else
+                  *ptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
+
+        	if (r0[1] == r1[1])
+                  *ptr++ = r0[1];
+        	else
+                  *ptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
+
+        	if (r0[0] == r1[0])
+                  *ptr++ = r0[0];
+        	else
+                  *ptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
+
+        	if (r0[3] == r1[3])
+                  *ptr++ = r0[3];
+        	else
+                  *ptr++ = (r0[3] * yerr0 + r1[3] * yerr1) / ysize;
+              }
+              break;
+        }
+        break;
+
+    case CUPS_ORDER_BANDED :
+	yptr = ptr;
+	mptr = ptr + bandwidth;
+	cptr = ptr + 2 * bandwidth;
+	kptr = ptr + 3 * bandwidth;
+
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 0x80 >> (bitoffset & 7);
+              dither  = Floyd16x16[y & 15];
+
+              for (x = xsize; x > 0; x --)
+              {
+	        pc = *r0++ > dither[x & 15];
+		pm = *r0++ > dither[x & 15];
+		py = *r0++ > dither[x & 15];
+
+		if (pc && pm && py)
+		  *kptr ^= bitmask;
+		else
+		{
+		  if (pc)
+        	    *cptr ^= bitmask;
+		  if (pm)
+        	    *mptr ^= bitmask;
+		  if (py)
+        	    *yptr ^= bitmask;
+                }
+
+                if (bitmask > 1)
+		  bitmask >>= 1;
+		else
+		{
+		  bitmask = 0x80;
+
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+		  kptr ++;
+        	}
+	      }
+              break;
+
+          case 2 :
+              bitmask = 0xc0 >> (bitoffset & 7);
+              dither  = Floyd8x8[y & 7];
+
+              if (fast)
+              {
+                pack_2(cptr, bitoffset, r0, 4, xsize, dither);
+                pack_2(mptr, bitoffset, r0 + 1, 4, xsize, dither);
+                pack_2(yptr, bitoffset, r0 + 2, 4, xsize, dither);
+                pack_2(kptr, bitoffset, r0 + 3, 4, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --)
+              {
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *cptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *cptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *mptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *mptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *yptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *yptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *kptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *kptr ^= (bitmask & OffPixels[*r0++]);
+
+                if (bitmask > 3)
+		  bitmask >>= 2;
+		else
+		{
+		  bitmask = 0xc0;
+
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+		  kptr ++;
+        	}
+	      }
+              break;
+
+          case 4 :
+              bitmask = 0xf0 >> (bitoffset & 7);
+              dither  = Floyd4x4[y & 3];
+
+              if (fast)
+              {
+                pack_4(cptr, bitoffset, r0, 4, xsize, dither);
+                pack_4(mptr, bitoffset, r0 + 1, 4, xsize, dither);
+                pack_4(yptr, bitoffset, r0 + 2, 4, xsize, dither);
+                pack_4(kptr, bitoffset, r0 + 3, 4, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --)
+              {
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *cptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *cptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *mptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *mptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *yptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *yptr ^= (bitmask & OffPixels[*r0++]);
+
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *kptr ^= (bitmask & OnPixels[*r0++]);
+        	else
+        	  *kptr ^= (bitmask & OffPixels[*r0++]);
+
+                if (bitmask == 0xf0)
+		  bitmask = 0x0f;
+		else
+		{
+		  bitmask = 0xf0;
+
+		  cptr ++;
+		  mptr ++;
+		  yptr ++;
+		  kptr ++;
+        	}
+	      }
+              break;
+
+          case 8 :
+              for (x = xsize; x > 0; x --, r0 += 4, r1 += 4)
+	      {
+        	if (r0[0] == r1[0])
+                  *cptr++ = r0[0];
+        	else
+                  *cptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
+
+        	if (r0[1] == r1[1])
+                  *mptr++ = r0[1];
+        	else
+                  *mptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
+
+        	if (r0[2] == r1[2])
+                  *yptr++ = r0[2];
+        	else
+                  *yptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
+
+        	if (r0[3] == r1[3])
+                  *kptr++ = r0[3];
+        	else
+                  *kptr++ = (r0[3] * yerr0 + r1[3] * yerr1) / ysize;
+              }
+              break;
+        }
+        break;
+
+    case CUPS_ORDER_PLANAR :
+        switch (bits)
+        {
+          case 1 :
+              bitmask = 0x80 >> (bitoffset & 7);
+              dither  = Floyd16x16[y & 15];
+
+              for (x = xsize; x > 0; x --)
+              {
+	        pc = *r0++ > dither[x & 15];
+		pm = *r0++ > dither[x & 15];
+		py = *r0++ > dither[x & 15];
+
+		if ((pc && pm && py && z == 3) ||
+		    (pc && z == 2) || (pm && z == 1) || (py && z == 0))
+        	  *ptr ^= bitmask;
+
+        	if (bitmask > 1)
+		  bitmask >>= 1;
+		else
+		{
+		  bitmask = 0x80;
+		  ptr ++;
+        	}
+	      }
+              break;
+
+          case 2 :
+              bitmask = 0xc0 >> (bitoffset & 7);
+              dither  = Floyd8x8[y & 7];
+              if (z == 3)
+	        r0 += 3;
+	      else
+	        r0 += 2 - z;
+
+              if (fast)
+              {
+                pack_2(ptr, bitoffset, r0, 4, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --, r0 += 4)
+              {
+        	if ((*r0 & 63) > dither[x & 7])
+        	  *ptr ^= (bitmask & OnPixels[*r0]);
+        	else
+        	  *ptr ^= (bitmask & OffPixels[*r0]);
+
+                if (bitmask > 3)
+		  bitmask >>= 2;
+		else
+		{
+		  bitmask = 0xc0;
+
+		  ptr ++;
+        	}
+	      }
+              break;
+
+          case 4 :
+              bitmask = 0xf0 >> (bitoffset & 7);
+              dither  = Floyd4x4[y & 3];
+              if (z == 3)
+	        r0 += 3;
+	      else
+	        r0 += 2 - z;
+
+              if (fast)
+              {
+                pack_4(ptr, bitoffset, r0, 4, xsize, dither);
+                break;
+              }
+
+              for (x = xsize; x > 0; x --, r0 += 4)
+              {
+        	if ((*r0 & 15) > dither[x & 3])
+        	  *ptr ^= (bitmask & OnPixels[*r0]);
+        	else
+        	  *ptr ^= (bitmask & OffPixels[*r0]);
+
+                if (bitmask == 0xf0)
+		  bitmask = 0x0f;
+		else
+		{
+		  bitmask = 0xf0;
+
+		  ptr ++;
+        	}
+	      }
+              break;
+
+          case 8 :
+              if (z == 3)
+	      {
+	        r0 += 3;
+	        r1 += 3;
+	      }
+	      else
+	      {
+	        r0 += 2 - z;
+	        r1 += 2 - z;
+	      }
+
+              for (x = xsize; x > 0; x --, r0 += 4, r1 += 4)
+	      {
+        	if (*r0 == *r1)
+                  *ptr++ = *r0;
+        	else
+                  *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
+              }
+              break;
+        }
+        break;
+  }
+}
+
+
+/*
+ * 'format_line()' - Format a line of raster data for the printer.
+ */
+
+void
+format_line(cups_page_header2_t *header,/* I - Page header */
+            unsigned char       *row,	/* O - Bitmap data for device */
+	    int                 y,	/* I - Current row */
+	    int                 z,	/* I - Current plane */
+	    int                 xsize,	/* I - Width of image data */
+	    int	                ysize,	/* I - Height of image data */
+	    int                 yerr0,	/* I - Top Y error */
+	    int                 yerr1,	/* I - Bottom Y error */
+	    cups_ib_t           *r0,	/* I - Primary image data */
+	    cups_ib_t           *r1)	/* I - Image data for interpolation */
+{
+  blank_line(header, row);
+
+  switch (header->cupsColorSpace)
+  {
+    case CUPS_CSPACE_W :
+	format_W(header, row, y, z, xsize, ysize, yerr0, yerr1, r0, r1,
+	         header->cupsColorOrder, header->cupsBitsPerColor, 0);
+	break;
+    default :
+    case CUPS_CSPACE_RGB :
+	format_RGB(header, row, y, z, xsize, ysize, yerr0, yerr1, r0, r1,
+	           header->cupsColorOrder, header->cupsBitsPerColor, 0);
+	break;
+    case CUPS_CSPACE_RGBA :
+    case CUPS_CSPACE_RGBW :
+	format_RGBA(header, row, y, z, xsize, ysize, yerr0, yerr1, r0, r1,
+	            header->cupsColorOrder, header->cupsBitsPerColor, 0);
+	break;
+    case CUPS_CSPACE_K :
+    case CUPS_CSPACE_WHITE :
+    case CUPS_CSPACE_GOLD :
+    case CUPS_CSPACE_SILVER :
+	format_K(header, row, y, z, xsize, ysize, yerr0, yerr1, r0, r1,
+	         header->cupsColorOrder, header->cupsBitsPerColor, 0);
+	break;
+    case CUPS_CSPACE_CMY :
+	format_CMY(header, row, y, z, xsize, ysize, yerr0, yerr1, r0, r1,
+	           header->cupsColorOrder, header->cupsBitsPerColor, 0);
+	break;
+    case CUPS_CSPACE_YMC :
+	format_YMC(header, row, y, z, xsize, ysize, yerr0, yerr1, r0, r1,
+	           header->cupsColorOrder, header->cupsBitsPerColor, 0);
+	break;
+    case CUPS_CSPACE_CMYK :
+	format_CMYK(header, row, y, z, xsize, ysize, yerr0, yerr1, r0, r1,
+	            header->cupsColorOrder, header->cupsBitsPerColor, 0);
+	break;
+    case CUPS_CSPACE_YMCK :
+    case CUPS_CSPACE_GMCK :
+    case CUPS_CSPACE_GMCS :
+	format_YMCK(header, row, y, z, xsize, ysize, yerr0, yerr1, r0, r1,
+	            header->cupsColorOrder, header->cupsBitsPerColor, 0);
+	break;
+    case CUPS_CSPACE_KCMYcm :
+	if (header->cupsBitsPerColor == 1)
+	{
+	  format_KCMYcm(header, row, y, z, xsize, ysize, yerr0, yerr1, r0,
+	                r1, header->cupsColorOrder, 1, 0);
+	  break;
+	}
+	/* fall through */
+    case CUPS_CSPACE_KCMY :
+	format_KCMY(header, row, y, z, xsize, ysize, yerr0, yerr1, r0, r1,
+	            header->cupsColorOrder, header->cupsBitsPerColor, 0);
+	break;
+  }
+}
+
+
+/*
+ * Line formatters for each colorspace, color order, and bits per color;
+ * format_select() picks one of them per page, so the color order, bit
+ * depth, and packing choice are no longer made for every line...
+ */
+
+#define FORMAT_KERNEL(func, name, order, bits)				\
+static void								\
+func ## _ ## name(cups_page_header2_t *header, unsigned char *row,	\
+                  int y, int z, int xsize, int ysize, int yerr0,	\
+		  int yerr1, cups_ib_t *r0, cups_ib_t *r1)		\
+{									\
+  blank_line(header, row);						\
+  func(header, row, y, z, xsize, ysize, yerr0, yerr1, r0, r1, order,	\
+       bits, 1);							\
+}
+
+#define FORMAT_KERNELS(func)						\
+FORMAT_KERNEL(func, c1, CUPS_ORDER_CHUNKED, 1)				\
+FORMAT_KERNEL(func, c2, CUPS_ORDER_CHUNKED, 2)				\
+FORMAT_KERNEL(func, c4, CUPS_ORDER_CHUNKED, 4)				\
+FORMAT_KERNEL(func, c8, CUPS_ORDER_CHUNKED, 8)				\
+FORMAT_KERNEL(func, b1, CUPS_ORDER_BANDED, 1)				\
+FORMAT_KERNEL(func, b2, CUPS_ORDER_BANDED, 2)				\
+FORMAT_KERNEL(func, b4, CUPS_ORDER_BANDED, 4)				\
+FORMAT_KERNEL(func, b8, CUPS_ORDER_BANDED, 8)				\
+FORMAT_KERNEL(func, p1, CUPS_ORDER_PLANAR, 1)				\
+FORMAT_KERNEL(func, p2, CUPS_ORDER_PLANAR, 2)				\
+FORMAT_KERNEL(func, p4, CUPS_ORDER_PLANAR, 4)				\
+FORMAT_KERNEL(func, p8, CUPS_ORDER_PLANAR, 8)
+
+#define FORMAT_TABLE(func)						\
+	{								\
+	  { func ## _c1, func ## _c2, func ## _c4, func ## _c8 },	\
+	  { func ## _b1, func ## _b2, func ## _b4, func ## _b8 },	\
+	  { func ## _p1, func ## _p2, func ## _p4, func ## _p8 }	\
+	}
+
+FORMAT_KERNELS(format_CMY)
+FORMAT_KERNELS(format_CMYK)
+FORMAT_KERNELS(format_KCMY)
+FORMAT_KERNELS(format_RGBA)
+FORMAT_KERNELS(format_YMC)
+FORMAT_KERNELS(format_YMCK)
+
+/* Black and luminance have a single color, so the color order does not matter */
+FORMAT_KERNEL(format_K, c1, CUPS_ORDER_CHUNKED, 1)
+FORMAT_KERNEL(format_K, c2, CUPS_ORDER_CHUNKED, 2)
+FORMAT_KERNEL(format_K, c4, CUPS_ORDER_CHUNKED, 4)
+FORMAT_KERNEL(format_K, c8, CUPS_ORDER_CHUNKED, 8)
+FORMAT_KERNEL(format_W, c1, CUPS_ORDER_CHUNKED, 1)
+FORMAT_KERNEL(format_W, c2, CUPS_ORDER_CHUNKED, 2)
+FORMAT_KERNEL(format_W, c4, CUPS_ORDER_CHUNKED, 4)
+FORMAT_KERNEL(format_W, c8, CUPS_ORDER_CHUNKED, 8)
+
+/* KCMYcm is only used for 1-bit output, deeper output uses KCMY */
+FORMAT_KERNEL(format_KCMYcm, c1, CUPS_ORDER_CHUNKED, 1)
+FORMAT_KERNEL(format_KCMYcm, b1, CUPS_ORDER_BANDED, 1)
+FORMAT_KERNEL(format_KCMYcm, p1, CUPS_ORDER_PLANAR, 1)
+
+static const format_func_t CMYFormats[3][4] = FORMAT_TABLE(format_CMY),
+			CMYKFormats[3][4] = FORMAT_TABLE(format_CMYK),
+			KCMYFormats[3][4] = FORMAT_TABLE(format_KCMY),
+			RGBAFormats[3][4] = FORMAT_TABLE(format_RGBA),
+			YMCFormats[3][4] = FORMAT_TABLE(format_YMC),
+			YMCKFormats[3][4] = FORMAT_TABLE(format_YMCK),
+			KFormats[3][4] =
+			{
+			  { format_K_c1, format_K_c2, format_K_c4, format_K_c8 },
+			  { format_K_c1, format_K_c2, format_K_c4, format_K_c8 },
+			  { format_K_c1, format_K_c2, format_K_c4, format_K_c8 }
+			},
+			WFormats[3][4] =
+			{
+			  { format_W_c1, format_W_c2, format_W_c4, format_W_c8 },
+			  { format_W_c1, format_W_c2, format_W_c4, format_W_c8 },
+			  { format_W_c1, format_W_c2, format_W_c4, format_W_c8 }
+			},
+			KCMYcmFormats[3][4] =
+			{
+			  { format_KCMYcm_c1, format_KCMY_c2, format_KCMY_c4,
+			    format_KCMY_c8 },
+			  { format_KCMYcm_b1, format_KCMY_b2, format_KCMY_b4,
+			    format_KCMY_b8 },
+			  { format_KCMYcm_p1, format_KCMY_p2, format_KCMY_p4,
+			    format_KCMY_p8 }
+			};
+
+
+/*
+ * 'format_select()' - Create the dither tables and choose the line
+ *                     formatter for the page.
+ *
+ * The returned function formats the same lines as format_line() does for
+ * this page header.
+ */
+
+format_func_t				/* O - Line formatter */
+format_select(
+    cups_page_header2_t *header)	/* I - Page header */
+{
+  int			i;		/* Looping var */
+  const format_func_t	(*formats)[4];	/* Formatters for the colorspace */
+
+
+ /*
+  * Create the dithering lookup tables...
+  */
+
+  OnPixels[0]    = 0x00;
+  OnPixels[255]  = 0xff;
+  OffPixels[0]   = 0x00;
+  OffPixels[255] = 0xff;
+
+  switch (header->cupsBitsPerColor)
+  {
+    case 2 :
+        for (i = 1; i < 255; i ++)
+        {
+          OnPixels[i]  = 0x55 * (i / 85 + 1);
+          OffPixels[i] = 0x55 * (i / 64);
+        }
+        break;
+    case 4 :
+        for (i = 1; i < 255; i ++)
+        {
+          OnPixels[i]  = 17 * (i / 17 + 1);
+          OffPixels[i] = 17 * (i / 16);
+        }
+        break;
+  }
+
+ /*
+  * Then pick the formatter, using the same colorspaces as format_line()...
+  */
+
+  switch (header->cupsColorSpace)
+  {
+    case CUPS_CSPACE_W :
+	formats = WFormats;
+	break;
+    default :
+    case CUPS_CSPACE_RGB :
+	formats = CMYFormats;
+	break;
+    case CUPS_CSPACE_RGBA :
+    case CUPS_CSPACE_RGBW :
+	formats = RGBAFormats;
+	break;
+    case CUPS_CSPACE_K :
+    case CUPS_CSPACE_WHITE :
+    case CUPS_CSPACE_GOLD :
+    case CUPS_CSPACE_SILVER :
+	formats = KFormats;
+	break;
+    case CUPS_CSPACE_CMY :
+	formats = CMYFormats;
+	break;
+    case CUPS_CSPACE_YMC :
+	formats = YMCFormats;
+	break;
+    case CUPS_CSPACE_CMYK :
+	formats = CMYKFormats;
+	break;
+    case CUPS_CSPACE_YMCK :
+    case CUPS_CSPACE_GMCK :
+    case CUPS_CSPACE_GMCS :
+	formats = YMCKFormats;
+	break;
+    case CUPS_CSPACE_KCMYcm :
+	formats = KCMYcmFormats;
+	break;
+    case CUPS_CSPACE_KCMY :
+	formats = KCMYFormats;
+	break;
+  }
+
+  if (header->cupsColorOrder > CUPS_ORDER_PLANAR)
+    return (format_line);
+
+  switch (header->cupsBitsPerColor)
+  {
+    case 1 :
+        return (formats[header->cupsColorOrder][0]);
+    case 2 :
+        return (formats[header->cupsColorOrder][1]);
+    case 4 :
+        return (formats[header->cupsColorOrder][2]);
+    case 8 :
+        return (formats[header->cupsColorOrder][3]);
+    default :
+        return (format_line);
+  }
+}
+
+
+/*
+ * 'pack_1()' - Dither one color of a line to 1 bit per pixel.
+ *
+ * The bits are flipped in the blank line like the format_*() functions
+ * do, but a byte at a time; 16 pixels of gray data are compared at once
+ * when SSE2 is available.
+ */
+
+static FORMAT_INLINE void
+pack_1(cups_ib_t       *ptr,		/* I - Pointer into row */
+       int             bitoffset,	/* I - Offset of first pixel in line */
+       const cups_ib_t *r0,		/* I - Image data of the color */
+       int             step,		/* I - Bytes per image pixel */
+       int             xsize,		/* I - Width of image data */
+       const int       *dither)		/* I - Row of the dither array */
+{
+  cups_ib_t	bitmask;		/* Current mask for pixel */
+  unsigned	byte;			/* Packed pixels */
+  int		x,			/* Current X coordinate on page */
+		i, j;			/* Looping vars */
+  unsigned char	threshold[16];		/* Dither values from here on */
+#ifdef __SSE2__
+  __m128i	sign,			/* Sign bit of each byte */
+		level,			/* Dither values */
+		pixels;			/* Image data */
+  int		bits;			/* Pixels over the dither values */
+#endif /* __SSE2__ */
+
+
+ /*
+  * Dither the pixels up to the next byte boundary one by one...
+  */
+
+  x       = xsize;
+  bitmask = 0x80 >> (bitoffset & 7);
+
+  if (bitmask != 0x80)
+  {
+    for (; x > 0 && bitmask; x --, r0 += step, bitmask >>= 1)
+      if (*r0 > dither[x & 15])
+        *ptr ^= bitmask;
+
+    ptr ++;
+  }
+
+ /*
+  * The dither values repeat every 16 pixels...
+  */
+
+  for (i = 0; i < 16; i ++)
+    threshold[i] = dither[(x - i) & 15];
+
+  j = 0;
+
+#ifdef __SSE2__
+  if (step == 1)
+  {
+    sign  = _mm_set1_epi8((char)0x80);
+    level = _mm_xor_si128(_mm_loadu_si128((const __m128i *)threshold), sign);
+
+    for (; x >= 16; x -= 16, r0 += 16, ptr += 2)
+    {
+      pixels = _mm_xor_si128(_mm_loadu_si128((const __m128i *)r0), sign);
+      bits   = _mm_movemask_epi8(_mm_cmpgt_epi8(pixels, level));
+
+      ptr[0] ^= BitReverse[bits & 255];
+      ptr[1] ^= BitReverse[bits >> 8];
+    }
+  }
+#endif /* __SSE2__ */
+
+  for (; x >= 8; x -= 8, ptr ++)
+  {
+    for (i = 0, byte = 0; i < 8; i ++, j ++, r0 += step)
+      byte = (byte << 1) | (*r0 > threshold[j & 15]);
+
+    *ptr ^= byte;
+  }
+
+ /*
+  * Then the rest of the line...
+  */
+
+  for (bitmask = 0x80; x > 0; x --, j ++, r0 += step, bitmask >>= 1)
+    if (*r0 > threshold[j & 15])
+      *ptr ^= bitmask;
+}
+
+
+/*
+ * 'pack_2()' - Dither one color of a line to 2 bits per pixel.
+ *
+ * With SSE2 the levels of 16 pixels of gray data are computed at once
+ * from the values in the OnPixels and OffPixels tables.
+ */
+
+static FORMAT_INLINE void
+pack_2(cups_ib_t       *ptr,		/* I - Pointer into row */
+       int             bitoffset,	/* I - Offset of first pixel in line */
+       const cups_ib_t *r0,		/* I - Image data of the color */
+       int             step,		/* I - Bytes per image pixel */
+       int             xsize,		/* I - Width of image data */
+       const int       *dither)		/* I - Row of the dither array */
+{
+  cups_ib_t	bitmask;		/* Current mask for pixel */
+  unsigned	byte,			/* Packed pixels */
+		over;			/* All ones over the dither value */
+  int		x,			/* Current X coordinate on page */
+		i, j;			/* Looping vars */
+  unsigned char	threshold[16];		/* Dither values from here on */
+#ifdef __SSE2__
+  __m128i	level,			/* Dither values */
+		pixels,			/* Image data */
+		on,			/* Levels over the dither value */
+		off,			/* Levels under the dither value */
+		mask;			/* Pixels over the dither value */
+  int		bits;			/* Packed pixels */
+#endif /* __SSE2__ */
+
+
+ /*
+  * Dither the pixels up to the next byte boundary one by one...
+  */
+
+  x       = xsize;
+  bitmask = 0xc0 >> (bitoffset & 7);
+
+  if (bitmask != 0xc0)
+  {
+    for (; x > 0 && bitmask; x --, r0 += step, bitmask >>= 2)
+      if ((*r0 & 63) > dither[x & 7])
+        *ptr ^= (bitmask & OnPixels[*r0]);
+      else
+        *ptr ^= (bitmask & OffPixels[*r0]);
+
+    ptr ++;
+  }
+
+ /*
+  * The dither values repeat every 8 pixels...
+  */
+
+  for (i = 0; i < 16; i ++)
+    threshold[i] = dither[(x - i) & 7];
+
+  j = 0;
+
+#ifdef __SSE2__
+  if (step == 1)
+  {
+    level = _mm_loadu_si128((const __m128i *)threshold);
+
+    for (; x >= 16; x -= 16, r0 += 16, ptr += 4)
+    {
+     /*
+      * OnPixels has 0 for 0 and i / 85 + 1 up to 3 for the other values,
+      * OffPixels has i / 64...
+      */
+
+      pixels = _mm_loadu_si128((const __m128i *)r0);
+      mask   = _mm_cmpgt_epi8(_mm_and_si128(pixels, _mm_set1_epi8(63)),
+                              level);
+      on     = _mm_sub_epi8(_mm_set1_epi8(1),
+                            _mm_cmpeq_epi8(_mm_max_epu8(pixels,
+			                                _mm_set1_epi8(85)),
+					   pixels));
+      on     = _mm_sub_epi8(on,
+                            _mm_cmpeq_epi8(_mm_max_epu8(pixels,
+			                                _mm_set1_epi8((char)170)),
+					   pixels));
+      off    = _mm_and_si128(_mm_srli_epi16(pixels, 6), _mm_set1_epi8(3));
+      pixels = _mm_or_si128(_mm_and_si128(mask, on),
+                            _mm_andnot_si128(mask, off));
+
+     /*
+      * Move the levels of each 4 pixels into the low byte of each 32-bit
+      * word, then pack the words into bytes...
+      */
+
+      pixels = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(pixels, 6),
+                                         _mm_srli_epi32(pixels, 4)),
+			    _mm_or_si128(_mm_srli_epi32(pixels, 14),
+			                 _mm_srli_epi32(pixels, 24)));
+      pixels = _mm_and_si128(pixels, _mm_set1_epi32(255));
+      pixels = _mm_packs_epi32(pixels, pixels);
+      bits   = _mm_cvtsi128_si32(_mm_packus_epi16(pixels, pixels));
+
+      ptr[0] ^= bits;
+      ptr[1] ^= bits >> 8;
+      ptr[2] ^= bits >> 16;
+      ptr[3] ^= bits >> 24;
+    }
+  }
+#endif /* __SSE2__ */
+
+  for (; x >= 4; x -= 4, ptr ++)
+  {
+    for (i = 0, byte = 0; i < 4; i ++, j ++, r0 += step)
+    {
+      over = -((*r0 & 63) > threshold[j & 15]);
+      byte = (byte << 2) |
+             (((OnPixels[*r0] & over) | (OffPixels[*r0] & ~over)) & 3);
+    }
+
+    *ptr ^= byte;
+  }
+
+ /*
+  * Then the rest of the line...
+  */
+
+  for (bitmask = 0xc0; x > 0; x --, j ++, r0 += step, bitmask >>= 2)
+    if ((*r0 & 63) > threshold[j & 15])
+      *ptr ^= (bitmask & OnPixels[*r0]);
+    else
+      *ptr ^= (bitmask & OffPixels[*r0]);
+}
+
+
+/*
+ * 'pack_4()' - Dither one color of a line to 4 bits per pixel.
+ *
+ * With SSE2 the levels of 16 pixels of gray data are computed at once
+ * from the values in the OnPixels and OffPixels tables.
+ */
+
+static FORMAT_INLINE void
+pack_4(cups_ib_t       *ptr,		/* I - Pointer into row */
+       int             bitoffset,	/* I - Offset of first pixel in line */
+       const cups_ib_t *r0,		/* I - Image data of the color */
+       int             step,		/* I - Bytes per image pixel */
+       int             xsize,		/* I - Width of image data */
+       const int       *dither)		/* I - Row of the dither array */
+{
+  cups_ib_t	bitmask;		/* Current mask for pixel */
+  unsigned	byte,			/* Packed pixels */
+		over;			/* All ones over the dither value */
+  int		x,			/* Current X coordinate on page */
+		i, j;			/* Looping vars */
+  unsigned char	threshold[16];		/* Dither values from here on */
+#ifdef __SSE2__
+  __m128i	level,			/* Dither values */
+		pixels,			/* Image data */
+		on,			/* Levels over the dither value */
+		off,			/* Levels under the dither value */
+		mask;			/* Pixels over the dither value */
+  unsigned char	bytes[8];		/* Packed pixels */
+#endif /* __SSE2__ */
+
+
+ /*
+  * Dither a pixel in the low nibble one by one...
+  */
+
+  x       = xsize;
+  bitmask = 0xf0 >> (bitoffset & 7);
+
+  if (bitmask != 0xf0 && x > 0)
+  {
+    if ((*r0 & 15) > dither[x & 3])
+      *ptr ^= (bitmask & OnPixels[*r0]);
+    else
+      *ptr ^= (bitmask & OffPixels[*r0]);
+
+    x --;
+    r0 += step;
+    ptr ++;
+  }
+
+ /*
+  * The dither values repeat every 4 pixels...
+  */
+
+  for (i = 0; i < 16; i ++)
+    threshold[i] = dither[(x - i) & 3];
+
+  j = 0;
+
+#ifdef __SSE2__
+  if (step == 1)
+  {
+    level = _mm_loadu_si128((const __m128i *)threshold);
+
+    for (; x >= 16; x -= 16, r0 += 16, ptr += 8)
+    {
+     /*
+      * OnPixels has i / 17 + 1 up to 15 for the values over the dither
+      * value and OffPixels has i / 16; i / 17 is (i * 3856) >> 16 for
+      * 8-bit values...
+      */
+
+      pixels = _mm_loadu_si128((const __m128i *)r0);
+      mask   = _mm_cmpgt_epi8(_mm_and_si128(pixels, _mm_set1_epi8(15)),
+                              level);
+      on     = _mm_packus_epi16(
+                   _mm_mulhi_epu16(_mm_unpacklo_epi8(pixels,
+		                                     _mm_setzero_si128()),
+		                   _mm_set1_epi16(3856)),
+                   _mm_mulhi_epu16(_mm_unpackhi_epi8(pixels,
+		                                     _mm_setzero_si128()),
+		                   _mm_set1_epi16(3856)));
+      on     = _mm_min_epu8(_mm_add_epi8(on, _mm_set1_epi8(1)),
+                            _mm_set1_epi8(15));
+      off    = _mm_and_si128(_mm_srli_epi16(pixels, 4), _mm_set1_epi8(15));
+      pixels = _mm_or_si128(_mm_and_si128(mask, on),
+                            _mm_andnot_si128(mask, off));
+
+     /*
+      * Move the levels of each 2 pixels into the low byte of each 16-bit
+      * word, then pack the words into bytes...
+      */
+
+      pixels = _mm_or_si128(_mm_slli_epi16(pixels, 4),
+                            _mm_srli_epi16(pixels, 8));
+      pixels = _mm_and_si128(pixels, _mm_set1_epi16(255));
+      _mm_storel_epi64((__m128i *)bytes, _mm_packus_epi16(pixels, pixels));
+
+      for (i = 0; i < 8; i ++)
+        ptr[i] ^= bytes[i];
+    }
+  }
+#endif /* __SSE2__ */
+
+  for (; x >= 2; x -= 2, ptr ++)
+  {
+    for (i = 0, byte = 0; i < 2; i ++, j ++, r0 += step)
+    {
+      over = -((*r0 & 15) > threshold[j & 15]);
+      byte = (byte << 4) |
+             (((OnPixels[*r0] & over) | (OffPixels[*r0] & ~over)) & 15);
+    }
+
+    *ptr ^= byte;
+  }
+
+ /*
+  * Then the last pixel...
+  */
+
+  if (x > 0)
+  {
+    if ((*r0 & 15) > threshold[j & 15])
+      *ptr ^= (0xf0 & OnPixels[*r0]);
+    else
+      *ptr ^= (0xf0 & OffPixels[*r0]);
+  }
+}
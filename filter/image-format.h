@@ -0,0 +1,51 @@
+/*
+ *   Line formatting for the image file to raster filter for CUPS.
+ *
+ *   Copyright 2007-2011 by Apple Inc.
+ *   Copyright 1993-2007 by Easy Software Products.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ */
+
+#ifndef _IMAGE_FORMAT_H_
+#  define _IMAGE_FORMAT_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include <cups/raster.h>
+#  include <cupsfilters/image.h>
+
+
+/*
+ * Types...
+ */
+
+typedef void (*format_func_t)(cups_page_header2_t *header, unsigned char *row,
+			      int y, int z, int xsize, int ysize, int yerr0,
+			      int yerr1, cups_ib_t *r0, cups_ib_t *r1);
+					/**** Line formatter ****/
+
+
+/*
+ * Globals...
+ */
+
+extern int	XPosition;		/* Horizontal position on page */
+
+
+/*
+ * Prototypes...
+ */
+
+extern void	blank_line(cups_page_header2_t *header, unsigned char *row);
+extern void	format_line(cups_page_header2_t *header, unsigned char *row,
+			    int y, int z, int xsize, int ysize, int yerr0,
+			    int yerr1, cups_ib_t *r0, cups_ib_t *r1);
+extern format_func_t format_select(cups_page_header2_t *header);
+
+#endif /* !_IMAGE_FORMAT_H_ */
@@ -64,6 +64,7 @@ int	Flip = 0,		/* Flip/mirror pages */
 #define CUPS_IMAGE_RGB IMAGE_RGB
 #define CUPS_IMAGE_RGB_CMYK IMAGE_RGB_CMYK
 #define cupsImageOpen ImageOpen
+#define cupsImageOpenStream(f,p,s,sat,hue,lut,xs,ys) ImageOpen(f,p,s,sat,hue,lut)
 #define cupsImageClose ImageClose
 #define cupsImageGetColorSpace(img) (img->colorspace)
 #define cupsImageGetXPPI(img) (img->xppi)
@@ -957,7 +958,8 @@ main(int  argc,				/* I - Number of command-line arguments */
 
   colorspace = ColorDevice ? CUPS_IMAGE_RGB_CMYK : CUPS_IMAGE_WHITE;
 
-  img = cupsImageOpen(filename, colorspace, CUPS_IMAGE_WHITE, sat, hue, NULL);
+  img = cupsImageOpenStream(filename, colorspace, CUPS_IMAGE_WHITE, sat, hue,
+                            NULL, 0, 0);
   if(img!=NULL){
 
   int margin_defined = 0;
@@ -1173,8 +1175,8 @@ main(int  argc,				/* I - Number of command-line arguments */
       perror("ERROR: Unable to copy image file");
       return (1);
     }
-    img = cupsImageOpen(filename2, colorspace,
-            CUPS_IMAGE_WHITE, sat, hue, NULL);
+    img = cupsImageOpenStream(filename2, colorspace,
+            CUPS_IMAGE_WHITE, sat, hue, NULL, 0, 0);
     unlink(filename2);
   }
 #endif
@@ -12,17 +12,16 @@
  * Contents:
  *
  *   main()          - Main entry...
- *   blank_line()    - Clear a line buffer to the blank value...
- *   format_CMY()    - Convert image data to CMY.
- *   format_CMYK()   - Convert image data to CMYK.
- *   format_K()      - Convert image data to black.
- *   format_KCMY()   - Convert image data to KCMY.
- *   format_KCMYcm() - Convert image data to KCMYcm.
- *   format_RGBA()   - Convert image data to RGBA/RGBW.
- *   format_W()      - Convert image data to luminance.
- *   format_YMC()    - Convert image data to YMC.
- *   format_YMCK()   - Convert image data to YMCK.
+ *   band_delete()   - Stop the band threads and free the bands.
+ *   band_flush()    - Format and write all pending bands.
+ *   band_get()      - Get a free band for the next lines.
+ *   band_grow()     - Make room for zoomed image rows in a band.
+ *   band_line()     - Add a line to the current band.
+ *   band_new()      - Start the band threads.
+ *   band_thread()   - Format bands of lines.
+ *   band_write()    - Write the formatted bands in order.
  *   make_lut()      - Make a lookup table given gamma and brightness values.
+ *   next_image()    - Get the next selected page of the image file.
  *   raster_cb()     - Validate the page header.
  */
 
@@ -34,10 +33,14 @@
 #include <cupsfilters/raster.h>
 #include <cupsfilters/colormanager.h>
 #include <cupsfilters/image-private.h>
+#include "image-format.h"
 #include <unistd.h>
 #include <math.h>
 #include <signal.h>
 #include <string.h>
+#ifdef HAVE_PTHREAD_H
+#  include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
 
 
 /*
@@ -45,84 +48,91 @@
  */
 
 int	Flip = 0,			/* Flip/mirror pages */
-	XPosition = 0,			/* Horizontal position on page */
 	YPosition = 0,			/* Vertical position on page */
 	Collate = 0,			/* Collate copies? */
 	Copies = 1;			/* Number of copies */
-int	Floyd16x16[16][16] =		/* Traditional Floyd ordered dither */
-	{
-	  { 0,   128, 32,  160, 8,   136, 40,  168,
-	    2,   130, 34,  162, 10,  138, 42,  170 },
-	  { 192, 64,  224, 96,  200, 72,  232, 104,
-	    194, 66,  226, 98,  202, 74,  234, 106 },
-	  { 48,  176, 16,  144, 56,  184, 24,  152,
-	    50,  178, 18,  146, 58,  186, 26,  154 },
-	  { 240, 112, 208, 80,  248, 120, 216, 88,
-	    242, 114, 210, 82,  250, 122, 218, 90 },
-	  { 12,  140, 44,  172, 4,   132, 36,  164,
-	    14,  142, 46,  174, 6,   134, 38,  166 },
-	  { 204, 76,  236, 108, 196, 68,  228, 100,
-	    206, 78,  238, 110, 198, 70,  230, 102 },
-	  { 60,  188, 28,  156, 52,  180, 20,  148,
-	    62,  190, 30,  158, 54,  182, 22,  150 },
-	  { 252, 124, 220, 92,  244, 116, 212, 84,
-	    254, 126, 222, 94,  246, 118, 214, 86 },
-	  { 3,   131, 35,  163, 11,  139, 43,  171,
-	    1,   129, 33,  161, 9,   137, 41,  169 },
-	  { 195, 67,  227, 99,  203, 75,  235, 107,
-	    193, 65,  225, 97,  201, 73,  233, 105 },
-	  { 51,  179, 19,  147, 59,  187, 27,  155,
-	    49,  177, 17,  145, 57,  185, 25,  153 },
-	  { 243, 115, 211, 83,  251, 123, 219, 91,
-	    241, 113, 209, 81,  249, 121, 217, 89 },
-	  { 15,  143, 47,  175, 7,   135, 39,  167,
-	    13,  141, 45,  173, 5,   133, 37,  165 },
-	  { 207, 79,  239, 111, 199, 71,  231, 103,
-	    205, 77,  237, 109, 197, 69,  229, 101 },
-	  { 63,  191, 31,  159, 55,  183, 23,  151,
-	    61,  189, 29,  157, 53,  181, 21,  149 },
-	  { 254, 127, 223, 95,  247, 119, 215, 87,
-	    253, 125, 221, 93,  245, 117, 213, 85 }
-	};
-int	Floyd8x8[8][8] =
-	{
-	  {  0, 32,  8, 40,  2, 34, 10, 42 },
-	  { 48, 16, 56, 24, 50, 18, 58, 26 },
-	  { 12, 44,  4, 36, 14, 46,  6, 38 },
-	  { 60, 28, 52, 20, 62, 30, 54, 22 },
-	  {  3, 35, 11, 43,  1, 33,  9, 41 },
-	  { 51, 19, 59, 27, 49, 17, 57, 25 },
-	  { 15, 47,  7, 39, 13, 45,  5, 37 },
-	  { 63, 31, 55, 23, 61, 29, 53, 21 }
-	};
-int	Floyd4x4[4][4] =
-	{
-	  {  0,  8,  2, 10 },
-	  { 12,  4, 14,  6 },
-	  {  3, 11,  1,  9 },
-	  { 15,  7, 13,  5 }
-	};
 
-cups_ib_t	OnPixels[256],		/* On-pixel LUT */
-		OffPixels[256];		/* Off-pixel LUT */
+
+#ifdef HAVE_PTHREAD_H
+/*
+ * Band pipeline...
+ *
+ * The main thread zooms the image, so the image is still read in order,
+ * and writes the raster data; the color separation and dithering of the
+ * lines is done in bands on the band threads.  Each line only needs its
+ * two zoomed image rows, so a band keeps a copy of the rows its lines
+ * use...
+ */
+
+#  define BAND_LINES	32		/* Lines per band */
+#  define BAND_THREADS	16		/* Maximum number of band threads */
+
+enum
+{
+  BAND_FREE,				/* Band can be filled */
+  BAND_READY,				/* Band waits for formatting */
+  BAND_DONE				/* Band waits for writing */
+};
+
+typedef struct band_s			/**** Band of raster lines ****/
+{
+  int		state,			/* BAND_FREE, _READY, or _DONE */
+		count,			/* Number of lines */
+		plane,			/* Color plane */
+		xsize,			/* Width of image data */
+		ysize;			/* Height of image data */
+  int		y[BAND_LINES],		/* Current row of each line */
+		yerr0[BAND_LINES],	/* Top Y error of each line */
+		yerr1[BAND_LINES],	/* Bottom Y error of each line */
+		r0[BAND_LINES],		/* Primary image row of each line */
+		r1[BAND_LINES];		/* Interpolation row of each line */
+  int		num_rows;		/* Number of zoomed image rows */
+  size_t	rowsize,		/* Size of a zoomed image row */
+		alloc_size;		/* Allocated size of zoomed rows */
+  cups_ib_t	*rows;			/* Zoomed image rows */
+  unsigned char	*lines;			/* Formatted raster lines */
+} band_t;
+
+typedef struct band_pipe_s		/**** Band threads ****/
+{
+  pthread_mutex_t	mutex;		/* Mutex for the band states */
+  pthread_cond_t	cond;		/* Band state changed */
+  int			num_threads;	/* Number of band threads */
+  pthread_t		threads[BAND_THREADS];
+					/* Band threads */
+  int			num_bands;	/* Number of bands */
+  band_t		*bands;		/* Bands */
+  band_t		*current;	/* Band being filled */
+  int			cur0,		/* Last zoomed row in current band */
+			cur1,		/* Previous zoomed row */
+			filled,		/* Number of bands filled */
+			formatted,	/* Number of bands taken for formatting */
+			written,	/* Number of bands written */
+			shutdown;	/* Non-zero when threads should exit */
+  cups_page_header2_t	*header;	/* Page header */
+  format_func_t		format;		/* Line formatter */
+  cups_raster_t		*ras;		/* Raster stream */
+  cups_image_t		*img;		/* Image to print */
+} band_pipe_t;
+#endif /* HAVE_PTHREAD_H */
 
 
 /*
  * Local functions...
  */
 
-static void	blank_line(cups_page_header2_t *header, unsigned char *row);
-static void	format_CMY(cups_page_header2_t *header, unsigned char *row, int y, int z, int xsize, int ysize, int yerr0, int yerr1, cups_ib_t *r0, cups_ib_t *r1);
-static void	format_CMYK(cups_page_header2_t *header, unsigned char *row, int y, int z, int xsize, int ysize, int yerr0, int yerr1, cups_ib_t *r0, cups_ib_t *r1);
-static void	format_K(cups_page_header2_t *header, unsigned char *row, int y, int z, int xsize, int ysize, int yerr0, int yerr1, cups_ib_t *r0, cups_ib_t *r1);
-static void	format_KCMYcm(cups_page_header2_t *header, unsigned char *row, int y, int z, int xsize, int ysize, int yerr0, int yerr1, cups_ib_t *r0, cups_ib_t *r1);
-static void	format_KCMY(cups_page_header2_t *header, unsigned char *row, int y, int z, int xsize, int ysize, int yerr0, int yerr1, cups_ib_t *r0, cups_ib_t *r1);
-#define		format_RGB format_CMY
-static void	format_RGBA(cups_page_header2_t *header, unsigned char *row, int y, int z, int xsize, int ysize, int yerr0, int yerr1, cups_ib_t *r0, cups_ib_t *r1);
-static void	format_W(cups_page_header2_t *header, unsigned char *row, int y, int z, int xsize, int ysize, int yerr0, int yerr1, cups_ib_t *r0, cups_ib_t *r1);
-static void	format_YMC(cups_page_header2_t *header, unsigned char *row, int y, int z, int xsize, int ysize, int yerr0, int yerr1, cups_ib_t *r0, cups_ib_t *r1);
-static void	format_YMCK(cups_page_header2_t *header, unsigned char *row, int y, int z, int xsize, int ysize, int yerr0, int yerr1, cups_ib_t *r0, cups_ib_t *r1);
+#ifdef HAVE_PTHREAD_H
+static void	band_delete(band_pipe_t *p);
+static void	band_flush(band_pipe_t *p);
+static band_t	*band_get(band_pipe_t *p, cups_izoom_t *z, int plane);
+static void	band_grow(band_pipe_t *p, band_t *b, int num_rows);
+static void	band_line(band_pipe_t *p, cups_izoom_t *z, int plane, int y, int yerr0, int yerr1, int fills);
+static band_pipe_t *band_new(cups_page_header2_t *header, format_func_t format, cups_raster_t *ras, cups_image_t *img, int num_threads);
+static void	*band_thread(void *data);
+static void	band_write(band_pipe_t *p, int count);
+#endif /* HAVE_PTHREAD_H */
 static void	make_lut(cups_ib_t *, int, float, float);
+static cups_image_t *next_image(cups_ipages_t *pages, const float *crop);
 static int	raster_cb(cups_page_header2_t *header, int preferred_bits);
 
 
@@ -134,8 +144,13 @@ int					/* O - Exit status */
 main(int  argc,				/* I - Number of command-line arguments */
      char *argv[])			/* I - Command-line arguments */
 {
-  int			i;		/* Looping var */
+  int			i, j;		/* Looping vars */
+  cups_ipages_t		*pages;		/* Pages of image file */
   cups_image_t		*img;		/* Image to print */
+  int			num_pages,	/* Number of selected pages */
+			page_copies,	/* Copies of each page */
+			cropped = 0;	/* Pages cropped? */
+  float			crop[4];	/* Cropped area relative to page size */
   float			xprint,		/* Printable area */
 			yprint,
 			xinches,	/* Total size in inches */
@@ -170,23 +185,29 @@ main(int  argc,				/* I - Number of command-line arguments */
   float			g;		/* Gamma correction value */
   float			b;		/* Brightness factor */
   float			zoom;		/* Zoom facter */
+  float			fitzoom;	/* Zoom factor if only scaled to fit */
+  unsigned		fitsize;	/* Size of fit box in pixels */
   int			xppi, yppi;	/* Pixels-per-inch */
   int			hue, sat;	/* Hue and saturation adjustment */
   cups_izoom_t		*z;		/* Image zoom buffer */
   cups_iztype_t		zoom_type;	/* Image zoom type */
   int			primary,	/* Primary image colorspace */
 			secondary;	/* Secondary image colorspace */
-  cups_ib_t		*row,		/* Current row */
-			*r0,		/* Top row */
-			*r1;		/* Bottom row */
+  cups_ib_t		*row;		/* Current row */
+  format_func_t		format;		/* Line formatter */
   int			y,		/* Current Y coordinate on page */
 			iy,		/* Current Y coordinate in image */
 			last_iy,	/* Previous Y coordinate in image */
+			fills,		/* Number of zoomed rows filled */
 			yerr0,		/* Top Y error value */
 			yerr1;		/* Bottom Y error value */
   cups_ib_t		lut[256];	/* Gamma/brightness LUT */
   int			plane,		/* Current color plane */
 			num_planes;	/* Number of color planes */
+#ifdef HAVE_PTHREAD_H
+  band_pipe_t		*bands = NULL;	/* Band threads */
+#endif /* HAVE_PTHREAD_H */
+  int			num_threads = 1;/* Number of band and decoding threads */
   char			filename[1024];	/* Name of file to print */
   cm_calibration_t      cm_calibrate;   /* Are we color calibrating the device? */
   int                   cm_disabled;    /* Color management disabled? */
@@ -605,12 +626,89 @@ main(int  argc,				/* I - Number of command-line arguments */
 
   fputs("INFO: Loading print file.\n", stderr);
 
+ /*
+  * An image which is only scaled to fit the page(s) never needs more
+  * pixels than the page(s), in either orientation, so let the image
+  * readers reduce larger images while decoding them...
+  */
+
+  if (xppi > 0)
+    fitzoom = 0.0;
+  else if ((val = cupsGetOption("print-scaling", num_options,
+                                options)) != NULL)
+    fitzoom = strcasecmp(val, "fit") ? 0.0 : 1.0;
+  else if (cupsGetOption("fill", num_options, options) ||
+           cupsGetOption("crop-to-fit", num_options, options) ||
+           cupsGetOption("natural-scaling", num_options, options))
+    fitzoom = 0.0;
+  else if ((val = cupsGetOption("scaling", num_options, options)) != NULL)
+    fitzoom = atoi(val) * 0.01;
+  else if ((val = cupsGetOption("fit-to-page", num_options,
+                                options)) != NULL ||
+           (val = cupsGetOption("fitplot", num_options, options)) != NULL)
+    fitzoom = (!strcasecmp(val, "yes") || !strcasecmp(val, "on") ||
+               !strcasecmp(val, "true")) ? 1.0 : 0.0;
+  else
+    fitzoom = zoom;
+
+  if (fitzoom > 0.0)
+    fitsize = ceil(fitzoom * max(PageRight - PageLeft, PageTop - PageBottom) *
+                   max(header.HWResolution[0], header.HWResolution[1]) /
+		   72.0);
+  else
+    fitsize = 0;
+
+#ifdef HAVE_PTHREAD_H
+ /*
+  * Decode pages and format lines on one thread per processor, or on the
+  * number of threads in the RIP_THREADS environment variable...
+  */
+
+  if ((val = getenv("RIP_THREADS")) != NULL)
+    num_threads = atoi(val);
+  else
+    num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (num_threads > BAND_THREADS)
+    num_threads = BAND_THREADS;
+#endif /* HAVE_PTHREAD_H */
+
+ /*
+  * Open the pages of the image file; pages not in "page-ranges" of
+  * multi-page TIFF and GIF files are skipped without decoding them.
+  * The layout and crop below are computed for the first selected page
+  * and used for all later pages...
+  */
+
   if (header.cupsColorSpace == CUPS_CSPACE_CIEXYZ ||
       header.cupsColorSpace == CUPS_CSPACE_CIELab ||
       header.cupsColorSpace >= CUPS_CSPACE_ICC1)
-    img = cupsImageOpen(filename, primary, secondary, sat, hue, NULL);
+    pages = cupsImagePagesOpen(filename, primary, secondary, sat, hue, NULL,
+                               fitsize, fitsize,
+			       cupsGetOption("page-ranges", num_options,
+			                     options), num_threads);
   else
-    img = cupsImageOpen(filename, primary, secondary, sat, hue, lut);
+    pages = cupsImagePagesOpen(filename, primary, secondary, sat, hue, lut,
+                               fitsize, fitsize,
+			       cupsGetOption("page-ranges", num_options,
+			                     options), num_threads);
+
+  if ((num_pages = cupsImagePagesCount(pages)) == 0 && pages)
+  {
+    fputs("DEBUG: No pages of the print file are selected.\n", stderr);
+
+    if (argc == 6)
+      unlink(filename);
+
+    cupsImagePagesClose(pages);
+    ppdClose(ppd);
+    return (0);
+  }
+
+  fprintf(stderr, "DEBUG: %d page(s) of the print file selected.\n",
+          num_pages);
+
+  img = next_image(pages, NULL);
 
   if(img!=NULL){
 
@@ -786,6 +884,11 @@ main(int  argc,				/* I - Number of command-line arguments */
         float posw=(w-final_w)/2,posh=(h-final_h)/2;
         posw = (1+XPosition)*posw;
         posh = (1-YPosition)*posh;
+        crop[0] = posw / w;
+        crop[1] = posh / h;
+        crop[2] = final_w / w;
+        crop[3] = final_h / h;
+        cropped = 1;
         cups_image_t *img2 = cupsImageCrop(img,posw,posh,final_w,final_h);
         cupsImageClose(img);
         img = img2;
@@ -809,6 +912,11 @@ main(int  argc,				/* I - Number of command-line arguments */
           float posw=(w-final_w)/2,posh=(h-final_h)/2;
           posw = (1+XPosition)*posw;
           posh = (1-YPosition)*posh;
+          crop[0] = posw / w;
+          crop[1] = posh / h;
+          crop[2] = final_w / w;
+          crop[3] = final_h / h;
+          cropped = 1;
           cups_image_t *img2 = cupsImageCrop(img,posw,posh,final_w,final_h);
           cupsImageClose(img);
           img = img2;
@@ -837,6 +945,7 @@ main(int  argc,				/* I - Number of command-line arguments */
   if (img == NULL)
   {
     fputs("ERROR: The print file could not be opened.\n", stderr);
+    cupsImagePagesClose(pages);
     ppdClose(ppd);
     return (1);
   }
@@ -1290,7 +1399,7 @@ main(int  argc,				/* I - Number of command-line arguments */
   * See if we need to collate, and if so how we need to do it...
   */
 
-  if (xpages == 1 && ypages == 1)
+  if (xpages == 1 && ypages == 1 && num_pages == 1)
     Collate = 0;
 
   slowcollate = Collate && ppdFindOption(ppd, "Collate") == NULL;
@@ -1310,31 +1419,10 @@ main(int  argc,				/* I - Number of command-line arguments */
     header.NumCopies = 1;
 
  /*
-  * Create the dithering lookup tables...
+  * Create the dithering lookup tables and choose the line formatter...
   */
 
-  OnPixels[0]    = 0x00;
-  OnPixels[255]  = 0xff;
-  OffPixels[0]   = 0x00;
-  OffPixels[255] = 0xff;
-
-  switch (header.cupsBitsPerColor)
-  {
-    case 2 :
-        for (i = 1; i < 255; i ++)
-        {
-          OnPixels[i]  = 0x55 * (i / 85 + 1);
-          OffPixels[i] = 0x55 * (i / 64);
-        }
-        break;
-    case 4 :
-        for (i = 1; i < 255; i ++)
-        {
-          OnPixels[i]  = 17 * (i / 17 + 1);
-          OffPixels[i] = 17 * (i / 16);
-        }
-        break;
-  }
+  format = format_select(&header);
 
  /*
   * Output the pages...
@@ -1352,3125 +1440,587 @@ main(int  argc,				/* I - Number of command-line arguments */
   row = malloc(2 * header.cupsBytesPerLine);
   ras = cupsRasterOpen(1, CUPS_RASTER_WRITE);
 
-  for (i = 0, page = 1; i < Copies; i ++)
-    for (xpage = 0; xpage < xpages; xpage ++)
-      for (ypage = 0; ypage < ypages; ypage ++, page ++)
-      {
-        fprintf(stderr, "INFO: Formatting page %d.\n", page);
+#ifdef HAVE_PTHREAD_H
+  if (num_threads > 1)
+    bands = band_new(&header, format, ras, img, num_threads);
 
-	if (Orientation & 1)
-	{
-	  xc0    = img->xsize * ypage / ypages;
-	  xc1    = img->xsize * (ypage + 1) / ypages - 1;
-	  yc0    = img->ysize * xpage / xpages;
-	  yc1    = img->ysize * (xpage + 1) / xpages - 1;
+  if (bands)
+    fprintf(stderr, "DEBUG: Formatting with %d band threads.\n",
+            num_threads);
+#endif /* HAVE_PTHREAD_H */
 
-	  xtemp = header.HWResolution[0] * yprint;
-	  ytemp = header.HWResolution[1] * xprint;
-	}
-	else
-	{
-	  xc0    = img->xsize * xpage / xpages;
-	  xc1    = img->xsize * (xpage + 1) / xpages - 1;
-	  yc0    = img->ysize * ypage / ypages;
-	  yc1    = img->ysize * (ypage + 1) / ypages - 1;
+ /*
+  * Later pages are scaled into the same area as the first page.  Without
+  * collating, all copies of a page are printed before the next page...
+  */
 
-	  xtemp = header.HWResolution[0] * xprint;
-	  ytemp = header.HWResolution[1] * yprint;
-        }
+  if (num_pages > 1 && !Collate)
+  {
+    page_copies = Copies;
+    Copies      = 1;
+  }
+  else
+    page_copies = 1;
 
-        cupsRasterWriteHeader2(ras, &header);
+  for (i = 0, page = 1; i < Copies; i ++)
+  {
+    if (i > 0 && num_pages > 1)
+    {
+      cupsImagePagesRewind(pages);
+      img = next_image(pages, cropped ? crop : NULL);
+    }
 
-        for (plane = 0; plane < num_planes; plane ++)
-	{
-	 /*
-	  * Initialize the image "zoom" engine...
-	  */
-
-          if (Flip)
-	    z = _cupsImageZoomNew(img, xc0, yc0, xc1, yc1, -xtemp, ytemp,
-	                          Orientation & 1, zoom_type);
-          else
-	    z = _cupsImageZoomNew(img, xc0, yc0, xc1, yc1, xtemp, ytemp,
-	                          Orientation & 1, zoom_type);
-
-         /*
-	  * Write leading blank space as needed...
-	  */
-
-          if (header.cupsHeight > z->ysize && YPosition <= 0)
+    while (img)
+    {
+#ifdef HAVE_PTHREAD_H
+      if (bands)
+        bands->img = img;
+#endif /* HAVE_PTHREAD_H */
+
+      for (j = 0; j < page_copies; j ++)
+	for (xpage = 0; xpage < xpages; xpage ++)
+	  for (ypage = 0; ypage < ypages; ypage ++, page ++)
 	  {
-	    blank_line(&header, row);
+	    fprintf(stderr, "INFO: Formatting page %d.\n", page);
 
-            y = header.cupsHeight - z->ysize;
-	    if (YPosition == 0)
-	      y /= 2;
-
-            fprintf(stderr, "DEBUG: Writing %d leading blank lines...\n", y);
+	    if (Orientation & 1)
+	    {
+	      xc0    = img->xsize * ypage / ypages;
+	      xc1    = img->xsize * (ypage + 1) / ypages - 1;
+	      yc0    = img->ysize * xpage / xpages;
+	      yc1    = img->ysize * (xpage + 1) / xpages - 1;
 
-	    for (; y > 0; y --)
+	      xtemp = header.HWResolution[0] * yprint;
+	      ytemp = header.HWResolution[1] * xprint;
+	    }
+	    else
 	    {
-	      if (cupsRasterWritePixels(ras, row, header.cupsBytesPerLine) <
-	              header.cupsBytesPerLine)
-	      {
-		fputs("ERROR: Unable to send raster data to the driver.\n",
-		      stderr);
-		cupsImageClose(img);
-		exit(1);
-	      }
-            }
-	  }
+	      xc0    = img->xsize * xpage / xpages;
+	      xc1    = img->xsize * (xpage + 1) / xpages - 1;
+	      yc0    = img->ysize * ypage / ypages;
+	      yc1    = img->ysize * (ypage + 1) / ypages - 1;
 
-         /*
-	  * Then write image data...
-	  */
+	      xtemp = header.HWResolution[0] * xprint;
+	      ytemp = header.HWResolution[1] * yprint;
+	    }
 
-	  for (y = z->ysize, yerr0 = 0, yerr1 = z->ysize, iy = 0, last_iy = -2;
-               y > 0;
-               y --)
-	  {
-	    if (iy != last_iy)
+	    cupsRasterWriteHeader2(ras, &header);
+
+	    for (plane = 0; plane < num_planes; plane ++)
 	    {
-	      if (zoom_type != CUPS_IZOOM_FAST && (iy - last_iy) > 1)
-        	_cupsImageZoomFill(z, iy);
+	     /*
+	      * Initialize the image "zoom" engine...
+	      */
 
-              _cupsImageZoomFill(z, iy + z->yincr);
+	      if (Flip)
+		z = _cupsImageZoomNew(img, xc0, yc0, xc1, yc1, -xtemp, ytemp,
+				      Orientation & 1, zoom_type);
+	      else
+		z = _cupsImageZoomNew(img, xc0, yc0, xc1, yc1, xtemp, ytemp,
+				      Orientation & 1, zoom_type);
 
-              last_iy = iy;
-	    }
+	     /*
+	      * Write leading blank space as needed...
+	      */
 
-           /*
-	    * Format this line of raster data for the printer...
-	    */
+	      if (header.cupsHeight > z->ysize && YPosition <= 0)
+	      {
+		blank_line(&header, row);
 
-    	    blank_line(&header, row);
+		y = header.cupsHeight - z->ysize;
+		if (YPosition == 0)
+		  y /= 2;
 
-            r0 = z->rows[z->row];
-            r1 = z->rows[1 - z->row];
+		fprintf(stderr, "DEBUG: Writing %d leading blank lines...\n", y);
 
-            switch (header.cupsColorSpace)
-	    {
-	      case CUPS_CSPACE_W :
-	          format_W(&header, row, y, plane, z->xsize, z->ysize,
-		           yerr0, yerr1, r0, r1);
-		  break;
-              default :
-	      case CUPS_CSPACE_RGB :
-	          format_RGB(&header, row, y, plane, z->xsize, z->ysize,
-		             yerr0, yerr1, r0, r1);
-		  break;
-	      case CUPS_CSPACE_RGBA :
-	      case CUPS_CSPACE_RGBW :
-	          format_RGBA(&header, row, y, plane, z->xsize, z->ysize,
-		              yerr0, yerr1, r0, r1);
-		  break;
-	      case CUPS_CSPACE_K :
-	      case CUPS_CSPACE_WHITE :
-	      case CUPS_CSPACE_GOLD :
-	      case CUPS_CSPACE_SILVER :
-	          format_K(&header, row, y, plane, z->xsize, z->ysize,
-		           yerr0, yerr1, r0, r1);
-		  break;
-	      case CUPS_CSPACE_CMY :
-	          format_CMY(&header, row, y, plane, z->xsize, z->ysize,
-		             yerr0, yerr1, r0, r1);
-		  break;
-	      case CUPS_CSPACE_YMC :
-	          format_YMC(&header, row, y, plane, z->xsize, z->ysize,
-		             yerr0, yerr1, r0, r1);
-		  break;
-	      case CUPS_CSPACE_CMYK :
-	          format_CMYK(&header, row, y, plane, z->xsize, z->ysize,
-		              yerr0, yerr1, r0, r1);
-		  break;
-	      case CUPS_CSPACE_YMCK :
-	      case CUPS_CSPACE_GMCK :
-	      case CUPS_CSPACE_GMCS :
-	          format_YMCK(&header, row, y, plane, z->xsize, z->ysize,
-		              yerr0, yerr1, r0, r1);
-		  break;
-	      case CUPS_CSPACE_KCMYcm :
-	          if (header.cupsBitsPerColor == 1)
+		for (; y > 0; y --)
+		{
+		  if (cupsRasterWritePixels(ras, row, header.cupsBytesPerLine) <
+			  header.cupsBytesPerLine)
 		  {
-	            format_KCMYcm(&header, row, y, plane, z->xsize, z->ysize,
-		                  yerr0, yerr1, r0, r1);
-		    break;
+		    fputs("ERROR: Unable to send raster data to the driver.\n",
+			  stderr);
+		    cupsImageClose(img);
+		    exit(1);
 		  }
-	      case CUPS_CSPACE_KCMY :
-	          format_KCMY(&header, row, y, plane, z->xsize, z->ysize,
-		              yerr0, yerr1, r0, r1);
-		  break;
-	    }
+		}
+	      }
 
-           /*
-	    * Write the raster data to the driver...
-	    */
+	     /*
+	      * Then write image data...
+	      */
 
-	    if (cupsRasterWritePixels(ras, row, header.cupsBytesPerLine) <
-	                              header.cupsBytesPerLine)
-	    {
-	      fputs("ERROR: Unable to send raster data to the driver.\n",
-	            stderr);
-	      cupsImageClose(img);
-	      exit(1);
-	    }
+	      for (y = z->ysize, yerr0 = 0, yerr1 = z->ysize, iy = 0, last_iy = -2;
+		   y > 0;
+		   y --)
+	      {
+		if (iy != last_iy)
+		{
+		  fills = 1;
 
-           /*
-	    * Compute the next scanline in the image...
-	    */
+		  if (zoom_type != CUPS_IZOOM_FAST && (iy - last_iy) > 1)
+		  {
+		    _cupsImageZoomFill(z, iy);
+		    fills ++;
+		  }
 
-	    iy    += z->ystep;
-	    yerr0 += z->ymod;
-	    yerr1 -= z->ymod;
-	    if (yerr1 <= 0)
-	    {
-              yerr0 -= z->ysize;
-              yerr1 += z->ysize;
-              iy    += z->yincr;
-	    }
-	  }
+		  _cupsImageZoomFill(z, iy + z->yincr);
+
+		  last_iy = iy;
+		}
+		else
+		  fills = 0;
 
-         /*
-	  * Write trailing blank space as needed...
-	  */
+#ifdef HAVE_PTHREAD_H
+		if (bands)
+		  band_line(bands, z, plane, y, yerr0, yerr1, fills);
+		else
+#endif /* HAVE_PTHREAD_H */
+		{
+		 /*
+		  * Format this line of raster data for the printer...
+		  */
 
-          if (header.cupsHeight > z->ysize && YPosition >= 0)
-	  {
-	    blank_line(&header, row);
+		  (*format)(&header, row, y, plane, z->xsize, z->ysize,
+			    yerr0, yerr1, z->rows[z->row], z->rows[1 - z->row]);
 
-            y = header.cupsHeight - z->ysize;
-	    if (YPosition == 0)
-	      y = y - y / 2;
+		 /*
+		  * Write the raster data to the driver...
+		  */
 
-            fprintf(stderr, "DEBUG: Writing %d trailing blank lines...\n", y);
+		  if (cupsRasterWritePixels(ras, row, header.cupsBytesPerLine) <
+					    header.cupsBytesPerLine)
+		  {
+		    fputs("ERROR: Unable to send raster data to the driver.\n",
+			  stderr);
+		    cupsImageClose(img);
+		    exit(1);
+		  }
+		}
 
-	    for (; y > 0; y --)
-	    {
-	      if (cupsRasterWritePixels(ras, row, header.cupsBytesPerLine) <
-	              header.cupsBytesPerLine)
+	       /*
+		* Compute the next scanline in the image...
+		*/
+
+		iy    += z->ystep;
+		yerr0 += z->ymod;
+		yerr1 -= z->ymod;
+		if (yerr1 <= 0)
+		{
+		  yerr0 -= z->ysize;
+		  yerr1 += z->ysize;
+		  iy    += z->yincr;
+		}
+	      }
+
+#ifdef HAVE_PTHREAD_H
+	      if (bands)
+		band_flush(bands);
+#endif /* HAVE_PTHREAD_H */
+
+	     /*
+	      * Write trailing blank space as needed...
+	      */
+
+	      if (header.cupsHeight > z->ysize && YPosition >= 0)
 	      {
-		fputs("ERROR: Unable to send raster data to the driver.\n",
-		      stderr);
-		cupsImageClose(img);
-		exit(1);
+		blank_line(&header, row);
+
+		y = header.cupsHeight - z->ysize;
+		if (YPosition == 0)
+		  y = y - y / 2;
+
+		fprintf(stderr, "DEBUG: Writing %d trailing blank lines...\n", y);
+
+		for (; y > 0; y --)
+		{
+		  if (cupsRasterWritePixels(ras, row, header.cupsBytesPerLine) <
+			  header.cupsBytesPerLine)
+		  {
+		    fputs("ERROR: Unable to send raster data to the driver.\n",
+			  stderr);
+		    cupsImageClose(img);
+		    exit(1);
+		  }
+		}
 	      }
-            }
+
+	     /*
+	      * Free memory used for the "zoom" engine...
+	      */
+
+	      _cupsImageZoomDelete(z);
+	    }
 	  }
 
-         /*
-	  * Free memory used for the "zoom" engine...
-	  */
+      if (num_pages == 1)
+        break;
 
-          _cupsImageZoomDelete(z);
-        }
-      }
+      cupsImageClose(img);
+      img = next_image(pages, cropped ? crop : NULL);
+    }
+  }
 
  /*
   * Close files...
   */
 
+#ifdef HAVE_PTHREAD_H
+  if (bands)
+    band_delete(bands);
+#endif /* HAVE_PTHREAD_H */
+
   free(row);
   cupsRasterClose(ras);
-  cupsImageClose(img);
+  if (img)
+    cupsImageClose(img);
+  cupsImagePagesClose(pages);
   ppdClose(ppd);
 
   return (0);
 }
 
 
+#ifdef HAVE_PTHREAD_H
 /*
- * 'blank_line()' - Clear a line buffer to the blank value...
+ * 'band_delete()' - Stop the band threads and free the bands.
  */
 
 static void
-blank_line(cups_page_header2_t *header,	/* I - Page header */
-           unsigned char       *row)	/* I - Row buffer */
+band_delete(band_pipe_t *p)		/* I - Band threads */
 {
-  int	count;				/* Remaining bytes */
+  int	i;				/* Looping var */
 
 
-  count = header->cupsBytesPerLine;
+  pthread_mutex_lock(&p->mutex);
+  p->shutdown = 1;
+  pthread_cond_broadcast(&p->cond);
+  pthread_mutex_unlock(&p->mutex);
 
-  switch (header->cupsColorSpace)
-  {
-    case CUPS_CSPACE_CIEXYZ :
-        while (count > 2)
-	{
-	  *row++ = 242;
-	  *row++ = 255;
-	  *row++ = 255;
-	  count -= 3;
-	}
-	break;
+  for (i = 0; i < p->num_threads; i ++)
+    pthread_join(p->threads[i], NULL);
 
-    case CUPS_CSPACE_CIELab :
-    case CUPS_CSPACE_ICC1 :
-    case CUPS_CSPACE_ICC2 :
-    case CUPS_CSPACE_ICC3 :
-    case CUPS_CSPACE_ICC4 :
-    case CUPS_CSPACE_ICC5 :
-    case CUPS_CSPACE_ICC6 :
-    case CUPS_CSPACE_ICC7 :
-    case CUPS_CSPACE_ICC8 :
-    case CUPS_CSPACE_ICC9 :
-    case CUPS_CSPACE_ICCA :
-    case CUPS_CSPACE_ICCB :
-    case CUPS_CSPACE_ICCC :
-    case CUPS_CSPACE_ICCD :
-    case CUPS_CSPACE_ICCE :
-    case CUPS_CSPACE_ICCF :
-        while (count > 2)
-	{
-	  *row++ = 255;
-	  *row++ = 128;
-	  *row++ = 128;
-	  count -= 3;
-	}
-        break;
+  for (i = 0; i < p->num_bands; i ++)
+  {
+    free(p->bands[i].rows);
+    free(p->bands[i].lines);
+  }
 
-    case CUPS_CSPACE_K :
-    case CUPS_CSPACE_CMY :
-    case CUPS_CSPACE_CMYK :
-    case CUPS_CSPACE_YMC :
-    case CUPS_CSPACE_YMCK :
-    case CUPS_CSPACE_KCMY :
-    case CUPS_CSPACE_KCMYcm :
-    case CUPS_CSPACE_GMCK :
-    case CUPS_CSPACE_GMCS :
-    case CUPS_CSPACE_WHITE :
-    case CUPS_CSPACE_GOLD :
-    case CUPS_CSPACE_SILVER :
-        memset(row, 0, count);
-	break;
+  pthread_cond_destroy(&p->cond);
+  pthread_mutex_destroy(&p->mutex);
 
-    default :
-        memset(row, 255, count);
-	break;
-  }
+  free(p->bands);
+  free(p);
 }
 
 
 /*
- * 'format_CMY()' - Convert image data to CMY.
+ * 'band_flush()' - Format and write all pending bands.
  */
 
 static void
-format_CMY(cups_page_header2_t *header,	/* I - Page header */
-            unsigned char      *row,	/* IO - Bitmap data for device */
-	    int                y,	/* I - Current row */
-	    int                z,	/* I - Current plane */
-	    int                xsize,	/* I - Width of image data */
-	    int	               ysize,	/* I - Height of image data */
-	    int                yerr0,	/* I - Top Y error */
-	    int                yerr1,	/* I - Bottom Y error */
-	    cups_ib_t          *r0,	/* I - Primary image data */
-	    cups_ib_t          *r1)	/* I - Image data for interpolation */
+band_flush(band_pipe_t *p)		/* I - Band threads */
 {
-  cups_ib_t	*ptr,			/* Pointer into row */
-		*cptr,			/* Pointer into cyan */
-		*mptr,			/* Pointer into magenta */
-		*yptr,			/* Pointer into yellow */
-		bitmask;		/* Current mask for pixel */
-  int		bitoffset;		/* Current offset in line */
-  int		bandwidth;		/* Width of a color band */
-  int		x,			/* Current X coordinate on page */
-		*dither;		/* Pointer into dither array */
-
-
-  switch (XPosition)
+  if (p->current)
   {
-    case -1 :
-        bitoffset = 0;
-	break;
-    default :
-        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
-	break;
-    case 1 :
-        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
-	break;
+    pthread_mutex_lock(&p->mutex);
+    p->current->state = BAND_READY;
+    p->filled ++;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
   }
 
-  ptr       = row + bitoffset / 8;
-  bandwidth = header->cupsBytesPerLine / 3;
+  band_write(p, p->filled);
+
+  p->current = NULL;
+  p->cur0    = -1;
+  p->cur1    = -1;
+}
+
+
+/*
+ * 'band_get()' - Get a free band for the next lines.
+ *
+ * The last two zoomed rows are copied into a new band, as its first
+ * lines may still use them.
+ */
+
+static band_t *				/* O - Band with room for a line */
+band_get(band_pipe_t  *p,		/* I - Band threads */
+         cups_izoom_t *z,		/* I - Image zoom buffer */
+	 int          plane)		/* I - Current color plane */
+{
+  band_t	*b,			/* New band */
+		*prev = p->current;	/* Previous band */
 
-  switch (header->cupsColorOrder)
+
+  if (prev && prev->count < BAND_LINES)
+    return (prev);
+
+  if (prev)
   {
-    case CUPS_ORDER_CHUNKED :
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 64 >> (bitoffset & 7);
-	      dither  = Floyd16x16[y & 15];
+    pthread_mutex_lock(&p->mutex);
+    prev->state = BAND_READY;
+    p->filled ++;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
+  }
 
-              for (x = xsize ; x > 0; x --)
-              {
-	        if (*r0++ > dither[x & 15])
-		  *ptr ^= bitmask;
-		bitmask >>= 1;
+ /*
+  * Write bands until the band for the next lines is free...
+  */
 
-	        if (*r0++ > dither[x & 15])
-		  *ptr ^= bitmask;
-		bitmask >>= 1;
+  band_write(p, p->filled - p->num_bands + 1);
 
-	        if (*r0++ > dither[x & 15])
-		  *ptr ^= bitmask;
+  b           = p->bands + p->filled % p->num_bands;
+  b->count    = 0;
+  b->plane    = plane;
+  b->xsize    = z->xsize;
+  b->ysize    = z->ysize;
+  b->rowsize  = z->xsize * z->depth;
+  b->num_rows = 0;
 
-                if (bitmask > 1)
-		  bitmask >>= 2;
-		else
-        	{
-        	  bitmask = 64;
-        	  ptr ++;
-        	}
-              }
-              break;
-
-          case 2 :
-	      dither = Floyd8x8[y & 7];
-
-              for (x = xsize ; x > 0; x --, r0 += 3)
-              {
-	       	if ((r0[0] & 63) > dither[x & 7])
-        	  *ptr ^= (0x30 & OnPixels[r0[0]]);
-        	else
-        	  *ptr ^= (0x30 & OffPixels[r0[0]]);
-
-        	if ((r0[1] & 63) > dither[x & 7])
-        	  *ptr ^= (0x0c & OnPixels[r0[1]]);
-        	else
-        	  *ptr ^= (0x0c & OffPixels[r0[1]]);
-
-        	if ((r0[2] & 63) > dither[x & 7])
-        	  *ptr++ ^= (0x03 & OnPixels[r0[2]]);
-        	else
-        	  *ptr++ ^= (0x03 & OffPixels[r0[2]]);
-              }
-              break;
-
-          case 4 :
-	      dither = Floyd4x4[y & 3];
-
-              for (x = xsize ; x > 0; x --, r0 += 3)
-              {
-        	if ((r0[0] & 15) > dither[x & 3])
-        	  *ptr++ ^= (0x0f & OnPixels[r0[0]]);
-        	else
-        	  *ptr++ ^= (0x0f & OffPixels[r0[0]]);
-
-        	if ((r0[1] & 15) > dither[x & 3])
-        	  *ptr ^= (0xf0 & OnPixels[r0[1]]);
-        	else
-        	  *ptr ^= (0xf0 & OffPixels[r0[1]]);
-
-        	if ((r0[2] & 15) > dither[x & 3])
-        	  *ptr++ ^= (0x0f & OnPixels[r0[2]]);
-        	else
-        	  *ptr++ ^= (0x0f & OffPixels[r0[2]]);
-              }
-              break;
-
-          case 8 :
-              for (x = xsize  * 3; x > 0; x --, r0 ++, r1 ++)
-        	if (*r0 == *r1)
-                  *ptr++ = *r0;
-        	else
-                  *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
-              break;
-        }
-        break;
+  if (prev && p->cur0 >= 0)
+  {
+    band_grow(p, b, 2);
 
-    case CUPS_ORDER_BANDED :
-	cptr = ptr;
-	mptr = ptr + bandwidth;
-	yptr = ptr + 2 * bandwidth;
+    memcpy(b->rows, prev->rows + p->cur1 * prev->rowsize, b->rowsize);
+    memcpy(b->rows + b->rowsize, prev->rows + p->cur0 * prev->rowsize,
+           b->rowsize);
 
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 0x80 >> (bitoffset & 7);
-	      dither  = Floyd16x16[y & 15];
-
-              for (x = xsize; x > 0; x --)
-              {
-        	if (*r0++ > dither[x & 15])
-        	  *cptr ^= bitmask;
-        	if (*r0++ > dither[x & 15])
-        	  *mptr ^= bitmask;
-        	if (*r0++ > dither[x & 15])
-        	  *yptr ^= bitmask;
-
-                if (bitmask > 1)
-		  bitmask >>= 1;
-		else
-		{
-		  bitmask = 0x80;
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-        	}
-	      }
-              break;
-
-          case 2 :
-              bitmask = 0xc0 >> (bitoffset & 7);
-	      dither  = Floyd8x8[y & 7];
-
-              for (x = xsize; x > 0; x --)
-              {
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *cptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *cptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *mptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *mptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *yptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *yptr ^= (bitmask & OffPixels[*r0++]);
-
-                if (bitmask > 3)
-		  bitmask >>= 2;
-		else
-		{
-		  bitmask = 0xc0;
+    b->num_rows = 2;
+    p->cur1     = 0;
+    p->cur0     = 1;
+  }
 
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-        	}
-	      }
-              break;
-
-          case 4 :
-              bitmask = 0xf0 >> (bitoffset & 7);
-	      dither  = Floyd4x4[y & 3];
-
-              for (x = xsize; x > 0; x --)
-              {
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *cptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *cptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *mptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *mptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *yptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *yptr ^= (bitmask & OffPixels[*r0++]);
-
-                if (bitmask == 0xf0)
-		  bitmask = 0x0f;
-		else
-		{
-		  bitmask = 0xf0;
+  p->current = b;
 
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-        	}
-	      }
-              break;
+  return (b);
+}
 
-          case 8 :
-              for (x = xsize; x > 0; x --, r0 += 3, r1 += 3)
-	      {
-        	if (r0[0] == r1[0])
-                  *cptr++ = r0[0];
-        	else
-                  *cptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
-
-        	if (r0[1] == r1[1])
-                  *mptr++ = r0[1];
-        	else
-                  *mptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
-
-        	if (r0[2] == r1[2])
-                  *yptr++ = r0[2];
-        	else
-                  *yptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
-              }
-              break;
-        }
-        break;
 
-    case CUPS_ORDER_PLANAR :
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 0x80 >> (bitoffset & 7);
-	      dither  = Floyd16x16[y & 15];
+/*
+ * 'band_grow()' - Make room for zoomed image rows in a band.
+ */
 
-              switch (z)
-	      {
-	        case 0 :
-        	    for (x = xsize; x > 0; x --, r0 += 3)
-        	    {
-        	      if (r0[0] > dither[x & 15])
-        		*ptr ^= bitmask;
-
-                      if (bitmask > 1)
-			bitmask >>= 1;
-		      else
-		      {
-			bitmask = 0x80;
-			ptr ++;
-        	      }
-	            }
-		    break;
-
-	        case 1 :
-        	    for (x = xsize; x > 0; x --, r0 += 3)
-        	    {
-        	      if (r0[1] > dither[x & 15])
-        		*ptr ^= bitmask;
-
-                      if (bitmask > 1)
-			bitmask >>= 1;
-		      else
-		      {
-			bitmask = 0x80;
-			ptr ++;
-        	      }
-	            }
-		    break;
-
-	        case 2 :
-        	    for (x = xsize; x > 0; x --, r0 += 3)
-        	    {
-        	      if (r0[2] > dither[x & 15])
-        		*ptr ^= bitmask;
-
-                      if (bitmask > 1)
-			bitmask >>= 1;
-		      else
-		      {
-			bitmask = 0x80;
-			ptr ++;
-        	      }
-	            }
-		    break;
-	      }
-              break;
-
-          case 2 :
-              bitmask = 0xc0 >> (bitoffset & 7);
-	      dither  = Floyd8x8[y & 7];
-              r0 += z;
-
-              for (x = xsize; x > 0; x --, r0 += 3)
-              {
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *ptr ^= (bitmask & OnPixels[*r0]);
-        	else
-        	  *ptr ^= (bitmask & OffPixels[*r0]);
-
-                if (bitmask > 3)
-		  bitmask >>= 2;
-		else
-		{
-		  bitmask = 0xc0;
+static void
+band_grow(band_pipe_t *p,		/* I - Band threads */
+          band_t      *b,		/* I - Band */
+	  int         num_rows)		/* I - Number of rows needed */
+{
+  size_t	size;			/* Size needed */
+  cups_ib_t	*rows;			/* New zoomed rows */
 
-		  ptr ++;
-        	}
-	      }
-              break;
-
-          case 4 :
-              bitmask = 0xf0 >> (bitoffset & 7);
-	      dither  = Floyd4x4[y & 3];
-              r0 += z;
-
-              for (x = xsize; x > 0; x --, r0 += 3)
-              {
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *ptr ^= (bitmask & OnPixels[*r0]);
-        	else
-        	  *ptr ^= (bitmask & OffPixels[*r0]);
-
-                if (bitmask == 0xf0)
-		  bitmask = 0x0f;
-		else
-		{
-		  bitmask = 0xf0;
 
-		  ptr ++;
-        	}
-	      }
-              break;
+  if ((size = num_rows * b->rowsize) <= b->alloc_size)
+    return;
 
-          case 8 :
-              r0 += z;
-	      r1 += z;
+  size += (BAND_LINES / 2) * b->rowsize;
 
-              for (x = xsize; x > 0; x --, r0 += 3, r1 += 3)
-	      {
-        	if (*r0 == *r1)
-                  *ptr++ = *r0;
-        	else
-                  *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
-              }
-              break;
-        }
-        break;
+  if ((rows = realloc(b->rows, size)) == NULL)
+  {
+    fputs("ERROR: Unable to allocate memory for image bands.\n", stderr);
+    cupsImageClose(p->img);
+    exit(1);
   }
+
+  b->rows       = rows;
+  b->alloc_size = size;
 }
 
 
 /*
- * 'format_CMYK()' - Convert image data to CMYK.
+ * 'band_line()' - Add a line to the current band.
  */
 
 static void
-format_CMYK(cups_page_header2_t *header,/* I - Page header */
-            unsigned char       *row,	/* IO - Bitmap data for device */
-	    int                 y,	/* I - Current row */
-	    int                 z,	/* I - Current plane */
-	    int                 xsize,	/* I - Width of image data */
-	    int	                ysize,	/* I - Height of image data */
-	    int                 yerr0,	/* I - Top Y error */
-	    int                 yerr1,	/* I - Bottom Y error */
-	    cups_ib_t           *r0,	/* I - Primary image data */
-	    cups_ib_t           *r1)	/* I - Image data for interpolation */
+band_line(band_pipe_t  *p,		/* I - Band threads */
+          cups_izoom_t *z,		/* I - Image zoom buffer */
+	  int          plane,		/* I - Current color plane */
+	  int          y,		/* I - Current row */
+	  int          yerr0,		/* I - Top Y error */
+	  int          yerr1,		/* I - Bottom Y error */
+	  int          fills)		/* I - Rows zoomed for this line */
 {
-  cups_ib_t	*ptr,			/* Pointer into row */
-		*cptr,			/* Pointer into cyan */
-		*mptr,			/* Pointer into magenta */
-		*yptr,			/* Pointer into yellow */
-		*kptr,			/* Pointer into black */
-		bitmask;		/* Current mask for pixel */
-  int		bitoffset;		/* Current offset in line */
-  int		bandwidth;		/* Width of a color band */
-  int		x,			/* Current X coordinate on page */
-		*dither;		/* Pointer into dither array */
-  int		pc, pm, py;		/* CMY pixels */
-
-
-  switch (XPosition)
+  band_t	*b;			/* Current band */
+  int		i;			/* Looping var */
+
+
+  b = band_get(p, z, plane);
+
+  band_grow(p, b, b->num_rows + fills);
+
+ /*
+  * Copy the rows zoomed for this line, the last one is the primary row
+  * and the one before it the row for interpolation...
+  */
+
+  for (i = fills; i > 0; i --)
   {
-    case -1 :
-        bitoffset = 0;
-	break;
-    default :
-        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
-	break;
-    case 1 :
-        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
-	break;
+    memcpy(b->rows + b->num_rows * b->rowsize, z->rows[(z->row + i + 1) & 1],
+           b->rowsize);
+
+    p->cur1 = p->cur0;
+    p->cur0 = b->num_rows ++;
   }
 
-  ptr       = row + bitoffset / 8;
-  bandwidth = header->cupsBytesPerLine / 4;
+  b->y[b->count]     = y;
+  b->yerr0[b->count] = yerr0;
+  b->yerr1[b->count] = yerr1;
+  b->r0[b->count]    = p->cur0;
+  b->r1[b->count]    = p->cur1 >= 0 ? p->cur1 : p->cur0;
+  b->count ++;
+}
 
-  switch (header->cupsColorOrder)
-  {
-    case CUPS_ORDER_CHUNKED :
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 128 >> (bitoffset & 7);
-	      dither  = Floyd16x16[y & 15];
 
-              for (x = xsize ; x > 0; x --)
-              {
-	        pc = *r0++ > dither[x & 15];
-		pm = *r0++ > dither[x & 15];
-		py = *r0++ > dither[x & 15];
+/*
+ * 'band_new()' - Start the band threads.
+ */
 
-		if (pc && pm && py)
-		{
-		  bitmask >>= 3;
-		  *ptr ^= bitmask;
-		}
-		else
-		{
-		  if (pc)
-		    *ptr ^= bitmask;
-		  bitmask >>= 1;
+static band_pipe_t *			/* O - Band threads or NULL */
+band_new(cups_page_header2_t *header,	/* I - Page header */
+         format_func_t       format,	/* I - Line formatter */
+         cups_raster_t       *ras,	/* I - Raster stream */
+         cups_image_t        *img,	/* I - Image to print */
+	 int                 num_threads)
+					/* I - Number of band threads */
+{
+  band_pipe_t	*p;			/* Band threads */
+  int		i;			/* Looping var */
 
-		  if (pm)
-		    *ptr ^= bitmask;
-		  bitmask >>= 1;
 
-		  if (py)
-		    *ptr ^= bitmask;
-		  bitmask >>= 1;
-                }
+  if ((p = calloc(1, sizeof(band_pipe_t))) == NULL)
+    return (NULL);
 
-                if (bitmask > 1)
-		  bitmask >>= 1;
-		else
-        	{
-        	  bitmask = 128;
-        	  ptr ++;
-        	}
-              }
-              break;
-
-          case 2 :
-	      dither = Floyd8x8[y & 7];
-
-              for (x = xsize ; x > 0; x --, r0 += 4)
-              {
-	       	if ((r0[0] & 63) > dither[x & 7])
-        	  *ptr ^= (0xc0 & OnPixels[r0[0]]);
-        	else
-        	  *ptr ^= (0xc0 & OffPixels[r0[0]]);
-
-        	if ((r0[1] & 63) > dither[x & 7])
-        	  *ptr ^= (0x30 & OnPixels[r0[1]]);
-        	else
-        	  *ptr ^= (0x30 & OffPixels[r0[1]]);
-
-        	if ((r0[2] & 63) > dither[x & 7])
-        	  *ptr ^= (0x0c & OnPixels[r0[2]]);
-        	else
-        	  *ptr ^= (0x0c & OffPixels[r0[2]]);
-
-        	if ((r0[3] & 63) > dither[x & 7])
-        	  *ptr++ ^= (0x03 & OnPixels[r0[3]]);
-        	else
-        	  *ptr++ ^= (0x03 & OffPixels[r0[3]]);
-              }
-              break;
-
-          case 4 :
-	      dither = Floyd4x4[y & 3];
-
-              for (x = xsize ; x > 0; x --, r0 += 4)
-              {
-        	if ((r0[0] & 15) > dither[x & 3])
-        	  *ptr ^= (0xf0 & OnPixels[r0[0]]);
-        	else
-        	  *ptr ^= (0xf0 & OffPixels[r0[0]]);
-
-        	if ((r0[1] & 15) > dither[x & 3])
-        	  *ptr++ ^= (0x0f & OnPixels[r0[1]]);
-        	else
-        	  *ptr++ ^= (0x0f & OffPixels[r0[1]]);
-
-        	if ((r0[2] & 15) > dither[x & 3])
-        	  *ptr ^= (0xf0 & OnPixels[r0[2]]);
-        	else
-        	  *ptr ^= (0xf0 & OffPixels[r0[2]]);
-
-        	if ((r0[3] & 15) > dither[x & 3])
-        	  *ptr++ ^= (0x0f & OnPixels[r0[3]]);
-        	else
-        	  *ptr++ ^= (0x0f & OffPixels[r0[3]]);
-              }
-              break;
-
-          case 8 :
-              for (x = xsize  * 4; x > 0; x --, r0 ++, r1 ++)
-        	if (*r0 == *r1)
-                  *ptr++ = *r0;
-        	else
-                  *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
-              break;
-        }
-        break;
+  p->header    = header;
+  p->format    = format;
+  p->ras       = ras;
+  p->img       = img;
+  p->cur0      = -1;
+  p->cur1      = -1;
+  p->num_bands = 2 * num_threads;
 
-    case CUPS_ORDER_BANDED :
-	cptr = ptr;
-	mptr = ptr + bandwidth;
-	yptr = ptr + 2 * bandwidth;
-	kptr = ptr + 3 * bandwidth;
-
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 0x80 >> (bitoffset & 7);
-	      dither  = Floyd16x16[y & 15];
-
-              for (x = xsize; x > 0; x --)
-              {
-	        pc = *r0++ > dither[x & 15];
-		pm = *r0++ > dither[x & 15];
-		py = *r0++ > dither[x & 15];
-
-		if (pc && pm && py)
-		  *kptr ^= bitmask;
-		else
-		{
-		  if (pc)
-        	    *cptr ^= bitmask;
-		  if (pm)
-        	    *mptr ^= bitmask;
-		  if (py)
-        	    *yptr ^= bitmask;
-                }
-
-                if (bitmask > 1)
-		  bitmask >>= 1;
-		else
-		{
-		  bitmask = 0x80;
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-		  kptr ++;
-        	}
-	      }
-              break;
-
-          case 2 :
-              bitmask = 0xc0 >> (bitoffset & 7);
-	      dither  = Floyd8x8[y & 7];
-
-              for (x = xsize; x > 0; x --)
-              {
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *cptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *cptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *mptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *mptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *yptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *yptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *kptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *kptr ^= (bitmask & OffPixels[*r0++]);
-
-                if (bitmask > 3)
-		  bitmask >>= 2;
-		else
-		{
-		  bitmask = 0xc0;
-
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-		  kptr ++;
-        	}
-	      }
-              break;
-
-          case 4 :
-              bitmask = 0xf0 >> (bitoffset & 7);
-	      dither  = Floyd4x4[y & 3];
-
-              for (x = xsize; x > 0; x --)
-              {
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *cptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *cptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *mptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *mptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *yptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *yptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *kptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *kptr ^= (bitmask & OffPixels[*r0++]);
-
-                if (bitmask == 0xf0)
-		  bitmask = 0x0f;
-		else
-		{
-		  bitmask = 0xf0;
-
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-		  kptr ++;
-        	}
-	      }
-              break;
-
-          case 8 :
-              for (x = xsize; x > 0; x --, r0 += 4, r1 += 4)
-	      {
-        	if (r0[0] == r1[0])
-                  *cptr++ = r0[0];
-        	else
-                  *cptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
-
-        	if (r0[1] == r1[1])
-                  *mptr++ = r0[1];
-        	else
-                  *mptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
-
-        	if (r0[2] == r1[2])
-                  *yptr++ = r0[2];
-        	else
-                  *yptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
-
-        	if (r0[3] == r1[3])
-                  *kptr++ = r0[3];
-        	else
-                  *kptr++ = (r0[3] * yerr0 + r1[3] * yerr1) / ysize;
-              }
-              break;
-        }
-        break;
-
-    case CUPS_ORDER_PLANAR :
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 0x80 >> (bitoffset & 7);
-	      dither  = Floyd16x16[y & 15];
-
-              for (x = xsize; x > 0; x --)
-              {
-	        pc = *r0++ > dither[x & 15];
-		pm = *r0++ > dither[x & 15];
-		py = *r0++ > dither[x & 15];
-
-		if ((pc && pm && py && z == 3) ||
-		    (pc && z == 0) || (pm && z == 1) || (py && z == 2))
-        	  *ptr ^= bitmask;
-
-                if (bitmask > 1)
-		  bitmask >>= 1;
-		else
-		{
-		  bitmask = 0x80;
-		  ptr ++;
-        	}
-	      }
-	      break;
-
-          case 2 :
-              bitmask = 0xc0 >> (bitoffset & 7);
-	      dither  = Floyd8x8[y & 7];
-              r0      += z;
-
-              for (x = xsize; x > 0; x --, r0 += 4)
-              {
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *ptr ^= (bitmask & OnPixels[*r0]);
-        	else
-        	  *ptr ^= (bitmask & OffPixels[*r0]);
-
-                if (bitmask > 3)
-		  bitmask >>= 2;
-		else
-		{
-		  bitmask = 0xc0;
-
-		  ptr ++;
-        	}
-	      }
-              break;
-
-          case 4 :
-              bitmask = 0xf0 >> (bitoffset & 7);
-	      dither  = Floyd4x4[y & 3];
-              r0 += z;
-
-              for (x = xsize; x > 0; x --, r0 += 4)
-              {
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *ptr ^= (bitmask & OnPixels[*r0]);
-        	else
-        	  *ptr ^= (bitmask & OffPixels[*r0]);
-
-                if (bitmask == 0xf0)
-		  bitmask = 0x0f;
-		else
-		{
-		  bitmask = 0xf0;
-
-		  ptr ++;
-        	}
-	      }
-              break;
-
-          case 8 :
-              r0 += z;
-	      r1 += z;
-
-              for (x = xsize; x > 0; x --, r0 += 4, r1 += 4)
-	      {
-        	if (*r0 == *r1)
-                  *ptr++ = *r0;
-        	else
-                  *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
-              }
-              break;
-        }
-        break;
-  }
-}
+  if ((p->bands = calloc(p->num_bands, sizeof(band_t))) == NULL)
+  {
+    free(p);
+    return (NULL);
+  }
 
+  for (i = 0; i < p->num_bands; i ++)
+    if ((p->bands[i].lines = malloc(BAND_LINES *
+                                    header->cupsBytesPerLine)) == NULL)
+    {
+      while (i > 0)
+        free(p->bands[--i].lines);
 
-/*
- * 'format_K()' - Convert image data to black.
- */
+      free(p->bands);
+      free(p);
+      return (NULL);
+    }
 
-static void
-format_K(cups_page_header2_t *header,	/* I - Page header */
-         unsigned char       *row,	/* IO - Bitmap data for device */
-	 int                 y,		/* I - Current row */
-	 int                 z,		/* I - Current plane */
-	 int                 xsize,	/* I - Width of image data */
-	 int	             ysize,	/* I - Height of image data */
-	 int                 yerr0,	/* I - Top Y error */
-	 int                 yerr1,	/* I - Bottom Y error */
-	 cups_ib_t           *r0,	/* I - Primary image data */
-	 cups_ib_t           *r1)	/* I - Image data for interpolation */
-{
-  cups_ib_t	*ptr,			/* Pointer into row */
-		bitmask;		/* Current mask for pixel */
-  int		bitoffset;		/* Current offset in line */
-  int		x,			/* Current X coordinate on page */
-		*dither;		/* Pointer into dither array */
+  pthread_mutex_init(&p->mutex, NULL);
+  pthread_cond_init(&p->cond, NULL);
 
+  for (i = 0; i < num_threads; i ++)
+    if (pthread_create(p->threads + i, NULL, band_thread, p))
+      break;
 
-  (void)z;
+  p->num_threads = i;
 
-  switch (XPosition)
+  if (i == 0)
   {
-    case -1 :
-        bitoffset = 0;
-	break;
-    default :
-        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
-	break;
-    case 1 :
-        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
-	break;
+    band_delete(p);
+    return (NULL);
   }
 
-  ptr = row + bitoffset / 8;
-
-  switch (header->cupsBitsPerColor)
-  {
-    case 1 :
-        bitmask = 0x80 >> (bitoffset & 7);
-        dither  = Floyd16x16[y & 15];
-
-        for (x = xsize; x > 0; x --)
-        {
-          if (*r0++ > dither[x & 15])
-            *ptr ^= bitmask;
-
-          if (bitmask > 1)
-	    bitmask >>= 1;
-	  else
-	  {
-	    bitmask = 0x80;
-	    ptr ++;
-          }
-	}
-        break;
-
-    case 2 :
-        bitmask = 0xc0 >> (bitoffset & 7);
-        dither  = Floyd8x8[y & 7];
-
-        for (x = xsize; x > 0; x --)
-        {
-          if ((*r0 & 63) > dither[x & 7])
-            *ptr ^= (bitmask & OnPixels[*r0++]);
-          else
-            *ptr ^= (bitmask & OffPixels[*r0++]);
-
-          if (bitmask > 3)
-	    bitmask >>= 2;
-	  else
-	  {
-	    bitmask = 0xc0;
-
-	    ptr ++;
-          }
-	}
-        break;
-
-    case 4 :
-        bitmask = 0xf0 >> (bitoffset & 7);
-        dither  = Floyd4x4[y & 3];
-
-        for (x = xsize; x > 0; x --)
-        {
-          if ((*r0 & 15) > dither[x & 3])
-            *ptr ^= (bitmask & OnPixels[*r0++]);
-          else
-            *ptr ^= (bitmask & OffPixels[*r0++]);
-
-          if (bitmask == 0xf0)
-	    bitmask = 0x0f;
-	  else
-	  {
-	    bitmask = 0xf0;
-
-	    ptr ++;
-          }
-	}
-        break;
-
-    case 8 :
-        for (x = xsize; x > 0; x --, r0 ++, r1 ++)
-	{
-          if (*r0 == *r1)
-            *ptr++ = *r0;
-          else
-            *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
-        }
-        break;
-  }
+  return (p);
 }
 
 
 /*
- * 'format_KCMY()' - Convert image data to KCMY.
+ * 'band_thread()' - Format bands of lines.
  */
 
-static void
-format_KCMY(cups_page_header2_t *header,/* I - Page header */
-            unsigned char       *row,	/* IO - Bitmap data for device */
-	    int                 y,	/* I - Current row */
-	    int                 z,	/* I - Current plane */
-	    int                 xsize,	/* I - Width of image data */
-	    int	                ysize,	/* I - Height of image data */
-	    int                 yerr0,	/* I - Top Y error */
-	    int                 yerr1,	/* I - Bottom Y error */
-	    cups_ib_t           *r0,	/* I - Primary image data */
-	    cups_ib_t           *r1)	/* I - Image data for interpolation */
+static void *				/* O - Thread exit status */
+band_thread(void *data)			/* I - Band threads */
 {
-  cups_ib_t	*ptr,			/* Pointer into row */
-		*cptr,			/* Pointer into cyan */
-		*mptr,			/* Pointer into magenta */
-		*yptr,			/* Pointer into yellow */
-		*kptr,			/* Pointer into black */
-		bitmask;		/* Current mask for pixel */
-  int		bitoffset;		/* Current offset in line */
-  int		bandwidth;		/* Width of a color band */
-  int		x,			/* Current X coordinate on page */
-		*dither;		/* Pointer into dither array */
-  int		pc, pm, py;		/* CMY pixels */
-
-
-  switch (XPosition)
-  {
-    case -1 :
-        bitoffset = 0;
-	break;
-    default :
-        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
-	break;
-    case 1 :
-        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
-	break;
-  }
-
-  ptr       = row + bitoffset / 8;
-  bandwidth = header->cupsBytesPerLine / 4;
-
-  switch (header->cupsColorOrder)
-  {
-    case CUPS_ORDER_CHUNKED :
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 128 >> (bitoffset & 7);
-              dither  = Floyd16x16[y & 15];
-
-              for (x = xsize ; x > 0; x --)
-              {
-	        pc = *r0++ > dither[x & 15];
-		pm = *r0++ > dither[x & 15];
-		py = *r0++ > dither[x & 15];
-
-		if (pc && pm && py)
-		{
-		  *ptr ^= bitmask;
-		  bitmask >>= 3;
-		}
-		else
-		{
-		  bitmask >>= 1;
-		  if (pc)
-		    *ptr ^= bitmask;
-
-		  bitmask >>= 1;
-		  if (pm)
-		    *ptr ^= bitmask;
-
-		  bitmask >>= 1;
-		  if (py)
-		    *ptr ^= bitmask;
-                }
-
-                if (bitmask > 1)
-		  bitmask >>= 1;
-		else
-        	{
-        	  bitmask = 128;
-        	  ptr ++;
-        	}
-              }
-              break;
-
-          case 2 :
-              dither = Floyd8x8[y & 7];
-
-              for (x = xsize ; x > 0; x --, r0 += 4)
-              {
-	       	if ((r0[3] & 63) > dither[x & 7])
-        	  *ptr ^= (0xc0 & OnPixels[r0[3]]);
-        	else
-        	  *ptr ^= (0xc0 & OffPixels[r0[3]]);
-
-        	if ((r0[0] & 63) > dither[x & 7])
-        	  *ptr ^= (0x30 & OnPixels[r0[0]]);
-        	else
-        	  *ptr ^= (0x30 & OffPixels[r0[0]]);
-
-        	if ((r0[1] & 63) > dither[x & 7])
-        	  *ptr ^= (0x0c & OnPixels[r0[1]]);
-        	else
-        	  *ptr ^= (0x0c & OffPixels[r0[1]]);
-
-        	if ((r0[2] & 63) > dither[x & 7])
-        	  *ptr++ ^= (0x03 & OnPixels[r0[2]]);
-        	else
-        	  *ptr++ ^= (0x03 & OffPixels[r0[2]]);
-              }
-              break;
-
-          case 4 :
-              dither = Floyd4x4[y & 3];
-
-              for (x = xsize ; x > 0; x --, r0 += 4)
-              {
-        	if ((r0[3] & 15) > dither[x & 3])
-        	  *ptr ^= (0xf0 & OnPixels[r0[3]]);
-        	else
-        	  *ptr ^= (0xf0 & OffPixels[r0[3]]);
-
-        	if ((r0[0] & 15) > dither[x & 3])
-        	  *ptr++ ^= (0x0f & OnPixels[r0[0]]);
-        	else
-        	  *ptr++ ^= (0x0f & OffPixels[r0[0]]);
-
-        	if ((r0[1] & 15) > dither[x & 3])
-        	  *ptr ^= (0xf0 & OnPixels[r0[1]]);
-        	else
-        	  *ptr ^= (0xf0 & OffPixels[r0[1]]);
-
-        	if ((r0[2] & 15) > dither[x & 3])
-        	  *ptr++ ^= (0x0f & OnPixels[r0[2]]);
-        	else
-        	  *ptr++ ^= (0x0f & OffPixels[r0[2]]);
-              }
-              break;
-
-          case 8 :
-              for (x = xsize; x > 0; x --, r0 += 4, r1 += 4)
-	      {
-        	if (r0[3] == r1[3])
-                  *ptr++ = r0[3];
-        	else
-                  *ptr++ = (r0[3] * yerr0 + r1[3] * yerr1) / ysize;
-
-        	if (r0[0] == r1[0])
-                  *ptr++ = r0[0];
-        	else
-                  *ptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
-
-        	if (r0[1] == r1[1])
-                  *ptr++ = r0[1];
-        	else
-                  *ptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
-
-        	if (r0[2] == r1[2])
-                  *ptr++ = r0[2];
-        	else
-                  *ptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
-              }
-              break;
-        }
-        break;
-
-    case CUPS_ORDER_BANDED :
-	kptr = ptr;
-	cptr = ptr + bandwidth;
-	mptr = ptr + 2 * bandwidth;
-	yptr = ptr + 3 * bandwidth;
-
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 0x80 >> (bitoffset & 7);
-              dither  = Floyd16x16[y & 15];
-
-              for (x = xsize; x > 0; x --)
-              {
-	        pc = *r0++ > dither[x & 15];
-		pm = *r0++ > dither[x & 15];
-		py = *r0++ > dither[x & 15];
-
-		if (pc && pm && py)
-		  *kptr ^= bitmask;
-		else
-		{
-		  if (pc)
-        	    *cptr ^= bitmask;
-		  if (pm)
-        	    *mptr ^= bitmask;
-		  if (py)
-        	    *yptr ^= bitmask;
-                }
-
-                if (bitmask > 1)
-		  bitmask >>= 1;
-		else
-		{
-		  bitmask = 0x80;
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-		  kptr ++;
-        	}
-	      }
-              break;
-
-          case 2 :
-              bitmask = 0xc0 >> (bitoffset & 7);
-              dither  = Floyd8x8[y & 7];
-
-              for (x = xsize; x > 0; x --)
-              {
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *cptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *cptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *mptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *mptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *yptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *yptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *kptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *kptr ^= (bitmask & OffPixels[*r0++]);
-
-                if (bitmask > 3)
-		  bitmask >>= 2;
-		else
-		{
-		  bitmask = 0xc0;
-
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-		  kptr ++;
-        	}
-	      }
-              break;
-
-          case 4 :
-              bitmask = 0xf0 >> (bitoffset & 7);
-              dither  = Floyd4x4[y & 3];
-
-              for (x = xsize; x > 0; x --)
-              {
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *cptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *cptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *mptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *mptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *yptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *yptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *kptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *kptr ^= (bitmask & OffPixels[*r0++]);
-
-                if (bitmask == 0xf0)
-		  bitmask = 0x0f;
-		else
-		{
-		  bitmask = 0xf0;
-
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-		  kptr ++;
-        	}
-	      }
-              break;
-
-          case 8 :
-              for (x = xsize; x > 0; x --, r0 += 4, r1 += 4)
-	      {
-        	if (r0[0] == r1[0])
-                  *cptr++ = r0[0];
-        	else
-                  *cptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
-
-        	if (r0[1] == r1[1])
-                  *mptr++ = r0[1];
-        	else
-                  *mptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
-
-        	if (r0[2] == r1[2])
-                  *yptr++ = r0[2];
-        	else
-                  *yptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
-
-        	if (r0[3] == r1[3])
-                  *kptr++ = r0[3];
-        	else
-                  *kptr++ = (r0[3] * yerr0 + r1[3] * yerr1) / ysize;
-              }
-              break;
-        }
-        break;
-
-    case CUPS_ORDER_PLANAR :
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 0x80 >> (bitoffset & 7);
-              dither  = Floyd16x16[y & 15];
-
-              for (x = xsize; x > 0; x --)
-              {
-	        pc = *r0++ > dither[x & 15];
-		pm = *r0++ > dither[x & 15];
-		py = *r0++ > dither[x & 15];
-
-		if ((pc && pm && py && z == 0) ||
-		    (pc && z == 1) || (pm && z == 2) || (py && z == 3))
-        	  *ptr ^= bitmask;
-
-                if (bitmask > 1)
-		  bitmask >>= 1;
-		else
-		{
-		  bitmask = 0x80;
-		  ptr ++;
-        	}
-	      }
-	      break;
-
-          case 2 :
-              bitmask = 0xc0 >> (bitoffset & 7);
-              dither  = Floyd8x8[y & 7];
-              if (z == 0)
-	        r0 += 3;
-	      else
-	        r0 += z - 1;
-
-              for (x = xsize; x > 0; x --, r0 += 4)
-              {
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *ptr ^= (bitmask & OnPixels[*r0]);
-        	else
-        	  *ptr ^= (bitmask & OffPixels[*r0]);
+  band_pipe_t	*p = (band_pipe_t *)data;
+					/* Band threads */
+  band_t	*b;			/* Current band */
+  int		i;			/* Looping var */
+  unsigned	bpl = p->header->cupsBytesPerLine;
+					/* Bytes per line */
 
-                if (bitmask > 3)
-		  bitmask >>= 2;
-		else
-		{
-		  bitmask = 0xc0;
-
-		  ptr ++;
-        	}
-	      }
-              break;
-
-          case 4 :
-              bitmask = 0xf0 >> (bitoffset & 7);
-              dither  = Floyd4x4[y & 3];
-              if (z == 0)
-	        r0 += 3;
-	      else
-	        r0 += z - 1;
-
-              for (x = xsize; x > 0; x --, r0 += 4)
-              {
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *ptr ^= (bitmask & OnPixels[*r0]);
-        	else
-        	  *ptr ^= (bitmask & OffPixels[*r0]);
-
-                if (bitmask == 0xf0)
-		  bitmask = 0x0f;
-		else
-		{
-		  bitmask = 0xf0;
-
-		  ptr ++;
-        	}
-	      }
-              break;
-
-          case 8 :
-              if (z == 0)
-	      {
-	        r0 += 3;
-	        r1 += 3;
-	      }
-	      else
-	      {
-	        r0 += z - 1;
-	        r1 += z - 1;
-	      }
-
-              for (x = xsize; x > 0; x --, r0 += 4, r1 += 4)
-	      {
-        	if (*r0 == *r1)
-                  *ptr++ = *r0;
-        	else
-                  *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
-              }
-              break;
-        }
-        break;
-  }
-}
-
-
-/*
- * 'format_KCMYcm()' - Convert image data to KCMYcm.
- */
-
-static void
-format_KCMYcm(
-    cups_page_header2_t *header,	/* I - Page header */
-    unsigned char       *row,		/* IO - Bitmap data for device */
-    int                 y,		/* I - Current row */
-    int                 z,		/* I - Current plane */
-    int                 xsize,		/* I - Width of image data */
-    int                 ysize,		/* I - Height of image data */
-    int                 yerr0,		/* I - Top Y error */
-    int                 yerr1,		/* I - Bottom Y error */
-    cups_ib_t           *r0,		/* I - Primary image data */
-    cups_ib_t           *r1)		/* I - Image data for interpolation */
-{
-  int		pc, pm, py, pk;		/* Cyan, magenta, yellow, and black values */
-  cups_ib_t	*ptr,			/* Pointer into row */
-		*cptr,			/* Pointer into cyan */
-		*mptr,			/* Pointer into magenta */
-		*yptr,			/* Pointer into yellow */
-		*kptr,			/* Pointer into black */
-		*lcptr,			/* Pointer into light cyan */
-		*lmptr,			/* Pointer into light magenta */
-		bitmask;		/* Current mask for pixel */
-  int		bitoffset;		/* Current offset in line */
-  int		bandwidth;		/* Width of a color band */
-  int		x,			/* Current X coordinate on page */
-		*dither;		/* Pointer into dither array */
-
-
-  switch (XPosition)
-  {
-    case -1 :
-        bitoffset = 0;
-	break;
-    default :
-        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
-	break;
-    case 1 :
-        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
-	break;
-  }
 
-  ptr       = row + bitoffset / 8;
-  bandwidth = header->cupsBytesPerLine / 6;
+  pthread_mutex_lock(&p->mutex);
 
-  switch (header->cupsColorOrder)
+  for (;;)
   {
-    case CUPS_ORDER_CHUNKED :
-        dither = Floyd16x16[y & 15];
+    while (!p->shutdown && p->formatted >= p->filled)
+      pthread_cond_wait(&p->cond, &p->mutex);
 
-        for (x = xsize ; x > 0; x --)
-        {
-	  pc = *r0++ > dither[x & 15];
-	  pm = *r0++ > dither[x & 15];
-	  py = *r0++ > dither[x & 15];
-	  pk = pc && pm && py;
-
-	  if (pk)
-	    *ptr++ ^= 32;	/* Black */
-	  else if (pc && pm)
-	    *ptr++ ^= 17;	/* Blue (cyan + light magenta) */
-	  else if (pc && py)
-	    *ptr++ ^= 6;	/* Green (light cyan + yellow) */
-	  else if (pm && py)
-	    *ptr++ ^= 12;	/* Red (magenta + yellow) */
-	  else if (pc)
-	    *ptr++ ^= 16;
-	  else if (pm)
-	    *ptr++ ^= 8;
-	  else if (py)
-	    *ptr++ ^= 4;
-	  else
-	    ptr ++;
-        }
-        break;
+    if (p->formatted >= p->filled)
+      break;
 
-    case CUPS_ORDER_BANDED :
-	kptr  = ptr;
-	cptr  = ptr + bandwidth;
-	mptr  = ptr + 2 * bandwidth;
-	yptr  = ptr + 3 * bandwidth;
-	lcptr = ptr + 4 * bandwidth;
-	lmptr = ptr + 5 * bandwidth;
+    b = p->bands + p->formatted % p->num_bands;
+    p->formatted ++;
 
-        bitmask = 0x80 >> (bitoffset & 7);
-        dither  = Floyd16x16[y & 15];
+    pthread_mutex_unlock(&p->mutex);
 
-        for (x = xsize; x > 0; x --)
-        {
-	  pc = *r0++ > dither[x & 15];
-	  pm = *r0++ > dither[x & 15];
-	  py = *r0++ > dither[x & 15];
-	  pk = pc && pm && py;
-
-	  if (pk)
-	    *kptr ^= bitmask;	/* Black */
-	  else if (pc && pm)
-	  {
-	    *cptr ^= bitmask;	/* Blue (cyan + light magenta) */
-	    *lmptr ^= bitmask;
-	  }
-	  else if (pc && py)
-	  {
-	    *lcptr ^= bitmask;	/* Green (light cyan + yellow) */
-	    *yptr  ^= bitmask;
-	  }
-	  else if (pm && py)
-	  {
-	    *mptr ^= bitmask;	/* Red (magenta + yellow) */
-	    *yptr ^= bitmask;
-	  }
-	  else if (pc)
-	    *cptr ^= bitmask;
-	  else if (pm)
-	    *mptr ^= bitmask;
-	  else if (py)
-	    *yptr ^= bitmask;
-
-          if (bitmask > 1)
-	    bitmask >>= 1;
-	  else
-	  {
-	    bitmask = 0x80;
-	    cptr ++;
-	    mptr ++;
-	    yptr ++;
-	    kptr ++;
-	    lcptr ++;
-	    lmptr ++;
-          }
-	}
-        break;
+    for (i = 0; i < b->count; i ++)
+      (*p->format)(p->header, b->lines + i * bpl, b->y[i], b->plane,
+                   b->xsize, b->ysize, b->yerr0[i], b->yerr1[i],
+		   b->rows + b->r0[i] * b->rowsize,
+		   b->rows + b->r1[i] * b->rowsize);
 
-    case CUPS_ORDER_PLANAR :
-        bitmask = 0x80 >> (bitoffset & 7);
-        dither  = Floyd16x16[y & 15];
+    pthread_mutex_lock(&p->mutex);
 
-        for (x = xsize; x > 0; x --)
-        {
-	  pc = *r0++ > dither[x & 15];
-	  pm = *r0++ > dither[x & 15];
-	  py = *r0++ > dither[x & 15];
-	  pk = pc && pm && py;
-
-          if (pk && z == 0)
-            *ptr ^= bitmask;
-	  else if (pc && pm && (z == 1 || z == 5))
-	    *ptr ^= bitmask;	/* Blue (cyan + light magenta) */
-	  else if (pc && py && (z == 3 || z == 4))
-	    *ptr ^= bitmask;	/* Green (light cyan + yellow) */
-	  else if (pm && py && (z == 2 || z == 3))
-	    *ptr ^= bitmask;	/* Red (magenta + yellow) */
-	  else if (pc && z == 1)
-	    *ptr ^= bitmask;
-	  else if (pm && z == 2)
-	    *ptr ^= bitmask;
-	  else if (py && z == 3)
-	    *ptr ^= bitmask;
-
-          if (bitmask > 1)
-	    bitmask >>= 1;
-	  else
-	  {
-	    bitmask = 0x80;
-	    ptr ++;
-          }
-	}
-        break;
+    b->state = BAND_DONE;
+    pthread_cond_broadcast(&p->cond);
   }
-}
-
 
-/*
- * 'format_RGBA()' - Convert image data to RGBA/RGBW.
- */
-
-static void
-format_RGBA(cups_page_header2_t *header,/* I - Page header */
-            unsigned char       *row,	/* IO - Bitmap data for device */
-	    int                 y,	/* I - Current row */
-	    int                 z,	/* I - Current plane */
-	    int                 xsize,	/* I - Width of image data */
-	    int	                ysize,	/* I - Height of image data */
-	    int                 yerr0,	/* I - Top Y error */
-	    int                 yerr1,	/* I - Bottom Y error */
-	    cups_ib_t           *r0,	/* I - Primary image data */
-	    cups_ib_t           *r1)	/* I - Image data for interpolation */
-{
-  cups_ib_t	*ptr,			/* Pointer into row */
-		*cptr,			/* Pointer into cyan */
-		*mptr,			/* Pointer into magenta */
-		*yptr,			/* Pointer into yellow */
-		bitmask;		/* Current mask for pixel */
-  int		bitoffset;		/* Current offset in line */
-  int		bandwidth;		/* Width of a color band */
-  int		x,			/* Current X coordinate on page */
-		*dither;		/* Pointer into dither array */
-
-
-  switch (XPosition)
-  {
-    case -1 :
-        bitoffset = 0;
-	break;
-    default :
-        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
-	break;
-    case 1 :
-        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
-	break;
-  }
-
-  ptr       = row + bitoffset / 8;
-  bandwidth = header->cupsBytesPerLine / 4;
-
-  switch (header->cupsColorOrder)
-  {
-    case CUPS_ORDER_CHUNKED :
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 128 >> (bitoffset & 7);
-	      dither  = Floyd16x16[y & 15];
-
-              for (x = xsize ; x > 0; x --)
-              {
-	        if (*r0++ > dither[x & 15])
-		  *ptr ^= bitmask;
-		bitmask >>= 1;
-
-	        if (*r0++ > dither[x & 15])
-		  *ptr ^= bitmask;
-		bitmask >>= 1;
-
-	        if (*r0++ > dither[x & 15])
-		  *ptr ^= bitmask;
-
-                if (bitmask > 2)
-		  bitmask >>= 2;
-		else
-        	{
-        	  bitmask = 128;
-        	  ptr ++;
-        	}
-              }
-              break;
-
-          case 2 :
-	      dither = Floyd8x8[y & 7];
-
-              for (x = xsize ; x > 0; x --, r0 += 3)
-              {
-	       	if ((r0[0] & 63) > dither[x & 7])
-        	  *ptr ^= (0xc0 & OnPixels[r0[0]]);
-        	else
-        	  *ptr ^= (0xc0 & OffPixels[r0[0]]);
-
-        	if ((r0[1] & 63) > dither[x & 7])
-        	  *ptr ^= (0x30 & OnPixels[r0[1]]);
-        	else
-        	  *ptr ^= (0x30 & OffPixels[r0[1]]);
-
-        	if ((r0[2] & 63) > dither[x & 7])
-        	  *ptr ^= (0x0c & OnPixels[r0[2]]);
-        	else
-        	  *ptr ^= (0x0c & OffPixels[r0[2]]);
-
-                ptr ++;
-              }
-              break;
-
-          case 4 :
-	      dither = Floyd4x4[y & 3];
-
-              for (x = xsize ; x > 0; x --, r0 += 3)
-              {
-        	if ((r0[0] & 15) > dither[x & 3])
-        	  *ptr ^= (0xf0 & OnPixels[r0[0]]);
-        	else
-        	  *ptr ^= (0xf0 & OffPixels[r0[0]]);
-
-        	if ((r0[1] & 15) > dither[x & 3])
-        	  *ptr++ ^= (0x0f & OnPixels[r0[1]]);
-        	else
-        	  *ptr++ ^= (0x0f & OffPixels[r0[1]]);
-
-        	if ((r0[2] & 15) > dither[x & 3])
-        	  *ptr ^= (0xf0 & OnPixels[r0[2]]);
-        	else
-        	  *ptr ^= (0xf0 & OffPixels[r0[2]]);
-
-                ptr ++;
-              }
-              break;
-
-          case 8 :
-              for (x = xsize; x > 0; x --, r0 += 3, r1 += 3)
-	      {
-        	if (r0[0] == r1[0])
-                  *ptr++ = r0[0];
-        	else
-                  *ptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
-
-        	if (r0[1] == r1[1])
-                  *ptr++ = r0[1];
-        	else
-                  *ptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
-
-        	if (r0[2] == r1[2])
-                  *ptr++ = r0[2];
-        	else
-                  *ptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
-
-                ptr ++;
-              }
-	      break;
-        }
-        break;
-
-    case CUPS_ORDER_BANDED :
-	cptr = ptr;
-	mptr = ptr + bandwidth;
-	yptr = ptr + 2 * bandwidth;
-
-        memset(ptr + 3 * bandwidth, 255, bandwidth);
-
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 0x80 >> (bitoffset & 7);
-	      dither  = Floyd16x16[y & 15];
-
-              for (x = xsize; x > 0; x --)
-              {
-        	if (*r0++ > dither[x & 15])
-        	  *cptr ^= bitmask;
-        	if (*r0++ > dither[x & 15])
-        	  *mptr ^= bitmask;
-        	if (*r0++ > dither[x & 15])
-        	  *yptr ^= bitmask;
-
-                if (bitmask > 1)
-		  bitmask >>= 1;
-		else
-		{
-		  bitmask = 0x80;
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-        	}
-	      }
-              break;
-
-          case 2 :
-              bitmask = 0xc0 >> (bitoffset & 7);
-	      dither  = Floyd8x8[y & 7];
-
-              for (x = xsize; x > 0; x --)
-              {
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *cptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *cptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *mptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *mptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *yptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *yptr ^= (bitmask & OffPixels[*r0++]);
-
-                if (bitmask > 3)
-		  bitmask >>= 2;
-		else
-		{
-		  bitmask = 0xc0;
-
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-        	}
-	      }
-              break;
-
-          case 4 :
-              bitmask = 0xf0 >> (bitoffset & 7);
-	      dither  = Floyd4x4[y & 3];
-
-              for (x = xsize; x > 0; x --)
-              {
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *cptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *cptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *mptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *mptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *yptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *yptr ^= (bitmask & OffPixels[*r0++]);
-
-                if (bitmask == 0xf0)
-		  bitmask = 0x0f;
-		else
-		{
-		  bitmask = 0xf0;
+  pthread_mutex_unlock(&p->mutex);
 
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-        	}
-	      }
-              break;
-
-          case 8 :
-              for (x = xsize; x > 0; x --, r0 += 3, r1 += 3)
-	      {
-        	if (r0[0] == r1[0])
-                  *cptr++ = r0[0];
-        	else
-                  *cptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
-
-        	if (r0[1] == r1[1])
-                  *mptr++ = r0[1];
-        	else
-                  *mptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
-
-        	if (r0[2] == r1[2])
-                  *yptr++ = r0[2];
-        	else
-                  *yptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
-              }
-              break;
-        }
-        break;
-
-    case CUPS_ORDER_PLANAR :
-        if (z == 3)
-	{
-          memset(row, 255, header->cupsBytesPerLine);
-	  break;
-        }
-
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 0x80 >> (bitoffset & 7);
-	      dither  = Floyd16x16[y & 15];
-
-              switch (z)
-	      {
-	        case 0 :
-        	    for (x = xsize; x > 0; x --, r0 += 3)
-        	    {
-        	      if (r0[0] > dither[x & 15])
-        		*ptr ^= bitmask;
-
-                      if (bitmask > 1)
-			bitmask >>= 1;
-		      else
-		      {
-			bitmask = 0x80;
-			ptr ++;
-        	      }
-	            }
-		    break;
-
-	        case 1 :
-        	    for (x = xsize; x > 0; x --, r0 += 3)
-        	    {
-        	      if (r0[1] > dither[x & 15])
-        		*ptr ^= bitmask;
-
-                      if (bitmask > 1)
-			bitmask >>= 1;
-		      else
-		      {
-			bitmask = 0x80;
-			ptr ++;
-        	      }
-	            }
-		    break;
-
-	        case 2 :
-        	    for (x = xsize; x > 0; x --, r0 += 3)
-        	    {
-        	      if (r0[2] > dither[x & 15])
-        		*ptr ^= bitmask;
-
-                      if (bitmask > 1)
-			bitmask >>= 1;
-		      else
-		      {
-			bitmask = 0x80;
-			ptr ++;
-        	      }
-	            }
-		    break;
-	      }
-              break;
-
-          case 2 :
-              bitmask = 0xc0 >> (bitoffset & 7);
-	      dither  = Floyd8x8[y & 7];
-              r0 += z;
-
-              for (x = xsize; x > 0; x --, r0 += 3)
-              {
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *ptr ^= (bitmask & OnPixels[*r0]);
-        	else
-        	  *ptr ^= (bitmask & OffPixels[*r0]);
-
-                if (bitmask > 3)
-		  bitmask >>= 2;
-		else
-		{
-		  bitmask = 0xc0;
-
-		  ptr ++;
-        	}
-	      }
-              break;
-
-          case 4 :
-              bitmask = 0xf0 >> (bitoffset & 7);
-	      dither  = Floyd4x4[y & 3];
-              r0 += z;
-
-              for (x = xsize; x > 0; x --, r0 += 3)
-              {
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *ptr ^= (bitmask & OnPixels[*r0]);
-        	else
-        	  *ptr ^= (bitmask & OffPixels[*r0]);
-
-                if (bitmask == 0xf0)
-		  bitmask = 0x0f;
-		else
-		{
-		  bitmask = 0xf0;
-
-		  ptr ++;
-        	}
-	      }
-              break;
-
-          case 8 :
-              r0 += z;
-	      r1 += z;
-
-              for (x = xsize; x > 0; x --, r0 += 3, r1 += 3)
-	      {
-        	if (*r0 == *r1)
-                  *ptr++ = *r0;
-        	else
-                  *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
-              }
-              break;
-        }
-        break;
-  }
-}
-
-
-/*
- * 'format_W()' - Convert image data to luminance.
- */
-
-static void
-format_W(cups_page_header2_t *header,	/* I - Page header */
-            unsigned char    *row,	/* IO - Bitmap data for device */
-	    int              y,		/* I - Current row */
-	    int              z,		/* I - Current plane */
-	    int              xsize,	/* I - Width of image data */
-	    int	             ysize,	/* I - Height of image data */
-	    int              yerr0,	/* I - Top Y error */
-	    int              yerr1,	/* I - Bottom Y error */
-	    cups_ib_t        *r0,	/* I - Primary image data */
-	    cups_ib_t        *r1)	/* I - Image data for interpolation */
-{
-  cups_ib_t	*ptr,			/* Pointer into row */
-		bitmask;		/* Current mask for pixel */
-  int		bitoffset;		/* Current offset in line */
-  int		x,			/* Current X coordinate on page */
-		*dither;		/* Pointer into dither array */
-
-
-  (void)z;
-
-  switch (XPosition)
-  {
-    case -1 :
-        bitoffset = 0;
-	break;
-    default :
-        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
-	break;
-    case 1 :
-        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
-	break;
-  }
-
-  ptr = row + bitoffset / 8;
-
-  switch (header->cupsBitsPerColor)
-  {
-    case 1 :
-        bitmask = 0x80 >> (bitoffset & 7);
-        dither  = Floyd16x16[y & 15];
-
-        for (x = xsize; x > 0; x --)
-        {
-          if (*r0++ > dither[x & 15])
-            *ptr ^= bitmask;
-
-          if (bitmask > 1)
-	    bitmask >>= 1;
-	  else
-	  {
-	    bitmask = 0x80;
-	    ptr ++;
-          }
-	}
-        break;
-
-    case 2 :
-        bitmask = 0xc0 >> (bitoffset & 7);
-        dither  = Floyd8x8[y & 7];
-
-        for (x = xsize; x > 0; x --)
-        {
-          if ((*r0 & 63) > dither[x & 7])
-            *ptr ^= (bitmask & OnPixels[*r0++]);
-          else
-            *ptr ^= (bitmask & OffPixels[*r0++]);
-
-          if (bitmask > 3)
-	    bitmask >>= 2;
-	  else
-	  {
-	    bitmask = 0xc0;
-
-	    ptr ++;
-          }
-	}
-        break;
-
-    case 4 :
-        bitmask = 0xf0 >> (bitoffset & 7);
-        dither  = Floyd4x4[y & 3];
-
-        for (x = xsize; x > 0; x --)
-        {
-          if ((*r0 & 15) > dither[x & 3])
-            *ptr ^= (bitmask & OnPixels[*r0++]);
-          else
-            *ptr ^= (bitmask & OffPixels[*r0++]);
-
-          if (bitmask == 0xf0)
-	    bitmask = 0x0f;
-	  else
-	  {
-	    bitmask = 0xf0;
-
-	    ptr ++;
-          }
-	}
-        break;
-
-    case 8 :
-        for (x = xsize; x > 0; x --, r0 ++, r1 ++)
-	{
-          if (*r0 == *r1)
-            *ptr++ = *r0;
-          else
-            *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
-        }
-        break;
-  }
+  return (NULL);
 }
 
 
 /*
- * 'format_YMC()' - Convert image data to YMC.
+ * 'band_write()' - Write the formatted bands in order.
  */
 
 static void
-format_YMC(cups_page_header2_t *header,	/* I - Page header */
-            unsigned char      *row,	/* IO - Bitmap data for device */
-	    int                y,	/* I - Current row */
-	    int                z,	/* I - Current plane */
-	    int                xsize,	/* I - Width of image data */
-	    int	               ysize,	/* I - Height of image data */
-	    int                yerr0,	/* I - Top Y error */
-	    int                yerr1,	/* I - Bottom Y error */
-	    cups_ib_t          *r0,	/* I - Primary image data */
-	    cups_ib_t          *r1)	/* I - Image data for interpolation */
+band_write(band_pipe_t *p,		/* I - Band threads */
+           int         count)		/* I - Number of bands to have written */
 {
-  cups_ib_t	*ptr,			/* Pointer into row */
-		*cptr,			/* Pointer into cyan */
-		*mptr,			/* Pointer into magenta */
-		*yptr,			/* Pointer into yellow */
-		bitmask;		/* Current mask for pixel */
-  int		bitoffset;		/* Current offset in line */
-  int		bandwidth;		/* Width of a color band */
-  int		x,			/* Current X coordinate on page */
-		*dither;		/* Pointer into dither array */
-
-
-  switch (XPosition)
-  {
-    case -1 :
-        bitoffset = 0;
-	break;
-    default :
-        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
-	break;
-    case 1 :
-        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
-	break;
-  }
+  band_t	*b;			/* Current band */
+  int		i;			/* Looping var */
+  unsigned	bpl = p->header->cupsBytesPerLine;
+					/* Bytes per line */
 
-  ptr       = row + bitoffset / 8;
-  bandwidth = header->cupsBytesPerLine / 3;
 
-  switch (header->cupsColorOrder)
+  while (p->written < count)
   {
-    case CUPS_ORDER_CHUNKED :
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 64 >> (bitoffset & 7);
-	      dither  = Floyd16x16[y & 15];
+    b = p->bands + p->written % p->num_bands;
 
-              for (x = xsize ; x > 0; x --, r0 += 3)
-              {
-	        if (r0[2] > dither[x & 15])
-		  *ptr ^= bitmask;
-		bitmask >>= 1;
+    pthread_mutex_lock(&p->mutex);
+    while (b->state != BAND_DONE)
+      pthread_cond_wait(&p->cond, &p->mutex);
+    pthread_mutex_unlock(&p->mutex);
 
-	        if (r0[1] > dither[x & 15])
-		  *ptr ^= bitmask;
-		bitmask >>= 1;
-
-	        if (r0[0] > dither[x & 15])
-		  *ptr ^= bitmask;
-
-                if (bitmask > 1)
-		  bitmask >>= 2;
-		else
-        	{
-        	  bitmask = 64;
-        	  ptr ++;
-        	}
-              }
-              break;
-
-          case 2 :
-	      dither = Floyd8x8[y & 7];
-
-              for (x = xsize ; x > 0; x --, r0 += 3)
-              {
-	       	if ((r0[2] & 63) > dither[x & 7])
-        	  *ptr ^= (0x30 & OnPixels[r0[2]]);
-        	else
-        	  *ptr ^= (0x30 & OffPixels[r0[2]]);
-
-        	if ((r0[1] & 63) > dither[x & 7])
-        	  *ptr ^= (0x0c & OnPixels[r0[1]]);
-        	else
-        	  *ptr ^= (0x0c & OffPixels[r0[1]]);
-
-        	if ((r0[0] & 63) > dither[x & 7])
-        	  *ptr++ ^= (0x03 & OnPixels[r0[0]]);
-        	else
-        	  *ptr++ ^= (0x03 & OffPixels[r0[0]]);
-              }
-              break;
-
-          case 4 :
-	      dither = Floyd4x4[y & 3];
-
-              for (x = xsize ; x > 0; x --, r0 += 3)
-              {
-        	if ((r0[2] & 15) > dither[x & 3])
-        	  *ptr++ ^= (0x0f & OnPixels[r0[2]]);
-        	else
-        	  *ptr++ ^= (0x0f & OffPixels[r0[2]]);
-
-        	if ((r0[1] & 15) > dither[x & 3])
-        	  *ptr ^= (0xf0 & OnPixels[r0[1]]);
-        	else
-        	  *ptr ^= (0xf0 & OffPixels[r0[1]]);
-
-        	if ((r0[0] & 15) > dither[x & 3])
-        	  *ptr++ ^= (0x0f & OnPixels[r0[0]]);
-        	else
-        	  *ptr++ ^= (0x0f & OffPixels[r0[0]]);
-              }
-              break;
-
-          case 8 :
-              for (x = xsize; x > 0; x --, r0 += 3, r1 += 3)
-	      {
-        	if (r0[2] == r1[2])
-                  *ptr++ = r0[2];
-        	else
-                  *ptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
-
-        	if (r0[1] == r1[1])
-                  *ptr++ = r0[1];
-        	else
-                  *ptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
-
-        	if (r0[0] == r1[0])
-                  *ptr++ = r0[0];
-        	else
-                  *ptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
-              }
-	      break;
-        }
-        break;
-
-    case CUPS_ORDER_BANDED :
-	yptr = ptr;
-	mptr = ptr + bandwidth;
-	cptr = ptr + 2 * bandwidth;
-
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 0x80 >> (bitoffset & 7);
-	      dither  = Floyd16x16[y & 15];
-
-              for (x = xsize; x > 0; x --)
-              {
-        	if (*r0++ > dither[x & 15])
-        	  *cptr ^= bitmask;
-        	if (*r0++ > dither[x & 15])
-        	  *mptr ^= bitmask;
-        	if (*r0++ > dither[x & 15])
-        	  *yptr ^= bitmask;
-
-                if (bitmask > 1)
-		  bitmask >>= 1;
-		else
-		{
-		  bitmask = 0x80;
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-        	}
-	      }
-              break;
-
-          case 2 :
-              bitmask = 0xc0 >> (bitoffset & 7);
-	      dither  = Floyd8x8[y & 7];
-
-              for (x = xsize; x > 0; x --)
-              {
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *cptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *cptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *mptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *mptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *yptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *yptr ^= (bitmask & OffPixels[*r0++]);
-
-                if (bitmask > 3)
-		  bitmask >>= 2;
-		else
-		{
-		  bitmask = 0xc0;
-
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-        	}
-	      }
-              break;
-
-          case 4 :
-              bitmask = 0xf0 >> (bitoffset & 7);
-	      dither  = Floyd4x4[y & 3];
-
-              for (x = xsize; x > 0; x --)
-              {
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *cptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *cptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *mptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *mptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *yptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *yptr ^= (bitmask & OffPixels[*r0++]);
-
-                if (bitmask == 0xf0)
-		  bitmask = 0x0f;
-		else
-		{
-		  bitmask = 0xf0;
-
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-        	}
-	      }
-              break;
-
-          case 8 :
-              for (x = xsize; x > 0; x --, r0 += 3, r1 += 3)
-	      {
-        	if (r0[0] == r1[0])
-                  *cptr++ = r0[0];
-        	else
-                  *cptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
-
-        	if (r0[1] == r1[1])
-                  *mptr++ = r0[1];
-        	else
-                  *mptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
-
-        	if (r0[2] == r1[2])
-                  *yptr++ = r0[2];
-        	else
-                  *yptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
-              }
-              break;
-        }
-        break;
-
-    case CUPS_ORDER_PLANAR :
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 0x80 >> (bitoffset & 7);
-	      dither  = Floyd16x16[y & 15];
-
-              switch (z)
-	      {
-	        case 2 :
-        	    for (x = xsize; x > 0; x --, r0 += 3)
-        	    {
-        	      if (r0[0] > dither[x & 15])
-        		*ptr ^= bitmask;
-
-                      if (bitmask > 1)
-			bitmask >>= 1;
-		      else
-		      {
-			bitmask = 0x80;
-			ptr ++;
-        	      }
-	            }
-		    break;
-
-	        case 1 :
-        	    for (x = xsize; x > 0; x --, r0 += 3)
-        	    {
-        	      if (r0[1] > dither[x & 15])
-        		*ptr ^= bitmask;
-
-                      if (bitmask > 1)
-			bitmask >>= 1;
-		      else
-		      {
-			bitmask = 0x80;
-			ptr ++;
-        	      }
-	            }
-		    break;
-
-	        case 0 :
-        	    for (x = xsize; x > 0; x --, r0 += 3)
-        	    {
-        	      if (r0[2] > dither[x & 15])
-        		*ptr ^= bitmask;
-
-                      if (bitmask > 1)
-			bitmask >>= 1;
-		      else
-		      {
-			bitmask = 0x80;
-			ptr ++;
-        	      }
-	            }
-		    break;
-	      }
-              break;
-
-          case 2 :
-              bitmask = 0xc0 >> (bitoffset & 7);
-	      dither  = Floyd8x8[y & 7];
-              z       = 2 - z;
-              r0      += z;
-
-              for (x = xsize; x > 0; x --, r0 += 3)
-              {
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *ptr ^= (bitmask & OnPixels[*r0]);
-        	else
-        	  *ptr ^= (bitmask & OffPixels[*r0]);
-
-                if (bitmask > 3)
-		  bitmask >>= 2;
-		else
-		{
-		  bitmask = 0xc0;
-
-		  ptr ++;
-        	}
-	      }
-              break;
-
-          case 4 :
-              bitmask = 0xf0 >> (bitoffset & 7);
-	      dither  = Floyd4x4[y & 3];
-              z       = 2 - z;
-              r0      += z;
-
-              for (x = xsize; x > 0; x --, r0 += 3)
-              {
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *ptr ^= (bitmask & OnPixels[*r0]);
-        	else
-        	  *ptr ^= (bitmask & OffPixels[*r0]);
-
-                if (bitmask == 0xf0)
-		  bitmask = 0x0f;
-		else
-		{
-		  bitmask = 0xf0;
-
-		  ptr ++;
-        	}
-	      }
-              break;
-
-          case 8 :
-              z  = 2 - z;
-              r0 += z;
-	      r1 += z;
-
-              for (x = xsize; x > 0; x --, r0 += 3, r1 += 3)
-	      {
-        	if (*r0 == *r1)
-                  *ptr++ = *r0;
-        	else
-                  *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
-              }
-              break;
-        }
-        break;
-  }
-}
-
-
-/*
- * 'format_YMCK()' - Convert image data to YMCK.
- */
-
-static void
-format_YMCK(cups_page_header2_t *header,/* I - Page header */
-            unsigned char       *row,	/* IO - Bitmap data for device */
-	    int                 y,	/* I - Current row */
-	    int                 z,	/* I - Current plane */
-	    int                 xsize,	/* I - Width of image data */
-	    int	                ysize,	/* I - Height of image data */
-	    int                 yerr0,	/* I - Top Y error */
-	    int                 yerr1,	/* I - Bottom Y error */
-	    cups_ib_t           *r0,	/* I - Primary image data */
-	    cups_ib_t           *r1)	/* I - Image data for interpolation */
-{
-  cups_ib_t	*ptr,			/* Pointer into row */
-		*cptr,			/* Pointer into cyan */
-		*mptr,			/* Pointer into magenta */
-		*yptr,			/* Pointer into yellow */
-		*kptr,			/* Pointer into black */
-		bitmask;		/* Current mask for pixel */
-  int		bitoffset;		/* Current offset in line */
-  int		bandwidth;		/* Width of a color band */
-  int		x,			/* Current X coordinate on page */
-		*dither;		/* Pointer into dither array */
-  int		pc, pm, py;		/* CMY pixels */
-
-
-  switch (XPosition)
-  {
-    case -1 :
-        bitoffset = 0;
-	break;
-    default :
-        bitoffset = header->cupsBitsPerPixel * ((header->cupsWidth - xsize) / 2);
-	break;
-    case 1 :
-        bitoffset = header->cupsBitsPerPixel * (header->cupsWidth - xsize);
-	break;
-  }
-
-  ptr       = row + bitoffset / 8;
-  bandwidth = header->cupsBytesPerLine / 4;
-
-  switch (header->cupsColorOrder)
-  {
-    case CUPS_ORDER_CHUNKED :
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 128 >> (bitoffset & 7);
-              dither  = Floyd16x16[y & 15];
-
-              for (x = xsize ; x > 0; x --)
-              {
-	        pc = *r0++ > dither[x & 15];
-		pm = *r0++ > dither[x & 15];
-		py = *r0++ > dither[x & 15];
-
-		if (pc && pm && py)
-		{
-		  bitmask >>= 3;
-		  *ptr ^= bitmask;
-		}
-		else
-		{
-		  if (py)
-		    *ptr ^= bitmask;
-		  bitmask >>= 1;
-
-		  if (pm)
-		    *ptr ^= bitmask;
-		  bitmask >>= 1;
-
-		  if (pc)
-		    *ptr ^= bitmask;
-		  bitmask >>= 1;
-                }
-
-                if (bitmask > 1)
-		  bitmask >>= 1;
-		else
-        	{
-        	  bitmask = 128;
-
-        	  ptr ++;
-        	}
-              }
-              break;
-
-          case 2 :
-              dither = Floyd8x8[y & 7];
-
-              for (x = xsize ; x > 0; x --, r0 += 4)
-              {
-	       	if ((r0[2] & 63) > dither[x & 7])
-        	  *ptr ^= (0xc0 & OnPixels[r0[2]]);
-        	else
-        	  *ptr ^= (0xc0 & OffPixels[r0[2]]);
-
-        	if ((r0[1] & 63) > dither[x & 7])
-        	  *ptr ^= (0x30 & OnPixels[r0[1]]);
-        	else
-        	  *ptr ^= (0x30 & OffPixels[r0[1]]);
-
-        	if ((r0[0] & 63) > dither[x & 7])
-        	  *ptr ^= (0x0c & OnPixels[r0[0]]);
-        	else
-        	  *ptr ^= (0x0c & OffPixels[r0[0]]);
-
-        	if ((r0[3] & 63) > dither[x & 7])
-        	  *ptr++ ^= (0x03 & OnPixels[r0[3]]);
-        	else
-        	  *ptr++ ^= (0x03 & OffPixels[r0[3]]);
-              }
-              break;
-
-          case 4 :
-              dither = Floyd4x4[y & 3];
-
-              for (x = xsize ; x > 0; x --, r0 += 4)
-              {
-        	if ((r0[2] & 15) > dither[x & 3])
-        	  *ptr ^= (0xf0 & OnPixels[r0[2]]);
-        	else
-        	  *ptr ^= (0xf0 & OffPixels[r0[2]]);
-
-        	if ((r0[1] & 15) > dither[x & 3])
-        	  *ptr++ ^= (0x0f & OnPixels[r0[1]]);
-        	else
-        	  *ptr++ ^= (0x0f & OffPixels[r0[1]]);
-
-        	if ((r0[0] & 15) > dither[x & 3])
-        	  *ptr ^= (0xf0 & OnPixels[r0[0]]);
-        	else
-        	  *ptr ^= (0xf0 & OffPixels[r0[0]]);
-
-        	if ((r0[3] & 15) > dither[x & 3])
-        	  *ptr++ ^= (0x0f & OnPixels[r0[3]]);
-        	else
-        	  *ptr++ ^= (0x0f & OffPixels[r0[3]]);
-              }
-              break;
-
-          case 8 :
-              for (x = xsize; x > 0; x --, r0 += 4, r1 += 4)
-	      {
-        	if (r0[2] == r1[2])
-                  *ptr++ = r0[2];
-        	else
-                  *ptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
-
-        	if (r0[1] == r1[1])
-                  *ptr++ = r0[1];
-        	else
-                  *ptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
-
-        	if (r0[0] == r1[0])
-                  *ptr++ = r0[0];
-        	else
-                  *ptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
-
-        	if (r0[3] == r1[3])
-                  *ptr++ = r0[3];
-        	else
-                  *ptr++ = (r0[3] * yerr0 + r1[3] * yerr1) / ysize;
-              }
-              break;
-        }
-        break;
-
-    case CUPS_ORDER_BANDED :
-	yptr = ptr;
-	mptr = ptr + bandwidth;
-	cptr = ptr + 2 * bandwidth;
-	kptr = ptr + 3 * bandwidth;
-
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 0x80 >> (bitoffset & 7);
-              dither  = Floyd16x16[y & 15];
-
-              for (x = xsize; x > 0; x --)
-              {
-	        pc = *r0++ > dither[x & 15];
-		pm = *r0++ > dither[x & 15];
-		py = *r0++ > dither[x & 15];
-
-		if (pc && pm && py)
-		  *kptr ^= bitmask;
-		else
-		{
-		  if (pc)
-        	    *cptr ^= bitmask;
-		  if (pm)
-        	    *mptr ^= bitmask;
-		  if (py)
-        	    *yptr ^= bitmask;
-                }
-
-                if (bitmask > 1)
-		  bitmask >>= 1;
-		else
-		{
-		  bitmask = 0x80;
-
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-		  kptr ++;
-        	}
-	      }
-              break;
-
-          case 2 :
-              bitmask = 0xc0 >> (bitoffset & 7);
-              dither  = Floyd8x8[y & 7];
-
-              for (x = xsize; x > 0; x --)
-              {
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *cptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *cptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *mptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *mptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *yptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *yptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *kptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *kptr ^= (bitmask & OffPixels[*r0++]);
-
-                if (bitmask > 3)
-		  bitmask >>= 2;
-		else
-		{
-		  bitmask = 0xc0;
-
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-		  kptr ++;
-        	}
-	      }
-              break;
-
-          case 4 :
-              bitmask = 0xf0 >> (bitoffset & 7);
-              dither  = Floyd4x4[y & 3];
-
-              for (x = xsize; x > 0; x --)
-              {
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *cptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *cptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *mptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *mptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *yptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *yptr ^= (bitmask & OffPixels[*r0++]);
-
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *kptr ^= (bitmask & OnPixels[*r0++]);
-        	else
-        	  *kptr ^= (bitmask & OffPixels[*r0++]);
-
-                if (bitmask == 0xf0)
-		  bitmask = 0x0f;
-		else
-		{
-		  bitmask = 0xf0;
-
-		  cptr ++;
-		  mptr ++;
-		  yptr ++;
-		  kptr ++;
-        	}
-	      }
-              break;
-
-          case 8 :
-              for (x = xsize; x > 0; x --, r0 += 4, r1 += 4)
-	      {
-        	if (r0[0] == r1[0])
-                  *cptr++ = r0[0];
-        	else
-                  *cptr++ = (r0[0] * yerr0 + r1[0] * yerr1) / ysize;
-
-        	if (r0[1] == r1[1])
-                  *mptr++ = r0[1];
-        	else
-                  *mptr++ = (r0[1] * yerr0 + r1[1] * yerr1) / ysize;
-
-        	if (r0[2] == r1[2])
-                  *yptr++ = r0[2];
-        	else
-                  *yptr++ = (r0[2] * yerr0 + r1[2] * yerr1) / ysize;
-
-        	if (r0[3] == r1[3])
-                  *kptr++ = r0[3];
-        	else
-                  *kptr++ = (r0[3] * yerr0 + r1[3] * yerr1) / ysize;
-              }
-              break;
-        }
-        break;
-
-    case CUPS_ORDER_PLANAR :
-        switch (header->cupsBitsPerColor)
-        {
-          case 1 :
-              bitmask = 0x80 >> (bitoffset & 7);
-              dither  = Floyd16x16[y & 15];
-
-              for (x = xsize; x > 0; x --)
-              {
-	        pc = *r0++ > dither[x & 15];
-		pm = *r0++ > dither[x & 15];
-		py = *r0++ > dither[x & 15];
-
-		if ((pc && pm && py && z == 3) ||
-		    (pc && z == 2) || (pm && z == 1) || (py && z == 0))
-        	  *ptr ^= bitmask;
-
-        	if (bitmask > 1)
-		  bitmask >>= 1;
-		else
-		{
-		  bitmask = 0x80;
-		  ptr ++;
-        	}
-	      }
-              break;
-
-          case 2 :
-              bitmask = 0xc0 >> (bitoffset & 7);
-              dither  = Floyd8x8[y & 7];
-              if (z == 3)
-	        r0 += 3;
-	      else
-	        r0 += 2 - z;
-
-              for (x = xsize; x > 0; x --, r0 += 4)
-              {
-        	if ((*r0 & 63) > dither[x & 7])
-        	  *ptr ^= (bitmask & OnPixels[*r0]);
-        	else
-        	  *ptr ^= (bitmask & OffPixels[*r0]);
-
-                if (bitmask > 3)
-		  bitmask >>= 2;
-		else
-		{
-		  bitmask = 0xc0;
-
-		  ptr ++;
-        	}
-	      }
-              break;
-
-          case 4 :
-              bitmask = 0xf0 >> (bitoffset & 7);
-              dither  = Floyd4x4[y & 3];
-              if (z == 3)
-	        r0 += 3;
-	      else
-	        r0 += 2 - z;
-
-              for (x = xsize; x > 0; x --, r0 += 4)
-              {
-        	if ((*r0 & 15) > dither[x & 3])
-        	  *ptr ^= (bitmask & OnPixels[*r0]);
-        	else
-        	  *ptr ^= (bitmask & OffPixels[*r0]);
-
-                if (bitmask == 0xf0)
-		  bitmask = 0x0f;
-		else
-		{
-		  bitmask = 0xf0;
-
-		  ptr ++;
-        	}
-	      }
-              break;
-
-          case 8 :
-              if (z == 3)
-	      {
-	        r0 += 3;
-	        r1 += 3;
-	      }
-	      else
-	      {
-	        r0 += 2 - z;
-	        r1 += 2 - z;
-	      }
+    for (i = 0; i < b->count; i ++)
+      if (cupsRasterWritePixels(p->ras, b->lines + i * bpl, bpl) < bpl)
+      {
+	fputs("ERROR: Unable to send raster data to the driver.\n", stderr);
+	cupsImageClose(p->img);
+	exit(1);
+      }
 
-              for (x = xsize; x > 0; x --, r0 += 4, r1 += 4)
-	      {
-        	if (*r0 == *r1)
-                  *ptr++ = *r0;
-        	else
-                  *ptr++ = (*r0 * yerr0 + *r1 * yerr1) / ysize;
-              }
-              break;
-        }
-        break;
+    b->state = BAND_FREE;
+    p->written ++;
   }
 }
+#endif /* HAVE_PTHREAD_H */
 
 
 /*
@@ -4507,6 +2057,49 @@ make_lut(cups_ib_t  *lut,		/* I - Lookup table */
 }
 
 
+/*
+ * 'next_image()' - Get the next selected page of the image file.
+ *
+ * Pages which cannot be read are skipped.  The page is cropped to the
+ * same part as the first page when "fill" or "crop-to-fit" is used.
+ */
+
+static cups_image_t *			/* O - Page image or NULL at the end */
+next_image(cups_ipages_t *pages,	/* I - Pages of image file */
+           const float   *crop)		/* I - Cropped area or NULL */
+{
+  cups_image_t	*img,			/* Page image */
+		*img2;			/* Cropped page image */
+  int		page;			/* Page number */
+  float		w, h;			/* Size of page image */
+
+
+  while ((img = cupsImagePagesNext(pages, &page)) == NULL)
+  {
+    if (!page)
+      return (NULL);
+
+    fprintf(stderr, "ERROR: Page %d of the print file could not be read.\n",
+            page);
+  }
+
+  fprintf(stderr, "DEBUG: Printing page %d of the print file.\n", page);
+
+  if (crop)
+  {
+    w    = (float)cupsImageGetWidth(img);
+    h    = (float)cupsImageGetHeight(img);
+    img2 = cupsImageCrop(img, crop[0] * w, crop[1] * h, crop[2] * w,
+                         crop[3] * h);
+
+    cupsImageClose(img);
+    img = img2;
+  }
+
+  return (img);
+}
+
+
 /*
  * 'raster_cb()' - Validate the page header.
  */
@@ -0,0 +1,643 @@
+/*
+ *   HP-PCL raster compression for CUPS.
+ *
+ *   Copyright 2007-2011 by Apple Inc.
+ *   Copyright 1993-2005 by Easy Software Products
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   pcl_compress()  - Compress a line of graphics.
+ *   load_word()     - Load 8 bytes from an unaligned address.
+ *   has_zero()      - Check whether a word contains a zero byte.
+ *   count_blank()   - Check whether a line is blank.
+ *   count_match()   - Count the bytes matching the seed row.
+ *   count_differ()  - Count the bytes differing from the seed row.
+ *   count_run()     - Count repeated bytes.
+ *   count_literal() - Count bytes up to the next pair of equal bytes.
+ *   delta_offset()  - Output a mode 3 command byte and offset.
+ *   mode10_data()   - Output mode 10 command byte, offset, and pixels.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "pcl-compress.h"
+#include <string.h>
+#include <stdint.h>
+
+
+/*
+ * The scanning functions below look at 8 bytes at a time and only fall
+ * back to single bytes for the word in which the scanned condition
+ * changes, so long unchanged or repeated spans are skipped in bulk.  The
+ * results do not depend on byte order or alignment.
+ */
+
+#define ONES	UINT64_C(0x0101010101010101)
+#define HIGHS	UINT64_C(0x8080808080808080)
+
+
+/*
+ * Local functions...
+ */
+
+static int		count_blank(const unsigned char *line, int length);
+static inline int	count_differ(const unsigned char *line,
+			             const unsigned char *seed, int length);
+static inline int	count_literal(const unsigned char *line, int length);
+static inline int	count_match(const unsigned char *line,
+			            const unsigned char *seed, int length);
+static inline int	count_run(const unsigned char *line, int length);
+static unsigned char	*delta_offset(unsigned char *comp_ptr, int offset,
+			              int count);
+static inline int	has_zero(uint64_t word);
+static inline uint64_t	load_word(const unsigned char *ptr);
+static unsigned char	*mode10_data(unsigned char *comp_ptr,
+			             const unsigned char *start,
+				     const unsigned char *seed, int offset,
+				     int count, int gray);
+
+
+/*
+ * 'pcl_compress()' - Compress a line of graphics.
+ *
+ * The seed row is not updated; the caller copies the line into it after
+ * sending it, as the printer does.  For mode 10, "length" must be a
+ * multiple of 3 unless "gray" is set.
+ */
+
+int					/* O - Number of bytes of output data */
+pcl_compress(
+    const unsigned char *line,		/* I - Data to compress */
+    int                 length,		/* I - Number of bytes */
+    const unsigned char *seed,		/* I - Seed row (modes 3 and 10) */
+    int                 seed_invalid,	/* I - Seed row invalid (mode 3)? */
+    int                 gray,		/* I - Grayscale data (mode 10)? */
+    int                 type,		/* I - Type of compression */
+    unsigned char       *comp,		/* I - Compression buffer */
+    const unsigned char **data)		/* O - Output data */
+{
+  const unsigned char	*line_ptr,	/* Current byte pointer */
+			*line_end,	/* End-of-line byte pointer */
+			*start;		/* Start of compression sequence */
+  unsigned char		*comp_ptr;	/* Pointer into compression buffer */
+  int			count,		/* Count of bytes for output */
+			offset;		/* Offset of bytes for output */
+
+
+  line_end = line + length;
+  comp_ptr = comp;
+
+  switch (type)
+  {
+    default :
+       /*
+	* Do no compression; with a mode-0 only printer, we can compress blank
+	* lines...
+	*/
+
+        *data = line;
+
+        return (count_blank(line, length) ? 0 : length);
+
+    case 1 :
+       /*
+        * Do run-length encoding...
+        */
+
+	for (line_ptr = line;
+	     line_ptr < line_end;
+	     comp_ptr += 2, line_ptr += count)
+	{
+	  count = count_run(line_ptr, line_end - line_ptr > 256 ?
+	                              256 : (int)(line_end - line_ptr));
+
+	  comp_ptr[0] = count - 1;
+	  comp_ptr[1] = line_ptr[0];
+	}
+	break;
+
+    case 2 :
+       /*
+        * Do TIFF pack-bits encoding...
+        */
+
+	for (line_ptr = line; line_ptr < line_end; line_ptr += count)
+	{
+	  if ((line_ptr + 1) >= line_end)
+	  {
+	   /*
+	    * Single byte on the end...
+	    */
+
+	    *comp_ptr++ = 0x00;
+	    *comp_ptr++ = *line_ptr;
+	    count       = 1;
+	  }
+	  else if (line_ptr[0] == line_ptr[1])
+	  {
+	   /*
+	    * Repeated sequence...
+	    */
+
+	    count = count_run(line_ptr, line_end - line_ptr > 127 ?
+	                                127 : (int)(line_end - line_ptr));
+
+	    *comp_ptr++ = 257 - count;
+	    *comp_ptr++ = *line_ptr;
+	  }
+	  else
+	  {
+	   /*
+	    * Non-repeated sequence...
+	    */
+
+	    count = 1 + count_literal(line_ptr + 1,
+	                              line_end - line_ptr > 128 ?
+				          127 : (int)(line_end - line_ptr - 1));
+
+	    *comp_ptr++ = count - 1;
+
+	    memcpy(comp_ptr, line_ptr, count);
+	    comp_ptr += count;
+	  }
+	}
+	break;
+
+    case 3 :
+       /*
+	* Do delta-row compression...
+	*/
+
+        if (seed_invalid)
+	{
+	 /*
+	  * The seed row is invalid, so send everything in chunks of 8 bytes...
+	  */
+
+	  for (line_ptr = line; line_ptr < line_end; line_ptr += count)
+	  {
+	    if ((count = line_end - line_ptr) > 8)
+	      count = 8;
+
+	    *comp_ptr++ = (count - 1) << 5;
+	    memcpy(comp_ptr, line_ptr, count);
+	    comp_ptr += count;
+	  }
+	  break;
+	}
+
+	line_ptr = line;
+
+	while (line_ptr < line_end)
+        {
+         /*
+          * Skip the bytes matching the seed row...
+          */
+
+	  offset   = count_match(line_ptr, seed, line_end - line_ptr);
+	  line_ptr += offset;
+	  seed     += offset;
+
+	  if (line_ptr == line_end)
+	    break;
+
+         /*
+          * Send up to 8 non-matching bytes...
+          */
+
+	  start = line_ptr;
+	  for (count = 1;
+	       count < 8 && line_ptr + count < line_end &&
+	           line_ptr[count] != seed[count];
+	       count ++);
+
+	  line_ptr += count;
+	  seed     += count;
+
+	  comp_ptr = delta_offset(comp_ptr, offset, count);
+          memcpy(comp_ptr, start, count);
+          comp_ptr += count;
+        }
+	break;
+
+    case 10 :
+       /*
+        * Mode 10 "near lossless" RGB compression...
+	*/
+
+        line_ptr = line;
+
+        if (gray)
+	{
+	 /*
+	  * Do grayscale compression to RGB...
+	  */
+
+	  while (line_ptr < line_end)
+          {
+	    offset   = count_match(line_ptr, seed, line_end - line_ptr);
+	    line_ptr += offset;
+	    seed     += offset;
+
+	    if (line_ptr == line_end)
+	      break;
+
+	    count    = count_differ(line_ptr, seed, line_end - line_ptr);
+	    comp_ptr = mode10_data(comp_ptr, line_ptr, seed, offset, count, 1);
+	    line_ptr += count;
+	    seed     += count;
+          }
+	}
+	else
+	{
+	 /*
+	  * Do RGB compression; a pixel matches if all 3 bytes match...
+	  */
+
+	  while (line_ptr < line_end)
+          {
+	    offset   = count_match(line_ptr, seed, line_end - line_ptr) / 3;
+	    line_ptr += 3 * offset;
+	    seed     += 3 * offset;
+
+	    if (line_ptr == line_end)
+	      break;
+
+	    for (start = line_ptr, count = 0;
+	         line_ptr < line_end &&
+		     (line_ptr[0] != seed[0] || line_ptr[1] != seed[1] ||
+		      line_ptr[2] != seed[2]);
+	         line_ptr += 3, seed += 3, count ++);
+
+	    comp_ptr = mode10_data(comp_ptr, start, seed - 3 * count, offset,
+	                           count, 0);
+          }
+	}
+	break;
+  }
+
+  *data = comp;
+
+  return (comp_ptr - comp);
+}
+
+
+/*
+ * 'load_word()' - Load 8 bytes from an unaligned address.
+ */
+
+static inline uint64_t			/* O - Word */
+load_word(const unsigned char *ptr)	/* I - Bytes */
+{
+  uint64_t	word;			/* Word */
+
+
+  memcpy(&word, ptr, sizeof(word));
+
+  return (word);
+}
+
+
+/*
+ * 'has_zero()' - Check whether a word contains a zero byte.
+ */
+
+static inline int			/* O - 1 if a byte is zero */
+has_zero(uint64_t word)			/* I - Word */
+{
+  return (((word - ONES) & ~word & HIGHS) != 0);
+}
+
+
+/*
+ * 'count_blank()' - Check whether a line is blank.
+ */
+
+static int				/* O - 1 if all bytes are zero */
+count_blank(const unsigned char *line,	/* I - Line */
+            int                 length)	/* I - Number of bytes */
+{
+  for (; length >= 8; line += 8, length -= 8)
+    if (load_word(line))
+      return (0);
+
+  for (; length > 0; line ++, length --)
+    if (*line)
+      return (0);
+
+  return (1);
+}
+
+
+/*
+ * 'count_match()' - Count the bytes matching the seed row.
+ */
+
+static inline int			/* O - Number of matching bytes */
+count_match(const unsigned char *line,	/* I - Line */
+            const unsigned char *seed,	/* I - Seed row */
+	    int                 length)	/* I - Number of bytes */
+{
+  int	count = 0;			/* Number of matching bytes */
+
+
+ /*
+  * Short spans are common with dense changes, so check the first bytes
+  * one at a time before switching to words...
+  */
+
+  while (count < length && count < 8 && line[count] == seed[count])
+    count ++;
+
+  if (count < 8)
+    return (count);
+
+  while (count + 8 <= length &&
+         load_word(line + count) == load_word(seed + count))
+    count += 8;
+
+  while (count < length && line[count] == seed[count])
+    count ++;
+
+  return (count);
+}
+
+
+/*
+ * 'count_differ()' - Count the bytes differing from the seed row.
+ */
+
+static inline int			/* O - Number of differing bytes */
+count_differ(const unsigned char *line,	/* I - Line */
+             const unsigned char *seed,	/* I - Seed row */
+	     int                 length)/* I - Number of bytes */
+{
+  int	count = 0;			/* Number of differing bytes */
+
+
+  while (count < length && count < 8 && line[count] != seed[count])
+    count ++;
+
+  if (count < 8)
+    return (count);
+
+  while (count + 8 <= length &&
+         !has_zero(load_word(line + count) ^ load_word(seed + count)))
+    count += 8;
+
+  while (count < length && line[count] != seed[count])
+    count ++;
+
+  return (count);
+}
+
+
+/*
+ * 'count_run()' - Count repeated bytes.
+ */
+
+static inline int			/* O - Length of run, at least 1 */
+count_run(const unsigned char *line,	/* I - Line */
+          int                 length)	/* I - Maximum length of run */
+{
+  int	count = 1;			/* Length of run */
+
+
+  while (count < length && count < 8 && line[count] == line[0])
+    count ++;
+
+  if (count < 8)
+    return (count);
+
+  while (count + 8 <= length && load_word(line + count) == line[0] * ONES)
+    count += 8;
+
+  while (count < length && line[count] == line[0])
+    count ++;
+
+  return (count);
+}
+
+
+/*
+ * 'count_literal()' - Count bytes up to the next pair of equal bytes.
+ */
+
+static inline int			/* O - Index of first byte equal to
+					       its successor, or length - 1 */
+count_literal(const unsigned char *line,/* I - Line */
+              int                 length)
+					/* I - Number of bytes to look at */
+{
+  int	count = 0;			/* Number of bytes */
+
+
+  while (count < length - 1 && count < 8 && line[count] != line[count + 1])
+    count ++;
+
+  if (count < 8)
+    return (count);
+
+  while (count + 9 <= length &&
+         !has_zero(load_word(line + count) ^ load_word(line + count + 1)))
+    count += 8;
+
+  while (count < length - 1 && line[count] != line[count + 1])
+    count ++;
+
+  return (count);
+}
+
+
+/*
+ * 'delta_offset()' - Output a mode 3 command byte and offset.
+ */
+
+static unsigned char *			/* O - New end of output */
+delta_offset(unsigned char *comp_ptr,	/* I - End of output */
+             int           offset,	/* I - Offset in bytes */
+	     int           count)	/* I - Number of replacement bytes */
+{
+ /*
+  * Place mode 3 compression data in the buffer; see HP manuals
+  * for details...
+  */
+
+  if (offset >= 31)
+  {
+   /*
+    * Output multi-byte offset...
+    */
+
+    *comp_ptr++ = ((count - 1) << 5) | 31;
+
+    offset -= 31;
+    while (offset >= 255)
+    {
+      *comp_ptr++ = 255;
+      offset    -= 255;
+    }
+
+    *comp_ptr++ = offset;
+  }
+  else
+  {
+   /*
+    * Output single-byte offset...
+    */
+
+    *comp_ptr++ = ((count - 1) << 5) | offset;
+  }
+
+  return (comp_ptr);
+}
+
+
+/*
+ * 'mode10_data()' - Output mode 10 command byte, offset, and pixels.
+ */
+
+static unsigned char *			/* O - New end of output */
+mode10_data(unsigned char       *comp_ptr,
+					/* I - End of output */
+            const unsigned char *start,	/* I - First replacement pixel */
+	    const unsigned char *seed,	/* I - Seed row at first pixel */
+	    int                 offset,	/* I - Offset in pixels */
+	    int                 count,	/* I - Number of replacement pixels */
+	    int                 gray)	/* I - Grayscale pixels? */
+{
+  int	temp;				/* Temporary count */
+  int	r, g, b;			/* RGB deltas */
+  int	green = gray ? 0 : 1,		/* Offset of green component */
+	blue = gray ? 0 : 2,		/* Offset of blue component */
+	step = gray ? 1 : 3;		/* Size of a pixel */
+
+
+ /*
+  * Place mode 10 compression data in the buffer; each sequence
+  * starts with a command byte that looks like:
+  *
+  *     CMD SRC SRC OFF OFF CNT CNT CNT
+  *
+  * For the purpose of this driver, CMD and SRC are always 0.
+  *
+  * If the offset >= 3 then additional offset bytes follow the
+  * first command byte, each byte == 255 until the last one.
+  *
+  * If the count >= 7, then additional count bytes follow each
+  * group of pixels, each byte == 255 until the last one.
+  *
+  * The offset and count are in RGB tuples (not bytes, as for
+  * Mode 3 and 9)...
+  */
+
+  if (offset >= 3)
+  {
+   /*
+    * Output multi-byte offset...
+    */
+
+    if (count > 7)
+      *comp_ptr++ = 0x1f;
+    else
+      *comp_ptr++ = 0x18 | (count - 1);
+
+    offset -= 3;
+    while (offset >= 255)
+    {
+      *comp_ptr++ = 255;
+      offset      -= 255;
+    }
+
+    *comp_ptr++ = offset;
+  }
+  else
+  {
+   /*
+    * Output single-byte offset...
+    */
+
+    if (count > 7)
+      *comp_ptr++ = (offset << 3) | 0x07;
+    else
+      *comp_ptr++ = (offset << 3) | (count - 1);
+  }
+
+  temp = count - 8;
+
+  while (count > 0)
+  {
+    if (count <= temp)
+    {
+     /*
+      * This is exceedingly lame...  The replacement counts
+      * are intermingled with the data...
+      */
+
+      if (temp >= 255)
+	*comp_ptr++ = 255;
+      else
+	*comp_ptr++ = temp;
+
+      temp -= 255;
+    }
+
+   /*
+    * Get difference between current and seed pixels; gray pixels are
+    * sent as RGB with all three components the same...
+    */
+
+    r = start[0] - seed[0];
+    g = start[green] - seed[green];
+    b = ((start[blue] & 0xfe) - (seed[blue] & 0xfe)) / 2;
+
+    if (r < -16 || r > 15 || g < -16 || g > 15 || b < -16 || b > 15)
+    {
+     /*
+      * Pack 24-bit RGB into 23 bits...  Lame...
+      */
+
+      *comp_ptr++ = start[0] >> 1;
+
+      if (start[0] & 1)
+	*comp_ptr++ = 0x80 | (start[green] >> 1);
+      else
+	*comp_ptr++ = start[green] >> 1;
+
+      if (start[green] & 1)
+	*comp_ptr++ = 0x80 | (start[blue] >> 1);
+      else
+	*comp_ptr++ = start[blue] >> 1;
+    }
+    else
+    {
+     /*
+      * Pack 15-bit RGB difference...
+      */
+
+      *comp_ptr++ = 0x80 | (((unsigned)r << 2) & 0x7c) | ((g >> 3) & 0x03);
+      *comp_ptr++ = (((unsigned)g << 5) & 0xe0) | (b & 0x1f);
+    }
+
+    count --;
+    start += step;
+    seed  += step;
+  }
+
+ /*
+  * Make sure we have the ending count if the replacement count
+  * was exactly 8 + 255n...
+  */
+
+  if (temp == 0)
+    *comp_ptr++ = 0;
+
+  return (comp_ptr);
+}
@@ -0,0 +1,33 @@
+/*
+ *   HP-PCL raster compression for CUPS.
+ *
+ *   Copyright 2007-2011 by Apple Inc.
+ *   Copyright 1993-2005 by Easy Software Products, All Rights Reserved.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ */
+
+#ifndef _PCL_COMPRESS_H_
+#  define _PCL_COMPRESS_H_
+
+/*
+ * Size of the compression buffer needed for a line of the given number
+ * of bytes; mode 10 needs up to 3 bytes per gray pixel plus count bytes...
+ */
+
+#  define PCL_COMPRESS_BUFSIZE(length)	(4 * (length) + 16)
+
+
+/*
+ * Prototypes...
+ */
+
+extern int	pcl_compress(const unsigned char *line, int length,
+			     const unsigned char *seed, int seed_invalid,
+			     int gray, int type, unsigned char *comp,
+			     const unsigned char **data);
+
+#endif /* !_PCL_COMPRESS_H_ */
@@ -19,6 +19,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include <cups/raster.h>
 #include <cups/cups.h>
 #include <ppd/ppd.h>
@@ -257,115 +259,157 @@ static bool dict_lookup_rect(QPDFObjectHandle object, std::string const& key, fl
   return array.size() == 4;
 }
 
-static unsigned char *rotatebitmap(unsigned char *src, unsigned char *dst,
-     unsigned int rotate, unsigned int height, unsigned int width, int rowsize, std::string colorspace)
+// Rows of the unrotated page, decoded one image strip at a time, so that
+// only the strip of the current row is held in memory
+class StripReader {
+public:
+  StripReader(std::vector<QPDFObjectHandle> const& strips,
+              unsigned int width, unsigned int pixel_size, unsigned char white);
+  unsigned char *getRow(unsigned int y);
+  void rewind();
+private:
+  std::vector<QPDFObjectHandle> strips;
+  std::vector<unsigned int> first, heights, widths;
+  unsigned int width, pixel_size;
+  unsigned char white;
+  int current;
+  PointerHolder<Buffer> data;
+  std::vector<unsigned char> row;
+};
+
+StripReader::StripReader(std::vector<QPDFObjectHandle> const& strips,
+                         unsigned int width, unsigned int pixel_size,
+                         unsigned char white)
+  : strips(strips), width(width), pixel_size(pixel_size), white(white),
+    current(-1), row(width * pixel_size)
 {
-  unsigned char *bp = src;
-  unsigned char *dp = dst;
-  unsigned char *temp = dst;
+  unsigned int y = 0;
 
-  if (rotate == 0) {
-    return src;
-  } else if (rotate == 180) {
-    if (colorspace == "/DeviceGray") {
-      bp = src + height * rowsize - 1;
-      dp = dst;
-      for (unsigned int h = 0; h < height; h++) {
-        for (unsigned int w = 0; w < width; w++, bp --, dp ++) {
-          *dp = *bp;
-        }
-      }
-    } else if (colorspace == "/DeviceCMYK") {
-      bp = src + height * rowsize - 4;
-      dp = dst;
-      for (unsigned int h = 0; h < height; h++) {
-        for (unsigned int w = 0; w < width; w++, bp -= 4, dp += 4) {
-          dp[0] = bp[0];
-          dp[1] = bp[1];
-          dp[2] = bp[2];
-          dp[3] = bp[3];
-        }
-      }
-    } else if (colorspace == "/DeviceRGB") {
-      bp = src + height * rowsize - 3;
-      dp = dst;
-      for (unsigned int h = 0; h < height; h++) {
-        for (unsigned int w = 0; w < width; w++, bp -= 3, dp += 3) {
-          dp[0] = bp[0];
-          dp[1] = bp[1];
-          dp[2] = bp[2];
-        }
-      }
-    }
+  for (auto strip: this->strips) {
+    QPDFObjectHandle dict = strip.getDict();
+
+    first.push_back(y);
+    heights.push_back(dict.getKey("/Height").getIntValue());
+    widths.push_back(dict.getKey("/Width").getIntValue());
+    y += heights.back();
   }
-  else if (rotate == 270) {
-    if (colorspace == "/DeviceGray") {
-      bp = src;
-      dp = dst;
-      for (unsigned int h = 0; h < height; h++) {
-        bp = src + (height - h) - 1;
-        for (unsigned int w = 0; w < width; w++, bp += height , dp ++) {
-          *dp = *bp;
-        }
-      }
-    } else if (colorspace == "/DeviceCMYK") {
-      for (unsigned int h = 0; h < height; h++) {
-        bp = src + (height - h)*4 - 4;
-        for (unsigned int i = 0; i < width; i++, bp += height*4 , dp += 4) {
-          dp[0] = bp[0];
-          dp[1] = bp[1];
-          dp[2] = bp[2];
-          dp[3] = bp[3];
-        }
-      }
-    } else if (colorspace == "/DeviceRGB") {
-      bp = src;
-      dp = dst;
-      for (unsigned int h = 0; h < height; h++) {
-        bp = src + (height - h)*3 - 3;
-        for (unsigned int i = 0; i < width; i++, bp += height*3 , dp += 3) {
-          dp[0] = bp[0];
-          dp[1] = bp[1];
-          dp[2] = bp[2];
-        }
-      }
-    }
+}
+
+// Returns row y of the page; the row stays valid until the next call.
+// Strips narrower than the page or with too little data are padded with
+// white.
+unsigned char *StripReader::getRow(unsigned int y)
+{
+  unsigned int s = std::upper_bound(first.begin(), first.end(), y) - first.begin() - 1;
+  size_t rowbytes = (size_t)widths[s] * pixel_size,
+         offset = (y - first[s]) * rowbytes,
+         bytes;
+
+  if ((int)s != current) {
+    data = PointerHolder<Buffer>(); // free the previous strip first
+    data = strips[s].getStreamData(qpdf_dl_all);
+    current = s;
   }
-  else if (rotate == 90) {
-    if (colorspace == "/DeviceGray") {
-      for (unsigned int h = 0; h < height; h++) {
-        bp = src + (width - 1) * height + h;
-        for (unsigned int i = 0; i < width; i++, bp -= height , dp ++) {
-          *dp = *bp;
-        }
-      }
-    } else if (colorspace == "/DeviceCMYK") {
-      for (unsigned int h = 0; h < height; h++) {
-        bp = src + (width - 1) * height * 4 + 4*h;
-        for (unsigned int i = 0; i < width; i++, bp -= height*4 , dp += 4) {
-          dp[0] = bp[0];
-          dp[1] = bp[1];
-          dp[2] = bp[2];
-          dp[3] = bp[3];
-        }
-      }
-    } else if (colorspace == "/DeviceRGB") {
-      for (unsigned int h = 0; h < height; h++) {
-       bp = src + (width - 1) * height * 3 + 3*h;
-        for (unsigned int i = 0; i < width; i++, bp -= height*3 , dp += 3) {
-          dp[0] = bp[0];
-          dp[1] = bp[1];
-          dp[2] = bp[2];
-        }
+
+  if (widths[s] == width && offset + rowbytes <= data->getSize())
+    return data->getBuffer() + offset;
+
+  bytes = offset < data->getSize() ? data->getSize() - offset : 0;
+  if (bytes > rowbytes) bytes = rowbytes;
+  if (bytes > row.size()) bytes = row.size();
+
+  memcpy(&row[0], data->getBuffer() + offset, bytes);
+  memset(&row[bytes], white, row.size() - bytes);
+
+  return &row[0];
+}
+
+// Goes back to the start of the page, so that the strips are decoded again
+void StripReader::rewind()
+{
+  data = PointerHolder<Buffer>();
+  current = -1;
+}
+
+// Copies a row with the order of its pixels reversed, for pages rotated
+// by 180 degrees
+template <unsigned int N>
+static void reverseRow(const unsigned char *src, unsigned char *dst, unsigned int width)
+{
+  src += (size_t)(width - 1) * N;
+  for (unsigned int w = 0; w < width; w++, src -= N, dst += N)
+    memcpy(dst, src, N);
+}
+
+// Copies rows [y0, y1) of the unrotated page (width x height pixels) into
+// the page rotated by 90 or 270 degrees.  The copy is done in tiles of
+// 32x32 pixels, each written one destination row at a time, so that the
+// source rows read and the destination rows written stay in the cache.
+template <unsigned int N>
+static void rotateRows(const unsigned char *src, unsigned char *dst,
+                       unsigned int y0, unsigned int y1, unsigned int width,
+                       unsigned int height, long long rotate)
+{
+  const unsigned int tile = 32;
+
+  for (unsigned int x0 = 0; x0 < width; x0 += tile) {
+    unsigned int x1 = std::min(x0 + tile, width);
+
+    for (unsigned int x = x0; x < x1; x++) {
+      const unsigned char *bp = src + (size_t)x * N;
+      unsigned char *dp;
+
+      if (rotate == 270) {
+        // source pixel (x, y) becomes row width - 1 - x, column y
+        dp = dst + ((size_t)(width - 1 - x) * height + y0) * N;
+        for (unsigned int y = y0; y < y1; y++, bp += (size_t)width * N, dp += N)
+          memcpy(dp, bp, N);
+      } else {
+        // source pixel (x, y) becomes row x, column height - 1 - y
+        dp = dst + ((size_t)x * height + height - 1 - y0) * N;
+        for (unsigned int y = y0; y < y1; y++, bp += (size_t)width * N, dp -= N)
+          memcpy(dp, bp, N);
       }
     }
   }
-  else {
-    fprintf(stderr, "ERROR: Incorrect Rotate Value %d\n", rotate);
+}
+
+// Decodes all strips of a page rotated by 90 or 270 degrees into the
+// rotated page.  Every row of the rotated page needs a pixel of every
+// strip, so the rotated page is kept instead of decoding the strips again
+// for each band of rows; the strips are still decoded one at a time.
+static unsigned char *rotatePage(StripReader &reader, unsigned int width,
+                                 unsigned int height, unsigned int pixel_size,
+                                 long long rotate)
+{
+  const unsigned int block = 32;
+  size_t rowbytes = (size_t)width * pixel_size;
+  unsigned char *page = (unsigned char *)malloc((size_t)height * rowbytes);
+  unsigned char *rows = (unsigned char *)malloc(block * rowbytes);
+
+  if (!page || !rows) {
+    fprintf(stderr, "ERROR: Unable to allocate memory for rotated page\n");
     exit(1);
   }
 
-  return temp;
+  for (unsigned int y0 = 0; y0 < height; y0 += block) {
+    unsigned int y1 = std::min(y0 + block, height);
+
+    for (unsigned int y = y0; y < y1; y++)
+      memcpy(rows + (y - y0) * rowbytes, reader.getRow(y), rowbytes);
+
+    if (pixel_size == 1)
+      rotateRows<1>(rows, page, y0, y1, width, height, rotate);
+    else if (pixel_size == 3)
+      rotateRows<3>(rows, page, y0, y1, width, height, rotate);
+    else
+      rotateRows<4>(rows, page, y0, y1, width, height, rotate);
+  }
+
+  free(rows);
+  reader.rewind();
+
+  return page;
 }
 
 void onebitpixel(unsigned char *src, unsigned char *dst, unsigned int width,
@@ -485,12 +529,14 @@ static void outPage(cups_raster_t *raster, QPDFObjectHandle page, int pgno) {
   double           l;
   QPDFObjectHandle image;
   QPDFObjectHandle imgdict;
-  int              rowsize = 0, bufsize = 0, pixel_count = 0, temp;
+  int              rowsize = 0, pixel_size = 0, temp;
   float            mediaBox[4];
-  unsigned char    *bitmap = NULL;
-  unsigned char    *colordata = NULL;
   QPDFObjectHandle colorspace_obj;
+  std::vector<QPDFObjectHandle> strips;
+  unsigned char    *rotated = NULL;
+  unsigned char    *revBuf = NULL;
   unsigned char    *lineBuf = NULL;
+  unsigned char    *bp = NULL;
   unsigned char    *dp = NULL;
   std::string      colorspace;
 
@@ -518,33 +564,34 @@ static void outPage(cups_raster_t *raster, QPDFObjectHandle page, int pgno) {
       header.PageSize[1] = (unsigned)l;
   }
 
+  if (rotate != 0 && rotate != 90 && rotate != 180 && rotate != 270) {
+    fprintf(stderr, "ERROR: Incorrect Rotate Value %lld\n", rotate);
+    exit(1);
+  }
+
   header.cupsWidth = 0;
   header.cupsHeight = 0;
 
+  // Only look at the image dictionaries here, the strips are decoded one
+  // at a time while writing the page
   std::map<std::string, QPDFObjectHandle> images = page.getPageImages();
   for (auto const& iter2: images) {
     image = iter2.second;
     imgdict = image.getDict();
 
-    PointerHolder<Buffer> actual_data = image.getStreamData(qpdf_dl_all);
     width = imgdict.getKey("/Width").getIntValue();
     height = imgdict.getKey("/Height").getIntValue();
     colorspace_obj = imgdict.getKey("/ColorSpace");
     header.cupsHeight += height;
-    bufsize = actual_data->getSize();
-
-    if(!pixel_count) {
-      bitmap = (unsigned char *) malloc(bufsize);
-    }
-    else {
-      bitmap = (unsigned char *) realloc(bitmap, pixel_count + bufsize);
-    }
-    memcpy(bitmap + pixel_count, actual_data->getBuffer(), bufsize);
-    pixel_count += bufsize;
+    strips.push_back(image);
 
     if (width > header.cupsWidth) header.cupsWidth = width;
   }
 
+  // Size of the unrotated page
+  width = header.cupsWidth;
+  height = header.cupsHeight;
+
   if (rotate == 270 || rotate == 90) {
     temp = header.cupsHeight;
     header.cupsHeight = header.cupsWidth;
@@ -560,24 +607,23 @@ static void outPage(cups_raster_t *raster, QPDFObjectHandle page, int pgno) {
   colorspace = (colorspace_obj.isName() ? colorspace_obj.getName() : std::string());
 
   if (colorspace == "/DeviceRGB") {
-    rowsize = header.cupsWidth*3;
+    pixel_size = 3;
   } else if (colorspace == "/DeviceCMYK") {
-     rowsize = header.cupsWidth*4;
+    pixel_size = 4;
   } else if (colorspace == "/DeviceGray") {
-     rowsize = header.cupsWidth;
+    pixel_size = 1;
   } else {
     fprintf(stderr, "ERROR: Colorspace %s not supported\n", colorspace.c_str());
     exit(1);
   }
+  rowsize = header.cupsWidth * pixel_size;
 
-  if(rotate) {
-    unsigned char *bitmap2 = (unsigned char *) malloc(pixel_count);
-    bitmap2 = rotatebitmap(bitmap, bitmap2, rotate, header.cupsHeight, header.cupsWidth, rowsize, colorspace);
-    free(bitmap);
-    bitmap = bitmap2;
-  }
+  StripReader reader(strips, width, pixel_size, colorspace == "/DeviceCMYK" ? 0 : 255);
 
-  colordata = bitmap;
+  if (rotate == 90 || rotate == 270)
+    rotated = rotatePage(reader, width, height, pixel_size, rotate);
+  else if (rotate == 180)
+    revBuf = new unsigned char [rowsize];
 
    switch (header.cupsColorSpace) {
     case CUPS_CSPACE_K:
@@ -606,20 +652,35 @@ static void outPage(cups_raster_t *raster, QPDFObjectHandle page, int pgno) {
      else if (colorspace == "/DeviceGray") convertLine = GraytoRGBLine;
    }
 
+  // Rows are converted and written as soon as their strip is decoded
   lineBuf = new unsigned char [bytesPerLine];
   for (unsigned int plane = 0; plane < nplanes ; plane++) {
-    unsigned char *bp = colordata;
+    reader.rewind();
     for (unsigned int h = 0; h < header.cupsHeight; h++) {
+      if (rotated) {
+        bp = rotated + (size_t)h * rowsize;
+      } else if (revBuf) {
+        bp = reader.getRow(header.cupsHeight - 1 - h);
+        if (pixel_size == 1)
+          reverseRow<1>(bp, revBuf, header.cupsWidth);
+        else if (pixel_size == 3)
+          reverseRow<3>(bp, revBuf, header.cupsWidth);
+        else
+          reverseRow<4>(bp, revBuf, header.cupsWidth);
+        bp = revBuf;
+      } else {
+        bp = reader.getRow(h);
+      }
       for (unsigned int band = 0; band < nbands; band++) {
          dp = convertLine(bp, lineBuf, h, header.cupsWidth);
         cupsRasterWritePixels(raster, dp, bytesPerLine);
       }
-    bp += rowsize;
     }
   }
 
   delete[] lineBuf;
-  free(bitmap);
+  delete[] revBuf;
+  free(rotated);
 }
 
 int main(int argc, char **argv)
@@ -19,8 +19,13 @@
 #include <config.h>
 #include "pdf.h"
 #include <vector>
+#include <set>
 #include <string>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+#include <unistd.h>
 #include <qpdf/QPDF.hh>
 #include <qpdf/QPDFObjectHandle.hh>
 #include <qpdf/QPDFWriter.hh>
@@ -448,3 +453,438 @@ extern "C" int pdf_fill_form(pdf_t *doc, opt_t *opt)
     // identifiable fields in the form
     return 1;
 }
+
+
+/*
+ * Banner skeleton
+ *
+ * The template is loaded, resized and given its font only when the
+ * skeleton is made; the result is written out with a classic cross
+ * reference table. A banner is the skeleton followed by an incremental
+ * update which replaces the empty content stream prepended to the page
+ * (or the text fields of a form), adds the extra copies of the page and
+ * a new page tree for them.
+ */
+
+struct pdf_skeleton_field {
+  int obj, gen;
+  std::string name;  // fully qualified field name
+  std::string dict;  // field dictionary without /V
+};
+
+struct pdf_skeleton_s {
+  std::string pdf;   // skeleton file
+  float scale;       // scale of the template on the page
+  long xref;         // offset of the cross reference table
+  int size;          // /Size of the trailer
+  std::string trailer; // /Root, /Info and /ID entries of the trailer
+  int pages_obj, pages_gen;
+  int page_obj, page_gen;
+  std::string page_dict;
+  bool form;
+  int stream_obj, stream_gen; // empty content stream (if !form)
+  std::vector<pdf_skeleton_field> fields;
+};
+
+
+/**
+ * 'pdf_skeleton_new()' - Make a skeleton of a loaded, resized template.
+ * O - Skeleton or NULL if the template can't be used as skeleton
+ * I - Pointer to QPDF object, not modified
+ * I - Scale of the template on the page, from pdf_resize_page()
+ */
+extern "C" pdf_skeleton_t *pdf_skeleton_new(pdf_t *template_doc, float scale)
+{
+  pdf_skeleton_t *skel = new pdf_skeleton_t;
+  std::string template_pdf; // must outlive the copy read from it
+
+  try {
+    // the skeleton is made from a copy, so that the caller can still
+    // use the unchanged template if this fails halfway
+    QPDFWriter copy(*template_doc);
+    copy.setOutputMemory();
+    copy.setPreserveEncryption(false);
+    copy.write();
+    PointerHolder<Buffer> copy_buf(copy.getBuffer());
+    template_pdf.assign((const char *)copy_buf->getBuffer(), copy_buf->getSize());
+    QPDF work;
+    work.processMemoryFile("template", template_pdf.data(), template_pdf.size());
+    QPDF *doc = &work;
+
+    QPDFAcroFormDocumentHelper afdh(*doc);
+    QPDFPageDocumentHelper pdh(*doc);
+    std::vector<QPDFPageObjectHelper> pages = pdh.getAllPages();
+    if (pages.empty())
+      throw std::runtime_error("no page");
+    QPDFObjectHandle page = pages.front().getObjectHandle();
+
+    skel->scale = scale;
+    skel->form = afdh.hasAcroForm();
+
+    if (skel->form) {
+      // the fields get their values in the update, so they must be
+      // objects of their own
+      std::vector<QPDFAnnotationObjectHelper> annotations =
+        afdh.getWidgetAnnotationsForPage(pages.front());
+      for (size_t i = 0; i < annotations.size(); ++i) {
+        QPDFFormFieldObjectHelper ffh = afdh.getFieldForAnnotation(annotations[i]);
+        if (ffh.getFieldType() != "/Tx")
+          continue;
+        if (!ffh.getObjectHandle().isIndirect()) {
+          fprintf(stderr, "DEBUG: Form field of PDF template is no indirect object, "
+                          "not using a skeleton.\n");
+          delete skel;
+          return NULL;
+        }
+        if (ffh.getFullyQualifiedName().find('\n') != std::string::npos) {
+          delete skel;
+          return NULL;
+        }
+        ffh.getObjectHandle().removeKey("/V");
+        doc->getRoot().getKey("/AcroForm").replaceKey("/NeedAppearances",
+                                                      QPDFObjectHandle::newBool(true));
+      }
+    } else {
+      pdf_prepend_stream(doc, 1, "", 0);
+    }
+
+    // a page tree of its own for the page, to be replaced in the update
+    doc->pushInheritedAttributesToPage();
+    QPDFObjectHandle kids = QPDFObjectHandle::newArray();
+    kids.appendItem(page);
+    QPDFObjectHandle pages_dict = QPDFObjectHandle::newDictionary();
+    pages_dict.replaceKey("/Type", QPDFObjectHandle::newName("/Pages"));
+    pages_dict.replaceKey("/Kids", kids);
+    pages_dict.replaceKey("/Count", QPDFObjectHandle::newInteger(1));
+    pages_dict = doc->makeIndirectObject(pages_dict);
+    page.replaceKey("/Parent", pages_dict);
+    doc->getRoot().replaceKey("/Pages", pages_dict);
+    doc->updateAllPagesCache();
+
+    QPDFWriter output(*doc);
+    output.setOutputMemory();
+    output.setObjectStreamMode(qpdf_o_disable);
+    output.setPreserveEncryption(false);
+    output.write();
+    PointerHolder<Buffer> buf(output.getBuffer());
+    skel->pdf.assign((const char *)buf->getBuffer(), buf->getSize());
+
+    // the object numbers are those of the written file
+    QPDF written;
+    written.processMemoryFile("skeleton", skel->pdf.data(), skel->pdf.size());
+
+    size_t pos = skel->pdf.rfind("startxref");
+    if (pos == std::string::npos)
+      throw std::runtime_error("no startxref");
+    skel->xref = strtol(skel->pdf.c_str() + pos + 9, NULL, 10);
+
+    QPDFObjectHandle trailer = written.getTrailer();
+    skel->size = trailer.getKey("/Size").getIntValueAsInt();
+    skel->trailer = " /Root " + trailer.getKey("/Root").unparse();
+    if (trailer.hasKey("/Info"))
+      skel->trailer += " /Info " + trailer.getKey("/Info").unparse();
+    if (trailer.hasKey("/ID"))
+      skel->trailer += " /ID " + trailer.getKey("/ID").unparse();
+
+    page = written.getAllPages().front();
+    skel->page_obj = page.getObjectID();
+    skel->page_gen = page.getGeneration();
+    skel->page_dict = page.shallowCopy().unparse();
+    skel->pages_obj = page.getKey("/Parent").getObjectID();
+    skel->pages_gen = page.getKey("/Parent").getGeneration();
+
+    if (skel->form) {
+      QPDFAcroFormDocumentHelper written_afdh(written);
+      std::vector<QPDFAnnotationObjectHelper> annotations =
+        written_afdh.getWidgetAnnotationsForPage(QPDFPageObjectHelper(page));
+      // a field with several widgets must be written only once
+      std::set<int> seen;
+      for (size_t i = 0; i < annotations.size(); ++i) {
+        QPDFFormFieldObjectHelper ffh =
+          written_afdh.getFieldForAnnotation(annotations[i]);
+        if (ffh.getFieldType() != "/Tx" ||
+            !seen.insert(ffh.getObjectHandle().getObjectID()).second)
+          continue;
+        pdf_skeleton_field field;
+        field.obj = ffh.getObjectHandle().getObjectID();
+        field.gen = ffh.getObjectHandle().getGeneration();
+        field.name = ffh.getFullyQualifiedName();
+        field.dict = ffh.getObjectHandle().shallowCopy().unparse();
+        skel->fields.push_back(field);
+      }
+    } else {
+      QPDFObjectHandle stream = page.getKey("/Contents").getArrayItem(0);
+      skel->stream_obj = stream.getObjectID();
+      skel->stream_gen = stream.getGeneration();
+    }
+  } catch (const std::exception &e) {
+    fprintf(stderr, "DEBUG: Unable to make skeleton of PDF template: %s\n",
+            e.what());
+    delete skel;
+    return NULL;
+  }
+
+  return skel;
+}
+
+
+/**
+ * 'pdf_skeleton_load()' - Load a skeleton saved by pdf_skeleton_save().
+ * O - Skeleton or NULL if missing, unreadable or made for another key
+ * I - File to load from
+ * I - Key the skeleton must have been saved with
+ */
+extern "C" pdf_skeleton_t *pdf_skeleton_load(const char *filename,
+                                             const char *key)
+{
+  FILE *fp;
+  char line[65536];
+  pdf_skeleton_t *skel;
+  bool ok = false;
+
+  if ((fp = fopen(filename, "rb")) == NULL)
+    return NULL;
+
+  skel = new pdf_skeleton_t;
+  skel->scale = 1.0;
+  skel->xref = 0;
+  skel->size = 0;
+  skel->pages_obj = skel->pages_gen = 0;
+  skel->page_obj = skel->page_gen = 0;
+  skel->form = false;
+  skel->stream_obj = skel->stream_gen = 0;
+
+  // the key must match exactly, the rest is checked on the way
+  if (fgets(line, sizeof(line), fp) && !strcmp(line, "bannertopdf skeleton 2\n") &&
+      fgets(line, sizeof(line), fp) && !strncmp(line, "key ", 4) &&
+      !strncmp(line + 4, key, strlen(key)) && !strcmp(line + 4 + strlen(key), "\n")) {
+    while (fgets(line, sizeof(line), fp)) {
+      char *value = strchr(line, ' ');
+      char *eol = strchr(line, '\n');
+      int n = 0;
+      if (!value || !eol)
+        break;
+      *value++ = '\0';
+      *eol = '\0';
+      if (!strcmp(line, "scale")) {
+        skel->scale = atof(value);
+      } else if (!strcmp(line, "xref")) {
+        skel->xref = atol(value);
+      } else if (!strcmp(line, "size")) {
+        skel->size = atoi(value);
+      } else if (!strcmp(line, "trailer")) {
+        skel->trailer = std::string(" ") + value;
+      } else if (!strcmp(line, "pages")) {
+        if (sscanf(value, "%d%d", &skel->pages_obj, &skel->pages_gen) != 2)
+          break;
+      } else if (!strcmp(line, "page")) {
+        if (sscanf(value, "%d%d %n", &skel->page_obj, &skel->page_gen, &n) != 2 || !n)
+          break;
+        skel->page_dict = value + n;
+      } else if (!strcmp(line, "stream")) {
+        if (sscanf(value, "%d%d", &skel->stream_obj, &skel->stream_gen) != 2)
+          break;
+      } else if (!strcmp(line, "field")) {
+        pdf_skeleton_field field;
+        if (sscanf(value, "%d%d %n", &field.obj, &field.gen, &n) != 2 || !n)
+          break;
+        field.name = value + n;
+        if (!fgets(line, sizeof(line), fp) || strncmp(line, "dict ", 5) ||
+            !(eol = strchr(line, '\n')))
+          break;
+        *eol = '\0';
+        field.dict = line + 5;
+        skel->fields.push_back(field);
+        skel->form = true;
+      } else if (!strcmp(line, "form")) {
+        skel->form = true;
+      } else if (!strcmp(line, "pdf")) {
+        size_t len = (size_t)atol(value);
+        skel->pdf.resize(len);
+        ok = len > 0 && fread(&skel->pdf[0], 1, len, fp) == len;
+        break;
+      }
+    }
+  }
+
+  fclose(fp);
+
+  if (!ok || !skel->xref || !skel->size || !skel->page_obj || !skel->pages_obj ||
+      (!skel->form && !skel->stream_obj)) {
+    delete skel;
+    return NULL;
+  }
+
+  return skel;
+}
+
+
+/**
+ * 'pdf_skeleton_save()' - Save a skeleton to a file.
+ * O - 0 on success, -1 on error
+ * I - Skeleton
+ * I - File to save to, replaced atomically
+ * I - Key to load it with again (single line)
+ */
+extern "C" int pdf_skeleton_save(pdf_skeleton_t *skel,
+                                 const char *filename,
+                                 const char *key)
+{
+  std::string tempfile = std::string(filename) + ".XXXXXX";
+  FILE *fp;
+  int fd;
+
+  if ((fd = mkstemp(&tempfile[0])) < 0)
+    return -1;
+
+  if ((fp = fdopen(fd, "wb")) == NULL) {
+    close(fd);
+    unlink(tempfile.c_str());
+    return -1;
+  }
+
+  fprintf(fp, "bannertopdf skeleton 2\n");
+  fprintf(fp, "key %s\n", key);
+  fprintf(fp, "scale %.9g\n", skel->scale);
+  fprintf(fp, "xref %ld\n", skel->xref);
+  fprintf(fp, "size %d\n", skel->size);
+  fprintf(fp, "trailer %s\n", skel->trailer.c_str() + 1);
+  fprintf(fp, "pages %d %d\n", skel->pages_obj, skel->pages_gen);
+  fprintf(fp, "page %d %d %s\n", skel->page_obj, skel->page_gen,
+          skel->page_dict.c_str());
+  if (skel->form)
+    fprintf(fp, "form 1\n");
+  else
+    fprintf(fp, "stream %d %d\n", skel->stream_obj, skel->stream_gen);
+  for (size_t i = 0; i < skel->fields.size(); ++i) {
+    fprintf(fp, "field %d %d %s\n", skel->fields[i].obj, skel->fields[i].gen,
+            skel->fields[i].name.c_str());
+    fprintf(fp, "dict %s\n", skel->fields[i].dict.c_str());
+  }
+  fprintf(fp, "pdf %lu\n", (unsigned long)skel->pdf.size());
+  fwrite(skel->pdf.data(), 1, skel->pdf.size(), fp);
+
+  if (fclose(fp) || rename(tempfile.c_str(), filename)) {
+    unlink(tempfile.c_str());
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/**
+ * 'pdf_skeleton_scale()' - Scale of the template on the page.
+ * I - Skeleton
+ */
+extern "C" float pdf_skeleton_scale(pdf_skeleton_t *skel)
+{
+  return skel->scale;
+}
+
+
+/**
+ * 'pdf_skeleton_write()' - Write a banner made from a skeleton.
+ * O - 0 on success, -1 on error
+ * I - Skeleton
+ * I - File pointer to write to
+ * I - Content stream to prepend to the page (if the template has no form)
+ * I - Length of content stream
+ * I - Pointer to the opt_t type list to fill form fields with
+ * I - Number of copies of the page
+ */
+extern "C" int pdf_skeleton_write(pdf_skeleton_t *skel,
+                                  FILE *file,
+                                  char const *buf,
+                                  size_t len,
+                                  opt_t *opt,
+                                  unsigned copies)
+{
+  std::string update;
+  std::vector<std::pair<int, std::pair<int, long> > > xref;
+  char tmp[256];
+
+  if (!skel->form) {
+    xref.push_back(std::make_pair(skel->stream_obj,
+        std::make_pair(skel->stream_gen, (long)update.size())));
+    snprintf(tmp, sizeof(tmp), "%d %d obj\n<< /Length %lu >>\nstream\n",
+             skel->stream_obj, skel->stream_gen, (unsigned long)len);
+    update += tmp;
+    update.append(buf, len);
+    update += "\nendstream\nendobj\n";
+  }
+
+  for (size_t i = 0; i < skel->fields.size(); ++i) {
+    pdf_skeleton_field &field = skel->fields[i];
+    std::string fill_with = lookup_opt(opt, field.name);
+    if (fill_with.empty()) {
+      std::cerr << "DEBUG: Lack information for widget: " << field.name << ".\n";
+      fill_with = "N/A";
+    }
+    QPDFObjectHandle fill_with_utf_16 = QPDFObjectHandle::newUnicodeString(fill_with);
+    std::cerr << "DEBUG: Fill widget name " << field.name << " with value "
+              << fill_with_utf_16.getUTF8Value() << ".\n";
+
+    // the dictionary ends with ">>"
+    xref.push_back(std::make_pair(field.obj,
+        std::make_pair(field.gen, (long)update.size())));
+    snprintf(tmp, sizeof(tmp), "%d %d obj\n", field.obj, field.gen);
+    update += tmp;
+    update += field.dict.substr(0, field.dict.rfind(">>"));
+    update += "/V " + fill_with_utf_16.unparse() + " >>\nendobj\n";
+  }
+
+  int size = skel->size;
+  if (copies > 1) {
+    std::string kids;
+    snprintf(tmp, sizeof(tmp), "%d %d R", skel->page_obj, skel->page_gen);
+    kids = tmp;
+    for (unsigned i = 1; i < copies; ++i, ++size) {
+      xref.push_back(std::make_pair(size, std::make_pair(0, (long)update.size())));
+      snprintf(tmp, sizeof(tmp), "%d 0 obj\n", size);
+      update += tmp + skel->page_dict + "\nendobj\n";
+      snprintf(tmp, sizeof(tmp), " %d 0 R", size);
+      kids += tmp;
+    }
+
+    xref.push_back(std::make_pair(skel->pages_obj,
+        std::make_pair(skel->pages_gen, (long)update.size())));
+    snprintf(tmp, sizeof(tmp), "%d %d obj\n<< /Type /Pages /Kids [ ",
+             skel->pages_obj, skel->pages_gen);
+    update += tmp + kids;
+    snprintf(tmp, sizeof(tmp), " ] /Count %u >>\nendobj\n", copies);
+    update += tmp;
+  }
+
+  // cross reference section of the update, one subsection per object
+  std::sort(xref.begin(), xref.end());
+  long startxref = (long)(skel->pdf.size() + update.size());
+  update += "xref\n";
+  for (size_t i = 0; i < xref.size(); ++i) {
+    snprintf(tmp, sizeof(tmp), "%d 1\n%010ld %05d n \n", xref[i].first,
+             (long)skel->pdf.size() + xref[i].second.second,
+             xref[i].second.first);
+    update += tmp;
+  }
+  snprintf(tmp, sizeof(tmp), "trailer\n<< /Size %d /Prev %ld", size, skel->xref);
+  update += tmp + skel->trailer;
+  snprintf(tmp, sizeof(tmp), " >>\nstartxref\n%ld\n%%%%EOF\n", startxref);
+  update += tmp;
+
+  if (fwrite(skel->pdf.data(), 1, skel->pdf.size(), file) != skel->pdf.size() ||
+      fwrite(update.data(), 1, update.size(), file) != update.size() ||
+      fflush(file))
+    return -1;
+
+  return 0;
+}
+
+
+/**
+ * 'pdf_skeleton_free()' - Free a skeleton.
+ * I - Skeleton
+ */
+extern "C" void pdf_skeleton_free(pdf_skeleton_t *skel)
+{
+  delete skel;
+}
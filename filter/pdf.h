@@ -47,6 +47,22 @@ void pdf_duplicate_page (pdf_t *doc, unsigned page, unsigned count);
 int pdf_fill_form(pdf_t *doc, opt_t *opt);
 int pdf_pages(const char *filename);
 
+/*
+ * Banner skeleton: the prepared template written out once, with the
+ * object numbers of the parts which differ from job to job.  Banners
+ * are made from it by appending these parts as an incremental update,
+ * without parsing the template again.
+ */
+typedef struct pdf_skeleton_s pdf_skeleton_t;
+
+pdf_skeleton_t *pdf_skeleton_new(pdf_t *doc, float scale);
+pdf_skeleton_t *pdf_skeleton_load(const char *filename, const char *key);
+int pdf_skeleton_save(pdf_skeleton_t *skel, const char *filename, const char *key);
+float pdf_skeleton_scale(pdf_skeleton_t *skel);
+int pdf_skeleton_write(pdf_skeleton_t *skel, FILE *file, char const *buf, size_t len,
+                       opt_t *opt, unsigned copies);
+void pdf_skeleton_free(pdf_skeleton_t *skel);
+
 #ifdef __cplusplus
 }
 #endif
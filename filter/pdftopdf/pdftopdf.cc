@@ -556,6 +556,10 @@ void getParameters(ppd_file_t *ppd,int num_options,cups_option_t *options,Proces
     param.emitJCL=!is_false(val)&&(strcmp(val,"0")!=0);
   }
 
+  if ((val=cupsGetOption("pdftopdf-compact-output",num_options,options)) != NULL) {
+    param.compactOutput=is_true(val);
+  }
+
   param.booklet=BookletMode::BOOKLET_OFF;
   if ((val=cupsGetOption("booklet",num_options,options)) != NULL) {
     if (strcasecmp(val,"shuffle-only")==0) {
@@ -803,7 +807,8 @@ static bool printerWillCollate(ppd_file_t *ppd) // {{{
 }
 // }}}
 
-void calculate(ppd_file_t *ppd,ProcessingParameters &param) // {{{
+// >num_pages: of the input document
+void calculate(ppd_file_t *ppd,ProcessingParameters &param,int num_pages) // {{{
 {
   if (param.reverse)
     // Enable evenDuplex or the first page may be empty.
@@ -833,7 +838,14 @@ void calculate(ppd_file_t *ppd,ProcessingParameters &param) // {{{
       } else {
 	// check collate device, with current/final(!) ppd settings
 	param.deviceCollate=printerWillCollate(ppd);
-	if (!param.deviceCollate) {
+	if ((!param.deviceCollate)&&(num_pages==1)&&(!param.duplex)) {
+	  // a single page needs no collating: let the printer make the
+	  // copies, even if it can not collate them
+	  ppdMarkOption(ppd,"Collate","False");
+	  param.collate=false;
+	  fprintf(stderr,"DEBUG: pdftopdf: Single page, printer makes the %d copies\n",
+		  param.deviceCopies);
+	} else if (!param.deviceCollate) {
 	  // printer can't hw collate -> we must copy collated in sw
 	  param.deviceCopies=1;
 	}
@@ -1107,11 +1119,6 @@ int main(int argc,char **argv)
     ppdMarkOptions(ppd,num_options,options);
 
     getParameters(ppd,num_options,options,param);
-    calculate(ppd,param);
-
-#ifdef DEBUG
-    param.dump();
-#endif
 
     /* Check with which method we will flatten interactive PDF forms
        and annotations so that they get printed also after page
@@ -1149,6 +1156,8 @@ int main(int argc,char **argv)
     cupsFreeOptions(num_options,options);
 
     std::unique_ptr<PDFTOPDF_Processor> proc(PDFTOPDF_Factory::processor());
+    // do not flatten or prepare pages which will not be printed
+    proc->setPageSelection(param);
 
     FILE *tmpfile = NULL;
     if (argc==7) {
@@ -1298,16 +1307,27 @@ int main(int argc,char **argv)
     }
 */
 
+    // hardware or software copies, depending also on the number of pages
+    calculate(ppd,param,proc->get_pages().size());
+
+#ifdef DEBUG
+    param.dump();
+#endif
+
+    StageTimer timer;
     if (!processPDFTOPDF(*proc,param)) {
       ppdClose(ppd);
       return 2;
     }
+    timer.report("processing");
 
     emitPreamble(ppd,param); // ppdEmit, JCL stuff
     emitComment(*proc,param); // pass information to subsequent filters via PDF comments
+    proc->setCompactOutput(param.compactOutput);
 
     //proc->emitFile(stdout);
     proc->emitFilename(NULL);
+    timer.report("output");
 
     emitPostamble(ppd,param);
     ppdClose(ppd);
@@ -2,6 +2,7 @@
 #include "qpdf_pdftopdf_processor.h"
 #include <stdio.h>
 #include <assert.h>
+#include <time.h>
 #include <numeric>
 
 void BookletMode_dump(BookletMode bkm) // {{{
@@ -28,6 +29,35 @@ bool ProcessingParameters::withPage(int outno) const // {{{
 }
 // }}}
 
+bool ProcessingParameters::selectsInputPages() const // {{{
+{
+  // without booklet and N-up, output page n is made from input page n
+  return (booklet==BOOKLET_OFF)&&(nup.nupX==1)&&(nup.nupY==1);
+}
+// }}}
+
+static double monotonic_seconds() // {{{
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec/1e9;
+}
+// }}}
+
+StageTimer::StageTimer() // {{{
+  : last(monotonic_seconds())
+{
+}
+// }}}
+
+void StageTimer::report(const char *stage) // {{{
+{
+  const double now=monotonic_seconds();
+  fprintf(stderr,"DEBUG: pdftopdf: %s took %.3f s\n",stage,now-last);
+  last=now;
+}
+// }}}
+
 void ProcessingParameters::dump() const // {{{
 {
   fprintf(stderr,"jobId: %d, numCopies: %d\n",
@@ -91,6 +121,9 @@ void ProcessingParameters::dump() const // {{{
   fprintf(stderr,"autoRotate: %s\n",
 	  (autoRotate)?"true":"false");
 
+  fprintf(stderr,"compactOutput: %s\n",
+	  (compactOutput)?"true":"false");
+
   fprintf(stderr,"emitJCL: %s\n",
 	  (emitJCL)?"true":"false");
   fprintf(stderr,"deviceCopies: %d\n",
@@ -225,6 +258,9 @@ bool processPDFTOPDF(PDFTOPDF_Processor &proc,ProcessingParameters &param) // {{
     }
     for(int i=0;i<(int)pages.size();i++)
     {
+      if (param.selectsInputPages()&&!param.withPage(i+1)) {
+        continue; // will not be printed (and was not prepared by the processor)
+      }
       std::shared_ptr<PDFTOPDF_PageHandle> page = pages[i];
       page->crop(param.page,param.orientation,param.xpos,param.ypos,!param.cropfit);
     }
@@ -322,9 +358,13 @@ bool processPDFTOPDF(PDFTOPDF_Processor &proc,ProcessingParameters &param) // {{
       } else {
         page=pages[shuffle[iA]];
       }
+      // will not be printed (and was not prepared by the processor):
+      // only keep the output page count in step
+      const bool skip=(shuffle[iA]<numOrigPages)&&
+        (param.selectsInputPages())&&(!param.withPage(shuffle[iA]+1));
 
       PageRect rect;
-      if (param.fitplot) {
+      if ((param.fitplot)&&(!skip)) {
         rect=page->getRect();
       } else {
         rect.width=param.page.width;
@@ -360,7 +400,7 @@ bool processPDFTOPDF(PDFTOPDF_Processor &proc,ProcessingParameters &param) // {{
         curpage=proc.new_page(param.page.width,param.page.height);
         outputpage++;
       }
-      if (shuffle[iA]>=numOrigPages) {
+      if ((shuffle[iA]>=numOrigPages)||(skip)) {
         continue;
       }
 
@@ -40,6 +40,8 @@ ProcessingParameters()
 
     autoRotate(false),
 
+    compactOutput(false),
+
     emitJCL(true),deviceCopies(1),
     deviceCollate(false),setDuplex(false),
 
@@ -91,6 +93,8 @@ ProcessingParameters()
 
   bool autoRotate;
 
+  bool compactOutput; // object streams, shared identical resources (PDF 1.5)
+
   // ppd/jcl changes
   bool emitJCL;
   int deviceCopies;
@@ -103,6 +107,7 @@ ProcessingParameters()
 
   // helper functions
   bool withPage(int outno) const; // 1 based
+  bool selectsInputPages() const; // withPage() also holds for input page numbers
   void dump() const;
 };
 
@@ -111,6 +116,15 @@ ProcessingParameters()
 
 enum ArgOwnership { WillStayAlive,MustDuplicate,TakeOwnership };
 
+// prints the time spent in each processing stage as DEBUG message
+class StageTimer {
+ public:
+  StageTimer();
+  void report(const char *stage); // time since construction / last report()
+ private:
+  double last;
+};
+
 class PDFTOPDF_PageHandle {
  public:
   virtual ~PDFTOPDF_PageHandle() {}
@@ -135,6 +149,10 @@ class PDFTOPDF_Processor { // abstract interface
   virtual bool loadFile(FILE *f,ArgOwnership take=WillStayAlive,int flatten_forms=1) =0;
   virtual bool loadFilename(const char *name,int flatten_forms=1) =0;
 
+  // call before load*(): only flatten and prepare the pages that will be
+  // printed, if param.selectsInputPages()
+  virtual void setPageSelection(const ProcessingParameters &param) =0;
+
   // TODO? virtual bool may_modify/may_print/?
   virtual bool check_print_permissions() =0;
 
@@ -153,6 +171,9 @@ class PDFTOPDF_Processor { // abstract interface
 
   virtual void setComments(const std::vector<std::string> &comments) =0;
 
+  // object streams, xref stream and deduplicated resources; needs PDF 1.5
+  virtual void setCompactOutput(bool compact) =0;
+
   virtual void emitFile(FILE *dst,ArgOwnership take=WillStayAlive) =0;
   virtual void emitFilename(const char *name) =0; // NULL -> stdout
 
@@ -0,0 +1,186 @@
+#include "qpdf_dedup.h"
+#include <qpdf/MD5.hh>
+#include <qpdf/QPDFObjGen.hh>
+#include <string.h>
+#include <map>
+#include <set>
+
+// Objects are compared bottom-up: children are replaced by their canonical
+// copy first, so two fonts referencing identical (but different) font files
+// end up with identical dictionaries, too.
+// Stream data is compared in its raw (still compressed) form, so nothing
+// has to be decoded.
+
+namespace {
+
+class Deduplicator {
+public:
+  Deduplicator() : replaced(0),saved(0) {}
+
+  QPDFObjectHandle visit(QPDFObjectHandle obj,int depth);
+
+  int replaced;
+  size_t saved;
+private:
+  void visitChildren(QPDFObjectHandle obj,int depth);
+  std::string key(QPDFObjectHandle obj);
+  bool sameData(QPDFObjectHandle a,QPDFObjectHandle b,size_t *size);
+private:
+  std::map<QPDFObjGen,QPDFObjectHandle> done; // -> canonical copy
+  std::set<QPDFObjGen> active; // against reference cycles
+  std::map<std::string,QPDFObjectHandle> canonical;
+};
+
+static bool isSameObject(QPDFObjectHandle a,QPDFObjectHandle b) // {{{
+{
+  return (a.isIndirect())&&(b.isIndirect())&&(a.getObjGen()==b.getObjGen());
+}
+// }}}
+
+QPDFObjectHandle Deduplicator::visit(QPDFObjectHandle obj,int depth) // {{{
+{
+  if (depth>100) {
+    return obj;
+  }
+  if (!obj.isIndirect()) {
+    visitChildren(obj,depth);
+    return obj;
+  }
+
+  const QPDFObjGen og=obj.getObjGen();
+  auto it=done.find(og);
+  if (it!=done.end()) {
+    return it->second;
+  }
+  if (active.count(og)) {
+    return obj;
+  }
+
+  QPDFObjectHandle dict=(obj.isStream())?obj.getDict():obj;
+  if ((!dict.isDictionary())||
+      (dict.hasKey("/Parent"))||(dict.hasKey("/Kids"))) { // don't walk into the page tree
+    done[og]=obj;
+    return obj;
+  }
+  QPDFObjectHandle type=dict.getKey("/Type");
+  if ((type.isName())&&
+      ((type.getName()=="/OCG")||(type.getName()=="/OCMD"))) {
+    // identity matters: the document's optional content config refers to them
+    done[og]=obj;
+    return obj;
+  }
+
+  active.insert(og);
+  visitChildren(obj,depth);
+  active.erase(og);
+
+  // form xobjects: the data of those made by pdftopdf is generated on demand
+  if ((obj.isStream())&&(dict.getKey("/Subtype").isName())&&
+      (dict.getKey("/Subtype").getName()=="/Form")) {
+    done[og]=obj;
+    return obj;
+  }
+
+  const std::string k=key(obj);
+  auto cit=canonical.find(k);
+  size_t size=0;
+  if ((cit!=canonical.end())&&
+      ((!obj.isStream())||(sameData(cit->second,obj,&size)))) {
+    saved+=size;
+    replaced++;
+    done[og]=cit->second;
+    return cit->second;
+  }
+  canonical[k]=obj;
+  done[og]=obj;
+  return obj;
+}
+// }}}
+
+void Deduplicator::visitChildren(QPDFObjectHandle obj,int depth) // {{{
+{
+  if (obj.isStream()) {
+    obj=obj.getDict();
+  }
+  if (obj.isDictionary()) {
+    for (const std::string &name : obj.getKeys()) {
+      if (name=="/Parent") {
+        continue;
+      }
+      QPDFObjectHandle val=obj.getKey(name);
+      QPDFObjectHandle repl=visit(val,depth+1);
+      if ((repl.isIndirect())&&(!isSameObject(val,repl))) {
+        obj.replaceKey(name,repl);
+      }
+    }
+  } else if (obj.isArray()) {
+    const int len=obj.getArrayNItems();
+    for (int iA=0;iA<len;iA++) {
+      QPDFObjectHandle val=obj.getArrayItem(iA);
+      QPDFObjectHandle repl=visit(val,depth+1);
+      if ((repl.isIndirect())&&(!isSameObject(val,repl))) {
+        obj.setArrayItem(iA,repl);
+      }
+    }
+  }
+}
+// }}}
+
+// dictionary (without /Length) + hash of the raw stream data
+std::string Deduplicator::key(QPDFObjectHandle obj) // {{{
+{
+  std::string ret;
+  QPDFObjectHandle dict=obj;
+  if (obj.isStream()) {
+    dict=obj.getDict();
+    PointerHolder<Buffer> data=obj.getRawStreamData();
+    MD5 md5;
+    md5.encodeDataIncrementally((const char *)data->getBuffer(),data->getSize());
+    ret.append("stream ");
+    ret.append(md5.unparse());
+  }
+  ret.append(" <<");
+  for (const std::string &name : dict.getKeys()) { // (sorted)
+    if ((obj.isStream())&&(name=="/Length")) {
+      continue;
+    }
+    ret.append(name);
+    ret.push_back(' ');
+    ret.append(dict.getKey(name).unparse());
+  }
+  ret.append(">>");
+  return ret;
+}
+// }}}
+
+bool Deduplicator::sameData(QPDFObjectHandle a,QPDFObjectHandle b,size_t *size) // {{{
+{
+  PointerHolder<Buffer> da=a.getRawStreamData(),db=b.getRawStreamData();
+  *size=db->getSize();
+  return (da->getSize()==db->getSize())&&
+    (memcmp(da->getBuffer(),db->getBuffer(),da->getSize())==0);
+}
+// }}}
+
+} // namespace
+
+int dedupResources(QPDF &pdf,size_t *saved) // {{{
+{
+  Deduplicator dedup;
+
+  std::vector<QPDFObjectHandle> pages=pdf.getAllPages();
+  const int len=pages.size();
+  for (int iA=0;iA<len;iA++) {
+    QPDFObjectHandle res=pages[iA].getKey("/Resources");
+    QPDFObjectHandle repl=dedup.visit(res,0);
+    if ((repl.isIndirect())&&(!isSameObject(res,repl))) {
+      pages[iA].replaceKey("/Resources",repl);
+    }
+  }
+
+  if (saved) {
+    *saved=dedup.saved;
+  }
+  return dedup.replaced;
+}
+// }}}
@@ -0,0 +1,11 @@
+#ifndef QPDF_DEDUP_H_
+#define QPDF_DEDUP_H_
+
+#include <qpdf/QPDF.hh>
+
+// Makes the pages' resources share one copy of identical fonts, images,
+// ICC profiles, ... (streams and indirect dictionaries).
+// Returns the number of objects replaced; *saved: raw stream bytes no longer referenced
+int dedupResources(QPDF &pdf,size_t *saved=NULL);
+
+#endif
@@ -9,6 +9,7 @@
 #include <qpdf/QPDFAcroFormDocumentHelper.hh>
 #include "qpdf_tools.h"
 #include "qpdf_xobject.h"
+#include "qpdf_dedup.h"
 #include "qpdf_pdftopdf.h"
 
 // Use: content.append(debug_box(pe.sub,xpos,ypos));
@@ -470,6 +471,7 @@ bool QPDF_PDFTOPDF_Processor::loadFile(FILE *f,ArgOwnership take,int flatten_for
   if (!f) {
     throw std::invalid_argument("loadFile(NULL,...) not allowed");
   }
+  StageTimer timer;
   try {
     pdf.reset(new QPDF);
   } catch (...) {
@@ -499,6 +501,7 @@ bool QPDF_PDFTOPDF_Processor::loadFile(FILE *f,ArgOwnership take,int flatten_for
     error("loadFile with MustDuplicate is not supported");
     return false;
   }
+  timer.report("loading");
   start(flatten_forms);
   return true;
 }
@@ -507,6 +510,7 @@ bool QPDF_PDFTOPDF_Processor::loadFile(FILE *f,ArgOwnership take,int flatten_for
 bool QPDF_PDFTOPDF_Processor::loadFilename(const char *name,int flatten_forms) // {{{
 {
   closeFile();
+  StageTimer timer;
   try {
     pdf.reset(new QPDF);
     pdf->processFile(name);
@@ -514,14 +518,103 @@ bool QPDF_PDFTOPDF_Processor::loadFilename(const char *name,int flatten_forms) /
     error("loadFilename failed: %s",e.what());
     return false;
   }
+  timer.report("loading");
   start(flatten_forms);
   return true;
 }
 // }}}
 
+void QPDF_PDFTOPDF_Processor::setPageSelection(const ProcessingParameters &param) // {{{
+{
+  if (param.selectsInputPages()) {
+    selection.reset(new ProcessingParameters(param));
+  } else {
+    selection.reset();
+  }
+}
+// }}}
+
+static void pushInheritedAttributes(QPDFObjectHandle page) // {{{
+{
+  static const char * const inheritable[]={"/MediaBox","/CropBox","/Resources","/Rotate"};
+  QPDFObjectHandle parent=page.getKey("/Parent");
+  for (int depth=0;(parent.isDictionary())&&(depth<100);depth++) {
+    for (const char *key : inheritable) {
+      if ((page.hasKey(key))||(!parent.hasKey(key))) {
+        continue;
+      }
+      QPDFObjectHandle value=parent.getKey(key);
+      if ((!value.isIndirect())&&(!value.isScalar())) {
+        // share, instead of copying it into every page (like qpdf does)
+        parent.replaceKey(key,parent.getOwningQPDF()->makeIndirectObject(value));
+        value=parent.getKey(key);
+      }
+      page.replaceKey(key,value);
+    }
+    parent=parent.getKey("/Parent");
+  }
+}
+// }}}
+
+// Replace the page tree by a flat one holding only the selected pages,
+// so that flattening and the page tree operations in start() do not have
+// to touch the pages that will not be printed.
+void QPDF_PDFTOPDF_Processor::selectPages() // {{{
+{
+  assert(pdf);
+  assert(selection);
+
+  const int len=orig_pages.size();
+  orig_selected.assign(len,false);
+
+  QPDFObjectHandle kids=QPDFObjectHandle::newArray();
+  for (int iA=0;iA<len;iA++) {
+    if (selection->withPage(iA+1)) {
+      orig_selected[iA]=true;
+      kids.appendItem(orig_pages[iA]);
+    }
+  }
+
+  // the first page is always prepared (but not flattened):
+  // print-scaling=auto looks at its size
+  for (int iA=0;iA<len;iA++) {
+    if ((orig_selected[iA])||(iA==0)) {
+      pushInheritedAttributes(orig_pages[iA]);
+    }
+  }
+
+  QPDFObjectHandle pages=pdf->makeIndirectObject(QPDFObjectHandle::parse(
+    "<<"
+    "  /Type /Pages"
+    "  /Kids null"
+    "  /Count 0"
+    ">>"));
+  pages.replaceKey("/Kids",kids);
+  pages.replaceKey("/Count",QPDFObjectHandle::newInteger(kids.getArrayNItems()));
+  // also for the other pages: keeps the old tree from being written, when
+  // e.g. a link still refers to one of them
+  for (int iA=0;iA<len;iA++) {
+    orig_pages[iA].replaceKey("/Parent",pages);
+  }
+  pdf->getRoot().replaceKey("/Pages",pages);
+  pdf->updateAllPagesCache();
+
+  fprintf(stderr,"DEBUG: pdftopdf: preparing %d of %d pages\n",
+          kids.getArrayNItems(),len);
+}
+// }}}
+
 void QPDF_PDFTOPDF_Processor::start(int flatten_forms) // {{{
 {
   assert(pdf);
+  StageTimer timer;
+
+  orig_selected.clear();
+  if (selection) {
+    orig_pages=pdf->getAllPages();
+    selectPages();
+    timer.report("page selection");
+  }
 
   if (flatten_forms) {
     QPDFAcroFormDocumentHelper afdh(*pdf);
@@ -529,15 +622,19 @@ void QPDF_PDFTOPDF_Processor::start(int flatten_forms) // {{{
 
     QPDFPageDocumentHelper dh(*pdf);
     dh.flattenAnnotations(an_print);
+    timer.report("form flattening");
   }
 
   pdf->pushInheritedAttributesToPage();
-  orig_pages=pdf->getAllPages();
+  std::vector<QPDFObjectHandle> pages=pdf->getAllPages(); // need copy
+  if (!selection) {
+    orig_pages=pages;
+  }
 
   // remove them (just unlink, data still there)
-  const int len=orig_pages.size();
+  const int len=pages.size();
   for (int iA=0;iA<len;iA++) {
-    pdf->removePage(orig_pages[iA]);
+    pdf->removePage(pages[iA]);
   }
 
   // we remove stuff that becomes defunct (probably)  TODO
@@ -545,6 +642,7 @@ void QPDF_PDFTOPDF_Processor::start(int flatten_forms) // {{{
   pdf->getRoot().removeKey("/Outlines");
   pdf->getRoot().removeKey("/OpenAction");
   pdf->getRoot().removeKey("/PageLabels");
+  timer.report("page tree setup");
 }
 // }}}
 
@@ -613,20 +711,51 @@ void QPDF_PDFTOPDF_Processor::multiply(int copies,bool collate) // {{{
 
   std::vector<QPDFObjectHandle> pages=pdf->getAllPages(); // need copy
   const int len=pages.size();
+  if ((copies==1)||(len==0)) {
+    return;
+  }
 
+  // The copies only get their own page dictionary. Dictionaries in it
+  // (e.g. the /Resources of N-up pages) are made indirect, so they are
+  // written once and not repeated in every copy.
+  for (int iB=0;iB<len;iB++) {
+    for (const std::string &key : pages[iB].getKeys()) {
+      QPDFObjectHandle val=pages[iB].getKey(key);
+      if ((!val.isIndirect())&&(val.isDictionary())) {
+        pages[iB].replaceKey(key,pdf->makeIndirectObject(val));
+      }
+    }
+  }
+
+  // The page tree is flat (see start()); build its new /Kids in one go
+  // instead of calling addPage()/addPageAt() for every copy, which update
+  // qpdf's page position cache each time (quadratic for uncollated copies).
+  QPDFObjectHandle root=pdf->getRoot().getKey("/Pages");
+  QPDFObjectHandle kids=QPDFObjectHandle::newArray();
+  auto add_copy=[&](QPDFObjectHandle page,int copy) {
+    if (copy>0) {
+      page=page.shallowCopy();
+      page.replaceKey("/Parent",root);
+      page=pdf->makeIndirectObject(page);
+    }
+    kids.appendItem(page);
+  };
   if (collate) {
-    for (int iA=1;iA<copies;iA++) {
+    for (int iA=0;iA<copies;iA++) {
       for (int iB=0;iB<len;iB++) {
-        pdf->addPage(pages[iB].shallowCopy(),false);
+        add_copy(pages[iB],iA);
       }
     }
   } else {
     for (int iB=0;iB<len;iB++) {
-      for (int iA=1;iA<copies;iA++) {
-        pdf->addPageAt(pages[iB].shallowCopy(),false,pages[iB]);
+      for (int iA=0;iA<copies;iA++) {
+        add_copy(pages[iB],iA);
       }
     }
   }
+  root.replaceKey("/Kids",kids);
+  root.replaceKey("/Count",QPDFObjectHandle::newInteger(copies*len));
+  pdf->updateAllPagesCache();
 }
 // }}}
 
@@ -637,6 +766,9 @@ void QPDF_PDFTOPDF_Processor::autoRotateAll(bool dst_lscape,Rotation normal_land
 
   const int len=orig_pages.size();
   for (int iA=0;iA<len;iA++) {
+    if ((!orig_selected.empty())&&(!orig_selected[iA])) {
+      continue; // not prepared, will not be printed
+    }
     QPDFObjectHandle page=orig_pages[iA];
 
     Rotation src_rot=getRotate(page);
@@ -691,6 +823,35 @@ void QPDF_PDFTOPDF_Processor::setComments(const std::vector<std::string> &commen
 }
 // }}}
 
+void QPDF_PDFTOPDF_Processor::setCompactOutput(bool compact) // {{{
+{
+  compactOutput=compact;
+}
+// }}}
+
+void QPDF_PDFTOPDF_Processor::setupWriter(QPDFWriter &out) // {{{
+{
+  if (compactOutput) {
+    size_t saved=0;
+    const int replaced=dedupResources(*pdf,&saved);
+    fprintf(stderr,"DEBUG: pdftopdf: %d duplicate resources removed, %lu bytes saved\n",
+            replaced,(unsigned long)saved);
+
+    // object and cross-reference streams need PDF 1.5
+    out.setMinimumPDFVersion("1.5");
+    out.setObjectStreamMode(qpdf_o_generate);
+  } else if (hasCM) {
+    out.setMinimumPDFVersion("1.4");
+  } else {
+    out.setMinimumPDFVersion("1.2");
+  }
+  if (!extraheader.empty()) {
+    out.setExtraHeaderText(extraheader);
+  }
+  out.setPreserveEncryption(false);
+}
+// }}}
+
 void QPDF_PDFTOPDF_Processor::emitFile(FILE *f,ArgOwnership take) // {{{
 {
   if (!pdf) {
@@ -708,15 +869,7 @@ void QPDF_PDFTOPDF_Processor::emitFile(FILE *f,ArgOwnership take) // {{{
     error("emitFile with MustDuplicate is not supported");
     return;
   }
-  if (hasCM) {
-    out.setMinimumPDFVersion("1.4");
-  } else {
-    out.setMinimumPDFVersion("1.2");
-  }
-  if (!extraheader.empty()) {
-    out.setExtraHeaderText(extraheader);
-  }
-  out.setPreserveEncryption(false);
+  setupWriter(out);
   out.write();
 }
 // }}}
@@ -728,21 +881,14 @@ void QPDF_PDFTOPDF_Processor::emitFilename(const char *name) // {{{
   }
   // special case: name==NULL -> stdout
   QPDFWriter out(*pdf,name);
-  if (hasCM) {
-    out.setMinimumPDFVersion("1.4");
-  } else {
-    out.setMinimumPDFVersion("1.2");
-  }
-  if (!extraheader.empty()) {
-    out.setExtraHeaderText(extraheader);
-  }
-  out.setPreserveEncryption(false);
   std::vector<QPDFObjectHandle> pages=pdf->getAllPages();
   int len=pages.size();
-  if (len)
-  out.write();
-  else
-  fprintf(stderr, "DEBUG: No pages left, outputting empty file.\n");
+  if (len) {
+    setupWriter(out);
+    out.write();
+  } else {
+    fprintf(stderr, "DEBUG: No pages left, outputting empty file.\n");
+  }
 }
 // }}}
 
@@ -3,6 +3,7 @@
 
 #include "pdftopdf_processor.h"
 #include <qpdf/QPDF.hh>
+#include <qpdf/QPDFWriter.hh>
 
 class QPDF_PDFTOPDF_PageHandle : public PDFTOPDF_PageHandle {
  public:
@@ -35,9 +36,13 @@ class QPDF_PDFTOPDF_PageHandle : public PDFTOPDF_PageHandle {
 
 class QPDF_PDFTOPDF_Processor : public PDFTOPDF_Processor {
  public:
+  QPDF_PDFTOPDF_Processor() : hasCM(false),compactOutput(false) {}
+
   virtual bool loadFile(FILE *f,ArgOwnership take=WillStayAlive,int flatten_forms=1);
   virtual bool loadFilename(const char *name,int flatten_forms=1);
 
+  virtual void setPageSelection(const ProcessingParameters &param);
+
   // TODO: virtual bool may_modify/may_print/?
   virtual bool check_print_permissions();
 
@@ -54,6 +59,7 @@ class QPDF_PDFTOPDF_Processor : public PDFTOPDF_Processor {
   virtual void addCM(const char *defaulticc,const char *outputicc);
 
   virtual void setComments(const std::vector<std::string> &comments);
+  virtual void setCompactOutput(bool compact);
 
   virtual void emitFile(FILE *dst,ArgOwnership take=WillStayAlive);
   virtual void emitFilename(const char *name);
@@ -63,12 +69,18 @@ class QPDF_PDFTOPDF_Processor : public PDFTOPDF_Processor {
   void closeFile();
   void error(const char *fmt,...);
   void start(int flatten_forms);
+  void selectPages();
+  void setupWriter(QPDFWriter &out);
  private:
   std::unique_ptr<QPDF> pdf;
   std::vector<QPDFObjectHandle> orig_pages;
 
+  std::unique_ptr<ProcessingParameters> selection; // NULL: all pages
+  std::vector<bool> orig_selected; // empty: all pages
+
   bool hasCM;
   std::string extraheader;
+  bool compactOutput;
 };
 
 #endif
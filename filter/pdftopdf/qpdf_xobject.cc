@@ -83,7 +83,14 @@ QPDFObjectHandle makeXObject(QPDF *pdf,QPDFObjectHandle page)
 {
   page.assertPageObject();
 
-  QPDFObjectHandle ret=QPDFObjectHandle::newStream(pdf);
+  std::vector<QPDFObjectHandle> contents=page.getPageContents();  // (will assertPageObject)
+
+  // A single content stream (not already turned into an XObject for another
+  // page sharing it) becomes the XObject itself: its data stays unmodified,
+  // so QPDFWriter copies it as is, instead of inflating and deflating it again.
+  const bool reuse=(contents.size()==1)&&(!contents[0].getDict().hasKey("/Subtype"));
+
+  QPDFObjectHandle ret=(reuse)?contents[0]:QPDFObjectHandle::newStream(pdf);
   QPDFObjectHandle dict=ret.getDict();
 
   dict.replaceKey("/Type",QPDFObjectHandle::newName("/XObject")); // optional
@@ -127,6 +134,14 @@ QPDFObjectHandle makeXObject(QPDF *pdf,QPDFObjectHandle page)
 
   // Note: [/Name]  (reqd. only in 1.0 -- but there we even can't use our normal img/patter procedures)
 
+  if (reuse) {
+    return ret;
+  }
+
+  // Multiple content streams have to be joined into one, decoded: q/Q or
+  // BT/ET may span stream boundaries, so they can not be wrapped one by one,
+  // and (Flate) compressed data can not simply be concatenated.
+
   // none:
   //  QPDFObjectHandle filter=QPDFObjectHandle::newArray();
   //  QPDFObjectHandle decode_parms=QPDFObjectHandle::newArray();
@@ -134,8 +149,6 @@ QPDFObjectHandle makeXObject(QPDF *pdf,QPDFObjectHandle page)
   QPDFObjectHandle filter=QPDFObjectHandle::newNull();
   QPDFObjectHandle decode_parms=QPDFObjectHandle::newNull();
 
-  std::vector<QPDFObjectHandle> contents=page.getPageContents();  // (will assertPageObject)
-
   auto ph=PointerHolder<QPDFObjectHandle::StreamDataProvider>(new CombineFromContents_Provider(contents));
   ret.replaceStreamData(ph,filter,decode_parms);
 
@@ -0,0 +1,183 @@
+// Test for the compact output mode of pdftopdf (pdftopdf-compact-output).
+//
+// Without arguments a document with fonts and images repeated on every
+// page is generated; the duplicates must be replaced, distinct resources
+// kept, and the compact output must be smaller.
+//
+// With PDF files as arguments, bytes saved and time spent for each file
+// are shown instead:
+//
+//     test_qpdf_dedup file.pdf ...
+
+#include "qpdf_dedup.h"
+#include <qpdf/QPDFWriter.hh>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <memory>
+#include <string>
+
+static double get_time() // {{{
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec/1e9;
+}
+// }}}
+
+static size_t write_size(QPDF &pdf,bool compact) // {{{
+{
+  QPDFWriter out(pdf);
+  out.setOutputMemory();
+  if (compact) {
+    out.setMinimumPDFVersion("1.5");
+    out.setObjectStreamMode(qpdf_o_generate);
+  }
+  out.write();
+  std::unique_ptr<Buffer> buf(out.getBuffer());
+  return buf->getSize();
+}
+// }}}
+
+static QPDFObjectHandle new_stream(QPDF &pdf,const std::string &data,const char *dict) // {{{
+{
+  QPDFObjectHandle ret=QPDFObjectHandle::newStream(&pdf,data);
+  QPDFObjectHandle d=QPDFObjectHandle::parse(dict);
+  for (const std::string &name : d.getKeys()) {
+    ret.getDict().replaceKey(name,d.getKey(name));
+  }
+  return ret;
+}
+// }}}
+
+// every page gets its own copy of the same font and image;
+// the last page uses a different image
+static void make_document(QPDF &pdf,int num_pages) // {{{
+{
+  std::string fontdata(20000,'\0'),imgdata(30000,'\0'),otherdata(30000,'\0');
+  for (size_t iA=0;iA<fontdata.size();iA++) {
+    fontdata[iA]=(char)(iA*7+(iA>>5));
+  }
+  for (size_t iA=0;iA<imgdata.size();iA++) {
+    imgdata[iA]=(char)(iA*13+(iA>>3));
+    otherdata[iA]=(char)(imgdata[iA]^1);
+  }
+
+  pdf.emptyPDF();
+  for (int iA=0;iA<num_pages;iA++) {
+    QPDFObjectHandle fontfile=new_stream(pdf,fontdata,"<< /Length1 20000 >>");
+    QPDFObjectHandle desc=pdf.makeIndirectObject(QPDFObjectHandle::parse(
+      "<< /Type /FontDescriptor /FontName /Test /Flags 32"
+      "   /FontBBox [0 0 1000 1000] /ItalicAngle 0 /Ascent 800 /Descent -200"
+      "   /CapHeight 700 /StemV 80 >>"));
+    desc.replaceKey("/FontFile2",fontfile);
+    QPDFObjectHandle font=pdf.makeIndirectObject(QPDFObjectHandle::parse(
+      "<< /Type /Font /Subtype /TrueType /BaseFont /Test >>"));
+    font.replaceKey("/FontDescriptor",desc);
+
+    QPDFObjectHandle image=new_stream(pdf,(iA==num_pages-1)?otherdata:imgdata,
+      "<< /Type /XObject /Subtype /Image /Width 100 /Height 100"
+      "   /ColorSpace /DeviceRGB /BitsPerComponent 8 >>");
+
+    QPDFObjectHandle page=QPDFObjectHandle::parse(
+      "<< /Type /Page /MediaBox [0 0 612 792]"
+      "   /Resources << /Font << /F1 null >> /XObject << /Im0 null >> >> >>");
+    page.getKey("/Resources").getKey("/Font").replaceKey("/F1",font);
+    page.getKey("/Resources").getKey("/XObject").replaceKey("/Im0",image);
+    page.replaceKey("/Contents",QPDFObjectHandle::newStream(&pdf,
+      "q 100 0 0 100 0 0 cm /Im0 Do Q BT /F1 12 Tf 72 72 Td (Test) Tj ET"));
+    pdf.addPage(pdf.makeIndirectObject(page),false);
+  }
+}
+// }}}
+
+static int bench_file(const char *filename) // {{{
+{
+  QPDF pdf;
+  try {
+    pdf.processFile(filename);
+
+    double start=get_time();
+    const size_t plain=write_size(pdf,false);
+    const double plain_time=get_time()-start;
+
+    start=get_time();
+    size_t saved=0;
+    const int replaced=dedupResources(pdf,&saved);
+    const double dedup_time=get_time()-start;
+
+    start=get_time();
+    const size_t compact=write_size(pdf,true);
+    const double compact_time=get_time()-start;
+
+    printf("%s: %lu -> %lu bytes (%.1f%%), %d objects (%lu stream bytes) shared, "
+           "write %.3f s, dedup %.3f s + write %.3f s\n",
+           filename,(unsigned long)plain,(unsigned long)compact,
+           100.0*compact/plain,replaced,(unsigned long)saved,
+           plain_time,dedup_time,compact_time);
+  } catch (const std::exception &e) {
+    fprintf(stderr,"%s: %s\n",filename,e.what());
+    return 1;
+  }
+  return 0;
+}
+// }}}
+
+int main(int argc,char **argv)
+{
+  if (argc>1) {
+    int status=0;
+    for (int iA=1;iA<argc;iA++) {
+      status|=bench_file(argv[iA]);
+    }
+    return status;
+  }
+
+  const int num_pages=10;
+  QPDF pdf;
+  make_document(pdf,num_pages);
+
+  const size_t plain=write_size(pdf,false);
+
+  size_t saved=0;
+  const int replaced=dedupResources(pdf,&saved);
+
+  // font file, descriptor, font and image of all pages but the first;
+  // the last page's image differs
+  const int expected=3*(num_pages-1)+(num_pages-2);
+  int status=0;
+  if (replaced!=expected) {
+    printf("FAIL: %d objects replaced, expected %d\n",replaced,expected);
+    status=1;
+  }
+
+  std::vector<QPDFObjectHandle> pages=pdf.getAllPages();
+  QPDFObjectHandle font0=pages[0].getKey("/Resources").getKey("/Font").getKey("/F1");
+  QPDFObjectHandle img0=pages[0].getKey("/Resources").getKey("/XObject").getKey("/Im0");
+  for (int iA=1;iA<num_pages;iA++) {
+    QPDFObjectHandle font=pages[iA].getKey("/Resources").getKey("/Font").getKey("/F1");
+    QPDFObjectHandle img=pages[iA].getKey("/Resources").getKey("/XObject").getKey("/Im0");
+    if (!(font.getObjGen()==font0.getObjGen())) {
+      printf("FAIL: font of page %d not shared\n",iA+1);
+      status=1;
+    }
+    if ((img.getObjGen()==img0.getObjGen())!=(iA!=num_pages-1)) {
+      printf("FAIL: image of page %d %s\n",iA+1,
+             (iA!=num_pages-1)?"not shared":"shared, but different");
+      status=1;
+    }
+  }
+
+  const size_t compact=write_size(pdf,true);
+  if (compact>=plain) {
+    printf("FAIL: compact output not smaller (%lu >= %lu bytes)\n",
+           (unsigned long)compact,(unsigned long)plain);
+    status=1;
+  }
+
+  if (!status) {
+    printf("PASS: %lu -> %lu bytes, %d objects (%lu stream bytes) shared\n",
+           (unsigned long)plain,(unsigned long)compact,replaced,(unsigned long)saved);
+  }
+  return status;
+}
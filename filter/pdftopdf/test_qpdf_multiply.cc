@@ -0,0 +1,144 @@
+// Test for the software copies of pdftopdf: multiply() builds the page
+// tree by hand, and must give the same page order, collated and
+// uncollated, as adding the copies one by one with addPage() and
+// addPageAt() did before.
+
+#include "qpdf_pdftopdf_processor.h"
+#include <qpdf/QPDFWriter.hh>
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static std::string make_document(int num_pages) // {{{
+{
+  QPDF pdf;
+  pdf.emptyPDF();
+  for (int iA=0;iA<num_pages;iA++) {
+    QPDFObjectHandle page=QPDFObjectHandle::parse(
+      "<< /Type /Page /MediaBox [0 0 612 792]"
+      "   /Resources << /Font << /F1 << /Type /Font /Subtype /Type1"
+      "                                 /BaseFont /Helvetica >> >> >> >>");
+    char content[100];
+    snprintf(content,sizeof(content),"BT /F1 12 Tf 72 720 Td (page %d) Tj ET",iA+1);
+    page.replaceKey("/Contents",QPDFObjectHandle::newStream(&pdf,content));
+    pdf.addPage(pdf.makeIndirectObject(page),false);
+  }
+
+  QPDFWriter out(pdf);
+  out.setOutputMemory();
+  out.write();
+  std::unique_ptr<Buffer> buf(out.getBuffer());
+  return std::string((const char *)buf->getBuffer(),buf->getSize());
+}
+// }}}
+
+// the content of each page, in page tree order
+static std::vector<std::string> page_order(QPDF &pdf) // {{{
+{
+  std::vector<std::string> ret;
+  for (QPDFObjectHandle page : pdf.getAllPages()) {
+    std::string content;
+    for (QPDFObjectHandle stream : page.getPageContents()) {
+      PointerHolder<Buffer> buf(stream.getStreamData());
+      content.append((const char *)buf->getBuffer(),buf->getSize());
+    }
+    ret.push_back(content);
+  }
+  if (pdf.getRoot().getKey("/Pages").getKey("/Count").getIntValue()!=(long long)ret.size()) {
+    ret.push_back("(wrong /Count)");
+  }
+  return ret;
+}
+// }}}
+
+// what addPage()/addPageAt() gave for the copies
+static std::vector<std::string> old_order(const std::string &doc,int copies,bool collate) // {{{
+{
+  QPDF pdf;
+  pdf.processMemoryFile("old",doc.data(),doc.size());
+
+  std::vector<QPDFObjectHandle> pages=pdf.getAllPages(); // need copy
+  const int len=pages.size();
+
+  if (collate) {
+    for (int iA=1;iA<copies;iA++) {
+      for (int iB=0;iB<len;iB++) {
+        pdf.addPage(pages[iB].shallowCopy(),false);
+      }
+    }
+  } else {
+    for (int iB=0;iB<len;iB++) {
+      for (int iA=1;iA<copies;iA++) {
+        pdf.addPageAt(pages[iB].shallowCopy(),false,pages[iB]);
+      }
+    }
+  }
+  return page_order(pdf);
+}
+// }}}
+
+static std::vector<std::string> new_order(const std::string &doc,int copies,bool collate) // {{{
+{
+  FILE *in=tmpfile(),*out=tmpfile();
+  if ( (!in)||(!out)||
+       (fwrite(doc.data(),1,doc.size(),in)!=doc.size()) ) {
+    throw std::runtime_error("tmpfile");
+  }
+  rewind(in);
+
+  QPDF_PDFTOPDF_Processor proc;
+  if (!proc.loadFile(in,TakeOwnership,0)) {
+    throw std::runtime_error("loadFile");
+  }
+  for (const std::shared_ptr<PDFTOPDF_PageHandle> &page : proc.get_pages()) {
+    proc.add_page(page,false);
+  }
+  proc.multiply(copies,collate);
+  proc.emitFile(out,WillStayAlive);
+
+  std::string data;
+  char buf[4096];
+  size_t len;
+  rewind(out);
+  while ((len=fread(buf,1,sizeof(buf),out))>0) {
+    data.append(buf,len);
+  }
+  fclose(out);
+
+  QPDF pdf;
+  pdf.processMemoryFile("new",data.data(),data.size());
+  return page_order(pdf);
+}
+// }}}
+
+int main()
+{
+  static const int num_pages[]={1,3},copies[]={1,2,4};
+  int ret=0;
+
+  try {
+    for (int pages : num_pages) {
+      const std::string doc=make_document(pages);
+      for (int num : copies) {
+        for (bool collate : {false,true}) {
+          const std::vector<std::string> expect=old_order(doc,num,collate),
+                                         got=new_order(doc,num,collate);
+          const bool ok=(got==expect)&&(got.size()==(size_t)(pages*num));
+          printf("%d pages, %d copies, %s: %s\n",pages,num,
+                 (collate)?"collated":"uncollated",(ok)?"PASS":"FAIL");
+          if (!ok) {
+            ret=1;
+          }
+        }
+      }
+    }
+  } catch (const std::exception &e) {
+    fprintf(stderr,"FAIL: %s\n",e.what());
+    ret=1;
+  }
+
+  return ret;
+}
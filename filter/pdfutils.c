@@ -13,15 +13,74 @@
 #include <memory.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <zlib.h>
 #include "pdfutils.h"
 #include "fontembed/embed.h"
 
+// makes room for >len more bytes of stream data, returns false on error
+static int pdfOut_stream_grow(pdfOut *pdf,long len) // {{{
+{
+  if (pdf->streamsize+len>pdf->streamalloc) {
+    long alloc=pdf->streamalloc ? pdf->streamalloc : 65536;
+    while (alloc<pdf->streamsize+len) {
+      alloc*=2;
+    }
+    char *tmp=realloc(pdf->stream,alloc);
+    if (!tmp) {
+      return 0;
+    }
+    pdf->stream=tmp;
+    pdf->streamalloc=alloc;
+  }
+  return 1;
+}
+// }}}
+
+static void pdfOut_write(pdfOut *pdf,const char *buf,int len) // {{{
+{
+  if (pdf->instream) {
+    if (!pdfOut_stream_grow(pdf,len)) {
+      fprintf(stderr,"Bad alloc: %s\n", strerror(errno));
+      assert(0);
+      return;
+    }
+    memcpy(pdf->stream+pdf->streamsize,buf,len);
+    pdf->streamsize+=len;
+  } else {
+    fwrite(buf,1,len,stdout);
+    pdf->filepos+=len;
+  }
+}
+// }}}
+
 void pdfOut_printf(pdfOut *pdf,const char *fmt,...) // {{{
 {
   assert(pdf);
   int len;
   va_list ap;
 
+  if (pdf->instream) {
+    // format right into the stream buffer, grow and retry if too small
+    while (1) {
+      const long avail=pdf->streamalloc-pdf->streamsize;
+      va_start(ap,fmt);
+      len=vsnprintf(pdf->stream+pdf->streamsize,avail,fmt,ap);
+      va_end(ap);
+      if (len<0) {
+        return;
+      } else if (len<avail) {
+        break;
+      } else if (!pdfOut_stream_grow(pdf,len+1)) {
+        fprintf(stderr,"Bad alloc: %s\n", strerror(errno));
+        assert(0);
+        return;
+      }
+    }
+    pdf->streamsize+=len;
+    return;
+  }
+
   va_start(ap,fmt);
   len=vprintf(fmt,ap);
   va_end(ap);
@@ -33,46 +92,115 @@ void pdfOut_putString(pdfOut *pdf,const char *str,int len) // {{{ - >len==-1: st
 {
   assert(pdf);
   assert(str);
+  char esc[4];
   if (len==-1) {
     len=strlen(str);
   }
-  putc('(',stdout);
+  pdfOut_write(pdf,"(",1);
   // escape special chars: \0 \\ \( \)  -- don't bother about balanced parens
   int iA=0;
   for (;len>0;iA++,len--) {
     if ( (str[iA]<32)||(str[iA]>126) ) {
-      fwrite(str,1,iA,stdout);
-      fprintf(stdout,"\\%03o",(unsigned char)str[iA]);
-      pdf->filepos+=iA+4;
+      pdfOut_write(pdf,str,iA);
+      snprintf(esc,sizeof(esc),"%03o",(unsigned char)str[iA]);
+      pdfOut_write(pdf,"\\",1);
+      pdfOut_write(pdf,esc,3);
       str+=iA+1;
       iA=-1;
     } else if ( (str[iA]=='(')||(str[iA]==')')||(str[iA]=='\\') ) {
-      fwrite(str,1,iA,stdout);
-      fprintf(stdout,"\\%c",str[iA]);
-      pdf->filepos+=iA+2;
+      pdfOut_write(pdf,str,iA);
+      esc[0]='\\';
+      esc[1]=str[iA];
+      pdfOut_write(pdf,esc,2);
       str+=iA+1;
       iA=-1;
     }
   }
-  pdf->filepos+=iA+2;
-  fwrite(str,1,iA,stdout);
-  putc(')',stdout);
+  pdfOut_write(pdf,str,iA);
+  pdfOut_write(pdf,")",1);
 }
 // }}}
 
 void pdfOut_putHexString(pdfOut *pdf,const char *str,int len) // {{{ - >len==-1: strlen()
 {
+  static const char hex[]="0123456789abcdef";
   assert(pdf);
   assert(str);
+  char buf[256];
+  int pos=0;
   if (len==-1) {
     len=strlen(str);
   }
-  pdf->filepos+=2*len+2;
-  putc('<',stdout);
+  buf[pos++]='<';
   for (;len>0;str++,len--) {
-    fprintf(stdout,"%02x",(unsigned char)*str);
+    if (pos+2>(int)sizeof(buf)) {
+      pdfOut_write(pdf,buf,pos);
+      pos=0;
+    }
+    buf[pos++]=hex[(unsigned char)*str>>4];
+    buf[pos++]=hex[(unsigned char)*str&0x0f];
   }
-  putc('>',stdout);
+  if (pos+1>(int)sizeof(buf)) {
+    pdfOut_write(pdf,buf,pos);
+    pos=0;
+  }
+  buf[pos++]='>';
+  pdfOut_write(pdf,buf,pos);
+}
+// }}}
+
+void pdfOut_begin_stream(pdfOut *pdf) // {{{
+{
+  assert(pdf);
+  assert(!pdf->instream);
+  pdf->instream=1;
+  pdf->streamsize=0;
+  if (!pdfOut_stream_grow(pdf,1)) {
+    fprintf(stderr,"Bad alloc: %s\n", strerror(errno));
+    assert(0);
+  }
+}
+// }}}
+
+int pdfOut_end_stream(pdfOut *pdf,int compress) // {{{ - obj_no, 0 on error
+{
+  assert( (pdf)&&(pdf->instream) );
+  const char *data=pdf->stream;
+  unsigned long len=pdf->streamsize;
+  unsigned char *zbuf=NULL;
+
+  pdf->instream=0;
+  if ( (compress)&&(len>0) ) {
+    uLongf zlen=compressBound(len);
+    zbuf=malloc(zlen);
+    if ( (zbuf)&&(compress2(zbuf,&zlen,(const Bytef *)data,len,Z_BEST_SPEED)==Z_OK) ) {
+      data=(const char *)zbuf;
+      len=zlen;
+    } else {
+      free(zbuf);
+      zbuf=NULL;
+      compress=0;
+    }
+  } else {
+    compress=0;
+  }
+
+  const int obj=pdfOut_add_xref(pdf);
+  if (obj<=0) {
+    free(zbuf);
+    return 0;
+  }
+  pdfOut_printf(pdf,"%d 0 obj\n"
+                    "<</Length %lu\n"
+                    "%s"
+                    ">>\n"
+                    "stream\n",
+                    obj,len,(compress)?"  /Filter /FlateDecode\n":"");
+  pdfOut_write(pdf,data,len);
+  pdfOut_printf(pdf,"\nendstream\n"
+                    "endobj\n");
+  free(zbuf);
+  return obj;
 }
 // }}}
 
@@ -275,6 +403,7 @@ void pdfOut_free(pdfOut *pdf) // {{{
   if (pdf) {
     assert(pdf->kvsize==0); // otherwise: finish_pdf has not been called
     free(pdf->kv);
+    free(pdf->stream);
     free(pdf->pages);
     free(pdf->xref);
     free(pdf);
@@ -24,6 +24,11 @@ typedef struct {
 
   int kvsize,kvalloc;
   struct keyval_t *kv;
+
+  // content stream being collected (see pdfOut_begin_stream())
+  int instream;
+  long streamsize,streamalloc;
+  char *stream;
 } pdfOut;
 
 /* allocates a new pdfOut structure
@@ -50,6 +55,17 @@ void pdfOut_printf(pdfOut *pdf,const char *fmt,...)
 void pdfOut_putString(pdfOut *pdf,const char *str,int len);
 void pdfOut_putHexString(pdfOut *pdf,const char *str,int len);
 
+/* Collect all output up to pdfOut_end_stream() in memory,
+ * as data of a stream object.
+ */
+void pdfOut_begin_stream(pdfOut *pdf);
+
+/* write out the collected stream as a new object,
+ * Flate compressed if >compress is true.
+ * returns the obj number, or 0 on error
+ */
+int pdfOut_end_stream(pdfOut *pdf,int compress);
+
 /* Format the broken up timestamp according to
  * pdf requirements for /CreationDate
  * NOTE: uses statically allocated buffer 
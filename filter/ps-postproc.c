@@ -0,0 +1,441 @@
+/*
+ *   PostScript post-processing for the pdftops filter.
+ *
+ *   Copyright 2020 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ *   Patches the DSC comments of the renderer's output on its way to
+ *   pstops: %%Title and %%For of Acrobat Reader's output are replaced,
+ *   printer bug workaround code is inserted at the beginning of the
+ *   Prolog, and option code for PPD-less printing in the Setup section.
+ *
+ *   Only the header up to the Setup section is scanned line by line,
+ *   inside the input buffer; the rest is passed on with large read()
+ *   and write() calls.
+ *
+ * Contents:
+ *
+ *   ps_postproc()   - Post-process PostScript from a file to another.
+ *   pp_copy()       - Copy the rest of the input.
+ *   pp_fill()       - Fill the input buffer.
+ *   pp_flush()      - Write out the output buffer.
+ *   pp_getline()    - Get the next line.
+ *   pp_output()     - Write bytes to the output file.
+ *   pp_puts()       - Write a string.
+ *   pp_write()      - Write bytes.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "ps-postproc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+
+/*
+ * Types...
+ */
+
+typedef struct pp_buf_s			/**** Buffered file ****/
+{
+  int		fd;			/* File descriptor */
+  volatile int	*canceled;		/* Job canceled flag or NULL */
+  int		error;			/* Read/write error or canceled? */
+  size_t	pos,			/* Position in buffer (input) */
+		length;			/* Bytes in buffer */
+  char		buffer[PS_POSTPROC_BUFSIZE];
+					/* Buffer */
+} pp_buf_t;
+
+
+/*
+ * Local functions...
+ */
+
+static void	pp_copy(pp_buf_t *in, pp_buf_t *out);
+static int	pp_fill(pp_buf_t *in);
+static void	pp_flush(pp_buf_t *out);
+static size_t	pp_getline(pp_buf_t *in, char *line, size_t linesize);
+static void	pp_output(pp_buf_t *out, const char *data, size_t bytes);
+static void	pp_puts(pp_buf_t *out, const char *s);
+static void	pp_write(pp_buf_t *out, const char *data, size_t bytes);
+
+
+/*
+ * 'ps_postproc()' - Post-process PostScript from a file to another.
+ */
+
+int					/* O - 0 on success, -1 on error */
+ps_postproc(int                 infd,	/* I - Input file */
+            int                 outfd,	/* I - Output file */
+	    const ps_postproc_t *pp)	/* I - What to do */
+{
+  pp_buf_t	*in,			/* Input */
+		*out;			/* Output */
+  char		line[8192];		/* Current line */
+  size_t	bytes;			/* Length of line */
+  int		status;			/* Return status */
+
+
+  in  = malloc(sizeof(pp_buf_t));
+  out = malloc(sizeof(pp_buf_t));
+
+  if (!in || !out)
+  {
+    free(in);
+    free(out);
+    return (-1);
+  }
+
+  in->fd        = infd;
+  out->fd       = outfd;
+  in->canceled  = out->canceled = pp->canceled;
+  in->error     = out->error    = 0;
+  in->pos       = in->length    = 0;
+  out->length   = 0;
+
+  if (pp->title)
+  {
+   /*
+    * Set %Title and %For from filter arguments since acroread inserts
+    * garbage for these when using -toPostScript
+    */
+
+    while ((bytes = pp_getline(in, line, sizeof(line))) > 0 &&
+           strncmp(line, "%%BeginProlog", 13))
+    {
+      if (strncmp(line, "%%Title", 7) == 0)
+      {
+        pp_puts(out, "%%Title: ");
+        pp_puts(out, pp->title);
+        pp_puts(out, "\n");
+      }
+      else if (strncmp(line, "%%For", 5) == 0)
+      {
+        pp_puts(out, "%%For: ");
+        pp_puts(out, pp->user);
+        pp_puts(out, "\n");
+      }
+      else
+        pp_write(out, line, bytes);
+    }
+
+    pp_write(out, line, bytes);
+  }
+  else
+  {
+   /*
+    * Copy everything until after initial comments (Prolog section)
+    */
+
+    while ((bytes = pp_getline(in, line, sizeof(line))) > 0 &&
+	   strncmp(line, "%%BeginProlog", 13) &&
+	   strncmp(line, "%%EndProlog", 11) &&
+	   strncmp(line, "%%BeginSetup", 12) &&
+	   strncmp(line, "%%Page:", 7))
+      pp_write(out, line, bytes);
+
+    if (bytes > 0)
+    {
+     /*
+      * Insert PostScript interpreter bug fix code in the beginning of
+      * the Prolog section (before the first active PostScript code)
+      */
+
+      if (strncmp(line, "%%BeginProlog", 13))
+      {
+	/* No Prolog section, create one */
+	fprintf(stderr, "DEBUG: Adding Prolog section for workaround PostScript code\n");
+	pp_puts(out, "%%BeginProlog\n");
+      }
+      else
+	pp_write(out, line, bytes);
+
+      if (pp->prolog_code)
+        pp_puts(out, pp->prolog_code);
+
+      if (strncmp(line, "%%BeginProlog", 13))
+      {
+	/* Close newly created Prolog section */
+	if (strncmp(line, "%%EndProlog", 11))
+	  pp_puts(out, "%%EndProlog\n");
+
+	/* The first page comes after the Setup section we add below */
+	if (!pp->setup_code || strncmp(line, "%%Page:", 7))
+	  pp_write(out, line, bytes);
+      }
+
+      if (pp->setup_code)
+      {
+       /*
+	* Copy everything until the setup section
+	*/
+
+	while (bytes > 0 &&
+	       strncmp(line, "%%BeginSetup", 12) &&
+	       strncmp(line, "%%EndSetup", 10) &&
+	       strncmp(line, "%%Page:", 7))
+	{
+	  bytes = pp_getline(in, line, sizeof(line));
+	  if (strncmp(line, "%%Page:", 7) &&
+	      strncmp(line, "%%EndSetup", 10))
+	    pp_write(out, line, bytes);
+	}
+
+	if (bytes > 0)
+	{
+	 /*
+	  * Insert option PostScript code in Setup section
+	  */
+
+	  if (strncmp(line, "%%BeginSetup", 12))
+	  {
+	    /* No Setup section, create one */
+	    fprintf(stderr, "DEBUG: Adding Setup section for option PostScript code\n");
+	    pp_puts(out, "%%BeginSetup\n");
+	  }
+
+	  pp_puts(out, pp->setup_code);
+
+	  if (strncmp(line, "%%BeginSetup", 12))
+	  {
+	    /* Close newly created Setup section */
+	    if (strncmp(line, "%%EndSetup", 10))
+	      pp_puts(out, "%%EndSetup\n");
+	    pp_write(out, line, bytes);
+	  }
+	}
+      }
+    }
+  }
+
+ /*
+  * Copy the rest of the file
+  */
+
+  pp_copy(in, out);
+
+  status = (in->error || out->error) ? -1 : 0;
+
+  free(in);
+  free(out);
+
+  return (status);
+}
+
+
+/*
+ * 'pp_copy()' - Copy the rest of the input.
+ */
+
+static void
+pp_copy(pp_buf_t *in,			/* I - Input */
+        pp_buf_t *out)			/* I - Output */
+{
+  pp_flush(out);
+
+  do
+  {
+   /*
+    * Write straight from the input buffer...
+    */
+
+    pp_output(out, in->buffer + in->pos, in->length - in->pos);
+    in->pos = in->length;
+  }
+  while (!out->error && pp_fill(in));
+}
+
+
+/*
+ * 'pp_fill()' - Fill the input buffer.
+ */
+
+static int				/* O - 1 on success, 0 on EOF or error */
+pp_fill(pp_buf_t *in)			/* I - Input */
+{
+  ssize_t	bytes;			/* Bytes read */
+
+
+  in->pos    = 0;
+  in->length = 0;
+
+  if (in->error)
+    return (0);
+
+  while ((bytes = read(in->fd, in->buffer, sizeof(in->buffer))) < 0)
+  {
+    if (errno == EINTR && in->canceled && *(in->canceled))
+    {
+      in->error = 1;
+      return (0);
+    }
+    else if (errno != EINTR && errno != EAGAIN)
+    {
+      perror("DEBUG: Unable to read print data");
+      in->error = 1;
+      return (0);
+    }
+  }
+
+  in->length = (size_t)bytes;
+
+  return (bytes > 0);
+}
+
+
+/*
+ * 'pp_flush()' - Write out the output buffer.
+ */
+
+static void
+pp_flush(pp_buf_t *out)			/* I - Output */
+{
+  pp_output(out, out->buffer, out->length);
+
+  out->length = 0;
+}
+
+
+/*
+ * 'pp_getline()' - Get the next line.
+ *
+ * Like cupsFileGetLine(), lines end with CR, LF, or CR LF, which are
+ * kept, and lines longer than the buffer are returned in pieces.
+ */
+
+static size_t				/* O - Length of line, 0 on EOF */
+pp_getline(pp_buf_t *in,		/* I - Input */
+           char     *line,		/* O - Line */
+	   size_t   linesize)		/* I - Size of line buffer */
+{
+  char		*start,			/* Start of data in buffer */
+		*ptr;			/* Pointer into buffer */
+  size_t	count,			/* Bytes to copy */
+		bytes = 0;		/* Length of line */
+
+
+  while (bytes < linesize - 1)
+  {
+    if (in->pos >= in->length && !pp_fill(in))
+      break;
+
+    start = in->buffer + in->pos;
+    count = in->length - in->pos;
+    if (count > linesize - 1 - bytes)
+      count = linesize - 1 - bytes;
+
+    for (ptr = start; ptr < start + count; ptr ++)
+      if (*ptr == '\n' || *ptr == '\r')
+        break;
+
+    if (ptr < start + count)
+    {
+     /*
+      * End of line...
+      */
+
+      ptr ++;
+      memcpy(line + bytes, start, (size_t)(ptr - start));
+      bytes   += (size_t)(ptr - start);
+      in->pos += (size_t)(ptr - start);
+
+      if (ptr[-1] == '\r' && bytes < linesize - 1 &&
+          (in->pos < in->length || pp_fill(in)) &&
+	  in->buffer[in->pos] == '\n')
+      {
+        line[bytes ++] = '\n';
+	in->pos ++;
+      }
+      break;
+    }
+
+    memcpy(line + bytes, start, count);
+    bytes   += count;
+    in->pos += count;
+  }
+
+  line[bytes] = '\0';
+
+  return (bytes);
+}
+
+
+/*
+ * 'pp_output()' - Write bytes to the output file.
+ */
+
+static void
+pp_output(pp_buf_t   *out,		/* I - Output */
+          const char *data,		/* I - Data */
+	  size_t     bytes)		/* I - Number of bytes */
+{
+  ssize_t	count;			/* Bytes written */
+
+
+  while (!out->error && bytes > 0)
+  {
+    if ((count = write(out->fd, data, bytes)) < 0)
+    {
+      if (errno == EINTR && out->canceled && *(out->canceled))
+        out->error = 1;
+      else if (errno != EINTR && errno != EAGAIN)
+      {
+        perror("DEBUG: Unable to write print data");
+	out->error = 1;
+      }
+    }
+    else
+    {
+      data  += count;
+      bytes -= (size_t)count;
+    }
+  }
+}
+
+
+/*
+ * 'pp_puts()' - Write a string.
+ */
+
+static void
+pp_puts(pp_buf_t   *out,		/* I - Output */
+        const char *s)			/* I - String */
+{
+  pp_write(out, s, strlen(s));
+}
+
+
+/*
+ * 'pp_write()' - Write bytes.
+ */
+
+static void
+pp_write(pp_buf_t   *out,		/* I - Output */
+         const char *data,		/* I - Data */
+	 size_t     bytes)		/* I - Number of bytes */
+{
+  size_t	count;			/* Bytes to copy */
+
+
+  while (bytes > 0 && !out->error)
+  {
+    if (out->length >= sizeof(out->buffer))
+      pp_flush(out);
+
+    if ((count = sizeof(out->buffer) - out->length) > bytes)
+      count = bytes;
+
+    memcpy(out->buffer + out->length, data, count);
+    out->length += count;
+    data        += count;
+    bytes       -= count;
+  }
+}
@@ -0,0 +1,49 @@
+/*
+ *   PostScript post-processing for the pdftops filter.
+ *
+ *   Copyright 2020 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ */
+
+#ifndef _PS_POSTPROC_H_
+#  define _PS_POSTPROC_H_
+
+#  ifdef __cplusplus
+extern "C" {
+#  endif /* __cplusplus */
+
+
+/*
+ * Size of the input and output buffers...
+ */
+
+#  define PS_POSTPROC_BUFSIZE	65536
+
+
+/*
+ * Types...
+ */
+
+typedef struct ps_postproc_s		/**** PostScript post-processing ****/
+{
+  const char	*title,			/* %%Title to set (Acrobat Reader) or NULL */
+		*user,			/* %%For to set (Acrobat Reader) */
+		*prolog_code,		/* Code for start of Prolog or NULL */
+		*setup_code;		/* Code for Setup section or NULL */
+  volatile int	*canceled;		/* Job canceled flag or NULL */
+} ps_postproc_t;
+
+
+/*
+ * Prototypes...
+ */
+
+extern int	ps_postproc(int infd, int outfd, const ps_postproc_t *pp);
+
+#  ifdef __cplusplus
+}
+#  endif /* __cplusplus */
+
+#endif /* !_PS_POSTPROC_H_ */
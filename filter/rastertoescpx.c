@@ -29,6 +29,7 @@
 
 #include <cupsfilters/driver.h>
 #include "escp.h"
+#include "pcl-compress.h"
 #include <signal.h>
 #include <string.h>
 #include <ctype.h>
@@ -65,7 +66,10 @@ unsigned char	*PixelBuffer,		/* Pixel buffer */
 short		*InputBuffer;		/* Color separation buffer */
 cups_weave_t	*DotAvailList,		/* Available buffers */
 		*DotUsedList,		/* Used buffers */
-		*DotBands[128][7];	/* Buffers in use */
+		*DotBands[128][7],	/* Buffers in use */
+		*DotBandArena;		/* Bands for the current page */
+unsigned char	*DotBandData;		/* Band buffers for the current page */
+int		DotSchedule[128];	/* Subrow for each line and pass */
 int		DotBufferSize,		/* Size of dot buffers */
 		DotRowMax,		/* Maximum row number in buffer */
 		DotColStep,		/* Step for each output column */
@@ -74,15 +78,28 @@ int		DotBufferSize,		/* Size of dot buffers */
 		DotRowCount,		/* Number of rows to output */
 		DotRowOffset[7],	/* Offset for each color on print head */
 		DotRowCurrent,		/* Current row */
+		DotXStep,		/* Band column spacing in 1/3600ths */
+		DotYStep,		/* Band line spacing in 1/3600ths */
 		DotSize;		/* Dot size (Pro 5000 only) */
 int		PrinterPlanes,		/* # of color planes */
 		BitPlanes,		/* # of bit planes per color */
 		PrinterTop,		/* Top of page */
-		PrinterLength;		/* Length of page */
+		PrinterLength,		/* Length of page */
+		PrinterColors[7];	/* Color selection for each plane */
 cups_lut_t	*DitherLuts[7];		/* Lookup tables for dithering */
 cups_dither_t	*DitherStates[7];	/* Dither state tables */
 int		OutputFeed;		/* Number of lines to skip */
 int		Canceled;		/* Is the job canceled? */
+const int	ColorTable[7][7] =	/* Colors */
+		{
+		  {  0,  0,  0,  0,  0,  0,  0 },	/* K */
+		  {  0, 16,  0,  0,  0,  0,  0 },	/* Kk */
+		  {  2,  1,  4,  0,  0,  0,  0 },	/* CMY */
+		  {  2,  1,  4,  0,  0,  0,  0 },	/* CMYK */
+		  {  0,  0,  0,  0,  0,  0,  0 },
+		  {  2, 18,  1, 17,  4,  0,  0 },	/* CcMmYK */
+		  {  2, 18,  1, 17,  4,  0, 16 },	/* CcMmYKk */
+		};
 
 
 /*
@@ -902,21 +919,23 @@ StartPage(ppd_file_t         *ppd,	/* I - PPD file */
     * Allocate bands...
     */
 
-    for (i = 0; i < bands; i ++)
-    {
-      band         = (cups_weave_t *)calloc(1, sizeof(cups_weave_t));
-      band->next   = DotAvailList;
-      DotAvailList = band;
-
-      band->buffer = calloc(DotRowCount, DotBufferSize);
-    }
+    DotBandArena = (cups_weave_t *)calloc(bands, sizeof(cups_weave_t));
+    DotBandData  = calloc((size_t)bands * DotRowCount, DotBufferSize);
 
-    if (!DotAvailList)
+    if (!DotBandArena || !DotBandData)
     {
       fputs("ERROR: Unable to allocate band list\n", stderr);
       exit(1);
     }
 
+    for (i = 0, band = DotBandArena; i < bands; i ++, band ++)
+    {
+      band->next   = DotAvailList;
+      DotAvailList = band;
+
+      band->buffer = DotBandData + (size_t)i * DotRowCount * DotBufferSize;
+    }
+
     fputs("DEBUG: Pointer list at start of page...\n", stderr);
 
     for (band = DotAvailList; band != NULL; band = band->next)
@@ -998,6 +1017,18 @@ StartPage(ppd_file_t         *ppd,	/* I - PPD file */
 
       subrow = (subrow + DotRowFeed) % modrow;
     }
+
+   /*
+    * Precompute the weave schedule; line y goes to pass "pass" of subrow
+    * DotSchedule[(y % DotRowStep) * DotColStep + pass]...
+    */
+
+    for (y = 0; y < DotRowStep; y ++)
+      for (i = 0; i < DotColStep; i ++)
+        DotSchedule[y * DotColStep + i] = y + i * DotRowStep;
+
+    DotXStep = 3600 * DotColStep / header->HWResolution[0];
+    DotYStep = 3600 * DotRowStep / header->HWResolution[1];
   }
   else
   {
@@ -1009,8 +1040,14 @@ StartPage(ppd_file_t         *ppd,	/* I - PPD file */
 
     for (plane = 0; plane < PrinterPlanes; plane ++, ptr += DotBufferSize)
       DotBuffers[plane] = ptr;
+
+    DotXStep = 3600 / header->HWResolution[0];
+    DotYStep = 3600 / header->HWResolution[1];
   }
 
+  for (plane = 0; plane < PrinterPlanes; plane ++)
+    PrinterColors[plane] = ColorTable[PrinterPlanes - 1][plane];
+
  /*
   * Set the output resolution...
   */
@@ -1041,7 +1078,7 @@ StartPage(ppd_file_t         *ppd,	/* I - PPD file */
   if (RGB)
     CMYKBuffer = malloc(header->cupsWidth * PrinterPlanes);
 
-  CompBuffer = malloc(10 * DotBufferSize * DotRowMax);
+  CompBuffer = malloc(PCL_COMPRESS_BUFSIZE(DotRowCount * DotBufferSize));
 }
 
 
@@ -1117,28 +1154,19 @@ EndPage(ppd_file_t         *ppd,	/* I - PPD file */
       next = band->next;
 
       OutputBand(ppd, header, band);
-
-      fprintf(stderr, "DEBUG: freeing used band %p, prev = %p, next = %p\n",
-              (void*)band, (void*)band->prev, (void*)band->next);
-
-      free(band->buffer);
-      free(band);
     }
 
    /*
-    * Free memory for the available bands, if any...
+    * Free memory for the bands...
     */
 
-    for (band = DotAvailList; band != NULL; band = next)
-    {
-      next = band->next;
-
-      fprintf(stderr, "DEBUG: freeing avail band %p, prev = %p,  next = %p\n",
-              (void*)band, (void*)band->prev, (void*)band->next);
+    free(DotBandArena);
+    free(DotBandData);
 
-      free(band->buffer);
-      free(band);
-    }
+    DotBandArena = NULL;
+    DotBandData  = NULL;
+    DotUsedList  = NULL;
+    DotAvailList = NULL;
   }
   else
   {
@@ -1303,113 +1331,30 @@ CompressData(ppd_file_t          *ppd,	/* I - PPD file information */
 	     const int           ystep,	/* I - Spacing between lines */
 	     const int           offset)/* I - Head offset */
 {
-  register const unsigned char *line_ptr,
-					/* Current byte pointer */
-        	*line_end,		/* End-of-line byte pointer */
-        	*start;			/* Start of compression sequence */
-  register unsigned char *comp_ptr;	/* Pointer into compression buffer */
-  register int  count;			/* Count of bytes for output */
-  register int	bytes;			/* Number of bytes per row */
-  static int	ctable[7][7] =		/* Colors */
-		{
-		  {  0,  0,  0,  0,  0,  0,  0 },	/* K */
-		  {  0, 16,  0,  0,  0,  0,  0 },	/* Kk */
-		  {  2,  1,  4,  0,  0,  0,  0 },	/* CMY */
-		  {  2,  1,  4,  0,  0,  0,  0 },	/* CMYK */
-		  {  0,  0,  0,  0,  0,  0,  0 },
-		  {  2, 18,  1, 17,  4,  0,  0 },	/* CcMmYK */
-		  {  2, 18,  1, 17,  4,  0, 16 },	/* CcMmYKk */
-		};
-
-
-  switch (type)
-  {
-    case 0 :
-       /*
-	* Do no compression...
-	*/
-
-	line_ptr = (const unsigned char *)line;
-	line_end = (const unsigned char *)line + length;
-	break;
-
-    default :
-       /*
-        * Do TIFF pack-bits encoding...
-        */
-
-	line_ptr = (const unsigned char *)line;
-	line_end = (const unsigned char *)line + length;
-	comp_ptr = CompBuffer;
-
-	while (line_ptr < line_end && (comp_ptr - CompBuffer) < length)
-	{
-	  if ((line_ptr + 1) >= line_end)
-	  {
-	   /*
-	    * Single byte on the end...
-	    */
-
-	    *comp_ptr++ = 0x00;
-	    *comp_ptr++ = *line_ptr++;
-	  }
-	  else if (line_ptr[0] == line_ptr[1])
-	  {
-	   /*
-	    * Repeated sequence...
-	    */
-
-	    line_ptr ++;
-	    count = 2;
+  const unsigned char	*line_ptr,	/* Output data */
+			*line_end;	/* End of output data */
+  int			count,		/* Number of compressed bytes */
+			bytes;		/* Number of bytes per row */
 
-	    while (line_ptr < (line_end - 1) &&
-        	   line_ptr[0] == line_ptr[1] &&
-        	   count < 127)
-	    {
-              line_ptr ++;
-              count ++;
-	    }
 
-	    *comp_ptr++ = 257 - count;
-	    *comp_ptr++ = *line_ptr++;
-	  }
-	  else
-	  {
-	   /*
-	    * Non-repeated sequence...
-	    */
-
-	    start    = line_ptr;
-	    line_ptr ++;
-	    count    = 1;
-
-	    while (line_ptr < (line_end - 1) &&
-        	   line_ptr[0] != line_ptr[1] &&
-        	   count < 127)
-	    {
-              line_ptr ++;
-              count ++;
-	    }
+  line_ptr = line;
+  line_end = line + length;
 
-	    *comp_ptr++ = count - 1;
+  if (type)
+  {
+   /*
+    * Do TIFF pack-bits encoding, but only use it when it saves space...
+    */
 
-	    memcpy(comp_ptr, start, count);
-	    comp_ptr += count;
-	  }
-	}
+    count = pcl_compress(line, length, NULL, 0, 0, 2, CompBuffer, &line_ptr);
 
-        if ((comp_ptr - CompBuffer) < length)
-	{
-          line_ptr = (const unsigned char *)CompBuffer;
-          line_end = (const unsigned char *)comp_ptr;
-	}
-	else
-	{
-	  type     = 0;
-	  line_ptr = (const unsigned char *)line;
-	  line_end = (const unsigned char *)line + length;
-	}
-	break;
+    if (count < length)
+      line_end = line_ptr + count;
+    else
+    {
+      type     = 0;
+      line_ptr = line;
+    }
   }
 
  /*
@@ -1442,7 +1387,7 @@ CompressData(ppd_file_t          *ppd,	/* I - PPD file information */
     */
 
     printf("\033i");
-    putchar(ctable[PrinterPlanes - 1][plane]);
+    putchar(PrinterColors[plane]);
     putchar((type != 0) ? '1': '0');
     putchar(BitPlanes);
     putchar(bytes & 255);
@@ -1458,7 +1403,7 @@ CompressData(ppd_file_t          *ppd,	/* I - PPD file information */
 
     if (PrinterPlanes > 1)
     {
-      plane = ctable[PrinterPlanes - 1][plane];
+      plane = PrinterColors[plane];
 
       if (plane & 0x10)
 	printf("\033(r%c%c%c%c", 2, 0, 1, plane & 0x0f);
@@ -1494,10 +1439,6 @@ OutputBand(ppd_file_t         *ppd,	/* I - PPD file */
            cups_page_header2_t *header,	/* I - Page header */
            cups_weave_t       *band)	/* I - Current band */
 {
-  int	xstep,				/* Spacing between columns */
-	ystep;				/* Spacing between rows */
-
-
  /*
   * Interleaved ESC/P2 graphics...
   */
@@ -1508,13 +1449,6 @@ OutputBand(ppd_file_t         *ppd,	/* I - PPD file */
   fprintf(stderr, "DEBUG: Printing band %p, x = %d, y = %d, plane = %d, count = %d, OutputFeed = %d\n",
           (void*)band, band->x, band->y, band->plane, band->count, OutputFeed);
 
- /*
-  * Compute step values...
-  */
-
-  xstep = 3600 * DotColStep / header->HWResolution[0];
-  ystep = 3600 * DotRowStep / header->HWResolution[1];
-
  /*
   * Output the band...
   */
@@ -1529,7 +1463,8 @@ OutputBand(ppd_file_t         *ppd,	/* I - PPD file */
   }
 
   CompressData(ppd, band->buffer, band->count * DotBufferSize, band->plane,
-	       header->cupsCompression, band->count, xstep, ystep, band->x);
+	       header->cupsCompression, band->count, DotXStep, DotYStep,
+	       band->x);
 
  /*
   * Clear the band...
@@ -1562,8 +1497,8 @@ ProcessLine(ppd_file_t         *ppd,	/* I - PPD file */
 		subrow,			/* Subrow for interleaved output */
 		offset,			/* Offset to current line */
 		pass,			/* Pass number */
-		xstep,			/* X step value */
-		ystep;			/* Y step value */
+		blank;			/* Is the dithered line blank? */
+  const int	*schedule;		/* Subrows for this line */
   cups_weave_t	*band;			/* Current band */
 
 
@@ -1580,8 +1515,7 @@ ProcessLine(ppd_file_t         *ppd,	/* I - PPD file */
 
   width    = header->cupsWidth;
   subwidth = header->cupsWidth / DotColStep;
-  xstep    = 3600 / header->HWResolution[0];
-  ystep    = 3600 / header->HWResolution[1];
+  schedule = DotSchedule + (y % DotRowStep) * DotColStep;
 
   switch (header->cupsColorSpace)
   {
@@ -1649,35 +1583,42 @@ ProcessLine(ppd_file_t         *ppd,	/* I - PPD file */
       }
 
       CompressData(ppd, DotBuffers[plane], DotBufferSize, plane, 1, 1,
-                   xstep, ystep, 0);
+                   DotXStep, DotYStep, 0);
       fflush(stdout);
     }
     else
     {
      /*
-      * Handle softweaved output...
+      * Handle softweaved output; band buffers are cleared when they are
+      * output, so blank lines only need to advance the band rows...
       */
 
-      for (pass = 0, subrow = y % DotRowStep;
-           pass < DotColStep;
-	   pass ++, subrow += DotRowStep)
+      blank = cupsCheckBytes(OutputBuffers[plane], width);
+
+      for (pass = 0; pass < DotColStep; pass ++)
       {
        /*
 	* See if we need to output the band...
 	*/
 
+        subrow = schedule[pass];
         band   = DotBands[subrow][plane];
-	offset = band->row * DotBufferSize;
 
-        if (BitPlanes == 1)
-	  cupsPackHorizontal(OutputBuffers[plane] + pass,
-	                     band->buffer + offset, subwidth, 0, DotColStep);
-        else
-	  cupsPackHorizontal2(OutputBuffers[plane] + pass,
-	                      band->buffer + offset, subwidth, DotColStep);
+        if (!blank)
+	{
+	  offset = band->row * DotBufferSize;
+
+          if (BitPlanes == 1)
+	    cupsPackHorizontal(OutputBuffers[plane] + pass,
+	                       band->buffer + offset, subwidth, 0, DotColStep);
+          else
+	    cupsPackHorizontal2(OutputBuffers[plane] + pass,
+	                        band->buffer + offset, subwidth, DotColStep);
+
+	  band->dirty |= !cupsCheckBytes(band->buffer + offset, DotBufferSize);
+	}
 
         band->row ++;
-	band->dirty |= !cupsCheckBytes(band->buffer + offset, DotBufferSize);
 	if (band->row >= band->count)
 	{
 	  if (band->dirty)
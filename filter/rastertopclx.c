@@ -29,6 +29,7 @@
 #include <cupsfilters/colormanager.h>
 #include <cupsfilters/driver.h>
 #include "pcl-common.h"
+#include "pcl-compress.h"
 #include <signal.h>
 
 
@@ -56,6 +57,7 @@ unsigned char	*PixelBuffer,		/* Pixel buffer */
 		*OutputBuffers[6],	/* Output buffers */
 		*DotBuffers[6],		/* Bit buffers */
 		*CompBuffer,		/* Compression buffer */
+		*TestBuffer,		/* Buffer for trying other modes */
 		*SeedBuffer,		/* Mode 3 seed buffers */
 		BlankValue;		/* The blank value */
 short		*InputBuffer;		/* Color separation buffer */
@@ -63,6 +65,9 @@ cups_lut_t	*DitherLuts[6];		/* Lookup tables for dithering */
 cups_dither_t	*DitherStates[6];	/* Dither state tables */
 int		PrinterPlanes,		/* Number of color planes */
 		SeedInvalid,		/* Contents of seed buffer invalid? */
+		SeedRows,		/* Keep seed rows (mode 3 or 10)? */
+		CompModes,		/* Bitmask of modes to choose from */
+		CompMode,		/* Current compression mode */
 		DotBits[6],		/* Number of bits per color */
 		DotBufferSizes[6],	/* Size of one row of color dots */
 		DotBufferSize,		/* Size of complete line */
@@ -127,6 +132,9 @@ StartPage(ppd_file_t         *ppd,	/* I - PPD file */
   const int	*order;			/* Order to use */
   int		xorigin,		/* X origin of page */
 		yorigin;		/* Y origin of page */
+  char		*ptr,			/* Pointer into attribute value */
+		*end;			/* End of number */
+  long		mode;			/* Compression mode */
   static const float default_lut[2] =	/* Default dithering lookup table */
 		{
 		  0.0,
@@ -787,6 +795,33 @@ StartPage(ppd_file_t         *ppd,	/* I - PPD file */
   if (header->cupsCompression && header->cupsCompression != 10)
     printf("\033*b%dM", header->cupsCompression);
 
+ /*
+  * If the PPD file lists further compression modes the printer accepts
+  * (modes 0 to 3 only, "*cupsPCLCompressionModes: "0 2 3""), send each
+  * line with the mode giving the least data...
+  */
+
+  CompMode  = header->cupsCompression;
+  CompModes = 0;
+
+  if (ppd && header->cupsCompression >= 1 && header->cupsCompression <= 3 &&
+      (attr = ppdFindAttr(ppd, "cupsPCLCompressionModes", NULL)) != NULL &&
+      attr->value)
+  {
+    for (ptr = attr->value; *ptr; ptr = end)
+    {
+      if ((mode = strtol(ptr, &end, 10)) >= 0 && mode <= 3 && end > ptr)
+        CompModes |= 1 << mode;
+      else if (end == ptr)
+        end ++;
+    }
+
+    if ((CompModes & ~(1 << header->cupsCompression)) == 0)
+      CompModes = 0;			/* Nothing to choose from */
+  }
+
+  SeedRows = header->cupsCompression >= 3 || (CompModes & (1 << 3));
+
   OutputFeed = 0;
 
  /*
@@ -818,9 +853,12 @@ StartPage(ppd_file_t         *ppd,	/* I - PPD file */
   }
 
   if (header->cupsCompression)
-    CompBuffer = malloc(DotBufferSize * 4);
+    CompBuffer = malloc(PCL_COMPRESS_BUFSIZE(DotBufferSize));
 
-  if (header->cupsCompression >= 3)
+  if (CompModes)
+    TestBuffer = malloc(PCL_COMPRESS_BUFSIZE(DotBufferSize));
+
+  if (SeedRows)
     SeedBuffer = malloc(DotBufferSize);
 
   SeedInvalid = 1;
@@ -891,7 +929,10 @@ EndPage(ppd_file_t         *ppd,	/* I - PPD file */
   if (header->cupsCompression)
     free(CompBuffer);
 
-  if (header->cupsCompression >= 3)
+  if (CompModes)
+    free(TestBuffer);
+
+  if (SeedRows)
     free(SeedBuffer);
 }
 
@@ -968,588 +1009,69 @@ CompressData(unsigned char *line,	/* I - Data to compress */
 	     int           pend,	/* I - End character for data */
 	     int           type)	/* I - Type of compression */
 {
-  unsigned char	*line_ptr,		/* Current byte pointer */
-        	*line_end,		/* End-of-line byte pointer */
-        	*comp_ptr,		/* Pointer into compression buffer */
-        	*start,			/* Start of compression sequence */
-		*seed;			/* Seed buffer pointer */
-  int           count,			/* Count of bytes for output */
-		offset,			/* Offset of bytes for output */
-		temp;			/* Temporary count */
-  int		r, g, b;		/* RGB deltas for mode 10 compression */
-
-
-  switch (type)
-  {
-    default :
-       /*
-	* Do no compression; with a mode-0 only printer, we can compress blank
-	* lines...
-	*/
-
-	line_ptr = line;
-
-        if (cupsCheckBytes(line, length))
-          line_end = line;		/* Blank line */
-        else
-	  line_end = line + length;	/* Non-blank line */
-	break;
-
-    case 1 :
-       /*
-        * Do run-length encoding...
-        */
-
-	line_end = line + length;
-	for (line_ptr = line, comp_ptr = CompBuffer;
-	     line_ptr < line_end;
-	     comp_ptr += 2, line_ptr += count)
-	{
-	  for (count = 1;
-               (line_ptr + count) < line_end &&
-	           line_ptr[0] == line_ptr[count] &&
-        	   count < 256;
-               count ++);
-
-	  comp_ptr[0] = count - 1;
-	  comp_ptr[1] = line_ptr[0];
-	}
-
-        line_ptr = CompBuffer;
-        line_end = comp_ptr;
-	break;
-
-    case 2 :
-       /*
-        * Do TIFF pack-bits encoding...
-        */
-
-	line_ptr = line;
-	line_end = line + length;
-	comp_ptr = CompBuffer;
-
-	while (line_ptr < line_end)
-	{
-	  if ((line_ptr + 1) >= line_end)
-	  {
-	   /*
-	    * Single byte on the end...
-	    */
-
-	    *comp_ptr++ = 0x00;
-	    *comp_ptr++ = *line_ptr++;
-	  }
-	  else if (line_ptr[0] == line_ptr[1])
-	  {
-	   /*
-	    * Repeated sequence...
-	    */
-
-	    line_ptr ++;
-	    count = 2;
-
-	    while (line_ptr < (line_end - 1) &&
-        	   line_ptr[0] == line_ptr[1] &&
-        	   count < 127)
-	    {
-              line_ptr ++;
-              count ++;
-	    }
-
-	    *comp_ptr++ = 257 - count;
-	    *comp_ptr++ = *line_ptr++;
-	  }
-	  else
-	  {
-	   /*
-	    * Non-repeated sequence...
-	    */
-
-	    start    = line_ptr;
-	    line_ptr ++;
-	    count    = 1;
-
-	    while (line_ptr < (line_end - 1) &&
-        	   line_ptr[0] != line_ptr[1] &&
-        	   count < 127)
-	    {
-              line_ptr ++;
-              count ++;
-	    }
-
-	    *comp_ptr++ = count - 1;
-
-	    memcpy(comp_ptr, start, count);
-	    comp_ptr += count;
-	  }
-	}
-
-        line_ptr = CompBuffer;
-        line_end = comp_ptr;
-	break;
-
-    case 3 :
-       /*
-	* Do delta-row compression...
-	*/
+  const unsigned char	*data,		/* Data to send */
+			*test_data;	/* Data with other mode */
+  unsigned char		*seed,		/* Seed buffer pointer */
+			*temp;		/* Temporary buffer pointer */
+  int			bytes,		/* Number of bytes to send */
+			test_bytes,	/* Number of bytes with other mode */
+			mode;		/* Other compression mode */
 
-	line_ptr = line;
-	line_end = line + length;
 
-	comp_ptr = CompBuffer;
-	seed     = SeedBuffer + plane * length;
+  seed  = SeedRows ? SeedBuffer + plane * length : NULL;
+  bytes = pcl_compress(line, length, seed, SeedInvalid, PrinterPlanes == 1,
+                       type, CompBuffer, &data);
 
-	while (line_ptr < line_end)
-        {
-         /*
-          * Find the next non-matching sequence...
-          */
-
-          start = line_ptr;
-
-	  if (SeedInvalid)
-	  {
-	   /*
-	    * The seed buffer is invalid, so do the next 8 bytes, max...
-	    */
-
-	    offset = 0;
-
-	    if ((count = line_end - line_ptr) > 8)
-	      count = 8;
-
-	    line_ptr += count;
-	  }
-	  else
-	  {
-	   /*
-	    * The seed buffer is valid, so compare against it...
-	    */
-
-            while (*line_ptr == *seed &&
-                   line_ptr < line_end)
-            {
-              line_ptr ++;
-              seed ++;
-            }
-
-            if (line_ptr == line_end)
-              break;
-
-            offset = line_ptr - start;
-
-           /*
-            * Find up to 8 non-matching bytes...
-            */
-
-            start = line_ptr;
-            count = 0;
-            while (*line_ptr != *seed &&
-                   line_ptr < line_end &&
-                   count < 8)
-            {
-              line_ptr ++;
-              seed ++;
-              count ++;
-            }
-	  }
-
-         /*
-          * Place mode 3 compression data in the buffer; see HP manuals
-          * for details...
-          */
-
-          if (offset >= 31)
-          {
-           /*
-            * Output multi-byte offset...
-            */
-
-            *comp_ptr++ = ((count - 1) << 5) | 31;
-
-            offset -= 31;
-            while (offset >= 255)
-            {
-              *comp_ptr++ = 255;
-              offset    -= 255;
-            }
-
-            *comp_ptr++ = offset;
-          }
-          else
-          {
-           /*
-            * Output single-byte offset...
-            */
-
-            *comp_ptr++ = ((count - 1) << 5) | offset;
-          }
-
-          memcpy(comp_ptr, start, count);
-          comp_ptr += count;
-        }
-
-	line_ptr = CompBuffer;
-	line_end = comp_ptr;
-
-        memcpy(SeedBuffer + plane * length, line, length);
-	break;
+  if (CompModes)
+  {
+   /*
+    * Try the other modes and keep the shortest result...
+    */
 
-    case 10 :
-       /*
-        * Mode 10 "near lossless" RGB compression...
-	*/
+    for (mode = 0; mode <= 3; mode ++)
+    {
+      if (mode == type || !(CompModes & (1 << mode)))
+        continue;
 
-	line_ptr = line;
-	line_end = line + length;
+      test_bytes = pcl_compress(line, length, seed, SeedInvalid, 0, mode,
+                                TestBuffer, &test_data);
 
-	comp_ptr = CompBuffer;
-	seed     = SeedBuffer;
+      if (test_bytes < bytes)
+      {
+        bytes = test_bytes;
+	data  = test_data;
+	type  = mode;
 
-        if (PrinterPlanes == 1)
+        if (data == TestBuffer)
 	{
-	 /*
-	  * Do grayscale compression to RGB...
-	  */
-
-	  while (line_ptr < line_end)
-          {
-           /*
-            * Find the next non-matching sequence...
-            */
-
-            start = line_ptr;
-            while (line_ptr < line_end &&
-	           *line_ptr == *seed)
-            {
-              line_ptr ++;
-              seed ++;
-            }
-
-            if (line_ptr == line_end)
-              break;
-
-            offset = line_ptr - start;
-
-           /*
-            * Find non-matching grayscale pixels...
-            */
-
-            start = line_ptr;
-            while (line_ptr < line_end &&
-	           *line_ptr != *seed)
-            {
-              line_ptr ++;
-              seed ++;
-            }
-
-            count = line_ptr - start;
-
-#if 0
-            fprintf(stderr, "DEBUG: offset=%d, count=%d, comp_ptr=%p(%d of %d)...\n",
-	            offset, count, comp_ptr, comp_ptr - CompBuffer,
-		    BytesPerLine * 5);
-#endif /* 0 */
-
-           /*
-            * Place mode 10 compression data in the buffer; each sequence
-	    * starts with a command byte that looks like:
-	    *
-	    *     CMD SRC SRC OFF OFF CNT CNT CNT
-	    *
-	    * For the purpose of this driver, CMD and SRC are always 0.
-	    *
-	    * If the offset >= 3 then additional offset bytes follow the
-	    * first command byte, each byte == 255 until the last one.
-	    *
-	    * If the count >= 7, then additional count bytes follow each
-	    * group of pixels, each byte == 255 until the last one.
-	    *
-	    * The offset and count are in RGB tuples (not bytes, as for
-	    * Mode 3 and 9)...
-            */
-
-            if (offset >= 3)
-            {
-             /*
-              * Output multi-byte offset...
-              */
-
-              if (count > 7)
-		*comp_ptr++ = 0x1f;
-	      else
-		*comp_ptr++ = 0x18 | (count - 1);
-
-              offset -= 3;
-              while (offset >= 255)
-              {
-        	*comp_ptr++ = 255;
-        	offset      -= 255;
-              }
-
-              *comp_ptr++ = offset;
-            }
-            else
-            {
-             /*
-              * Output single-byte offset...
-              */
-
-              if (count > 7)
-		*comp_ptr++ = (offset << 3) | 0x07;
-	      else
-		*comp_ptr++ = (offset << 3) | (count - 1);
-            }
-
-	    temp = count - 8;
-	    seed -= count;
-
-            while (count > 0)
-	    {
-	      if (count <= temp)
-	      {
-	       /*
-		* This is exceedingly lame...  The replacement counts
-		* are intermingled with the data...
-		*/
-
-        	if (temp >= 255)
-        	  *comp_ptr++ = 255;
-        	else
-        	  *comp_ptr++ = temp;
-
-        	temp -= 255;
-	      }
-
-             /*
-	      * Get difference between current and see pixels...
-	      */
-
-              r = *start - *seed;
-	      g = r;
-	      b = ((*start & 0xfe) - (*seed & 0xfe)) / 2;
-
-              if (r < -16 || r > 15 || g < -16 || g > 15 || b < -16 || b > 15)
-	      {
-	       /*
-		* Pack 24-bit RGB into 23 bits...  Lame...
-		*/
-
-                g = *start;
-
-		*comp_ptr++ = g >> 1;
-
-		if (g & 1)
-		  *comp_ptr++ = 0x80 | (g >> 1);
-		else
-		  *comp_ptr++ = g >> 1;
-
-		if (g & 1)
-		  *comp_ptr++ = 0x80 | (g >> 1);
-		else
-		  *comp_ptr++ = g >> 1;
-              }
-	      else
-	      {
-	       /*
-		* Pack 15-bit RGB difference...
-		*/
-
-        	*comp_ptr++ = 0x80 | ((r << 2) & 0x7c) | ((g >> 3) & 0x03);
-		*comp_ptr++ = ((g << 5) & 0xe0) | (b & 0x1f);
-	      }
-
-              count --;
-	      start ++;
-	      seed ++;
-            }
-
-           /*
-	    * Make sure we have the ending count if the replacement count
-	    * was exactly 8 + 255n...
-	    */
-
-	    if (temp == 0)
-	      *comp_ptr++ = 0;
-          }
+	  temp       = CompBuffer;
+	  CompBuffer = TestBuffer;
+	  TestBuffer = temp;
 	}
-	else
-	{
-	 /*
-	  * Do RGB compression...
-	  */
+      }
+    }
 
-	  while (line_ptr < line_end)
-          {
-           /*
-            * Find the next non-matching sequence...
-            */
-
-            start = line_ptr;
-            while (line_ptr[0] == seed[0] &&
-                   line_ptr[1] == seed[1] &&
-                   line_ptr[2] == seed[2] &&
-                   (line_ptr + 2) < line_end)
-            {
-              line_ptr += 3;
-              seed += 3;
-            }
-
-            if (line_ptr == line_end)
-              break;
-
-            offset = (line_ptr - start) / 3;
-
-           /*
-            * Find non-matching RGB tuples...
-            */
-
-            start = line_ptr;
-            while ((line_ptr[0] != seed[0] ||
-                    line_ptr[1] != seed[1] ||
-                    line_ptr[2] != seed[2]) &&
-                   (line_ptr + 2) < line_end)
-            {
-              line_ptr += 3;
-              seed += 3;
-            }
-
-            count = (line_ptr - start) / 3;
-
-           /*
-            * Place mode 10 compression data in the buffer; each sequence
-	    * starts with a command byte that looks like:
-	    *
-	    *     CMD SRC SRC OFF OFF CNT CNT CNT
-	    *
-	    * For the purpose of this driver, CMD and SRC are always 0.
-	    *
-	    * If the offset >= 3 then additional offset bytes follow the
-	    * first command byte, each byte == 255 until the last one.
-	    *
-	    * If the count >= 7, then additional count bytes follow each
-	    * group of pixels, each byte == 255 until the last one.
-	    *
-	    * The offset and count are in RGB tuples (not bytes, as for
-	    * Mode 3 and 9)...
-            */
-
-            if (offset >= 3)
-            {
-             /*
-              * Output multi-byte offset...
-              */
-
-              if (count > 7)
-		*comp_ptr++ = 0x1f;
-	      else
-		*comp_ptr++ = 0x18 | (count - 1);
-
-              offset -= 3;
-              while (offset >= 255)
-              {
-        	*comp_ptr++ = 255;
-        	offset      -= 255;
-              }
-
-              *comp_ptr++ = offset;
-            }
-            else
-            {
-             /*
-              * Output single-byte offset...
-              */
-
-              if (count > 7)
-		*comp_ptr++ = (offset << 3) | 0x07;
-	      else
-		*comp_ptr++ = (offset << 3) | (count - 1);
-            }
-
-	    temp = count - 8;
-	    seed -= count * 3;
-
-            while (count > 0)
-	    {
-	      if (count <= temp)
-	      {
-	       /*
-		* This is exceedingly lame...  The replacement counts
-		* are intermingled with the data...
-		*/
-
-        	if (temp >= 255)
-        	  *comp_ptr++ = 255;
-        	else
-        	  *comp_ptr++ = temp;
-
-        	temp -= 255;
-	      }
-
-             /*
-	      * Get difference between current and see pixels...
-	      */
-
-              r = start[0] - seed[0];
-	      g = start[1] - seed[1];
-	      b = ((start[2] & 0xfe) - (seed[2] & 0xfe)) / 2;
-
-              if (r < -16 || r > 15 || g < -16 || g > 15 || b < -16 || b > 15)
-	      {
-	       /*
-		* Pack 24-bit RGB into 23 bits...  Lame...
-		*/
-
-		*comp_ptr++ = start[0] >> 1;
-
-		if (start[0] & 1)
-		  *comp_ptr++ = 0x80 | (start[1] >> 1);
-		else
-		  *comp_ptr++ = start[1] >> 1;
-
-		if (start[1] & 1)
-		  *comp_ptr++ = 0x80 | (start[2] >> 1);
-		else
-		  *comp_ptr++ = start[2] >> 1;
-              }
-	      else
-	      {
-	       /*
-		* Pack 15-bit RGB difference...
-		*/
-
-        	*comp_ptr++ = 0x80 | ((r << 2) & 0x7c) | ((g >> 3) & 0x03);
-		*comp_ptr++ = ((g << 5) & 0xe0) | (b & 0x1f);
-	      }
-
-              count --;
-	      start += 3;
-	      seed += 3;
-            }
-
-           /*
-	    * Make sure we have the ending count if the replacement count
-	    * was exactly 8 + 255n...
-	    */
-
-	    if (temp == 0)
-	      *comp_ptr++ = 0;
-          }
-        }
+    if (type != CompMode)
+    {
+      printf("\033*b%dM", type);
+      CompMode = type;
+    }
+  }
 
-	line_ptr = CompBuffer;
-	line_end = comp_ptr;
+ /*
+  * The printer keeps the last line of each plane as seed row for
+  * modes 3 and 10, whatever mode it was sent with...
+  */
 
-        memcpy(SeedBuffer, line, length);
-	break;
-  }
+  if (SeedRows)
+    memcpy(seed, line, length);
 
  /*
   * Set the length of the data and write a raster plane...
   */
 
-  printf("\033*b%d%c", (int)(line_end - line_ptr), pend);
-  cupsWritePrintData(line_ptr, line_end - line_ptr);
+  printf("\033*b%d%c", bytes, pend);
+  cupsWritePrintData(data, bytes);
 }
 
 
@@ -1576,7 +1098,7 @@ OutputLine(ppd_file_t         *ppd,	/* I - PPD file */
 
   if (OutputFeed > 0)
   {
-    if (header->cupsCompression < 3)
+    if (!SeedRows)
     {
      /*
       * Send blank raster lines...
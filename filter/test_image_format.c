@@ -0,0 +1,314 @@
+/*
+ *   Line formatting test program for CUPS.
+ *
+ *   Compares the lines of the line formatter format_select() chooses for
+ *   a page and the lines of the generic format_line() byte for byte with
+ *   the lines of the original imagetoraster formatters, which are kept
+ *   in test_image_format_ref.c, on random image data for all colorspaces,
+ *   color orders, bit depths, and horizontal positions imagetoraster
+ *   supports.
+ *
+ *   Copyright 2007-2011 by Apple Inc.
+ *   Copyright 1993-2007 by Easy Software Products.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   main()       - Compare the formatted lines for many pages.
+ *   fill_row()   - Fill an image row with random data.
+ *   set_header() - Set up a page header like the RIP would.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "image-format.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/*
+ * Colorspaces to test...
+ */
+
+static const struct
+{
+  cups_cspace_t	cspace;			/* Colorspace */
+  const char	*name;			/* Name of colorspace */
+  int		colors;			/* Number of colors */
+}		cspaces[] =
+{
+  { CUPS_CSPACE_W,	"W",		1 },
+  { CUPS_CSPACE_RGB,	"RGB",		3 },
+  { CUPS_CSPACE_RGBA,	"RGBA",		4 },
+  { CUPS_CSPACE_K,	"K",		1 },
+  { CUPS_CSPACE_CMY,	"CMY",		3 },
+  { CUPS_CSPACE_YMC,	"YMC",		3 },
+  { CUPS_CSPACE_CMYK,	"CMYK",		4 },
+  { CUPS_CSPACE_YMCK,	"YMCK",		4 },
+  { CUPS_CSPACE_KCMY,	"KCMY",		4 },
+  { CUPS_CSPACE_KCMYcm,	"KCMYcm",	6 },
+  { CUPS_CSPACE_GMCK,	"GMCK",		4 }
+};
+
+
+/*
+ * Local functions...
+ */
+
+static void	fill_row(cups_ib_t *row, int count);
+extern void	ref_format_line(cups_page_header2_t *header,
+		                unsigned char *row, int y, int z, int xsize,
+				int ysize, int yerr0, int yerr1, cups_ib_t *r0,
+				cups_ib_t *r1);
+static int	set_header(cups_page_header2_t *header, int cspace,
+		           cups_order_t order, int bits, int width);
+
+
+/*
+ * 'main()' - Compare the formatted lines for many pages.
+ */
+
+int					/* O - Exit status */
+main(void)
+{
+  static const int	bitss[] = { 1, 2, 4, 8 };
+					/* Bits per color */
+  static const char * const orders[] = { "chunked", "banded", "planar" };
+					/* Color orders */
+  int			i, j,		/* Looping vars */
+			cspace,		/* Current colorspace */
+			order,		/* Current color order */
+			width,		/* Page width */
+			xsize,		/* Width of image data */
+			ysize,		/* Height of image data */
+			yerr0,		/* Top Y error */
+			y,		/* Current row */
+			z,		/* Current plane */
+			depth,		/* Bytes per image pixel */
+			planes,		/* Number of color planes */
+			tests = 0,	/* Number of comparisons */
+			errors = 0;	/* Number of errors */
+  cups_page_header2_t	header;		/* Page header */
+  format_func_t		format;		/* Chosen line formatter */
+  cups_ib_t		*r0,		/* Primary image row */
+			*r1;		/* Image row for interpolation */
+  unsigned char		*line,		/* Line of format_select() formatter */
+			*gen_line,	/* Line of format_line() */
+			*ref_line;	/* Line of original formatter */
+  size_t		size;		/* Size of line buffers */
+
+
+  srand(1);
+
+  r0       = malloc(4 * 1100);
+  r1       = malloc(4 * 1100);
+  line     = malloc(8 * 1100);
+  gen_line = malloc(8 * 1100);
+  ref_line = malloc(8 * 1100);
+
+  if (!r0 || !r1 || !line || !gen_line || !ref_line)
+  {
+    puts("Unable to allocate memory!");
+    return (1);
+  }
+
+  for (cspace = 0; cspace < (int)(sizeof(cspaces) / sizeof(cspaces[0]));
+       cspace ++)
+    for (order = CUPS_ORDER_CHUNKED; order <= CUPS_ORDER_PLANAR; order ++)
+      for (i = 0; i < (int)(sizeof(bitss) / sizeof(bitss[0])); i ++)
+	for (width = 1; width <= 1100; width += (width < 48 ? 1 : 131))
+	  for (XPosition = -1; XPosition <= 1; XPosition ++)
+	  {
+	   /*
+	    * Set up the page, the image is narrower than the page for most
+	    * widths so that it starts within a byte...
+	    */
+
+	    depth  = set_header(&header, cspace, order, bitss[i], width);
+	    format = format_select(&header);
+	    planes = order == CUPS_ORDER_PLANAR ? header.cupsNumColors : 1;
+	    size   = header.cupsBytesPerLine + 16;
+
+	    xsize = width - rand() % (width < 8 ? width : 8);
+	    ysize = 1 + rand() % 100;
+
+	    for (j = 0; j < 8; j ++)
+	    {
+	      fill_row(r0, xsize * depth);
+
+	      if (j & 1)
+	        memcpy(r1, r0, xsize * depth);
+	      else
+		fill_row(r1, xsize * depth);
+
+	      y     = rand();
+	      yerr0 = rand() % (ysize + 1);
+
+	      for (z = 0; z < planes; z ++)
+	      {
+	       /*
+		* Fill the buffers with the same garbage, so that stray
+		* writes past the line show up as well...
+		*/
+
+		memset(line, 0xa5, size);
+		memset(gen_line, 0xa5, size);
+		memset(ref_line, 0xa5, size);
+
+		ref_format_line(&header, ref_line, y, z, xsize, ysize, yerr0,
+		                ysize - yerr0, r0, r1);
+		(*format)(&header, line, y, z, xsize, ysize, yerr0,
+		          ysize - yerr0, r0, r1);
+		format_line(&header, gen_line, y, z, xsize, ysize, yerr0,
+		            ysize - yerr0, r0, r1);
+
+		tests ++;
+
+		if (memcmp(line, ref_line, size) ||
+		    memcmp(gen_line, ref_line, size))
+		{
+		  if (errors < 20)
+		    printf("FAIL: %s, %s, %d bits, width %d, xsize %d, "
+		           "position %d, plane %d (%s)\n", cspaces[cspace].name,
+			   orders[order], bitss[i], width, xsize, XPosition, z,
+			   memcmp(line, ref_line, size) ? "format_select" :
+			                                  "format_line");
+
+		  errors ++;
+		}
+	      }
+	    }
+	  }
+
+  free(r0);
+  free(r1);
+  free(line);
+  free(gen_line);
+  free(ref_line);
+
+  if (errors)
+  {
+    printf("%d of %d formatted lines differ!\n", errors, tests);
+    return (1);
+  }
+
+  printf("PASS: %d formatted lines identical.\n", tests);
+  return (0);
+}
+
+
+/*
+ * 'fill_row()' - Fill an image row with random data.
+ *
+ * Runs of black and white are mixed in, as the dither tables treat them
+ * differently.
+ */
+
+static void
+fill_row(cups_ib_t *row,		/* I - Image row */
+         int       count)		/* I - Number of bytes */
+{
+  int	value,				/* Value of current run */
+	run;				/* Length of current run */
+
+
+  while (count > 0)
+  {
+    switch (rand() & 3)
+    {
+      case 0 :
+          value = 0;
+	  break;
+      case 1 :
+          value = 255;
+	  break;
+      default :
+          value = -1;
+	  break;
+    }
+
+    for (run = 1 + rand() % 24; run > 0 && count > 0; run --, count --)
+      *row++ = value < 0 ? rand() & 255 : value;
+  }
+}
+
+
+/*
+ * 'set_header()' - Set up a page header like the RIP would.
+ */
+
+static int				/* O - Bytes per image pixel */
+set_header(cups_page_header2_t *header,	/* O - Page header */
+           int                 cspace,	/* I - Colorspace index */
+	   cups_order_t        order,	/* I - Color order */
+	   int                 bits,	/* I - Bits per color */
+	   int                 width)	/* I - Width in pixels */
+{
+  int	colors = cspaces[cspace].colors;/* Number of colors */
+
+
+  memset(header, 0, sizeof(cups_page_header2_t));
+
+  header->cupsWidth        = width;
+  header->cupsColorSpace   = cspaces[cspace].cspace;
+  header->cupsColorOrder   = order;
+  header->cupsBitsPerColor = bits;
+
+ /*
+  * KCMYcm is only used for 1-bit output...
+  */
+
+  if (header->cupsColorSpace == CUPS_CSPACE_KCMYcm && bits > 1)
+    colors = 4;
+
+  header->cupsNumColors = colors;
+
+  if (order == CUPS_ORDER_CHUNKED)
+  {
+    if (header->cupsColorSpace == CUPS_CSPACE_KCMYcm && bits == 1)
+      header->cupsBitsPerPixel = 8;
+    else if (colors == 3 && bits < 8)
+      header->cupsBitsPerPixel = 4 * bits;
+    else
+      header->cupsBitsPerPixel = colors * bits;
+
+    header->cupsBytesPerLine = (width * header->cupsBitsPerPixel + 7) / 8;
+  }
+  else
+  {
+    header->cupsBitsPerPixel = bits;
+    header->cupsBytesPerLine = (width * bits + 7) / 8;
+
+    if (order == CUPS_ORDER_BANDED)
+      header->cupsBytesPerLine *= colors;
+  }
+
+ /*
+  * Return the number of bytes per pixel of the image data imagetoraster
+  * formats for this colorspace...
+  */
+
+  switch (header->cupsColorSpace)
+  {
+    case CUPS_CSPACE_W :
+    case CUPS_CSPACE_K :
+        return (1);
+
+    case CUPS_CSPACE_CMYK :
+    case CUPS_CSPACE_YMCK :
+    case CUPS_CSPACE_KCMY :
+    case CUPS_CSPACE_KCMYcm :
+    case CUPS_CSPACE_GMCK :
+        return (bits == 1 ? 3 : 4);
+
+    default :
+        return (3);
+  }
+}
@@ -0,0 +1,369 @@
+/*
+ *   Threaded RIP test program for CUPS.
+ *
+ *   Runs the imagetoraster filter of the build directory on a generated
+ *   image, once on the main thread only (RIP_THREADS=1) and once with
+ *   band threads, for color models with different colorspaces, color
+ *   orders, and bit depths, and compares the raster data byte for byte.
+ *   With "-b" the time of each run is shown, too:
+ *
+ *       test_imagetoraster [-b] [-t threads]
+ *
+ *   Copyright 2020 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   main()       - Compare the raster data of the threaded and the
+ *                  single-threaded filter.
+ *   get_time()   - Get the time in seconds.
+ *   make_image() - Write the test image.
+ *   make_ppd()   - Write the PPD file with the color models.
+ *   run_filter() - Run imagetoraster and collect its output.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+/*
+ * Color models to test...
+ */
+
+static const struct
+{
+  const char	*name;			/* Choice name */
+  int		cspace,			/* cupsColorSpace */
+		bits,			/* cupsBitsPerColor */
+		order;			/* cupsColorOrder */
+} models[] =
+{
+  { "Gray1",    3, 1, 0 },		/* K, dithered */
+  { "Gray8",   18, 8, 0 },		/* sGray */
+  { "RGB8",     1, 8, 0 },
+  { "CMYK1",    6, 1, 0 },
+  { "KCMY2",    8, 2, 1 },		/* banded */
+  { "CMY4",     4, 4, 2 },		/* planar */
+  { "KCMYcm1",  9, 1, 0 }
+};
+
+
+/*
+ * Local functions...
+ */
+
+static double	get_time(void);
+static int	make_image(const char *filename);
+static int	make_ppd(const char *filename);
+static char	*run_filter(const char *ppdfile, const char *imagefile,
+		            const char *model, int threads, size_t *len,
+			    double *secs);
+
+
+/*
+ * 'main()' - Compare the raster data of the threaded and the single-threaded
+ *            filter.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line arguments */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		i;			/* Looping var */
+  int		bench = 0,		/* Show times? */
+		threads = 4,		/* Band threads */
+		status = 0;		/* Exit status */
+  char		imagefile[] = "/tmp/test_imagetoraster.XXXXXX",
+		ppdfile[] = "/tmp/test_imagetoraster.XXXXXX";
+					/* Temporary files */
+  int		fd;			/* Temporary file */
+  char		*single,		/* Output of the single-threaded run */
+		*threaded;		/* Output of the threaded run */
+  size_t	single_len,		/* Length of single-threaded output */
+		threaded_len;		/* Length of threaded output */
+  double	single_secs,		/* Time of single-threaded run */
+		threaded_secs;		/* Time of threaded run */
+
+
+  for (i = 1; i < argc; i ++)
+    if (!strcmp(argv[i], "-b"))
+      bench = 1;
+    else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+      threads = atoi(argv[++ i]);
+    else
+    {
+      puts("Usage: test_imagetoraster [-b] [-t threads]");
+      return (1);
+    }
+
+  if (threads < 2)
+    threads = 2;
+
+  if (access("./imagetoraster", X_OK))
+  {
+    puts("imagetoraster not built, skipping test.");
+    return (77);
+  }
+
+  if ((fd = mkstemp(imagefile)) < 0)
+  {
+    perror(imagefile);
+    return (1);
+  }
+  close(fd);
+
+  if ((fd = mkstemp(ppdfile)) < 0)
+  {
+    perror(ppdfile);
+    unlink(imagefile);
+    return (1);
+  }
+  close(fd);
+
+  if (make_image(imagefile) || make_ppd(ppdfile))
+  {
+    unlink(imagefile);
+    unlink(ppdfile);
+    return (1);
+  }
+
+  for (i = 0; i < (int)(sizeof(models) / sizeof(models[0])); i ++)
+  {
+    printf("%-8s 1 thread vs. %d threads: ", models[i].name, threads);
+    fflush(stdout);
+
+    single   = run_filter(ppdfile, imagefile, models[i].name, 1, &single_len,
+                          &single_secs);
+    threaded = run_filter(ppdfile, imagefile, models[i].name, threads,
+                          &threaded_len, &threaded_secs);
+
+    if (!single || !threaded || single_len < 1800)
+    {
+      puts("FAIL (no raster data)");
+      status = 1;
+    }
+    else if (single_len != threaded_len ||
+             memcmp(single, threaded, single_len))
+    {
+      printf("FAIL (%lu and %lu bytes differ)\n", (unsigned long)single_len,
+             (unsigned long)threaded_len);
+      status = 1;
+    }
+    else if (bench)
+      printf("PASS (%lu bytes, %.3f s vs. %.3f s)\n",
+             (unsigned long)single_len, single_secs, threaded_secs);
+    else
+      puts("PASS");
+
+    free(single);
+    free(threaded);
+  }
+
+  unlink(imagefile);
+  unlink(ppdfile);
+
+  return (status);
+}
+
+
+/*
+ * 'get_time()' - Get the time in seconds.
+ */
+
+static double				/* O - Time in seconds */
+get_time(void)
+{
+  struct timespec ts;			/* Monotonic clock */
+
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+
+/*
+ * 'make_image()' - Write the test image.
+ *
+ * The image has smooth gradients for the dithering and fine patterns
+ * which show misplaced lines.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+make_image(const char *filename)	/* I - File to write to */
+{
+  FILE		*fp;			/* Image file */
+  int		x, y;			/* Looping vars */
+  const int	width = 640,		/* Width of image */
+		height = 480;		/* Height of image */
+
+
+  if ((fp = fopen(filename, "wb")) == NULL)
+  {
+    perror(filename);
+    return (-1);
+  }
+
+  fprintf(fp, "P6\n%d %d\n255\n", width, height);
+
+  for (y = 0; y < height; y ++)
+    for (x = 0; x < width; x ++)
+    {
+      putc(x * 255 / (width - 1), fp);
+      putc(y * 255 / (height - 1), fp);
+      putc(((x / 8) ^ (y / 8)) & 1 ? 255 - (x + y) % 256 : (x * y) % 256,
+           fp);
+    }
+
+  if (fclose(fp))
+  {
+    perror(filename);
+    return (-1);
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'make_ppd()' - Write the PPD file with the color models.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+make_ppd(const char *filename)		/* I - File to write to */
+{
+  FILE		*fp;			/* PPD file */
+  int		i;			/* Looping var */
+
+
+  if ((fp = fopen(filename, "w")) == NULL)
+  {
+    perror(filename);
+    return (-1);
+  }
+
+  fputs("*PPD-Adobe: \"4.3\"\n"
+        "*FormatVersion: \"4.3\"\n"
+        "*FileVersion: \"1.0\"\n"
+        "*LanguageVersion: English\n"
+        "*LanguageEncoding: ISOLatin1\n"
+        "*PCFileName: \"TESTRIP.PPD\"\n"
+        "*Manufacturer: \"Test\"\n"
+        "*Product: \"(Test)\"\n"
+        "*ModelName: \"Test\"\n"
+        "*ShortNickName: \"Test\"\n"
+        "*NickName: \"Test for imagetoraster\"\n"
+        "*PSVersion: \"(3010.000) 0\"\n"
+        "*LanguageLevel: \"3\"\n"
+        "*ColorDevice: True\n"
+        "*DefaultColorSpace: RGB\n"
+        "*cupsFilter: \"application/vnd.cups-raster 0 -\"\n"
+        "*OpenUI *PageSize: PickOne\n"
+        "*OrderDependency: 10 AnySetup *PageSize\n"
+        "*DefaultPageSize: Letter\n"
+        "*PageSize Letter: \"<</PageSize[612 792]/ImagingBBox null>>"
+        "setpagedevice\"\n"
+        "*CloseUI: *PageSize\n"
+        "*DefaultImageableArea: Letter\n"
+        "*ImageableArea Letter: \"18 36 594 756\"\n"
+        "*DefaultPaperDimension: Letter\n"
+        "*PaperDimension Letter: \"612 792\"\n"
+        "*OpenUI *Resolution: PickOne\n"
+        "*OrderDependency: 20 AnySetup *Resolution\n"
+        "*DefaultResolution: 150dpi\n"
+        "*Resolution 150dpi: \"<</HWResolution[150 150]>>setpagedevice\"\n"
+        "*CloseUI: *Resolution\n"
+        "*OpenUI *ColorModel: PickOne\n"
+        "*OrderDependency: 30 AnySetup *ColorModel\n"
+        "*DefaultColorModel: Gray1\n", fp);
+
+  for (i = 0; i < (int)(sizeof(models) / sizeof(models[0])); i ++)
+    fprintf(fp, "*ColorModel %s: \"<</cupsColorSpace %d/cupsBitsPerColor %d"
+                "/cupsColorOrder %d>>setpagedevice\"\n",
+	    models[i].name, models[i].cspace, models[i].bits,
+	    models[i].order);
+
+  fputs("*CloseUI: *ColorModel\n", fp);
+
+  if (fclose(fp))
+  {
+    perror(filename);
+    return (-1);
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'run_filter()' - Run imagetoraster and collect its output.
+ */
+
+static char *				/* O - Raster data or NULL on error */
+run_filter(const char *ppdfile,		/* I - PPD file */
+           const char *imagefile,	/* I - Image file */
+	   const char *model,		/* I - ColorModel choice */
+	   int        threads,		/* I - Number of threads */
+	   size_t     *len,		/* O - Length of raster data */
+	   double     *secs)		/* O - Time of the run */
+{
+  char		command[1024];		/* Command line */
+  FILE		*fp;			/* Pipe from the filter */
+  char		*data = NULL,		/* Raster data */
+		*temp;			/* New data buffer */
+  size_t	alloc = 0,		/* Allocated bytes */
+		bytes;			/* Bytes read */
+  double	start = get_time();	/* Start of run */
+
+
+  *len = 0;
+
+  snprintf(command, sizeof(command),
+           "PPD=%s RIP_THREADS=%d ./imagetoraster 1 test test 1 "
+	   "ColorModel=%s %s 2>/dev/null", ppdfile, threads, model, imagefile);
+
+  if ((fp = popen(command, "r")) == NULL)
+  {
+    perror("imagetoraster");
+    return (NULL);
+  }
+
+  for (;;)
+  {
+    if (*len == alloc)
+    {
+      alloc = alloc ? 2 * alloc : 1024 * 1024;
+      if ((temp = realloc(data, alloc)) == NULL)
+      {
+        free(data);
+	pclose(fp);
+	return (NULL);
+      }
+      data = temp;
+    }
+
+    if ((bytes = fread(data + *len, 1, alloc - *len, fp)) == 0)
+      break;
+
+    *len += bytes;
+  }
+
+  if (pclose(fp))
+  {
+    free(data);
+    return (NULL);
+  }
+
+  *secs = get_time() - start;
+
+  return (data);
+}
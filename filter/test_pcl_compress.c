@@ -0,0 +1,824 @@
+/*
+ *   PCL compression test program for CUPS.
+ *
+ *   Compares the output of pcl_compress() byte for byte with the line
+ *   compression code rastertopclx used before, which is kept below as
+ *   reference, for all compression modes and for lines of different
+ *   lengths and content.
+ *
+ *   Copyright 2007-2011 by Apple Inc.
+ *   Copyright 1993-2005 by Easy Software Products
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   main()            - Compare the compressed data for many lines.
+ *   fill_line()       - Fill a line and its seed row with test data.
+ *   ref_check_bytes() - Check to see if all bytes are zero.
+ *   ref_compress()    - Compress a line of graphics the old way.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "pcl-compress.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/*
+ * Local functions...
+ */
+
+static void	fill_line(unsigned char *line, unsigned char *seed, int length,
+		          int pattern);
+static int	ref_check_bytes(const unsigned char *bytes, int length);
+static int	ref_compress(unsigned char *line, int length,
+		             unsigned char *SeedBuffer, int SeedInvalid,
+			     int PrinterPlanes, int type,
+			     unsigned char *CompBuffer, unsigned char **data);
+
+
+/*
+ * 'main()' - Compare the compressed data for many lines.
+ */
+
+int					/* O - Exit status */
+main(void)
+{
+  static const int	types[] = { 0, 1, 2, 3, 10 };
+					/* Compression types */
+  int			i,		/* Looping var */
+			length,		/* Line length */
+			pattern,	/* Test pattern */
+			seed_invalid,	/* Seed row invalid? */
+			gray,		/* Grayscale mode 10? */
+			bytes,		/* Bytes of new output */
+			ref_bytes,	/* Bytes of reference output */
+			tests = 0,	/* Number of comparisons */
+			errors = 0;	/* Number of errors */
+  unsigned char		*line,		/* Line */
+			*seed,		/* Seed row */
+			*comp,		/* Compression buffer */
+			*ref_comp,	/* Reference compression buffer */
+			*ref_data;	/* Reference output data */
+  const unsigned char	*data;		/* Output data */
+
+
+ /*
+  * The reference code reads a byte beyond the end of the line, so
+  * allocate some extra bytes...
+  */
+
+  line     = calloc(1, 1024 + 16);
+  seed     = calloc(1, 1024 + 16);
+  comp     = malloc(PCL_COMPRESS_BUFSIZE(1024));
+  ref_comp = malloc(PCL_COMPRESS_BUFSIZE(1024));
+
+  if (!line || !seed || !comp || !ref_comp)
+  {
+    puts("Unable to allocate memory!");
+    return (1);
+  }
+
+  for (length = 1; length <= 1024; length += (length < 64 ? 1 : 37))
+    for (pattern = 0; pattern < 12; pattern ++)
+    {
+      fill_line(line, seed, length, pattern);
+
+      for (i = 0; i < (int)(sizeof(types) / sizeof(types[0])); i ++)
+        for (seed_invalid = 0; seed_invalid < 2; seed_invalid ++)
+	  for (gray = 0; gray < 2; gray ++)
+	  {
+	    if (types[i] == 10 && !gray && (length % 3))
+	      continue;
+
+	    bytes     = pcl_compress(line, length, seed, seed_invalid, gray,
+	                             types[i], comp, &data);
+	    ref_bytes = ref_compress(line, length, seed, seed_invalid,
+	                             gray ? 1 : 3, types[i], ref_comp,
+				     &ref_data);
+
+	    tests ++;
+
+	    if (bytes != ref_bytes || memcmp(data, ref_data, bytes))
+	    {
+	      if (errors < 20)
+		printf("FAIL: mode %d, length %d, pattern %d, seed %s, %s: "
+		       "%d bytes, expected %d\n", types[i], length, pattern,
+		       seed_invalid ? "invalid" : "valid", gray ? "gray" : "rgb",
+		       bytes, ref_bytes);
+
+	      errors ++;
+	    }
+	  }
+    }
+
+  free(line);
+  free(seed);
+  free(comp);
+  free(ref_comp);
+
+  if (errors)
+  {
+    printf("%d of %d compressed lines differ!\n", errors, tests);
+    return (1);
+  }
+
+  printf("PASS: %d compressed lines identical.\n", tests);
+  return (0);
+}
+
+
+/*
+ * 'fill_line()' - Fill a line and its seed row with test data.
+ */
+
+static void
+fill_line(unsigned char *line,		/* I - Line */
+          unsigned char *seed,		/* I - Seed row */
+          int           length,		/* I - Number of bytes */
+	  int           pattern)	/* I - Test pattern */
+{
+  int	i;				/* Looping var */
+
+
+  srand(length * 16 + pattern);
+
+  for (i = 0; i < length; i ++)
+  {
+    switch (pattern)
+    {
+      case 0 :				/* Blank */
+          line[i] = 0;
+	  break;
+      case 1 :				/* Solid */
+          line[i] = 0xff;
+	  break;
+      case 2 :				/* Random */
+          line[i] = rand();
+	  break;
+      case 3 :				/* Short runs */
+          line[i] = (i / 3) & 1 ? 0x55 : 0xaa;
+	  break;
+      case 4 :				/* Long runs */
+          line[i] = (i / 300) & 1 ? 0 : 0x0f;
+	  break;
+      case 5 :				/* Runs with random lengths */
+          line[i] = (i && rand() % 8) ? line[i - 1] : rand();
+	  break;
+      case 6 :				/* Few different values */
+          line[i] = rand() % 3;
+	  break;
+      default :				/* Like seed row, with differences */
+          line[i] = seed[i];
+	  break;
+    }
+
+    switch (pattern)
+    {
+      case 7 :				/* Same as seed row */
+	  break;
+      case 8 :				/* Sparse random differences */
+          seed[i] = rand();
+	  line[i] = rand() % 16 ? seed[i] : rand();
+	  break;
+      case 9 :				/* Small differences (mode 10) */
+          seed[i] = rand();
+	  line[i] = seed[i] + rand() % 9 - 4;
+	  break;
+      case 10 :				/* Long changed and unchanged spans */
+          seed[i] = i;
+	  line[i] = (i / 500) & 1 ? ~seed[i] : seed[i];
+	  break;
+      case 11 :				/* Unchanged spans of random length */
+          seed[i] = rand();
+	  line[i] = rand() % 64 ? (i && line[i - 1] != seed[i - 1] ?
+	                           ~seed[i] : seed[i]) : ~seed[i];
+	  break;
+      default :				/* Random seed row */
+	  seed[i] = rand();
+	  break;
+    }
+  }
+}
+
+
+/*
+ * 'ref_check_bytes()' - Check to see if all bytes are zero.
+ */
+
+static int				/* O - 1 if they match */
+ref_check_bytes(
+    const unsigned char *bytes,		/* I - Bytes to check */
+    int                 length)		/* I - Number of bytes to check */
+{
+  while (length > 0)
+    if (*bytes++)
+      return (0);
+    else
+      length --;
+
+  return (1);
+}
+
+
+/*
+ * 'ref_compress()' - Compress a line of graphics the old way.
+ */
+
+static int
+ref_compress(unsigned char *line,	/* I - Data to compress */
+             int           length,	/* I - Number of bytes */
+	     unsigned char *SeedBuffer,	/* I - Seed row */
+	     int           SeedInvalid,	/* I - Seed row invalid? */
+	     int           PrinterPlanes,
+					/* I - 1 for grayscale mode 10 */
+	     int           type,	/* I - Type of compression */
+	     unsigned char *CompBuffer,	/* I - Compression buffer */
+	     unsigned char **data)	/* O - Output data */
+{
+  unsigned char	*line_ptr,		/* Current byte pointer */
+        	*line_end,		/* End-of-line byte pointer */
+        	*comp_ptr,		/* Pointer into compression buffer */
+        	*start,			/* Start of compression sequence */
+		*seed;			/* Seed buffer pointer */
+  int           count,			/* Count of bytes for output */
+		offset,			/* Offset of bytes for output */
+		temp;			/* Temporary count */
+  int		r, g, b;		/* RGB deltas for mode 10 compression */
+
+
+  switch (type)
+  {
+    default :
+       /*
+	* Do no compression; with a mode-0 only printer, we can compress blank
+	* lines...
+	*/
+
+	line_ptr = line;
+
+        if (ref_check_bytes(line, length))
+          line_end = line;		/* Blank line */
+        else
+	  line_end = line + length;	/* Non-blank line */
+	break;
+
+    case 1 :
+       /*
+        * Do run-length encoding...
+        */
+
+	line_end = line + length;
+	for (line_ptr = line, comp_ptr = CompBuffer;
+	     line_ptr < line_end;
+	     comp_ptr += 2, line_ptr += count)
+	{
+	  for (count = 1;
+               (line_ptr + count) < line_end &&
+	           line_ptr[0] == line_ptr[count] &&
+        	   count < 256;
+               count ++);
+
+	  comp_ptr[0] = count - 1;
+	  comp_ptr[1] = line_ptr[0];
+	}
+
+        line_ptr = CompBuffer;
+        line_end = comp_ptr;
+	break;
+
+    case 2 :
+       /*
+        * Do TIFF pack-bits encoding...
+        */
+
+	line_ptr = line;
+	line_end = line + length;
+	comp_ptr = CompBuffer;
+
+	while (line_ptr < line_end)
+	{
+	  if ((line_ptr + 1) >= line_end)
+	  {
+	   /*
+	    * Single byte on the end...
+	    */
+
+	    *comp_ptr++ = 0x00;
+	    *comp_ptr++ = *line_ptr++;
+	  }
+	  else if (line_ptr[0] == line_ptr[1])
+	  {
+	   /*
+	    * Repeated sequence...
+	    */
+
+	    line_ptr ++;
+	    count = 2;
+
+	    while (line_ptr < (line_end - 1) &&
+        	   line_ptr[0] == line_ptr[1] &&
+        	   count < 127)
+	    {
+              line_ptr ++;
+              count ++;
+	    }
+
+	    *comp_ptr++ = 257 - count;
+	    *comp_ptr++ = *line_ptr++;
+	  }
+	  else
+	  {
+	   /*
+	    * Non-repeated sequence...
+	    */
+
+	    start    = line_ptr;
+	    line_ptr ++;
+	    count    = 1;
+
+	    while (line_ptr < (line_end - 1) &&
+        	   line_ptr[0] != line_ptr[1] &&
+        	   count < 127)
+	    {
+              line_ptr ++;
+              count ++;
+	    }
+
+	    *comp_ptr++ = count - 1;
+
+	    memcpy(comp_ptr, start, count);
+	    comp_ptr += count;
+	  }
+	}
+
+        line_ptr = CompBuffer;
+        line_end = comp_ptr;
+	break;
+
+    case 3 :
+       /*
+	* Do delta-row compression...
+	*/
+
+	line_ptr = line;
+	line_end = line + length;
+
+	comp_ptr = CompBuffer;
+	seed     = SeedBuffer;
+
+	while (line_ptr < line_end)
+        {
+         /*
+          * Find the next non-matching sequence...
+          */
+
+          start = line_ptr;
+
+	  if (SeedInvalid)
+	  {
+	   /*
+	    * The seed buffer is invalid, so do the next 8 bytes, max...
+	    */
+
+	    offset = 0;
+
+	    if ((count = line_end - line_ptr) > 8)
+	      count = 8;
+
+	    line_ptr += count;
+	  }
+	  else
+	  {
+	   /*
+	    * The seed buffer is valid, so compare against it...
+	    */
+
+            while (*line_ptr == *seed &&
+                   line_ptr < line_end)
+            {
+              line_ptr ++;
+              seed ++;
+            }
+
+            if (line_ptr == line_end)
+              break;
+
+            offset = line_ptr - start;
+
+           /*
+            * Find up to 8 non-matching bytes...
+            */
+
+            start = line_ptr;
+            count = 0;
+            while (*line_ptr != *seed &&
+                   line_ptr < line_end &&
+                   count < 8)
+            {
+              line_ptr ++;
+              seed ++;
+              count ++;
+            }
+	  }
+
+         /*
+          * Place mode 3 compression data in the buffer; see HP manuals
+          * for details...
+          */
+
+          if (offset >= 31)
+          {
+           /*
+            * Output multi-byte offset...
+            */
+
+            *comp_ptr++ = ((count - 1) << 5) | 31;
+
+            offset -= 31;
+            while (offset >= 255)
+            {
+              *comp_ptr++ = 255;
+              offset    -= 255;
+            }
+
+            *comp_ptr++ = offset;
+          }
+          else
+          {
+           /*
+            * Output single-byte offset...
+            */
+
+            *comp_ptr++ = ((count - 1) << 5) | offset;
+          }
+
+          memcpy(comp_ptr, start, count);
+          comp_ptr += count;
+        }
+
+	line_ptr = CompBuffer;
+	line_end = comp_ptr;
+
+	break;
+
+    case 10 :
+       /*
+        * Mode 10 "near lossless" RGB compression...
+	*/
+
+	line_ptr = line;
+	line_end = line + length;
+
+	comp_ptr = CompBuffer;
+	seed     = SeedBuffer;
+
+        if (PrinterPlanes == 1)
+	{
+	 /*
+	  * Do grayscale compression to RGB...
+	  */
+
+	  while (line_ptr < line_end)
+          {
+           /*
+            * Find the next non-matching sequence...
+            */
+
+            start = line_ptr;
+            while (line_ptr < line_end &&
+	           *line_ptr == *seed)
+            {
+              line_ptr ++;
+              seed ++;
+            }
+
+            if (line_ptr == line_end)
+              break;
+
+            offset = line_ptr - start;
+
+           /*
+            * Find non-matching grayscale pixels...
+            */
+
+            start = line_ptr;
+            while (line_ptr < line_end &&
+	           *line_ptr != *seed)
+            {
+              line_ptr ++;
+              seed ++;
+            }
+
+            count = line_ptr - start;
+
+#if 0
+            fprintf(stderr, "DEBUG: offset=%d, count=%d, comp_ptr=%p(%d of %d)...\n",
+	            offset, count, comp_ptr, comp_ptr - CompBuffer,
+		    BytesPerLine * 5);
+#endif /* 0 */
+
+           /*
+            * Place mode 10 compression data in the buffer; each sequence
+	    * starts with a command byte that looks like:
+	    *
+	    *     CMD SRC SRC OFF OFF CNT CNT CNT
+	    *
+	    * For the purpose of this driver, CMD and SRC are always 0.
+	    *
+	    * If the offset >= 3 then additional offset bytes follow the
+	    * first command byte, each byte == 255 until the last one.
+	    *
+	    * If the count >= 7, then additional count bytes follow each
+	    * group of pixels, each byte == 255 until the last one.
+	    *
+	    * The offset and count are in RGB tuples (not bytes, as for
+	    * Mode 3 and 9)...
+            */
+
+            if (offset >= 3)
+            {
+             /*
+              * Output multi-byte offset...
+              */
+
+              if (count > 7)
+		*comp_ptr++ = 0x1f;
+	      else
+		*comp_ptr++ = 0x18 | (count - 1);
+
+              offset -= 3;
+              while (offset >= 255)
+              {
+        	*comp_ptr++ = 255;
+        	offset      -= 255;
+              }
+
+              *comp_ptr++ = offset;
+            }
+            else
+            {
+             /*
+              * Output single-byte offset...
+              */
+
+              if (count > 7)
+		*comp_ptr++ = (offset << 3) | 0x07;
+	      else
+		*comp_ptr++ = (offset << 3) | (count - 1);
+            }
+
+	    temp = count - 8;
+	    seed -= count;
+
+            while (count > 0)
+	    {
+	      if (count <= temp)
+	      {
+	       /*
+		* This is exceedingly lame...  The replacement counts
+		* are intermingled with the data...
+		*/
+
+        	if (temp >= 255)
+        	  *comp_ptr++ = 255;
+        	else
+        	  *comp_ptr++ = temp;
+
+        	temp -= 255;
+	      }
+
+             /*
+	      * Get difference between current and see pixels...
+	      */
+
+              r = *start - *seed;
+	      g = r;
+	      b = ((*start & 0xfe) - (*seed & 0xfe)) / 2;
+
+              if (r < -16 || r > 15 || g < -16 || g > 15 || b < -16 || b > 15)
+	      {
+	       /*
+		* Pack 24-bit RGB into 23 bits...  Lame...
+		*/
+
+                g = *start;
+
+		*comp_ptr++ = g >> 1;
+
+		if (g & 1)
+		  *comp_ptr++ = 0x80 | (g >> 1);
+		else
+		  *comp_ptr++ = g >> 1;
+
+		if (g & 1)
+		  *comp_ptr++ = 0x80 | (g >> 1);
+		else
+		  *comp_ptr++ = g >> 1;
+              }
+	      else
+	      {
+	       /*
+		* Pack 15-bit RGB difference...
+		*/
+
+        	*comp_ptr++ = 0x80 | ((r << 2) & 0x7c) | ((g >> 3) & 0x03);
+		*comp_ptr++ = ((g << 5) & 0xe0) | (b & 0x1f);
+	      }
+
+              count --;
+	      start ++;
+	      seed ++;
+            }
+
+           /*
+	    * Make sure we have the ending count if the replacement count
+	    * was exactly 8 + 255n...
+	    */
+
+	    if (temp == 0)
+	      *comp_ptr++ = 0;
+          }
+	}
+	else
+	{
+	 /*
+	  * Do RGB compression...
+	  */
+
+	  while (line_ptr < line_end)
+          {
+           /*
+            * Find the next non-matching sequence...
+            */
+
+            start = line_ptr;
+            while (line_ptr[0] == seed[0] &&
+                   line_ptr[1] == seed[1] &&
+                   line_ptr[2] == seed[2] &&
+                   (line_ptr + 2) < line_end)
+            {
+              line_ptr += 3;
+              seed += 3;
+            }
+
+            if (line_ptr == line_end)
+              break;
+
+            offset = (line_ptr - start) / 3;
+
+           /*
+            * Find non-matching RGB tuples...
+            */
+
+            start = line_ptr;
+            while ((line_ptr[0] != seed[0] ||
+                    line_ptr[1] != seed[1] ||
+                    line_ptr[2] != seed[2]) &&
+                   (line_ptr + 2) < line_end)
+            {
+              line_ptr += 3;
+              seed += 3;
+            }
+
+            count = (line_ptr - start) / 3;
+
+           /*
+            * Place mode 10 compression data in the buffer; each sequence
+	    * starts with a command byte that looks like:
+	    *
+	    *     CMD SRC SRC OFF OFF CNT CNT CNT
+	    *
+	    * For the purpose of this driver, CMD and SRC are always 0.
+	    *
+	    * If the offset >= 3 then additional offset bytes follow the
+	    * first command byte, each byte == 255 until the last one.
+	    *
+	    * If the count >= 7, then additional count bytes follow each
+	    * group of pixels, each byte == 255 until the last one.
+	    *
+	    * The offset and count are in RGB tuples (not bytes, as for
+	    * Mode 3 and 9)...
+            */
+
+            if (offset >= 3)
+            {
+             /*
+              * Output multi-byte offset...
+              */
+
+              if (count > 7)
+		*comp_ptr++ = 0x1f;
+	      else
+		*comp_ptr++ = 0x18 | (count - 1);
+
+              offset -= 3;
+              while (offset >= 255)
+              {
+        	*comp_ptr++ = 255;
+        	offset      -= 255;
+              }
+
+              *comp_ptr++ = offset;
+            }
+            else
+            {
+             /*
+              * Output single-byte offset...
+              */
+
+              if (count > 7)
+		*comp_ptr++ = (offset << 3) | 0x07;
+	      else
+		*comp_ptr++ = (offset << 3) | (count - 1);
+            }
+
+	    temp = count - 8;
+	    seed -= count * 3;
+
+            while (count > 0)
+	    {
+	      if (count <= temp)
+	      {
+	       /*
+		* This is exceedingly lame...  The replacement counts
+		* are intermingled with the data...
+		*/
+
+        	if (temp >= 255)
+        	  *comp_ptr++ = 255;
+        	else
+        	  *comp_ptr++ = temp;
+
+        	temp -= 255;
+	      }
+
+             /*
+	      * Get difference between current and see pixels...
+	      */
+
+              r = start[0] - seed[0];
+	      g = start[1] - seed[1];
+	      b = ((start[2] & 0xfe) - (seed[2] & 0xfe)) / 2;
+
+              if (r < -16 || r > 15 || g < -16 || g > 15 || b < -16 || b > 15)
+	      {
+	       /*
+		* Pack 24-bit RGB into 23 bits...  Lame...
+		*/
+
+		*comp_ptr++ = start[0] >> 1;
+
+		if (start[0] & 1)
+		  *comp_ptr++ = 0x80 | (start[1] >> 1);
+		else
+		  *comp_ptr++ = start[1] >> 1;
+
+		if (start[1] & 1)
+		  *comp_ptr++ = 0x80 | (start[2] >> 1);
+		else
+		  *comp_ptr++ = start[2] >> 1;
+              }
+	      else
+	      {
+	       /*
+		* Pack 15-bit RGB difference...
+		*/
+
+        	*comp_ptr++ = 0x80 | ((r << 2) & 0x7c) | ((g >> 3) & 0x03);
+		*comp_ptr++ = ((g << 5) & 0xe0) | (b & 0x1f);
+	      }
+
+              count --;
+	      start += 3;
+	      seed += 3;
+            }
+
+           /*
+	    * Make sure we have the ending count if the replacement count
+	    * was exactly 8 + 255n...
+	    */
+
+	    if (temp == 0)
+	      *comp_ptr++ = 0;
+          }
+        }
+
+	line_ptr = CompBuffer;
+	line_end = comp_ptr;
+
+	break;
+  }
+
+  *data = line_ptr;
+
+  return (line_end - line_ptr);
+}
@@ -0,0 +1,211 @@
+// Test for texttopdf's Flate compressed page streams: a page is written
+// uncompressed and compressed, and the inflated stream must give the
+// same content. Then a 100000 line text file is printed both ways,
+// to /dev/null, and the sizes and times are reported to stderr.
+#include "pdfutils.h"
+#include "config.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <stdio.h>
+
+static double get_time() // {{{
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec/1e9;
+}
+// }}}
+
+// like WritePage(): one BT/ET per line
+static void write_page_content(pdfOut *pdf,int first,int lines) // {{{
+{
+  const int PageLength=792;
+  char text[100];
+  int iA;
+
+  pdfOut_printf(pdf,"q\n");
+  for (iA=0;iA<lines;iA++) {
+    const int no=first+iA;
+    snprintf(text,sizeof(text),
+             "Oct 18 12:%02d:%02d host daemon[%d]: request %d served in %d ms",
+             no/60%60,no%60,1000+no%7,no,no*37%500);
+    pdfOut_printf(pdf,"BT\n"
+                      "  36 %.3f Td\n"
+                      "  /F1 10 Tf ",
+                      PageLength-36-iA*11.0);
+    pdfOut_putHexString(pdf,text,-1);
+    pdfOut_printf(pdf," Tj\n"
+                      "ET\n");
+  }
+  pdfOut_printf(pdf,"Q\n");
+}
+// }}}
+
+// 66 lines per page; returns bytes written (without xref table and trailer)
+static long print_text(int lines,int compress) // {{{
+{
+  const int PageWidth=612,PageLength=792,LinesPerPage=66;
+  pdfOut *pdf;
+  int iA;
+
+  pdf=pdfOut_new();
+  assert(pdf);
+  pdfOut_begin_pdf(pdf);
+
+  const int font_obj=pdfOut_add_xref(pdf);
+  pdfOut_printf(pdf,"%d 0 obj\n"
+                    "<</Type/Font\n"
+                    "  /Subtype /Type1\n"
+                    "  /BaseFont /Courier\n"
+                    ">>\n"
+                    "endobj\n"
+                    ,font_obj);
+
+  for (iA=0;iA<lines;iA+=LinesPerPage) {
+    pdfOut_begin_stream(pdf);
+    write_page_content(pdf,iA,(lines-iA<LinesPerPage)?lines-iA:LinesPerPage);
+    const int cobj=pdfOut_end_stream(pdf,compress);
+    assert(cobj);
+
+    const int obj=pdfOut_add_xref(pdf);
+    pdfOut_printf(pdf,"%d 0 obj\n"
+                      "<</Type/Page\n"
+                      "  /Parent 1 0 R\n"
+                      "  /MediaBox [0 0 %d %d]\n"
+                      "  /Contents %d 0 R\n"
+                      "  /Resources << /Font << /F1 %d 0 R >> >>\n"
+                      ">>\n"
+                      "endobj\n"
+                      ,obj,PageWidth,PageLength,cobj,font_obj);
+    pdfOut_add_page(pdf,obj);
+  }
+  const long size=pdf->filepos;
+  pdfOut_finish_pdf(pdf);
+  pdfOut_free(pdf);
+  return size;
+}
+// }}}
+
+// finds the data of the >no-th stream object in >buf; returns its length, or -1
+static long find_stream(const char *buf,int no,const char **data) // {{{
+{
+  const char *pos=buf;
+  for (;no>=0;no--) {
+    pos=strstr(pos,"<</Length ");
+    if (!pos) {
+      return -1;
+    }
+    pos+=10;
+  }
+  const long len=strtol(pos,NULL,10);
+  pos=strstr(pos,"stream\n");
+  if (!pos) {
+    return -1;
+  }
+  *data=pos+7;
+  return len;
+}
+// }}}
+
+// the same page, written uncompressed and compressed, must inflate to the same content
+static int check_stream() // {{{ - returns 0 on success
+{
+  FILE *tmp=tmpfile();
+  assert(tmp);
+  fflush(stdout);
+  const int saved=dup(fileno(stdout));
+  dup2(fileno(tmp),fileno(stdout));
+
+  pdfOut *pdf=pdfOut_new();
+  assert(pdf);
+  pdfOut_begin_pdf(pdf);
+  pdfOut_begin_stream(pdf);
+  write_page_content(pdf,0,66);
+  const int plain_obj=pdfOut_end_stream(pdf,0);
+  pdfOut_begin_stream(pdf);
+  write_page_content(pdf,0,66);
+  const int deflated_obj=pdfOut_end_stream(pdf,1);
+  pdfOut_finish_pdf(pdf);
+  pdfOut_free(pdf);
+
+  fflush(stdout);
+  dup2(saved,fileno(stdout));
+  close(saved);
+
+  if ( (!plain_obj)||(!deflated_obj) ) {
+    fprintf(stderr,"FAIL: pdfOut_end_stream() failed\n");
+    return 1;
+  }
+
+  fseek(tmp,0,SEEK_END);
+  const long size=ftell(tmp);
+  char *buf=malloc(size+1);
+  assert(buf);
+  rewind(tmp);
+  if (fread(buf,1,size,tmp)!=(size_t)size) {
+    fprintf(stderr,"FAIL: short read of the test PDF\n");
+    return 1;
+  }
+  buf[size]=0;
+  fclose(tmp);
+
+  const char *plain,*deflated;
+  const long plain_len=find_stream(buf,0,&plain),
+             deflated_len=find_stream(buf,1,&deflated);
+  if ( (plain_len<=0)||(deflated_len<=0)||
+       (!strstr(buf,"/Filter /FlateDecode")) ) {
+    fprintf(stderr,"FAIL: streams not found\n");
+    return 1;
+  }
+
+  uLongf len=plain_len+1;
+  Bytef *inflated=malloc(len);
+  assert(inflated);
+  if ( (uncompress(inflated,&len,(const Bytef *)deflated,deflated_len)!=Z_OK)||
+       (len!=(uLongf)plain_len)||(memcmp(inflated,plain,len)!=0) ) {
+    fprintf(stderr,"FAIL: compressed stream does not inflate to the page content\n");
+    return 1;
+  }
+  free(inflated);
+  free(buf);
+  return 0;
+}
+// }}}
+
+int main()
+{
+  const int lines=100000;
+
+  if (check_stream()) {
+    return 1;
+  }
+
+  // the benchmark only counts bytes
+  if (!freopen("/dev/null","w",stdout)) {
+    fprintf(stderr,"Could not open /dev/null, skipping benchmark\n");
+    return 0;
+  }
+
+  double start=get_time();
+  const long plain=print_text(lines,0);
+  const double plain_time=get_time()-start;
+
+  start=get_time();
+  const long compressed=print_text(lines,1);
+  const double compressed_time=get_time()-start;
+
+  fprintf(stderr,"%d lines: %ld bytes in %.3f s uncompressed, "
+                 "%ld bytes in %.3f s compressed\n",
+                 lines,plain,plain_time,compressed,compressed_time);
+  if (compressed>=plain/2) {
+    fprintf(stderr,"FAIL: compressed output not smaller\n");
+    return 1;
+  }
+
+  return 0;
+}
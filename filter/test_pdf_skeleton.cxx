@@ -0,0 +1,251 @@
+// Test for the banner skeletons of bannertopdf: a skeleton is made from
+// a template with a form and from one without, saved, loaded back, and
+// a banner with 3 copies is written from it. The banner is parsed again
+// with QPDF and must have 3 pages, the field values, and the contents.
+// A template which can't be made into a skeleton must stay unchanged.
+#include "pdf.h"
+#include <qpdf/QPDF.hh>
+#include <qpdf/QPDFObjectHandle.hh>
+#include <qpdf/QPDFWriter.hh>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+static const char template_content[]="BT /F1 12 Tf 72 720 Td (template) Tj ET";
+static const char banner_content[]="BT /bannertopdf-font 14 Tf 72 360 Td (banner) Tj ET";
+
+enum { NO_FORM, FORM, DIRECT_FIELD };
+
+// writes a one page template to >filename
+static void make_template(const char *filename,int type) // {{{
+{
+  QPDF pdf;
+  pdf.emptyPDF();
+
+  QPDFObjectHandle page=pdf.makeIndirectObject(QPDFObjectHandle::parse(
+    "<< /Type /Page /MediaBox [0 0 612 792]"
+    "   /Resources << /Font << /F1 << /Type /Font /Subtype /Type1"
+    "                                 /BaseFont /Helvetica >> >> >> >>"));
+  page.replaceKey("/Contents",QPDFObjectHandle::newStream(&pdf,template_content));
+
+  if (type!=NO_FORM) {
+    // one field which is its own widget, one with two widgets
+    QPDFObjectHandle job=QPDFObjectHandle::parse(
+      "<< /FT /Tx /T (job-id) /V (old) /Subtype /Widget"
+      "   /Rect [72 600 300 620] >>");
+    if (type==FORM) {
+      job=pdf.makeIndirectObject(job);
+    }
+    QPDFObjectHandle user=pdf.makeIndirectObject(QPDFObjectHandle::parse(
+      "<< /FT /Tx /T (user) /V (old) >>"));
+    QPDFObjectHandle kids=QPDFObjectHandle::newArray(),
+                     annots=QPDFObjectHandle::newArray(),
+                     fields=QPDFObjectHandle::newArray();
+    for (int iA=0;iA<2;iA++) {
+      QPDFObjectHandle widget=pdf.makeIndirectObject(QPDFObjectHandle::parse(
+        "<< /Subtype /Widget /Rect [72 500 300 520] >>"));
+      widget.replaceKey("/Parent",user);
+      kids.appendItem(widget);
+      annots.appendItem(widget);
+    }
+    user.replaceKey("/Kids",kids);
+    // a direct field comes last, after the other one lost its /V
+    annots.appendItem(job);
+    fields.appendItem(user);
+    fields.appendItem(job);
+    page.replaceKey("/Annots",annots);
+
+    QPDFObjectHandle acroform=QPDFObjectHandle::parse(
+      "<< /DA (/Helv 0 Tf 0 g) >>");
+    acroform.replaceKey("/Fields",fields);
+    pdf.getRoot().replaceKey("/AcroForm",pdf.makeIndirectObject(acroform));
+  }
+
+  pdf.addPage(page,false);
+
+  QPDFWriter out(pdf,filename);
+  out.setStaticID(true);
+  out.write();
+}
+// }}}
+
+static std::string write_memory(pdf_t *doc) // {{{
+{
+  QPDFWriter out(*doc);
+  out.setOutputMemory();
+  out.setStaticID(true);
+  out.write();
+  PointerHolder<Buffer> buf(out.getBuffer());
+  return std::string((const char *)buf->getBuffer(),buf->getSize());
+}
+// }}}
+
+static std::string stream_data(QPDFObjectHandle stream) // {{{
+{
+  PointerHolder<Buffer> buf(stream.getStreamData());
+  return std::string((const char *)buf->getBuffer(),buf->getSize());
+}
+// }}}
+
+// checks the banner in >data, returns 0 on success
+static int check_banner(const std::string &data,bool form,unsigned copies) // {{{
+{
+  QPDF pdf;
+  pdf.processMemoryFile("banner",data.data(),data.size());
+
+  std::vector<QPDFObjectHandle> pages=pdf.getAllPages();
+  if (pages.size()!=copies) {
+    fprintf(stderr,"FAIL: %d pages instead of %u\n",(int)pages.size(),copies);
+    return 1;
+  }
+
+  for (size_t iA=0;iA<pages.size();iA++) {
+    std::vector<QPDFObjectHandle> contents=pages[iA].getPageContents();
+    if ( (contents.size()!=(form?1u:2u))||
+         (stream_data(contents.back())!=template_content)||
+         ( (!form)&&(stream_data(contents.front())!=banner_content) ) ) {
+      fprintf(stderr,"FAIL: wrong contents of page %d\n",(int)iA+1);
+      return 1;
+    }
+  }
+
+  if (form) {
+    QPDFObjectHandle fields=pdf.getRoot().getKey("/AcroForm").getKey("/Fields");
+    if ( (!fields.isArray())||(fields.getArrayNItems()!=2) ) {
+      fprintf(stderr,"FAIL: form fields missing\n");
+      return 1;
+    }
+    for (int iA=0;iA<fields.getArrayNItems();iA++) {
+      QPDFObjectHandle field=fields.getArrayItem(iA);
+      const std::string name=field.getKey("/T").getUTF8Value(),
+                        value=field.getKey("/V").getUTF8Value(),
+                        expect=(name=="job-id")?"42":"alice";
+      if (value!=expect) {
+        fprintf(stderr,"FAIL: field %s is \"%s\" instead of \"%s\"\n",
+                name.c_str(),value.c_str(),expect.c_str());
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+// }}}
+
+static int test_template(const char *dir,int type) // {{{ - returns 0 on success
+{
+  const std::string tmpl=std::string(dir)+"/template.pdf",
+                    skelfile=std::string(dir)+"/skeleton";
+  opt_t user={"user","alice",NULL},
+        job={"job-id","42",&user};
+  const unsigned copies=3;
+  float scale;
+
+  make_template(tmpl.c_str(),type);
+  pdf_t *doc=pdf_load_template(tmpl.c_str());
+  unlink(tmpl.c_str());
+  if (!doc) {
+    fprintf(stderr,"FAIL: template not loaded\n");
+    return 1;
+  }
+  pdf_resize_page(doc,1,595,842,&scale);
+  pdf_add_type1_font(doc,1,"Courier");
+
+  const std::string before=write_memory(doc);
+  pdf_skeleton_t *skel=pdf_skeleton_new(doc,scale);
+  const bool unchanged=(write_memory(doc)==before);
+  pdf_free(doc);
+
+  if (type==DIRECT_FIELD) {
+    if (skel) {
+      fprintf(stderr,"FAIL: skeleton with a direct form field\n");
+      pdf_skeleton_free(skel);
+      return 1;
+    }
+    if (!unchanged) {
+      fprintf(stderr,"FAIL: template changed by the failed skeleton\n");
+      return 1;
+    }
+    return 0;
+  }
+  if (!skel) {
+    fprintf(stderr,"FAIL: no skeleton made\n");
+    return 1;
+  }
+  if (!unchanged) {
+    fprintf(stderr,"FAIL: template changed by the skeleton\n");
+    pdf_skeleton_free(skel);
+    return 1;
+  }
+
+  const int saved=pdf_skeleton_save(skel,skelfile.c_str(),"test key");
+  pdf_skeleton_free(skel);
+  if (saved) {
+    fprintf(stderr,"FAIL: skeleton not saved\n");
+    return 1;
+  }
+  if ((skel=pdf_skeleton_load(skelfile.c_str(),"other key"))!=NULL) {
+    fprintf(stderr,"FAIL: skeleton loaded with another key\n");
+    pdf_skeleton_free(skel);
+    return 1;
+  }
+  skel=pdf_skeleton_load(skelfile.c_str(),"test key");
+  unlink(skelfile.c_str());
+  if (!skel) {
+    fprintf(stderr,"FAIL: skeleton not loaded\n");
+    return 1;
+  }
+  if (pdf_skeleton_scale(skel)!=scale) {
+    fprintf(stderr,"FAIL: scale %g instead of %g\n",pdf_skeleton_scale(skel),scale);
+    pdf_skeleton_free(skel);
+    return 1;
+  }
+
+  FILE *f=tmpfile();
+  if ( (!f)||
+       (pdf_skeleton_write(skel,f,banner_content,strlen(banner_content),&job,copies)!=0) ) {
+    fprintf(stderr,"FAIL: banner not written\n");
+    pdf_skeleton_free(skel);
+    return 1;
+  }
+  pdf_skeleton_free(skel);
+
+  std::string data;
+  char buf[4096];
+  size_t len;
+  rewind(f);
+  while ((len=fread(buf,1,sizeof(buf),f))>0) {
+    data.append(buf,len);
+  }
+  fclose(f);
+
+  return check_banner(data,type==FORM,copies);
+}
+// }}}
+
+int main()
+{
+  char dir[]="/tmp/test_pdf_skeleton.XXXXXX";
+  int ret=0;
+
+  if (!mkdtemp(dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  try {
+    if ( (test_template(dir,NO_FORM))||
+         (test_template(dir,FORM))||
+         (test_template(dir,DIRECT_FIELD)) ) {
+      ret=1;
+    }
+  } catch (const std::exception &e) {
+    fprintf(stderr,"FAIL: %s\n",e.what());
+    ret=1;
+  }
+
+  rmdir(dir);
+  return ret;
+}
@@ -0,0 +1,378 @@
+/*
+ *   PostScript post-processing test program for CUPS.
+ *
+ *   Checks the DSC patching of ps_postproc() on small documents with and
+ *   without Prolog and Setup sections, CR LF line ends, long lines, and
+ *   a large body, and shows its throughput on a large generated document
+ *   next to copying it line by line with stdio.
+ *
+ *   With PostScript files as arguments, the throughput for these files
+ *   is shown instead:
+ *
+ *       test_ps_postproc file.ps ...
+ *
+ *   Copyright 2020 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   main()        - Run the tests or post-process PostScript files.
+ *   bench_file()  - Show the throughput for a file.
+ *   check()       - Post-process a document and compare the result.
+ *   get_time()    - Get the current time in seconds.
+ *   run()         - Post-process a file into a temporary file.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "ps-postproc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+
+/*
+ * Local functions...
+ */
+
+static int	bench_file(const char *filename);
+static int	check(const char *name, const char *input, const char *expected,
+		      const ps_postproc_t *pp);
+static double	get_time(void);
+static char	*run(FILE *in, const ps_postproc_t *pp, size_t *length);
+
+
+/*
+ * 'main()' - Run the tests or post-process PostScript files.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line args */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		i,			/* Looping var */
+		status = 0;		/* Exit status */
+  ps_postproc_t	pp;			/* Post-processing */
+  char		*input,			/* Input document */
+		*expected,		/* Expected output */
+		*output,		/* Output */
+		line[256];		/* Line */
+  size_t	length;			/* Length of output */
+  FILE		*fp;			/* Temporary file */
+  double	start,			/* Start time */
+		secs;			/* Seconds */
+  long		bytes;			/* Size of generated document */
+
+
+  if (argc > 1)
+  {
+    for (i = 1; i < argc; i ++)
+      status |= bench_file(argv[i]);
+
+    return (status);
+  }
+
+ /*
+  * Workaround code at the start of an existing Prolog...
+  */
+
+  memset(&pp, 0, sizeof(pp));
+  pp.prolog_code = "/bind {} bind def\n";
+
+  status |= check("existing Prolog",
+                  "%!PS-Adobe-3.0\n%%Title: x\n%%EndComments\n"
+		  "%%BeginProlog\n/a 1 def\n%%EndProlog\n%%Page: 1 1\nshowpage\n",
+                  "%!PS-Adobe-3.0\n%%Title: x\n%%EndComments\n"
+		  "%%BeginProlog\n/bind {} bind def\n/a 1 def\n%%EndProlog\n"
+		  "%%Page: 1 1\nshowpage\n", &pp);
+
+ /*
+  * No Prolog and Setup sections, both created before the first page...
+  */
+
+  pp.setup_code = "<</Duplex false>> setpagedevice\n";
+
+  status |= check("no Prolog, no Setup",
+                  "%!PS-Adobe-3.0\r\n%%EndComments\r\n%%Page: 1 1\r\nshowpage\r\n",
+                  "%!PS-Adobe-3.0\r\n%%EndComments\r\n"
+		  "%%BeginProlog\n/bind {} bind def\n%%EndProlog\n"
+		  "%%BeginSetup\n<</Duplex false>> setpagedevice\n%%EndSetup\n"
+		  "%%Page: 1 1\r\nshowpage\r\n", &pp);
+
+ /*
+  * Option code at the start of an existing Setup...
+  */
+
+  pp.prolog_code = NULL;
+
+  status |= check("existing Setup",
+                  "%!PS-Adobe-3.0\n%%BeginProlog\n%%EndProlog\n"
+		  "%%BeginSetup\n/b 2 def\n%%EndSetup\n%%Page: 1 1\nshowpage\n",
+                  "%!PS-Adobe-3.0\n%%BeginProlog\n%%EndProlog\n"
+		  "%%BeginSetup\n<</Duplex false>> setpagedevice\n/b 2 def\n"
+		  "%%EndSetup\n%%Page: 1 1\nshowpage\n", &pp);
+
+ /*
+  * No DSC comments at all...
+  */
+
+  status |= check("no DSC", "%!\n/a 1 def\nshowpage\n",
+                  "%!\n/a 1 def\nshowpage\n", &pp);
+
+ /*
+  * Acrobat Reader's %%Title and %%For...
+  */
+
+  memset(&pp, 0, sizeof(pp));
+  pp.title = "Job Title";
+  pp.user  = "someone";
+
+  status |= check("Acrobat Reader",
+                  "%!PS-Adobe-3.0\n%%Title: garbage\n%%For: garbage\n"
+		  "%%BeginProlog\n%%Title: keep\n%%EndProlog\n",
+                  "%!PS-Adobe-3.0\n%%Title: Job Title\n%%For: someone\n"
+		  "%%BeginProlog\n%%Title: keep\n%%EndProlog\n", &pp);
+
+ /*
+  * Long header lines and a body larger than the buffers...
+  */
+
+  memset(&pp, 0, sizeof(pp));
+
+  input    = malloc(3 * PS_POSTPROC_BUFSIZE + 100000);
+  expected = malloc(3 * PS_POSTPROC_BUFSIZE + 100000);
+
+  strcpy(input, "%!PS-Adobe-3.0\n%");
+  memset(input + 16, 'x', 20000);
+  strcpy(input + 20016, "\n%%BeginProlog\n");
+  strcpy(expected, input);
+  for (i = 0, length = strlen(input); length < 3 * PS_POSTPROC_BUFSIZE; i ++)
+    length += (size_t)sprintf(input + length, "%d %d moveto\n", i, i % 97);
+  strcpy(expected + strlen(expected), input + strlen(expected));
+
+  status |= check("long lines, large body", input, expected, &pp);
+
+  free(input);
+  free(expected);
+
+  if (status)
+    return (status);
+
+  puts("PASS: DSC patching");
+
+ /*
+  * Throughput on a large generated document...
+  */
+
+  if ((fp = tmpfile()) == NULL)
+  {
+    perror("tmpfile");
+    return (1);
+  }
+
+  fputs("%!PS-Adobe-3.0\n%%EndComments\n%%BeginProlog\n%%EndProlog\n", fp);
+  for (i = 0; i < 2000; i ++)
+  {
+    int j;				/* Looping var */
+
+    fprintf(fp, "%%%%Page: %d %d\n", i + 1, i + 1);
+    for (j = 0; j < 2000; j ++)
+      fprintf(fp, "%d %d moveto (Line %d) show\n", 72, 720 - j % 60 * 10, j);
+    fputs("showpage\n", fp);
+  }
+  fputs("%%EOF\n", fp);
+  fflush(fp);
+  bytes = ftell(fp);
+
+  memset(&pp, 0, sizeof(pp));
+  pp.prolog_code = "/bind {} bind def\n";
+  pp.setup_code  = "<</Duplex false>> setpagedevice\n";
+
+  start = get_time();
+  if ((output = run(fp, &pp, &length)) == NULL)
+    return (1);
+  secs = get_time() - start;
+  free(output);
+
+  printf("ps_postproc():       %.0f MB/s\n", bytes / secs / 1048576.0);
+
+ /*
+  * The way every line was copied before...
+  */
+
+  rewind(fp);
+
+  {
+    FILE	*out = tmpfile();	/* Output file */
+
+    start = get_time();
+    while (fgets(line, sizeof(line), fp))
+      fputs(line, out);
+    fflush(out);
+    secs = get_time() - start;
+
+    printf("fgets()/fputs():     %.0f MB/s\n", bytes / secs / 1048576.0);
+
+    fclose(out);
+  }
+
+  fclose(fp);
+
+  return (0);
+}
+
+
+/*
+ * 'bench_file()' - Show the throughput for a file.
+ */
+
+static int				/* O - 0 on success, 1 on error */
+bench_file(const char *filename)	/* I - File to read */
+{
+  FILE		*fp;			/* File */
+  ps_postproc_t	pp;			/* Post-processing */
+  char		*output;		/* Output */
+  size_t	length;			/* Length of output */
+  double	start,			/* Start time */
+		secs;			/* Seconds */
+
+
+  if ((fp = fopen(filename, "rb")) == NULL)
+  {
+    perror(filename);
+    return (1);
+  }
+
+  memset(&pp, 0, sizeof(pp));
+  pp.prolog_code = "/bind {} bind def\n";
+  pp.setup_code  = "<</Duplex false>> setpagedevice\n";
+
+  start = get_time();
+  output = run(fp, &pp, &length);
+  secs = get_time() - start;
+
+  fclose(fp);
+
+  if (!output)
+    return (1);
+
+  free(output);
+
+  printf("%s: %lu bytes in %.3f seconds, %.0f MB/s\n", filename,
+         (unsigned long)length, secs, length / secs / 1048576.0);
+
+  return (0);
+}
+
+
+/*
+ * 'check()' - Post-process a document and compare the result.
+ */
+
+static int				/* O - 0 if as expected, 1 otherwise */
+check(const char          *name,	/* I - Name of test */
+      const char          *input,	/* I - Input document */
+      const char          *expected,	/* I - Expected output */
+      const ps_postproc_t *pp)		/* I - Post-processing */
+{
+  FILE		*fp;			/* Input file */
+  char		*output;		/* Output */
+  size_t	length;			/* Length of output */
+  int		status;			/* Result */
+
+
+  if ((fp = tmpfile()) == NULL)
+  {
+    perror("tmpfile");
+    return (1);
+  }
+
+  fwrite(input, 1, strlen(input), fp);
+  fflush(fp);
+
+  if ((output = run(fp, pp, &length)) == NULL)
+  {
+    fclose(fp);
+    return (1);
+  }
+
+  fclose(fp);
+
+  if ((status = length != strlen(expected) ||
+                memcmp(output, expected, length)) != 0)
+    printf("FAIL: %s\n---- expected:\n%s\n---- got:\n%.*s\n", name, expected,
+           (int)length, output);
+
+  free(output);
+
+  return (status);
+}
+
+
+/*
+ * 'get_time()' - Get the current time in seconds.
+ */
+
+static double				/* O - Time in seconds */
+get_time(void)
+{
+  struct timeval	tv;		/* Current time */
+
+
+  gettimeofday(&tv, NULL);
+
+  return (tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+
+/*
+ * 'run()' - Post-process a file into a temporary file.
+ */
+
+static char *				/* O - Output (malloc'd) or NULL */
+run(FILE                *in,		/* I - Input file */
+    const ps_postproc_t *pp,		/* I - Post-processing */
+    size_t              *length)	/* O - Length of output */
+{
+  FILE		*out;			/* Output file */
+  char		*data;			/* Output data */
+
+
+  if ((out = tmpfile()) == NULL)
+  {
+    perror("tmpfile");
+    return (NULL);
+  }
+
+  lseek(fileno(in), 0, SEEK_SET);
+
+  if (ps_postproc(fileno(in), fileno(out), pp))
+  {
+    puts("FAIL: ps_postproc() returned an error");
+    fclose(out);
+    return (NULL);
+  }
+
+  *length = (size_t)lseek(fileno(out), 0, SEEK_END);
+  lseek(fileno(out), 0, SEEK_SET);
+
+  if ((data = malloc(*length + 1)) == NULL ||
+      read(fileno(out), data, *length) != (ssize_t)*length)
+  {
+    puts("FAIL: Unable to read output");
+    free(data);
+    fclose(out);
+    return (NULL);
+  }
+
+  fclose(out);
+
+  return (data);
+}
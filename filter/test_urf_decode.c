@@ -0,0 +1,529 @@
+/*
+ *   URF decoding test program for CUPS.
+ *
+ *   Compares the pages urf_decode_line() decodes byte for byte with the
+ *   decoder urftopdf used before, which is kept below as reference, on
+ *   generated pages with runs, literal pixels, white line ends, and
+ *   repeated lines, and shows the decoding throughput of both.
+ *
+ *   With URF files as arguments, the throughput of decoding all pages of
+ *   the files is shown instead:
+ *
+ *       test_urf_decode file.urf ...
+ *
+ *   Copyright 2020 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ * Contents:
+ *
+ *   main()         - Run the tests or decode URF files.
+ *   bench_file()   - Show the decoding throughput for a URF file.
+ *   decode_page()  - Decode a page with urf_decode_line().
+ *   get_time()     - Get the current time in seconds.
+ *   ref_decode()   - Decode a page the old way.
+ *   write_page()   - Write a generated page.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "urf-decode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+
+
+/*
+ * Local functions...
+ */
+
+static int	bench_file(const char *filename);
+static int	decode_page(urf_input_t *in, unsigned char *page,
+		            unsigned width, unsigned height,
+			    unsigned pixel_size);
+static double	get_time(void);
+static int	ref_decode(int fd, unsigned char *page, unsigned width,
+		           unsigned height, unsigned pixel_size);
+static void	write_page(FILE *fp, unsigned width, unsigned height,
+		           unsigned pixel_size, int photo);
+
+
+/*
+ * 'main()' - Run the tests or decode URF files.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line args */
+     char *argv[])			/* I - Command-line arguments */
+{
+  static const unsigned	sizes[][2] =	/* Page sizes */
+  {
+    { 1, 1 }, { 7, 5 }, { 129, 40 }, { 300, 257 }, { 2550, 330 }
+  };
+  int			i,		/* Looping var */
+			photo,		/* Generate photo-like pages? */
+			fd,		/* Page file */
+			errors = 0;	/* Number of errors */
+  unsigned		width,		/* Page width */
+			height,		/* Page height */
+			pixel_size;	/* Bytes per pixel */
+  char			filename[] = "/tmp/test_urf_decodeXXXXXX";
+					/* Page file */
+  FILE			*fp;		/* Page file */
+  unsigned char		*page,		/* Decoded page */
+			*ref_page;	/* Reference decoded page */
+  size_t		size;		/* Size of page */
+  urf_input_t		*in;		/* URF data */
+  double		start,		/* Start time */
+			new_time = 0.0,	/* Time of urf_decode_line() */
+			ref_time = 0.0,	/* Time of reference decoder */
+			bytes = 0.0;	/* Bytes decoded */
+
+
+  if (argc > 1)
+  {
+    for (i = 1; i < argc; i ++)
+      errors += bench_file(argv[i]);
+
+    return (errors ? 1 : 0);
+  }
+
+  if ((fd = mkstemp(filename)) < 0 || (fp = fdopen(fd, "w+b")) == NULL)
+  {
+    perror(filename);
+    return (1);
+  }
+
+  unlink(filename);
+
+  in = malloc(sizeof(urf_input_t));
+
+  srand(1);
+
+  for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i ++)
+    for (pixel_size = 1; pixel_size <= 4; pixel_size ++)
+      for (photo = 0; photo < 2; photo ++)
+      {
+        width    = sizes[i][0];
+	height   = sizes[i][1];
+	size     = (size_t)width * height * pixel_size;
+	page     = malloc(size);
+	ref_page = malloc(size);
+
+        if (!in || !page || !ref_page)
+	{
+	  puts("Unable to allocate memory!");
+	  return (1);
+	}
+
+       /*
+        * Write the page and decode it twice...
+	*/
+
+        rewind(fp);
+	if (ftruncate(fileno(fp), 0))
+	  perror(filename);
+        write_page(fp, width, height, pixel_size, photo);
+	fflush(fp);
+
+        memset(page, 0x5a, size);
+        memset(ref_page, 0x5a, size);
+
+        lseek(fd, 0, SEEK_SET);
+	start = get_time();
+	if (ref_decode(fd, ref_page, width, height, pixel_size))
+	{
+	  printf("FAIL: %ux%u, %u bytes per pixel, reference decoder got "
+	         "EOF\n", width, height, pixel_size);
+	  errors ++;
+	}
+	ref_time += get_time() - start;
+
+        lseek(fd, 0, SEEK_SET);
+	start = get_time();
+	urf_init(in, fd);
+	if (decode_page(in, page, width, height, pixel_size))
+	{
+	  printf("FAIL: %ux%u, %u bytes per pixel, urf_decode_line() got "
+	         "EOF\n", width, height, pixel_size);
+	  errors ++;
+	}
+	new_time += get_time() - start;
+
+        bytes += size;
+
+        if (memcmp(page, ref_page, size))
+	{
+	  printf("FAIL: %ux%u, %u bytes per pixel, %s page differs\n", width,
+	         height, pixel_size, photo ? "photo" : "graphics");
+	  errors ++;
+	}
+
+        free(page);
+	free(ref_page);
+      }
+
+  fclose(fp);
+  free(in);
+
+  printf("Reference decoder: %.1f MB/s\n", bytes / ref_time / 1048576.0);
+  printf("urf_decode_line(): %.1f MB/s\n", bytes / new_time / 1048576.0);
+
+  if (errors)
+  {
+    printf("%d errors!\n", errors);
+    return (1);
+  }
+
+  puts("PASS: All pages decoded identically.");
+  return (0);
+}
+
+
+/*
+ * 'bench_file()' - Show the decoding throughput for a URF file.
+ */
+
+static int				/* O - 0 on success, 1 on error */
+bench_file(const char *filename)	/* I - URF file */
+{
+  int		fd,			/* URF file */
+		page,			/* Current page */
+		num_pages;		/* Number of pages */
+  unsigned char	file_header[12],	/* File header */
+		page_header[32],	/* Page header */
+		*data = NULL;		/* Decoded page */
+  unsigned	width,			/* Page width */
+		height,			/* Page height */
+		pixel_size;		/* Bytes per pixel */
+  uint32_t	value;			/* Header value */
+  urf_input_t	*in;			/* URF data */
+  double	start,			/* Start time */
+		secs,			/* Decoding time */
+		bytes = 0.0;		/* Bytes decoded */
+  int		status = 0;		/* Return status */
+
+
+  if ((fd = open(filename, O_RDONLY)) < 0)
+  {
+    perror(filename);
+    return (1);
+  }
+
+  if ((in = malloc(sizeof(urf_input_t))) == NULL)
+  {
+    close(fd);
+    return (1);
+  }
+
+  urf_init(in, fd);
+
+  start = get_time();
+
+  if (urf_read(in, file_header, sizeof(file_header)) != sizeof(file_header) ||
+      memcmp(file_header, "UNIRAST", 7))
+  {
+    printf("%s: Not a URF file.\n", filename);
+    status = 1;
+    num_pages = 0;
+  }
+  else
+  {
+    memcpy(&value, file_header + 8, 4);
+    num_pages = (int)ntohl(value);
+  }
+
+  for (page = 0; page < num_pages; page ++)
+  {
+    if (urf_read(in, page_header, sizeof(page_header)) != sizeof(page_header))
+    {
+      printf("%s: Unable to read header of page %d.\n", filename, page + 1);
+      status = 1;
+      break;
+    }
+
+    pixel_size = page_header[0] / 8;
+    memcpy(&value, page_header + 12, 4);
+    width = ntohl(value);
+    memcpy(&value, page_header + 16, 4);
+    height = ntohl(value);
+
+    free(data);
+
+    if (pixel_size < 1 ||
+        (data = malloc((size_t)width * height * pixel_size)) == NULL)
+    {
+      printf("%s: Bad size of page %d.\n", filename, page + 1);
+      status = 1;
+      break;
+    }
+
+    if (decode_page(in, data, width, height, pixel_size))
+    {
+      printf("%s: Unable to decode page %d.\n", filename, page + 1);
+      status = 1;
+      break;
+    }
+
+    bytes += (double)width * height * pixel_size;
+  }
+
+  secs = get_time() - start;
+
+  if (!status)
+    printf("%s: %d pages, %.1f MB in %.3f seconds, %.1f MB/s\n", filename,
+           num_pages, bytes / 1048576.0, secs, bytes / secs / 1048576.0);
+
+  free(data);
+  free(in);
+  close(fd);
+
+  return (status);
+}
+
+
+/*
+ * 'decode_page()' - Decode a page with urf_decode_line().
+ */
+
+static int				/* O - 0 on success, 1 on EOF */
+decode_page(urf_input_t   *in,		/* I - URF data */
+            unsigned char *page,	/* O - Decoded page */
+	    unsigned      width,	/* I - Page width */
+	    unsigned      height,	/* I - Page height */
+	    unsigned      pixel_size)	/* I - Bytes per pixel */
+{
+  unsigned	y;			/* Current line */
+  int		repeat;			/* Times to repeat line */
+  size_t	line_bytes = (size_t)width * pixel_size;
+					/* Bytes per line */
+
+
+  for (y = 0; y < height;)
+  {
+    if ((repeat = urf_decode_line(in, page + y * line_bytes, width,
+                                  pixel_size)) < 0)
+      return (1);
+
+    for (y ++, repeat --; repeat > 0 && y < height; y ++, repeat --)
+      memcpy(page + y * line_bytes, page + (y - 1) * line_bytes, line_bytes);
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'get_time()' - Get the current time in seconds.
+ */
+
+static double				/* O - Time in seconds */
+get_time(void)
+{
+  struct timeval	curtime;	/* Current time */
+
+
+  gettimeofday(&curtime, NULL);
+
+  return (curtime.tv_sec + 0.000001 * curtime.tv_usec);
+}
+
+
+/*
+ * 'ref_decode()' - Decode a page the old way.
+ *
+ * This is decode_raster() of urftopdf before, reading the file a code
+ * or pixel at a time, with lines past the end of the page dropped.
+ */
+
+static int				/* O - 0 on success, 1 on EOF */
+ref_decode(int           fd,		/* I - URF file */
+           unsigned char *page,		/* O - Decoded page */
+	   unsigned      width,		/* I - Page width */
+	   unsigned      height,	/* I - Page height */
+	   unsigned      pixel_size)	/* I - Bytes per pixel */
+{
+  int		i, j;
+  unsigned	cur_line = 0;
+  unsigned	pos = 0;
+  uint8_t	line_repeat_byte = 0;
+  unsigned	line_repeat = 0;
+  int8_t	packbit_code = 0;
+  uint8_t	pixel_container[8];
+  uint8_t	*line_container = calloc(width, pixel_size);
+
+
+  do
+  {
+    if (read(fd, &line_repeat_byte, 1) < 1)
+    {
+      free(line_container);
+      return (1);
+    }
+
+    line_repeat = (unsigned)line_repeat_byte + 1;
+
+    pos = 0;
+
+    do
+    {
+      if (read(fd, &packbit_code, 1) < 1)
+      {
+        free(line_container);
+	return (1);
+      }
+
+      if (packbit_code == -128)
+      {
+        memset((&line_container[pos * pixel_size]), 0xFF,
+	       (pixel_size * (width - pos)));
+        pos = width;
+        break;
+      }
+      else if (packbit_code >= 0 && packbit_code <= 127)
+      {
+        int n = (packbit_code + 1);
+
+        if (read(fd, &pixel_container[0], pixel_size) < (int)pixel_size)
+	{
+	  free(line_container);
+	  return (1);
+	}
+
+        for (i = 0; i < n; ++i)
+        {
+          for (j = 0; j < (int)pixel_size; ++j)
+            line_container[pixel_size * pos + j] = pixel_container[j];
+          ++pos;
+          if (pos >= width)
+            break;
+        }
+
+        if (pos >= width)
+          break;
+      }
+      else if (packbit_code > -128 && packbit_code < 0)
+      {
+        int n = (-(int)packbit_code) + 1;
+
+        for (i = 0; i < n; ++i)
+        {
+          if (read(fd, &pixel_container[0], pixel_size) < (int)pixel_size)
+	  {
+	    free(line_container);
+	    return (1);
+	  }
+
+          for (j = 0; j < (int)pixel_size; ++j)
+            line_container[pixel_size * pos + j] = pixel_container[j];
+          ++pos;
+          if (pos >= width)
+            break;
+        }
+
+        if (pos >= width)
+          break;
+      }
+    }
+    while (pos < width);
+
+    for (i = 0; i < (int)line_repeat; ++i)
+    {
+      if (cur_line < height)
+        memcpy(page + (size_t)cur_line * width * pixel_size, line_container,
+	       (size_t)width * pixel_size);
+      ++cur_line;
+    }
+  }
+  while (cur_line < height);
+
+  free(line_container);
+
+  return (0);
+}
+
+
+/*
+ * 'write_page()' - Write a generated page.
+ *
+ * Graphics pages have long runs, white line ends, and repeated lines;
+ * photo pages are mostly literal pixels with short runs.  Runs of
+ * repeated pixels sometimes go past the end of a line.
+ */
+
+static void
+write_page(FILE     *fp,		/* I - Page file */
+           unsigned width,		/* I - Page width */
+	   unsigned height,		/* I - Page height */
+	   unsigned pixel_size,		/* I - Bytes per pixel */
+	   int      photo)		/* I - Photo-like page? */
+{
+  unsigned	y,			/* Current line */
+		x,			/* Current pixel */
+		i,			/* Looping var */
+		count,			/* Pixels in run */
+		repeat;			/* Times to repeat line */
+
+
+  for (y = 0; y < height; y += repeat)
+  {
+    if (photo)
+      repeat = (rand() % 16) ? 1 : 2;
+    else
+      repeat = 1 + (rand() % 4 ? 0 : rand() % 40);
+
+    putc(repeat - 1, fp);
+
+    for (x = 0; x < width; x += count)
+    {
+      if (!photo && x > 0 && rand() % 8 == 0)
+      {
+        putc(0x80, fp);			/* White to end of line */
+	break;
+      }
+
+      if (rand() % (photo ? 4 : 2))
+      {
+       /*
+        * Literal pixels, not past the end of the line...
+	*/
+
+        count = 2 + rand() % 127;
+	if (count > width - x)
+	  count = width - x;
+
+        if (count < 2)
+	{
+	  putc(0, fp);			/* Single pixel as a run of one */
+	  count = 1;
+	}
+	else
+	  putc(257 - count, fp);
+
+        for (i = 0; i < count * pixel_size; i ++)
+	  putc(photo ? rand() & 255 : (rand() & 3) * 85, fp);
+      }
+      else
+      {
+       /*
+        * Repeated pixel...
+	*/
+
+        count = 1 + rand() % (photo ? 8 : 128);
+
+        putc(count - 1, fp);
+
+        for (i = 0; i < pixel_size; i ++)
+	  putc(rand() & 255, fp);
+      }
+    }
+  }
+}
@@ -30,6 +30,8 @@
 #include <assert.h>
 #include "fontembed/sfnt.h"
 #include <fontconfig/fontconfig.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /*
  * Globals...
@@ -39,6 +41,195 @@
 int     UTF8 = 1;               /* Use UTF-8 encoding? */
 #endif /* CUPS_1_4 */
 
+/*
+ * Font cache: the font files fontconfig found for font_load() in earlier
+ * jobs, so that fontconfig does not need to be initialized again.  Kept
+ * in $CUPS_CACHEDIR/texttopdf-fonts, one line per font:
+ *
+ *   fontwidth mtime size <TAB> font <TAB> fontname
+ *
+ * An entry is dropped when the font file's mtime or size has changed.
+ */
+
+typedef struct {
+  char *font,*fontname;
+  int  fontwidth;
+  long mtime,size;
+} font_cache_t;
+
+static font_cache_t *FontCache;		/* Cached fonts */
+static int	NumFontCache=-1,	/* Number of cached fonts, -1 = not read */
+		FontCacheChanged;	/* Save the cache? */
+
+static const char *font_cache_filename(char *filename, int len)
+{
+  const char *cachedir=getenv("CUPS_CACHEDIR");
+
+  if ( (!cachedir)||(!*cachedir) ) {
+    return NULL;
+  }
+  snprintf(filename, len, "%s/texttopdf-fonts", cachedir);
+  return filename;
+}
+
+// stat() the font file, without the TTC subfont number
+static int font_cache_stat(const char *fontname, struct stat *st)
+{
+  char *tmp,*end;
+  int ret;
+
+  if (!stat(fontname, st)) {
+    return 0;
+  }
+  if ( (tmp=strrchr(fontname, '/'))==NULL ) {
+    return -1;
+  }
+  strtoul(tmp+1, &end, 10);
+  if ( (*end)||(end==tmp+1) ) {
+    return -1;
+  }
+  tmp=strndup(fontname, tmp-fontname);
+  if (!tmp) {
+    return -1;
+  }
+  ret=stat(tmp, st);
+  free(tmp);
+  return ret;
+}
+
+static void font_cache_append(font_cache_t *entry)
+{
+  font_cache_t *tmp=realloc(FontCache, sizeof(font_cache_t)*(NumFontCache+1));
+
+  if ( (!tmp)||(!entry->font)||(!entry->fontname) ) {
+    free(entry->font);
+    free(entry->fontname);
+    if (tmp) {
+      FontCache=tmp;
+    }
+    return;
+  }
+  FontCache=tmp;
+  FontCache[NumFontCache++]=*entry;
+}
+
+static void font_cache_read(void)
+{
+  char filename[1024],line[4096];
+  FILE *f;
+
+  NumFontCache=0;
+  if ( (!font_cache_filename(filename, sizeof(filename)))||
+       ((f=fopen(filename, "r"))==NULL) ) {
+    return;
+  }
+
+  while (fgets(line, sizeof(line), f)) {
+    font_cache_t entry;
+    char *font,*fontname,*end;
+
+    if ( ((font=strchr(line, '\t'))==NULL)||
+         ((fontname=strchr(font+1, '\t'))==NULL)||
+         ((end=strchr(fontname+1, '\n'))==NULL)||
+         (sscanf(line, "%d%ld%ld", &entry.fontwidth, &entry.mtime, &entry.size)!=3) ) {
+      continue;
+    }
+    *end=0;
+    entry.font=strndup(font+1, fontname-font-1);
+    entry.fontname=strdup(fontname+1);
+    font_cache_append(&entry);
+  }
+  fclose(f);
+}
+
+// returns the cached font file name (malloc'd), or NULL if there is none
+// or it is outdated
+static char *font_cache_lookup(const char *font, int fontwidth)
+{
+  struct stat st;
+  int i;
+
+  if (NumFontCache<0) {
+    font_cache_read();
+  }
+
+  for (i=0; i<NumFontCache; i++) {
+    font_cache_t *entry=&FontCache[i];
+    if ( (entry->fontwidth!=fontwidth)||(strcmp(entry->font, font)) ) {
+      continue;
+    }
+    if ( (font_cache_stat(entry->fontname, &st))||
+         ((long)st.st_mtime!=entry->mtime)||((long)st.st_size!=entry->size) ) {
+      // outdated, drop it
+      free(entry->font);
+      free(entry->fontname);
+      FontCache[i]=FontCache[--NumFontCache];
+      FontCacheChanged=1;
+      return NULL;
+    }
+    return strdup(entry->fontname);
+  }
+  return NULL;
+}
+
+static void font_cache_add(const char *font, int fontwidth, const char *fontname)
+{
+  font_cache_t entry;
+  struct stat st;
+
+  if ( (NumFontCache<0)||(font_cache_stat(fontname, &st))||
+       (strchr(font, '\t'))||(strchr(font, '\n'))||
+       (strchr(fontname, '\t'))||(strchr(fontname, '\n')) ) {
+    return;
+  }
+
+  entry.fontwidth=fontwidth;
+  entry.mtime=st.st_mtime;
+  entry.size=st.st_size;
+  entry.font=strdup(font);
+  entry.fontname=strdup(fontname);
+  font_cache_append(&entry);
+  FontCacheChanged=1;
+}
+
+static void font_cache_save(void)
+{
+  char filename[1024],tempfile[1040];
+  FILE *f;
+  int fd,i;
+
+  if ( (!FontCacheChanged)||
+       (!font_cache_filename(filename, sizeof(filename))) ) {
+    return;
+  }
+  FontCacheChanged=0;
+
+  snprintf(tempfile, sizeof(tempfile), "%s.XXXXXX", filename);
+  if ((fd=mkstemp(tempfile))<0) {
+    fprintf(stderr, "DEBUG: Unable to save font cache %s: %s\n", filename,
+            strerror(errno));
+    return;
+  }
+  if ((f=fdopen(fd, "w"))==NULL) {
+    close(fd);
+    unlink(tempfile);
+    return;
+  }
+
+  for (i=0; i<NumFontCache; i++) {
+    fprintf(f, "%d %ld %ld\t%s\t%s\n",
+            FontCache[i].fontwidth, FontCache[i].mtime, FontCache[i].size,
+            FontCache[i].font, FontCache[i].fontname);
+  }
+
+  // readers only ever see a complete file
+  if ( (fclose(f))||(rename(tempfile, filename)) ) {
+    fprintf(stderr, "DEBUG: Unable to save font cache %s: %s\n", filename,
+            strerror(errno));
+    unlink(tempfile);
+  }
+}
+
 EMB_PARAMS *font_load(const char *font, int fontwidth);
 
 EMB_PARAMS *font_load(const char *font, int fontwidth)
@@ -50,10 +241,13 @@ EMB_PARAMS *font_load(const char *font, int fontwidth)
   FcChar8   *fontname = NULL;
   FcResult   result;
   int i;
+  int found = 0;	/* Found by fontconfig? */
 
   if ( (font[0]=='/')||(font[0]=='.') ) {
     candidates = NULL;
     fontname=(FcChar8 *)strdup(font);
+  } else if ((fontname = (FcChar8 *)font_cache_lookup(font, fontwidth)) != NULL) {
+    fprintf(stderr, "DEBUG: Using cached font %s for %s\n", fontname, font);
   } else {
     FcInit ();
     pattern = FcNameParse ((const FcChar8 *)font);
@@ -86,6 +280,7 @@ EMB_PARAMS *font_load(const char *font, int fontwidth)
       }
       FcFontSetDestroy (candidates);
     }
+    found = 1;
   }
 
   if (!fontname) {
@@ -95,6 +290,9 @@ EMB_PARAMS *font_load(const char *font, int fontwidth)
   }
 
   otf = otf_load((const char *)fontname);
+  if ( (otf)&&(found) ) {
+    font_cache_add(font, fontwidth, (const char *)fontname);
+  }
   free(fontname);
   if (!otf) {
     return NULL;
@@ -222,14 +420,8 @@ WritePage(void)
 {
   int	line;			/* Current line */
 
-  int content=pdfOut_add_xref(pdf);
-  pdfOut_printf(pdf,"%d 0 obj\n"
-                    "<</Length %d 0 R\n"
-                    ">>\n"
-                    "stream\n"
-                    "q\n"
-                    ,content,content+1);
-  long size=-(pdf->filepos-2);
+  pdfOut_begin_stream(pdf);
+  pdfOut_printf(pdf,"q\n");
 
   NumPages ++;
   if (PrettyPrint)
@@ -238,17 +430,9 @@ WritePage(void)
   for (line = 0; line < SizeLines; line ++)
     write_line(line, Page[line]);
 
-  size+=pdf->filepos+2;
-  pdfOut_printf(pdf,"Q\n"
-                    "endstream\n"
-                    "endobj\n");
-  
-  int len_obj=pdfOut_add_xref(pdf);
-  assert(len_obj==content+1);
-  pdfOut_printf(pdf,"%d 0 obj\n"
-                    "%ld\n"
-                    "endobj\n",
-                    len_obj,size);
+  pdfOut_printf(pdf,"Q\n");
+  int content=pdfOut_end_stream(pdf,1); // Flate compressed
+  assert(content);
 
   int obj=pdfOut_add_xref(pdf);
   pdfOut_printf(pdf,"%d 0 obj\n"
@@ -824,6 +1008,8 @@ WriteProlog(const char *title,		/* I - Title of job */
   FontScaleX=120.0 / CharsPerInch;
   FontScaleY=68.0 / LinesPerInch;
 
+  font_cache_save();
+
   // allocate now, for pages to use. will be fixed in epilogue
   FontResource=pdfOut_add_xref(pdf);
 
@@ -1079,6 +1265,11 @@ static void write_font_str(float x,float y,int fontid, lchar_t *str, int len)
   unsigned short		ch;		/* Current character */
   static char	*names[] =	/* Font names */
 		{ "FN","FB","FI","FBI" };
+  static unsigned short	*runchars = NULL,	/* Characters of a run in one font */
+			*rungids = NULL;	/* ... and their glyph ids */
+  static char	*runbytes = NULL;	/* ... as string data */
+  static int	runalloc = 0;		/* Allocated run length */
+  int		i, n;
 
   if (len==-1) {
     for (len=0;str[len].ch;len++);
@@ -1120,33 +1311,58 @@ static void write_font_str(float x,float y,int fontid, lchar_t *str, int len)
                         FontScaleX*100.0/FontScaleY); // TODO?
     }
 
-    pdfOut_printf(pdf,"  /%s%02x %.3f Tf <",
+    pdfOut_printf(pdf,"  /%s%02x %.3f Tf ",
                       names[fontid],lastfont,FontScaleY);
 
-    while (len > 0)
+    if (len > runalloc) {
+      free(runchars);
+      free(rungids);
+      free(runbytes);
+      runalloc = len;
+      runchars = malloc(runalloc * sizeof(unsigned short));
+      rungids = malloc(runalloc * sizeof(unsigned short));
+      runbytes = malloc(runalloc * 2);
+      if (!runchars || !rungids || !runbytes) {
+        fputs("ERROR: Unable to allocate memory for text\n", stderr);
+        exit(1);
+      }
+    }
+
+    // collect the run of characters in this font
+    for (n = 0; n < len; n ++)
     {
       if (UTF8) {
-        ch=str->ch;
+        ch=str[n].ch;
       } else {
-        ch=Chars[str->ch];
+        ch=Chars[str[n].ch];
       }
 
       font = Codes[ch];
       if (lastfont != font) { // only possible, when not used via write_string (e.g. utf-8filename.txt in prettyprint)
         break;
       }
-      if (otf) { // TODO 
-        const unsigned short gid=emb_get(emb,ch);
-        pdfOut_printf(pdf,"%04x", gid);
-      } else { // std 14 font with 7-bit us-ascii uses single byte encoding, TODO
-        pdfOut_printf(pdf,"%02x",ch);
-      }
+      runchars[n] = ch;
+    }
 
-      len --;
-      str ++;
+    if (otf) { // TODO 
+      if (emb_get_str(emb,runchars,n,rungids)!=0) {
+        memset(rungids,0,n * sizeof(unsigned short));
+      }
+      for (i = 0; i < n; i ++) {
+        runbytes[2*i] = rungids[i] >> 8;
+        runbytes[2*i+1] = rungids[i] & 0xff;
+      }
+      pdfOut_putHexString(pdf,runbytes,2*n);
+    } else { // std 14 font with 7-bit us-ascii uses single byte encoding, TODO
+      for (i = 0; i < n; i ++) {
+        runbytes[i] = runchars[i];
+      }
+      pdfOut_putHexString(pdf,runbytes,n);
     }
 
-    pdfOut_printf(pdf,"> Tj\n");
+    pdfOut_printf(pdf," Tj\n");
+    len -= n;
+    str += n;
   }
   pdfOut_printf(pdf,"ET\n");
 }
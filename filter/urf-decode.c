@@ -0,0 +1,233 @@
+/*
+ *   URF (UNIRAST) raster decoding for CUPS.
+ *
+ *   Copyright 2020 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ *
+ *   Each line of a URF page starts with a repeat count byte, followed by
+ *   PackBits-like codes for pixels: 0 to 127 repeat the next pixel 1 to
+ *   128 times, -127 to -1 copy the next 128 to 2 pixels, and -128 fills
+ *   the rest of the line with white.
+ *
+ *   The input is read in large blocks instead of a read() call per code
+ *   or pixel, literal pixels are copied straight from the input buffer,
+ *   and repeated pixels are expanded by doubling memcpy() calls instead
+ *   of byte by byte.
+ *
+ * Contents:
+ *
+ *   urf_decode_line() - Decode the next line of a page.
+ *   urf_init()        - Start reading URF data from a file.
+ *   urf_read()        - Read bytes from the URF data.
+ *   urf_fill()        - Fill the input buffer.
+ *   urf_repeat()      - Repeat the first pixel of a run.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "urf-decode.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/*
+ * Macros...
+ */
+
+#define urf_getc(in)	((in)->pos < (in)->length || urf_fill(in) ? \
+			 (in)->buffer[(in)->pos ++] : -1)
+
+
+/*
+ * Local functions...
+ */
+
+static int	urf_fill(urf_input_t *in);
+static void	urf_repeat(unsigned char *pixels, unsigned pixel_size,
+		           unsigned count);
+
+
+/*
+ * 'urf_decode_line()' - Decode the next line of a page.
+ *
+ * Runs past the end of the line are cut off, like in the original
+ * decoder; the rest of a cut off literal run is not skipped.
+ */
+
+int					/* O - Times to repeat line, -1 on EOF */
+urf_decode_line(urf_input_t   *in,	/* I - URF data */
+                unsigned char *line,	/* O - Decoded line */
+		unsigned      width,	/* I - Width in pixels */
+		unsigned      pixel_size)/* I - Bytes per pixel */
+{
+  int		repeat,			/* Times to repeat line */
+		code;			/* Run code */
+  unsigned	pos,			/* Current pixel */
+		count;			/* Pixels in run */
+  size_t	bytes;			/* Bytes in run */
+
+
+  if ((repeat = urf_getc(in)) < 0)
+    return (-1);
+
+  for (pos = 0; pos < width; pos += count)
+  {
+    if ((code = urf_getc(in)) < 0)
+      return (-1);
+
+    if (code == 0x80)
+    {
+     /*
+      * White for the rest of the line...
+      */
+
+      memset(line + pos * pixel_size, 0xff, (width - pos) * pixel_size);
+      break;
+    }
+    else if (code < 0x80)
+    {
+     /*
+      * Repeated pixel...
+      */
+
+      if ((count = code + 1) > width - pos)
+        count = width - pos;
+
+      if (urf_read(in, line + pos * pixel_size, pixel_size) < pixel_size)
+        return (-1);
+
+      urf_repeat(line + pos * pixel_size, pixel_size, count);
+    }
+    else
+    {
+     /*
+      * Literal pixels...
+      */
+
+      if ((count = 257 - code) > width - pos)
+        count = width - pos;
+
+      bytes = (size_t)count * pixel_size;
+
+      if (urf_read(in, line + pos * pixel_size, bytes) < bytes)
+        return (-1);
+    }
+  }
+
+  return (repeat + 1);
+}
+
+
+/*
+ * 'urf_init()' - Start reading URF data from a file.
+ */
+
+void
+urf_init(urf_input_t *in,		/* I - URF data */
+         int         fd)		/* I - File to read from */
+{
+  in->fd     = fd;
+  in->pos    = 0;
+  in->length = 0;
+}
+
+
+/*
+ * 'urf_read()' - Read bytes from the URF data.
+ */
+
+size_t					/* O - Bytes read */
+urf_read(urf_input_t *in,		/* I - URF data */
+         void        *data,		/* O - Buffer */
+	 size_t      bytes)		/* I - Bytes to read */
+{
+  unsigned char	*ptr = (unsigned char *)data;
+					/* Pointer into buffer */
+  size_t	count,			/* Bytes to copy */
+		total = 0;		/* Bytes read */
+
+
+  while (total < bytes)
+  {
+    if (in->pos >= in->length && !urf_fill(in))
+      break;
+
+    if ((count = in->length - in->pos) > bytes - total)
+      count = bytes - total;
+
+    memcpy(ptr + total, in->buffer + in->pos, count);
+
+    in->pos += count;
+    total   += count;
+  }
+
+  return (total);
+}
+
+
+/*
+ * 'urf_fill()' - Fill the input buffer.
+ */
+
+static int				/* O - 1 on success, 0 on EOF or error */
+urf_fill(urf_input_t *in)		/* I - URF data */
+{
+  ssize_t	bytes;			/* Bytes read */
+
+
+  while ((bytes = read(in->fd, in->buffer, sizeof(in->buffer))) < 0)
+    if (errno != EINTR && errno != EAGAIN)
+      break;
+
+  if (bytes <= 0)
+  {
+    in->pos    = 0;
+    in->length = 0;
+    return (0);
+  }
+
+  in->pos    = 0;
+  in->length = (size_t)bytes;
+
+  return (1);
+}
+
+
+/*
+ * 'urf_repeat()' - Repeat the first pixel of a run.
+ *
+ * The pixels written so far are copied after themselves, doubling the
+ * length of each copy.
+ */
+
+static void
+urf_repeat(unsigned char *pixels,	/* I - Run, starting with the pixel */
+           unsigned      pixel_size,	/* I - Bytes per pixel */
+	   unsigned      count)		/* I - Pixels in run */
+{
+  size_t	done,			/* Bytes written */
+		bytes,			/* Bytes in run */
+		copy;			/* Bytes to copy */
+
+
+  if (pixel_size == 1)
+  {
+    memset(pixels + 1, pixels[0], count - 1);
+    return;
+  }
+
+  for (done = pixel_size, bytes = (size_t)count * pixel_size;
+       done < bytes;
+       done += copy)
+  {
+    if ((copy = done) > bytes - done)
+      copy = bytes - done;
+
+    memcpy(pixels + done, pixels, copy);
+  }
+}
@@ -0,0 +1,53 @@
+/*
+ *   URF (UNIRAST) raster decoding for CUPS.
+ *
+ *   Copyright 2020 by OpenPrinting.
+ *
+ *   Distribution and use rights are outlined in the file "COPYING"
+ *   which should have been included with this file.
+ */
+
+#ifndef _URF_DECODE_H_
+#  define _URF_DECODE_H_
+
+#  include <stddef.h>
+
+#  ifdef __cplusplus
+extern "C" {
+#  endif /* __cplusplus */
+
+
+/*
+ * Size of the input buffer...
+ */
+
+#  define URF_BUFSIZE	65536
+
+
+/*
+ * Types...
+ */
+
+typedef struct urf_input_s		/**** Buffered URF input ****/
+{
+  int		fd;			/* File to read from */
+  size_t	pos,			/* Position in buffer */
+		length;			/* Bytes in buffer */
+  unsigned char	buffer[URF_BUFSIZE];	/* Input buffer */
+} urf_input_t;
+
+
+/*
+ * Prototypes...
+ */
+
+extern int	urf_decode_line(urf_input_t *in, unsigned char *line,
+		                unsigned width, unsigned pixel_size);
+extern void	urf_init(urf_input_t *in, int fd);
+extern size_t	urf_read(urf_input_t *in, void *data, size_t bytes);
+
+#  ifdef __cplusplus
+}
+#  endif /* __cplusplus */
+
+#endif /* !_URF_DECODE_H_ */
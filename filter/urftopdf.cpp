@@ -37,9 +37,10 @@
 #include <qpdf/QUtil.hh>
 
 #include <qpdf/Pl_Flate.hh>
-#include <qpdf/Pl_Buffer.hh>
+#include <qpdf/Pl_StdioFile.hh>
 
 #include "unirast.h"
+#include "urf-decode.h"
 
 #define DEFAULT_PDF_UNIT 72   // 1/72 inch
 
@@ -68,7 +69,8 @@ struct pdf_info
         width(0),height(0),
         pixel_bytes(0),line_bytes(0),
         bpp(0),
-        page_width(0),page_height(0)
+        page_width(0),page_height(0),
+        spool(NULL),image_offset(0)
     {
     }
 
@@ -80,8 +82,13 @@ struct pdf_info
     unsigned pixel_bytes;
     unsigned line_bytes;
     unsigned bpp;
-    PointerHolder<Buffer> page_data;
     double page_width,page_height;
+
+    // page images are Flate-compressed line by line into the spool file
+    FILE *spool;
+    off_t image_offset;
+    PointerHolder<Pl_StdioFile> image_file;
+    PointerHolder<Pl_Flate> image_flate;
 };
 
 int create_pdf_file(struct pdf_info * info, unsigned pagecount)
@@ -94,6 +101,11 @@ int create_pdf_file(struct pdf_info * info, unsigned pagecount)
 
     info->pagecount = pagecount;
 
+    info->spool = tmpfile();
+    if (!info->spool) {
+        return 1;
+    }
+
     return 0;
 }
 
@@ -113,13 +125,40 @@ enum ColorSpace {
     DEVICE_CMYK
 };
 
-#define PRE_COMPRESS
-/* or temporarily store images?
-    if(cupsTempFile2(tempfile_name, 255) == NULL) die("Unable to create a temporary pdf file");
-    iprintf("Created temporary file '%s'\n", tempfile_name);
-*/
+// Provides a compressed page image from the spool file when QPDFWriter
+// writes it, so that no page image is kept in memory until then
+class SpoolProvider : public QPDFObjectHandle::StreamDataProvider {
+public:
+    SpoolProvider(FILE *spool, off_t offset, off_t length)
+      : spool(spool),offset(offset),length(length)
+    {
+    }
+
+    void provideStreamData(int objid, int generation, Pipeline* pipeline);
+private:
+    FILE *spool;
+    off_t offset,length;
+};
+
+void SpoolProvider::provideStreamData(int objid, int generation, Pipeline* pipeline)
+{
+    unsigned char buffer[65536];
+    off_t left = length;
+    size_t bytes;
+
+    if (fseeko(spool, offset, SEEK_SET) != 0) die("Unable to read page image");
+
+    while (left > 0) {
+        bytes = fread(buffer, 1, left < (off_t)sizeof(buffer) ? (size_t)left : sizeof(buffer), spool);
+        if (bytes == 0) die("Unable to read page image");
 
-QPDFObjectHandle makeImage(QPDF &pdf, PointerHolder<Buffer> page_data, unsigned width, unsigned height, ColorSpace cs, unsigned bpc)
+        pipeline->write(buffer, bytes);
+        left -= bytes;
+    }
+    pipeline->finish();
+}
+
+QPDFObjectHandle makeImage(QPDF &pdf, PointerHolder<QPDFObjectHandle::StreamDataProvider> provider, unsigned width, unsigned height, ColorSpace cs, unsigned bpc)
 {
     QPDFObjectHandle ret = QPDFObjectHandle::newStream(&pdf);
 
@@ -143,21 +182,11 @@ QPDFObjectHandle makeImage(QPDF &pdf, PointerHolder<Buffer> page_data, unsigned
 
     ret.replaceDict(QPDFObjectHandle::newDictionary(dict));
 
-#ifdef PRE_COMPRESS
     // we deliver already compressed content (instead of letting QPDFWriter do it), to avoid using excessive memory
-    Pl_Buffer psink("psink");
-    Pl_Flate pflate("pflate",&psink,Pl_Flate::a_deflate);
-    
-    pflate.write(page_data->getBuffer(),page_data->getSize());
-    pflate.finish();
-
 //    /Filter /FlateDecode
 //    /DecodeParms  [<</Predictor 1 /Colors 1[3] /BitsPerComponent $bits /Columns $x>>]  ??
-    ret.replaceStreamData(PointerHolder<Buffer>(psink.getBuffer()),
+    ret.replaceStreamData(provider,
                           QPDFObjectHandle::newName("/FlateDecode"),QPDFObjectHandle::newNull());
-#else
-    ret.replaceStreamData(page_data,QPDFObjectHandle::newNull(),QPDFObjectHandle::newNull());
-#endif
 
     return ret;
 }
@@ -165,10 +194,16 @@ QPDFObjectHandle makeImage(QPDF &pdf, PointerHolder<Buffer> page_data, unsigned
 void finish_page(struct pdf_info * info)
 {
     //Finish previous Page
-    if(!info->page_data.getPointer())
+    if(!info->image_flate.getPointer())
         return;
 
-    QPDFObjectHandle image = makeImage(info->pdf, info->page_data, info->width, info->height, DEVICE_RGB, 8);
+    info->image_flate->finish(); // flushes the spool file as well
+
+    off_t length = ftello(info->spool) - info->image_offset;
+    if (ferror(info->spool) || length < 0) die("Unable to write page image");
+
+    PointerHolder<QPDFObjectHandle::StreamDataProvider> provider(new SpoolProvider(info->spool, info->image_offset, length));
+    QPDFObjectHandle image = makeImage(info->pdf, provider, info->width, info->height, DEVICE_RGB, 8);
     if(!image.isInitialized()) die("Unable to load image data");
 
     // add it
@@ -182,7 +217,8 @@ void finish_page(struct pdf_info * info)
     info->page.getKey("/Contents").replaceStreamData(content,QPDFObjectHandle::newNull(),QPDFObjectHandle::newNull());
 
     // bookkeeping
-    info->page_data = PointerHolder<Buffer>();
+    info->image_flate = PointerHolder<Pl_Flate>();
+    info->image_file = PointerHolder<Pl_StdioFile>();
 }
 
 int add_pdf_page(struct pdf_info * info, int pagen, unsigned width, unsigned height, int bpp, unsigned dpi)
@@ -199,7 +235,10 @@ int add_pdf_page(struct pdf_info * info, int pagen, unsigned width, unsigned hei
         if (info->height > (std::numeric_limits<unsigned>::max() / info->line_bytes)) {
             die("Page too big");
         }
-        info->page_data = PointerHolder<Buffer>(new Buffer(info->line_bytes*info->height));
+        if (fseeko(info->spool, 0, SEEK_END) != 0) die("Unable to write page image");
+        info->image_offset = ftello(info->spool);
+        info->image_file = PointerHolder<Pl_StdioFile>(new Pl_StdioFile("spool", info->spool));
+        info->image_flate = PointerHolder<Pl_Flate>(new Pl_Flate("pflate", info->image_file.getPointer(), Pl_Flate::a_deflate));
 
         QPDFObjectHandle page = QPDFObjectHandle::parse(
             "<<"
@@ -239,20 +278,15 @@ int close_pdf_file(struct pdf_info * info)
         return 1;
     }
 
+    fclose(info->spool);
+    info->spool = NULL;
+
     return 0;
 }
 
-void pdf_set_line(struct pdf_info * info, unsigned line_n, uint8_t line[])
+void pdf_write_line(struct pdf_info * info, uint8_t line[])
 {
-    dprintf("pdf_set_line(%d)\n", line_n);
-
-    if(line_n > info->height)
-    {
-        dprintf("Bad line %d\n", line_n);
-        return;
-    }
-  
-    memcpy((info->page_data->getBuffer()+(line_n*info->line_bytes)), line, info->line_bytes);
+    info->image_flate->write(line, info->line_bytes);
 }
 
 // Data are in network endianness
@@ -275,133 +309,39 @@ struct urf_page_header {
     uint32_t unknown3;
 } __attribute__((__packed__));
 
-int decode_raster(int fd, unsigned width, unsigned height, int bpp, struct pdf_info * info)
+int decode_raster(urf_input_t * in, unsigned width, unsigned height, int bpp, struct pdf_info * info)
 {
     // We should be at raster start
-    int i, j;
     unsigned cur_line = 0;
-    unsigned pos = 0;
-    uint8_t line_repeat_byte = 0;
-    unsigned line_repeat = 0;
-    int8_t packbit_code = 0;
+    int line_repeat;
     int pixel_size = (bpp/8);
-    std::vector<uint8_t> pixel_container;
     std::vector<uint8_t> line_container;
 
     if (width > (std::numeric_limits<unsigned>::max() / pixel_size)) {
         die("Line too big");
     }
     try {
-        pixel_container.resize(pixel_size);
         line_container.resize(pixel_size*width);
     } catch (...) {
         die("Unable to allocate temporary storage");
     }
 
+    // Each line is compressed as soon as it is decoded, repeated lines
+    // are decoded only once
     do
     {
-        if(read(fd, &line_repeat_byte, 1) < 1)
+        if((line_repeat = urf_decode_line(in, &line_container[0], width, pixel_size)) < 0)
         {
-            dprintf("l%06d : line_repeat EOF at %lu\n", cur_line, lseek(fd, 0, SEEK_CUR));
+            dprintf("l%06d : EOF\n", cur_line);
             return 1;
         }
 
-        line_repeat = (unsigned)line_repeat_byte + 1;
-
-        dprintf("l%06d : next actions for %d lines\n", cur_line, line_repeat);
-
-        // Start of line
-        pos = 0;
-
-        do
-        {
-            if(read(fd, &packbit_code, 1) < 1)
-            {
-                dprintf("p%06dl%06d : packbit_code EOF at %lu\n", pos, cur_line, lseek(fd, 0, SEEK_CUR));
-                return 1;
-            }
-
-            dprintf("p%06dl%06d: Raster code %02X='%d'.\n", pos, cur_line, (uint8_t)packbit_code, packbit_code);
-
-            if(packbit_code == -128)
-            {
-                dprintf("\tp%06dl%06d : blank rest of line.\n", pos, cur_line);
-                memset((&line_container[pos*pixel_size]), 0xFF, (pixel_size*(width-pos)));
-                pos = width;
-                break;
-            }
-            else if(packbit_code >= 0 && packbit_code <= 127)
-            {
-                int n = (packbit_code+1);
-
-                //Read pixel
-                if(read(fd, &pixel_container[0], pixel_size) < pixel_size)
-                {
-                    dprintf("p%06dl%06d : pixel repeat EOF at %lu\n", pos, cur_line, lseek(fd, 0, SEEK_CUR));
-                    return 1;
-                }
-
-                dprintf("\tp%06dl%06d : Repeat pixel '", pos, cur_line);
-                for(j = 0 ; j < pixel_size ; ++j)
-                    dprintf("%02X ", pixel_container[j]);
-                dprintf("' for %d times.\n", n);
-
-                for(i = 0 ; i < n ; ++i)
-                {
-                    //for(j = pixel_size-1 ; j >= 0 ; --j)
-                    for(j = 0 ; j < pixel_size ; ++j)
-                        line_container[pixel_size*pos + j] = pixel_container[j];
-                    ++pos;
-                    if(pos >= width)
-                        break;
-                }
-
-                if(i < n && pos >= width)
-                {
-                    dprintf("\tp%06dl%06d : Forced end of line for pixel repeat.\n", pos, cur_line);
-                }
-                
-                if(pos >= width)
-                    break;
-            }
-            else if(packbit_code > -128 && packbit_code < 0)
-            {
-                int n = (-(int)packbit_code)+1;
-
-                dprintf("\tp%06dl%06d : Copy %d verbatim pixels.\n", pos, cur_line, n);
-
-                for(i = 0 ; i < n ; ++i)
-                {
-                    if(read(fd, &pixel_container[0], pixel_size) < pixel_size)
-                    {
-                        dprintf("p%06dl%06d : literal_pixel EOF at %lu\n", pos, cur_line, lseek(fd, 0, SEEK_CUR));
-                        return 1;
-                    }
-                    //Invert pixels, should be programmable
-                    for(j = 0 ; j < pixel_size ; ++j)
-                        line_container[pixel_size*pos + j] = pixel_container[j];
-                    ++pos;
-                    if(pos >= width)
-                        break;
-                }
-
-                if(i < n && pos >= width)
-                {
-                    dprintf("\tp%06dl%06d : Forced end of line for pixel copy.\n", pos, cur_line);
-                }
-                
-                if(pos >= width)
-                    break;
-            }
-        }
-        while(pos < width);
-
         dprintf("\tl%06d : End Of line, drawing %d times.\n", cur_line, line_repeat);
 
-        // write lines
-        for(i = 0 ; i < (int)line_repeat ; ++i)
+        // write lines, but not past the end of the page
+        for( ; line_repeat > 0 && cur_line < height ; --line_repeat)
         {
-            pdf_set_line(info, cur_line, &line_container[0]);
+            pdf_write_line(info, &line_container[0]);
             ++cur_line;
         }
     }
@@ -413,6 +353,7 @@ int decode_raster(int fd, unsigned width, unsigned height, int bpp, struct pdf_i
 int main(int argc, char **argv)
 {
     int fd, page;
+    static urf_input_t in;
     struct urf_file_header head, head_orig;
     struct urf_page_header page_header, page_header_orig;
     struct pdf_info pdf;
@@ -435,8 +376,9 @@ int main(int argc, char **argv)
 
     // Get fd from file
     fd = fileno(input);
+    urf_init(&in, fd);
 
-    if(read(fd, &head_orig, sizeof(head)) == -1) die("Unable to read file header");
+    if(urf_read(&in, &head_orig, sizeof(head)) != sizeof(head)) die("Unable to read file header");
 
     //Transform
     memcpy(head.unirast, head_orig.unirast, sizeof(head.unirast));
@@ -453,7 +395,7 @@ int main(int argc, char **argv)
 
     for(page = 0 ; page < (int)head.page_count ; ++page)
     {
-        if(read(fd, &page_header_orig, sizeof(page_header_orig)) == -1) die("Unable to read page header");
+        if(urf_read(&in, &page_header_orig, sizeof(page_header_orig)) != sizeof(page_header_orig)) die("Unable to read page header");
 
         //Transform
         page_header.bpp = page_header_orig.bpp;
@@ -488,7 +430,7 @@ int main(int argc, char **argv)
 
         if(add_pdf_page(&pdf, page, page_header.width, page_header.height, page_header.bpp, page_header.dot_per_inch) != 0) die("Unable to create PDF file");
 
-        if(decode_raster(fd, page_header.width, page_header.height, page_header.bpp, &pdf) != 0)
+        if(decode_raster(&in, page_header.width, page_header.height, page_header.bpp, &pdf) != 0)
             die("Failed to decode Page");
     }
 
@@ -207,7 +207,10 @@ int emb_embed(EMB_PARAMS *emb,OUTPUT_FN output,void *context) // {{{
         return otf_subset(emb->font->sfnt,emb->subset,output,context);
       } else if (emb->font->sfnt->numTTC) { //
         return otf_ttc_extract(emb->font->sfnt,output,context);
-      } else { // copy verbatim
+      } else if (emb->font->sfnt->map) { // copy verbatim
+        (*output)(emb->font->sfnt->map,emb->font->sfnt->mapsize,context);
+        return emb->font->sfnt->mapsize;
+      } else {
         return copy_file(emb->font->sfnt->f,output,context);
       }
     } else if (emb->outtype==EMB_FMT_OTF) {
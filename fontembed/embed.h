@@ -87,6 +87,20 @@ static inline unsigned short emb_get(EMB_PARAMS *emb,int unicode) // {{{ gid
 }
 // }}}
 
+// like emb_get() for >len BMP code points; gids in >gids. returns 0, or -1 on error
+static inline int emb_get_str(EMB_PARAMS *emb,const unsigned short *unicode,int len,unsigned short *gids) // {{{
+{
+  int iA;
+  if (otf_from_unicode_str(emb->font->sfnt,unicode,len,gids)!=0) {
+    return -1;
+  }
+  for (iA=0;iA<len;iA++) {
+    emb_set(emb,unicode[iA],gids[iA]);
+  }
+  return 0;
+}
+// }}}
+
 #include "embed_pdf.h"
 
 #endif
@@ -4,6 +4,8 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "sfnt_int.h"
 
 // TODO?
@@ -32,38 +34,6 @@ static void otf_bsearch_params(int num, // {{{
 }
 // }}}
 
-static char *otf_bsearch(char *table, // {{{
-                         const char *target,int len,
-                         int searchRange,
-                         int entrySelector,
-                         int rangeShift,
-                         int lower_bound) // return lower_bound, if !=0
-{
-  char *ret=table+rangeShift;
-  if (memcmp(target,ret,len)<0) {
-    ret=table;
-  }
-
-  for (;entrySelector>0;entrySelector--) {
-    searchRange>>=1;
-    ret+=searchRange;
-    if (memcmp(target,ret,len)<0) {
-      ret-=searchRange;
-    }
-  }
-  const int result=memcmp(target,ret,len);
-  if (result==0) {
-    return ret;
-  } else if (lower_bound) {
-    if (result>0) {
-      return ret+searchRange;
-    }
-    return ret;
-  }
-  return NULL; // not found;
-}
-// }}}
-
 static OTF_FILE *otf_new(FILE *f) // {{{
 {
   assert(f);
@@ -73,6 +43,16 @@ static OTF_FILE *otf_new(FILE *f) // {{{
   if (ret) {
     ret->f=f;
     ret->version=0x00010000;
+
+    // map the whole file, if possible; tables are then used in place
+    struct stat st;
+    if ( (fstat(fileno(f),&st)==0)&&(st.st_size>0) ) {
+      void *map=mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fileno(f),0);
+      if (map!=MAP_FAILED) {
+        ret->map=map;
+        ret->mapsize=st.st_size;
+      }
+    }
   }
 
   return ret;
@@ -92,10 +72,17 @@ static char *otf_read(OTF_FILE *otf,char *buf,long pos,int length) // {{{
     return NULL;
   }
 
-  int res=fseek(otf->f,pos,SEEK_SET);
-  if (res==-1) {
-    fprintf(stderr,"Seek failed: %s\n", strerror(errno));
-    return NULL;
+  if (otf->map) {
+    if ( (pos<0)||(pos+length>otf->mapsize) ) {
+      fprintf(stderr,"Short read\n");
+      return NULL;
+    }
+  } else {
+    int res=fseek(otf->f,pos,SEEK_SET);
+    if (res==-1) {
+      fprintf(stderr,"Seek failed: %s\n", strerror(errno));
+      return NULL;
+    }
   }
 
   // (+3)&~3 for checksum...
@@ -108,7 +95,13 @@ static char *otf_read(OTF_FILE *otf,char *buf,long pos,int length) // {{{
     }
   }
 
-  res=fread(buf,1,pad_len,otf->f);
+  if (otf->map) {
+    memcpy(buf,otf->map+pos,length);
+    memset(buf+length,0,pad_len-length);
+    return buf;
+  }
+
+  int res=fread(buf,1,pad_len,otf->f);
   if (res!=pad_len) {
     if (res==length) { // file size not multiple of 4, pad with zero
       memset(buf+res,0,pad_len-length);
@@ -123,6 +116,40 @@ static char *otf_read(OTF_FILE *otf,char *buf,long pos,int length) // {{{
 }
 // }}}
 
+// like otf_get_table(), but returns a pointer into >otf->map, if mapped.
+// release with otf_release_table()
+static char *otf_use_table(OTF_FILE *otf,unsigned int tag,int *ret_len) // {{{
+{
+  assert(otf);
+  assert(ret_len);
+
+  if ( (!otf->map)||(otf->flags&OTF_F_DO_CHECKSUM) ) {
+    return otf_get_table(otf,tag,ret_len);
+  }
+
+  const int idx=otf_find_table(otf,tag);
+  if (idx==-1) {
+    *ret_len=-1;
+    return NULL;
+  }
+  const OTF_DIRENT *table=otf->tables+idx;
+
+  if ((long)table->offset+table->length>otf->mapsize) {
+    fprintf(stderr,"Short read\n");
+    return NULL;
+  }
+  *ret_len=table->length;
+  return (char *)otf->map+table->offset;
+}
+// }}}
+
+static void otf_release_table(OTF_FILE *otf,char *buf) // {{{
+{
+  if ( (!otf->map)||(buf<otf->map)||(buf>=otf->map+otf->mapsize) ) {
+    free(buf);
+  }
+}
+// }}}
 
 static int otf_get_ttc_start(OTF_FILE *otf,int use_ttc) // {{{
 {
@@ -206,14 +233,14 @@ OTF_FILE *otf_do_load(OTF_FILE *otf,int pos) // {{{
 //  otf->flags|=OTF_F_DO_CHECKSUM;
   // {{{ check head table
   int len=0;
-  char *head=otf_get_table(otf,OTF_TAG('h','e','a','d'),&len);
+  char *head=otf_use_table(otf,OTF_TAG('h','e','a','d'),&len);
   if ( (!head)||
        (get_ULONG(head+0)!=0x00010000)||  // version
        (len!=54)||
        (get_ULONG(head+12)!=0x5F0F3CF5)|| // magic
        (get_SHORT(head+52)!=0x0000) ) {   // glyphDataFormat
     fprintf(stderr,"Unsupported OTF font / head table \n");
-    free(head);
+    otf_release_table(otf,head);
     otf_close(otf);
     return NULL;
   }
@@ -235,42 +262,42 @@ OTF_FILE *otf_do_load(OTF_FILE *otf,int pos) // {{{
     }
     if (csum!=0xb1b0afba) {
       fprintf(stderr,"Wrong global checksum\n");
-      free(head);
+      otf_release_table(otf,head);
       otf_close(otf);
       return NULL;
     }
   }
   // }}}
-  free(head);
+  otf_release_table(otf,head);
 
   // {{{ read maxp table / numGlyphs
-  char *maxp=otf_get_table(otf,OTF_TAG('m','a','x','p'),&len);
+  char *maxp=otf_use_table(otf,OTF_TAG('m','a','x','p'),&len);
   if (maxp) {
     const unsigned int maxp_version=get_ULONG(maxp);
     if ( (maxp_version==0x00005000)&&(len==6) ) { // version 0.5
       otf->numGlyphs=get_USHORT(maxp+4);
       if ( (otf->flags&OTF_F_FMT_CFF)==0) { // only CFF
-        free(maxp);
+        otf_release_table(otf,maxp);
         maxp=NULL;
       }
     } else if ( (maxp_version==0x00010000)&&(len==32) ) { // version 1.0
       otf->numGlyphs=get_USHORT(maxp+4);
       if (otf->flags&OTF_F_FMT_CFF) { // only TTF
-        free(maxp);
+        otf_release_table(otf,maxp);
         maxp=NULL;
       }
     } else {
-      free(maxp);
+      otf_release_table(otf,maxp);
       maxp=NULL;
     }
   }
   if (!maxp) {
     fprintf(stderr,"Unsupported OTF font / maxp table \n");
-    free(maxp);
+    otf_release_table(otf,maxp);
     otf_close(otf);
     return NULL;
   }
-  free(maxp);
+  otf_release_table(otf,maxp);
   // }}}
 
   return otf;
@@ -347,11 +374,17 @@ void otf_close(OTF_FILE *otf) // {{{
 {
   assert(otf);
   if (otf) {
-    free(otf->gly);
-    free(otf->cmap);
-    free(otf->name);
-    free(otf->hmtx);
+    if (!otf->map) {
+      free(otf->gly);
+    }
+    otf_release_table(otf,otf->cmap);
+    otf_release_table(otf,otf->name);
+    otf_release_table(otf,otf->hmtx);
     free(otf->glyphOffsets);
+    free(otf->unitab);
+    if (otf->map) {
+      munmap((void *)otf->map,otf->mapsize);
+    }
     fclose(otf->f);
     free(otf->tables);
     free(otf);
@@ -465,7 +498,7 @@ int otf_load_glyf(OTF_FILE *otf) // {{{  - 0 on success
   // }}}
 
   // {{{ read loca table
-  char *loca=otf_get_table(otf,OTF_TAG('l','o','c','a'),&len);
+  char *loca=otf_use_table(otf,OTF_TAG('l','o','c','a'),&len);
   if ( (!loca)||
        (otf->indexToLocFormat>=2)||
        (((len+3)&~3)!=((((otf->numGlyphs+1)*(otf->indexToLocFormat+1)*2)+3)&~3)) ) {
@@ -490,7 +523,7 @@ int otf_load_glyf(OTF_FILE *otf) // {{{  - 0 on success
       otf->glyphOffsets[iA]=get_ULONG(loca+iA*4);
     }
   }
-  free(loca);
+  otf_release_table(otf,loca);
   if (otf->glyphOffsets[otf->numGlyphs]>otf->glyfTable->length) {
     fprintf(stderr,"Bad loca table \n");
     return -1;
@@ -509,6 +542,13 @@ int otf_load_glyf(OTF_FILE *otf) // {{{  - 0 on success
       maxGlyfLen=glyfLen;
     }
   }
+  if (otf->map) { // otf_get_glyph() will point into the map
+    if ((long)otf->glyfTable->offset+otf->glyfTable->length>otf->mapsize) {
+      fprintf(stderr,"Short read\n");
+      return -1;
+    }
+    return 0;
+  }
   if (otf->gly) {
     free(otf->gly);
     assert(0);
@@ -536,7 +576,7 @@ int otf_load_more(OTF_FILE *otf) // {{{  - 0 on success   => hhea,hmtx,name,[gly
   }
 
   // {{{ read hhea table
-  char *hhea=otf_get_table(otf,OTF_TAG('h','h','e','a'),&len);
+  char *hhea=otf_use_table(otf,OTF_TAG('h','h','e','a'),&len);
   if ( (!hhea)||
        (get_ULONG(hhea)!=0x00010000)|| // version
        (len!=36)||
@@ -545,25 +585,25 @@ int otf_load_more(OTF_FILE *otf) // {{{  - 0 on success   => hhea,hmtx,name,[gly
     return -1;
   }
   otf->numberOfHMetrics=get_USHORT(hhea+34);
-  free(hhea);
+  otf_release_table(otf,hhea);
   // }}}
 
   // {{{ read hmtx table
-  char *hmtx=otf_get_table(otf,OTF_TAG('h','m','t','x'),&len);
+  char *hmtx=otf_use_table(otf,OTF_TAG('h','m','t','x'),&len);
   if ( (!hmtx)||
        (len!=otf->numberOfHMetrics*2+otf->numGlyphs*2) ) {
     fprintf(stderr,"Unsupported OTF font / hmtx table \n");
     return -1;
   }
   if (otf->hmtx) {
-    free(otf->hmtx);
+    otf_release_table(otf,otf->hmtx);
     assert(0);
   }
   otf->hmtx=hmtx;
   // }}}
 
   // {{{ read name table
-  char *name=otf_get_table(otf,OTF_TAG('n','a','m','e'),&len);
+  char *name=otf_use_table(otf,OTF_TAG('n','a','m','e'),&len);
   if ( (!name)||
        (get_USHORT(name)!=0x0000)|| // version
        (len<get_USHORT(name+2)*12+6)||
@@ -578,12 +618,12 @@ int otf_load_more(OTF_FILE *otf) // {{{  - 0 on success   => hhea,hmtx,name,[gly
     const char *nrec=name+6+12*iA;
     if (nstore-name+get_USHORT(nrec+10)+get_USHORT(nrec+8)>len) {
       fprintf(stderr,"Bad name table \n");
-      free(name);
+      otf_release_table(otf,name);
       return -1;
     }
   }
   if (otf->name) {
-    free(otf->name);
+    otf_release_table(otf,otf->name);
     assert(0);
   }
   otf->name=name;
@@ -598,7 +638,7 @@ int otf_load_cmap(OTF_FILE *otf) // {{{  - 0 on success
   int iA;
   int len;
 
-  char *cmap=otf_get_table(otf,OTF_TAG('c','m','a','p'),&len);
+  char *cmap=otf_use_table(otf,OTF_TAG('c','m','a','p'),&len);
   if ( (!cmap)||
        (get_USHORT(cmap)!=0x0000)|| // version
        (len<get_USHORT(cmap+2)*8+4) ) {
@@ -616,7 +656,7 @@ int otf_load_cmap(OTF_FILE *otf) // {{{  - 0 on success
          (offset>=len)||
          (offset+get_USHORT(ndata+2)>len) ) {
       fprintf(stderr,"Bad cmap table \n");
-      free(cmap);
+      otf_release_table(otf,cmap);
       assert(0);
       return -1;
     }
@@ -625,10 +665,18 @@ int otf_load_cmap(OTF_FILE *otf) // {{{  - 0 on success
          (get_USHORT(ndata)==4)&&
          (get_USHORT(ndata+4)==0) ) {
       otf->unimap=ndata;
+    } else if ( (get_USHORT(nrec)==3)&&
+                (get_USHORT(nrec+2)==10)&&
+                (get_USHORT(ndata)==12)&&
+                (offset+16<=len)&&
+                (get_ULONG(ndata+4)>=16)&&
+                (get_ULONG(ndata+4)<=len-offset)&&
+                (get_ULONG(ndata+12)<=(get_ULONG(ndata+4)-16)/12) ) {
+      otf->unimap12=ndata;
     }
   }
   if (otf->cmap) {
-    free(otf->cmap);
+    otf_release_table(otf,otf->cmap);
     assert(0);
   }
   otf->cmap=cmap;
@@ -713,7 +761,7 @@ int otf_get_glyph(OTF_FILE *otf,unsigned short gid) // {{{ result in >otf->gly,
   }
 
   // ensure >glyphOffsets and >gly is there
-  if ( (!otf->gly)||(!otf->glyphOffsets) ) {
+  if ( (!otf->glyphOffsets)||((!otf->gly)&&(!otf->map)) ) {
     if (otf_load_more(otf)!=0) {
       assert(0);
       return -1;
@@ -726,6 +774,10 @@ int otf_get_glyph(OTF_FILE *otf,unsigned short gid) // {{{ result in >otf->gly,
   }
 
   assert(otf->glyfTable->length>=otf->glyphOffsets[gid+1]);
+  if (otf->map) {
+    otf->gly=(char *)otf->map+otf->glyfTable->offset+otf->glyphOffsets[gid];
+    return len;
+  }
   if (!otf_read(otf,otf->gly,
                 otf->glyfTable->offset+otf->glyphOffsets[gid],len)) {
     return -1;
@@ -735,53 +787,138 @@ int otf_get_glyph(OTF_FILE *otf,unsigned short gid) // {{{ result in >otf->gly,
 }
 // }}}
 
-unsigned short otf_from_unicode(OTF_FILE *otf,int unicode) // {{{ 0 = missing
+// fill >otf->unitab from the format 4 (or format 12) cmap
+static int otf_load_unitab(OTF_FILE *otf) // {{{  - 0 on success
 {
-  assert(otf);
-  assert( (unicode>=0)&&(unicode<65536) );
-//  assert((otf->flags&OTF_F_FMT_CFF)==0); // not for CFF, other method!
+  int iA;
+  unsigned int iB;
 
   // ensure >cmap and >unimap is there
   if (!otf->cmap) {
     if (otf_load_cmap(otf)!=0) {
       assert(0);
-      return 0; // TODO?
+      return -1;
     }
   }
-  if (!otf->unimap) {
+  if ( (!otf->unimap)&&(!otf->unimap12) ) {
     fprintf(stderr,"Unicode (3,1) cmap in format 4 not found\n");
-    return 0;
+    return -1;
   }
 
-#if 0
-  // linear search is cache friendly and should be quite fast
-#else
-  const unsigned short segCountX2=get_USHORT(otf->unimap+6);
-  char target[]={unicode>>8,unicode}; // set_USHORT(target,unicode);
-  char *result=otf_bsearch((char *)otf->unimap+14,target,2,
-                           get_USHORT(otf->unimap+8),
-                           get_USHORT(otf->unimap+10),
-                           get_USHORT(otf->unimap+12),1);
-  if (result>=otf->unimap+14+segCountX2) { // outside of endCode[segCount]
-    assert(0); // bad font, no 0xffff sentinel
-    return 0;
+  otf->unitab=calloc(0x10000,sizeof(unsigned short));
+  if (!otf->unitab) {
+    fprintf(stderr,"Bad alloc: %s\n", strerror(errno));
+    return -1;
   }
 
-  result+=2+segCountX2; // jump over padding into startCode[segCount]
-  const unsigned short startCode=get_USHORT(result);
-  if (startCode>unicode) {
+  if (otf->unimap) {
+    const char *end=otf->unimap+get_USHORT(otf->unimap+2);
+    const unsigned short segCountX2=get_USHORT(otf->unimap+6);
+    const char *endCode=otf->unimap+14,
+               *startCode=endCode+2+segCountX2, // jump over padding
+               *idDelta=startCode+segCountX2,
+               *idRangeOffset=idDelta+segCountX2;
+    if (idRangeOffset+segCountX2>end) {
+      fprintf(stderr,"Bad cmap table \n");
+      free(otf->unitab);
+      otf->unitab=NULL;
+      return -1;
+    }
+    int next=0; // like the bsearch in otf_from_unicode() did: first segment with endCode>=unicode
+    for (iA=0;iA<segCountX2;iA+=2) {
+      const unsigned short segEnd=get_USHORT(endCode+iA);
+      int unicode=get_USHORT(startCode+iA);
+      if (unicode<next) {
+        unicode=next;
+      }
+      const unsigned short rangeOffset=get_USHORT(idRangeOffset+iA);
+      const short delta=get_SHORT(idDelta+iA);
+      for (;unicode<=segEnd;unicode++) {
+        if (rangeOffset) {
+          // the so called "obscure indexing trick" into glyphIdArray[]
+          // NOTE: this is according to apple spec; microsoft says we must add delta (probably incorrect; fonts probably have delta==0)
+          const char *gid=idRangeOffset+iA+rangeOffset+2*(unicode-get_USHORT(startCode+iA));
+          if (gid+2<=end) {
+            otf->unitab[unicode]=get_USHORT(gid);
+          }
+        } else {
+          otf->unitab[unicode]=(delta+unicode)&0xffff;
+        }
+      }
+      next=segEnd+1;
+    }
+  } else { // BMP part of format 12
+    const int nGroups=get_ULONG(otf->unimap12+12);
+    for (iA=0;iA<nGroups;iA++) {
+      const char *group=otf->unimap12+16+12*iA;
+      const unsigned int first=get_ULONG(group),last=get_ULONG(group+4);
+      if ( (first>0xffff)||(first>last) ) {
+        continue;
+      }
+      for (iB=first;(iB<=last)&&(iB<0x10000);iB++) {
+        const unsigned int gid=get_ULONG(group+8)+(iB-first);
+        otf->unitab[iB]=(gid<otf->numGlyphs)?gid:0;
+      }
+    }
+  }
+
+  return 0;
+}
+// }}}
+
+unsigned short otf_from_unicode(OTF_FILE *otf,int unicode) // {{{ 0 = missing
+{
+  assert(otf);
+  assert( (unicode>=0)&&(unicode<0x110000) );
+//  assert((otf->flags&OTF_F_FMT_CFF)==0); // not for CFF, other method!
+
+  // ensure >unitab is there
+  if (!otf->unitab) {
+    if (otf_load_unitab(otf)!=0) {
+      return 0; // TODO?
+    }
+  }
+
+  if (unicode<0x10000) {
+    return otf->unitab[unicode];
+  } else if (!otf->unimap12) {
     return 0;
   }
-  result+=2*segCountX2;
-  const unsigned short rangeOffset=get_USHORT(result);
-  if (rangeOffset) {
-    return get_USHORT(result+rangeOffset+2*(unicode-startCode)); // the so called "obscure indexing trick" into glyphIdArray[]
-    // NOTE: this is according to apple spec; microsoft says we must add delta (probably incorrect; fonts probably have delta==0)
-  } else {
-    const short delta=get_SHORT(result-segCountX2);
-    return (delta+unicode)&0xffff;
+
+  // sparse above the BMP: bsearch the sorted SequentialMapGroups
+  int lo=0,hi=get_ULONG(otf->unimap12+12);
+  while (lo<hi) {
+    const int mid=(lo+hi)/2;
+    const char *group=otf->unimap12+16+12*mid;
+    if (unicode<get_ULONG(group)) {
+      hi=mid;
+    } else if (unicode>get_ULONG(group+4)) {
+      lo=mid+1;
+    } else {
+      const unsigned int gid=get_ULONG(group+8)+(unicode-get_ULONG(group));
+      return (gid<otf->numGlyphs)?gid:0;
+    }
   }
-#endif
+  return 0;
+}
+// }}}
+
+int otf_from_unicode_str(OTF_FILE *otf,const unsigned short *unicode,int len,unsigned short *gids) // {{{  - 0 on success
+{
+  assert(otf);
+  assert( (unicode)&&(gids) );
+  int iA;
+
+  if (!otf->unitab) {
+    if (otf_load_unitab(otf)!=0) {
+      return -1;
+    }
+  }
+
+  for (iA=0;iA<len;iA++) {
+    gids[iA]=otf->unitab[unicode[iA]];
+  }
+  return 0;
 }
 // }}}
 
@@ -798,6 +935,12 @@ int otf_action_copy(void *param,int table_no,OUTPUT_FN output,void *context) //
 
 // TODO? copy_block(otf->f,table->offset,(table->length+3)&~3,output,context);
 // problem: PS currently depends on single-output.  also checksum not possible
+  // padding included: write directly from the map
+  if ( (otf->map)&&((table->length&3)==0)&&
+       ((long)table->offset+table->length<=otf->mapsize) ) {
+    (*output)(otf->map+table->offset,table->length,context);
+    return table->length;
+  }
   char *data=otf_read(otf,NULL,table->offset,table->length);
   if (!data) {
     return -1;
@@ -12,6 +12,8 @@ typedef struct {
 
 typedef struct {
   FILE *f;
+  const char *map; // whole file, if it could be mmap'ed; else NULL
+  long mapsize;
   unsigned int numTTC,useTTC;
   unsigned int version;
 
@@ -23,13 +25,16 @@ typedef struct {
   unsigned short indexToLocFormat; // 0=short, 1=long
   unsigned short numGlyphs;
 
-  // optionally loaded data
+  // optionally loaded data (point into >map, when mapped)
   unsigned int *glyphOffsets;
   unsigned short numberOfHMetrics;
   char *hmtx,*name,*cmap;
   const char *unimap; // ptr to (3,1) or (3,0) cmap start
+  const char *unimap12; // ptr to (3,10) format 12 cmap start, for >0xffff
+  unsigned short *unitab; // gid for each BMP code point, see otf_from_unicode()
 
-  // single glyf buffer, allocated large enough by otf_load_more()
+  // single glyf buffer, allocated large enough by otf_load_more(),
+  // or the current glyph in >map
   char *gly;
   OTF_DIRENT *glyfTable;
 
@@ -45,12 +50,15 @@ void otf_close(OTF_FILE *otf);
 #define OTF_UNTAG(a)  (((unsigned int)(a)>>24)&0xff),(((unsigned int)(a)>>16)&0xff),\
                       (((unsigned int)(a)>>8)&0xff),(((unsigned int)(a))&0xff)
 
+// returns a malloc'd copy of the table; free() when done
 char *otf_get_table(OTF_FILE *otf,unsigned int tag,int *ret_len);
 
 int otf_get_width(OTF_FILE *otf,unsigned short gid);
 const char *otf_get_name(OTF_FILE *otf,int platformID,int encodingID,int languageID,int nameID,int *ret_len);
 int otf_get_glyph(OTF_FILE *otf,unsigned short gid);
 unsigned short otf_from_unicode(OTF_FILE *otf,int unicode);
+// maps >len BMP code points from >unicode to >gids (may be the same array); returns 0, or -1 on error
+int otf_from_unicode_str(OTF_FILE *otf,const unsigned short *unicode,int len,unsigned short *gids);
 
 #include "bitset.h"
 #include "iofn.h"
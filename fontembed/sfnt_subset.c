@@ -114,6 +114,69 @@ static int otf_subset_glyf(OTF_FILE *otf,int curgid,int donegid,BITSET glyphs) /
 }
 // }}}
 
+static unsigned int otf_checksum_at(const char *buf,int len,int pos) // {{{ - checksum part of >buf at table offset >pos
+{
+  unsigned int ret=0;
+  for (;(len>0)&&(pos&3);len--,pos++,buf++) {
+    ret+=(unsigned char)*buf<<(8*(3-(pos&3)));
+  }
+  for (;len>=4;len-=4,buf+=4) {
+    ret+=get_ULONG(buf);
+  }
+  for (pos=0;len>0;len--,pos++,buf++) {
+    ret+=(unsigned char)*buf<<(8*(3-pos));
+  }
+  return ret;
+}
+// }}}
+
+struct OTF_GLYF_RANGES {
+  OTF_FILE *otf;
+  BITSET glyphs;
+};
+
+// new glyf table, written from the mapped font: one output call per run of consecutive glyphs
+static int otf_action_glyf_ranges(void *param,int length,OUTPUT_FN output,void *context) // {{{
+{
+  struct OTF_GLYF_RANGES *gr=param;
+  OTF_FILE *otf=gr->otf;
+  const char *glyf=otf->map+otf->glyfTable->offset;
+  char pad[4]={0,0,0,0};
+  unsigned int csum=0;
+  int iA,iB,pos=0;
+
+  for (iA=0;iA<otf->numGlyphs;iA=iB) {
+    if (!bit_check(gr->glyphs,iA)) {
+      iB=iA+1;
+      continue;
+    }
+    for (iB=iA+1;(iB<otf->numGlyphs)&&(bit_check(gr->glyphs,iB));iB++) {
+    }
+    const int len=otf->glyphOffsets[iB]-otf->glyphOffsets[iA];
+    if (len>0) {
+      if (output) {
+        (*output)(glyf+otf->glyphOffsets[iA],len,context);
+      } else {
+        csum+=otf_checksum_at(glyf+otf->glyphOffsets[iA],len,pos);
+      }
+      pos+=len;
+    }
+  }
+  assert(pos==length);
+
+  if (!output) { // get checksum and unpadded length
+    *(unsigned int *)context=csum;
+    return length;
+  }
+
+  const int ret=(length+3)&~3;
+  if (ret!=length) {
+    (*output)(pad,ret-length,context);
+  }
+  return ret; // padded length
+}
+// }}}
+
 // TODO: cmap only required in non-CID context
 int otf_subset(OTF_FILE *otf,BITSET glyphs,OUTPUT_FN output,void *context) // {{{ - returns number of bytes written
 {
@@ -149,11 +212,15 @@ int otf_subset(OTF_FILE *otf,BITSET glyphs,OUTPUT_FN output,void *context) // {{
   }
 
   // second pass: calculate new glyf and loca
+  // (with a mapped font, the glyphs are later written directly from the map)
   int locaSize=(otf->numGlyphs+1)*(otf->indexToLocFormat+1)*2;
 
   char *new_loca=malloc(locaSize);
-  char *new_glyf=malloc(glyfSize);
-  if ( (!new_loca)||(!new_glyf) ) {
+  char *new_glyf=NULL;
+  if (!otf->map) {
+    new_glyf=malloc(glyfSize);
+  }
+  if ( (!new_loca)||((!new_glyf)&&(!otf->map)) ) {
     fprintf(stderr,"Bad alloc: %s\n", strerror(errno));
     assert(0);
     free(new_loca);
@@ -177,10 +244,12 @@ int otf_subset(OTF_FILE *otf,BITSET glyphs,OUTPUT_FN output,void *context) // {{
     }
 
     if (glyphs[b]&c) {
-      const int len=otf_get_glyph(otf,iA);
-      assert(len>=0);
-      memcpy(new_glyf+offset,otf->gly,len);
-      offset+=len;
+      if (new_glyf) {
+        const int len=otf_get_glyph(otf,iA);
+        assert(len>=0);
+        memcpy(new_glyf+offset,otf->gly,len);
+      }
+      offset+=otf->glyphOffsets[iA+1]-otf->glyphOffsets[iA];
     }
   }
   // last entry
@@ -191,13 +260,17 @@ int otf_subset(OTF_FILE *otf,BITSET glyphs,OUTPUT_FN output,void *context) // {{
   }
   assert(offset==glyfSize);
 
+  struct OTF_GLYF_RANGES ranges={otf,glyphs};
+
   // determine new tables.
   struct _OTF_WRITE otw[]={ // sorted
     // TODO: cmap only required in non-CID context   or always in CFF
       {OTF_TAG('c','m','a','p'),otf_action_copy,otf,},
       {OTF_TAG('c','v','t',' '),otf_action_copy,otf,},
       {OTF_TAG('f','p','g','m'),otf_action_copy,otf,},
-      {OTF_TAG('g','l','y','f'),otf_action_replace,new_glyf,glyfSize},
+      {OTF_TAG('g','l','y','f'),
+       (new_glyf)?otf_action_replace:otf_action_glyf_ranges,
+       (new_glyf)?(void *)new_glyf:(void *)&ranges,glyfSize},
       {OTF_TAG('h','e','a','d'),otf_action_copy,otf,}, // _copy_head
       {OTF_TAG('h','h','e','a'),otf_action_copy,otf,},
       {OTF_TAG('h','m','t','x'),otf_action_copy,otf,},
@@ -302,6 +375,10 @@ int otf_cff_extract(OTF_FILE *otf,OUTPUT_FN output,void *context) // {{{ - retur
   }
   const OTF_DIRENT *table=otf->tables+idx;
 
+  if ( (otf->map)&&((long)table->offset+table->length<=otf->mapsize) ) {
+    (*output)(otf->map+table->offset,table->length,context);
+    return table->length;
+  }
   return copy_block(otf->f,table->offset,table->length,output,context);
 }
 // }}}
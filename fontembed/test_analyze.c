@@ -129,7 +129,7 @@ void show_glyf(OTF_FILE *otf,int full) // {{{
   assert(otf);
 
   // ensure >glyphOffsets and >gly is there
-  if ( (!otf->gly)||(!otf->glyphOffsets) ) {
+  if (!otf->glyphOffsets) {
     if (otf_load_glyf(otf)!=0) {
       assert(0);
       return;
@@ -140,7 +140,7 @@ void show_glyf(OTF_FILE *otf,int full) // {{{
   int compGlyf=0,zeroGlyf=0;
 
   // {{{ glyf
-  assert(otf->gly);
+  assert( (otf->gly)||(otf->map) );
   for (iA=0;iA<otf->numGlyphs;iA++) {
     int len=otf_get_glyph(otf,iA);
     if (len==0) {
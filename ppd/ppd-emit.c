@@ -29,7 +29,16 @@
  * Local functions...
  */
 
+static int	ppd_collect_cached(ppd_file_t *ppd, ppd_section_t section,
+		                   float min_order, ppd_choice_t ***choices);
 static int	ppd_compare_cparams(ppd_cparam_t *a, ppd_cparam_t *b);
+static char	*ppd_emit_arena(ppd_file_t *ppd, size_t bufsize);
+static ppd_emit_cache_t *ppd_emit_cache(ppd_file_t *ppd);
+static char	*ppd_emit_code(ppd_file_t *ppd, ppd_section_t section,
+		               ppd_choice_t **choices, int count,
+			       char *buffer, size_t bufsize);
+static size_t	ppd_emit_size(ppd_file_t *ppd, ppd_section_t section,
+		              ppd_choice_t **choices, int count);
 static void	ppd_handle_media(ppd_file_t *ppd);
 
 
@@ -75,12 +84,9 @@ ppdCollect2(ppd_file_t    *ppd,		/* I - PPD file data */
 	    float         min_order,	/* I - Minimum OrderDependency value */
             ppd_choice_t  ***choices)	/* O - Pointers to choices */
 {
-  ppd_choice_t	*c;			/* Current choice */
-  ppd_section_t	csection;		/* Current section */
-  float		corder;			/* Current OrderDependency value */
   int		count;			/* Number of choices collected */
-  ppd_choice_t	**collect;		/* Collected choices */
-  float		*orders;		/* Collected order values */
+  ppd_choice_t	**cached,		/* Cached choices */
+		**collect;		/* Collected choices */
 
 
   DEBUG_printf(("ppdCollect2(ppd=%p, section=%d, min_order=%f, choices=%p)",
@@ -95,126 +101,21 @@ ppdCollect2(ppd_file_t    *ppd,		/* I - PPD file data */
   }
 
  /*
-  * Allocate memory for up to N selected choices...
+  * Get the sorted choices from the cache and hand the caller its own copy...
   */
 
-  count = 0;
-  if ((collect = calloc(sizeof(ppd_choice_t *),
-                        (size_t)cupsArrayCount(ppd->marked))) == NULL)
-  {
-    *choices = NULL;
-    return (0);
-  }
-
-  if ((orders = calloc(sizeof(float), (size_t)cupsArrayCount(ppd->marked))) == NULL)
+  if ((count = ppd_collect_cached(ppd, section, min_order, &cached)) == 0 ||
+      (collect = malloc((size_t)count * sizeof(ppd_choice_t *))) == NULL)
   {
     *choices = NULL;
-    free(collect);
     return (0);
   }
 
- /*
-  * Loop through all options and add choices as needed...
-  */
-
-  for (c = (ppd_choice_t *)cupsArrayFirst(ppd->marked);
-       c;
-       c = (ppd_choice_t *)cupsArrayNext(ppd->marked))
-  {
-    csection = c->option->section;
-    corder   = c->option->order;
-
-    if (!strcmp(c->choice, "Custom"))
-    {
-      ppd_attr_t	*attr;		/* NonUIOrderDependency value */
-      float		aorder;		/* Order value */
-      char		asection[17],	/* Section name */
-			amain[PPD_MAX_NAME + 1],
-			aoption[PPD_MAX_NAME];
-					/* *CustomFoo and True */
-
-
-      for (attr = ppdFindAttr(ppd, "NonUIOrderDependency", NULL);
-           attr;
-	   attr = ppdFindNextAttr(ppd, "NonUIOrderDependency", NULL))
-        if (attr->value &&
-	    sscanf(attr->value, "%f%16s%41s%40s", &aorder, asection, amain,
-	           aoption) == 4 &&
-	    !strncmp(amain, "*Custom", 7) &&
-	    !strcmp(amain + 7, c->option->keyword) && !strcmp(aoption, "True"))
-	{
-	 /*
-	  * Use this NonUIOrderDependency...
-	  */
-
-          corder = aorder;
-
-	  if (!strcmp(asection, "DocumentSetup"))
-	    csection = PPD_ORDER_DOCUMENT;
-	  else if (!strcmp(asection, "ExitServer"))
-	    csection = PPD_ORDER_EXIT;
-	  else if (!strcmp(asection, "JCLSetup"))
-	    csection = PPD_ORDER_JCL;
-	  else if (!strcmp(asection, "PageSetup"))
-	    csection = PPD_ORDER_PAGE;
-	  else if (!strcmp(asection, "Prolog"))
-	    csection = PPD_ORDER_PROLOG;
-	  else
-	    csection = PPD_ORDER_ANY;
-
-	  break;
-	}
-    }
-
-    if (csection == section && corder >= min_order)
-    {
-      collect[count] = c;
-      orders[count]  = corder;
-      count ++;
-    }
-  }
-
- /*
-  * If we have more than 1 marked choice, sort them...
-  */
-
-  if (count > 1)
-  {
-    int i, j;				/* Looping vars */
-
-    for (i = 0; i < (count - 1); i ++)
-      for (j = i + 1; j < count; j ++)
-        if (orders[i] > orders[j])
-	{
-	  c          = collect[i];
-	  corder     = orders[i];
-	  collect[i] = collect[j];
-	  orders[i]  = orders[j];
-	  collect[j] = c;
-	  orders[j]  = corder;
-	}
-  }
-
-  free(orders);
-
-  DEBUG_printf(("2ppdCollect2: %d marked choices...", count));
+  memcpy(collect, cached, (size_t)count * sizeof(ppd_choice_t *));
 
- /*
-  * Return the array and number of choices; if 0, free the array since
-  * it isn't needed.
-  */
+  *choices = collect;
 
-  if (count > 0)
-  {
-    *choices = collect;
-    return (count);
-  }
-  else
-  {
-    *choices = NULL;
-    free(collect);
-    return (0);
-  }
+  return (count);
 }
 
 
@@ -251,7 +152,6 @@ ppdEmitAfterOrder(
     float         min_order)		/* I - Lowest OrderDependency */
 {
   char	*buffer;			/* Option code */
-  int	status;				/* Return status */
 
 
  /*
@@ -262,25 +162,20 @@ ppdEmitAfterOrder(
     return (-1);
 
  /*
-  * Get the string...
+  * Get the string into the PPD's output buffer...
   */
 
-  buffer = ppdEmitString(ppd, section, limit ? min_order : 0.0f);
+  ppdEmitSections(ppd, 1, &section, limit ? min_order : 0.0f, NULL, 0,
+                  &buffer);
 
  /*
   * Write it as needed and return...
   */
 
-  if (buffer)
-  {
-    status = fputs(buffer, fp) < 0 ? -1 : 0;
-
-    free(buffer);
-  }
+  if (buffer && *buffer)
+    return (fputs(buffer, fp) < 0 ? -1 : 0);
   else
-    status = 0;
-
-  return (status);
+    return (0);
 }
 
 
@@ -308,16 +203,16 @@ ppdEmitFd(ppd_file_t    *ppd,		/* I - PPD file record */
     return (-1);
 
  /*
-  * Get the string...
+  * Get the string into the PPD's output buffer...
   */
 
-  buffer = ppdEmitString(ppd, section, 0.0);
+  ppdEmitSections(ppd, 1, &section, 0.0, NULL, 0, &buffer);
 
  /*
   * Write it as needed and return...
   */
 
-  if (buffer)
+  if (buffer && *buffer)
   {
     buflength = strlen(buffer);
     bufptr    = buffer;
@@ -342,8 +237,6 @@ ppdEmitFd(ppd_file_t    *ppd,		/* I - PPD file record */
     }
 
     status = bytes < 0 ? -1 : 0;
-
-    free(buffer);
   }
   else
     status = 0;
@@ -587,6 +480,113 @@ ppdEmitJCLEnd(ppd_file_t *ppd,		/* I - PPD file record */
 }
 
 
+/*
+ * 'ppdEmitSections()' - Get the code for marked options of several sections
+ *                       in a single call.
+ *
+ * The code for each of the "num_sections" sections is copied, nul-terminated,
+ * into "buffer" one after another and "strings" receives a pointer to each
+ * of them; sections without code get an empty string.  When "min_order" is
+ * greater than zero only options whose OrderDependency value is greater than
+ * or equal to "min_order" are included.
+ *
+ * When "buffer" is @code NULL@ the strings are stored in a buffer owned by
+ * the PPD file which stays valid until the next ppdEmit* call or ppdClose.
+ * Otherwise nothing is copied and all strings are set to @code NULL@ if
+ * "bufsize" is less than the returned size.
+ *
+ * The marked choices of each section are collected and sorted only once for
+ * a given set of marked options, so calling this once per page is cheap.
+ *
+ * @since cups-filters 1.28.0@
+ */
+
+size_t					/* O - Size of buffer needed, 0 on error */
+ppdEmitSections(
+    ppd_file_t          *ppd,		/* I - PPD file record */
+    int                 num_sections,	/* I - Number of sections */
+    const ppd_section_t *sections,	/* I - Sections to write */
+    float               min_order,	/* I - Lowest OrderDependency */
+    char                *buffer,	/* I - Buffer or @code NULL@ */
+    size_t              bufsize,	/* I - Size of buffer */
+    char                **strings)	/* O - Code for each section */
+{
+  int		i,			/* Looping var */
+		count;			/* Number of choices */
+  ppd_choice_t	**choices;		/* Choices */
+  size_t	total;			/* Size of buffer needed */
+  char		*bufptr,		/* Pointer into buffer */
+		*bufend;		/* End of buffer */
+
+
+  DEBUG_printf(("ppdEmitSections(ppd=%p, num_sections=%d, sections=%p, "
+                "min_order=%f, buffer=%p, bufsize=" CUPS_LLFMT ", strings=%p)",
+		ppd, num_sections, sections, min_order, buffer,
+		CUPS_LLCAST bufsize, strings));
+
+ /*
+  * Range check input...
+  */
+
+  if (!strings || num_sections <= 0)
+    return (0);
+
+  for (i = 0; i < num_sections; i ++)
+    strings[i] = NULL;
+
+  if (!ppd || !sections)
+    return (0);
+
+ /*
+  * Use PageSize or PageRegion as required...
+  */
+
+  ppd_handle_media(ppd);
+
+ /*
+  * Add up the space needed for all sections...
+  */
+
+  for (i = 0, total = 0; i < num_sections; i ++)
+  {
+    if ((count = ppd_collect_cached(ppd, sections[i], min_order,
+                                    &choices)) > 0)
+      total += ppd_emit_size(ppd, sections[i], choices, count);
+    else
+      total ++;
+  }
+
+  if (!buffer)
+  {
+    if ((buffer = ppd_emit_arena(ppd, total)) == NULL)
+      return (0);
+  }
+  else if (bufsize < total)
+    return (total);
+
+ /*
+  * Copy the option code for each section...
+  */
+
+  for (i = 0, bufptr = buffer, bufend = buffer + total; i < num_sections;
+       i ++)
+  {
+    strings[i] = bufptr;
+
+    if ((count = ppd_collect_cached(ppd, sections[i], min_order,
+                                    &choices)) > 0)
+      bufptr = ppd_emit_code(ppd, sections[i], choices, count, bufptr,
+                             (size_t)(bufend - bufptr));
+    else
+      *bufptr = '\0';
+
+    bufptr ++;
+  }
+
+  return (total);
+}
+
+
 /*
  * 'ppdEmitString()' - Get a string containing the code for marked options.
  *
@@ -606,17 +606,10 @@ ppdEmitString(ppd_file_t    *ppd,	/* I - PPD file record */
               ppd_section_t section,	/* I - Section to write */
 	      float         min_order)	/* I - Lowest OrderDependency */
 {
-  int		i, j,			/* Looping vars */
-		count;			/* Number of choices */
+  int		count;			/* Number of choices */
   ppd_choice_t	**choices;		/* Choices */
-  ppd_size_t	*size;			/* Custom page size */
-  ppd_coption_t	*coption;		/* Custom option */
-  ppd_cparam_t	*cparam;		/* Custom parameter */
   size_t	bufsize;		/* Size of string buffer needed */
-  char		*buffer,		/* String buffer */
-		*bufptr,		/* Pointer into buffer */
-		*bufend;		/* End of buffer */
-  struct lconv	*loc;			/* Locale data */
+  char		*buffer;		/* String buffer */
 
 
   DEBUG_printf(("ppdEmitString(ppd=%p, section=%d, min_order=%f)",
@@ -639,138 +632,325 @@ ppdEmitString(ppd_file_t    *ppd,	/* I - PPD file record */
   * Collect the options we need to emit...
   */
 
-  if ((count = ppdCollect2(ppd, section, min_order, &choices)) == 0)
+  if ((count = ppd_collect_cached(ppd, section, min_order, &choices)) == 0)
     return (NULL);
 
  /*
-  * Count the number of bytes that are required to hold all of the
-  * option code...
+  * Allocate memory...
   */
 
-  for (i = 0, bufsize = 1; i < count; i ++)
-  {
-    if (section == PPD_ORDER_JCL)
-    {
-      if (!_ppd_strcasecmp(choices[i]->choice, "Custom") &&
-	  (coption = ppdFindCustomOption(ppd, choices[i]->option->keyword))
-	      != NULL)
-      {
-       /*
-        * Add space to account for custom parameter substitution...
-	*/
-
-        for (cparam = (ppd_cparam_t *)cupsArrayFirst(coption->params);
-	     cparam;
-	     cparam = (ppd_cparam_t *)cupsArrayNext(coption->params))
-	{
-          switch (cparam->type)
-	  {
-	    case PPD_CUSTOM_UNKNOWN :
-	        break;
+  bufsize = ppd_emit_size(ppd, section, choices, count);
 
-	    case PPD_CUSTOM_CURVE :
-	    case PPD_CUSTOM_INVCURVE :
-	    case PPD_CUSTOM_POINTS :
-	    case PPD_CUSTOM_REAL :
-	    case PPD_CUSTOM_INT :
-	        bufsize += 10;
-	        break;
+  DEBUG_printf(("2ppdEmitString: Allocating %d bytes for string...",
+                (int)bufsize));
 
-	    case PPD_CUSTOM_PASSCODE :
-	    case PPD_CUSTOM_PASSWORD :
-	    case PPD_CUSTOM_STRING :
-	        if (cparam->current.custom_string)
-		  bufsize += strlen(cparam->current.custom_string);
-	        break;
-          }
-	}
-      }
-    }
-    else if (section != PPD_ORDER_EXIT)
-    {
-      bufsize += 3;			/* [{\n */
+  if ((buffer = calloc(1, bufsize)) == NULL)
+    return (NULL);
 
-      if ((!_ppd_strcasecmp(choices[i]->option->keyword, "PageSize") ||
-           !_ppd_strcasecmp(choices[i]->option->keyword, "PageRegion")) &&
-          !_ppd_strcasecmp(choices[i]->choice, "Custom"))
-      {
-        DEBUG_puts("2ppdEmitString: Custom size set!");
+ /*
+  * Copy the option code to the buffer and return...
+  */
 
-        bufsize += 37;			/* %%BeginFeature: *CustomPageSize True\n */
-        bufsize += 50;			/* Five 9-digit numbers + newline */
-      }
-      else if (!_ppd_strcasecmp(choices[i]->choice, "Custom") &&
-               (coption = ppdFindCustomOption(ppd,
-	                                      choices[i]->option->keyword))
-	           != NULL)
-      {
-        bufsize += 23 + strlen(choices[i]->option->keyword) + 6;
-					/* %%BeginFeature: *Customkeyword True\n */
+  ppd_emit_code(ppd, section, choices, count, buffer, bufsize);
 
+  return (buffer);
+}
 
-        for (cparam = (ppd_cparam_t *)cupsArrayFirst(coption->params);
-	     cparam;
-	     cparam = (ppd_cparam_t *)cupsArrayNext(coption->params))
-	{
-          switch (cparam->type)
-	  {
-	    case PPD_CUSTOM_UNKNOWN :
-	        break;
 
-	    case PPD_CUSTOM_CURVE :
-	    case PPD_CUSTOM_INVCURVE :
-	    case PPD_CUSTOM_POINTS :
-	    case PPD_CUSTOM_REAL :
-	    case PPD_CUSTOM_INT :
-	        bufsize += 10;
-	        break;
+/*
+ * 'ppd_collect_cached()' - Collect the marked options of a section, reusing
+ *                          the sorted list from the last call if the marked
+ *                          choices did not change since then.
+ *
+ * The returned array belongs to the PPD file and must not be freed.
+ */
 
-	    case PPD_CUSTOM_PASSCODE :
-	    case PPD_CUSTOM_PASSWORD :
-	    case PPD_CUSTOM_STRING :
-		bufsize += 3;
-	        if (cparam->current.custom_string)
-		  bufsize += 4 * strlen(cparam->current.custom_string);
-	        break;
-          }
-	}
-      }
-      else
-        bufsize += 17 + strlen(choices[i]->option->keyword) + 1 +
-	           strlen(choices[i]->choice) + 1;
-					/* %%BeginFeature: *keyword choice\n */
+static int				/* O - Number of options marked */
+ppd_collect_cached(
+    ppd_file_t    *ppd,			/* I - PPD file data */
+    ppd_section_t section,		/* I - Section to collect */
+    float         min_order,		/* I - Minimum OrderDependency value */
+    ppd_choice_t  ***choices)		/* O - Pointers to choices */
+{
+  ppd_emit_cache_t *ec;			/* Emit cache */
+  ppd_choice_t	*c;			/* Current choice */
+  ppd_section_t	csection;		/* Current section */
+  float		corder;			/* Current OrderDependency value */
+  int		count;			/* Number of choices collected */
+  ppd_choice_t	**collect;		/* Collected choices */
+  float		*orders;		/* Collected order values */
 
-      bufsize += 13;			/* %%EndFeature\n */
-      bufsize += 22;			/* } stopped cleartomark\n */
-    }
 
-    if (choices[i]->code)
-      bufsize += strlen(choices[i]->code) + 1;
-    else
-      bufsize += strlen(ppd_custom_code);
+  *choices = NULL;
+
+  if ((int)section < 0 || section > PPD_ORDER_PROLOG ||
+      (ec = ppd_emit_cache(ppd)) == NULL)
+    return (0);
+
+ /*
+  * Use the cached choices if we have them...
+  */
+
+  if (ec->num_choices[section] >= 0 && ec->min_orders[section] == min_order)
+  {
+    DEBUG_printf(("2ppd_collect_cached: %d cached choices...",
+                  ec->num_choices[section]));
+
+    *choices = ec->choices[section];
+    return (ec->num_choices[section]);
   }
 
  /*
-  * Allocate memory...
+  * Allocate memory for up to N selected choices...
   */
 
-  DEBUG_printf(("2ppdEmitString: Allocating %d bytes for string...",
-                (int)bufsize));
+  count = 0;
+  if ((collect = realloc(ec->choices[section],
+                         (size_t)(ec->num_marked + 1) *
+			     sizeof(ppd_choice_t *))) == NULL)
+    return (0);
 
-  if ((buffer = calloc(1, bufsize)) == NULL)
+  ec->choices[section] = collect;
+
+  if ((orders = calloc(sizeof(float), (size_t)(ec->num_marked + 1))) == NULL)
+    return (0);
+
+ /*
+  * Loop through all options and add choices as needed...
+  */
+
+  for (c = (ppd_choice_t *)cupsArrayFirst(ppd->marked);
+       c;
+       c = (ppd_choice_t *)cupsArrayNext(ppd->marked))
+  {
+    csection = c->option->section;
+    corder   = c->option->order;
+
+    if (!strcmp(c->choice, "Custom"))
+    {
+      ppd_attr_t	*attr;		/* NonUIOrderDependency value */
+      float		aorder;		/* Order value */
+      char		asection[17],	/* Section name */
+			amain[PPD_MAX_NAME + 1],
+			aoption[PPD_MAX_NAME];
+					/* *CustomFoo and True */
+
+
+      for (attr = ppdFindAttr(ppd, "NonUIOrderDependency", NULL);
+           attr;
+	   attr = ppdFindNextAttr(ppd, "NonUIOrderDependency", NULL))
+        if (attr->value &&
+	    sscanf(attr->value, "%f%16s%41s%40s", &aorder, asection, amain,
+	           aoption) == 4 &&
+	    !strncmp(amain, "*Custom", 7) &&
+	    !strcmp(amain + 7, c->option->keyword) && !strcmp(aoption, "True"))
+	{
+	 /*
+	  * Use this NonUIOrderDependency...
+	  */
+
+          corder = aorder;
+
+	  if (!strcmp(asection, "DocumentSetup"))
+	    csection = PPD_ORDER_DOCUMENT;
+	  else if (!strcmp(asection, "ExitServer"))
+	    csection = PPD_ORDER_EXIT;
+	  else if (!strcmp(asection, "JCLSetup"))
+	    csection = PPD_ORDER_JCL;
+	  else if (!strcmp(asection, "PageSetup"))
+	    csection = PPD_ORDER_PAGE;
+	  else if (!strcmp(asection, "Prolog"))
+	    csection = PPD_ORDER_PROLOG;
+	  else
+	    csection = PPD_ORDER_ANY;
+
+	  break;
+	}
+    }
+
+    if (csection == section && corder >= min_order)
+    {
+      collect[count] = c;
+      orders[count]  = corder;
+      count ++;
+    }
+  }
+
+ /*
+  * If we have more than 1 marked choice, sort them...
+  */
+
+  if (count > 1)
   {
-    free(choices);
+    int i, j;				/* Looping vars */
+
+    for (i = 0; i < (count - 1); i ++)
+      for (j = i + 1; j < count; j ++)
+        if (orders[i] > orders[j])
+	{
+	  c          = collect[i];
+	  corder     = orders[i];
+	  collect[i] = collect[j];
+	  orders[i]  = orders[j];
+	  collect[j] = c;
+	  orders[j]  = corder;
+	}
+  }
+
+  free(orders);
+
+  DEBUG_printf(("2ppd_collect_cached: %d marked choices...", count));
+
+  ec->num_choices[section] = count;
+  ec->min_orders[section]  = min_order;
+
+  if (count > 0)
+    *choices = collect;
+
+  return (count);
+}
+
+
+/*
+ * 'ppd_compare_cparams()' - Compare the order of two custom parameters.
+ */
+
+static int				/* O - Result of comparison */
+ppd_compare_cparams(ppd_cparam_t *a,	/* I - First parameter */
+                    ppd_cparam_t *b)	/* I - Second parameter */
+{
+  return (a->order - b->order);
+}
+
+
+/*
+ * 'ppd_emit_arena()' - Get the PPD file's output buffer with at least
+ *                      "bufsize" bytes.
+ */
+
+static char *				/* O - Output buffer or @code NULL@ */
+ppd_emit_arena(ppd_file_t *ppd,		/* I - PPD file record */
+               size_t     bufsize)	/* I - Bytes needed */
+{
+  ppd_emit_cache_t *ec;			/* Emit cache */
+  char		*buffer;		/* New buffer */
+
+
+  if ((ec = ppd_emit_cache(ppd)) == NULL)
     return (NULL);
+
+  if (bufsize > ec->bufsize)
+  {
+    if (bufsize < 2 * ec->bufsize)
+      bufsize = 2 * ec->bufsize;
+
+    if ((buffer = realloc(ec->buffer, bufsize)) == NULL)
+      return (NULL);
+
+    ec->buffer  = buffer;
+    ec->bufsize = bufsize;
   }
 
-  bufend = buffer + bufsize - 1;
-  loc    = localeconv();
+  return (ec->buffer);
+}
+
+
+/*
+ * 'ppd_emit_cache()' - Get the emit cache of a PPD file, dropping the
+ *                      collected choices if the marked choices changed.
+ */
+
+static ppd_emit_cache_t *		/* O - Emit cache or @code NULL@ */
+ppd_emit_cache(ppd_file_t *ppd)		/* I - PPD file record */
+{
+  ppd_emit_cache_t *ec;			/* Emit cache */
+  ppd_choice_t	*c,			/* Current choice */
+		**marked;		/* New snapshot array */
+  int		i,			/* Looping var */
+		count,			/* Number of marked choices */
+		changed;		/* Did the marked choices change? */
+
+
+  if ((ec = ppd->emit_cache) == NULL)
+  {
+    if ((ec = calloc(1, sizeof(ppd_emit_cache_t))) == NULL)
+      return (NULL);
+
+    for (i = PPD_ORDER_ANY; i <= PPD_ORDER_PROLOG; i ++)
+      ec->num_choices[i] = -1;
+
+    ppd->emit_cache = ec;
+  }
 
  /*
-  * Copy the option code to the buffer...
+  * Compare the marked choices against the snapshot taken when the cached
+  * choices were collected; choices are only freed by ppdClose, so equal
+  * pointers mean an unchanged marking...
   */
 
-  for (i = 0, bufptr = buffer; i < count; i ++, bufptr += strlen(bufptr))
+  count   = cupsArrayCount(ppd->marked);
+  changed = count != ec->num_marked;
+
+  if (count > ec->alloc_marked)
+  {
+    if ((marked = realloc(ec->marked,
+                          (size_t)count * sizeof(ppd_choice_t *))) == NULL)
+      return (NULL);
+
+    ec->marked       = marked;
+    ec->alloc_marked = count;
+  }
+
+  for (i = 0, c = (ppd_choice_t *)cupsArrayFirst(ppd->marked);
+       c && i < count;
+       i ++, c = (ppd_choice_t *)cupsArrayNext(ppd->marked))
+    if (changed || ec->marked[i] != c)
+    {
+      ec->marked[i] = c;
+      changed       = 1;
+    }
+
+  ec->num_marked = count;
+
+  if (changed)
+  {
+    DEBUG_puts("3ppd_emit_cache: Marked choices changed, flushing cache.");
+
+    for (i = PPD_ORDER_ANY; i <= PPD_ORDER_PROLOG; i ++)
+      ec->num_choices[i] = -1;
+  }
+
+  return (ec);
+}
+
+
+/*
+ * 'ppd_emit_code()' - Copy the code for the given choices to a buffer.
+ *
+ * The buffer must be at least as large as reported by ppd_emit_size().
+ */
+
+static char *				/* O - Pointer to nul at end of code */
+ppd_emit_code(ppd_file_t    *ppd,	/* I - PPD file record */
+              ppd_section_t section,	/* I - Section to write */
+	      ppd_choice_t  **choices,	/* I - Sorted choices */
+	      int           count,	/* I - Number of choices */
+	      char          *buffer,	/* I - String buffer */
+	      size_t        bufsize)	/* I - Size of string buffer */
+{
+  int		i, j;			/* Looping vars */
+  ppd_size_t	*size;			/* Custom page size */
+  ppd_coption_t	*coption;		/* Custom option */
+  ppd_cparam_t	*cparam;		/* Custom parameter */
+  char		*bufptr,		/* Pointer into buffer */
+		*bufend;		/* End of buffer */
+  struct lconv	*loc;			/* Locale data */
+
+
+  bufend = buffer + bufsize - 1;
+  loc    = localeconv();
+
+  for (i = 0, bufptr = buffer; i < count; i ++)
     if (section == PPD_ORDER_JCL)
     {
       if (!_ppd_strcasecmp(choices[i]->choice, "Custom") &&
@@ -1091,26 +1271,136 @@ ppdEmitString(ppd_file_t    *ppd,	/* I - PPD file record */
     }
 
  /*
-  * Nul-terminate, free, and return...
+  * Nul-terminate and return...
   */
 
   *bufptr = '\0';
 
-  free(choices);
-
-  return (buffer);
+  return (bufptr);
 }
 
 
 /*
- * 'ppd_compare_cparams()' - Compare the order of two custom parameters.
+ * 'ppd_emit_size()' - Count the number of bytes that are required to hold
+ *                     all of the option code for the given choices.
  */
 
-static int				/* O - Result of comparison */
-ppd_compare_cparams(ppd_cparam_t *a,	/* I - First parameter */
-                    ppd_cparam_t *b)	/* I - Second parameter */
+static size_t				/* O - Size of buffer needed */
+ppd_emit_size(ppd_file_t    *ppd,	/* I - PPD file record */
+              ppd_section_t section,	/* I - Section to write */
+	      ppd_choice_t  **choices,	/* I - Sorted choices */
+	      int           count)	/* I - Number of choices */
 {
-  return (a->order - b->order);
+  int		i;			/* Looping var */
+  ppd_coption_t	*coption;		/* Custom option */
+  ppd_cparam_t	*cparam;		/* Custom parameter */
+  size_t	bufsize;		/* Size of string buffer needed */
+
+
+  for (i = 0, bufsize = 1; i < count; i ++)
+  {
+    if (section == PPD_ORDER_JCL)
+    {
+      if (!_ppd_strcasecmp(choices[i]->choice, "Custom") &&
+	  (coption = ppdFindCustomOption(ppd, choices[i]->option->keyword))
+	      != NULL)
+      {
+       /*
+        * Add space to account for custom parameter substitution...
+	*/
+
+        for (cparam = (ppd_cparam_t *)cupsArrayFirst(coption->params);
+	     cparam;
+	     cparam = (ppd_cparam_t *)cupsArrayNext(coption->params))
+	{
+          switch (cparam->type)
+	  {
+	    case PPD_CUSTOM_UNKNOWN :
+	        break;
+
+	    case PPD_CUSTOM_CURVE :
+	    case PPD_CUSTOM_INVCURVE :
+	    case PPD_CUSTOM_POINTS :
+	    case PPD_CUSTOM_REAL :
+	    case PPD_CUSTOM_INT :
+	        bufsize += 10;
+	        break;
+
+	    case PPD_CUSTOM_PASSCODE :
+	    case PPD_CUSTOM_PASSWORD :
+	    case PPD_CUSTOM_STRING :
+	        if (cparam->current.custom_string)
+		  bufsize += strlen(cparam->current.custom_string);
+	        break;
+          }
+	}
+      }
+    }
+    else if (section != PPD_ORDER_EXIT)
+    {
+      bufsize += 3;			/* [{\n */
+
+      if ((!_ppd_strcasecmp(choices[i]->option->keyword, "PageSize") ||
+           !_ppd_strcasecmp(choices[i]->option->keyword, "PageRegion")) &&
+          !_ppd_strcasecmp(choices[i]->choice, "Custom"))
+      {
+        DEBUG_puts("2ppdEmitString: Custom size set!");
+
+        bufsize += 37;			/* %%BeginFeature: *CustomPageSize True\n */
+        bufsize += 50;			/* Five 9-digit numbers + newline */
+      }
+      else if (!_ppd_strcasecmp(choices[i]->choice, "Custom") &&
+               (coption = ppdFindCustomOption(ppd,
+	                                      choices[i]->option->keyword))
+	           != NULL)
+      {
+        bufsize += 23 + strlen(choices[i]->option->keyword) + 6;
+					/* %%BeginFeature: *Customkeyword True\n */
+
+
+        for (cparam = (ppd_cparam_t *)cupsArrayFirst(coption->params);
+	     cparam;
+	     cparam = (ppd_cparam_t *)cupsArrayNext(coption->params))
+	{
+          switch (cparam->type)
+	  {
+	    case PPD_CUSTOM_UNKNOWN :
+	        break;
+
+	    case PPD_CUSTOM_CURVE :
+	    case PPD_CUSTOM_INVCURVE :
+	    case PPD_CUSTOM_POINTS :
+	    case PPD_CUSTOM_REAL :
+	    case PPD_CUSTOM_INT :
+	        bufsize += 10;
+	        break;
+
+	    case PPD_CUSTOM_PASSCODE :
+	    case PPD_CUSTOM_PASSWORD :
+	    case PPD_CUSTOM_STRING :
+		bufsize += 3;
+	        if (cparam->current.custom_string)
+		  bufsize += 4 * strlen(cparam->current.custom_string);
+	        break;
+          }
+	}
+      }
+      else
+        bufsize += 17 + strlen(choices[i]->option->keyword) + 1 +
+	           strlen(choices[i]->choice) + 1;
+					/* %%BeginFeature: *keyword choice\n */
+
+      bufsize += 13;			/* %%EndFeature\n */
+      bufsize += 22;			/* } stopped cleartomark\n */
+    }
+
+    if (choices[i]->code)
+      bufsize += strlen(choices[i]->code) + 1;
+    else
+      bufsize += strlen(ppd_custom_code);
+  }
+
+  return (bufsize);
 }
 
 
@@ -263,6 +263,20 @@ ppdClose(ppd_file_t *ppd)		/* I - PPD file record */
   if (ppd->cache)
     ppdCacheDestroy(ppd->cache);
 
+ /*
+  * Free any cached choices and output buffer of ppdEmit*()...
+  */
+
+  if (ppd->emit_cache)
+  {
+    for (i = PPD_ORDER_ANY; i <= PPD_ORDER_PROLOG; i ++)
+      free(ppd->emit_cache->choices[i]);
+
+    free(ppd->emit_cache->marked);
+    free(ppd->emit_cache->buffer);
+    free(ppd->emit_cache);
+  }
+
  /*
   * Free the whole record...
   */
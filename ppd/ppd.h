@@ -394,6 +394,21 @@ struct ppd_cache_s			/**** PPD cache and PWG conversion data ****/
 typedef struct ppd_cache_s ppd_cache_t;
 					/**** PPD cache and mapping data ****/
 
+typedef struct ppd_emit_cache_s		/**** Cached data for ppdEmit*() ****/
+{
+  int		num_marked,		/* Number of choices in snapshot */
+		alloc_marked;		/* Allocated snapshot entries */
+  ppd_choice_t	**marked;		/* Snapshot of the marked choices */
+  int		num_choices[PPD_ORDER_PROLOG + 1];
+					/* Number of collected choices per section, -1 if not collected */
+  float		min_orders[PPD_ORDER_PROLOG + 1];
+					/* Minimum order of collected choices */
+  ppd_choice_t	**choices[PPD_ORDER_PROLOG + 1];
+					/* Sorted choices per section */
+  size_t	bufsize;		/* Size of output buffer */
+  char		*buffer;		/* Output buffer */
+} ppd_emit_cache_t;
+
 typedef struct ppd_file_s		/**** PPD File ****/
 {
   int		language_level;		/* Language level of device */
@@ -459,6 +474,9 @@ typedef struct ppd_file_s		/**** PPD File ****/
 
   /**** New in CUPS 1.5 ****/
   ppd_cache_t	*cache;			/* PPD cache and mapping data @since CUPS 1.5/macOS 10.7@ @private@ */
+
+  /**** New in cups-filters 1.28.0 ****/
+  ppd_emit_cache_t *emit_cache;		/* Sorted marked choices and output buffer @since cups-filters 1.28.0@ @private@ */
 } ppd_file_t;
 
 
@@ -653,6 +671,12 @@ extern const char	*ppdPwgPageSizeForMedia(pwg_media_t *media,
 extern ipp_t		*ppdLoadAttributes(const char *ppdfile,
 					   cups_array_t *docformats);
 
+/**** New in cups-filters 1.28.0: Option code emission without re-collecting ****/
+extern size_t		ppdEmitSections(ppd_file_t *ppd, int num_sections,
+					const ppd_section_t *sections,
+					float min_order, char *buffer,
+					size_t bufsize, char **strings);
+
 
 /*
  * C++ magic...
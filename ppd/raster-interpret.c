@@ -130,7 +130,6 @@ ppdRasterInterpretPPD(
     cups_interpret_cb_t func)		/* I - Optional page header callback (@code NULL@ for none) */
 {
   int		status;			/* Cummulative status */
-  char		*code;			/* Code to run */
   const char	*val;			/* Option value */
   ppd_size_t	*size;			/* Current size */
   float		left,			/* Left position */
@@ -195,6 +194,17 @@ ppdRasterInterpretPPD(
 
   if (ppd)
   {
+    static const ppd_section_t sections[] =
+    {					/* Sections in execution order */
+      PPD_ORDER_DOCUMENT,
+      PPD_ORDER_ANY,
+      PPD_ORDER_PROLOG,
+      PPD_ORDER_PAGE
+    };
+    char	*codes[4];		/* Code for each section */
+    int		i;			/* Looping var */
+
+
    /*
     * Apply any patch code (used to override the defaults...)
     */
@@ -206,29 +216,11 @@ ppdRasterInterpretPPD(
     * Then apply printer options in the proper order...
     */
 
-    if ((code = ppdEmitString(ppd, PPD_ORDER_DOCUMENT, 0.0)) != NULL)
-    {
-      status |= ppdRasterExecPS(h, &preferred_bits, code);
-      free(code);
-    }
-
-    if ((code = ppdEmitString(ppd, PPD_ORDER_ANY, 0.0)) != NULL)
-    {
-      status |= ppdRasterExecPS(h, &preferred_bits, code);
-      free(code);
-    }
-
-    if ((code = ppdEmitString(ppd, PPD_ORDER_PROLOG, 0.0)) != NULL)
-    {
-      status |= ppdRasterExecPS(h, &preferred_bits, code);
-      free(code);
-    }
+    ppdEmitSections(ppd, 4, sections, 0.0, NULL, 0, codes);
 
-    if ((code = ppdEmitString(ppd, PPD_ORDER_PAGE, 0.0)) != NULL)
-    {
-      status |= ppdRasterExecPS(h, &preferred_bits, code);
-      free(code);
-    }
+    for (i = 0; i < 4; i ++)
+      if (codes[i] && *codes[i])
+        status |= ppdRasterExecPS(h, &preferred_bits, codes[i]);
   }
 
  /*
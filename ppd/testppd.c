@@ -535,6 +535,43 @@ main(int  argc,				/* I - Number of command-line arguments */
     if (s)
       free(s);
 
+    fputs("ppdEmitSections (custom size and string): ", stdout);
+    {
+      static const ppd_section_t sections[2] =
+      {					/* Sections to emit */
+        PPD_ORDER_ANY,
+	PPD_ORDER_JCL
+      };
+      char	*codes[2];		/* Code for each section */
+      size_t	needed;			/* Size needed */
+
+
+      if ((needed = ppdEmitSections(ppd, 2, sections, 0.0, buffer, 10,
+                                    codes)) <= 10 || codes[0])
+      {
+        status ++;
+	printf("FAIL (%d bytes needed with short buffer)\n", (int)needed);
+      }
+      else if (needed > sizeof(buffer) ||
+               ppdEmitSections(ppd, 2, sections, 0.0, buffer, sizeof(buffer),
+	                       codes) != needed ||
+	       !codes[0] || strcmp(codes[0], custom_code) ||
+	       !codes[1] || codes[1][0])
+      {
+        status ++;
+	printf("FAIL (got \"%s\")\n", codes[0] ? codes[0] : "(null)");
+      }
+      else if (!ppdEmitSections(ppd, 2, sections, 0.0, NULL, 0, codes) ||
+               !codes[0] || strcmp(codes[0], custom_code))
+      {
+        status ++;
+	printf("FAIL (got \"%s\" from PPD buffer)\n",
+	       codes[0] ? codes[0] : "(null)");
+      }
+      else
+        puts("PASS");
+    }
+
    /*
     * Test constraints...
     */
@@ -153,6 +153,7 @@ static int  ldap_rebind_proc(LDAP *RebindLDAPHandle,
 #define REMOTE_DEFAULT_PRINTER_FILE "/cups-browsed-remote-default-printer"
 #define SAVE_OPTIONS_FILE "/cups-browsed-options-%s"
 #define DEBUG_LOG_FILE "/cups-browsed_log"
+#define UI_STRINGS_CACHE_FILE "/cups-browsed-ui-strings"
 
 /* Status of remote printer */
 typedef enum printer_status_e {
@@ -485,6 +486,7 @@ static char logdir[1024];
 static char local_default_printer_file[2048];
 static char remote_default_printer_file[2048];
 static char save_options_file[2048];
+static char ui_strings_cache_file[2048];
 static char debug_log_file[2048];
 
 /*Contains ppd keywords which are written by ppdgenerator.c in the ppd file.*/
@@ -12140,6 +12142,14 @@ int main(int argc, char*argv[]) {
   strncpy(debug_log_file + strlen(logdir),
 	  DEBUG_LOG_FILE,
 	  sizeof(debug_log_file) - strlen(logdir) - 1);
+#ifdef HAVE_CUPS_1_6
+  /* Keep the PPD generator's compiled UI string catalog in the cache
+     directory, so that CUPS' message catalog gets only parsed when it
+     changes */
+  snprintf(ui_strings_cache_file, sizeof(ui_strings_cache_file), "%s%s",
+	   cachedir, UI_STRINGS_CACHE_FILE);
+  ppdgeneratorSetStringsCache(ui_strings_cache_file);
+#endif /* HAVE_CUPS_1_6 */
   if (debug_logfile == 1)
     start_debug_logging();
 